@@ -0,0 +1,111 @@
+#!/usr/bin/env bash
+# Copyright © 2026 The VTE developers
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 2 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License along
+# with this program; if not, write to the Free Software Foundation, Inc.,
+# 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+# Generates the fixed input the parser-cat and decoder-cat benchmarks
+# run over, so that results are comparable between releases.
+#
+# Usage: corpus.sh NAME [REPEAT]
+#
+# The output only depends on NAME and REPEAT: random.sh is replaced by
+# a seeded PRNG, and vim.sh, which needs vim and a terminal, by a replay
+# of the cursor movement and scrolling it does over UTF-8-demo.txt.
+
+set -e
+
+cd "`dirname "$0"`"
+
+name="$1"
+repeat="${2:-1}"
+
+random() {
+  # Park-Miller; exact with the doubles awk uses for numbers
+  LC_ALL=C awk 'BEGIN {
+    x = 1
+    for (i = 0; i < 512 * 4096; i++) {
+      x = (x * 16807) % 2147483647
+      printf "%c", int(x / 65536) % 256
+    }
+  }'
+  printf '\ec'
+}
+
+sgr() {
+  bash sgr-test.sh 1 2 3 4 7 9 53 1+7 4:3+58:5:9
+}
+
+colors256() {
+  bash 256test.sh -colon
+  bash 256test.sh -semicolon
+}
+
+utf8() {
+  cat UTF-8-demo.txt
+}
+
+# Lines of 40 wide characters, from @first on, cycling through @count
+wide() {
+  LC_ALL=C awk -v first="$1" -v count="$2" 'function utf8(c) {
+    if (c < 65536)
+      return sprintf("%c%c%c", 224 + int(c / 4096), 128 + int(c / 64) % 64, 128 + c % 64)
+    return sprintf("%c%c%c%c", 240 + int(c / 262144), 128 + int(c / 4096) % 64,
+                   128 + int(c / 64) % 64, 128 + c % 64)
+  }
+  BEGIN {
+    for (i = 0; i < 4096; i++) {
+      line = ""
+      for (j = 0; j < 40; j++)
+        line = line utf8(first + (i * 40 + j) % count)
+      printf "%s\r\n", line
+    }
+  }'
+}
+
+cjk() {
+  wide 19968 2048
+}
+
+emoji() {
+  wide 128512 80
+}
+
+vim() {
+  local rows=24 row=0 n=0
+  printf '\e[?1049h\e[H\e[2J\e[1;%dr' $((rows - 1))
+  while IFS= read -r line; do
+    if [ $row -lt $((rows - 1)) ]; then
+      row=$((row + 1))
+      printf '\e[%d;1H\e[K%s' $row "$line"
+    else
+      printf '\e[%d;1H\n\e[K%s' $((rows - 1)) "$line"
+    fi
+    n=$((n + 1))
+    printf '\e7\e[%d;1H\e[7m\e[K%s\e[%dG%d,1\e[27m\e8' $rows "UTF-8-demo.txt" 60 $n
+  done < UTF-8-demo.txt
+  printf '\e[r\e[?1049l'
+}
+
+case "$name" in
+  random|sgr|colors256|utf8|cjk|emoji|vim) ;;
+  *)
+    echo "Usage: ${0##*/} random|sgr|colors256|utf8|cjk|emoji|vim [REPEAT]" >&2
+    exit 1
+    ;;
+esac
+
+for (( i = 0; i < repeat; i++ )); do
+  "$name"
+done
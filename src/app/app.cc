@@ -61,6 +61,7 @@ public:
         gboolean no_shell{false};
         gboolean object_notifications{false};
         gboolean reverse{false};
+        gboolean spawn_helper{false};
         gboolean test_mode{false};
         gboolean version{false};
         gboolean whole_window_transparent{false};
@@ -71,6 +72,7 @@ public:
         bool hl_bg_color_set{false};
         bool hl_fg_color_set{false};
         cairo_extend_t background_extend{CAIRO_EXTEND_NONE};
+        char* benchmark_filename{nullptr};
         char* command{nullptr};
         char* encoding{nullptr};
         char* font_string{nullptr};
@@ -88,6 +90,8 @@ public:
         GdkRGBA cursor_fg_color{};
         GdkRGBA hl_bg_color{};
         GdkRGBA hl_fg_color{};
+        int benchmark_frames{0};
+        int benchmark_repeat{1};
         int cjk_ambiguous_width{1};
         int extra_margin{-1};
         int scrollback_lines{-1 /* infinite */};
@@ -101,6 +105,7 @@ public:
 
         ~Options() {
                 g_clear_object(&background_pixbuf);
+                g_free(benchmark_filename);
                 g_free(command);
                 g_free(encoding);
                 g_free(font_string);
@@ -339,6 +344,8 @@ public:
                           "Set background image from file", "FILE" },
                         { "background-extend", 0, 0, G_OPTION_ARG_CALLBACK, (void*)parse_background_extend,
                           "Set background image extend", "EXTEND" },
+                        { "benchmark", 0, 0, G_OPTION_ARG_FILENAME, &benchmark_filename,
+                          "Feed the recorded output in FILE instead of spawning, report the statistics and exit", "FILE" },
                         { "blink", 0, 0, G_OPTION_ARG_CALLBACK, (void*)parse_text_blink,
                           "Text blink mode (never|focused|unfocused|always)", "MODE" },
                         { "bold-is-bright", 'B', 0, G_OPTION_ARG_NONE, &bold_is_bright,
@@ -371,6 +378,8 @@ public:
                           "Specify a font to use", nullptr },
                         { "foreground-color", 0, 0, G_OPTION_ARG_CALLBACK, (void*)parse_fg_color,
                           "Set default foreground color", "COLOR" },
+                        { "frames", 0, 0, G_OPTION_ARG_INT, &benchmark_frames,
+                          "Report the statistics and exit after painting N frames", "N" },
                         { "geometry", 'g', 0, G_OPTION_ARG_STRING, &geometry,
                           "Set the size (in characters) and position", "GEOMETRY" },
                         { "highlight-background-color", 0, 0, G_OPTION_ARG_CALLBACK, (void*)parse_hl_bg_color,
@@ -407,10 +416,14 @@ public:
                           "Print VteTerminal object notifications", nullptr },
                         { "output-file", 0, 0, G_OPTION_ARG_FILENAME, &output_filename,
                           "Save terminal contents to file at exit", nullptr },
+                        { "repeat", 0, 0, G_OPTION_ARG_INT, &benchmark_repeat,
+                          "Feed the benchmark file N times", "N" },
                         { "reverse", 0, 0, G_OPTION_ARG_NONE, &reverse,
                           "Reverse foreground/background colors", nullptr },
                         { "scrollback-lines", 'n', 0, G_OPTION_ARG_INT, &scrollback_lines,
                           "Specify the number of scrollback-lines (-1 for infinite)", nullptr },
+                        { "spawn-helper", 0, 0, G_OPTION_ARG_NONE, &spawn_helper,
+                          "Spawn the child from the spawn helper process", nullptr },
                         { "transparent", 'T', 0, G_OPTION_ARG_INT, &transparency_percent,
                           "Enable the use of a transparent background", "0..100" },
                         { "verbose", 'v', G_OPTION_FLAG_NO_ARG, G_OPTION_ARG_CALLBACK,
@@ -962,6 +975,16 @@ struct _VteappWindow {
         int cached_chrome_height{0};
         int cached_csd_width{0};
         int cached_csd_height{0};
+
+        /* used for --benchmark and --frames */
+        guint benchmark_tick_id{0};
+        gint64 benchmark_start_time{0};
+        gint64 benchmark_last_frame_time{0};
+        guint64 benchmark_fed_bytes{0};
+        guint64 benchmark_parsed_bytes{0};
+        guint64 benchmark_peak_memory{0};
+        guint64 benchmark_peak_stream{0};
+        GArray* benchmark_frame_us{nullptr};
 };
 
 struct _VteappWindowClass {
@@ -1206,7 +1229,8 @@ vteapp_window_launch_argv(VteappWindow* window,
                                  options.working_directory,
                                  argv,
                                  options.environment,
-                                 G_SPAWN_SEARCH_PATH_FROM_ENVP,
+                                 GSpawnFlags(G_SPAWN_SEARCH_PATH_FROM_ENVP |
+                                             (options.spawn_helper ? VTE_SPAWN_USE_HELPER : 0)),
                                  nullptr, nullptr, nullptr, /* child setup, data and destroy */
                                  30 * 1000 /* 30s timeout */,
                                  nullptr /* cancellable */,
@@ -1293,13 +1317,118 @@ vteapp_window_fork(VteappWindow* window,
         return true;
 }
 
+static void
+vteapp_window_benchmark_report(VteappWindow* window)
+{
+        if (window->benchmark_tick_id == 0)
+                return;
+
+        gtk_widget_remove_tick_callback(GTK_WIDGET(window->terminal), window->benchmark_tick_id);
+        window->benchmark_tick_id = 0;
+
+        auto const elapsed = g_get_monotonic_time() - window->benchmark_start_time;
+        auto const bytes = std::max(window->benchmark_fed_bytes, window->benchmark_parsed_bytes);
+        auto const frame_us = window->benchmark_frame_us;
+        auto const n_frames = frame_us->len;
+
+        auto mean = 0.0;
+        auto p99 = gint64{0};
+        if (n_frames != 0) {
+                auto const v = &g_array_index(frame_us, gint64, 0);
+                std::sort(v, v + n_frames);
+                for (auto i = 0u; i < n_frames; ++i)
+                        mean += v[i];
+                mean /= n_frames;
+                p99 = v[std::min(n_frames - 1, n_frames * 99 / 100)];
+        }
+
+        g_print("%" G_GUINT64_FORMAT " bytes in %.3fs: %.2f MB/s\n"
+                "%u frames painted, frame time mean %.0fus p99 %" G_GINT64_FORMAT "us\n"
+                "peak memory %.1f MiB, scrollback %.1f MiB\n",
+                bytes, elapsed / 1e6, elapsed > 0 ? bytes / double(elapsed) : 0.,
+                n_frames, mean, p99,
+                window->benchmark_peak_memory / 1048576., window->benchmark_peak_stream / 1048576.);
+}
+
+static gboolean
+window_benchmark_tick_cb(GtkWidget* widget,
+                         GdkFrameClock* frame_clock,
+                         void* data)
+{
+        auto window = VTEAPP_WINDOW(data);
+
+        /* The terminal only keeps the last frames, so collect the new ones on each tick */
+        auto n_frames = gsize{0};
+        auto frames = vte_terminal_get_frame_stats(window->terminal, &n_frames);
+        for (auto i = gsize{0}; i < n_frames; ++i) {
+                if (frames[i].time <= window->benchmark_last_frame_time)
+                        continue;
+
+                window->benchmark_last_frame_time = frames[i].time;
+                window->benchmark_parsed_bytes += frames[i].bytes_parsed;
+                g_array_append_val(window->benchmark_frame_us, frames[i].frame_us);
+        }
+        g_free(frames);
+
+        auto stats = VteMemoryStats{};
+        vte_terminal_get_memory_stats(window->terminal, &stats);
+        auto const memory = stats.ring_bytes + stats.row_cache_bytes + stats.hyperlink_bytes +
+                stats.unistr_bytes + stats.bidi_bytes + stats.image_bytes +
+                stats.incoming_bytes + stats.outgoing_bytes;
+        window->benchmark_peak_memory = std::max(window->benchmark_peak_memory, memory);
+        window->benchmark_peak_stream = std::max(window->benchmark_peak_stream, stats.stream_bytes);
+
+        if ((options.benchmark_frames > 0 &&
+             window->benchmark_frame_us->len >= guint(options.benchmark_frames)) ||
+            (options.benchmark_filename != nullptr && stats.incoming_bytes == 0)) {
+                vteapp_window_benchmark_report(window);
+                if (!options.keep)
+                        gtk_widget_destroy(GTK_WIDGET(window));
+                return G_SOURCE_REMOVE;
+        }
+
+        return G_SOURCE_CONTINUE;
+}
+
+static bool
+vteapp_window_launch_benchmark(VteappWindow* window,
+                               GError** error)
+{
+        auto file = g_file_new_for_commandline_arg(options.benchmark_filename);
+        auto bytes = g_file_load_bytes(file, nullptr, nullptr, error);
+        g_object_unref(file);
+        if (bytes == nullptr)
+                return false;
+
+        /* The terminal processes the data as it would the child's output,
+         * painting frames in between, and keeps a reference instead of a copy.
+         */
+        for (auto i = 0; i < std::max(options.benchmark_repeat, 1); ++i) {
+                vte_terminal_feed_bytes(window->terminal, bytes);
+                window->benchmark_fed_bytes += g_bytes_get_size(bytes);
+        }
+
+        g_bytes_unref(bytes);
+        return true;
+}
+
 static void
 vteapp_window_launch(VteappWindow* window)
 {
         auto rv = bool{};
         auto error = vte::glib::Error{};
 
-        if (options.exec_argv != nullptr)
+        if (options.benchmark_filename != nullptr || options.benchmark_frames > 0) {
+                window->benchmark_frame_us = g_array_new(false, false, sizeof(gint64));
+                window->benchmark_start_time = g_get_monotonic_time();
+                window->benchmark_tick_id = gtk_widget_add_tick_callback(GTK_WIDGET(window->terminal),
+                                                                         window_benchmark_tick_cb,
+                                                                         window, nullptr);
+        }
+
+        if (options.benchmark_filename != nullptr)
+                rv = vteapp_window_launch_benchmark(window, error);
+        else if (options.exec_argv != nullptr)
                 rv = vteapp_window_launch_argv(window, options.exec_argv, error);
         else if (options.command != nullptr)
                 rv = vteapp_window_launch_commandline(window, options.command, error);
@@ -1560,6 +1689,8 @@ window_child_exited_cb(VteTerminal* term,
 
         window->child_pid = -1;
 
+        vteapp_window_benchmark_report(window);
+
         if (options.keep)
                 return;
 
@@ -1948,6 +2079,12 @@ vteapp_window_dispose(GObject *object)
                 window->search_popover = nullptr;
         }
 
+        if (window->benchmark_tick_id != 0) {
+                gtk_widget_remove_tick_callback(GTK_WIDGET(window->terminal), window->benchmark_tick_id);
+                window->benchmark_tick_id = 0;
+        }
+        g_clear_pointer(&window->benchmark_frame_us, g_array_unref);
+
         G_OBJECT_CLASS(vteapp_window_parent_class)->dispose(object);
 }
 
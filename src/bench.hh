@@ -0,0 +1,207 @@
+/*
+ * Copyright © 2026 The VTE developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <glib.h>
+
+#include <algorithm>
+#include <cstdarg>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace vte {
+
+namespace base {
+
+/*
+ * Benchmark:
+ *
+ * Collects the timings of repeated runs over some input for the
+ * benchmark tools, and reports them as throughput, in MB/s of input
+ * and in items (sequences, characters, rows) per second, and as the
+ * time per item.
+ */
+class Benchmark {
+public:
+        class Run {
+        public:
+                int64_t time; /* µs */
+                size_t bytes;
+                size_t items;
+
+                /* 1 byte/µs is 1 MB/s */
+                inline constexpr double mb_per_s() const noexcept { return time > 0 ? double(bytes) / double(time) : 0.; }
+                inline constexpr double items_per_s() const noexcept { return time > 0 ? double(items) * 1e6 / double(time) : 0.; }
+                inline constexpr double ns_per_item() const noexcept { return items > 0 ? double(time) * 1e3 / double(items) : 0.; }
+        };
+
+        /* @items_name: what the items are called in the report, e.g. "sequences" */
+        explicit Benchmark(char const* items_name) noexcept
+                : m_items_name{items_name}
+        {
+        }
+
+        Benchmark(Benchmark const&) = delete;
+        Benchmark(Benchmark&&) = delete;
+        Benchmark& operator= (Benchmark const&) = delete;
+        Benchmark& operator= (Benchmark&&) = delete;
+
+        inline bool empty() const noexcept { return m_runs.empty(); }
+
+        void add(int64_t time,
+                 size_t bytes,
+                 size_t items)
+        {
+                m_runs.push_back(Run{time, bytes, items});
+        }
+
+        void print() const noexcept
+        {
+                if (empty())
+                        return;
+
+                auto const sorted = sorted_runs();
+                auto const total = total_run();
+                auto const& best = sorted.front();
+                auto const& worst = sorted.back();
+
+                g_printerr("\nTimes: best %\'" G_GINT64_FORMAT "µs "
+                           "worst %\'" G_GINT64_FORMAT "µs "
+                           "average %\'" G_GINT64_FORMAT "µs\n",
+                           best.time, worst.time,
+                           total.time / int64_t(m_runs.size()));
+                g_printerr("Throughput: best %.2f MB/s %\'.0f %s/s (%.1f ns each), "
+                           "average %.2f MB/s %\'.0f %s/s (%.1f ns each)\n",
+                           best.mb_per_s(), best.items_per_s(), m_items_name, best.ns_per_item(),
+                           total.mb_per_s(), total.items_per_s(), m_items_name, total.ns_per_item());
+                for (auto const& run : sorted)
+                        g_printerr("  %\'" G_GINT64_FORMAT "µs %.2f MB/s\n",
+                                   run.time, run.mb_per_s());
+        }
+
+        /* Appends the results as a JSON object to @str */
+        void append_json(std::string& str) const noexcept
+        {
+                auto const sorted = sorted_runs();
+                auto const total = total_run();
+
+                str.append("{\"items\":");
+                append_json_string(str, m_items_name);
+
+                if (!empty()) {
+                        append_json_run(str, "best", sorted.front());
+                        append_json_run(str, "worst", sorted.back());
+                        append_json_run(str, "average",
+                                        Run{total.time / int64_t(m_runs.size()),
+                                            total.bytes / m_runs.size(),
+                                            total.items / m_runs.size()});
+                }
+
+                str.append(",\"runs\":[");
+                for (auto i = size_t{0}; i < m_runs.size(); ++i) {
+                        if (i > 0)
+                                str.push_back(',');
+                        append_format(str, "%" G_GINT64_FORMAT, m_runs[i].time);
+                }
+                str.append("]}");
+        }
+
+        static void append_json_string(std::string& str,
+                                       char const* value) noexcept
+        {
+                str.push_back('"');
+                for (auto p = value; *p; ++p) {
+                        auto const c = *p;
+                        if (c == '"' || c == '\\')
+                                str.push_back('\\');
+                        if ((unsigned char)c < 0x20)
+                                append_format(str, "\\u%04x", c);
+                        else
+                                str.push_back(c);
+                }
+                str.push_back('"');
+        }
+
+        G_GNUC_PRINTF(2, 3)
+        static void append_format(std::string& str,
+                                  char const* format,
+                                  ...) noexcept
+        {
+                char buf[128];
+                va_list args;
+                va_start(args, format);
+                auto const len = g_vsnprintf(buf, sizeof(buf), format, args);
+                va_end(args);
+
+                str.append(buf, std::min(size_t(len), sizeof(buf) - 1));
+        }
+
+private:
+        char const* m_items_name;
+        std::vector<Run> m_runs{};
+
+        std::vector<Run> sorted_runs() const
+        {
+                auto runs = m_runs;
+                std::sort(std::begin(runs), std::end(runs),
+                          [](Run const& a, Run const& b) { return a.time < b.time; });
+                return runs;
+        }
+
+        Run total_run() const noexcept
+        {
+                auto total = Run{0, 0, 0};
+                for (auto const& run : m_runs) {
+                        total.time += run.time;
+                        total.bytes += run.bytes;
+                        total.items += run.items;
+                }
+                return total;
+        }
+
+        void append_json_run(std::string& str,
+                             char const* name,
+                             Run const& run) const noexcept
+        {
+                append_format(str,
+                              ",\"%s\":{\"time_us\":%" G_GINT64_FORMAT ",\"bytes\":%" G_GSIZE_FORMAT
+                              ",\"%s\":%" G_GSIZE_FORMAT ",\"mb_per_s\":",
+                              name, run.time, run.bytes,
+                              m_items_name, run.items);
+                append_json_double(str, "%.3f", run.mb_per_s());
+                append_format(str, ",\"%s_per_s\":", m_items_name);
+                append_json_double(str, "%.1f", run.items_per_s());
+                str.append(",\"ns_per_item\":");
+                append_json_double(str, "%.2f", run.ns_per_item());
+                str.push_back('}');
+        }
+
+        /* Unlike printf, this doesn't use the locale's decimal separator */
+        static void append_json_double(std::string& str,
+                                       char const* format,
+                                       double value) noexcept
+        {
+                char buf[G_ASCII_DTOSTR_BUF_SIZE];
+                str.append(g_ascii_formatd(buf, sizeof(buf), format, value));
+        }
+};
+
+} // namespace base
+
+} // namespace vte
@@ -45,6 +45,9 @@
 
 #ifdef WITH_FRIBIDI
 #include <fribidi.h>
+
+#include <string>
+#include <unordered_map>
 #endif
 
 #include "bidi.hh"
@@ -63,12 +66,20 @@ using namespace vte::base;
 
 BidiRow::~BidiRow()
 {
-        g_free (m_log2vis);
-        g_free (m_vis2log);
-        g_free (m_vis_rtl);
-        g_free (m_vis_shaped_base_char);
+        g_free (m_storage);
+}
+
+size_t
+BidiRow::size() const noexcept
+{
+        auto size = sizeof(*this);
+        if (m_storage != nullptr)
+                size += (m_width_alloc + 63) / 64 * sizeof (uint64_t) +
+                        m_width_alloc * (sizeof (gunichar) + 2 * sizeof (uint16_t));
+        return size;
 }
 
+/* Makes room in the arrays for @width columns. */
 void
 BidiRow::set_width(vte::grid::column_t width)
 {
@@ -91,21 +102,81 @@ BidiRow::set_width(vte::grid::column_t width)
                 }
                 m_width_alloc = alloc;
 
-                m_log2vis = (uint16_t *) g_realloc (m_log2vis, sizeof (uint16_t) * m_width_alloc);
-                m_vis2log = (uint16_t *) g_realloc (m_vis2log, sizeof (uint16_t) * m_width_alloc);
-                m_vis_rtl = (uint8_t *)  g_realloc (m_vis_rtl, sizeof (uint8_t)  * m_width_alloc);
-                m_vis_shaped_base_char = (gunichar *) g_realloc (m_vis_shaped_base_char, sizeof (gunichar) * m_width_alloc);
+                /* The arrays in the order of their alignment. Nothing needs to be
+                 * kept, the callers write all of the columns. */
+                auto const n_words = (alloc + 63) / 64;
+                g_free (m_storage);
+                m_storage = g_malloc (n_words * sizeof (uint64_t) +
+                                      alloc * (sizeof (gunichar) + 2 * sizeof (uint16_t)));
+                m_vis_rtl = reinterpret_cast<uint64_t*>(m_storage);
+                m_vis_shaped_base_char = reinterpret_cast<gunichar*>(m_vis_rtl + n_words);
+                m_log2vis = reinterpret_cast<uint16_t*>(m_vis_shaped_base_char + alloc);
+                m_vis2log = m_log2vis + alloc;
         }
 
         m_width = width;
 }
 
+/* Sets up the trivial LTR mapping. */
+void
+BidiRow::set_ltr()
+{
+        m_mapping = Mapping::eLTR;
+        m_width = 0;
+        m_has_shaped = false;
+}
+
+/* Sets up the trivial RTL mapping of @width columns. */
+void
+BidiRow::set_rtl(vte::grid::column_t width)
+{
+        m_mapping = Mapping::eRTL;
+        m_width = MIN(width, G_MAXUSHORT);
+        m_has_shaped = false;
+}
+
+/* Sets up a mapping of @width columns in the arrays, to be filled in
+ * by the caller, using set_vis() and m_log2vis. */
+void
+BidiRow::set_table(vte::grid::column_t width)
+{
+        set_width(width);
+        m_mapping = Mapping::eTable;
+        m_has_shaped = false;
+}
+
+/* Turns a trivial mapping into one in the arrays of @width columns. */
+void
+BidiRow::expand(vte::grid::column_t width)
+{
+        if (m_mapping == Mapping::eTable)
+                return;
+
+        auto const rtl = m_mapping == Mapping::eRTL;
+        set_table(width);
+        for (int k = 0; k < m_width; k++) {
+                m_log2vis[k] = rtl ? m_width - 1 - k : k;
+                set_vis(k, m_log2vis[k], rtl, 0);
+        }
+}
+
+void
+BidiRow::set_shaped(vte::grid::column_t col,
+                    gunichar shaped_base_char)
+{
+        if (G_UNLIKELY (!m_has_shaped)) {
+                memset (m_vis_shaped_base_char, 0, m_width * sizeof (gunichar));
+                m_has_shaped = true;
+        }
+        m_vis_shaped_base_char[col] = shaped_base_char;
+}
+
 /* Converts from logical to visual column. Offscreen columns are mirrored
  * for RTL lines, e.g. (assuming 80 columns) -1 <=> 80, -2 <=> 81 etc. */
 vte::grid::column_t
 BidiRow::log2vis(vte::grid::column_t col) const
 {
-        if (col >= 0 && col < m_width) {
+        if (m_mapping == Mapping::eTable && col >= 0 && col < m_width) {
                 return m_log2vis[col];
         } else {
                 return m_base_rtl ? m_width - 1 - col : col;
@@ -117,7 +188,7 @@ BidiRow::log2vis(vte::grid::column_t col) const
 vte::grid::column_t
 BidiRow::vis2log(vte::grid::column_t col) const
 {
-        if (col >= 0 && col < m_width) {
+        if (m_mapping == Mapping::eTable && col >= 0 && col < m_width) {
                 return m_vis2log[col];
         } else {
                 return m_base_rtl ? m_width - 1 - col : col;
@@ -129,8 +200,8 @@ BidiRow::vis2log(vte::grid::column_t col) const
 bool
 BidiRow::vis_is_rtl(vte::grid::column_t col) const
 {
-        if (col >= 0 && col < m_width) {
-                return m_vis_rtl[col];
+        if (m_mapping == Mapping::eTable && col >= 0 && col < m_width) {
+                return get_vis_rtl(col);
         } else {
                 return m_base_rtl;
         }
@@ -141,9 +212,8 @@ BidiRow::vis_is_rtl(vte::grid::column_t col) const
 bool
 BidiRow::log_is_rtl(vte::grid::column_t col) const
 {
-        if (col >= 0 && col < m_width) {
-                col = m_log2vis[col];
-                return m_vis_rtl[col];
+        if (m_mapping == Mapping::eTable && col >= 0 && col < m_width) {
+                return get_vis_rtl(m_log2vis[col]);
         } else {
                 return m_base_rtl;
         }
@@ -159,8 +229,8 @@ BidiRow::log_is_rtl(vte::grid::column_t col) const
  * Apply the combining accents here. There's no design rationale behind this, it's
  * just much simpler to do it here than during the BiDi algorithm.
  *
- * In some cases a fully LTR line is denoted by m_width being 0. In other cases a
- * character that didn't need shaping is stored as the value 0. In order to provide a
+ * In some cases a line is denoted by a trivial mapping without the arrays. In other
+ * cases a character that didn't need shaping is stored as the value 0. In order to provide a
  * consistent and straightforward behavior (where the caller doesn't need to special
  * case the return value of 0) we need to ask for the unshaped character anyway.
  *
@@ -172,7 +242,7 @@ BidiRow::vis_get_shaped_char(vte::grid::column_t col, vteunistr s) const
 {
         g_assert_cmpint (col, >=, 0);
 
-        if (col >= m_width || m_vis_shaped_base_char[col] == 0)
+        if (!m_has_shaped || col >= m_width || m_vis_shaped_base_char[col] == 0)
                 return s;
 
         return _vte_unistr_replace_base(s, m_vis_shaped_base_char[col]);
@@ -186,6 +256,20 @@ is_arabic(gunichar c)
         return FRIBIDI_IS_ARABIC (fribidi_get_bidi_type (c));
 }
 
+/* The shaped look of the Arabic words that explicit_line_shape() came across,
+ * by their characters, or an empty string if FriBidi failed on them. A word
+ * always extends to non-Arabic characters on both sides, so its characters
+ * are all the context its shaping depends on.
+ *
+ * There is one per thread, since the paragraphs may be done on several.
+ */
+static std::unordered_map<std::u32string, std::u32string>&
+shaping_cache()
+{
+        static thread_local std::unordered_map<std::u32string, std::u32string> cache{};
+        return cache;
+}
+
 /* Perform Arabic shaping on an explicit line (which could be explicit LTR or explicit RTL),
  * using presentation form characters.
  *
@@ -261,36 +345,45 @@ BidiRunner::explicit_line_shape(vte::grid::row_t row)
                 count = fribidi_chars_array->len;
                 fribidi_chars = (FriBidiChar *) fribidi_chars_array->data;
 
-                /* Run the BiDi algorithm on the paragraph to get the embedding levels. */
-                fribidi_chartypes = g_newa (FriBidiCharType, count);
-                fribidi_brackettypes = g_newa (FriBidiBracketType, count);
-                fribidi_joiningtypes = g_newa (FriBidiJoiningType, count);
-                fribidi_levels = g_newa (FriBidiLevel, count);
+                auto& cache = shaping_cache();
+                auto word = std::u32string{reinterpret_cast<char32_t const*>(fribidi_chars), size_t(count)};
+                auto it = cache.find(word);
+                if (it == cache.end()) {
+                        /* Run the BiDi algorithm on the paragraph to get the embedding levels. */
+                        fribidi_chartypes = g_newa (FriBidiCharType, count);
+                        fribidi_brackettypes = g_newa (FriBidiBracketType, count);
+                        fribidi_joiningtypes = g_newa (FriBidiJoiningType, count);
+                        fribidi_levels = g_newa (FriBidiLevel, count);
+
+                        fribidi_get_bidi_types (fribidi_chars, count, fribidi_chartypes);
+                        fribidi_get_bracket_types (fribidi_chars, count, fribidi_chartypes, fribidi_brackettypes);
+                        fribidi_get_joining_types (fribidi_chars, count, fribidi_joiningtypes);
+                        level = fribidi_get_par_embedding_levels_ex (fribidi_chartypes, fribidi_brackettypes, count, &pbase_dir, fribidi_levels) - 1;
+
+                        auto shaped = std::u32string{};
+                        if (level != (FriBidiLevel)(-1)) {
+                                /* Shaping. */
+                                fribidi_join_arabic (fribidi_chartypes, count, fribidi_levels, fribidi_joiningtypes);
+                                fribidi_shape_arabic (VTE_ARABIC_SHAPING_FLAGS, fribidi_levels, count, fribidi_joiningtypes, fribidi_chars);
+                                shaped.assign(reinterpret_cast<char32_t const*>(fribidi_chars), count);
+                        }
 
-                fribidi_get_bidi_types (fribidi_chars, count, fribidi_chartypes);
-                fribidi_get_bracket_types (fribidi_chars, count, fribidi_chartypes, fribidi_brackettypes);
-                fribidi_get_joining_types (fribidi_chars, count, fribidi_joiningtypes);
-                level = fribidi_get_par_embedding_levels_ex (fribidi_chartypes, fribidi_brackettypes, count, &pbase_dir, fribidi_levels) - 1;
-                if (level == (FriBidiLevel)(-1)) {
+                        if (cache.size() >= VTE_SHAPING_CACHE_SIZE)
+                                cache.clear();
+                        it = cache.emplace(std::move(word), std::move(shaped)).first;
+                } else if (!it->second.empty()) {
+                        memcpy (fribidi_chars, it->second.data(), count * sizeof (FriBidiChar));
+                }
+
+                if (it->second.empty()) {
                         /* Error. Skip shaping this word. */
                         i = j - 1;
                         continue;
                 }
 
-                /* Shaping. */
-                fribidi_join_arabic (fribidi_chartypes, count, fribidi_levels, fribidi_joiningtypes);
-                fribidi_shape_arabic (VTE_ARABIC_SHAPING_FLAGS, fribidi_levels, count, fribidi_joiningtypes, fribidi_chars);
-
-                /* If we have the shortcut notation for the trivial LTR mapping, we need to
+                /* If we have the shortcut notation for a trivial mapping, we need to
                  * expand it to the nontrivial notation, in order to store the shaped character. */
-                if (bidirow->m_width == 0) {
-                        bidirow->set_width(width);
-                        for (int k = 0; k < width; k++) {
-                                bidirow->m_log2vis[k] = bidirow->m_vis2log[k] = k;
-                                bidirow->m_vis_rtl[k] = false;
-                                bidirow->m_vis_shaped_base_char[k] = 0;
-                        }
-                }
+                bidirow->expand(width);
 
                 /* Walk through the Arabic word again. */
                 j = i;
@@ -301,7 +394,7 @@ BidiRunner::explicit_line_shape(vte::grid::row_t row)
                         base = _vte_unistr_get_base(c);
                         if (*fribidi_chars != base) {
                                 /* Shaping changed the codepoint, store it. */
-                                bidirow->m_vis_shaped_base_char[j] = *fribidi_chars;
+                                bidirow->set_shaped(j, *fribidi_chars);
                         }
                         int len = _vte_unistr_strlen(c);
                         fribidi_chars += len;
@@ -327,8 +420,6 @@ BidiRunner::explicit_line_shape(vte::grid::row_t row)
 void
 BidiRunner::explicit_line(vte::grid::row_t row, bool rtl, bool do_shaping)
 {
-        int i;
-
         BidiRow *bidirow = m_ringview->get_bidirow_writable(row);
         if (G_UNLIKELY (bidirow == nullptr))
                 return;
@@ -337,18 +428,11 @@ BidiRunner::explicit_line(vte::grid::row_t row, bool rtl, bool do_shaping)
 
         auto width = m_ringview->get_width();
 
-        if (G_LIKELY (!rtl)) {
-                /* Shortcut notation: a width of 0 means the trivial LTR mapping. */
-                bidirow->set_width(0);
-        } else {
-                /* Set up the explicit RTL mapping. */
-                bidirow->set_width(width);
-                for (i = 0; i < width; i++) {
-                        bidirow->m_log2vis[i] = bidirow->m_vis2log[i] = width - 1 - i;
-                        bidirow->m_vis_rtl[i] = true;
-                        bidirow->m_vis_shaped_base_char[i] = 0;
-                }
-        }
+        /* Shortcut notation for the trivial mappings. */
+        if (G_LIKELY (!rtl))
+                bidirow->set_ltr();
+        else
+                bidirow->set_rtl(width);
 
 #ifdef WITH_FRIBIDI
         if (do_shaping)
@@ -356,6 +440,23 @@ BidiRunner::explicit_line(vte::grid::row_t row, bool rtl, bool do_shaping)
 #endif
 }
 
+/* Returns: whether the rows between the given ones contain nothing that
+ * BiDi or shaping would move or change: every strong RTL, Arabic number,
+ * joining and explicit directional formatting character is at U+0590 or
+ * above. Combining sequences are assumed to need it. */
+bool
+BidiRunner::paragraph_is_ltr_only(vte::grid::row_t start, vte::grid::row_t end) const
+{
+        for (auto row = start; row < end; row++) {
+                auto const row_data = m_ringview->get_row(row);
+                for (gulong i = 0; i < _vte_row_data_stored_length(row_data); i++) {
+                        if (G_UNLIKELY (row_data->cells[i].c >= 0x0590))
+                                return false;
+                }
+        }
+        return true;
+}
+
 /* Figure out the mapping for the paragraph between the given rows. */
 void
 BidiRunner::paragraph(vte::grid::row_t start, vte::grid::row_t end,
@@ -371,7 +472,14 @@ BidiRunner::paragraph(vte::grid::row_t start, vte::grid::row_t end,
         }
 
         if (!do_bidi) {
-                explicit_paragraph(start, end, false, do_shaping);
+                explicit_paragraph(start, end, false, do_shaping && !paragraph_is_ltr_only(start, end));
+                return;
+        }
+
+        /* An LTR paragraph with only LTR text needs neither BiDi nor shaping. */
+        if (!(row_data->attr.bidi_flags & VTE_BIDI_FLAG_RTL) &&
+            paragraph_is_ltr_only(start, end)) {
+                explicit_paragraph(start, end, false, false);
                 return;
         }
 
@@ -636,7 +744,7 @@ BidiRunner::implicit_paragraph(vte::grid::row_t start, vte::grid::row_t end, boo
 
                 bidirow->m_base_rtl = rtl;
                 bidirow->m_has_foreign = has_foreign;
-                bidirow->set_width(width);
+                bidirow->set_table(width);
 
                 row_data = m_ringview->get_row(row);
 
@@ -669,9 +777,7 @@ BidiRunner::implicit_paragraph(vte::grid::row_t start, vte::grid::row_t end, boo
                         /* Unused cells on the left for RTL paragraphs */
                         int unused = width - row_data->len;
                         for (; tv < unused; tv++) {
-                                bidirow->m_vis2log[tv] = width - 1 - tv;
-                                bidirow->m_vis_rtl[tv] = true;
-                                bidirow->m_vis_shaped_base_char[tv] = 0;
+                                bidirow->set_vis(tv, width - 1 - tv, true, 0);
                         }
                 }
                 for (fv = lines[line]; fv < lines[line + 1]; fv++) {
@@ -683,21 +789,19 @@ BidiRunner::implicit_paragraph(vte::grid::row_t start, vte::grid::row_t end, boo
                         cell = _vte_row_data_get (row_data, tl);
                         g_assert (!cell->attr.fragment());
                         g_assert (cell->attr.columns() > 0);
+                        /* Only store the characters that shaping changed */
+                        auto const shaped = fribidi_chars[fl] != _vte_unistr_get_base(cell->c) ? fribidi_chars[fl] : 0;
                         if (FRIBIDI_LEVEL_IS_RTL(fribidi_levels[fl])) {
                                 /* RTL character directionality. Map fragments in reverse order. */
                                 for (col = 0; col < cell->attr.columns(); col++) {
-                                        bidirow->m_vis2log[tv + col] = tl + cell->attr.columns() - 1 - col;
-                                        bidirow->m_vis_rtl[tv + col] = true;
-                                        bidirow->m_vis_shaped_base_char[tv + col] = fribidi_chars[fl];
+                                        bidirow->set_vis(tv + col, tl + cell->attr.columns() - 1 - col, true, shaped);
                                 }
                                 tv += cell->attr.columns();
                                 tl += cell->attr.columns();
                         } else {
                                 /* LTR character directionality. */
                                 for (col = 0; col < cell->attr.columns(); col++) {
-                                        bidirow->m_vis2log[tv] = tl;
-                                        bidirow->m_vis_rtl[tv] = false;
-                                        bidirow->m_vis_shaped_base_char[tv] = fribidi_chars[fl];
+                                        bidirow->set_vis(tv, tl, false, shaped);
                                         tv++;
                                         tl++;
                                 }
@@ -707,9 +811,7 @@ BidiRunner::implicit_paragraph(vte::grid::row_t start, vte::grid::row_t end, boo
                         /* Unused cells on the right for LTR paragraphs */
                         g_assert_cmpint (tv, ==, row_data->len);
                         for (; tv < width; tv++) {
-                                bidirow->m_vis2log[tv] = tv;
-                                bidirow->m_vis_rtl[tv] = false;
-                                bidirow->m_vis_shaped_base_char[tv] = 0;
+                                bidirow->set_vis(tv, tv, false, 0);
                         }
                 }
                 g_assert_cmpint (tv, ==, width);
@@ -61,18 +61,60 @@ public:
          * This is used in the cursor, showing the character's directionality. */
         inline constexpr bool has_foreign() const noexcept { return m_has_foreign; }
 
+        /* Whether the visual and the logical columns are the same. */
+        inline constexpr bool is_trivial_ltr() const noexcept { return m_mapping == Mapping::eLTR; }
+
+        /* The bytes the row takes on the heap. */
+        size_t size() const noexcept;
+
 private:
-        void set_width(vte::grid::column_t width);
+        /* How the mapping is stored */
+        enum class Mapping : uint8_t {
+                eLTR,    /* the trivial LTR mapping, m_width is 0 */
+                eRTL,    /* the trivial RTL mapping, of m_width columns */
+                eTable,  /* in the arrays, of m_width columns */
+        };
 
-        /* The value of m_width == 0 is a valid representation of the trivial LTR mapping. */
+        void set_width(vte::grid::column_t width);
+        void set_ltr();
+        void set_rtl(vte::grid::column_t width);
+        void set_table(vte::grid::column_t width);
+        void expand(vte::grid::column_t width);
+
+        inline void set_vis(vte::grid::column_t col,
+                            vte::grid::column_t log,
+                            bool rtl,
+                            gunichar shaped_base_char)
+        {
+                m_vis2log[col] = log;
+                if (rtl)
+                        m_vis_rtl[col >> 6] |= uint64_t{1} << (col & 63);
+                else
+                        m_vis_rtl[col >> 6] &= ~(uint64_t{1} << (col & 63));
+                if (shaped_base_char != 0 || m_has_shaped)
+                        set_shaped(col, shaped_base_char);
+        }
+
+        inline bool get_vis_rtl(vte::grid::column_t col) const
+        {
+                return (m_vis_rtl[col >> 6] >> (col & 63)) & 1;
+        }
+
+        void set_shaped(vte::grid::column_t col,
+                        gunichar shaped_base_char);
+
+        Mapping m_mapping{Mapping::eLTR};
         uint16_t m_width{0};
         uint16_t m_width_alloc{0};
 
-        /* These will be initialized / allocated on demand, when some shuffling or shaping is needed. */
+        /* These are all in one allocation, made on demand, when some shuffling
+         * or shaping is needed. */
+        void *m_storage{nullptr};
+        uint64_t *m_vis_rtl{nullptr};  /* a bitset */
+        gunichar *m_vis_shaped_base_char{nullptr};  /* without combining accents, all 0 unless m_has_shaped */
         uint16_t *m_log2vis{nullptr};
         uint16_t *m_vis2log{nullptr};
-        uint8_t  *m_vis_rtl{nullptr};  /* FIXME use a bitset */
-        gunichar *m_vis_shaped_base_char{nullptr};  /* without combining accents */
+        bool m_has_shaped{false};
 
         bool m_base_rtl{false};
         bool m_has_foreign{false};
@@ -103,6 +145,7 @@ private:
         void explicit_line_shape(vte::grid::row_t row);
 #endif
 
+        bool paragraph_is_ltr_only(vte::grid::row_t start, vte::grid::row_t end) const;
         void explicit_line(vte::grid::row_t row, bool rtl, bool do_shaping);
         void explicit_paragraph(vte::grid::row_t start, vte::grid::row_t end, bool rtl, bool do_shaping);
 #ifdef WITH_FRIBIDI
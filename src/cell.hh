@@ -43,7 +43,8 @@
 
 #define VTE_TAB_WIDTH_MAX		((1 << VTE_ATTR_COLUMNS_BITS) - 1)
 
-#define VTE_CELL_ATTR_COMMON_BYTES      12  /* The number of common bytes in VteCellAttr and VteStreamCellAttr */
+#define VTE_CELL_ATTR_COMMON_BYTES      12  /* The number of common bytes in VteCellAttr and VteStreamCellAttr,
+                                               that is, all of VteCellAttr */
 
 /*
  * VteCellAttr: A single cell style attributes
@@ -51,6 +52,9 @@
  * When adding new attributes, keep in sync with VteStreamCellAttr and
  * update VTE_CELL_ATTR_COMMON_BYTES accordingly.
  * Also don't forget to update basic_cell below!
+ *
+ * A cell's hyperlink is not one of its attributes, but kept with its
+ * row, see VteRowData.
  */
 
 #define CELL_ATTR_BOOL(lname,uname) \
@@ -81,15 +85,6 @@ typedef struct _VTE_GNUC_PACKED VteCellAttr {
 	/* 4-byte boundary (8-byte boundary in VteCell) */
         uint64_t m_colors;                     /* fore, back and deco (underline) colour */
 
-        /* 12-byte boundary (16-byte boundary in VteCell) */
-        uint32_t hyperlink_idx; /* a unique hyperlink index at a time for the ring's cells,
-                                   0 means not a hyperlink, VTE_HYPERLINK_IDX_TARGET_IN_STREAM
-                                   means the target is irrelevant/unknown at the moment.
-                                   If bitpacking, choose a size big enough to hold a different idx
-                                   for every cell in the ring but not yet in the stream
-                                   (currently the height rounded up to the next power of two, times width)
-                                   for supported VTE sizes, and update VTE_HYPERLINK_IDX_TARGET_IN_STREAM. */
-
         /* Methods */
 
         inline constexpr uint64_t colors() const { return m_colors; }
@@ -149,8 +144,7 @@ typedef struct _VTE_GNUC_PACKED VteCellAttr {
         CELL_ATTR_BOOL(separated_mosaic, SEPARATED_MOSAIC)
         /* ATTR_BOOL(boxed, BOXED) */
 } VteCellAttr;
-static_assert(sizeof (VteCellAttr) == 16, "VteCellAttr has wrong size");
-static_assert(offsetof (VteCellAttr, hyperlink_idx) == VTE_CELL_ATTR_COMMON_BYTES, "VteCellAttr layout is wrong");
+static_assert(sizeof (VteCellAttr) == VTE_CELL_ATTR_COMMON_BYTES, "VteCellAttr has wrong size");
 
 /*
  * VteStreamCellAttr: Variant of VteCellAttr to be stored in attr_stream.
@@ -187,14 +181,13 @@ typedef struct _VTE_GNUC_PACKED _VteCell {
 	VteCellAttr attr;
 } VteCell;
 
-static_assert(sizeof (VteCell) == 20, "VteCell has wrong size");
+static_assert(sizeof (VteCell) == 16, "VteCell has wrong size");
 
 static const VteCell basic_cell = {
 	0,
 	{
                 VTE_ATTR_DEFAULT, /* attr */
                 VTE_COLOR_TRIPLE_INIT_DEFAULT, /* colors */
-                0, /* hyperlink_idx */
 	}
 };
 
@@ -0,0 +1,106 @@
+/*
+ * Copyright © 2026 The VTE developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <glib.h>
+
+#include <vector>
+
+#include "chunk.hh"
+
+using namespace vte::base;
+
+struct Cacher {
+        GMutex mutex;
+        GCond cond;
+        bool cached{false};
+        bool done{false};
+};
+
+/* Takes the shared stack into this thread's cache, and holds on to it */
+static gpointer
+cache_chunks(gpointer data)
+{
+        auto cacher = reinterpret_cast<Cacher*>(data);
+
+        /* Returned to the shared stack, with the rest left in the cache */
+        Chunk::get().reset();
+
+        g_mutex_lock(&cacher->mutex);
+        cacher->cached = true;
+        g_cond_signal(&cacher->cond);
+        while (!cacher->done)
+                g_cond_wait(&cacher->cond, &cacher->mutex);
+        g_mutex_unlock(&cacher->mutex);
+
+        return nullptr;
+}
+
+static void
+test_chunk_prune_other_cache(void)
+{
+#ifdef VTE_DEBUG
+        auto const n_free = Chunk::stats().n_free;
+        {
+                auto chunks = std::vector<Chunk::unique_type>{};
+                for (auto i = 0; i < 16; ++i)
+                        chunks.push_back(Chunk::get());
+        }
+        g_assert_cmpuint(Chunk::stats().n_free, ==, n_free + 16);
+
+        auto cacher = Cacher{};
+        g_mutex_init(&cacher.mutex);
+        g_cond_init(&cacher.cond);
+        auto thread = g_thread_new("cacher", cache_chunks, &cacher);
+        g_mutex_lock(&cacher.mutex);
+        while (!cacher.cached)
+                g_cond_wait(&cacher.cond, &cacher.mutex);
+        g_mutex_unlock(&cacher.mutex);
+
+        /* Only the one chunk on the shared stack counts against the limit,
+         * the others are out of reach in the other thread's cache.
+         */
+        Chunk::prune(4);
+        g_assert_cmpuint(Chunk::stats().n_free, ==, n_free + 16);
+
+        g_mutex_lock(&cacher.mutex);
+        cacher.done = true;
+        g_cond_signal(&cacher.cond);
+        g_mutex_unlock(&cacher.mutex);
+        g_thread_join(thread);
+        g_mutex_clear(&cacher.mutex);
+        g_cond_clear(&cacher.cond);
+
+        /* The thread returned its cache on exit */
+        Chunk::prune(4);
+        g_assert_cmpuint(Chunk::stats().n_free, ==, 4);
+#else
+        g_test_skip("Needs the debug statistics");
+#endif
+}
+
+int
+main(int argc,
+     char* argv[])
+{
+        g_test_init(&argc, &argv, nullptr);
+
+        g_test_add_func("/vte/chunk/prune/other-cache", test_chunk_prune_other_cache);
+
+        return g_test_run();
+}
@@ -19,9 +19,13 @@
 
 #include "chunk.hh"
 
+#include <algorithm>
+#include <atomic>
 #include <cstddef> // offsetof
 #include <new>
 
+#include "debug.h"
+
 namespace vte {
 
 namespace base {
@@ -29,36 +33,208 @@ namespace base {
 static_assert(sizeof(Chunk) <= Chunk::k_chunk_size - 2 *sizeof(void*), "Chunk too large");
 static_assert(offsetof(Chunk, data) == offsetof(Chunk, dataminusone) + 1, "Chunk layout wrong");
 
+/*
+ * Spare chunks are kept on an intrusive Treiber stack which any thread
+ * may push to. Popping single chunks off it from more than one thread
+ * (the main thread and the PTY reader thread) would be prone to ABA,
+ * so instead a thread takes the whole stack at once into its own
+ * thread-local cache, and pops from there.
+ *
+ * Each keeps count of its chunks, so that prune() only weighs those it
+ * can reach against its limit, not those cached by other threads.
+ */
+class FreeChunks {
+public:
+        FreeChunks() = default;
+        FreeChunks(FreeChunks const&) = delete;
+        FreeChunks(FreeChunks&&) = delete;
+
+        /* Return the cached chunks to the shared stack on thread exit */
+        ~FreeChunks() noexcept
+        {
+                while (auto chunk = m_head) {
+                        m_head = chunk->m_next_free;
+                        push(chunk);
+                }
+                m_n = 0;
+        }
+
+        FreeChunks& operator= (FreeChunks const&) = delete;
+        FreeChunks& operator= (FreeChunks&&) = delete;
+
+        static void push(Chunk* chunk) noexcept
+        {
+                auto head = s_head.load(std::memory_order_relaxed);
+                do {
+                        chunk->m_next_free = head;
+                } while (!s_head.compare_exchange_weak(head, chunk,
+                                                       std::memory_order_release,
+                                                       std::memory_order_relaxed));
+                s_n.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        Chunk* pop() noexcept
+        {
+                if (m_head == nullptr) {
+                        m_head = s_head.exchange(nullptr, std::memory_order_acquire);
+                        auto n = 0;
+                        for (auto chunk = m_head; chunk != nullptr; chunk = chunk->m_next_free)
+                                ++n;
+                        s_n.fetch_sub(n, std::memory_order_relaxed);
+                        m_n += n;
+                }
+                if (m_head == nullptr)
+                        return nullptr;
+
+                auto chunk = m_head;
+                m_head = chunk->m_next_free;
+                chunk->m_next_free = nullptr;
+                --m_n;
+                return chunk;
+        }
+
+        /* Returns: the number of chunks in this cache and on the shared
+         * stack, which may be momentarily off while other threads push */
+        int size() const noexcept
+        {
+                return m_n + std::max(s_n.load(std::memory_order_relaxed), 0);
+        }
+
+private:
+        Chunk* m_head{nullptr};
+        int m_n{0};
+
+        static inline std::atomic<Chunk*> s_head{nullptr};
+        static inline std::atomic<int> s_n{0}; /* chunks on the shared stack */
+};
+
+static thread_local FreeChunks t_free_chunks;
+
+static std::atomic<unsigned int> g_n_free{0};
+static std::atomic<unsigned int> g_n_used{0};
+static std::atomic<unsigned int> g_peak_used{0};
+static std::atomic<unsigned int> g_max_free{Chunk::k_max_free_chunks};
+
+#ifdef VTE_DEBUG
+static std::atomic<uint64_t> g_n_allocations{0};
+static std::atomic<uint64_t> g_n_recycles{0};
+static std::atomic<uint64_t> g_n_pool_hits{0};
+#define CHUNK_STAT_INC(name) (g_n_##name.fetch_add(1, std::memory_order_relaxed))
+#else
+#define CHUNK_STAT_INC(name) do { } while (0)
+#endif
+
 void
 Chunk::recycle() noexcept
 {
-        g_free_chunks.push(std::unique_ptr<Chunk>(this));
+        /* Don't hold on to external storage while on the free list */
+        release();
+
         /* FIXME: bzero out the chunk for security? */
+        FreeChunks::push(this);
+        g_n_free.fetch_add(1, std::memory_order_relaxed);
+        g_n_used.fetch_sub(1, std::memory_order_relaxed);
+        CHUNK_STAT_INC(recycles);
 }
 
-std::stack<std::unique_ptr<Chunk>, std::list<std::unique_ptr<Chunk>>> Chunk::g_free_chunks;
-
 Chunk::unique_type
 Chunk::get(void) noexcept
 {
-        Chunk* chunk;
-        if (!g_free_chunks.empty()) {
-                chunk = g_free_chunks.top().release();
-                g_free_chunks.pop();
-
+        auto chunk = t_free_chunks.pop();
+        if (chunk) {
+                g_n_free.fetch_sub(1, std::memory_order_relaxed);
                 chunk->reset();
+                CHUNK_STAT_INC(pool_hits);
         } else {
                 chunk = new Chunk();
+                CHUNK_STAT_INC(allocations);
         }
 
+        /* Track the peak use, to size the free list in prune() */
+        auto const used = g_n_used.fetch_add(1, std::memory_order_relaxed) + 1;
+        auto peak = g_peak_used.load(std::memory_order_relaxed);
+        while (used > peak &&
+               !g_peak_used.compare_exchange_weak(peak, used, std::memory_order_relaxed));
+
         return Chunk::unique_type(chunk);
 }
+
+Chunk::unique_type
+Chunk::get_external(uint8_t const* storage,
+                    unsigned int len,
+                    release_func release,
+                    void* release_data) noexcept
+{
+        auto chunk = get();
+        chunk->m_external = storage;
+        chunk->m_release = release;
+        chunk->m_release_data = release_data;
+        chunk->len = len;
+        /* Nothing may be appended to it */
+        chunk->set_sealed();
+
+        return chunk;
+}
+
 void
 Chunk::prune(unsigned int max_size) noexcept
 {
-        while (g_free_chunks.size() > max_size)
-                g_free_chunks.pop();
+        /* Only chunks in this thread's cache and the shared stack can be freed
+         * here, so only those count; chunks cached by another thread are
+         * returned on its exit.
+         */
+        while (unsigned(t_free_chunks.size()) > max_size) {
+                auto chunk = t_free_chunks.pop();
+                if (chunk == nullptr)
+                        break;
+
+                g_n_free.fetch_sub(1, std::memory_order_relaxed);
+                delete chunk;
+        }
+
+#ifdef VTE_DEBUG
+        _VTE_DEBUG_IF(VTE_DEBUG_IO) {
+                auto const s = stats();
+                g_printerr("Chunks: pruned to %u free (%u in use, peak %u); "
+                           "%" G_GUINT64_FORMAT " allocations, %" G_GUINT64_FORMAT " recycles, "
+                           "%" G_GUINT64_FORMAT " pool hits\n",
+                           s.n_free, s.n_used, s.peak_used,
+                           s.allocations, s.recycles, s.pool_hits);
+        }
+#endif
+}
+
+void
+Chunk::prune() noexcept
+{
+        /* Keep as many spare chunks as were in use at peak since the last prune,
+         * and restart peak tracking from the current use.
+         */
+        auto const peak = g_peak_used.exchange(g_n_used.load(std::memory_order_relaxed),
+                                               std::memory_order_relaxed);
+        prune(std::clamp(peak,
+                         k_min_free_chunks,
+                         std::max(k_min_free_chunks, g_max_free.load(std::memory_order_relaxed))));
+}
+
+void
+Chunk::set_max_free_chunks(unsigned int max_size) noexcept
+{
+        g_max_free.store(max_size, std::memory_order_relaxed);
+}
+
+#ifdef VTE_DEBUG
+Chunk::Stats
+Chunk::stats() noexcept
+{
+        return Stats{g_n_allocations.load(std::memory_order_relaxed),
+                        g_n_recycles.load(std::memory_order_relaxed),
+                        g_n_pool_hits.load(std::memory_order_relaxed),
+                        g_n_free.load(std::memory_order_relaxed),
+                        g_n_used.load(std::memory_order_relaxed),
+                        g_peak_used.load(std::memory_order_relaxed)};
 }
+#endif
 
 } // namespace base
 
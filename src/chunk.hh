@@ -18,9 +18,7 @@
 #pragma once
 
 #include <cstdint>
-#include <list>
 #include <memory>
-#include <stack>
 
 namespace vte {
 
@@ -39,8 +37,6 @@ private:
 
         void recycle() noexcept;
 
-        static unsigned int const k_max_free_chunks = 16;
-
         enum class Flags : uint8_t {
                 eSEALED = 1u << 0,
                 eEOS    = 1u << 1,
@@ -51,10 +47,22 @@ public:
 
         static unsigned int const k_chunk_size = 0x2000;
 
+        /* The number of spare chunks kept around adapts to the peak
+         * number of chunks in use, between these two limits.
+         */
+        static constexpr unsigned int const k_min_free_chunks = 4;
+        static constexpr unsigned int const k_max_free_chunks = 128;
+
+        using release_func = void (*)(void*);
+
+        Chunk* m_next_free{nullptr}; /* intrusive free list link; internal */
+        uint8_t const* m_external{nullptr}; /* external storage, used instead of data */
+        release_func m_release{nullptr};
+        void* m_release_data{nullptr};
         unsigned int len{0};
         uint8_t m_flags{0};
         uint8_t dataminusone;    /* Hack: Keep it right before data, so that data[-1] is valid and usable */
-        uint8_t data[k_chunk_size - 2 * sizeof(void*) - 2 - sizeof(unsigned int)];
+        uint8_t data[k_chunk_size - 6 * sizeof(void*) - 2 - sizeof(unsigned int)];
 
         Chunk() = default;
         Chunk(Chunk const&) = delete;
@@ -66,15 +74,51 @@ public:
 
         void reset() noexcept
         {
+                release();
                 len = 0;
                 m_flags = 0;
         }
 
-        inline constexpr size_t capacity() const noexcept { return sizeof(data); }
+        inline constexpr size_t capacity() const noexcept { return external() ? len : sizeof(data); }
         inline constexpr size_t remaining_capacity() const noexcept { return capacity() - len; }
 
+        /* The data to process; for an external chunk, that's not @data */
+        inline constexpr bool external() const noexcept { return m_external != nullptr; }
+        inline constexpr uint8_t const* begin_reading() const noexcept { return external() ? m_external : data; }
+        inline constexpr uint8_t const* end_reading() const noexcept { return begin_reading() + len; }
+
+        /* get() and recycling are lock-free and may be used from any thread */
         static unique_type get() noexcept;
-        static void prune(unsigned int max_size = k_max_free_chunks) noexcept;
+
+        /* Returns a sealed chunk referring to @len bytes at @storage, which
+         * are released with @release(@release_data) when the chunk is recycled.
+         */
+        static unique_type get_external(uint8_t const* storage,
+                                        unsigned int len,
+                                        release_func release,
+                                        void* release_data) noexcept;
+
+        /* Frees spare chunks beyond max_size, or beyond the peak use
+         * since the last prune.
+         */
+        static void prune(unsigned int max_size) noexcept;
+        static void prune() noexcept;
+
+        /* Upper limit for the adaptive number of spare chunks */
+        static void set_max_free_chunks(unsigned int max_size) noexcept;
+
+#ifdef VTE_DEBUG
+        struct Stats {
+                uint64_t allocations; /* chunks allocated with new */
+                uint64_t recycles;    /* chunks returned to the free list */
+                uint64_t pool_hits;   /* get() served from the free list */
+                unsigned int n_free;
+                unsigned int n_used;
+                unsigned int peak_used;
+        };
+
+        static Stats stats() noexcept;
+#endif
 
         inline constexpr bool sealed() const noexcept { return m_flags & (uint8_t)Flags::eSEALED; }
         inline void set_sealed() noexcept { m_flags |= (uint8_t)Flags::eSEALED; }
@@ -83,9 +127,14 @@ public:
         inline void set_eos() noexcept { m_flags |= (uint8_t)Flags::eEOS; }
 
 private:
-
-        /* Note that this is using the standard deleter, not Recycler */
-        static std::stack<std::unique_ptr<Chunk>, std::list<std::unique_ptr<Chunk>>> g_free_chunks;
+        void release() noexcept
+        {
+                if (m_release)
+                        m_release(m_release_data);
+                m_external = nullptr;
+                m_release = nullptr;
+                m_release_data = nullptr;
+        }
 };
 
 } // namespace base
@@ -0,0 +1,75 @@
+/*
+ * Copyright © 2026 The VTE developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <glib.h>
+
+#include "color-cache.hh"
+
+using namespace vte::base;
+
+static void
+test_color_cache_lookup(void)
+{
+        ColorCache cache{};
+
+        g_assert_null(cache.lookup(0x1234, 0x1, false));
+        g_assert_cmpuint(cache.misses(), ==, 1);
+
+        cache.insert(0x1234, 0x1, false, ColorCache::Colors{1, 2, 3});
+        auto const cached = cache.lookup(0x1234, 0x1, false);
+        g_assert_nonnull(cached);
+        g_assert_cmpuint(cached->fore, ==, 1);
+        g_assert_cmpuint(cached->back, ==, 2);
+        g_assert_cmpuint(cached->deco, ==, 3);
+        g_assert_cmpuint(cache.hits(), ==, 1);
+
+        /* Each part is part of the key */
+        g_assert_null(cache.lookup(0x1235, 0x1, false));
+        g_assert_null(cache.lookup(0x1234, 0x2, false));
+        g_assert_null(cache.lookup(0x1234, 0x1, true));
+        g_assert_cmpuint(cache.misses(), ==, 4);
+
+        /* The selected look replaces the unselected one */
+        cache.insert(0x1234, 0x1, true, ColorCache::Colors{2, 1, 3});
+        g_assert_cmpuint(cache.lookup(0x1234, 0x1, true)->fore, ==, 2);
+        g_assert_null(cache.lookup(0x1234, 0x1, false));
+}
+
+static void
+test_color_cache_empty(void)
+{
+        ColorCache cache{};
+
+        /* The empty entries don't match the all-zeros key */
+        g_assert_null(cache.lookup(0, 0, false));
+        cache.insert(0, 0, false, ColorCache::Colors{});
+        g_assert_nonnull(cache.lookup(0, 0, false));
+}
+
+int
+main(int argc,
+     char* argv[])
+{
+        g_test_init(&argc, &argv, nullptr);
+
+        g_test_add_func("/vte/color-cache/lookup", test_color_cache_lookup);
+        g_test_add_func("/vte/color-cache/empty", test_color_cache_empty);
+
+        return g_test_run();
+}
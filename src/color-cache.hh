@@ -0,0 +1,122 @@
+/*
+ * Copyright © 2026 The VTE developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+
+namespace vte {
+
+namespace base {
+
+/*
+ * ColorCache:
+ *
+ * Small direct-mapped cache from the colours and the colour related
+ * attribute bits of a cell, and whether it's selected, to the colour
+ * indices they resolve to for painting, see Terminal::determine_colors().
+ *
+ * What they resolve to also depends on the palette and the modes, so
+ * a cache is only for as long as these stay the same, e.g. for a frame.
+ */
+class ColorCache {
+public:
+        static constexpr unsigned int const k_size = 64;
+
+        class Colors {
+        public:
+                uint32_t fore{0};
+                uint32_t back{0};
+                uint32_t deco{0};
+        };
+
+        ColorCache() = default;
+        ColorCache(ColorCache const&) = delete;
+        ColorCache(ColorCache&&) = delete;
+        ColorCache& operator= (ColorCache const&) = delete;
+        ColorCache& operator= (ColorCache&&) = delete;
+
+        /* lookup:
+         *
+         * Returns: the cached colours for the cell colours @colors, attribute
+         *   bits @attr and selectedness @selected, or %nullptr if there are none
+         */
+        Colors const* lookup(uint64_t colors,
+                             uint32_t attr,
+                             bool selected) noexcept
+        {
+                auto const& entry = m_entries[hash(colors, attr)];
+                if (entry.valid &&
+                    entry.colors == colors &&
+                    entry.attr == attr &&
+                    entry.selected == selected) {
+                        ++m_hits;
+                        return &entry.resolved;
+                }
+
+                ++m_misses;
+                return nullptr;
+        }
+
+        /* insert:
+         *
+         * Caches @resolved for @colors, @attr and @selected, evicting
+         * whatever occupied its slot before.
+         */
+        void insert(uint64_t colors,
+                    uint32_t attr,
+                    bool selected,
+                    Colors const& resolved) noexcept
+        {
+                auto& entry = m_entries[hash(colors, attr)];
+                entry.colors = colors;
+                entry.attr = attr;
+                entry.selected = selected;
+                entry.valid = true;
+                entry.resolved = resolved;
+        }
+
+        inline constexpr unsigned long hits() const noexcept { return m_hits; }
+        inline constexpr unsigned long misses() const noexcept { return m_misses; }
+
+private:
+        class Entry {
+        public:
+                uint64_t colors{0};
+                uint32_t attr{0};
+                bool selected{false};
+                bool valid{false};
+                Colors resolved;
+        };
+
+        Entry m_entries[k_size];
+        unsigned long m_hits{0};
+        unsigned long m_misses{0};
+
+        /* The selected and unselected look of a cell share a slot, since
+         * a run of cells rarely changes only in that. */
+        static inline constexpr unsigned int hash(uint64_t colors,
+                                                  uint32_t attr) noexcept
+        {
+                auto const h = (colors ^ (colors >> 29) ^ attr) * uint64_t{0x9e3779b97f4a7c15u};
+                return unsigned(h >> 58) & (k_size - 1);
+        }
+};
+
+} // namespace base
+
+} // namespace vte
@@ -0,0 +1,110 @@
+/*
+ * Copyright © 2026 The VTE developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <glib.h>
+
+#include <string>
+
+#include "damage.hh"
+
+using namespace vte::base;
+
+static std::string
+spans(Damage const& damage)
+{
+        auto str = std::string{};
+        damage.for_each_span([&](Damage::row_t row_start,
+                                 Damage::row_t row_end,
+                                 Damage::column_t column_start,
+                                 Damage::column_t column_end) {
+                char buf[64];
+                g_snprintf(buf, sizeof(buf), "%ld-%ld:%ld-%ld;",
+                           row_start, row_end, column_start,
+                           column_end == Damage::k_all_columns ? -1 : column_end);
+                str.append(buf);
+        });
+        return str;
+}
+
+static void
+test_damage_add(void)
+{
+        auto damage = Damage{};
+        damage.reset(100, 24);
+        g_assert_true(damage.empty());
+
+        /* A status line at the top and text at the bottom stay apart */
+        damage.add(100, 100, 0, 80);
+        damage.add(122, 122, 3, 10);
+        g_assert_false(damage.empty());
+        g_assert_true(damage.is_dirty(100));
+        g_assert_false(damage.is_dirty(101));
+        g_assert_true(damage.is_dirty(122));
+        g_assert_cmpstr(spans(damage).c_str(), ==, "100-100:0-80;122-122:3-10;");
+
+        /* Column ranges of the same row are merged */
+        damage.add(122, 122, 20, 30);
+        g_assert_cmpstr(spans(damage).c_str(), ==, "100-100:0-80;122-122:3-30;");
+
+        /* Rows outside of the window are ignored */
+        damage.add(90, 99);
+        damage.add(124, 200);
+        damage.add(0, 0, 5, 5);
+        g_assert_cmpstr(spans(damage).c_str(), ==, "100-100:0-80;122-122:3-30;");
+
+        damage.clear();
+        g_assert_true(damage.empty());
+        g_assert_false(damage.is_dirty(100));
+        g_assert_cmpstr(spans(damage).c_str(), ==, "");
+}
+
+static void
+test_damage_spans(void)
+{
+        auto damage = Damage{};
+        damage.reset(0, 130);
+
+        /* Consecutive rows with the same columns make one span, also
+         * across the words of the bitmap. */
+        damage.add(60, 70);
+        damage.add(71, 71, 0, 10);
+        damage.add(72, 72, 0, 10);
+        damage.add(74, 74, 0, 10);
+        damage.add(127, 129);
+        g_assert_cmpstr(spans(damage).c_str(), ==,
+                        "60-70:0--1;71-72:0-10;74-74:0-10;127-129:0--1;");
+
+        /* Moving the window clears it */
+        damage.reset(10, 4);
+        g_assert_true(damage.empty());
+        damage.add(0, 100);
+        g_assert_cmpstr(spans(damage).c_str(), ==, "10-13:0--1;");
+}
+
+int
+main(int argc,
+     char* argv[])
+{
+        g_test_init(&argc, &argv, nullptr);
+
+        g_test_add_func("/vte/damage/add", test_damage_add);
+        g_test_add_func("/vte/damage/spans", test_damage_spans);
+
+        return g_test_run();
+}
@@ -0,0 +1,185 @@
+/*
+ * Copyright © 2026 The VTE developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+namespace vte {
+
+namespace base {
+
+/*
+ * Damage:
+ *
+ * The rows of a window (normally, the displayed rows) that need to be
+ * repainted, as a bitmap, together with the range of columns that
+ * changed in each of them.
+ *
+ * Unlike a bounding box, this keeps updates to distant rows (say, a
+ * status line at the top and text at the bottom) apart, and only merges
+ * consecutive rows with the same column range when it comes to emitting
+ * rectangles.
+ */
+class Damage {
+public:
+        using row_t = long;
+        using column_t = long;
+
+        static constexpr column_t const k_all_columns = std::numeric_limits<int>::max();
+
+        Damage() = default;
+        Damage(Damage const&) = delete;
+        Damage(Damage&&) = delete;
+        Damage& operator= (Damage const&) = delete;
+        Damage& operator= (Damage&&) = delete;
+
+        /* reset:
+         * @origin: the first row of the window
+         * @n_rows: the number of rows in the window
+         *
+         * Clears the damage, and moves the window.
+         */
+        void reset(row_t origin,
+                   row_t n_rows)
+        {
+                clear();
+                m_origin = origin;
+                m_n_rows = std::max(n_rows, row_t{0});
+                m_bits.assign((m_n_rows + 63) / 64, 0);
+                m_columns.resize(m_n_rows);
+        }
+
+        void clear() noexcept
+        {
+                if (m_n_dirty == 0)
+                        return;
+
+                std::fill(std::begin(m_bits), std::end(m_bits), 0);
+                m_n_dirty = 0;
+        }
+
+        inline constexpr bool empty() const noexcept { return m_n_dirty == 0; }
+        inline constexpr row_t origin() const noexcept { return m_origin; }
+        inline constexpr row_t n_rows() const noexcept { return m_n_rows; }
+
+        /* add:
+         * @row_start: the first row
+         * @row_end: the last row (inclusive)
+         * @column_start: the first column
+         * @column_end: the column after the last one
+         *
+         * Adds the given cells to the damage. Rows outside of the window
+         * are ignored.
+         */
+        void add(row_t row_start,
+                 row_t row_end,
+                 column_t column_start = 0,
+                 column_t column_end = k_all_columns) noexcept
+        {
+                row_start = std::max(row_start - m_origin, row_t{0});
+                row_end = std::min(row_end - m_origin, m_n_rows - 1);
+                if (row_end < row_start || column_end <= column_start)
+                        return;
+
+                for (auto row = row_start; row <= row_end; ++row) {
+                        auto& columns = m_columns[row];
+                        auto& word = m_bits[row / 64];
+                        auto const bit = uint64_t{1} << (row % 64);
+                        if (word & bit) {
+                                columns.start = std::min(columns.start, column_start);
+                                columns.end = std::max(columns.end, column_end);
+                        } else {
+                                word |= bit;
+                                columns.start = column_start;
+                                columns.end = column_end;
+                                ++m_n_dirty;
+                        }
+                }
+        }
+
+        inline bool is_dirty(row_t row) const noexcept
+        {
+                row -= m_origin;
+                return row >= 0 && row < m_n_rows &&
+                        (m_bits[row / 64] & (uint64_t{1} << (row % 64))) != 0;
+        }
+
+        /* for_each_span:
+         * @func: called with the first and last (inclusive) row, and the
+         *   start and end column of each span
+         *
+         * Calls @func for each maximal span of consecutive dirty rows
+         * with the same column range, from the top.
+         */
+        template<typename F>
+        void for_each_span(F&& func) const
+        {
+                auto have_span = false;
+                auto span_start = row_t{0}, span_end = row_t{0};
+                auto span_columns = Columns{};
+
+                for (auto w = size_t{0}; w < m_bits.size(); ++w) {
+                        auto word = m_bits[w];
+                        while (word != 0) {
+                                auto const row = row_t(w * 64 + __builtin_ctzll(word));
+                                word &= word - 1;
+
+                                auto const& columns = m_columns[row];
+                                if (have_span &&
+                                    row == span_end + 1 &&
+                                    columns.start == span_columns.start &&
+                                    columns.end == span_columns.end) {
+                                        span_end = row;
+                                        continue;
+                                }
+
+                                if (have_span)
+                                        func(m_origin + span_start, m_origin + span_end,
+                                             span_columns.start, span_columns.end);
+
+                                have_span = true;
+                                span_start = span_end = row;
+                                span_columns = columns;
+                        }
+                }
+
+                if (have_span)
+                        func(m_origin + span_start, m_origin + span_end,
+                             span_columns.start, span_columns.end);
+        }
+
+private:
+        class Columns {
+        public:
+                column_t start{0};
+                column_t end{0};
+        };
+
+        row_t m_origin{0};
+        row_t m_n_rows{0};
+        row_t m_n_dirty{0};
+        std::vector<uint64_t> m_bits{};
+        std::vector<Columns> m_columns{};
+};
+
+} // namespace base
+
+} // namespace vte
@@ -31,6 +31,7 @@
 
 #include <string>
 
+#include "bench.hh"
 #include "debug.h"
 #include "glib-glue.hh"
 #include "icu-decoder.hh"
@@ -43,8 +44,10 @@ class Options {
 private:
         bool m_benchmark{false};
         bool m_codepoints{false};
+        bool m_json{false};
         bool m_list{false};
         bool m_quiet{false};
+        bool m_single_byte{false};
         bool m_statistics{false};
         bool m_utf8{false};
         int m_repeat{1};
@@ -84,9 +87,11 @@ public:
 
         inline constexpr bool benchmark()  const noexcept { return m_benchmark;  }
         inline constexpr bool codepoints() const noexcept { return m_codepoints; }
+        inline constexpr bool json()       const noexcept { return m_json;       }
         inline constexpr bool list()       const noexcept { return m_list;       }
         inline constexpr bool statistics() const noexcept { return m_statistics; }
         inline constexpr int  quiet()      const noexcept { return m_quiet;      }
+        inline constexpr bool single_byte() const noexcept { return m_single_byte; }
         inline constexpr bool utf8()       const noexcept { return m_utf8;       }
         inline constexpr int  repeat()     const noexcept { return m_repeat;     }
         inline constexpr char const* charset()          const noexcept { return m_charset;   }
@@ -99,8 +104,10 @@ public:
                 {
                         auto benchmark = BoolArg{&m_benchmark, false};
                         auto codepoints = BoolArg{&m_codepoints, false};
+                        auto json = BoolArg{&m_json, false};
                         auto list = BoolArg{&m_list, false};
                         auto quiet = BoolArg{&m_quiet, false};
+                        auto single_byte = BoolArg{&m_single_byte, false};
                         auto statistics = BoolArg{&m_statistics, false};
                         auto utf8 = BoolArg{&m_utf8, false};
                         auto repeat = IntArg{&m_repeat, 1};
@@ -113,12 +120,16 @@ public:
                                   "Output unicode code points by number", nullptr },
                                 { "charset", 'f', 0, G_OPTION_ARG_STRING, charset.ptr(),
                                   "Input charset", "CHARSET" },
+                                { "json", 'j', 0, G_OPTION_ARG_NONE, json.ptr(),
+                                  "Output benchmark and statistics as JSON instead of the decoded input", nullptr },
                                 { "list-charsets", 'l', 0, G_OPTION_ARG_NONE, list.ptr(),
                                   "List available charsets", nullptr },
                                 { "quiet", 'q', 0, G_OPTION_ARG_NONE, quiet.ptr(),
                                   "Suppress output except for statistics and benchmark", nullptr },
                                 { "repeat", 'r', 0, G_OPTION_ARG_INT, repeat.ptr(),
                                   "Repeat each file COUNT times", "COUNT" },
+                                { "single-byte", '1', 0, G_OPTION_ARG_NONE, single_byte.ptr(),
+                                  "Decode legacy charsets one byte at a time instead of in blocks", nullptr },
                                 { "statistics", 's', 0, G_OPTION_ARG_NONE, statistics.ptr(),
                                   "Output statistics", nullptr },
                                 { "utf-8", '8', 0, G_OPTION_ARG_NONE, utf8.ptr(),
@@ -266,7 +277,18 @@ private:
         gsize m_input_bytes{0};
         gsize m_output_chars{0};
         gsize m_errors{0};
-        GArray* m_bench_times{nullptr};
+        vte::base::Benchmark m_benchmark{"characters"};
+
+        void
+        end_run(int64_t start_time,
+                gsize input_bytes,
+                gsize output_chars)
+        {
+                auto const time_spent = int64_t{g_get_monotonic_time() - start_time};
+                m_benchmark.add(time_spent,
+                                m_input_bytes - input_bytes,
+                                m_output_chars - output_chars);
+        }
 
         template<class Functor>
         void
@@ -278,6 +300,8 @@ private:
                 auto const buf_size = size_t{16384};
                 auto buf = g_new0(uint8_t, buf_size);
 
+                auto const input_bytes = m_input_bytes;
+                auto const output_chars = m_output_chars;
                 auto start_time = g_get_monotonic_time();
 
                 auto buf_start = size_t{0};
@@ -323,8 +347,7 @@ private:
                         m_output_chars++;
                 }
 
-                auto const time_spent = int64_t{g_get_monotonic_time() - start_time};
-                g_array_append_val(m_bench_times, time_spent);
+                end_run(start_time, input_bytes, output_chars);
 
                 g_free(buf);
         }
@@ -333,6 +356,7 @@ private:
         void
         process_file_icu(int fd,
                          vte::base::ICUDecoder* decoder,
+                         bool single_byte,
                          Functor& func)
         {
                 decoder->reset();
@@ -340,6 +364,8 @@ private:
                 auto const buf_size = size_t{16384};
                 auto buf = g_new0(uint8_t, buf_size);
 
+                auto const input_bytes = m_input_bytes;
+                auto const output_chars = m_output_chars;
                 auto start_time = g_get_monotonic_time();
 
                 auto buf_start = size_t{0};
@@ -362,7 +388,8 @@ private:
                                  * since when the decoder runs out of output, this input byte
                                  * *will* be consumed.
                                  */
-                                switch (decoder->decode(&sptr)) {
+                                auto const send = single_byte ? sptr + 1 : sptrend;
+                                switch (decoder->decode(&sptr, send)) {
                                 case vte::base::ICUDecoder::Result::eSomething:
                                         func(decoder->codepoint());
                                         m_output_chars++;
@@ -383,13 +410,12 @@ private:
                 /* Flush remaining output */
                 auto sptr = reinterpret_cast<uint8_t const*>(buf + buf_size);
                 auto result = vte::base::ICUDecoder::Result{};
-                while ((result = decoder->decode(&sptr, true)) == vte::base::ICUDecoder::Result::eSomething) {
+                while ((result = decoder->decode(&sptr, sptr, true)) == vte::base::ICUDecoder::Result::eSomething) {
                         func(decoder->codepoint());
                         m_output_chars++;
                 }
 
-                auto const time_spent = int64_t{g_get_monotonic_time() - start_time};
-                g_array_append_val(m_bench_times, time_spent);
+                end_run(start_time, input_bytes, output_chars);
 
                 g_free(buf);
         }
@@ -416,7 +442,7 @@ private:
                         }
 
                         if (decoder) {
-                                process_file_icu(fd, decoder.get(), func);
+                                process_file_icu(fd, decoder.get(), options.single_byte(), func);
                         } else {
                                 process_file_utf8(fd, func);
                         }
@@ -427,15 +453,8 @@ private:
 
 public:
 
-        Processor() noexcept
-        {
-                m_bench_times = g_array_new(false, true, sizeof(int64_t));
-        }
-
-        ~Processor() noexcept
-        {
-                g_array_free(m_bench_times, true);
-        }
+        Processor() noexcept = default;
+        ~Processor() noexcept = default;
 
         template<class Functor>
         bool
@@ -485,26 +504,21 @@ public:
 
         void print_benchmark() const noexcept
         {
-                g_array_sort(m_bench_times,
-                             [](void const* p1, void const* p2) -> int {
-                                     int64_t const t1 = *(int64_t const*)p1;
-                                     int64_t const t2 = *(int64_t const*)p2;
-                                     return t1 == t2 ? 0 : (t1 < t2 ? -1 : 1);
-                             });
-
-                auto total_time = int64_t{0};
-                for (unsigned int i = 0; i < m_bench_times->len; ++i)
-                        total_time += g_array_index(m_bench_times, int64_t, i);
-
-                g_printerr("\nTimes: best %\'" G_GINT64_FORMAT "µs "
-                           "worst %\'" G_GINT64_FORMAT "µs "
-                           "average %\'" G_GINT64_FORMAT "µs\n",
-                           g_array_index(m_bench_times, int64_t, 0),
-                           g_array_index(m_bench_times, int64_t, m_bench_times->len - 1),
-                           total_time / (int64_t)m_bench_times->len);
-                for (unsigned int i = 0; i < m_bench_times->len; ++i)
-                        g_printerr("  %\'" G_GINT64_FORMAT "µs\n",
-                                   g_array_index(m_bench_times, int64_t, i));
+                m_benchmark.print();
+        }
+
+        /* Prints the benchmark results and statistics as one JSON object to stdout */
+        void print_json() const noexcept
+        {
+                auto str = std::string{"{\"benchmark\":"};
+                m_benchmark.append_json(str);
+                vte::base::Benchmark::append_format(str,
+                                                    ",\"input_bytes\":%" G_GSIZE_FORMAT
+                                                    ",\"output_chars\":%" G_GSIZE_FORMAT
+                                                    ",\"errors\":%" G_GSIZE_FORMAT "}\n",
+                                                    m_input_bytes, m_output_chars, m_errors);
+
+                g_print("%s", str.c_str());
         }
 
 }; // class Processor
@@ -536,7 +550,7 @@ main(int argc,
 
         auto rv = bool{};
         auto proc = Processor{};
-        if (options.quiet()) {
+        if (options.quiet() || options.json()) {
                 auto sink = Sink{};
                 rv = proc.process_files(options, sink);
         } else {
@@ -544,10 +558,14 @@ main(int argc,
                 rv = proc.process_files(options, printer);
         }
 
-        if (options.statistics())
-                proc.print_statistics();
-        if (options.benchmark())
-                proc.print_benchmark();
+        if (options.json()) {
+                proc.print_json();
+        } else {
+                if (options.statistics())
+                        proc.print_statistics();
+                if (options.benchmark())
+                        proc.print_benchmark();
+        }
 
         return rv ? EXIT_SUCCESS : EXIT_FAILURE;
 }
@@ -0,0 +1,86 @@
+/*
+ * Copyright © 2026 The VTE developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <glib.h>
+
+#include <memory>
+
+#include "framestats.hh"
+
+using namespace vte::base;
+
+static void
+test_framestats_commit(void)
+{
+        auto stats = std::make_unique<FrameStats>();
+        g_assert_cmpuint(stats->n_frames(), ==, 0);
+
+        stats->add(FrameStats::Counter::eBytes, 100);
+        stats->add(FrameStats::Counter::eSequences);
+        stats->add(FrameStats::Counter::eSequences);
+        stats->add_elapsed(FrameStats::Stage::eDraw, 5);
+        {
+                FrameStats::Scope scope{*stats, FrameStats::Stage::eProcess};
+        }
+        stats->commit();
+
+        g_assert_cmpuint(stats->n_frames(), ==, 1);
+        auto const& frame = stats->frame(0);
+        g_assert_cmpuint(frame.counters[int(FrameStats::Counter::eBytes)], ==, 100);
+        g_assert_cmpuint(frame.counters[int(FrameStats::Counter::eSequences)], ==, 2);
+        g_assert_cmpuint(frame.counters[int(FrameStats::Counter::eFills)], ==, 0);
+        g_assert_cmpint(frame.elapsed[int(FrameStats::Stage::eDraw)], ==, 5);
+        g_assert_cmpint(frame.elapsed[int(FrameStats::Stage::eProcess)], >=, 0);
+        g_assert_cmpint(frame.time, >, 0);
+
+        /* The next frame starts from nothing */
+        stats->commit();
+        g_assert_cmpuint(stats->n_frames(), ==, 2);
+        g_assert_cmpuint(stats->frame(1).counters[int(FrameStats::Counter::eBytes)], ==, 0);
+        g_assert_cmpuint(stats->frame(0).counters[int(FrameStats::Counter::eBytes)], ==, 100);
+}
+
+static void
+test_framestats_wrap(void)
+{
+        auto const n = FrameStats::k_n_frames;
+        auto stats = std::make_unique<FrameStats>();
+
+        /* Only the last frames are kept, oldest first */
+        for (size_t i = 0; i < n + 10; i++) {
+                stats->add(FrameStats::Counter::eBytes, i);
+                stats->commit();
+        }
+
+        g_assert_cmpuint(stats->n_frames(), ==, n);
+        for (size_t i = 0; i < n; i++)
+                g_assert_cmpuint(stats->frame(i).counters[int(FrameStats::Counter::eBytes)], ==, i + 10);
+}
+
+int
+main(int argc,
+     char* argv[])
+{
+        g_test_init(&argc, &argv, nullptr);
+
+        g_test_add_func("/vte/framestats/commit", test_framestats_commit);
+        g_test_add_func("/vte/framestats/wrap", test_framestats_wrap);
+
+        return g_test_run();
+}
@@ -0,0 +1,145 @@
+/*
+ * Copyright © 2026 The VTE developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <glib.h>
+
+#include <cstddef>
+#include <cstdint>
+
+#include "vtedefines.hh"
+
+namespace vte {
+
+namespace base {
+
+/*
+ * FrameStats:
+ *
+ * Per-terminal counters of the work done for each painted frame, kept
+ * for the last k_n_frames frames. Unlike Profile, it is always enabled;
+ * counting costs an addition, and timing a stage two clock reads.
+ *
+ * The work done between two frames (processing the incoming data,
+ * mostly) is accounted to the frame painted after it.
+ */
+class FrameStats {
+public:
+        static constexpr size_t const k_n_frames = VTE_FRAME_STATS_FRAMES;
+
+        enum class Counter {
+                eBytes,       /* bytes of incoming data parsed */
+                eSequences,   /* control sequences handled */
+                eRowsFrozen,  /* rows written to the scrollback streams */
+                eRowsThawed,  /* rows read back from the scrollback streams */
+                eDrawItems,   /* characters passed to the drawing code */
+                eFills,       /* background rectangles filled */
+                eN
+        };
+
+        enum class Stage {
+                eProcess,   /* processing the incoming data */
+                eRingview,  /* BiDi and shaping of the displayed rows */
+                eDraw,      /* painting the rows */
+                eSignals,   /* emitting the signals, including to the accessibility code */
+                eFrame,     /* all of the painting, including the above stages done for it */
+                eN
+        };
+
+        struct Frame {
+                int64_t time;  /* the monotonic time at the end of the frame, in µs */
+                uint64_t counters[int(Counter::eN)];
+                int64_t elapsed[int(Stage::eN)];  /* in µs */
+        };
+
+        class Scope {
+        public:
+                Scope(FrameStats& stats,
+                      Stage stage) noexcept
+                        : m_stats{stats},
+                          m_stage{stage},
+                          m_start{g_get_monotonic_time()}
+                {
+                }
+
+                ~Scope() noexcept
+                {
+                        m_stats.add_elapsed(m_stage, g_get_monotonic_time() - m_start);
+                }
+
+                Scope(Scope const&) = delete;
+                Scope(Scope&&) = delete;
+                Scope& operator= (Scope const&) = delete;
+                Scope& operator= (Scope&&) = delete;
+
+        private:
+                FrameStats& m_stats;
+                Stage m_stage;
+                int64_t m_start;
+        };
+
+        FrameStats() noexcept = default;
+        FrameStats(FrameStats const&) = delete;
+        FrameStats(FrameStats&&) = delete;
+        FrameStats& operator= (FrameStats const&) = delete;
+        FrameStats& operator= (FrameStats&&) = delete;
+
+        inline void add(Counter counter,
+                        uint64_t n = 1) noexcept
+        {
+                m_current.counters[int(counter)] += n;
+        }
+
+        inline void add_elapsed(Stage stage,
+                                int64_t us) noexcept
+        {
+                m_current.elapsed[int(stage)] += us;
+        }
+
+        /* commit:
+         *
+         * Ends the current frame, and starts the next one.
+         */
+        void commit() noexcept
+        {
+                m_current.time = g_get_monotonic_time();
+                m_frames[m_next] = m_current;
+                m_next = (m_next + 1) % k_n_frames;
+                m_n_frames = MIN(m_n_frames + 1, k_n_frames);
+                m_current = Frame{};
+        }
+
+        /* Returns: the number of frames kept */
+        inline size_t n_frames() const noexcept { return m_n_frames; }
+
+        /* Returns: the @i-th kept frame, oldest first */
+        inline Frame const& frame(size_t i) const noexcept
+        {
+                return m_frames[(m_next + k_n_frames - m_n_frames + i) % k_n_frames];
+        }
+
+private:
+        Frame m_current{};
+        Frame m_frames[k_n_frames]{};
+        size_t m_next{0};      /* where the next frame goes in m_frames */
+        size_t m_n_frames{0};
+};
+
+} // namespace base
+
+} // namespace vte
@@ -20,6 +20,7 @@
 #include "icu-converter.hh"
 
 #include <cassert>
+#include <cstdint>
 #include <memory>
 
 #include <unicode/errorcode.h>
@@ -51,13 +52,13 @@ ICUConverter::make(char const* charset,
         return std::make_unique<ICUConverter>(charset, charset_converter, u32_converter, u8_converter);
 }
 
-std::string
+std::string_view
 ICUConverter::convert(std::string_view const& data)
 {
         /* We can't use ucnv_convertEx since that doesn't support preflighting.
-         * Instead, convert to UTF-16 first, and the to the target, with
-         * preflighting both times. This is slow, but this is the legacy
-         * code path, so we don't care.
+         * Instead, convert to UTF-16 first, and then to the target, into
+         * buffers sized for the worst case, so that no preflighting is
+         * needed; and keep the buffers, since this is done for every input.
          */
 
         if (data.size() == 0)
@@ -65,30 +66,20 @@ ICUConverter::convert(std::string_view const& data)
 
         ucnv_resetToUnicode(m_u8_converter.get());
 
-        auto err = icu::ErrorCode{};
-        auto u16_size = ucnv_toUChars(m_u8_converter.get(),
-                                      nullptr, 0,
-                                      data.data(), data.size(),
-                                      err);
-        if (err.isFailure() && (err.get() != U_BUFFER_OVERFLOW_ERROR)) {
-                _vte_debug_print(VTE_DEBUG_CONVERSION,
-                                 "Error converting from UTF-8 to UTF-16 in preflight: %s\n",
-                                 err.errorName());
+        /* UTF-8 never has fewer bytes than UTF-16 has code units */
+        if (data.size() > size_t(INT32_MAX) ||
+            data.size() > m_u16_buffer.max_size()) // prevent exceptions
                 return {};
-        }
+        if (m_u16_buffer.size() < data.size())
+                m_u16_buffer.resize(data.size());
 
-        auto u16_buffer = std::u16string{};
-        if ((size_t)u16_size > u16_buffer.max_size()) // prevent exceptions
-                return {};
-        u16_buffer.resize(u16_size);
-
-        err.reset();
-        u16_size = ucnv_toUChars(m_u8_converter.get(),
-                                 u16_buffer.data(),
-                                 u16_buffer.size(),
-                                 data.data(),
-                                 data.size(),
-                                 err);
+        auto err = icu::ErrorCode{};
+        auto const u16_size = ucnv_toUChars(m_u8_converter.get(),
+                                            m_u16_buffer.data(),
+                                            m_u16_buffer.size(),
+                                            data.data(),
+                                            data.size(),
+                                            err);
         if (err.isFailure()) {
                 _vte_debug_print(VTE_DEBUG_CONVERSION,
                                  "Error converting from UTF-8 to UTF-16: %s\n",
@@ -97,33 +88,22 @@ ICUConverter::convert(std::string_view const& data)
         }
 
         /* Now convert to target */
-        ucnv_resetFromUnicode(m_charset_converter.get());
-        err.reset();
-        auto target_size = ucnv_fromUChars(m_charset_converter.get(),
-                                           nullptr, 0,
-                                           u16_buffer.data(),
-                                           u16_size,
-                                           err);
-        if (err.isFailure() && (err.get() != U_BUFFER_OVERFLOW_ERROR)) {
-                _vte_debug_print(VTE_DEBUG_CONVERSION,
-                                 "Error converting from UTF-8 to %s in preflight: %s\n",
-                                 m_charset.c_str(),
-                                 err.errorName());
+        auto const max_size = size_t(UCNV_GET_MAX_BYTES_FOR_STRING(size_t(u16_size),
+                                                                   ucnv_getMaxCharSize(m_charset_converter.get())));
+        if (max_size > size_t(INT32_MAX) ||
+            max_size > m_target_buffer.max_size()) // prevent exceptions
                 return {};
-        }
-
-        auto target_buffer = std::string{};
-        if ((size_t)target_size > target_buffer.max_size()) // prevent exceptions
-                return {};
-        target_buffer.resize(target_size);
+        if (m_target_buffer.size() < max_size)
+                m_target_buffer.resize(max_size);
 
+        ucnv_resetFromUnicode(m_charset_converter.get());
         err.reset();
-        target_size = ucnv_fromUChars(m_charset_converter.get(),
-                                      target_buffer.data(),
-                                      target_buffer.capacity(),
-                                      u16_buffer.data(),
-                                      u16_size,
-                                      err);
+        auto const target_size = ucnv_fromUChars(m_charset_converter.get(),
+                                                 m_target_buffer.data(),
+                                                 m_target_buffer.size(),
+                                                 m_u16_buffer.data(),
+                                                 u16_size,
+                                                 err);
         if (err.isFailure()) {
                 _vte_debug_print(VTE_DEBUG_CONVERSION,
                                  "Error converting from UTF-16 to %s: %s\n",
@@ -132,7 +112,7 @@ ICUConverter::convert(std::string_view const& data)
                 return {};
         }
 
-        return target_buffer;
+        return {m_target_buffer.data(), size_t(target_size)};
 }
 
 } // namespace vte::base
@@ -21,6 +21,7 @@
 
 #include <memory>
 #include <string>
+#include <string_view>
 
 #include <unicode/ucnv.h>
 
@@ -61,7 +62,13 @@ public:
         auto u32_converter() noexcept     { return m_u32_converter.get();     }
         auto u8_converter() noexcept      { return m_u8_converter.get();      }
 
-        std::string convert(std::string_view const& data);
+        /* convert:
+         * @data: UTF-8 text
+         *
+         * Returns: @data converted to the charset, in a buffer reused by the
+         *   next call; or an empty view on failure
+         */
+        std::string_view convert(std::string_view const& data);
 
 private:
         std::string m_charset;
@@ -70,6 +77,10 @@ private:
         converter_shared_type m_u8_converter;
         vte::base::ICUDecoder m_decoder;
 
+        /* The buffers for convert(), to reuse their storage */
+        std::u16string m_u16_buffer{};
+        std::string m_target_buffer{};
+
         /* Note that m_decoder will share m_charset_converter and only use it in the
          * toUnicode direction; and m_u32_decoder, and will use that only in the
          * fromUnicode direction.
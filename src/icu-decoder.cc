@@ -19,25 +19,77 @@
 
 #include <glib.h>
 
+#include <algorithm>
 #include <cassert>
 #include <memory>
 
 #include "icu-decoder.hh"
+#include "utf8.hh"
 
 namespace vte::base {
 
+/* Returns: a pointer to the first printable ASCII byte in [@begin, @end),
+ *   or @end if there is none
+ */
+static inline uint8_t const*
+find_printable_ascii(uint8_t const* begin,
+                     uint8_t const* end) noexcept
+{
+        auto p = begin;
+        while (p < end && (*p < 0x20 || *p >= 0x7f))
+                ++p;
+
+        return p;
+}
+
+/*
+ * ICUDecoder::pass_ascii:
+ * @sptr: inout pointer to input data
+ * @send: end of input data
+ *
+ * Copies the run of printable ASCII at *@sptr to the output.
+ *
+ * Returns: whether there is an output character available
+ */
+ICUDecoder::Result
+ICUDecoder::pass_ascii(uint8_t const** sptr,
+                       uint8_t const* send) noexcept
+{
+        auto const start = *sptr;
+        auto const end = find_printable_ascii_end(start, send);
+        auto const n = int(end - start);
+        if (n == 0)
+                return Result::eNothing;
+
+        for (auto i = 0; i < n; ++i)
+                m_u32_buffer[i] = start[i];
+
+        *sptr = end;
+        m_available = n;
+        m_index = 0;
+        m_state = State::eOutput;
+        return Result::eSomething;
+}
+
 /*
  * ICUDecoder::decode:
  * @sptr: inout pointer to input data
+ * @send: end of input data
  * @flush: whether to flush
  *
  * Decodes input, and advances *@sptr for input consumed. At most
- * one byte of input is consumed; if flushing, no input is consumed.
+ * k_block_size bytes of input are consumed; if flushing, no input is
+ * consumed.
+ *
+ * In an ASCII compatible charset, each call either copies a run of printable
+ * ASCII, or converts the input up to the next one; so that the caller gets
+ * to see the printable ASCII at a place where can_pass_ascii() is true too.
  *
  * Returns: whether there is an output character available
  */
 ICUDecoder::Result
 ICUDecoder::decode(uint8_t const** sptr,
+                   uint8_t const* send,
                    bool flush) noexcept
 {
         switch (m_state) {
@@ -48,6 +100,13 @@ ICUDecoder::decode(uint8_t const** sptr,
                 m_state = State::eInput;
                 [[fallthrough]];
         case State::eInput: {
+                auto const limit = flush ? *sptr : *sptr + std::min(size_t(send - *sptr), k_block_size);
+
+                if (!flush && can_pass_ascii()) {
+                        if (auto const r = pass_ascii(sptr, limit); r == Result::eSomething)
+                                return r;
+                }
+
                 /* Convert in two stages from charset to UTF-32, pivoting through UTF-16.
                  * This is similar to ucnv_convertEx(), but that API does not fit our
                  * requirements completely.
@@ -59,7 +118,15 @@ ICUDecoder::decode(uint8_t const** sptr,
 
                 auto source_ptr = reinterpret_cast<char const**>(sptr);
                 auto source_start = *source_ptr;
-                auto source_limit = source_start + (1 - flush);
+                auto source_limit = source_start;
+                if (!flush) {
+                        /* Stop before the next printable ASCII, but convert at least
+                         * a byte, which may be a trail byte completing a character.
+                         */
+                        source_limit = m_ascii_compatible
+                                ? reinterpret_cast<char const*>(find_printable_ascii(*sptr + 1, limit))
+                                : reinterpret_cast<char const*>(limit);
+                }
 
                 auto target_u16_start = u16_buffer();
                 auto target_u16_limit = u16_buffer_end();
@@ -75,12 +142,11 @@ ICUDecoder::decode(uint8_t const** sptr,
 
                 /* There should be no error here. We use the default callback
                  * which replaces invalid input with replacment character (either
-                 * U+FFFD or SUB), and we should never hit U_BUFFER_OVERFLOW_ERROR,
-                 * since we process only one input byte at a time and the output
-                 * buffer holds at most 1 UTF-16 character (a high surrogate), and
-                 * there are no charsets where the state is so deep as to suddently
-                 * output 32 characters.
+                 * U+FFFD or SUB). If the output fills the buffer, the converter
+                 * keeps the rest, and outputs it first on the next call.
                  */
+                if (m_err.get() == U_BUFFER_OVERFLOW_ERROR)
+                        m_err.reset();
                 if (m_err.isFailure()) {
                         m_state = State::eError;
                         return Result::eError;
@@ -128,6 +194,7 @@ ICUDecoder::decode(uint8_t const** sptr,
                 assert(m_available >= 1);
 
                 m_index = 0;
+                m_state = State::eOutput;
                 return Result::eSomething;
         }
 
@@ -137,6 +204,68 @@ ICUDecoder::decode(uint8_t const** sptr,
         }
 }
 
+bool
+ICUDecoder::can_pass_ascii() const noexcept
+{
+        if (!m_ascii_compatible || m_state != State::eInput)
+                return false;
+
+        auto err = icu::ErrorCode{};
+        return ucnv_toUCountPending(m_charset_converter.get(), err) == 0 && err.isSuccess();
+}
+
+/*
+ * ICUDecoder::is_ascii_compatible:
+ * @converter: a #UConverter
+ *
+ * Returns: whether the charset is stateless, and decodes each printable
+ *   ASCII byte outside of a multi-byte character to itself
+ */
+bool
+ICUDecoder::is_ascii_compatible(UConverter* converter) noexcept
+{
+        switch (ucnv_getType(converter)) {
+        case UCNV_SBCS:
+        case UCNV_DBCS:
+        case UCNV_MBCS:
+        case UCNV_LATIN_1:
+        case UCNV_UTF8:
+        case UCNV_US_ASCII:
+                break;
+        default:
+                /* Stateful, or not byte oriented */
+                return false;
+        }
+
+        /* Check the mapping, using a fresh converter so as not to disturb
+         * @converter's state. E.g. some Shift_JIS variants map 0x5c to YEN SIGN.
+         */
+        auto err = icu::ErrorCode{};
+        auto const name = ucnv_getName(converter, err);
+        if (err.isFailure())
+                return false;
+
+        auto cnv = std::unique_ptr<UConverter, decltype(&ucnv_close)>{ucnv_open(name, err), &ucnv_close};
+        if (err.isFailure())
+                return false;
+
+        char ascii[0x7f - 0x20];
+        for (auto i = 0; i < int(sizeof(ascii)); ++i)
+                ascii[i] = char(0x20 + i);
+
+        char16_t u16[sizeof(ascii)];
+        auto const n = ucnv_toUChars(cnv.get(), u16, G_N_ELEMENTS(u16), ascii, sizeof(ascii), err);
+        if (err.isFailure() || n != int(sizeof(ascii)))
+                return false;
+
+        for (auto i = 0; i < n; ++i) {
+                if (u16[i] != char16_t(ascii[i]))
+                        return false;
+        }
+
+        return true;
+}
+
 void
 ICUDecoder::reset() noexcept
 {
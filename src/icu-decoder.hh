@@ -17,6 +17,8 @@
 
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
 #include <memory>
 
 #include <unicode/errorcode.h>
@@ -27,17 +29,23 @@ namespace vte::base {
 /*
  * vte::base::Decoder:
  *
- * Converts input from any ICU-supported charset to UTF-32, one input byte at a time.
+ * Converts input from any ICU-supported charset to UTF-32, a block of input
+ * at a time; runs of printable ASCII in ASCII compatible charsets are copied
+ * instead of converted.
  */
 class ICUDecoder {
 public:
 
         using converter_shared_type = std::shared_ptr<UConverter>;
 
+        /* The most input bytes decoded at once */
+        static constexpr size_t const k_block_size = 1024;
+
         ICUDecoder(converter_shared_type charset_converter,
                    converter_shared_type u32_converter)
                 : m_charset_converter{charset_converter},
-                  m_u32_converter{u32_converter}
+                  m_u32_converter{u32_converter},
+                  m_ascii_compatible{is_ascii_compatible(charset_converter.get())}
         { }
 
         ~ICUDecoder() noexcept { }
@@ -64,10 +72,24 @@ public:
         constexpr auto codepoint() const noexcept { return m_u32_buffer[m_index]; }
 
         Result decode(uint8_t const** sptr,
+                      uint8_t const* send,
                       bool flush = false) noexcept;
 
+        /* Decodes at most one byte of input */
+        inline Result decode(uint8_t const** sptr,
+                             bool flush = false) noexcept
+        {
+                return decode(sptr, *sptr + 1, flush);
+        }
+
         void reset() noexcept;
 
+        /* Whether printable ASCII input at the current position decodes to
+         * itself, i.e. the charset is ASCII compatible and no partial
+         * character is pending; so that it may bypass the decoder.
+         */
+        bool can_pass_ascii() const noexcept;
+
 private:
         enum class State {
                 eInput  = 0,
@@ -80,22 +102,32 @@ private:
         converter_shared_type m_charset_converter;
         converter_shared_type m_u32_converter;
 
+        bool m_ascii_compatible{false};
+
+        static bool is_ascii_compatible(UConverter* converter) noexcept;
+
         icu::ErrorCode m_err{};
 
         int m_available{0}; /* how many output characters are available */
         int m_index{0};     /* index of current output character in m_u32_buffer */
 
-        /* 32 is large enough to avoid UCNV_EXT_MAX_UCHARS and UCNV_ERROR_BUFFER_LENGTH,
-         * see comment in icu4c/source/common/ucnv.cpp:ucnv_convertEx().
+        /* Large enough to avoid UCNV_EXT_MAX_UCHARS and UCNV_ERROR_BUFFER_LENGTH,
+         * see comment in icu4c/source/common/ucnv.cpp:ucnv_convertEx(); the UTF-16
+         * conversion may still overflow, but ICU keeps the excess for the next
+         * call. The UTF-32 one can't, since it outputs at most one character
+         * per UTF-16 code unit.
          */
-        char32_t m_u32_buffer[32];
-        char16_t m_u16_buffer[32];
+        char32_t m_u32_buffer[k_block_size];
+        char16_t m_u16_buffer[k_block_size];
 
         constexpr auto u16_buffer() noexcept { return &m_u16_buffer[0]; }
         constexpr auto u32_buffer() noexcept { return &m_u32_buffer[0]; }
 
-        constexpr auto u16_buffer_end() const noexcept { return &m_u16_buffer[0] + 32; }
-        constexpr auto u32_buffer_end() const noexcept { return &m_u32_buffer[0] + 32; }
+        constexpr auto u16_buffer_end() const noexcept { return &m_u16_buffer[0] + k_block_size; }
+        constexpr auto u32_buffer_end() const noexcept { return &m_u32_buffer[0] + k_block_size; }
+
+        Result pass_ascii(uint8_t const** sptr,
+                          uint8_t const* send) noexcept;
 
 }; // class ICUDecoder
 
@@ -0,0 +1,220 @@
+/*
+ * Copyright © 2026 The VTE developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <glib.h>
+
+#include <string>
+#include <vector>
+
+#include "image.hh"
+#include "sixel.hh"
+
+using namespace std::literals;
+using namespace vte::base;
+
+static bool
+decode(std::u32string const& data,
+       std::vector<uint32_t>& pixels,
+       unsigned& width,
+       unsigned& height,
+       bool transparent = false)
+{
+        SixelDecoder decoder;
+        decoder.begin(transparent);
+        /* In pieces, as the parser hands them out */
+        for (auto i = size_t{0}; i < data.size(); i += 3)
+                decoder.feed(std::u32string_view{data}.substr(i, 3));
+
+        return decoder.finish(0xff000000u, pixels, width, height);
+}
+
+static void
+test_sixel_basic(void)
+{
+        std::vector<uint32_t> pixels;
+        unsigned width, height;
+
+        /* Select red in RGB, then a column with the top and bottom pixels set */
+        g_assert_true(decode(U"#1;2;100;0;0#1`"s, pixels, width, height));
+        g_assert_cmpuint(width, ==, 1);
+        g_assert_cmpuint(height, ==, 6);
+        g_assert_cmphex(pixels[0], ==, 0xffff0000u);
+        g_assert_cmphex(pixels[1], ==, 0xff000000u);
+        g_assert_cmphex(pixels[5], ==, 0xffff0000u);
+
+        /* Repeat, and the carriage return drawing over the same sixels */
+        g_assert_true(decode(U"#2;2;0;100;0!4~$#3;2;0;0;100??@"s, pixels, width, height));
+        g_assert_cmpuint(width, ==, 4);
+        g_assert_cmpuint(height, ==, 6);
+        g_assert_cmphex(pixels[0], ==, 0xff00ff00u);
+        g_assert_cmphex(pixels[2], ==, 0xff0000ffu);
+        g_assert_cmphex(pixels[3], ==, 0xff00ff00u);
+
+        /* The next line starts six pixels down */
+        g_assert_true(decode(U"~-~"s, pixels, width, height));
+        g_assert_cmpuint(width, ==, 1);
+        g_assert_cmpuint(height, ==, 12);
+
+        /* HLS, with blue at 0° */
+        g_assert_true(decode(U"#4;1;0;50;100@"s, pixels, width, height));
+        g_assert_cmphex(pixels[0], ==, 0xff0000ffu);
+        g_assert_true(decode(U"#4;1;120;50;100@"s, pixels, width, height));
+        g_assert_cmphex(pixels[0], ==, 0xffff0000u);
+
+        /* Nothing drawn */
+        g_assert_false(decode(U"#1"s, pixels, width, height));
+}
+
+static void
+test_sixel_raster(void)
+{
+        std::vector<uint32_t> pixels;
+        unsigned width, height;
+
+        /* The raster attributes give the size, even where not drawn */
+        g_assert_true(decode(U"\"1;1;10;8#1;2;100;100;100~"s, pixels, width, height, true));
+        g_assert_cmpuint(width, ==, 10);
+        g_assert_cmpuint(height, ==, 8);
+        g_assert_cmphex(pixels[0], ==, 0xffffffffu);
+        g_assert_cmphex(pixels[1], ==, 0);
+        g_assert_cmphex(pixels[7 * 10 + 9], ==, 0);
+
+        /* The size is limited */
+        g_assert_true(decode(U"!100000~"s, pixels, width, height));
+        g_assert_cmpuint(width, ==, VTE_SIXEL_MAX_WIDTH);
+        g_assert_cmpuint(height, ==, 6);
+
+        /* A tall strip, growing only downwards */
+        auto strip = std::u32string{};
+        for (auto i = 0; i < 100; ++i)
+                strip += U"~-"s;
+        g_assert_true(decode(strip, pixels, width, height));
+        g_assert_cmpuint(width, ==, 1);
+        g_assert_cmpuint(height, ==, 6 * 100);
+}
+
+static std::vector<uint32_t>
+make_pixels(unsigned width,
+            unsigned height)
+{
+        auto pixels = std::vector<uint32_t>(size_t(width) * height);
+        for (auto i = size_t{0}; i < pixels.size(); ++i)
+                pixels[i] = 0xff000000u | (i / 64 % 4) * 0x404040u;
+        return pixels;
+}
+
+static void
+test_image_compress(void)
+{
+        auto image = Image{make_pixels(64, 64), 64, 64, 0, 10, 0, 4, 8};
+        auto const pixels = std::vector<uint32_t>{image.pixels(), image.pixels() + 64 * 64};
+        auto const size = image.size();
+        g_assert_cmpuint(size, ==, 64 * 64 * 4);
+
+        g_assert_true(image.compress());
+        g_assert_true(image.compressed());
+        g_assert_cmpuint(image.size(), <, size);
+
+        g_assert_true(image.uncompress());
+        g_assert_false(image.compressed());
+        g_assert_cmpuint(image.size(), ==, size);
+        g_assert_true(std::equal(pixels.begin(), pixels.end(), image.pixels()));
+}
+
+static void
+destroy_surface(void* data)
+{
+        ++*reinterpret_cast<int*>(data);
+}
+
+static void
+test_image_cache(void)
+{
+        auto const image_size = size_t{64 * 64 * 4};
+        auto const budget = image_size * 5 / 2;
+        auto cache = ImageCache{budget};
+
+        /* An image covering an older one replaces it */
+        cache.add(make_pixels(64, 64), 64, 64, 0, 10, 2, 2, 2);
+        cache.add(make_pixels(64, 64), 64, 64, 0, 10, 0, 4, 8);
+        g_assert_cmpuint(cache.n_images(), ==, 1);
+        g_assert_cmpuint(cache.size(), ==, image_size);
+
+        /* The surface is dropped when the pixels are compressed */
+        auto n_destroyed = 0;
+        cache.for_each_shown(0, 0, 100, [&](Image& image) {
+                g_assert_false(image.compressed());
+                image.set_surface(&n_destroyed, destroy_surface);
+        });
+
+        /* Over the budget, the least recently shown are compressed */
+        cache.add(make_pixels(64, 64), 64, 64, 1, 10, 0, 4, 8);
+        cache.add(make_pixels(64, 64), 64, 64, 0, 20, 0, 4, 8);
+        g_assert_cmpuint(cache.n_images(), ==, 3);
+        g_assert_cmpuint(cache.size(), <=, budget);
+        g_assert_cmpint(n_destroyed, ==, 1);
+
+        auto n_shown = 0;
+        cache.for_each(0, 12, 13, [&](Image const& image) {
+                g_assert_cmpint(image.row(), ==, 10);
+                ++n_shown;
+        });
+        g_assert_cmpint(n_shown, ==, 1);
+
+        /* Shown in the order they were added */
+        auto last_id = uint64_t{0};
+        n_shown = 0;
+        cache.for_each_shown(0, 0, 100, [&](Image& image) {
+                g_assert_false(image.compressed());
+                g_assert_cmpuint(image.id(), >, last_id);
+                last_id = image.id();
+                ++n_shown;
+        });
+        g_assert_cmpint(n_shown, ==, 2);
+
+        /* The images scrolled off are compressed, the ones outside the ring dropped */
+        cache.prune(0, 12, 100, 20);
+        g_assert_cmpuint(cache.n_images(), ==, 3);
+        cache.for_each(0, [&](Image& image) {
+                g_assert_true(image.compressed() == (image.row() == 10));
+        });
+        cache.prune(0, 14, 100, 20);
+        g_assert_cmpuint(cache.n_images(), ==, 2);
+
+        cache.remove_rows(1, 0, 11);
+        g_assert_cmpuint(cache.n_images(), ==, 1);
+
+        cache.clear();
+        g_assert_true(cache.empty());
+        g_assert_cmpuint(cache.size(), ==, 0);
+}
+
+int
+main(int argc,
+     char* argv[])
+{
+        g_test_init(&argc, &argv, nullptr);
+
+        g_test_add_func("/vte/sixel/basic", test_sixel_basic);
+        g_test_add_func("/vte/sixel/raster", test_sixel_raster);
+        g_test_add_func("/vte/image/compress", test_image_compress);
+        g_test_add_func("/vte/image/cache", test_image_cache);
+
+        return g_test_run();
+}
@@ -0,0 +1,228 @@
+/*
+ * Copyright © 2026 The VTE developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "image.hh"
+
+#include <zlib.h>
+
+namespace vte {
+
+namespace base {
+
+static uint64_t next_image_id = 1;
+
+Image::Image(std::vector<uint32_t>&& pixels,
+             unsigned width,
+             unsigned height,
+             int screen,
+             long row,
+             long column,
+             long n_rows,
+             long n_columns) noexcept
+        : m_id{next_image_id++},
+          m_width{width},
+          m_height{height},
+          m_screen{screen},
+          m_row{row},
+          m_column{column},
+          m_n_rows{n_rows},
+          m_n_columns{n_columns},
+          m_pixels{std::move(pixels)}
+{
+        g_assert_cmpuint(m_pixels.size(), ==, size_t(width) * height);
+}
+
+Image::~Image() noexcept
+{
+        drop_surface();
+}
+
+size_t
+Image::size() const noexcept
+{
+        return compressed() ? m_compressed.size() : m_pixels.size() * sizeof(m_pixels[0]);
+}
+
+void
+Image::drop_surface() noexcept
+{
+        if (m_surface == nullptr)
+                return;
+
+        m_surface_destroy(m_surface);
+        m_surface = nullptr;
+        m_surface_destroy = nullptr;
+}
+
+void
+Image::set_surface(void* surface,
+                   GDestroyNotify destroy) noexcept
+{
+        drop_surface();
+        m_surface = surface;
+        m_surface_destroy = destroy;
+}
+
+bool
+Image::compress() noexcept
+{
+        if (compressed())
+                return true;
+
+        auto const len = m_pixels.size() * sizeof(m_pixels[0]);
+        auto data = std::vector<uint8_t>(compressBound(len));
+        auto data_len = uLongf(data.size());
+        /* Images compress well even at the fastest level */
+        if (compress2(data.data(), &data_len,
+                      reinterpret_cast<Bytef const*>(m_pixels.data()), len,
+                      1) != Z_OK ||
+            data_len >= len)
+                return false;
+
+        drop_surface();
+        data.resize(data_len);
+        data.shrink_to_fit();
+        m_compressed = std::move(data);
+        m_pixels = std::vector<uint32_t>{};
+        return true;
+}
+
+bool
+Image::uncompress() noexcept
+{
+        if (!compressed())
+                return true;
+
+        auto pixels = std::vector<uint32_t>(size_t(m_width) * m_height);
+        auto const len = pixels.size() * sizeof(pixels[0]);
+        auto pixels_len = uLongf(len);
+        if (::uncompress(reinterpret_cast<Bytef*>(pixels.data()), &pixels_len,
+                         m_compressed.data(), m_compressed.size()) != Z_OK ||
+            pixels_len != len)
+                return false;
+
+        m_pixels = std::move(pixels);
+        m_compressed = std::vector<uint8_t>{};
+        return true;
+}
+
+Image&
+ImageCache::add(std::vector<uint32_t>&& pixels,
+                unsigned width,
+                unsigned height,
+                int screen,
+                long row,
+                long column,
+                long n_rows,
+                long n_columns) noexcept
+{
+        m_images.emplace_front(std::move(pixels), width, height,
+                               screen, row, column, n_rows, n_columns);
+        auto& image = m_images.front();
+        m_size += image.size();
+
+        for (auto it = std::next(m_images.begin()); it != m_images.end(); ) {
+                auto const next = std::next(it);
+                if (image.covers(*it))
+                        remove(m_images, it);
+                it = next;
+        }
+
+        trim();
+        return image;
+}
+
+bool
+ImageCache::uncompress(Image& image) noexcept
+{
+        auto const size = image.size();
+        if (!image.uncompress())
+                return false;
+
+        m_size = m_size - size + image.size();
+        return true;
+}
+
+void
+ImageCache::remove(std::list<Image>& list,
+                   std::list<Image>::iterator it) noexcept
+{
+        m_size -= it->size();
+        list.erase(it);
+}
+
+void
+ImageCache::trim() noexcept
+{
+        /* Compress the least recently shown images first… */
+        for (auto it = m_images.rbegin(); m_size > m_budget && it != m_images.rend(); ++it) {
+                auto const size = it->size();
+                if (it->compress())
+                        m_size = m_size - size + it->size();
+        }
+
+        /* … and only then drop them */
+        while (m_size > m_budget && !m_images.empty())
+                remove(m_images, std::prev(m_images.end()));
+}
+
+void
+ImageCache::prune(int screen,
+                  long start,
+                  long end,
+                  long scrollback_end) noexcept
+{
+        for (auto it = m_images.begin(); it != m_images.end(); ) {
+                auto const next = std::next(it);
+                if (it->screen() == screen) {
+                        if (!it->intersects(start, end)) {
+                                remove(m_images, it);
+                        } else if (it->end_row() <= scrollback_end && !it->compressed()) {
+                                auto const size = it->size();
+                                if (it->compress())
+                                        m_size = m_size - size + it->size();
+                        }
+                }
+                it = next;
+        }
+}
+
+void
+ImageCache::remove_rows(int screen,
+                        long start,
+                        long end) noexcept
+{
+        for (auto it = m_images.begin(); it != m_images.end(); ) {
+                auto const next = std::next(it);
+                if (it->screen() == screen && it->intersects(start, end))
+                        remove(m_images, it);
+                it = next;
+        }
+}
+
+void
+ImageCache::clear() noexcept
+{
+        m_images.clear();
+        m_size = 0;
+}
+
+} // namespace base
+
+} // namespace vte
@@ -0,0 +1,278 @@
+/*
+ * Copyright © 2026 The VTE developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <vector>
+
+#include <glib.h>
+
+#include "vtedefines.hh"
+
+namespace vte {
+
+namespace base {
+
+/*
+ * Image:
+ *
+ * An image placed on a screen, covering @n_rows rows from the absolute
+ * ring row @row, and @n_columns columns from @column. It keeps its
+ * pixels, in premultiplied ARGB32, either as they are or compressed.
+ *
+ * The Terminal keeps its cairo surface of the pixels with the image; it
+ * is dropped whenever the pixels are compressed.
+ */
+class Image {
+public:
+        Image(std::vector<uint32_t>&& pixels,
+              unsigned width,
+              unsigned height,
+              int screen,
+              long row,
+              long column,
+              long n_rows,
+              long n_columns) noexcept;
+        ~Image() noexcept;
+
+        Image(Image const&) = delete;
+        Image(Image&&) = delete;
+        Image& operator= (Image const&) = delete;
+        Image& operator= (Image&&) = delete;
+
+        /* Returns: a number identifying the image among all the images */
+        inline uint64_t id() const noexcept { return m_id; }
+
+        inline unsigned width() const noexcept { return m_width; }
+        inline unsigned height() const noexcept { return m_height; }
+        inline unsigned stride() const noexcept { return m_width * 4; }
+
+        inline int screen() const noexcept { return m_screen; }
+        inline long row() const noexcept { return m_row; }
+        inline long column() const noexcept { return m_column; }
+        inline long n_rows() const noexcept { return m_n_rows; }
+        inline long n_columns() const noexcept { return m_n_columns; }
+        inline long end_row() const noexcept { return m_row + m_n_rows; }
+
+        inline void set_position(long row,
+                                 long column) noexcept
+        {
+                m_row = row;
+                m_column = column;
+        }
+
+        /* Returns: whether the image covers any of the rows @start..@end (exclusive) */
+        inline bool intersects(long start,
+                               long end) const noexcept
+        {
+                return m_row < end && end_row() > start;
+        }
+
+        /* Returns: whether @other is entirely under this image */
+        inline bool covers(Image const& other) const noexcept
+        {
+                return other.m_screen == m_screen &&
+                        other.m_row >= m_row && other.end_row() <= end_row() &&
+                        other.m_column >= m_column &&
+                        other.m_column + other.m_n_columns <= m_column + m_n_columns;
+        }
+
+        /* Returns: the memory the pixels take, compressed or not */
+        size_t size() const noexcept;
+
+        inline bool compressed() const noexcept { return m_pixels.empty(); }
+
+        /* Returns: the pixels; only while not compressed() */
+        inline uint32_t* pixels() noexcept { return m_pixels.data(); }
+
+        /* Compresses the pixels, unless nothing would be saved.
+         * Returns: whether the pixels are compressed */
+        bool compress() noexcept;
+
+        /* Returns: false if the compressed pixels are corrupt */
+        bool uncompress() noexcept;
+
+        inline void* surface() const noexcept { return m_surface; }
+
+        /* Keeps @surface of the pixels with the image, until they are
+         * compressed, freeing it with @destroy */
+        void set_surface(void* surface,
+                         GDestroyNotify destroy) noexcept;
+
+private:
+        void drop_surface() noexcept;
+
+        uint64_t m_id;
+        unsigned m_width;
+        unsigned m_height;
+        int m_screen;
+        long m_row;
+        long m_column;
+        long m_n_rows;
+        long m_n_columns;
+
+        std::vector<uint32_t> m_pixels;
+        std::vector<uint8_t> m_compressed{};
+
+        void* m_surface{nullptr};
+        GDestroyNotify m_surface_destroy{nullptr};
+};
+
+/*
+ * ImageCache:
+ *
+ * The images of a terminal's screens, in the order they were last shown.
+ * When they take more than the budget, first the least recently shown
+ * ones are compressed, then dropped. Images that scrolled off the screen
+ * are compressed right away, until they are shown again.
+ */
+class ImageCache {
+public:
+        explicit ImageCache(size_t budget = VTE_IMAGE_CACHE_BUDGET) noexcept
+                : m_budget{budget}
+        {
+        }
+
+        ImageCache(ImageCache const&) = delete;
+        ImageCache(ImageCache&&) = delete;
+        ImageCache& operator= (ImageCache const&) = delete;
+        ImageCache& operator= (ImageCache&&) = delete;
+
+        /* Returns: the memory the images take */
+        inline size_t size() const noexcept { return m_size; }
+        inline size_t n_images() const noexcept { return m_images.size(); }
+        inline bool empty() const noexcept { return m_images.empty(); }
+
+        /* add:
+         *
+         * Adds an image, see Image::Image(), replacing the images it
+         * entirely covers.
+         *
+         * Returns: the image
+         */
+        Image& add(std::vector<uint32_t>&& pixels,
+                   unsigned width,
+                   unsigned height,
+                   int screen,
+                   long row,
+                   long column,
+                   long n_rows,
+                   long n_columns) noexcept;
+
+        /* for_each:
+         *
+         * Calls @func(image) for the images of @screen, without
+         * changing their order.
+         */
+        template<typename F>
+        void for_each(int screen,
+                      F&& func) noexcept
+        {
+                for (auto& image : m_images)
+                        if (image.screen() == screen)
+                                func(image);
+        }
+
+        /* for_each:
+         *
+         * Calls @func(image) for the images of @screen covering any of the
+         * rows @start..@end (exclusive), without changing their order.
+         */
+        template<typename F>
+        void for_each(int screen,
+                      long start,
+                      long end,
+                      F&& func) const noexcept
+        {
+                for (auto const& image : m_images)
+                        if (image.screen() == screen && image.intersects(start, end))
+                                func(image);
+        }
+
+        /* for_each_shown:
+         *
+         * Calls @func(image) for the images of @screen covering any of
+         * the rows @start..@end (exclusive), uncompressed, oldest first so
+         * that newer images are painted over older ones, and makes
+         * them the most recently shown.
+         */
+        template<typename F>
+        void for_each_shown(int screen,
+                            long start,
+                            long end,
+                            F&& func) noexcept
+        {
+                auto shown = std::list<Image>{};
+                for (auto it = m_images.begin(); it != m_images.end(); ) {
+                        auto const next = std::next(it);
+                        if (it->screen() == screen && it->intersects(start, end))
+                                shown.splice(shown.end(), m_images, it);
+                        it = next;
+                }
+                shown.sort([](Image const& a, Image const& b) { return a.id() < b.id(); });
+
+                for (auto it = shown.begin(); it != shown.end(); ) {
+                        auto const next = std::next(it);
+                        if (!uncompress(*it))
+                                remove(shown, it);
+                        it = next;
+                }
+
+                /* Making room can't take the pixels being painted */
+                trim();
+
+                for (auto& image : shown)
+                        func(image);
+
+                m_images.splice(m_images.begin(), shown);
+        }
+
+        /* prune:
+         *
+         * Drops the images of @screen that are entirely outside the
+         * rows @start..@end (exclusive), that is, what's left of the ring,
+         * and compresses the ones above @scrollback_end.
+         */
+        void prune(int screen,
+                   long start,
+                   long end,
+                   long scrollback_end) noexcept;
+
+        /* Drops the images of @screen covering any of the rows @start..@end (exclusive) */
+        void remove_rows(int screen,
+                         long start,
+                         long end) noexcept;
+
+        void clear() noexcept;
+
+private:
+        bool uncompress(Image& image) noexcept;
+        void remove(std::list<Image>& list,
+                    std::list<Image>::iterator it) noexcept;
+        void trim() noexcept;
+
+        size_t m_budget;
+        size_t m_size{0};
+        std::list<Image> m_images{}; /* the most recently shown first */
+};
+
+} // namespace base
+
+} // namespace vte
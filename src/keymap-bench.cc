@@ -0,0 +1,122 @@
+/*
+ * Copyright © 2026 The VTE developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * keymap-bench: times _vte_keymap_map(), the lookup of the sequence to
+ * send for a key press, over a mix of keys, modifiers and modes.
+ */
+
+#include "config.h"
+
+#include <glib.h>
+#include <gdk/gdk.h>
+
+#include <cstdlib>
+#include <locale.h>
+
+#include "bench.hh"
+#include "debug.h"
+#include "keymap.h"
+
+/* Keys first and last in the keymap, in between, and not in it */
+static guint const keyvals[] = {
+        GDK_KEY_space,
+        GDK_KEY_Return,
+        GDK_KEY_BackSpace,
+        GDK_KEY_a,
+        GDK_KEY_Up,
+        GDK_KEY_Left,
+        GDK_KEY_Page_Down,
+        GDK_KEY_KP_Enter,
+        GDK_KEY_KP_5,
+        GDK_KEY_KP_Page_Up,
+        GDK_KEY_F1,
+        GDK_KEY_F12,
+        GDK_KEY_F35,
+};
+
+static guint const modifiers[] = {
+        0,
+        GDK_SHIFT_MASK,
+        GDK_CONTROL_MASK,
+        VTE_META_MASK,
+        GDK_CONTROL_MASK | GDK_SHIFT_MASK,
+        VTE_NUMLOCK_MASK,
+};
+
+int
+main(int argc,
+     char *argv[])
+{
+        setlocale(LC_ALL, "");
+        _vte_debug_init();
+
+        auto repeat = 10;
+        auto iterations = 10000;
+        GOptionEntry const entries[] = {
+                { "repeat", 'r', 0, G_OPTION_ARG_INT, &repeat,
+                  "Repeat the measurement COUNT times", "COUNT" },
+                { "iterations", 'i', 0, G_OPTION_ARG_INT, &iterations,
+                  "Look up each combination N times per measurement", "N" },
+                { nullptr },
+        };
+
+        auto context = g_option_context_new("— keymap lookup benchmark");
+        g_option_context_set_help_enabled(context, true);
+        g_option_context_add_main_entries(context, entries, nullptr);
+
+        GError* error = nullptr;
+        auto const rv = g_option_context_parse(context, &argc, &argv, &error);
+        g_option_context_free(context);
+        if (!rv) {
+                g_printerr("Failed to parse arguments: %s\n", error->message);
+                g_error_free(error);
+                return EXIT_FAILURE;
+        }
+
+        vte::base::Benchmark benchmark{"lookups"};
+        for (auto r = 0; r < repeat; ++r) {
+                auto bytes = size_t{0};
+                auto lookups = size_t{0};
+                auto const start = g_get_monotonic_time();
+
+                for (auto i = 0; i < iterations; ++i) {
+                        for (auto keyval : keyvals) {
+                                for (auto mods : modifiers) {
+                                        for (auto mode = 0; mode < 4; ++mode) {
+                                                char* normal;
+                                                gsize normal_length;
+                                                _vte_keymap_map(keyval, mods,
+                                                                (mode & 1) != 0,
+                                                                (mode & 2) != 0,
+                                                                &normal, &normal_length);
+                                                g_free(normal);
+
+                                                bytes += normal_length;
+                                                ++lookups;
+                                        }
+                                }
+                        }
+                }
+
+                benchmark.add(g_get_monotonic_time() - start, bytes, lookups);
+        }
+
+        benchmark.print();
+
+        return EXIT_SUCCESS;
+}
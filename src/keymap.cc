@@ -85,7 +85,7 @@ enum _vte_modifier_encoding_method {
 	MODIFIER_ENCODING_LONG,
 };
 
-static const struct _vte_keymap_entry _vte_keymap_GDK_space[] = {
+static constexpr struct _vte_keymap_entry _vte_keymap_GDK_space[] = {
 	/* Control+Meta+space = ESC+NUL */
         {cursor_all, keypad_all, GDK_CONTROL_MASK | VTE_META_MASK, _VTE_CAP_ESC "\0", 2},
 	/* Meta+space = ESC+" " */
@@ -97,7 +97,7 @@ static const struct _vte_keymap_entry _vte_keymap_GDK_space[] = {
         {cursor_all, keypad_all, 0, X_NULL, 0},
 };
 
-static const struct _vte_keymap_entry _vte_keymap_GDK_Tab[] = {
+static constexpr struct _vte_keymap_entry _vte_keymap_GDK_Tab[] = {
 	/* Shift+Tab = Back-Tab */
         {cursor_all, keypad_all, GDK_SHIFT_MASK, _VTE_CAP_CSI "Z", -1},
 	/* Alt+Tab = Esc+Tab */
@@ -107,36 +107,36 @@ static const struct _vte_keymap_entry _vte_keymap_GDK_Tab[] = {
         {cursor_all, keypad_all, 0, X_NULL, 0},
 };
 
-static const struct _vte_keymap_entry _vte_keymap_GDK_Return[] = {
+static constexpr struct _vte_keymap_entry _vte_keymap_GDK_Return[] = {
         {cursor_all, keypad_all, VTE_META_MASK, _VTE_CAP_ESC "\r", 2},
         {cursor_all, keypad_all, 0, "\r", 1},
         {cursor_all, keypad_all, 0, X_NULL, 0},
 };
 
-static const struct _vte_keymap_entry _vte_keymap_GDK_Escape[] = {
+static constexpr struct _vte_keymap_entry _vte_keymap_GDK_Escape[] = {
         {cursor_all, keypad_all, VTE_META_MASK, _VTE_CAP_ESC _VTE_CAP_ESC, 2},
         {cursor_all, keypad_all, 0, _VTE_CAP_ESC, 1},
         {cursor_all, keypad_all, 0, X_NULL, 0},
 };
 
-static const struct _vte_keymap_entry _vte_keymap_GDK_Insert[] = {
+static constexpr struct _vte_keymap_entry _vte_keymap_GDK_Insert[] = {
         {cursor_all, keypad_all, 0, _VTE_CAP_CSI "2~", -1},
         {cursor_all, keypad_all, 0, X_NULL, 0},
 };
 
-static const struct _vte_keymap_entry _vte_keymap_GDK_ISO_Left_Tab[] = {
+static constexpr struct _vte_keymap_entry _vte_keymap_GDK_ISO_Left_Tab[] = {
         {cursor_all, keypad_all, 0, _VTE_CAP_CSI "Z", -1},
         {cursor_all, keypad_all, 0, X_NULL, 0},
 };
 
-static const struct _vte_keymap_entry _vte_keymap_GDK_slash[] = {
+static constexpr struct _vte_keymap_entry _vte_keymap_GDK_slash[] = {
         {cursor_all, keypad_all, VTE_META_MASK, _VTE_CAP_ESC "/", 2},
         {cursor_all, keypad_all, GDK_CONTROL_MASK, "\037", 1},
         {cursor_all, keypad_all, 0, "/", 1},
         {cursor_all, keypad_all, 0, X_NULL, 0},
 };
 
-static const struct _vte_keymap_entry _vte_keymap_GDK_question[] = {
+static constexpr struct _vte_keymap_entry _vte_keymap_GDK_question[] = {
         {cursor_all, keypad_all, VTE_META_MASK, _VTE_CAP_ESC "?", 2},
         {cursor_all, keypad_all, GDK_CONTROL_MASK, "\177", 1},
         {cursor_all, keypad_all, 0, "?", 1},
@@ -144,160 +144,160 @@ static const struct _vte_keymap_entry _vte_keymap_GDK_question[] = {
 };
 
 /* Various numeric keys enter control characters. */
-static const struct _vte_keymap_entry _vte_keymap_GDK_2[] = {
+static constexpr struct _vte_keymap_entry _vte_keymap_GDK_2[] = {
         {cursor_all, keypad_all, GDK_CONTROL_MASK, "\0", 1},
         {cursor_all, keypad_all, 0, X_NULL, 0},
 };
-static const struct _vte_keymap_entry _vte_keymap_GDK_3[] = {
+static constexpr struct _vte_keymap_entry _vte_keymap_GDK_3[] = {
         {cursor_all, keypad_all, GDK_CONTROL_MASK, "\033", 1},
         {cursor_all, keypad_all, 0, X_NULL, 0},
 };
-static const struct _vte_keymap_entry _vte_keymap_GDK_4[] = {
+static constexpr struct _vte_keymap_entry _vte_keymap_GDK_4[] = {
         {cursor_all, keypad_all, GDK_CONTROL_MASK, "\034", 1},
         {cursor_all, keypad_all, 0, X_NULL, 0},
 };
-static const struct _vte_keymap_entry _vte_keymap_GDK_5[] = {
+static constexpr struct _vte_keymap_entry _vte_keymap_GDK_5[] = {
         {cursor_all, keypad_all, GDK_CONTROL_MASK, "\035", 1},
         {cursor_all, keypad_all, 0, X_NULL, 0},
 };
-static const struct _vte_keymap_entry _vte_keymap_GDK_6[] = {
+static constexpr struct _vte_keymap_entry _vte_keymap_GDK_6[] = {
         {cursor_all, keypad_all, GDK_CONTROL_MASK, "\036", 1},
         {cursor_all, keypad_all, 0, X_NULL, 0},
 };
-static const struct _vte_keymap_entry _vte_keymap_GDK_7[] = {
+static constexpr struct _vte_keymap_entry _vte_keymap_GDK_7[] = {
         {cursor_all, keypad_all, GDK_CONTROL_MASK, "\037", 1},
         {cursor_all, keypad_all, 0, X_NULL, 0},
 };
-static const struct _vte_keymap_entry _vte_keymap_GDK_8[] = {
+static constexpr struct _vte_keymap_entry _vte_keymap_GDK_8[] = {
         {cursor_all, keypad_all, GDK_CONTROL_MASK, "\177", 1},
         {cursor_all, keypad_all, 0, X_NULL, 0},
 };
-static const struct _vte_keymap_entry _vte_keymap_GDK_Minus[] = {
+static constexpr struct _vte_keymap_entry _vte_keymap_GDK_Minus[] = {
         {cursor_all, keypad_all, GDK_CONTROL_MASK, "\037", 1},
         {cursor_all, keypad_all, 0, X_NULL, 0},
 };
 
 /* Keys (potentially) affected by the cursor key mode. */
-static const struct _vte_keymap_entry _vte_keymap_GDK_Home[] = {
+static constexpr struct _vte_keymap_entry _vte_keymap_GDK_Home[] = {
         {cursor_default, keypad_all, 0, _VTE_CAP_CSI "H", -1},
         {cursor_app, keypad_all, 0, _VTE_CAP_SS3 "H", -1},
         {cursor_all, keypad_all, 0, X_NULL, 0},
 };
 
-static const struct _vte_keymap_entry _vte_keymap_GDK_End[] = {
+static constexpr struct _vte_keymap_entry _vte_keymap_GDK_End[] = {
         {cursor_default, keypad_all, 0, _VTE_CAP_CSI "F", -1},
         {cursor_app, keypad_all, 0, _VTE_CAP_SS3 "F", -1},
         {cursor_all, keypad_all, 0, X_NULL, 0},
 };
 
-static const struct _vte_keymap_entry _vte_keymap_GDK_Page_Up[] = {
+static constexpr struct _vte_keymap_entry _vte_keymap_GDK_Page_Up[] = {
         {cursor_all, keypad_all, 0, _VTE_CAP_CSI "5~", -1},
         {cursor_all, keypad_all, 0, X_NULL, 0},
 };
 
-static const struct _vte_keymap_entry _vte_keymap_GDK_Page_Down[] = {
+static constexpr struct _vte_keymap_entry _vte_keymap_GDK_Page_Down[] = {
         {cursor_all, keypad_all, 0, _VTE_CAP_CSI "6~", -1},
         {cursor_all, keypad_all, 0, X_NULL, 0},
 };
 
-static const struct _vte_keymap_entry _vte_keymap_GDK_Up[] = {
+static constexpr struct _vte_keymap_entry _vte_keymap_GDK_Up[] = {
         {cursor_default, keypad_all, 0, _VTE_CAP_CSI "A", -1},
         {cursor_app, keypad_all, 0, _VTE_CAP_SS3 "A", -1},
         {cursor_all, keypad_all, 0, X_NULL, 0},
 };
 
-static const struct _vte_keymap_entry _vte_keymap_GDK_Down[] = {
+static constexpr struct _vte_keymap_entry _vte_keymap_GDK_Down[] = {
         {cursor_default, keypad_all, 0, _VTE_CAP_CSI "B", -1},
         {cursor_app, keypad_all, 0, _VTE_CAP_SS3 "B", -1},
         {cursor_all, keypad_all, 0, X_NULL, 0},
 };
 
-static const struct _vte_keymap_entry _vte_keymap_GDK_Right[] = {
+static constexpr struct _vte_keymap_entry _vte_keymap_GDK_Right[] = {
         {cursor_default, keypad_all, 0, _VTE_CAP_CSI "C", -1},
         {cursor_app, keypad_all, 0, _VTE_CAP_SS3 "C", -1},
         {cursor_all, keypad_all, 0, X_NULL, 0},
 };
 
-static const struct _vte_keymap_entry _vte_keymap_GDK_Left[] = {
+static constexpr struct _vte_keymap_entry _vte_keymap_GDK_Left[] = {
         {cursor_default, keypad_all, 0, _VTE_CAP_CSI "D", -1},
         {cursor_app, keypad_all, 0, _VTE_CAP_SS3 "D", -1},
         {cursor_all, keypad_all, 0, X_NULL, 0},
 };
 
 /* Keys (potentially) affected by the keypad key mode. */
-static const struct _vte_keymap_entry _vte_keymap_GDK_KP_Space[] = {
+static constexpr struct _vte_keymap_entry _vte_keymap_GDK_KP_Space[] = {
         {cursor_all, keypad_default, 0, " ", 1},
         {cursor_all, keypad_app, 0, _VTE_CAP_SS3 " ", -1},
         {cursor_all, keypad_all, 0, X_NULL, 0},
 };
 
-static const struct _vte_keymap_entry _vte_keymap_GDK_KP_Tab[] = {
+static constexpr struct _vte_keymap_entry _vte_keymap_GDK_KP_Tab[] = {
         {cursor_all, keypad_default, 0, "\t", 1},
         {cursor_all, keypad_app, 0, _VTE_CAP_SS3 "I", -1},
         {cursor_all, keypad_all, 0, X_NULL, 0},
 };
 
-static const struct _vte_keymap_entry _vte_keymap_GDK_KP_Enter[] = {
+static constexpr struct _vte_keymap_entry _vte_keymap_GDK_KP_Enter[] = {
         {cursor_all, keypad_app, VTE_NUMLOCK_MASK, "\r", 1},
         {cursor_all, keypad_app, 0, _VTE_CAP_SS3 "M", -1},
         {cursor_all, keypad_all, 0, "\r", 1},
         {cursor_all, keypad_all, 0, X_NULL, 0},
 };
 
-static const struct _vte_keymap_entry _vte_keymap_GDK_KP_F1[] = {
+static constexpr struct _vte_keymap_entry _vte_keymap_GDK_KP_F1[] = {
         {cursor_all, keypad_all, 0, _VTE_CAP_SS3 "P", -1},
         {cursor_all, keypad_all, 0, X_NULL, 0},
 };
 
-static const struct _vte_keymap_entry _vte_keymap_GDK_KP_F2[] = {
+static constexpr struct _vte_keymap_entry _vte_keymap_GDK_KP_F2[] = {
         {cursor_all, keypad_all, 0, _VTE_CAP_SS3 "Q", -1},
         {cursor_all, keypad_all, 0, X_NULL, 0},
 };
 
-static const struct _vte_keymap_entry _vte_keymap_GDK_KP_F3[] = {
+static constexpr struct _vte_keymap_entry _vte_keymap_GDK_KP_F3[] = {
         {cursor_all, keypad_all, 0, _VTE_CAP_SS3 "R", -1},
         {cursor_all, keypad_all, 0, X_NULL, 0},
 };
 
-static const struct _vte_keymap_entry _vte_keymap_GDK_KP_F4[] = {
+static constexpr struct _vte_keymap_entry _vte_keymap_GDK_KP_F4[] = {
         {cursor_all, keypad_all, 0, _VTE_CAP_SS3 "S", -1},
         {cursor_all, keypad_all, 0, X_NULL, 0},
 };
 
-static const struct _vte_keymap_entry _vte_keymap_GDK_KP_Multiply[] = {
+static constexpr struct _vte_keymap_entry _vte_keymap_GDK_KP_Multiply[] = {
         {cursor_all, keypad_default, 0, "*", 1},
         {cursor_all, keypad_app, VTE_NUMLOCK_MASK, "*", 1},
         {cursor_all, keypad_app, 0, _VTE_CAP_SS3 "j", -1},
         {cursor_all, keypad_all, 0, X_NULL, 0},
 };
 
-static const struct _vte_keymap_entry _vte_keymap_GDK_KP_Add[] = {
+static constexpr struct _vte_keymap_entry _vte_keymap_GDK_KP_Add[] = {
         {cursor_all, keypad_default, 0, "+", 1},
         {cursor_all, keypad_app, VTE_NUMLOCK_MASK, "+", 1},
         {cursor_all, keypad_app, 0, _VTE_CAP_SS3 "k", -1},
         {cursor_all, keypad_all, 0, X_NULL, 0},
 };
 
-static const struct _vte_keymap_entry _vte_keymap_GDK_KP_Separator[] = {
+static constexpr struct _vte_keymap_entry _vte_keymap_GDK_KP_Separator[] = {
         {cursor_all, keypad_default, 0, ",", 1},
         {cursor_all, keypad_app, 0, _VTE_CAP_SS3 "l", -1},
         {cursor_all, keypad_all, 0, X_NULL, 0},
 };
 
-static const struct _vte_keymap_entry _vte_keymap_GDK_KP_Subtract[] = {
+static constexpr struct _vte_keymap_entry _vte_keymap_GDK_KP_Subtract[] = {
         {cursor_all, keypad_default, 0, "-", 1},
         {cursor_all, keypad_app, VTE_NUMLOCK_MASK, "-", 1},
         {cursor_all, keypad_app, 0, _VTE_CAP_SS3 "m", -1},
         {cursor_all, keypad_all, 0, X_NULL, 0},
 };
 
-static const struct _vte_keymap_entry _vte_keymap_GDK_KP_Decimal_Delete[] = {
+static constexpr struct _vte_keymap_entry _vte_keymap_GDK_KP_Decimal_Delete[] = {
         {cursor_all, keypad_default, 0, ".", 1},
         {cursor_all, keypad_app, 0, _VTE_CAP_SS3 "3~", -1},
         {cursor_all, keypad_all, 0, X_NULL, 0},
 };
 
-static const struct _vte_keymap_entry _vte_keymap_GDK_KP_Divide[] = {
+static constexpr struct _vte_keymap_entry _vte_keymap_GDK_KP_Divide[] = {
         {cursor_all, keypad_default, 0, "/", 1},
         {cursor_all, keypad_app, VTE_NUMLOCK_MASK, "/", 1},
         {cursor_all, keypad_app, 0, _VTE_CAP_SS3 "o", -1},
@@ -306,115 +306,115 @@ static const struct _vte_keymap_entry _vte_keymap_GDK_KP_Divide[] = {
 
 /* GDK already separates keypad "0" from keypad "Insert", so the only time
  * we'll see this key is when NumLock is on. */
-static const struct _vte_keymap_entry _vte_keymap_GDK_KP_0[] = {
+static constexpr struct _vte_keymap_entry _vte_keymap_GDK_KP_0[] = {
         {cursor_all, keypad_all, 0, "0", 1},
         {cursor_all, keypad_all, 0, X_NULL, 0},
 };
 
-static const struct _vte_keymap_entry _vte_keymap_GDK_KP_1[] = {
+static constexpr struct _vte_keymap_entry _vte_keymap_GDK_KP_1[] = {
         {cursor_all, keypad_all, 0, "1", 1},
         {cursor_all, keypad_all, 0, X_NULL, 0},
 };
 
-static const struct _vte_keymap_entry _vte_keymap_GDK_KP_2[] = {
+static constexpr struct _vte_keymap_entry _vte_keymap_GDK_KP_2[] = {
         {cursor_all, keypad_all, 0, "2", 1},
         {cursor_all, keypad_all, 0, X_NULL, 0},
 };
 
-static const struct _vte_keymap_entry _vte_keymap_GDK_KP_3[] = {
+static constexpr struct _vte_keymap_entry _vte_keymap_GDK_KP_3[] = {
         {cursor_all, keypad_all, 0, "3", 1},
         {cursor_all, keypad_all, 0, X_NULL, 0},
 };
 
-static const struct _vte_keymap_entry _vte_keymap_GDK_KP_4[] = {
+static constexpr struct _vte_keymap_entry _vte_keymap_GDK_KP_4[] = {
         {cursor_all, keypad_all, 0, "4", 1},
         {cursor_all, keypad_all, 0, X_NULL, 0},
 };
 
-static const struct _vte_keymap_entry _vte_keymap_GDK_KP_5[] = {
+static constexpr struct _vte_keymap_entry _vte_keymap_GDK_KP_5[] = {
         {cursor_all, keypad_all, 0, "5", 1},
         {cursor_all, keypad_all, 0, X_NULL, 0},
 };
 
-static const struct _vte_keymap_entry _vte_keymap_GDK_KP_6[] = {
+static constexpr struct _vte_keymap_entry _vte_keymap_GDK_KP_6[] = {
         {cursor_all, keypad_all, 0, "6", 1},
         {cursor_all, keypad_all, 0, X_NULL, 0},
 };
 
-static const struct _vte_keymap_entry _vte_keymap_GDK_KP_7[] = {
+static constexpr struct _vte_keymap_entry _vte_keymap_GDK_KP_7[] = {
         {cursor_all, keypad_all, 0, "7", 1},
         {cursor_all, keypad_all, 0, X_NULL, 0},
 };
 
-static const struct _vte_keymap_entry _vte_keymap_GDK_KP_8[] = {
+static constexpr struct _vte_keymap_entry _vte_keymap_GDK_KP_8[] = {
         {cursor_all, keypad_all, 0, "8", 1},
         {cursor_all, keypad_all, 0, X_NULL, 0},
 };
 
-static const struct _vte_keymap_entry _vte_keymap_GDK_KP_9[] = {
+static constexpr struct _vte_keymap_entry _vte_keymap_GDK_KP_9[] = {
         {cursor_all, keypad_all, 0, "9", 1},
         {cursor_all, keypad_all, 0, X_NULL, 0},
 };
 
 /* These are the same keys as above, but without numlock. */
-static const struct _vte_keymap_entry _vte_keymap_GDK_KP_Insert[] = {
+static constexpr struct _vte_keymap_entry _vte_keymap_GDK_KP_Insert[] = {
         {cursor_all, keypad_all, 0, _VTE_CAP_CSI "2~", -1},
         {cursor_all, keypad_all, 0, X_NULL, 0},
 };
 
-static const struct _vte_keymap_entry _vte_keymap_GDK_KP_End[] = {
+static constexpr struct _vte_keymap_entry _vte_keymap_GDK_KP_End[] = {
         {cursor_app, keypad_all, 0, _VTE_CAP_SS3 "F", -1},
         {cursor_default, keypad_all, 0, _VTE_CAP_CSI "F", -1},
         {cursor_all, keypad_all, 0, X_NULL, 0},
 };
 
-static const struct _vte_keymap_entry _vte_keymap_GDK_KP_Down[] = {
+static constexpr struct _vte_keymap_entry _vte_keymap_GDK_KP_Down[] = {
         {cursor_app, keypad_all, 0, _VTE_CAP_SS3 "B", -1},
         {cursor_default, keypad_all, 0, _VTE_CAP_CSI "B", -1},
         {cursor_all, keypad_all, 0, X_NULL, 0},
 };
 
-static const struct _vte_keymap_entry _vte_keymap_GDK_KP_Page_Down[] = {
+static constexpr struct _vte_keymap_entry _vte_keymap_GDK_KP_Page_Down[] = {
         {cursor_all, keypad_all, 0, _VTE_CAP_CSI "6~", -1},
         {cursor_all, keypad_all, 0, X_NULL, 0},
 };
 
-static const struct _vte_keymap_entry _vte_keymap_GDK_KP_Left[] = {
+static constexpr struct _vte_keymap_entry _vte_keymap_GDK_KP_Left[] = {
         {cursor_app, keypad_all, 0, _VTE_CAP_SS3 "D", -1},
         {cursor_default, keypad_all, 0, _VTE_CAP_CSI "D", -1},
         {cursor_all, keypad_all, 0, X_NULL, 0},
 };
 
-static const struct _vte_keymap_entry _vte_keymap_GDK_KP_Begin[] = {
+static constexpr struct _vte_keymap_entry _vte_keymap_GDK_KP_Begin[] = {
         {cursor_app, keypad_all, 0, _VTE_CAP_SS3 "E", -1},
         {cursor_default, keypad_all, 0, _VTE_CAP_CSI "E", -1},
         {cursor_all, keypad_all, 0, X_NULL, 0},
 };
 
-static const struct _vte_keymap_entry _vte_keymap_GDK_KP_Right[] = {
+static constexpr struct _vte_keymap_entry _vte_keymap_GDK_KP_Right[] = {
         {cursor_app, keypad_all, 0, _VTE_CAP_SS3 "C", -1},
         {cursor_default, keypad_all, 0, _VTE_CAP_CSI "C", -1},
         {cursor_all, keypad_all, 0, X_NULL, 0},
 };
 
-static const struct _vte_keymap_entry _vte_keymap_GDK_KP_Home[] = {
+static constexpr struct _vte_keymap_entry _vte_keymap_GDK_KP_Home[] = {
         {cursor_app, keypad_all, 0, _VTE_CAP_SS3 "H", -1},
         {cursor_default, keypad_all, 0, _VTE_CAP_CSI "H", -1},
         {cursor_all, keypad_all, 0, X_NULL, 0},
 };
 
-static const struct _vte_keymap_entry _vte_keymap_GDK_KP_Up[] = {
+static constexpr struct _vte_keymap_entry _vte_keymap_GDK_KP_Up[] = {
         {cursor_app, keypad_all, 0, _VTE_CAP_SS3 "A", -1},
         {cursor_default, keypad_all, 0, _VTE_CAP_CSI "A", -1},
         {cursor_all, keypad_all, 0, X_NULL, 0},
 };
 
-static const struct _vte_keymap_entry _vte_keymap_GDK_KP_Page_Up[] = {
+static constexpr struct _vte_keymap_entry _vte_keymap_GDK_KP_Page_Up[] = {
         {cursor_all, keypad_all, 0, _VTE_CAP_CSI "5~", -1},
         {cursor_all, keypad_all, 0, X_NULL, 0},
 };
 
-static const struct _vte_keymap_entry _vte_keymap_GDK_F1[] = {
+static constexpr struct _vte_keymap_entry _vte_keymap_GDK_F1[] = {
         {cursor_all, keypad_all, GDK_CONTROL_MASK, _VTE_CAP_CSI "P", -1},
         {cursor_all, keypad_all, GDK_SHIFT_MASK, _VTE_CAP_CSI "P", -1},
         {cursor_all, keypad_all, VTE_META_MASK, _VTE_CAP_CSI "P", -1},
@@ -422,7 +422,7 @@ static const struct _vte_keymap_entry _vte_keymap_GDK_F1[] = {
         {cursor_all, keypad_all, 0, X_NULL, 0},
 };
 
-static const struct _vte_keymap_entry _vte_keymap_GDK_F2[] = {
+static constexpr struct _vte_keymap_entry _vte_keymap_GDK_F2[] = {
         {cursor_all, keypad_all, GDK_CONTROL_MASK, _VTE_CAP_CSI "Q", -1},
         {cursor_all, keypad_all, GDK_SHIFT_MASK, _VTE_CAP_CSI "Q", -1},
         {cursor_all, keypad_all, VTE_META_MASK, _VTE_CAP_CSI "Q", -1},
@@ -430,7 +430,7 @@ static const struct _vte_keymap_entry _vte_keymap_GDK_F2[] = {
         {cursor_all, keypad_all, 0, X_NULL, 0},
 };
 
-static const struct _vte_keymap_entry _vte_keymap_GDK_F3[] = {
+static constexpr struct _vte_keymap_entry _vte_keymap_GDK_F3[] = {
         {cursor_all, keypad_all, GDK_CONTROL_MASK, _VTE_CAP_CSI "R", -1},
         {cursor_all, keypad_all, GDK_SHIFT_MASK, _VTE_CAP_CSI "R", -1},
         {cursor_all, keypad_all, VTE_META_MASK, _VTE_CAP_CSI "R", -1},
@@ -438,7 +438,7 @@ static const struct _vte_keymap_entry _vte_keymap_GDK_F3[] = {
         {cursor_all, keypad_all, 0, X_NULL, 0},
 };
 
-static const struct _vte_keymap_entry _vte_keymap_GDK_F4[] = {
+static constexpr struct _vte_keymap_entry _vte_keymap_GDK_F4[] = {
         {cursor_all, keypad_all, GDK_CONTROL_MASK, _VTE_CAP_CSI "S", -1},
         {cursor_all, keypad_all, GDK_SHIFT_MASK, _VTE_CAP_CSI "S", -1},
         {cursor_all, keypad_all, VTE_META_MASK, _VTE_CAP_CSI "S", -1},
@@ -446,162 +446,162 @@ static const struct _vte_keymap_entry _vte_keymap_GDK_F4[] = {
         {cursor_all, keypad_all, 0, X_NULL, 0},
 };
 
-static const struct _vte_keymap_entry _vte_keymap_GDK_F5[] = {
+static constexpr struct _vte_keymap_entry _vte_keymap_GDK_F5[] = {
         {cursor_all, keypad_all, 0, _VTE_CAP_CSI "15~", -1},
         {cursor_all, keypad_all, 0, X_NULL, 0},
 };
 
-static const struct _vte_keymap_entry _vte_keymap_GDK_F6[] = {
+static constexpr struct _vte_keymap_entry _vte_keymap_GDK_F6[] = {
         {cursor_all, keypad_all, 0, _VTE_CAP_CSI "17~", -1},
         {cursor_all, keypad_all, 0, X_NULL, 0},
 };
 
-static const struct _vte_keymap_entry _vte_keymap_GDK_F7[] = {
+static constexpr struct _vte_keymap_entry _vte_keymap_GDK_F7[] = {
         {cursor_all, keypad_all, 0, _VTE_CAP_CSI "18~", -1},
         {cursor_all, keypad_all, 0, X_NULL, 0},
 };
 
-static const struct _vte_keymap_entry _vte_keymap_GDK_F8[] = {
+static constexpr struct _vte_keymap_entry _vte_keymap_GDK_F8[] = {
         {cursor_all, keypad_all, 0, _VTE_CAP_CSI "19~", -1},
         {cursor_all, keypad_all, 0, X_NULL, 0},
 };
 
-static const struct _vte_keymap_entry _vte_keymap_GDK_F9[] = {
+static constexpr struct _vte_keymap_entry _vte_keymap_GDK_F9[] = {
         {cursor_all, keypad_all, 0, _VTE_CAP_CSI "20~", -1},
         {cursor_all, keypad_all, 0, X_NULL, 0},
 };
 
-static const struct _vte_keymap_entry _vte_keymap_GDK_F10[] = {
+static constexpr struct _vte_keymap_entry _vte_keymap_GDK_F10[] = {
         {cursor_all, keypad_all, 0, _VTE_CAP_CSI "21~", -1},
         {cursor_all, keypad_all, 0, X_NULL, 0},
 };
 
-static const struct _vte_keymap_entry _vte_keymap_GDK_F11[] = {
+static constexpr struct _vte_keymap_entry _vte_keymap_GDK_F11[] = {
         {cursor_all, keypad_all, 0, _VTE_CAP_CSI "23~", -1},
         {cursor_all, keypad_all, 0, X_NULL, 0},
 };
 
-static const struct _vte_keymap_entry _vte_keymap_GDK_F12[] = {
+static constexpr struct _vte_keymap_entry _vte_keymap_GDK_F12[] = {
         {cursor_all, keypad_all, 0, _VTE_CAP_CSI "24~", -1},
         {cursor_all, keypad_all, 0, X_NULL, 0},
 };
 
-static const struct _vte_keymap_entry _vte_keymap_GDK_F13[] = {
+static constexpr struct _vte_keymap_entry _vte_keymap_GDK_F13[] = {
         {cursor_all, keypad_all, 0, _VTE_CAP_CSI "25~", -1},
         {cursor_all, keypad_all, 0, X_NULL, 0},
 };
 
-static const struct _vte_keymap_entry _vte_keymap_GDK_F14[] = {
+static constexpr struct _vte_keymap_entry _vte_keymap_GDK_F14[] = {
         {cursor_all, keypad_all, 0, _VTE_CAP_CSI "26~", -1},
         {cursor_all, keypad_all, 0, X_NULL, 0},
 };
 
-static const struct _vte_keymap_entry _vte_keymap_GDK_F15[] = {
+static constexpr struct _vte_keymap_entry _vte_keymap_GDK_F15[] = {
         {cursor_all, keypad_all, 0, _VTE_CAP_CSI "28~", -1},
         {cursor_all, keypad_all, 0, X_NULL, 0},
 };
 
-static const struct _vte_keymap_entry _vte_keymap_GDK_F16[] = {
+static constexpr struct _vte_keymap_entry _vte_keymap_GDK_F16[] = {
         {cursor_all, keypad_all, 0, _VTE_CAP_CSI "29~", -1},
         {cursor_all, keypad_all, 0, X_NULL, 0},
 };
 
-static const struct _vte_keymap_entry _vte_keymap_GDK_F17[] = {
+static constexpr struct _vte_keymap_entry _vte_keymap_GDK_F17[] = {
         {cursor_all, keypad_all, 0, _VTE_CAP_CSI "31~", -1},
         {cursor_all, keypad_all, 0, X_NULL, 0},
 };
 
-static const struct _vte_keymap_entry _vte_keymap_GDK_F18[] = {
+static constexpr struct _vte_keymap_entry _vte_keymap_GDK_F18[] = {
         {cursor_all, keypad_all, 0, _VTE_CAP_CSI "32~", -1},
         {cursor_all, keypad_all, 0, X_NULL, 0},
 };
 
-static const struct _vte_keymap_entry _vte_keymap_GDK_F19[] = {
+static constexpr struct _vte_keymap_entry _vte_keymap_GDK_F19[] = {
         {cursor_all, keypad_all, 0, _VTE_CAP_CSI "33~", -1},
         {cursor_all, keypad_all, 0, X_NULL, 0},
 };
 
-static const struct _vte_keymap_entry _vte_keymap_GDK_F20[] = {
+static constexpr struct _vte_keymap_entry _vte_keymap_GDK_F20[] = {
         {cursor_all, keypad_all, 0, _VTE_CAP_CSI "34~", -1},
         {cursor_all, keypad_all, 0, X_NULL, 0},
 };
 
-static const struct _vte_keymap_entry _vte_keymap_GDK_F21[] = {
+static constexpr struct _vte_keymap_entry _vte_keymap_GDK_F21[] = {
         {cursor_all, keypad_all, 0, _VTE_CAP_CSI "42~", -1},
         {cursor_all, keypad_all, 0, X_NULL, 0},
 };
 
-static const struct _vte_keymap_entry _vte_keymap_GDK_F22[] = {
+static constexpr struct _vte_keymap_entry _vte_keymap_GDK_F22[] = {
         {cursor_all, keypad_all, 0, _VTE_CAP_CSI "43~", -1},
         {cursor_all, keypad_all, 0, X_NULL, 0},
 };
 
-static const struct _vte_keymap_entry _vte_keymap_GDK_F23[] = {
+static constexpr struct _vte_keymap_entry _vte_keymap_GDK_F23[] = {
         {cursor_all, keypad_all, 0, _VTE_CAP_CSI "44~", -1},
         {cursor_all, keypad_all, 0, X_NULL, 0},
 };
 
-static const struct _vte_keymap_entry _vte_keymap_GDK_F24[] = {
+static constexpr struct _vte_keymap_entry _vte_keymap_GDK_F24[] = {
         {cursor_all, keypad_all, 0, _VTE_CAP_CSI "45~", -1},
         {cursor_all, keypad_all, 0, X_NULL, 0},
 };
 
-static const struct _vte_keymap_entry _vte_keymap_GDK_F25[] = {
+static constexpr struct _vte_keymap_entry _vte_keymap_GDK_F25[] = {
         {cursor_all, keypad_all, 0, _VTE_CAP_CSI "46~", -1},
         {cursor_all, keypad_all, 0, X_NULL, 0},
 };
 
-static const struct _vte_keymap_entry _vte_keymap_GDK_F26[] = {
+static constexpr struct _vte_keymap_entry _vte_keymap_GDK_F26[] = {
         {cursor_all, keypad_all, 0, _VTE_CAP_CSI "47~", -1},
         {cursor_all, keypad_all, 0, X_NULL, 0},
 };
 
-static const struct _vte_keymap_entry _vte_keymap_GDK_F27[] = {
+static constexpr struct _vte_keymap_entry _vte_keymap_GDK_F27[] = {
         {cursor_all, keypad_all, 0, _VTE_CAP_CSI "48~", -1},
         {cursor_all, keypad_all, 0, X_NULL, 0},
 };
 
-static const struct _vte_keymap_entry _vte_keymap_GDK_F28[] = {
+static constexpr struct _vte_keymap_entry _vte_keymap_GDK_F28[] = {
         {cursor_all, keypad_all, 0, _VTE_CAP_CSI "49~", -1},
         {cursor_all, keypad_all, 0, X_NULL, 0},
 };
 
-static const struct _vte_keymap_entry _vte_keymap_GDK_F29[] = {
+static constexpr struct _vte_keymap_entry _vte_keymap_GDK_F29[] = {
         {cursor_all, keypad_all, 0, _VTE_CAP_CSI "50~", -1},
         {cursor_all, keypad_all, 0, X_NULL, 0},
 };
 
-static const struct _vte_keymap_entry _vte_keymap_GDK_F30[] = {
+static constexpr struct _vte_keymap_entry _vte_keymap_GDK_F30[] = {
         {cursor_all, keypad_all, 0, _VTE_CAP_CSI "51~", -1},
         {cursor_all, keypad_all, 0, X_NULL, 0},
 };
 
-static const struct _vte_keymap_entry _vte_keymap_GDK_F31[] = {
+static constexpr struct _vte_keymap_entry _vte_keymap_GDK_F31[] = {
         {cursor_all, keypad_all, 0, _VTE_CAP_CSI "52~", -1},
         {cursor_all, keypad_all, 0, X_NULL, 0},
 };
 
-static const struct _vte_keymap_entry _vte_keymap_GDK_F32[] = {
+static constexpr struct _vte_keymap_entry _vte_keymap_GDK_F32[] = {
         {cursor_all, keypad_all, 0, _VTE_CAP_CSI "53~", -1},
         {cursor_all, keypad_all, 0, X_NULL, 0},
 };
 
-static const struct _vte_keymap_entry _vte_keymap_GDK_F33[] = {
+static constexpr struct _vte_keymap_entry _vte_keymap_GDK_F33[] = {
         {cursor_all, keypad_all, 0, _VTE_CAP_CSI "54~", -1},
         {cursor_all, keypad_all, 0, X_NULL, 0},
 };
 
-static const struct _vte_keymap_entry _vte_keymap_GDK_F34[] = {
+static constexpr struct _vte_keymap_entry _vte_keymap_GDK_F34[] = {
         {cursor_all, keypad_all, 0, _VTE_CAP_CSI "55~", -1},
         {cursor_all, keypad_all, 0, X_NULL, 0},
 };
 
-static const struct _vte_keymap_entry _vte_keymap_GDK_F35[] = {
+static constexpr struct _vte_keymap_entry _vte_keymap_GDK_F35[] = {
         {cursor_all, keypad_all, 0, _VTE_CAP_CSI "56~", -1},
         {cursor_all, keypad_all, 0, X_NULL, 0},
 };
 
-static const struct _vte_keymap_group {
+static constexpr struct _vte_keymap_group {
 	guint keyval;
 	const struct _vte_keymap_entry *entries;
 } _vte_keymap[] = {
@@ -705,6 +705,103 @@ static const struct _vte_keymap_group {
 	{GDK_KEY_F35,			_vte_keymap_GDK_F35},
 };
 
+/* The entry for a key press is looked up through a hash of the keyval
+ * that is perfect for the keyvals in _vte_keymap, and a table per keyval
+ * of its entry for each combination of modifiers and modes, both
+ * computed at compile time. */
+
+#define VTE_KEYMAP_HASH_SIZE	256
+#define VTE_KEYMAP_NO_ENTRY	0xff
+
+static constexpr guint
+_vte_keymap_hash(guint keyval)
+{
+	/* Folds the 0xff00 page of the function keys onto the latin keyvals */
+	return (keyval + (keyval >> 8)) & (VTE_KEYMAP_HASH_SIZE - 1);
+}
+
+enum _vte_keymap_state {
+	state_shift =		1u << 0,
+	state_control =		1u << 1,
+	state_meta =		1u << 2,
+	state_numlock =		1u << 3,
+	state_cursor_app =	1u << 4,
+	state_keypad_app =	1u << 5,
+	n_states =		1u << 6
+};
+
+static constexpr guint
+_vte_keymap_state_modifiers(guint state)
+{
+	return ((state & state_shift) ? GDK_SHIFT_MASK : 0) |
+	       ((state & state_control) ? GDK_CONTROL_MASK : 0) |
+	       ((state & state_meta) ? VTE_META_MASK : 0) |
+	       ((state & state_numlock) ? VTE_NUMLOCK_MASK : 0);
+}
+
+static inline guint
+_vte_keymap_state(guint modifiers,
+		  enum _vte_cursor_mode cursor_mode,
+		  enum _vte_keypad_mode keypad_mode)
+{
+	return ((modifiers & GDK_SHIFT_MASK) ? state_shift : 0) |
+	       ((modifiers & GDK_CONTROL_MASK) ? state_control : 0) |
+	       ((modifiers & VTE_META_MASK) ? state_meta : 0) |
+	       ((modifiers & VTE_NUMLOCK_MASK) ? state_numlock : 0) |
+	       (cursor_mode == cursor_app ? state_cursor_app : 0) |
+	       (keypad_mode == keypad_app ? state_keypad_app : 0);
+}
+
+struct _vte_keymap_tables {
+	/* Index + 1 into _vte_keymap by hash, or 0 */
+	guint8 groups[VTE_KEYMAP_HASH_SIZE];
+	/* Index into the group's entries by state, or VTE_KEYMAP_NO_ENTRY */
+	guint8 entries[G_N_ELEMENTS(_vte_keymap)][n_states];
+};
+
+static constexpr struct _vte_keymap_tables
+_vte_keymap_build_tables()
+{
+	struct _vte_keymap_tables tables{};
+
+	for (gsize i = 0; i < G_N_ELEMENTS(_vte_keymap); i++) {
+		tables.groups[_vte_keymap_hash(_vte_keymap[i].keyval)] = i + 1;
+
+		const struct _vte_keymap_entry *entries = _vte_keymap[i].entries;
+		for (guint state = 0; state < n_states; state++) {
+			guint cursor_mode = (state & state_cursor_app) ? cursor_app : cursor_default;
+			guint keypad_mode = (state & state_keypad_app) ? keypad_app : keypad_default;
+			guint modifiers = _vte_keymap_state_modifiers(state);
+
+			tables.entries[i][state] = VTE_KEYMAP_NO_ENTRY;
+			for (gsize j = 0; entries[j].normal_length; j++) {
+				if ((entries[j].cursor_mode & cursor_mode) &&
+				    (entries[j].keypad_mode & keypad_mode) &&
+				    (modifiers & entries[j].mod_mask) == entries[j].mod_mask) {
+					tables.entries[i][state] = j;
+					break;
+				}
+			}
+		}
+	}
+
+	return tables;
+}
+
+static constexpr struct _vte_keymap_tables _vte_keymap_tables = _vte_keymap_build_tables();
+
+static constexpr bool
+_vte_keymap_hash_is_perfect()
+{
+	for (gsize i = 0; i < G_N_ELEMENTS(_vte_keymap); i++) {
+		if (_vte_keymap_tables.groups[_vte_keymap_hash(_vte_keymap[i].keyval)] != i + 1)
+			return false;
+	}
+	return G_N_ELEMENTS(_vte_keymap) < VTE_KEYMAP_NO_ENTRY;
+}
+
+static_assert(_vte_keymap_hash_is_perfect(), "Keymap hash has collisions");
+
 /* Map the specified keyval/modifier setup, dependent on the mode, to
  * a literal string. */
 void
@@ -715,10 +812,10 @@ _vte_keymap_map(guint keyval,
 		char **normal,
 		gsize *normal_length)
 {
-	gsize i;
-	const struct _vte_keymap_entry *entries;
+	const struct _vte_keymap_entry *entry;
 	enum _vte_cursor_mode cursor_mode;
 	enum _vte_keypad_mode keypad_mode;
+	guint group, index;
 
 	g_return_if_fail(normal != NULL);
 	g_return_if_fail(normal_length != NULL);
@@ -730,16 +827,9 @@ _vte_keymap_map(guint keyval,
 	*normal = NULL;
 	*normal_length = 0;
 
-	/* Search for the list for this key. */
-	entries = NULL;
-	for (i = 0; i < G_N_ELEMENTS(_vte_keymap); i++) {
-		if (_vte_keymap[i].keyval == keyval) {
-			/* Found it! */
-			entries = _vte_keymap[i].entries;
-			break;
-		}
-	}
-	if (entries == NULL) {
+	/* Look up the list for this key. */
+	group = _vte_keymap_tables.groups[_vte_keymap_hash(keyval)];
+	if (group == 0 || _vte_keymap[group - 1].keyval != keyval) {
 		_vte_debug_print(VTE_DEBUG_KEYBOARD,
 				" (ignoring, no map for key).\n");
 		return;
@@ -750,18 +840,17 @@ _vte_keymap_map(guint keyval,
 	keypad_mode = app_keypad_keys ? keypad_app : keypad_default;
 	modifiers &= GDK_SHIFT_MASK | GDK_CONTROL_MASK | VTE_META_MASK | VTE_NUMLOCK_MASK;
 
-	/* Search for the conditions. */
-	for (i = 0; entries[i].normal_length; i++)
-	if ((entries[i].cursor_mode & cursor_mode) &&
-	    (entries[i].keypad_mode & keypad_mode))
-	if ((modifiers & entries[i].mod_mask) == entries[i].mod_mask) {
-                if (entries[i].normal_length != -1) {
-                        *normal_length = entries[i].normal_length;
-                        *normal = (char*)g_memdup(entries[i].normal,
-                                                  entries[i].normal_length);
+	/* Look up the entry for the conditions. */
+	index = _vte_keymap_tables.entries[group - 1][_vte_keymap_state(modifiers, cursor_mode, keypad_mode)];
+	if (index != VTE_KEYMAP_NO_ENTRY) {
+		entry = &_vte_keymap[group - 1].entries[index];
+                if (entry->normal_length != -1) {
+                        *normal_length = entry->normal_length;
+                        *normal = (char*)g_memdup(entry->normal,
+                                                  entry->normal_length);
                 } else {
-                        *normal_length = strlen(entries[i].normal);
-                        *normal = g_strdup(entries[i].normal);
+                        *normal_length = strlen(entry->normal);
+                        *normal = g_strdup(entry->normal);
                 }
                 _vte_keymap_key_add_key_modifiers(keyval,
                                                   modifiers,
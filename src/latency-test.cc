@@ -0,0 +1,119 @@
+/*
+ * Copyright © 2026 The VTE developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <glib.h>
+
+#include <memory>
+
+#include "latency.hh"
+
+using namespace vte::base;
+
+using Stage = InputLatency::Stage;
+
+static void
+test_latency_buckets(void)
+{
+        using Histogram = InputLatency::Histogram;
+
+        g_assert_cmpuint(Histogram::bucket(-1), ==, 0);
+        g_assert_cmpuint(Histogram::bucket(0), ==, 0);
+        g_assert_cmpuint(Histogram::bucket(1), ==, 0);
+        g_assert_cmpuint(Histogram::bucket(2), ==, 1);
+        g_assert_cmpuint(Histogram::bucket(3), ==, 1);
+        g_assert_cmpuint(Histogram::bucket(1000), ==, 9);
+        g_assert_cmpuint(Histogram::bucket(1024), ==, 10);
+        g_assert_cmpuint(Histogram::bucket(G_MAXINT64), ==, InputLatency::k_n_buckets - 1);
+}
+
+static void
+test_latency_stages(void)
+{
+        auto latency = std::make_unique<InputLatency>();
+
+        latency->key_pressed(1000);
+        g_assert_true(latency->waiting_for_write());
+
+        /* Out of order stages aren't recorded */
+        latency->read(1005);
+        latency->presented(1005);
+        g_assert_cmpuint(latency->histogram(Stage::eRead).n_samples, ==, 0);
+
+        latency->written(1010);
+        /* Another key press doesn't restart it */
+        latency->key_pressed(1020);
+        latency->read(1100);
+        latency->processed(1200);
+        g_assert_true(latency->presented(2000));
+        g_assert_false(latency->waiting_for_present());
+
+        g_assert_cmpuint(latency->histogram(Stage::eWrite).n_samples, ==, 1);
+        g_assert_cmpint(latency->histogram(Stage::eWrite).min, ==, 10);
+        g_assert_cmpint(latency->histogram(Stage::eRead).max, ==, 100);
+        g_assert_cmpint(latency->histogram(Stage::eProcess).total, ==, 200);
+        g_assert_cmpint(latency->histogram(Stage::ePresent).total, ==, 1000);
+        g_assert_cmpuint(latency->histogram(Stage::ePresent).buckets[9], ==, 1);
+        g_assert_cmpint(latency->histogram(Stage::ePresent).last, ==, 1000);
+
+        /* Not followed any more */
+        g_assert_false(latency->presented(3000));
+        g_assert_cmpuint(latency->histogram(Stage::ePresent).n_samples, ==, 1);
+
+        latency->key_pressed(5000);
+        latency->written(5002);
+        g_assert_cmpuint(latency->histogram(Stage::eWrite).n_samples, ==, 2);
+        g_assert_cmpint(latency->histogram(Stage::eWrite).min, ==, 2);
+        g_assert_cmpint(latency->histogram(Stage::eWrite).max, ==, 10);
+
+        latency->reset();
+        g_assert_cmpuint(latency->histogram(Stage::eWrite).n_samples, ==, 0);
+        g_assert_false(latency->waiting_for_read());
+}
+
+static void
+test_latency_timeout(void)
+{
+        auto latency = std::make_unique<InputLatency>();
+
+        /* Never echoed */
+        latency->key_pressed(1000);
+        latency->written(1010);
+        latency->read(1000 + InputLatency::k_timeout + 1);
+        g_assert_cmpuint(latency->histogram(Stage::eRead).n_samples, ==, 0);
+        g_assert_false(latency->waiting_for_process());
+
+        /* Abandoned for a later key press */
+        latency->key_pressed(10000000);
+        latency->written(10000010);
+        latency->key_pressed(10000000 + InputLatency::k_timeout + 1);
+        g_assert_true(latency->waiting_for_write());
+}
+
+int
+main(int argc,
+     char* argv[])
+{
+        g_test_init(&argc, &argv, nullptr);
+
+        g_test_add_func("/vte/latency/buckets", test_latency_buckets);
+        g_test_add_func("/vte/latency/stages", test_latency_stages);
+        g_test_add_func("/vte/latency/timeout", test_latency_timeout);
+
+        return g_test_run();
+}
@@ -0,0 +1,170 @@
+/*
+ * Copyright © 2026 The VTE developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <glib.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+#include "vtedefines.hh"
+
+namespace vte {
+
+namespace base {
+
+/*
+ * InputLatency:
+ *
+ * Measures how long it takes from a key press to its echo being painted,
+ * through the stages in between, and keeps a histogram of each.
+ *
+ * Only one key press is followed at a time: the ones until it is painted
+ * are not measured. A measurement that takes longer than k_timeout, such
+ * as for a key press the child doesn't echo, is dropped.
+ */
+class InputLatency {
+public:
+        static constexpr int64_t const k_timeout = VTE_INPUT_LATENCY_TIMEOUT; /* µs */
+        static constexpr size_t const k_n_buckets = VTE_INPUT_LATENCY_BUCKETS;
+
+        /* The times measured, all from the key press */
+        enum class Stage {
+                eWrite,    /* its input was written to the PTY */
+                eRead,     /* data from the child was read afterwards */
+                eProcess,  /* that data was processed */
+                ePresent,  /* a frame was painted afterwards */
+                eN
+        };
+
+        /*
+         * Histogram:
+         *
+         * Bucket 0 counts the times below 2µs, bucket i > 0 those in
+         * [2^i, 2^(i+1)) µs, and the last bucket also all the longer ones.
+         */
+        struct Histogram {
+                uint64_t n_samples;
+                int64_t last;  /* µs */
+                int64_t min;
+                int64_t max;
+                int64_t total;
+                uint64_t buckets[k_n_buckets];
+
+                static constexpr size_t bucket(int64_t us) noexcept
+                {
+                        if (us < 2)
+                                return 0;
+                        return std::min(size_t(63 - __builtin_clzll(uint64_t(us))), k_n_buckets - 1);
+                }
+
+                void add(int64_t us) noexcept
+                {
+                        last = us;
+                        min = n_samples ? std::min(min, us) : us;
+                        max = n_samples ? std::max(max, us) : us;
+                        total += us;
+                        ++n_samples;
+                        ++buckets[bucket(us)];
+                }
+        };
+
+        InputLatency() noexcept = default;
+        InputLatency(InputLatency const&) = delete;
+        InputLatency(InputLatency&&) = delete;
+        InputLatency& operator= (InputLatency const&) = delete;
+        InputLatency& operator= (InputLatency&&) = delete;
+
+        /* key_pressed:
+         * @time: when the key was pressed
+         *
+         * Starts following this key press unless one is still followed.
+         */
+        void key_pressed(int64_t time) noexcept
+        {
+                if (m_next != Next::eIdle && time - m_press_time <= k_timeout)
+                        return;
+
+                m_press_time = time;
+                m_next = Next::eWrite;
+        }
+
+        /* The stages of the key press, in order; each one is only
+         * recorded after the previous one was.
+         *
+         * Returns: whether the stage was recorded
+         */
+        inline bool written(int64_t time) noexcept { return reached(Next::eWrite, Stage::eWrite, time); }
+        inline bool read(int64_t time) noexcept { return reached(Next::eRead, Stage::eRead, time); }
+        inline bool processed(int64_t time) noexcept { return reached(Next::eProcess, Stage::eProcess, time); }
+        inline bool presented(int64_t time) noexcept { return reached(Next::ePresent, Stage::ePresent, time); }
+
+        /* Returns: whether the next stage of a key press is awaited */
+        inline bool waiting_for_write() const noexcept { return m_next == Next::eWrite; }
+        inline bool waiting_for_read() const noexcept { return m_next == Next::eRead; }
+        inline bool waiting_for_process() const noexcept { return m_next == Next::eProcess; }
+        inline bool waiting_for_present() const noexcept { return m_next == Next::ePresent; }
+
+        inline Histogram const& histogram(Stage stage) const noexcept
+        {
+                return m_histograms[int(stage)];
+        }
+
+        void reset() noexcept
+        {
+                m_next = Next::eIdle;
+                for (auto& histogram : m_histograms)
+                        histogram = Histogram{};
+        }
+
+private:
+        enum class Next {
+                eWrite,
+                eRead,
+                eProcess,
+                ePresent,
+                eIdle
+        };
+
+        Next m_next{Next::eIdle};
+        int64_t m_press_time{0};
+        Histogram m_histograms[int(Stage::eN)]{};
+
+        bool reached(Next next,
+                     Stage stage,
+                     int64_t time) noexcept
+        {
+                if (m_next != next)
+                        return false;
+
+                auto const us = time - m_press_time;
+                if (us > k_timeout) {
+                        m_next = Next::eIdle;
+                        return false;
+                }
+
+                m_histograms[int(stage)].add(us);
+                m_next = next == Next::ePresent ? Next::eIdle : Next(int(next) + 1);
+                return true;
+        }
+};
+
+} // namespace base
+
+} // namespace vte
@@ -145,6 +145,15 @@ MODE(VTE_BIDI_BOX_MIRROR, 2500)
  */
 MODE(VTE_BIDI_AUTO, 2501)
 
+/*
+ * Whether output is synchronized: while set, the screen isn't
+ * updated, and everything received is shown at once when the
+ * mode is reset, or after a timeout. Same as XDGSYNC.
+ *
+ * Reference: Terminal-wg/synchronized-output
+ */
+MODE(VTE_SYNCHRONIZED_OUTPUT, 2026)
+
 /* XTERM */
 
 MODE(XTERM_MOUSE_X10,                   9)
@@ -75,6 +75,13 @@ test_modes_private(void)
         modes.clear_saved();
         set = modes.pop_saved(vte::terminal::modes::Private::eXTERM_FOCUS);
         g_assert_false(set);
+
+        g_assert_cmpint(modes.mode_from_param(2026), ==, vte::terminal::modes::Private::eVTE_SYNCHRONIZED_OUTPUT);
+        g_assert_false(modes.VTE_SYNCHRONIZED_OUTPUT());
+        modes.set_VTE_SYNCHRONIZED_OUTPUT(true);
+        g_assert_true(modes.VTE_SYNCHRONIZED_OUTPUT());
+        modes.reset();
+        g_assert_false(modes.VTE_SYNCHRONIZED_OUTPUT());
 }
 
 int
@@ -0,0 +1,122 @@
+/*
+ * Copyright © 2026 The VTE developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <glib.h>
+
+#include <string>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "outgoing-queue.hh"
+
+using namespace vte::base;
+
+static std::string
+make_data(size_t len)
+{
+        auto data = std::string(len, '\0');
+        for (auto i = size_t{0}; i < len; i++)
+                data[i] = char('a' + i % 26);
+        return data;
+}
+
+static std::string
+peek_all(OutgoingQueue const& queue)
+{
+        auto str = std::string{};
+        queue.peek(queue.size(), [&](uint8_t const* data, size_t len) {
+                str.append(reinterpret_cast<char const*>(data), len);
+        });
+        return str;
+}
+
+static void
+test_outgoing_queue_append(void)
+{
+        OutgoingQueue queue;
+        g_assert_true(queue.empty());
+
+        /* Spanning several chunks, appended in pieces */
+        auto const data = make_data(3 * Chunk::k_chunk_size + 17);
+        for (auto i = size_t{0}; i < data.size(); i += 1000)
+                queue.append(data.data() + i, std::min(size_t{1000}, data.size() - i));
+
+        g_assert_cmpuint(queue.size(), ==, data.size());
+        g_assert_true(peek_all(queue) == data);
+
+        /* Consuming within a chunk and across chunks */
+        queue.consume(5);
+        g_assert_true(peek_all(queue) == data.substr(5));
+        queue.consume(Chunk::k_chunk_size);
+        g_assert_true(peek_all(queue) == data.substr(5 + Chunk::k_chunk_size));
+
+        queue.consume(data.size());
+        g_assert_true(queue.empty());
+        g_assert_true(peek_all(queue).empty());
+
+        queue.append("xyz", 3);
+        g_assert_true(peek_all(queue) == "xyz");
+        queue.clear();
+        g_assert_true(queue.empty());
+}
+
+static void
+test_outgoing_queue_write(void)
+{
+        int fds[2];
+        g_assert_cmpint(pipe(fds), ==, 0);
+        g_assert_cmpint(fcntl(fds[1], F_SETFL, O_NONBLOCK), ==, 0);
+
+        OutgoingQueue queue;
+        g_assert_cmpint(queue.write(fds[1]), ==, 0);
+
+        auto const data = make_data(2 * Chunk::k_chunk_size + 100);
+        queue.append(data.data(), data.size());
+        queue.consume(10);
+
+        /* Gathered into one write */
+        auto const count = queue.write(fds[1]);
+        g_assert_cmpint(count, ==, data.size() - 10);
+
+        /* The written data stays queued until consumed */
+        g_assert_cmpuint(queue.size(), ==, data.size() - 10);
+        queue.consume(count);
+        g_assert_true(queue.empty());
+
+        auto buf = std::string(data.size(), '\0');
+        g_assert_cmpint(read(fds[0], &buf[0], buf.size()), ==, count);
+        buf.resize(count);
+        g_assert_true(buf == data.substr(10));
+
+        close(fds[0]);
+        close(fds[1]);
+}
+
+int
+main(int argc,
+     char* argv[])
+{
+        g_test_init(&argc, &argv, nullptr);
+
+        g_test_add_func("/vte/outgoing-queue/append", test_outgoing_queue_append);
+        g_test_add_func("/vte/outgoing-queue/write", test_outgoing_queue_write);
+
+        return g_test_run();
+}
@@ -0,0 +1,164 @@
+/*
+ * Copyright © 2026 The VTE developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#include "chunk.hh"
+
+namespace vte {
+
+namespace base {
+
+/*
+ * OutgoingQueue:
+ *
+ * The data waiting to be written to the PTY, in a list of chunks. Writing
+ * gathers several chunks into one writev(), and the written data is
+ * consumed by advancing over it, never by moving the rest.
+ */
+class OutgoingQueue {
+public:
+        /* The most chunks written with one writev() */
+        static constexpr unsigned const k_max_iov = 16;
+
+        OutgoingQueue() noexcept = default;
+        OutgoingQueue(OutgoingQueue const&) = delete;
+        OutgoingQueue(OutgoingQueue&&) = delete;
+        OutgoingQueue& operator= (OutgoingQueue const&) = delete;
+        OutgoingQueue& operator= (OutgoingQueue&&) = delete;
+
+        /* Returns: the number of bytes queued */
+        inline size_t size() const noexcept { return m_size; }
+        inline bool empty() const noexcept { return m_size == 0; }
+
+        /* append:
+         *
+         * Copies @len bytes at @data to the end of the queue, filling up
+         * the last chunk before taking new ones.
+         */
+        void append(void const* data,
+                    size_t len) noexcept
+        {
+                auto p = reinterpret_cast<uint8_t const*>(data);
+                m_size += len;
+
+                while (len != 0) {
+                        if (m_chunks.empty() ||
+                            m_chunks.back()->remaining_capacity() == 0)
+                                m_chunks.push_back(Chunk::get());
+
+                        auto& chunk = m_chunks.back();
+                        auto const n = std::min(len, chunk->remaining_capacity());
+                        memcpy(chunk->data + chunk->len, p, n);
+                        chunk->len += n;
+                        p += n;
+                        len -= n;
+                }
+        }
+
+        void clear() noexcept
+        {
+                m_chunks.clear();
+                m_offset = 0;
+                m_size = 0;
+        }
+
+        /* write:
+         *
+         * Writes from the start of the queue to @fd, gathering up to
+         * k_max_iov chunks. The written data isn't consumed.
+         *
+         * Returns: the number of bytes written, or -1 with errno set
+         */
+        ssize_t write(int fd) const noexcept
+        {
+                struct iovec iov[k_max_iov];
+                auto n_iov = 0u;
+                auto offset = m_offset;
+                for (auto const& chunk : m_chunks) {
+                        if (n_iov == k_max_iov)
+                                break;
+
+                        iov[n_iov].iov_base = chunk->data + offset;
+                        iov[n_iov].iov_len = chunk->len - offset;
+                        ++n_iov;
+                        offset = 0;
+                }
+
+                return n_iov != 0 ? ::writev(fd, iov, n_iov) : 0;
+        }
+
+        /* peek:
+         *
+         * Calls @func(data, len) for the pieces of the first @count queued bytes.
+         */
+        template<typename F>
+        void peek(size_t count,
+                  F&& func) const noexcept
+        {
+                auto offset = m_offset;
+                for (auto const& chunk : m_chunks) {
+                        if (count == 0)
+                                break;
+
+                        auto const n = std::min(count, size_t(chunk->len - offset));
+                        func(chunk->data + offset, n);
+                        count -= n;
+                        offset = 0;
+                }
+        }
+
+        /* consume:
+         *
+         * Drops the first @count queued bytes, recycling the chunks that
+         * were entirely consumed.
+         */
+        void consume(size_t count) noexcept
+        {
+                count = std::min(count, m_size);
+                m_size -= count;
+
+                while (count != 0) {
+                        auto const n = std::min(count, size_t(m_chunks.front()->len - m_offset));
+                        m_offset += n;
+                        count -= n;
+
+                        if (m_offset == m_chunks.front()->len) {
+                                m_chunks.pop_front();
+                                m_offset = 0;
+                        }
+                }
+        }
+
+private:
+        std::deque<Chunk::unique_type> m_chunks{};
+        size_t m_offset{0}; /* of the first unconsumed byte in the first chunk */
+        size_t m_size{0};
+};
+
+} // namespace base
+
+} // namespace vte
@@ -30,6 +30,7 @@
 
 #include <string>
 
+#include "bench.hh"
 #include "debug.h"
 #include "glib-glue.hh"
 #include "parser.hh"
@@ -69,6 +70,7 @@ seq_to_str(unsigned int type) noexcept
         case VTE_SEQ_APC: return "APC";
         case VTE_SEQ_PM: return "PM";
         case VTE_SEQ_SOS: return "SOS";
+        case VTE_SEQ_DCS_DATA: return "DCS_DATA";
         default:
                 assert(false);
         }
@@ -622,7 +624,7 @@ class Processor {
 private:
         gsize m_seq_stats[VTE_SEQ_N];
         gsize m_cmd_stats[VTE_CMD_N];
-        GArray* m_bench_times;
+        vte::base::Benchmark m_benchmark{"sequences"};
 
         template<class Functor>
         void
@@ -639,6 +641,9 @@ private:
 
                 vte::base::UTF8Decoder decoder;
 
+                gsize n_bytes = 0;
+                gsize n_seqs = 0;
+
                 gsize buf_start = 0;
                 for (;;) {
                         auto len = read(fd, buf + buf_start, buf_size - buf_start);
@@ -650,6 +655,8 @@ private:
                                 break;
                         }
 
+                        n_bytes += len;
+
                         auto const bufend = buf + len;
                         for (auto sptr = buf; sptr < bufend; ++sptr) {
                                 switch (decoder.decode(*sptr)) {
@@ -673,6 +680,7 @@ private:
 
                                         m_seq_stats[ret]++;
                                         if (ret != VTE_SEQ_NONE) {
+                                                n_seqs++;
                                                 m_cmd_stats[seq.command()]++;
                                                 func(seq);
                                         }
@@ -688,7 +696,7 @@ private:
         out:
 
                 int64_t time_spent = g_get_monotonic_time() - start_time;
-                g_array_append_val(m_bench_times, time_spent);
+                m_benchmark.add(time_spent, n_bytes, n_seqs);
 
                 g_free(buf);
         }
@@ -722,13 +730,9 @@ public:
         {
                 memset(&m_seq_stats, 0, sizeof(m_seq_stats));
                 memset(&m_cmd_stats, 0, sizeof(m_cmd_stats));
-                m_bench_times = g_array_new(false, true, sizeof(int64_t));
         }
 
-        ~Processor() noexcept
-        {
-                g_array_free(m_bench_times, true);
-        }
+        ~Processor() noexcept = default;
 
         template<class Functor>
         bool
@@ -771,11 +775,16 @@ public:
                         g_printerr("%\'16" G_GSIZE_FORMAT " %s\n",  m_seq_stats[s], seq_to_str(s));
                 }
 
+                gsize total = 0;
+                for (unsigned int s = 0; s < VTE_CMD_N; s++)
+                        total += m_cmd_stats[s];
+
                 g_printerr("\n");
                 for (unsigned int s = 0; s < VTE_CMD_N; s++) {
                         if (m_cmd_stats[s] > 0) {
-                                g_printerr("%\'16" G_GSIZE_FORMAT " %s%s\n",
+                                g_printerr("%\'16" G_GSIZE_FORMAT " %6.2f%% %s%s\n",
                                            m_cmd_stats[s],
+                                           100. * double(m_cmd_stats[s]) / double(total),
                                            cmd_to_str(s),
                                            s >= VTE_CMD_NOP_FIRST ? " [NOP]" : "");
                         }
@@ -784,26 +793,41 @@ public:
 
         void print_benchmark() const noexcept
         {
-                g_array_sort(m_bench_times,
-                             [](void const* p1, void const* p2) -> int {
-                                     int64_t const t1 = *(int64_t const*)p1;
-                                     int64_t const t2 = *(int64_t const*)p2;
-                                     return t1 == t2 ? 0 : (t1 < t2 ? -1 : 1);
-                             });
-
-                int64_t total_time = 0;
-                for (unsigned int i = 0; i < m_bench_times->len; ++i)
-                        total_time += g_array_index(m_bench_times, int64_t, i);
-
-                g_printerr("\nTimes: best %\'" G_GINT64_FORMAT "µs "
-                           "worst %\'" G_GINT64_FORMAT "µs "
-                           "average %\'" G_GINT64_FORMAT "µs\n",
-                           g_array_index(m_bench_times, int64_t, 0),
-                           g_array_index(m_bench_times, int64_t, m_bench_times->len - 1),
-                           total_time / (int64_t)m_bench_times->len);
-                for (unsigned int i = 0; i < m_bench_times->len; ++i)
-                        g_printerr("  %\'" G_GINT64_FORMAT "µs\n",
-                                   g_array_index(m_bench_times, int64_t, i));
+                m_benchmark.print();
+        }
+
+        /* Prints the benchmark results, and the sequence and command
+         * statistics, as one JSON object to stdout.
+         */
+        void print_json() const noexcept
+        {
+                auto str = std::string{"{\"benchmark\":"};
+                m_benchmark.append_json(str);
+
+                str.append(",\"sequences\":{");
+                auto first = true;
+                for (unsigned int s = VTE_SEQ_NONE + 1; s < VTE_SEQ_N; s++) {
+                        if (!first)
+                                str.push_back(',');
+                        first = false;
+                        vte::base::Benchmark::append_json_string(str, seq_to_str(s));
+                        vte::base::Benchmark::append_format(str, ":%" G_GSIZE_FORMAT, m_seq_stats[s]);
+                }
+
+                str.append("},\"commands\":{");
+                first = true;
+                for (unsigned int s = 0; s < VTE_CMD_N; s++) {
+                        if (m_cmd_stats[s] == 0)
+                                continue;
+                        if (!first)
+                                str.push_back(',');
+                        first = false;
+                        vte::base::Benchmark::append_json_string(str, cmd_to_str(s));
+                        vte::base::Benchmark::append_format(str, ":%" G_GSIZE_FORMAT, m_cmd_stats[s]);
+                }
+                str.append("}}\n");
+
+                g_print("%s", str.c_str());
         }
 
 }; // class Processor
@@ -812,6 +836,7 @@ class Options {
 private:
         bool m_benchmark{false};
         bool m_codepoints{false};
+        bool m_json{false};
         bool m_lint{false};
         bool m_plain{false};
         bool m_quiet{false};
@@ -848,6 +873,7 @@ public:
 
         inline constexpr bool benchmark()  const noexcept { return m_benchmark;  }
         inline constexpr bool codepoints() const noexcept { return m_codepoints; }
+        inline constexpr bool json()       const noexcept { return m_json;       }
         inline constexpr bool lint()       const noexcept { return m_lint;       }
         inline constexpr bool plain()      const noexcept { return m_plain;      }
         inline constexpr bool quiet()      const noexcept { return m_quiet;      }
@@ -861,6 +887,7 @@ public:
         {
                 BoolArg benchmark{&m_benchmark, false};
                 BoolArg codepoints{&m_codepoints, false};
+                BoolArg json{&m_json, false};
                 BoolArg lint{&m_lint, false};
                 BoolArg plain{&m_plain, false};
                 BoolArg quiet{&m_quiet, false};
@@ -872,6 +899,8 @@ public:
                           "Measure time spent parsing each file", nullptr },
                         { "codepoints", 'u', 0, G_OPTION_ARG_NONE, codepoints.ptr(),
                           "Output unicode code points by number", nullptr },
+                        { "json", 'j', 0, G_OPTION_ARG_NONE, json.ptr(),
+                          "Output benchmark and statistics as JSON instead of the parsed input", nullptr },
                         { "lint", 'l', 0, G_OPTION_ARG_NONE, lint.ptr(),
                           "Check input", nullptr },
                         { "plain", 'p', 0, G_OPTION_ARG_NONE, plain.ptr(),
@@ -916,7 +945,7 @@ main(int argc,
         if (options.lint()) {
                 Linter linter{};
                 rv = proc.process_files(options.filenames(), 1, linter);
-        } else if (options.quiet()) {
+        } else if (options.quiet() || options.json()) {
                 Sink sink{};
                 rv = proc.process_files(options.filenames(), options.repeat(), sink);
         } else {
@@ -924,10 +953,14 @@ main(int argc,
                 rv = proc.process_files(options.filenames(), options.repeat(), pp);
         }
 
-        if (options.statistics())
-                proc.print_statistics();
-        if (options.benchmark())
-                proc.print_benchmark();
+        if (options.json()) {
+                proc.print_json();
+        } else {
+                if (options.statistics())
+                        proc.print_statistics();
+                if (options.benchmark())
+                        proc.print_benchmark();
+        }
 
         return rv ? EXIT_SUCCESS : EXIT_FAILURE;
 }
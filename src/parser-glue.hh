@@ -20,6 +20,7 @@
 #include <cstdint>
 #include <algorithm>
 #include <string>
+#include <string_view>
 
 #include "parser.hh"
 
@@ -53,11 +54,29 @@ public:
                 return vte_parser_feed(&m_parser, raw);
         }
 
+        /* Feeds a run of printable characters at once, see vte_parser_feed_run() */
+        inline int feed(uint32_t const* begin,
+                        uint32_t const* end,
+                        size_t* n_consumed) noexcept
+        {
+                return vte_parser_feed_run(&m_parser, begin, end, n_consumed);
+        }
+
+        inline bool is_graphic(uint32_t raw) const noexcept
+        {
+                return vte_parser_is_graphic(&m_parser, raw);
+        }
+
         inline void reset() noexcept
         {
                 vte_parser_reset(&m_parser);
         }
 
+        inline constexpr bool is_ground() const noexcept
+        {
+                return m_parser.state == VTE_PARSER_STATE_GROUND;
+        }
+
 protected:
         vte_parser_t m_parser;
 }; // class Parser
@@ -173,36 +192,43 @@ public:
                 return m_seq->intermediates;
         }
 
-        // FIXMEchpe: upgrade to C++17 and use the u32string_view version below, instead
         /*
          * string:
          *
          * This is the string argument of a DCS or OSC sequence.
          *
-         * Returns: the string argument
+         * Returns: the string argument, as a view into the parser's
+         *   storage; it is only valid until the next character is fed
          */
-        inline std::u32string string() const noexcept
+        inline std::u32string_view string() const noexcept
         {
-                size_t len;
+                size_t len = 0;
                 auto buf = vte_seq_string_get(&m_seq->arg_str, &len);
-                return std::u32string(reinterpret_cast<char32_t*>(buf), len);
+                return std::u32string_view(reinterpret_cast<char32_t const*>(buf), len);
         }
 
-        #if 0
-        /*
-         * string:
+        /* string_chunk:
          *
-         * This is the string argument of a DCS or OSC sequence.
+         * For a streamed DCS, dispatched as %VTE_SEQ_DCS_DATA sequences
+         * followed by the final %VTE_SEQ_DCS, the index of the chunk of
+         * the data that string() holds; 0 for the first.
          *
-         * Returns: the string argument
+         * Returns: the index of the chunk
          */
-        inline constexpr std::u32string_view string() const noexcept
+        inline constexpr unsigned int string_chunk() const noexcept
         {
-                size_t len = 0;
-                auto buf = vte_seq_string_get(&m_seq->arg_str, &len);
-                return std::u32string_view(buf, len);
+                return m_seq->n_chunks;
         }
-        #endif
+
+        /*
+         * string_utf8:
+         * @str: the string to store the result in
+         *
+         * Converts the string argument of a DCS or OSC sequence to UTF-8,
+         * replacing the contents of @str. Reusing @str avoids allocating
+         * for every sequence.
+         */
+        void string_utf8(std::string& str) const noexcept;
 
         /*
          * string:
@@ -229,6 +255,15 @@ public:
                 return m_seq->n_args;
         }
 
+        /* args:
+         *
+         * Returns: the raw parameters; there are size() of them
+         */
+        inline constexpr vte_seq_arg_t const* args() const noexcept
+        {
+                return m_seq->args;
+        }
+
 
         /* size:
          *
@@ -19,44 +19,59 @@
 
 #include <glib.h>
 #include <assert.h>
+#include <algorithm>
 #include <cstdint>
 #include <cstring>
 
+#include "vtedefines.hh"
+
+#define VTE_SEQ_STRING_MAX_CAPACITY     (1 << 12)
+
+/* Enough to collect an OSC 8 with the longest hyperlink we accept,
+ * including the OSC number and separators, without allocating.
+ */
+#define VTE_SEQ_STRING_ARENA_CAPACITY   (VTE_HYPERLINK_TOTAL_LENGTH_MAX + 16)
+
+static_assert(VTE_SEQ_STRING_ARENA_CAPACITY <= VTE_SEQ_STRING_MAX_CAPACITY, "arena too large");
+
 /*
  * vte_seq_string_t:
  *
  * A type to hold the argument string of a DSC or OSC sequence.
+ *
+ * The string is collected into the inline arena, and only moves to
+ * the heap when it outgrows it. Since @buf may point into the struct
+ * itself, a vte_seq_string_t must not be copied or moved.
  */
 typedef struct vte_seq_string_t {
         uint32_t capacity;
         uint32_t len;
         uint32_t* buf;
+        uint32_t arena[VTE_SEQ_STRING_ARENA_CAPACITY];
 } vte_seq_string_t;
 
-#define VTE_SEQ_STRING_DEFAULT_CAPACITY (1 << 7) /* must be power of two */
-#define VTE_SEQ_STRING_MAX_CAPACITY     (1 << 12)
-
 /*
  * vte_seq_string_init:
  *
- * Returns: a new #vte_seq_string_t
+ * Initialises @str to an empty string using its arena.
  */
 static inline void vte_seq_string_init(vte_seq_string_t* str) noexcept
 {
-        str->capacity = VTE_SEQ_STRING_DEFAULT_CAPACITY;
+        str->capacity = VTE_SEQ_STRING_ARENA_CAPACITY;
         str->len = 0;
-        str->buf = (uint32_t*)g_malloc0_n(str->capacity, sizeof(uint32_t));
+        str->buf = str->arena;
 }
 
 /*
  * vte_seq_string_free:
  * @string:
  *
- * Frees @string's storage and itself.
+ * Frees @string's heap storage, if any.
  */
 static inline void vte_seq_string_free(vte_seq_string_t* str) noexcept
 {
-        g_free(str->buf);
+        if (str->buf != str->arena)
+                g_free(str->buf);
 }
 
 /*
@@ -64,7 +79,7 @@ static inline void vte_seq_string_free(vte_seq_string_t* str) noexcept
  * @string:
  *
  * If @string's length is at capacity, and capacity is not maximal,
- * expands the string's capacity.
+ * expands the string's capacity, moving it off the arena if necessary.
  *
  * Returns: %true if the string has capacity for at least one more character
  */
@@ -75,8 +90,14 @@ static inline bool vte_seq_string_ensure_capacity(vte_seq_string_t* str) noexcep
         if (str->capacity >= VTE_SEQ_STRING_MAX_CAPACITY)
                 return false;
 
-        str->capacity *= 2;
-        str->buf = (uint32_t*)g_realloc_n(str->buf, str->capacity, sizeof(uint32_t));
+        auto const capacity = std::min(str->capacity * 2, uint32_t{VTE_SEQ_STRING_MAX_CAPACITY});
+        if (str->buf == str->arena) {
+                str->buf = (uint32_t*)g_malloc_n(capacity, sizeof(uint32_t));
+                memcpy(str->buf, str->arena, str->len * sizeof(uint32_t));
+        } else {
+                str->buf = (uint32_t*)g_realloc_n(str->buf, capacity, sizeof(uint32_t));
+        }
+        str->capacity = capacity;
         return true;
 }
 
@@ -63,6 +63,7 @@ seq_to_str(unsigned int type)
         case VTE_SEQ_PM: return "PM";
         case VTE_SEQ_SOS: return "SOS";
         case VTE_SEQ_SCI: return "SCI";
+        case VTE_SEQ_DCS_DATA: return "DCS_DATA";
         default:
                 g_assert_not_reached();
         }
@@ -304,6 +305,56 @@ test_seq_control(void)
         }
 }
 
+static void
+test_seq_graphic_run(void)
+{
+        static uint32_t const str[] = { 'a', 'b', 0xe9, 0x4e2d, 0x1b, '[', 'm', 'c', 'd', 0x7f, 'e' };
+        uint32_t const* ptr = str;
+        uint32_t const* end = str + G_N_ELEMENTS(str);
+        size_t n;
+
+        parser.reset();
+        g_assert_true(parser.is_graphic('a'));
+        g_assert_false(parser.is_graphic(0x1b));
+
+        /* The whole run up to ESC */
+        auto rv = parser.feed(ptr, end, &n);
+        g_assert_cmpint(rv, ==, VTE_SEQ_GRAPHIC);
+        g_assert_cmpuint(n, ==, 4);
+        g_assert_cmpuint(seq.terminator(), ==, 0x4e2dU);
+        ptr += n;
+
+        /* Outside of ground state, one character at a time */
+        rv = parser.feed(ptr, end, &n);
+        g_assert_cmpint(rv, ==, VTE_SEQ_NONE);
+        g_assert_cmpuint(n, ==, 1);
+        ptr += n;
+        g_assert_false(parser.is_graphic('['));
+        rv = parser.feed(ptr, end, &n);
+        g_assert_cmpuint(n, ==, 1);
+        ptr += n;
+        rv = parser.feed(ptr, end, &n);
+        g_assert_cmpint(rv, ==, VTE_SEQ_CSI);
+        g_assert_cmpuint(seq.command(), ==, VTE_CMD_SGR);
+        g_assert_cmpuint(n, ==, 1);
+        ptr += n;
+
+        /* DEL ends a run */
+        rv = parser.feed(ptr, end, &n);
+        g_assert_cmpint(rv, ==, VTE_SEQ_GRAPHIC);
+        g_assert_cmpuint(n, ==, 2);
+        g_assert_cmpuint(seq.terminator(), ==, (uint32_t)'d');
+        ptr += n;
+        rv = parser.feed(ptr, end, &n);
+        g_assert_cmpint(rv, ==, VTE_SEQ_NONE);
+        g_assert_cmpuint(n, ==, 1);
+        ptr += n;
+        rv = parser.feed(ptr, end, &n);
+        g_assert_cmpint(rv, ==, VTE_SEQ_GRAPHIC);
+        g_assert_cmpuint(n, ==, 1);
+        g_assert_true(ptr + n == end);
+}
+
 static void
 test_seq_esc_invalid(void)
 {
@@ -929,6 +980,53 @@ test_seq_dcs(void)
         test_seq_dcs(U"123;TESTING"s);
 }
 
+static void
+test_seq_dcs_streamed(void)
+{
+        /* The data of DECSIXEL comes in chunks of the string's maximum length */
+        auto const len = size_t{VTE_SEQ_STRING_MAX_CAPACITY * 5 / 2};
+        auto const data = std::u32string(len, U'~');
+        auto n_chunks = 0u;
+        auto n_data = size_t{0};
+
+        for (auto i = 0; i < 2; ++i) {
+                parser.reset();
+                n_chunks = 0;
+                n_data = 0;
+
+                auto rv = feed_parser(U"\x1bP0;1q"s);
+                g_assert_cmpint(rv, ==, VTE_SEQ_NONE);
+                /* The second time, the data ends with the chunk */
+                for (auto c : (i == 0 ? data : data.substr(0, VTE_SEQ_STRING_MAX_CAPACITY * 2))) {
+                        rv = parser.feed(c);
+                        if (rv == VTE_SEQ_NONE)
+                                continue;
+
+                        g_assert_cmpint(rv, ==, VTE_SEQ_DCS_DATA);
+                        g_assert_cmpint(seq.command(), ==, VTE_CMD_DECSIXEL);
+                        g_assert_cmpuint(seq.string_chunk(), ==, n_chunks);
+                        g_assert_cmpuint(seq.string().size(), ==, VTE_SEQ_STRING_MAX_CAPACITY);
+                        g_assert_cmpint(seq.param(1), ==, 1);
+                        ++n_chunks;
+                        n_data += seq.string().size();
+                }
+
+                rv = feed_parser(U"\x1b\\"s);
+                g_assert_cmpint(rv, ==, VTE_SEQ_DCS);
+                g_assert_cmpint(seq.command(), ==, VTE_CMD_DECSIXEL);
+                g_assert_cmpuint(seq.string_chunk(), ==, n_chunks);
+                n_data += seq.string().size();
+
+                g_assert_cmpuint(n_chunks, ==, 2);
+                g_assert_cmpuint(n_data, ==, i == 0 ? len : VTE_SEQ_STRING_MAX_CAPACITY * 2);
+        }
+
+        /* Other DCS are still limited to the maximum length */
+        parser.reset();
+        auto rv = feed_parser(U"\x1bP1$q"s + data + U"\x9c"s);
+        g_assert_cmpint(rv, ==, VTE_SEQ_NONE);
+}
+
 static void
 test_seq_dcs_known(uint32_t f,
                    uint32_t p,
@@ -1489,6 +1587,7 @@ main(int argc,
         g_test_add_func("/vte/parser/sequences/glue/sequence-builder", test_seq_glue_sequence_builder);
         g_test_add_func("/vte/parser/sequences/glue/reply-builder", test_seq_glue_reply_builder);
         g_test_add_func("/vte/parser/sequences/control", test_seq_control);
+        g_test_add_func("/vte/parser/sequences/graphic-run", test_seq_graphic_run);
         g_test_add_func("/vte/parser/sequences/escape/invalid", test_seq_esc_invalid);
         g_test_add_func("/vte/parser/sequences/escape/charset/94", test_seq_esc_charset_94);
         g_test_add_func("/vte/parser/sequences/escape/charset/96", test_seq_esc_charset_96);
@@ -1508,6 +1607,7 @@ main(int argc,
         g_test_add_func("/vte/parser/sequences/sci/known", test_seq_sci_known);
         g_test_add_func("/vte/parser/sequences/dcs", test_seq_dcs);
         g_test_add_func("/vte/parser/sequences/dcs/known", test_seq_dcs_known);
+        g_test_add_func("/vte/parser/sequences/dcs/streamed", test_seq_dcs_streamed);
         g_test_add_func("/vte/parser/sequences/osc", test_seq_osc);
 
         return g_test_run();
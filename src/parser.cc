@@ -20,6 +20,7 @@
 
 #include "parser.hh"
 
+#include <array>
 #include <cstdio>
 #include <cstring>
 #include <cstdlib>
@@ -517,87 +518,259 @@ enum parser_state_t {
         STATE_N,
 };
 
+static_assert(STATE_GROUND == VTE_PARSER_STATE_GROUND, "Parser ground state mismatch");
+
 /* Parser state transitioning */
 
-typedef int (* parser_action_func)(vte_parser_t* parser, uint32_t raw);
+/*
+ * The state machine is compiled into a dense table, indexed by the state
+ * and the class of the character, which is the character itself below
+ * 0xa0, and one class for everything from 0xa0 up. An entry holds the
+ * state to enter, and the action to perform after entering it.
+ */
 
-// FIXMEchpe: I get weird performance results here from
-// either not inlining, inlining these function or the
-// macros below. Sometimes (after a recompile) one is
-// (as much as 50%!) slower, sometimes the other one etc. ‽
+enum parser_action_t : uint8_t {
+        ACTION_NONE,
+        ACTION_CLEAR,
+        ACTION_CLEAR_INT,
+        ACTION_CLEAR_INT_AND_PARAMS,
+        ACTION_CLEAR_PARAMS_ONLY,
+        ACTION_IGNORE,
+        ACTION_PRINT,
+        ACTION_EXECUTE,
+        ACTION_COLLECT_ESC,
+        ACTION_COLLECT_CSI,
+        ACTION_COLLECT_PARAMETER,
+        ACTION_PARAM,
+        ACTION_FINISH_PARAM,
+        ACTION_FINISH_SUBPARAM,
+        ACTION_ESC_DISPATCH,
+        ACTION_CSI_DISPATCH,
+        ACTION_DCS_START,
+        ACTION_DCS_CONSUME,
+        ACTION_DCS_COLLECT,
+        ACTION_DCS_DISPATCH,
+        ACTION_OSC_START,
+        ACTION_OSC_COLLECT,
+        ACTION_OSC_DISPATCH,
+        ACTION_SCI_DISPATCH,
+
+        ACTION_N,
+
+        ACTION_COLLECT_DCS = ACTION_COLLECT_CSI,
+
+        /* Flag: first do the ESC state entry that STATE_DCS_PASS_ESC
+         * and STATE_OSC_STRING_ESC deferred.
+         */
+        ACTION_FLAG_DEFERRED_CLEAR = 0x80,
+};
 
-#if 1 // (inline) functions
+static_assert(STATE_N <= 0xff, "Too many parser states");
+static_assert(ACTION_N < ACTION_FLAG_DEFERRED_CLEAR, "Too many parser actions");
 
-// #define PTINLINE inline
-#define PTINLINE
+#define PARSER_N_CLASSES (0xa1)
 
-/* nop */
-static PTINLINE int
-parser_nop(vte_parser_t* parser,
-           uint32_t raw)
+static constexpr inline unsigned int
+parser_class(uint32_t raw)
 {
-        return VTE_SEQ_NONE;
+        return raw < 0xa0 ? raw : 0xa0;
 }
-/* dispatch related actions */
-static PTINLINE int
-parser_action(vte_parser_t* parser,
-              uint32_t raw,
-              parser_action_func action)
+
+struct parser_transition_t {
+        uint8_t state;
+        uint8_t action;
+};
+
+using parser_table_t = std::array<std::array<parser_transition_t, PARSER_N_CLASSES>, STATE_N>;
+
+static constexpr void
+parser_table_set(parser_table_t& table,
+                 unsigned int state,
+                 unsigned int first,
+                 unsigned int last,
+                 unsigned int next_state,
+                 unsigned int action)
 {
-        return action(parser, raw);
+        for (auto c = first; c <= last; ++c)
+                table[state][c] = parser_transition_t{uint8_t(next_state), uint8_t(action)};
 }
 
-/* perform state transition */
-static PTINLINE int
-parser_transition_no_action(vte_parser_t* parser,
-                            uint32_t raw,
-                            unsigned int state)
+static constexpr void
+parser_table_set(parser_table_t& table,
+                 unsigned int state,
+                 unsigned int c,
+                 unsigned int next_state,
+                 unsigned int action)
 {
-        parser->state = state;
-        return VTE_SEQ_NONE;
+        parser_table_set(table, state, c, c, next_state, action);
 }
 
-/* perform state transition and dispatch related actions */
-static PTINLINE int
-parser_transition(vte_parser_t* parser,
-                  uint32_t raw,
-                  unsigned int state,
-                  parser_action_func action)
+/* Sets the transitions on C0 (except ESC) to perform @action without
+ * changing state, and on ESC, to start an escape sequence.
+ */
+static constexpr void
+parser_table_set_c0(parser_table_t& table,
+                    unsigned int state,
+                    unsigned int action)
 {
-        parser->state = state;
-
-        return action(parser, raw);
+        parser_table_set(table, state, 0x00, 0x1a, state, action);
+        parser_table_set(table, state, 0x1b, STATE_ESC, ACTION_CLEAR_INT);
+        parser_table_set(table, state, 0x1c, 0x1f, state, action);
 }
 
-#undef PTINLINE
-
-#else // macros
-
-/* nop */
-#define parser_nop(parser,raw) \
-        ({ VTE_SEQ_NONE; })
-
-/* dispatch related actions */
-#define parser_action(p,r,a) \
-        ({ \
-                a((p), (r)); \
-        })
+static constexpr parser_table_t
+parser_make_table()
+{
+        parser_table_t t{};
+
+        /* Every state's default transition */
+        constexpr struct {
+                unsigned int state;
+                unsigned int next_state;
+                unsigned int action;
+        } defaults[] = {
+                { STATE_GROUND,         STATE_GROUND,     ACTION_PRINT       },
+                { STATE_ESC,            STATE_GROUND,     ACTION_IGNORE      },
+                { STATE_ESC_INT,        STATE_GROUND,     ACTION_IGNORE      },
+                { STATE_CSI_ENTRY,      STATE_CSI_IGNORE, ACTION_NONE        },
+                { STATE_CSI_PARAM,      STATE_CSI_IGNORE, ACTION_NONE        },
+                { STATE_CSI_INT,        STATE_CSI_IGNORE, ACTION_NONE        },
+                { STATE_CSI_IGNORE,     STATE_CSI_IGNORE, ACTION_NONE        },
+                { STATE_DCS_ENTRY,      STATE_DCS_PASS,   ACTION_DCS_CONSUME },
+                { STATE_DCS_PARAM,      STATE_DCS_PASS,   ACTION_DCS_CONSUME },
+                { STATE_DCS_INT,        STATE_DCS_PASS,   ACTION_DCS_CONSUME },
+                { STATE_DCS_PASS,       STATE_DCS_PASS,   ACTION_DCS_COLLECT },
+                { STATE_DCS_IGNORE,     STATE_DCS_IGNORE, ACTION_NONE        },
+                { STATE_OSC_STRING,     STATE_OSC_STRING, ACTION_OSC_COLLECT },
+                { STATE_ST_IGNORE,      STATE_ST_IGNORE,  ACTION_NONE        },
+                { STATE_SCI,            STATE_GROUND,     ACTION_IGNORE      },
+        };
+        for (auto const& d : defaults)
+                parser_table_set(t, d.state, 0, PARSER_N_CLASSES - 1, d.next_state, d.action);
+
+        parser_table_set(t, STATE_GROUND, 0x00, 0x1a, STATE_GROUND, ACTION_EXECUTE); /* C0 \ { ESC } */
+        parser_table_set(t, STATE_GROUND, 0x1b, STATE_ESC, ACTION_CLEAR_INT);
+        parser_table_set(t, STATE_GROUND, 0x1c, 0x1f, STATE_GROUND, ACTION_EXECUTE);
+        parser_table_set(t, STATE_GROUND, 0x80, 0x9f, STATE_GROUND, ACTION_EXECUTE); /* C1 */
+
+        parser_table_set_c0(t, STATE_ESC, ACTION_EXECUTE);
+        parser_table_set(t, STATE_ESC, 0x20, 0x2f, STATE_ESC_INT, ACTION_COLLECT_ESC); /* [' ' - '\'] */
+        parser_table_set(t, STATE_ESC, 0x30, 0x7e, STATE_GROUND, ACTION_ESC_DISPATCH); /* ['0' - '~'] */
+        parser_table_set(t, STATE_ESC, 0x50, STATE_DCS_ENTRY, ACTION_DCS_START); /* 'P' */
+        parser_table_set(t, STATE_ESC, 0x58, STATE_ST_IGNORE, ACTION_NONE); /* 'X' */
+        parser_table_set(t, STATE_ESC, 0x5a, STATE_SCI, ACTION_CLEAR); /* 'Z' */
+        parser_table_set(t, STATE_ESC, 0x5b, STATE_CSI_ENTRY, ACTION_CLEAR_PARAMS_ONLY); /* '[' (rest already cleaned on ESC state entry) */
+        parser_table_set(t, STATE_ESC, 0x5d, STATE_OSC_STRING, ACTION_OSC_START); /* ']' */
+        parser_table_set(t, STATE_ESC, 0x5e, 0x5f, STATE_ST_IGNORE, ACTION_NONE); /* '^', '_' */
+
+        parser_table_set_c0(t, STATE_ESC_INT, ACTION_EXECUTE);
+        parser_table_set(t, STATE_ESC_INT, 0x20, 0x2f, STATE_ESC_INT, ACTION_COLLECT_ESC); /* [' ' - '\'] */
+        parser_table_set(t, STATE_ESC_INT, 0x30, 0x7e, STATE_GROUND, ACTION_ESC_DISPATCH); /* ['0' - '~'] */
+
+        /* ESC after DCS or OSC is only ST if followed by '\'; otherwise it's
+         * a new escape sequence, whose state entry was deferred until now.
+         */
+        for (auto state : { STATE_DCS_PASS_ESC, STATE_OSC_STRING_ESC }) {
+                for (auto c = 0u; c < PARSER_N_CLASSES; ++c) {
+                        t[state][c] = t[STATE_ESC][c];
+                        t[state][c].action |= ACTION_FLAG_DEFERRED_CLEAR;
+                }
+        }
+        parser_table_set(t, STATE_DCS_PASS_ESC, 0x5c, STATE_GROUND, ACTION_DCS_DISPATCH); /* '\' */
+        parser_table_set(t, STATE_OSC_STRING_ESC, 0x5c, STATE_GROUND, ACTION_OSC_DISPATCH); /* '\' */
+
+        parser_table_set_c0(t, STATE_CSI_ENTRY, ACTION_EXECUTE);
+        parser_table_set(t, STATE_CSI_ENTRY, 0x20, 0x2f, STATE_CSI_INT, ACTION_COLLECT_CSI); /* [' ' - '\'] */
+        parser_table_set(t, STATE_CSI_ENTRY, 0x30, 0x39, STATE_CSI_PARAM, ACTION_PARAM); /* ['0' - '9'] */
+        parser_table_set(t, STATE_CSI_ENTRY, 0x3a, STATE_CSI_PARAM, ACTION_FINISH_SUBPARAM); /* ':' */
+        parser_table_set(t, STATE_CSI_ENTRY, 0x3b, STATE_CSI_PARAM, ACTION_FINISH_PARAM); /* ';' */
+        parser_table_set(t, STATE_CSI_ENTRY, 0x3c, 0x3f, STATE_CSI_PARAM, ACTION_COLLECT_PARAMETER); /* ['<' - '?'] */
+        parser_table_set(t, STATE_CSI_ENTRY, 0x40, 0x7e, STATE_GROUND, ACTION_CSI_DISPATCH); /* ['@' - '~'] */
+
+        parser_table_set_c0(t, STATE_CSI_PARAM, ACTION_EXECUTE);
+        parser_table_set(t, STATE_CSI_PARAM, 0x20, 0x2f, STATE_CSI_INT, ACTION_COLLECT_CSI); /* [' ' - '\'] */
+        parser_table_set(t, STATE_CSI_PARAM, 0x30, 0x39, STATE_CSI_PARAM, ACTION_PARAM); /* ['0' - '9'] */
+        parser_table_set(t, STATE_CSI_PARAM, 0x3a, STATE_CSI_PARAM, ACTION_FINISH_SUBPARAM); /* ':' */
+        parser_table_set(t, STATE_CSI_PARAM, 0x3b, STATE_CSI_PARAM, ACTION_FINISH_PARAM); /* ';' */
+        parser_table_set(t, STATE_CSI_PARAM, 0x40, 0x7e, STATE_GROUND, ACTION_CSI_DISPATCH); /* ['@' - '~'] */
+
+        parser_table_set_c0(t, STATE_CSI_INT, ACTION_EXECUTE);
+        parser_table_set(t, STATE_CSI_INT, 0x20, 0x2f, STATE_CSI_INT, ACTION_COLLECT_CSI); /* [' ' - '\'] */
+        parser_table_set(t, STATE_CSI_INT, 0x40, 0x7e, STATE_GROUND, ACTION_CSI_DISPATCH); /* ['@' - '~'] */
+
+        parser_table_set_c0(t, STATE_CSI_IGNORE, ACTION_EXECUTE);
+        parser_table_set(t, STATE_CSI_IGNORE, 0x40, 0x7e, STATE_GROUND, ACTION_NONE); /* ['@' - '~'] */
+
+        for (auto state : { STATE_CSI_ENTRY, STATE_CSI_PARAM, STATE_CSI_INT, STATE_CSI_IGNORE })
+                parser_table_set(t, state, 0x9c, STATE_GROUND, ACTION_IGNORE); /* ST */
+
+        parser_table_set_c0(t, STATE_DCS_ENTRY, ACTION_IGNORE);
+        parser_table_set(t, STATE_DCS_ENTRY, 0x20, 0x2f, STATE_DCS_INT, ACTION_COLLECT_DCS); /* [' ' - '\'] */
+        parser_table_set(t, STATE_DCS_ENTRY, 0x30, 0x39, STATE_DCS_PARAM, ACTION_PARAM); /* ['0' - '9'] */
+        parser_table_set(t, STATE_DCS_ENTRY, 0x3a, STATE_DCS_PARAM, ACTION_FINISH_SUBPARAM); /* ':' */
+        parser_table_set(t, STATE_DCS_ENTRY, 0x3b, STATE_DCS_PARAM, ACTION_FINISH_PARAM); /* ';' */
+        parser_table_set(t, STATE_DCS_ENTRY, 0x3c, 0x3f, STATE_DCS_PARAM, ACTION_COLLECT_PARAMETER); /* ['<' - '?'] */
+
+        parser_table_set_c0(t, STATE_DCS_PARAM, ACTION_IGNORE);
+        parser_table_set(t, STATE_DCS_PARAM, 0x20, 0x2f, STATE_DCS_INT, ACTION_COLLECT_DCS); /* [' ' - '\'] */
+        parser_table_set(t, STATE_DCS_PARAM, 0x30, 0x39, STATE_DCS_PARAM, ACTION_PARAM); /* ['0' - '9'] */
+        parser_table_set(t, STATE_DCS_PARAM, 0x3a, STATE_DCS_PARAM, ACTION_FINISH_SUBPARAM); /* ':' */
+        parser_table_set(t, STATE_DCS_PARAM, 0x3b, STATE_DCS_PARAM, ACTION_FINISH_PARAM); /* ';' */
+        parser_table_set(t, STATE_DCS_PARAM, 0x3c, 0x3f, STATE_DCS_IGNORE, ACTION_NONE); /* ['<' - '?'] */
+
+        parser_table_set_c0(t, STATE_DCS_INT, ACTION_IGNORE);
+        parser_table_set(t, STATE_DCS_INT, 0x20, 0x2f, STATE_DCS_INT, ACTION_COLLECT_DCS); /* [' ' - '\'] */
+        parser_table_set(t, STATE_DCS_INT, 0x30, 0x3f, STATE_DCS_IGNORE, ACTION_NONE); /* ['0' - '?'] */
+
+        for (auto state : { STATE_DCS_ENTRY, STATE_DCS_PARAM, STATE_DCS_INT })
+                parser_table_set(t, state, 0x9c, STATE_GROUND, ACTION_IGNORE); /* ST */
+
+        parser_table_set(t, STATE_DCS_PASS, 0x1b, STATE_DCS_PASS_ESC, ACTION_NONE); /* ESC */
+        parser_table_set(t, STATE_DCS_PASS, 0x9c, STATE_GROUND, ACTION_DCS_DISPATCH); /* ST */
+
+        parser_table_set(t, STATE_DCS_IGNORE, 0x1b, STATE_ESC, ACTION_CLEAR_INT); /* ESC */
+        parser_table_set(t, STATE_DCS_IGNORE, 0x9c, STATE_GROUND, ACTION_NONE); /* ST */
+
+        parser_table_set(t, STATE_OSC_STRING, 0x00, 0x1f, STATE_OSC_STRING, ACTION_NONE); /* C0 \ { BEL, ESC } */
+        parser_table_set(t, STATE_OSC_STRING, 0x07, STATE_GROUND, ACTION_OSC_DISPATCH); /* BEL */
+        parser_table_set(t, STATE_OSC_STRING, 0x1b, STATE_OSC_STRING_ESC, ACTION_NONE); /* ESC */
+        parser_table_set(t, STATE_OSC_STRING, 0x9c, STATE_GROUND, ACTION_OSC_DISPATCH); /* ST */
+
+        parser_table_set(t, STATE_ST_IGNORE, 0x1b, STATE_ESC, ACTION_CLEAR_INT); /* ESC */
+        parser_table_set(t, STATE_ST_IGNORE, 0x9c, STATE_GROUND, ACTION_IGNORE); /* ST */
+
+        parser_table_set(t, STATE_SCI, 0x1b, STATE_ESC, ACTION_CLEAR_INT); /* ESC */
+        parser_table_set(t, STATE_SCI, 0x08, 0x0d, STATE_GROUND, ACTION_SCI_DISPATCH); /* BS, HT, LF, VT, FF, CR */
+        parser_table_set(t, STATE_SCI, 0x20, 0x7e, STATE_GROUND, ACTION_SCI_DISPATCH); /* [' ' - '~'] */
 
-/* perform state transition */
-#define parser_transition_no_action(p,r,s) \
-        ({ \
-                parser->state = s; \
-                VTE_SEQ_NONE; \
-        })
+        /*
+         * Finally, the transitions that apply in any state:
+         *  * DEC treats GR codes as GL. We don't do that as we require UTF-8
+         *    as charset and, thus, it doesn't make sense to treat GR special.
+         *  * During control sequences, unexpected C1 codes cancel the sequence
+         *    and immediately start a new one. C0 codes, however, may or may not
+         *    be ignored/executed depending on the sequence.
+         */
+        for (auto state = 0u; state < STATE_N; ++state) {
+                parser_table_set(t, state, 0x18, STATE_GROUND, ACTION_IGNORE); /* CAN */
+                parser_table_set(t, state, 0x1a, STATE_GROUND, ACTION_EXECUTE); /* SUB */
+                parser_table_set(t, state, 0x7f, state, ACTION_NONE); /* DEL */
+                parser_table_set(t, state, 0x80, 0x8f, STATE_GROUND, ACTION_EXECUTE); /* C1 \ {DCS, SOS, SCI, CSI, ST, OSC, PM, APC} */
+                parser_table_set(t, state, 0x90, STATE_DCS_ENTRY, ACTION_DCS_START); /* DCS */
+                parser_table_set(t, state, 0x91, 0x97, STATE_GROUND, ACTION_EXECUTE);
+                parser_table_set(t, state, 0x98, STATE_ST_IGNORE, ACTION_NONE); /* SOS */
+                // FIXMEchpe shouldn't SOS, PM, APC use ACTION_CLEAR?
+                parser_table_set(t, state, 0x99, STATE_GROUND, ACTION_EXECUTE);
+                parser_table_set(t, state, 0x9a, STATE_SCI, ACTION_CLEAR); /* SCI */
+                parser_table_set(t, state, 0x9b, STATE_CSI_ENTRY, ACTION_CLEAR_INT_AND_PARAMS); /* CSI */
+                parser_table_set(t, state, 0x9d, STATE_OSC_STRING, ACTION_OSC_START); /* OSC */
+                parser_table_set(t, state, 0x9e, 0x9f, STATE_ST_IGNORE, ACTION_NONE); /* PM, APC */
+        }
 
-/* perform state transition and dispatch related actions */
-#define parser_transition(p,r,s,a) \
-        ({ \
-                (p)->state = s; \
-                a((p), (r)); \
-        })
+        return t;
+}
 
-#endif // (inline) functions or macros
+static constexpr parser_table_t const parser_table = parser_make_table();
 
 /**
  * vte_parser_init() - Initialise parser object
@@ -772,10 +945,8 @@ parser_params_overflow(vte_parser_t* parser,
          * Transition to STATE_{CSI,DCS}_IGNORE to ignore the
          * whole sequence.
          */
-        parser_transition_no_action(parser,
-                                    raw,
-                                    parser->state == STATE_CSI_PARAM ?
-                                    STATE_CSI_IGNORE : STATE_DCS_IGNORE);
+        parser->state = parser->state == STATE_CSI_PARAM ?
+                STATE_CSI_IGNORE : STATE_DCS_IGNORE;
 }
 
 /* The next two functions are only called when encountering a ';' or ':',
@@ -860,6 +1031,7 @@ parser_dcs_start(vte_parser_t* parser,
         vte_seq_string_reset(&parser->seq.arg_str);
 
         parser->seq.introducer = raw;
+        parser->seq.n_chunks = 0;
         return VTE_SEQ_NONE;
 }
 
@@ -886,12 +1058,39 @@ parser_dcs_consume(vte_parser_t* parser,
         return VTE_SEQ_NONE;
 }
 
+/*
+ * The data of the DCS sequences that carry more than fits the string,
+ * like images, is dispatched in chunks of the string's maximum length
+ * as VTE_SEQ_DCS_DATA sequences, with the sequence's command, and the
+ * rest with the final VTE_SEQ_DCS as usual.
+ */
+static inline bool
+parser_dcs_is_streamed(vte_parser_t const* parser)
+{
+        return parser->seq.command == VTE_CMD_DECSIXEL;
+}
+
 static int
 parser_dcs_collect(vte_parser_t* parser,
                    uint32_t raw)
 {
-        if (G_UNLIKELY(!vte_seq_string_push(&parser->seq.arg_str, raw)))
+        /* Start the next chunk after dispatching one */
+        if (G_UNLIKELY(parser->seq.type == VTE_SEQ_DCS_DATA)) {
+                parser->seq.type = VTE_SEQ_DCS;
+                ++parser->seq.n_chunks;
+                vte_seq_string_reset(&parser->seq.arg_str);
+        }
+
+        if (G_UNLIKELY(!vte_seq_string_push(&parser->seq.arg_str, raw))) {
                 parser->state = STATE_DCS_IGNORE;
+                return VTE_SEQ_NONE;
+        }
+
+        if (G_UNLIKELY(parser->seq.arg_str.len == VTE_SEQ_STRING_MAX_CAPACITY) &&
+            parser_dcs_is_streamed(parser)) {
+                parser->seq.type = VTE_SEQ_DCS_DATA;
+                return parser->seq.type;
+        }
 
         return VTE_SEQ_NONE;
 }
@@ -961,6 +1160,13 @@ parser_dcs(vte_parser_t* parser,
 {
         /* parser->seq was already filled in parser_dcs_consume() */
 
+        /* The last chunk of streamed data was already dispatched */
+        if (G_UNLIKELY(parser->seq.type == VTE_SEQ_DCS_DATA)) {
+                parser->seq.type = VTE_SEQ_DCS;
+                ++parser->seq.n_chunks;
+                vte_seq_string_reset(&parser->seq.arg_str);
+        }
+
         vte_seq_string_finish(&parser->seq.arg_str);
 
         /* We only dispatch a DCS if the introducer and string
@@ -984,463 +1190,105 @@ parser_sci(vte_parser_t* parser,
         return parser->seq.type;
 }
 
-#define ACTION_CLEAR parser_clear
-#define ACTION_CLEAR_INT parser_clear_int
-#define ACTION_CLEAR_INT_AND_PARAMS parser_clear_int_and_params
-#define ACTION_CLEAR_PARAMS_ONLY parser_clear_params
-#define ACTION_IGNORE parser_ignore
-#define ACTION_PRINT parser_print
-#define ACTION_EXECUTE parser_execute
-#define ACTION_COLLECT_ESC parser_collect_esc
-#define ACTION_COLLECT_CSI parser_collect_csi
-#define ACTION_COLLECT_DCS ACTION_COLLECT_CSI
-#define ACTION_COLLECT_PARAMETER parser_collect_parameter
-#define ACTION_PARAM parser_param
-#define ACTION_FINISH_PARAM parser_finish_param
-#define ACTION_FINISH_SUBPARAM parser_finish_subparam
-#define ACTION_ESC_DISPATCH parser_esc
-#define ACTION_CSI_DISPATCH parser_csi
-#define ACTION_DCS_START parser_dcs_start
-#define ACTION_DCS_CONSUME parser_dcs_consume
-#define ACTION_DCS_COLLECT parser_dcs_collect
-#define ACTION_DCS_DISPATCH parser_dcs
-#define ACTION_OSC_START parser_osc_start
-#define ACTION_OSC_COLLECT parser_osc_collect
-#define ACTION_OSC_DISPATCH parser_osc
-#define ACTION_SCI_DISPATCH parser_sci
-
-static int
-parser_feed_to_state(vte_parser_t* parser,
-                     uint32_t raw)
+int
+vte_parser_feed(vte_parser_t* parser,
+                uint32_t raw)
 {
-        switch (parser->state) {
-        case STATE_GROUND:
-                switch (raw) {
-                case 0x00 ... 0x1a:        /* C0 \ { ESC } */
-                case 0x1c ... 0x1f:
-                case 0x80 ... 0x9f:        /* C1 */
-                        return parser_action(parser, raw,
-                                             ACTION_EXECUTE);
-                case 0x1b:                /* ESC */
-                        return parser_transition(parser, raw, STATE_ESC,
-                                                 ACTION_CLEAR_INT);
-                }
-
-                return parser_action(parser, raw,
-                                     ACTION_PRINT);
-
-        case STATE_DCS_PASS_ESC:
-        case STATE_OSC_STRING_ESC:
-                if (raw == 0x5c /* '\' */) {
-                        switch (parser->state) {
-                        case STATE_DCS_PASS_ESC:
-                                return parser_transition(parser, raw, STATE_GROUND,
-                                                         ACTION_DCS_DISPATCH);
-                        case STATE_OSC_STRING_ESC:
-                                return parser_transition(parser, raw, STATE_GROUND,
-                                                         ACTION_OSC_DISPATCH);
-                        }
-                }
-
-                /* Do the deferred clear and fallthrough to STATE_ESC */
-                parser_transition(parser, 0x1b /* ESC */, STATE_ESC,
-                                  ACTION_CLEAR_INT);
-
-                [[fallthrough]];
-        case STATE_ESC:
-                switch (raw) {
-                case 0x00 ... 0x1a:        /* C0 \ { ESC } */
-                case 0x1c ... 0x1f:
-                        return parser_action(parser, raw,
-                                                 ACTION_EXECUTE);
-                case 0x1b:                /* ESC */
-                        return parser_transition(parser, raw, STATE_ESC,
-                                                 ACTION_CLEAR_INT);
-                case 0x20 ... 0x2f:        /* [' ' - '\'] */
-                        return parser_transition(parser, raw, STATE_ESC_INT,
-                                                 ACTION_COLLECT_ESC);
-                case 0x30 ... 0x4f:        /* ['0' - '~'] \ */
-                case 0x51 ... 0x57:        /* { 'P', 'X', 'Z' '[', ']', '^', '_' } */
-                case 0x59:
-                case 0x5c:
-                case 0x60 ... 0x7e:
-                        return parser_transition(parser, raw, STATE_GROUND,
-                                                 ACTION_ESC_DISPATCH);
-                case 0x50:                /* 'P' */
-                        return parser_transition(parser, raw, STATE_DCS_ENTRY,
-                                                 ACTION_DCS_START);
-                case 0x5a:                /* 'Z' */
-                        return parser_transition(parser, raw, STATE_SCI,
-                                                 ACTION_CLEAR);
-                case 0x5b:                /* '[' */
-                        return parser_transition(parser, raw, STATE_CSI_ENTRY,
-                                                 ACTION_CLEAR_PARAMS_ONLY
-                                                 /* rest already cleaned on ESC state entry */);
-                case 0x5d:                /* ']' */
-                        return parser_transition(parser, raw, STATE_OSC_STRING,
-                                                 ACTION_OSC_START);
-                case 0x58:                /* 'X' */
-                case 0x5e:                /* '^' */
-                case 0x5f:                /* '_' */
-                        return parser_transition_no_action(parser, raw, STATE_ST_IGNORE);
-                case 0x9c:                /* ST */
-                        return parser_transition(parser, raw, STATE_GROUND,
-                                                 ACTION_IGNORE);
-                }
-
-                return parser_transition(parser, raw, STATE_GROUND,
-                                         ACTION_IGNORE);
-        case STATE_ESC_INT:
-                switch (raw) {
-                case 0x00 ... 0x1a:        /* C0 \ { ESC } */
-                case 0x1c ... 0x1f:
-                        return parser_action(parser, raw,
-                                             ACTION_EXECUTE);
-                case 0x1b:                /* ESC */
-                        return parser_transition(parser, raw, STATE_ESC,
-                                                 ACTION_CLEAR_INT);
-                case 0x20 ... 0x2f:        /* [' ' - '\'] */
-                        return parser_action(parser, raw,
-                                             ACTION_COLLECT_ESC);
-                case 0x30 ... 0x7e:        /* ['0' - '~'] */
-                        return parser_transition(parser, raw, STATE_GROUND,
-                                                 ACTION_ESC_DISPATCH);
-                case 0x9c:                /* ST */
-                        return parser_transition(parser, raw, STATE_GROUND,
-                                                 ACTION_IGNORE);
-                }
-
-                return parser_transition(parser, raw, STATE_GROUND,
-                                         ACTION_IGNORE);
-        case STATE_CSI_ENTRY:
-                switch (raw) {
-                case 0x00 ... 0x1a:        /* C0 \ { ESC } */
-                case 0x1c ... 0x1f:
-                        return parser_action(parser, raw,
-                                             ACTION_EXECUTE);
-                case 0x1b:                /* ESC */
-                        return parser_transition(parser, raw, STATE_ESC,
-                                                 ACTION_CLEAR_INT);
-                case 0x20 ... 0x2f:        /* [' ' - '\'] */
-                        return parser_transition(parser, raw, STATE_CSI_INT,
-                                                 ACTION_COLLECT_CSI);
-                case 0x30 ... 0x39:        /* ['0' - '9'] */
-                        return parser_transition(parser, raw, STATE_CSI_PARAM,
-                                                 ACTION_PARAM);
-                case 0x3a:                 /* ':' */
-                        return parser_transition(parser, raw, STATE_CSI_PARAM,
-                                                 ACTION_FINISH_SUBPARAM);
-                case 0x3b:                 /* ';' */
-                        return parser_transition(parser, raw, STATE_CSI_PARAM,
-                                                 ACTION_FINISH_PARAM);
-                case 0x3c ... 0x3f:        /* ['<' - '?'] */
-                        return parser_transition(parser, raw, STATE_CSI_PARAM,
-                                                 ACTION_COLLECT_PARAMETER);
-                case 0x40 ... 0x7e:        /* ['@' - '~'] */
-                        return parser_transition(parser, raw, STATE_GROUND,
-                                                 ACTION_CSI_DISPATCH);
-                case 0x9c:                /* ST */
-                        return parser_transition(parser, raw, STATE_GROUND,
-                                                 ACTION_IGNORE);
-                }
-
-                return parser_transition_no_action(parser, raw, STATE_CSI_IGNORE);
-        case STATE_CSI_PARAM:
-                switch (raw) {
-                case 0x00 ... 0x1a:        /* C0 \ { ESC } */
-                case 0x1c ... 0x1f:
-                        return parser_action(parser, raw,
-                                             ACTION_EXECUTE);
-                case 0x1b:                /* ESC */
-                        return parser_transition(parser, raw, STATE_ESC,
-                                                 ACTION_CLEAR_INT);
-                case 0x20 ... 0x2f:        /* [' ' - '\'] */
-                        return parser_transition(parser, raw, STATE_CSI_INT,
-                                                 ACTION_COLLECT_CSI);
-                case 0x30 ... 0x39:        /* ['0' - '9'] */
-                        return parser_action(parser, raw,
-                                             ACTION_PARAM);
-                case 0x3a:                 /* ':' */
-                        return parser_action(parser, raw,
-                                             ACTION_FINISH_SUBPARAM);
-                case 0x3b:                 /* ';' */
-                        return parser_action(parser, raw,
-                                             ACTION_FINISH_PARAM);
-                case 0x3c ... 0x3f:        /* ['<' - '?'] */
-                        return parser_transition_no_action(parser, raw, STATE_CSI_IGNORE);
-                case 0x40 ... 0x7e:        /* ['@' - '~'] */
-                        return parser_transition(parser, raw, STATE_GROUND,
-                                                 ACTION_CSI_DISPATCH);
-                case 0x9c:                /* ST */
-                        return parser_transition(parser, raw, STATE_GROUND,
-                                                 ACTION_IGNORE);
-                }
-
-                return parser_transition_no_action(parser, raw, STATE_CSI_IGNORE);
-        case STATE_CSI_INT:
-                switch (raw) {
-                case 0x00 ... 0x1a:        /* C0 \ { ESC } */
-                case 0x1c ... 0x1f:
-                        return parser_action(parser, raw,
-                                             ACTION_EXECUTE);
-                case 0x1b:                /* ESC */
-                        return parser_transition(parser, raw, STATE_ESC,
-                                                 ACTION_CLEAR_INT);
-                case 0x20 ... 0x2f:        /* [' ' - '\'] */
-                        return parser_action(parser, raw,
-                                             ACTION_COLLECT_CSI);
-                case 0x30 ... 0x3f:        /* ['0' - '?'] */
-                        return parser_transition_no_action(parser, raw, STATE_CSI_IGNORE);
-                case 0x40 ... 0x7e:        /* ['@' - '~'] */
-                        return parser_transition(parser, raw, STATE_GROUND,
-                                                 ACTION_CSI_DISPATCH);
-                case 0x9c:                /* ST */
-                        return parser_transition(parser, raw, STATE_GROUND,
-                                                 ACTION_IGNORE);
-                }
-
-                return parser_transition_no_action(parser, raw, STATE_CSI_IGNORE);
-        case STATE_CSI_IGNORE:
-                switch (raw) {
-                case 0x00 ... 0x1a:        /* C0 \ { ESC } */
-                case 0x1c ... 0x1f:
-                        return parser_action(parser, raw,
-                                             ACTION_EXECUTE);
-                case 0x1b:                /* ESC */
-                        return parser_transition(parser, raw, STATE_ESC,
-                                                 ACTION_CLEAR_INT);
-                case 0x20 ... 0x3f:        /* [' ' - '?'] */
-                        return parser_nop(parser, raw);
-                case 0x40 ... 0x7e:        /* ['@' - '~'] */
-                        return parser_transition_no_action(parser, raw, STATE_GROUND);
-                case 0x9c:                /* ST */
-                        return parser_transition(parser, raw, STATE_GROUND,
-                                                 ACTION_IGNORE);
-                }
-
-                return parser_nop(parser, raw);
-        case STATE_DCS_ENTRY:
-                switch (raw) {
-                case 0x00 ... 0x1a:        /* C0 \ ESC */
-                case 0x1c ... 0x1f:
-                        return parser_action(parser, raw,
-                                             ACTION_IGNORE);
-                case 0x1b:                /* ESC */
-                        return parser_transition(parser, raw, STATE_ESC,
-                                                 ACTION_CLEAR_INT);
-                case 0x20 ... 0x2f:        /* [' ' - '\'] */
-                        return parser_transition(parser, raw, STATE_DCS_INT,
-                                                 ACTION_COLLECT_DCS);
-                case 0x30 ... 0x39:        /* ['0' - '9'] */
-                        return parser_transition(parser, raw, STATE_DCS_PARAM,
-                                                 ACTION_PARAM);
-                case 0x3a:                 /* ':' */
-                        return parser_transition(parser, raw, STATE_DCS_PARAM,
-                                                 ACTION_FINISH_SUBPARAM);
-                case 0x3b:                 /* ';' */
-                        return parser_transition(parser, raw, STATE_DCS_PARAM,
-                                                 ACTION_FINISH_PARAM);
-                case 0x3c ... 0x3f:        /* ['<' - '?'] */
-                        return parser_transition(parser, raw, STATE_DCS_PARAM,
-                                                 ACTION_COLLECT_PARAMETER);
-                case 0x40 ... 0x7e:        /* ['@' - '~'] */
-                        return parser_transition(parser, raw, STATE_DCS_PASS,
-                                                 ACTION_DCS_CONSUME);
-                case 0x9c:                /* ST */
-                        return parser_transition(parser, raw, STATE_GROUND,
-                                                 ACTION_IGNORE);
-                }
-
-                return parser_transition(parser, raw,
-                                         STATE_DCS_PASS, ACTION_DCS_CONSUME);
-        case STATE_DCS_PARAM:
-                switch (raw) {
-                case 0x00 ... 0x1a:        /* C0 \ { ESC } */
-                case 0x1c ... 0x1f:
-                        return parser_action(parser, raw,
-                                             ACTION_IGNORE);
-                case 0x1b:                /* ESC */
-                        return parser_transition(parser, raw, STATE_ESC,
-                                                 ACTION_CLEAR_INT);
-                case 0x20 ... 0x2f:        /* [' ' - '\'] */
-                        return parser_transition(parser, raw, STATE_DCS_INT,
-                                                 ACTION_COLLECT_DCS);
-                case 0x30 ... 0x39:        /* ['0' - '9'] */
-                        return parser_action(parser, raw,
-                                                 ACTION_PARAM);
-                case 0x3a:                 /* ':' */
-                        return parser_action(parser, raw,
-                                             ACTION_FINISH_SUBPARAM);
-                case 0x3b:                 /* ';' */
-                        return parser_action(parser, raw,
-                                             ACTION_FINISH_PARAM);
-                case 0x3c ... 0x3f:        /* ['<' - '?'] */
-                        return parser_transition_no_action(parser, raw, STATE_DCS_IGNORE);
-                case 0x40 ... 0x7e:        /* ['@' - '~'] */
-                        return parser_transition(parser, raw, STATE_DCS_PASS,
-                                                 ACTION_DCS_CONSUME);
-                case 0x9c:                /* ST */
-                        return parser_transition(parser, raw, STATE_GROUND,
-                                                 ACTION_IGNORE);
-                }
-
-                return parser_transition(parser, raw,
-                                         STATE_DCS_PASS, ACTION_DCS_CONSUME);
-        case STATE_DCS_INT:
-                switch (raw) {
-                case 0x00 ... 0x1a:        /* C0 \ { ESC } */
-                case 0x1c ... 0x1f:
-                        return parser_action(parser, raw,
-                                             ACTION_IGNORE);
-                case 0x1b:                /* ESC */
-                        return parser_transition(parser, raw, STATE_ESC,
-                                                 ACTION_CLEAR_INT);
-                case 0x20 ... 0x2f:        /* [' ' - '\'] */
-                        return parser_action(parser, raw,
-                                             ACTION_COLLECT_DCS);
-                case 0x30 ... 0x3f:        /* ['0' - '?'] */
-                        return parser_transition_no_action(parser, raw, STATE_DCS_IGNORE);
-                case 0x40 ... 0x7e:        /* ['@' - '~'] */
-                        return parser_transition(parser, raw, STATE_DCS_PASS,
-                                                 ACTION_DCS_CONSUME);
-                case 0x9c:                /* ST */
-                        return parser_transition(parser, raw, STATE_GROUND,
-                                                 ACTION_IGNORE);
-                }
-
-                return parser_transition(parser, raw,
-                                         STATE_DCS_PASS, ACTION_DCS_CONSUME);
-        case STATE_DCS_PASS:
-                switch (raw) {
-                case 0x00 ... 0x1a:        /* ASCII \ { ESC } */
-                case 0x1c ... 0x7f:
-                        return parser_action(parser, raw,
-                                             ACTION_DCS_COLLECT);
-                case 0x1b:                /* ESC */
-                        return parser_transition_no_action(parser, raw, STATE_DCS_PASS_ESC);
-                case 0x9c:                /* ST */
-                        return parser_transition(parser, raw, STATE_GROUND,
-                                                 ACTION_DCS_DISPATCH);
-                }
-
-                return parser_action(parser, raw,
-                                     ACTION_DCS_COLLECT);
-        case STATE_DCS_IGNORE:
-                switch (raw) {
-                case 0x00 ... 0x1a:        /* ASCII \ { ESC } */
-                case 0x1c ... 0x7f:
-                        return parser_nop(parser, raw);
-                case 0x1b:                /* ESC */
-                        return parser_transition(parser, raw, STATE_ESC,
-                                                 ACTION_CLEAR_INT);
-                case 0x9c:                /* ST */
-                        return parser_transition_no_action(parser, raw, STATE_GROUND);
-                }
-
-                return parser_nop(parser, raw);
-        case STATE_OSC_STRING:
-                switch (raw) {
-                case 0x00 ... 0x06:        /* C0 \ { BEL, ESC } */
-                case 0x08 ... 0x1a:
-                case 0x1c ... 0x1f:
-                        return parser_nop(parser, raw);
-                case 0x1b:                /* ESC */
-                        return parser_transition_no_action(parser, raw, STATE_OSC_STRING_ESC);
-                case 0x20 ... 0x7f:        /* [' ' - DEL] */
-                        return parser_action(parser, raw,
-                                             ACTION_OSC_COLLECT);
-                case 0x07:                /* BEL */
-                case 0x9c:                /* ST */
-                        return parser_transition(parser, raw, STATE_GROUND,
-                                                 ACTION_OSC_DISPATCH);
-                }
-
-                return parser_action(parser, raw,
-                                     ACTION_OSC_COLLECT);
-        case STATE_ST_IGNORE:
-                switch (raw) {
-                case 0x00 ... 0x1a:        /* ASCII \ { ESC } */
-                case 0x1c ... 0x7f:
-                        return parser_nop(parser, raw);
-                case 0x1b:                /* ESC */
-                        return parser_transition(parser, raw, STATE_ESC,
-                                                 ACTION_CLEAR_INT);
-                case 0x9c:                /* ST */
-                        return parser_transition(parser, raw,
-                                                 STATE_GROUND, ACTION_IGNORE);
-                }
+        auto const transition = parser_table[parser->state][parser_class(raw)];
+        auto action = transition.action;
 
-                return parser_nop(parser, raw);
-        case STATE_SCI:
-                switch (raw) {
-                case 0x1b:                /* ESC */
-                        return parser_transition(parser, raw,
-                                                 STATE_ESC, ACTION_CLEAR_INT);
-                case 0x08 ... 0x0d:        /* BS, HT, LF, VT, FF, CR */
-                case 0x20 ... 0x7e:        /* [' ' - '~'] */
-                        return parser_transition(parser, raw, STATE_GROUND,
-                                                 ACTION_SCI_DISPATCH);
-                }
+        if (G_UNLIKELY(action & ACTION_FLAG_DEFERRED_CLEAR)) {
+                parser_clear_int(parser, 0x1b /* ESC */);
+                action &= ~ACTION_FLAG_DEFERRED_CLEAR;
+        }
 
-                return parser_transition(parser, raw, STATE_GROUND,
-                                         ACTION_IGNORE);
+        parser->state = transition.state;
+
+        switch (action) {
+        case ACTION_NONE:                 return VTE_SEQ_NONE;
+        case ACTION_CLEAR:                return parser_clear(parser, raw);
+        case ACTION_CLEAR_INT:            return parser_clear_int(parser, raw);
+        case ACTION_CLEAR_INT_AND_PARAMS: return parser_clear_int_and_params(parser, raw);
+        case ACTION_CLEAR_PARAMS_ONLY:    return parser_clear_params(parser, raw);
+        case ACTION_IGNORE:               return parser_ignore(parser, raw);
+        case ACTION_PRINT:                return parser_print(parser, raw);
+        case ACTION_EXECUTE:              return parser_execute(parser, raw);
+        case ACTION_COLLECT_ESC:          return parser_collect_esc(parser, raw);
+        case ACTION_COLLECT_CSI:          return parser_collect_csi(parser, raw);
+        case ACTION_COLLECT_PARAMETER:    return parser_collect_parameter(parser, raw);
+        case ACTION_PARAM:                return parser_param(parser, raw);
+        case ACTION_FINISH_PARAM:         return parser_finish_param(parser, raw);
+        case ACTION_FINISH_SUBPARAM:      return parser_finish_subparam(parser, raw);
+        case ACTION_ESC_DISPATCH:         return parser_esc(parser, raw);
+        case ACTION_CSI_DISPATCH:         return parser_csi(parser, raw);
+        case ACTION_DCS_START:            return parser_dcs_start(parser, raw);
+        case ACTION_DCS_CONSUME:          return parser_dcs_consume(parser, raw);
+        case ACTION_DCS_COLLECT:          return parser_dcs_collect(parser, raw);
+        case ACTION_DCS_DISPATCH:         return parser_dcs(parser, raw);
+        case ACTION_OSC_START:            return parser_osc_start(parser, raw);
+        case ACTION_OSC_COLLECT:          return parser_osc_collect(parser, raw);
+        case ACTION_OSC_DISPATCH:         return parser_osc(parser, raw);
+        case ACTION_SCI_DISPATCH:         return parser_sci(parser, raw);
         }
 
         g_assert_not_reached();
         return VTE_SEQ_NONE;
 }
 
+/**
+ * vte_parser_is_graphic() - Whether feeding @raw would print it
+ * @parser: the struct vte_parser
+ * @raw: the character
+ *
+ * Returns: whether vte_parser_feed() would return %VTE_SEQ_GRAPHIC for @raw
+ */
+bool
+vte_parser_is_graphic(vte_parser_t const* parser,
+                      uint32_t raw)
+{
+        return parser->state == STATE_GROUND &&
+                parser_table[STATE_GROUND][parser_class(raw)].action == ACTION_PRINT;
+}
+
+/**
+ * vte_parser_feed_run() - Feed a run of characters
+ * @parser: the struct vte_parser
+ * @begin: the first character
+ * @end: the end of the characters; must be past @begin
+ * @n_consumed: where to store the number of characters consumed
+ *
+ * In the ground state, consumes the run of printable characters that
+ * starts at @begin, up to @end, and returns %VTE_SEQ_GRAPHIC, with that
+ * run's last character as the sequence's terminator. Otherwise, feeds
+ * just the first character like vte_parser_feed() does.
+ *
+ * Returns: the type of the sequence
+ */
 int
-vte_parser_feed(vte_parser_t* parser,
-                uint32_t raw)
+vte_parser_feed_run(vte_parser_t* parser,
+                    uint32_t const* begin,
+                    uint32_t const* end,
+                    size_t* n_consumed)
 {
-        /*
-         * Notes:
-         *  * DEC treats GR codes as GL. We don't do that as we require UTF-8
-         *    as charset and, thus, it doesn't make sense to treat GR special.
-         *  * During control sequences, unexpected C1 codes cancel the sequence
-         *    and immediately start a new one. C0 codes, however, may or may not
-         *    be ignored/executed depending on the sequence.
-         */
+        auto ptr = begin;
+        if (parser->state == STATE_GROUND) {
+                while (ptr < end &&
+                       parser_table[STATE_GROUND][parser_class(*ptr)].action == ACTION_PRINT)
+                        ++ptr;
+        }
 
-        switch (raw) {
-        case 0x18:                /* CAN */
-                return parser_transition(parser, raw,
-                                         STATE_GROUND, ACTION_IGNORE);
-        case 0x1a:                /* SUB */
-                return parser_transition(parser, raw,
-                                         STATE_GROUND, ACTION_EXECUTE);
-        case 0x7f:                 /* DEL */
-                return parser_nop(parser, raw);
-        case 0x80 ... 0x8f:        /* C1 \ {DCS, SOS, SCI, CSI, ST, OSC, PM, APC} */
-        case 0x91 ... 0x97:
-        case 0x99:
-                return parser_transition(parser, raw,
-                                         STATE_GROUND, ACTION_EXECUTE);
-        case 0x98:                /* SOS */
-        case 0x9e:                /* PM */
-        case 0x9f:                /* APC */
-                return parser_transition_no_action(parser, raw, STATE_ST_IGNORE);
-                // FIXMEchpe shouldn't this use ACTION_CLEAR?
-        case 0x90:                /* DCS */
-                return parser_transition(parser, raw,
-                                         STATE_DCS_ENTRY, ACTION_DCS_START);
-        case 0x9a:                /* SCI */
-                return parser_transition(parser, raw,
-                                         STATE_SCI, ACTION_CLEAR);
-        case 0x9d:                /* OSC */
-                return parser_transition(parser, raw,
-                                         STATE_OSC_STRING, ACTION_OSC_START);
-        case 0x9b:                /* CSI */
-                return parser_transition(parser, raw,
-                                         STATE_CSI_ENTRY, ACTION_CLEAR_INT_AND_PARAMS);
-        default:
-                return parser_feed_to_state(parser, raw);
+        if (ptr == begin) {
+                *n_consumed = 1;
+                return vte_parser_feed(parser, *begin);
         }
+
+        *n_consumed = ptr - begin;
+        return parser_print(parser, *(ptr - 1));
 }
 
 void
 vte_parser_reset(vte_parser_t* parser)
 {
-        parser_transition(parser, 0, STATE_GROUND, ACTION_IGNORE);
+        parser->state = STATE_GROUND;
+        parser_ignore(parser, 0);
 }
@@ -52,6 +52,7 @@ enum {
         VTE_SEQ_APC,         /* application program command */
         VTE_SEQ_PM,          /* privacy message */
         VTE_SEQ_SOS,         /* start of string */
+        VTE_SEQ_DCS_DATA,    /* a chunk of the data of a streamed DCS */
 
         VTE_SEQ_N,
 };
@@ -195,8 +196,12 @@ struct vte_seq_t {
         vte_seq_arg_t args[VTE_PARSER_ARG_MAX];
         vte_seq_string_t arg_str;
         uint32_t introducer;
+        unsigned int n_chunks; /* of a streamed DCS, dispatched so far */
 };
 
+/* The parser's initial and ground state; see parser_state_t in parser.cc */
+#define VTE_PARSER_STATE_GROUND (0U)
+
 struct vte_parser_t {
         vte_seq_t seq;
         unsigned int state;
@@ -206,4 +211,10 @@ void vte_parser_init(vte_parser_t* parser);
 void vte_parser_deinit(vte_parser_t* parser);
 int vte_parser_feed(vte_parser_t* parser,
                     uint32_t raw);
+int vte_parser_feed_run(vte_parser_t* parser,
+                        uint32_t const* begin,
+                        uint32_t const* end,
+                        size_t* n_consumed);
+bool vte_parser_is_graphic(vte_parser_t const* parser,
+                           uint32_t raw);
 void vte_parser_reset(vte_parser_t* parser);
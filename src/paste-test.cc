@@ -0,0 +1,148 @@
+/*
+ * Copyright © 2026 The VTE developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <glib.h>
+
+#include <string>
+
+#include "paste.hh"
+
+using namespace std::literals;
+using namespace vte::base;
+
+static std::string
+filter(std::string const& str)
+{
+        auto out = std::string{};
+        filter_paste(str.data(), str.size(), out);
+        return out;
+}
+
+static void
+test_paste_find_special(void)
+{
+        /* Check each position within and after a SIMD block */
+        for (auto len = size_t{1}; len < 40; ++len) {
+                for (auto c : {0x00, 0x01, 0x0a, 0x1f, 0x7f, 0xc2}) {
+                        auto str = std::string(len, 'x');
+                        str[len - 1] = char(c);
+                        auto const begin = reinterpret_cast<uint8_t const*>(str.data());
+                        g_assert_true(find_paste_special(begin, begin + len) == begin + len - 1);
+                }
+        }
+
+        auto const str = "printable \xc3\xa4 \xe2\x82\xac text, long enough for a block"s;
+        auto const begin = reinterpret_cast<uint8_t const*>(str.data());
+        g_assert_true(find_paste_special(begin, begin + str.size()) == begin + str.size());
+}
+
+static void
+test_paste_filter(void)
+{
+        g_assert_cmpstr(filter("one\ntwo\r\n\tthree"s).c_str(), ==, "one\rtwo\r\r\tthree");
+        g_assert_cmpstr(filter("a\x01\x1b[31mb\x7f"s).c_str(), ==, "a[31mb");
+        /* C1 controls are removed, other U+0080..U+00FF kept */
+        g_assert_cmpstr(filter("a\xc2\x9b" "1m\xc2\xa0\xc2"s).c_str(), ==, "a1m\xc2\xa0\xc2");
+        g_assert_cmpstr(filter("\xc3\xa4\xe2\x82\xac"s).c_str(), ==, "\xc3\xa4\xe2\x82\xac");
+
+        /* Appends */
+        auto out = "x"s;
+        filter_paste("y\n", 2, out);
+        g_assert_cmpstr(out.c_str(), ==, "xy\r");
+}
+
+static void
+test_paste_slice_size(void)
+{
+        auto const str = "ab\xe2\x82\xac" "cd"s; /* € is 3 bytes at 2..4 */
+        g_assert_cmpuint(paste_slice_size(str.data(), str.size(), 100), ==, str.size());
+        g_assert_cmpuint(paste_slice_size(str.data(), str.size(), 2), ==, 2);
+        g_assert_cmpuint(paste_slice_size(str.data(), str.size(), 3), ==, 2);
+        g_assert_cmpuint(paste_slice_size(str.data(), str.size(), 4), ==, 2);
+        g_assert_cmpuint(paste_slice_size(str.data(), str.size(), 5), ==, 5);
+
+        /* Never empty, and not backing up over non-UTF-8 */
+        auto const garbage = "\x80\x80\x80\x80\x80\x80"s;
+        g_assert_cmpuint(paste_slice_size(garbage.data(), garbage.size(), 1), ==, 1);
+        g_assert_cmpuint(paste_slice_size(garbage.data(), garbage.size(), 5), ==, 5);
+}
+
+/* Sends to @outgoing as the terminal does: other input only after all of
+ * the paste in progress */
+static void
+send_input(PasteQueue& paste,
+           std::string const& data,
+           std::string& outgoing)
+{
+        if (paste.pasting())
+                paste.finish(4, outgoing);
+        outgoing.append(data);
+}
+
+static void
+test_paste_queue(void)
+{
+        PasteQueue paste;
+        auto outgoing = std::string{};
+
+        paste.start("one\ntwo\x01three"sv, true, outgoing);
+        g_assert_true(paste.pasting());
+        g_assert_cmpstr(outgoing.c_str(), ==, "\e[200~");
+
+        /* In slices, not cut in UTF-8 characters */
+        g_assert_true(paste.next(4, outgoing));
+        g_assert_cmpstr(outgoing.c_str(), ==, "\e[200~one\r");
+        g_assert_cmpuint(paste.offset(), ==, 4);
+
+        /* Typed in the middle of the paste, it goes after its end */
+        send_input(paste, "x"s, outgoing);
+        g_assert_false(paste.pasting());
+        g_assert_cmpstr(outgoing.c_str(), ==, "\e[200~one\rtwothree\e[201~x");
+        g_assert_false(paste.next(4, outgoing));
+
+        /* Cancelled, it still ends */
+        outgoing.clear();
+        paste.start("\xe2\x82\xac\xe2\x82\xac"sv, true, outgoing);
+        g_assert_true(paste.next(4, outgoing));
+        g_assert_cmpuint(paste.offset(), ==, 3);
+        paste.cancel(outgoing);
+        g_assert_false(paste.pasting());
+        g_assert_cmpuint(paste.size(), ==, 0);
+        g_assert_cmpstr(outgoing.c_str(), ==, "\e[200~\xe2\x82\xac\e[201~");
+
+        /* Not bracketed */
+        outgoing.clear();
+        paste.start("a\nb"sv, false, outgoing);
+        send_input(paste, "c"s, outgoing);
+        g_assert_cmpstr(outgoing.c_str(), ==, "a\rbc");
+}
+
+int
+main(int argc,
+     char* argv[])
+{
+        g_test_init(&argc, &argv, nullptr);
+
+        g_test_add_func("/vte/paste/find-special", test_paste_find_special);
+        g_test_add_func("/vte/paste/filter", test_paste_filter);
+        g_test_add_func("/vte/paste/slice-size", test_paste_slice_size);
+        g_test_add_func("/vte/paste/queue", test_paste_queue);
+
+        return g_test_run();
+}
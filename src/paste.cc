@@ -0,0 +1,214 @@
+/*
+ * Copyright © 2026 The VTE developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "paste.hh"
+
+#include <glib.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+static inline bool
+is_paste_special(uint8_t c) noexcept
+{
+        return c < 0x20 || c == 0x7f || c == 0xc2;
+}
+
+uint8_t const*
+vte::base::find_paste_special(uint8_t const* begin,
+                              uint8_t const* end) noexcept
+{
+        auto p = begin;
+
+#if defined(__SSE2__)
+        /* There's no unsigned compare, but v < 0x20 iff min(v, 0x1f) == v */
+        auto const c0 = _mm_set1_epi8(0x1f);
+        auto const del = _mm_set1_epi8(0x7f);
+        auto const c2 = _mm_set1_epi8(char(0xc2));
+        while (end - p >= 16) {
+                auto const v = _mm_loadu_si128(reinterpret_cast<__m128i const*>(p));
+                auto const special = _mm_or_si128(_mm_cmpeq_epi8(_mm_min_epu8(v, c0), v),
+                                                  _mm_or_si128(_mm_cmpeq_epi8(v, del),
+                                                               _mm_cmpeq_epi8(v, c2)));
+                auto const mask = unsigned(_mm_movemask_epi8(special));
+                if (mask != 0)
+                        return p + __builtin_ctz(mask);
+
+                p += 16;
+        }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+        auto const c0 = vdupq_n_u8(0x20);
+        auto const del = vdupq_n_u8(0x7f);
+        auto const c2 = vdupq_n_u8(0xc2);
+        while (end - p >= 16) {
+                auto const v = vld1q_u8(p);
+                auto const special = vorrq_u8(vcltq_u8(v, c0),
+                                              vorrq_u8(vceqq_u8(v, del),
+                                                       vceqq_u8(v, c2)));
+                if (vmaxvq_u8(special) != 0)
+                        break; /* find the exact position below */
+
+                p += 16;
+        }
+#endif
+
+        while (p < end && !is_paste_special(*p))
+                ++p;
+
+        return p;
+}
+
+void
+vte::base::filter_paste(char const* text,
+                        size_t len,
+                        std::string& out)
+{
+        auto p = reinterpret_cast<uint8_t const*>(text);
+        auto const end = p + len;
+
+        out.reserve(out.size() + len);
+        while (p < end) {
+                auto const run = find_paste_special(p, end);
+                out.append(reinterpret_cast<char const*>(p), run - p);
+                p = run;
+                if (p == end)
+                        break;
+
+                switch (*p) {
+                case 0x09: /* HT */
+                case 0x0d: /* CR */
+                        out.push_back(char(*p));
+                        ++p;
+                        break;
+                case 0x0a: /* LF */
+                        out.push_back('\x0d');
+                        ++p;
+                        break;
+                case 0xc2:
+                        if (end - p >= 2 && p[1] >= 0x80 && p[1] <= 0x9f) {
+                                /* Skip both bytes of a C1 */
+                                p += 2;
+                        } else {
+                                /* Move along, nothing to see here */
+                                out.push_back('\xc2');
+                                ++p;
+                        }
+                        break;
+                default:
+                        /* Swallow this byte */
+                        ++p;
+                        break;
+                }
+        }
+}
+
+size_t
+vte::base::paste_slice_size(char const* text,
+                            size_t len,
+                            size_t max_len) noexcept
+{
+        if (len <= max_len)
+                return len;
+
+        /* Back up over the continuation bytes of the character cut in two,
+         * if there are not too many for it to be UTF-8.
+         */
+        auto size = max_len;
+        for (auto i = 0; i < 3 && size > 1 && (uint8_t(text[size]) & 0xc0) == 0x80; ++i)
+                --size;
+
+        return (uint8_t(text[size]) & 0xc0) == 0x80 ? max_len : size;
+}
+
+void
+vte::base::PasteQueue::start(std::string_view const& text,
+                             bool bracketed,
+                             std::string& out)
+{
+        m_text.assign(text);
+        m_offset = 0;
+        m_pasting = true;
+        m_bracketed = bracketed;
+
+        // FIXMEchpe can we not hardcode C0 controls here?
+        if (m_bracketed)
+                out.append("\e[200~");
+}
+
+bool
+vte::base::PasteQueue::next(size_t max_len,
+                            std::string& out)
+{
+        if (!m_pasting)
+                return false;
+
+        if (m_offset < m_text.size()) {
+                auto const text = m_text.data() + m_offset;
+                auto const len = paste_slice_size(text, m_text.size() - m_offset, max_len);
+
+                // FIXMEchpe this cannot happen ever
+                if (!g_utf8_validate(text, len, nullptr)) {
+                        g_warning("Paste not valid UTF-8, dropping the rest.");
+                        m_offset = m_text.size();
+                } else {
+                        m_offset += len;
+                        filter_paste(text, len, out);
+                }
+        }
+
+        if (m_offset < m_text.size())
+                return true;
+
+        if (m_bracketed)
+                out.append("\e[201~");
+        m_pasting = false;
+        return false;
+}
+
+void
+vte::base::PasteQueue::finish(size_t max_len,
+                              std::string& out)
+{
+        while (next(max_len, out))
+                ;
+}
+
+void
+vte::base::PasteQueue::cancel(std::string& out)
+{
+        if (!m_pasting)
+                return;
+
+        auto const bracketed = m_bracketed;
+        stop();
+        if (bracketed)
+                out.append("\e[201~");
+}
+
+void
+vte::base::PasteQueue::stop() noexcept
+{
+        m_pasting = false;
+        m_offset = 0;
+        m_text.clear();
+        m_text.shrink_to_fit();
+}
@@ -0,0 +1,122 @@
+/*
+ * Copyright © 2026 The VTE developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace vte {
+
+namespace base {
+
+/* find_paste_special:
+ * @begin: start of the buffer
+ * @end: end of the buffer
+ *
+ * Returns: a pointer to the first byte in [@begin, @end) that
+ *   filter_paste() may have to change: a C0 control, DEL, or the 0xC2
+ *   lead byte of a C1 control; or @end if there is no such byte
+ */
+uint8_t const* find_paste_special(uint8_t const* begin,
+                                  uint8_t const* end) noexcept;
+
+/* filter_paste:
+ * @text: the UTF-8 text to paste
+ * @len: the length of @text
+ * @out: the string to append the result to
+ *
+ * Appends @text to @out, with newlines converted to carriage returns,
+ * which more software is able to cope with, and all C0 controls except
+ * HT and CR, DEL, and the C1 controls removed.
+ *
+ * @text must not end in the middle of a UTF-8 character; see
+ * paste_slice_size().
+ */
+void filter_paste(char const* text,
+                  size_t len,
+                  std::string& out);
+
+/* paste_slice_size:
+ * @text: the UTF-8 text
+ * @len: the length of @text
+ * @max_len: the largest slice wanted
+ *
+ * Returns: the length of the first slice of @text that is at most
+ *   @max_len bytes long and doesn't end in the middle of a UTF-8 character
+ */
+size_t paste_slice_size(char const* text,
+                        size_t len,
+                        size_t max_len) noexcept;
+
+/*
+ * PasteQueue:
+ *
+ * A paste in progress, filtered and queued for the child a slice at a time
+ * as the PTY drains, so that a large paste doesn't block the main loop nor
+ * take the memory for all of it several times. Any other input for the
+ * child must wait for finish(), or it would end up in the middle of the
+ * paste, inside the bracketed paste markers.
+ */
+class PasteQueue {
+public:
+        PasteQueue() = default;
+
+        PasteQueue(PasteQueue const&) = delete;
+        PasteQueue(PasteQueue&&) = delete;
+        PasteQueue& operator= (PasteQueue const&) = delete;
+        PasteQueue& operator= (PasteQueue&&) = delete;
+
+        inline constexpr bool pasting() const noexcept { return m_pasting; }
+        inline constexpr size_t offset() const noexcept { return m_offset; }
+        inline size_t size() const noexcept { return m_text.size(); }
+
+        /* Starts pasting @text, appending the start of the bracketed paste
+         * to @out if @bracketed */
+        void start(std::string_view const& text,
+                   bool bracketed,
+                   std::string& out);
+
+        /* Appends the next slice of at most @max_len bytes, filtered, to
+         * @out, and the end of the bracketed paste after the last one.
+         * Returns: whether there is more to paste */
+        bool next(size_t max_len,
+                  std::string& out);
+
+        /* Appends all of the rest of the paste to @out */
+        void finish(size_t max_len,
+                    std::string& out);
+
+        /* Stops the paste, appending the end of the bracketed paste to
+         * @out if it began with one */
+        void cancel(std::string& out);
+
+        /* Forgets the paste, e.g. when its PTY goes away */
+        void stop() noexcept;
+
+private:
+        std::string m_text{};
+        size_t m_offset{0};
+        bool m_pasting{false};
+        bool m_bracketed{false};
+};
+
+} // namespace base
+
+} // namespace vte
@@ -0,0 +1,113 @@
+/*
+ * Copyright © 2026 The VTE developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <ctime>
+
+namespace vte {
+
+namespace base {
+
+/*
+ * Profile:
+ *
+ * Process-wide accumulated time spent in the stages of processing
+ * terminal output, for vte-replay. Disabled by default, in which case
+ * a Scope costs a single well-predicted branch.
+ *
+ * Stages nest (the ring freezes rows from within handlers, and
+ * compresses from within freezing), so each count includes the time
+ * spent in the stages below it.
+ *
+ * Scopes are entered on the worker threads too (the boa stream
+ * compresses its blocks on one), so the counts are atomic.
+ */
+class Profile {
+public:
+        enum class Stage {
+                eHandler,        /* sequence handlers and character insertion */
+                eRingFreeze,     /* Ring::freeze_row() */
+                eStreamCompress, /* compressing, encrypting and writing stream blocks */
+                eN
+        };
+
+        class Scope {
+        public:
+                explicit Scope(Stage stage) noexcept
+                        : m_stage{stage},
+                          m_start{enabled() ? now() : 0}
+                {
+                }
+
+                ~Scope() noexcept
+                {
+                        if (m_start != 0)
+                                s_elapsed[int(m_stage)].fetch_add(now() - m_start,
+                                                          std::memory_order_relaxed);
+                }
+
+                Scope(Scope const&) = delete;
+                Scope(Scope&&) = delete;
+                Scope& operator= (Scope const&) = delete;
+                Scope& operator= (Scope&&) = delete;
+
+        private:
+                Stage m_stage;
+                int64_t m_start;
+        };
+
+        static inline void set_enabled(bool enabled) noexcept
+        {
+                s_enabled.store(enabled, std::memory_order_relaxed);
+        }
+
+        static inline bool enabled() noexcept
+        {
+                return s_enabled.load(std::memory_order_relaxed);
+        }
+
+        static void reset() noexcept
+        {
+                for (auto& elapsed : s_elapsed)
+                        elapsed.store(0, std::memory_order_relaxed);
+        }
+
+        /* Returns: the time spent in @stage, in ns */
+        static inline int64_t elapsed(Stage stage) noexcept
+        {
+                return s_elapsed[int(stage)].load(std::memory_order_relaxed);
+        }
+
+        /* Returns: CLOCK_MONOTONIC, in ns */
+        static inline int64_t now() noexcept
+        {
+                struct timespec ts;
+                clock_gettime(CLOCK_MONOTONIC, &ts);
+                return int64_t(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+        }
+
+private:
+        static inline std::atomic<bool> s_enabled{false};
+        static inline std::atomic<int64_t> s_elapsed[int(Stage::eN)]{};
+};
+
+} // namespace base
+
+} // namespace vte
@@ -0,0 +1,98 @@
+/*
+ * Copyright © 2026 The VTE developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <glib.h>
+
+#include <string>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "pty-reader.hh"
+
+using namespace vte::base;
+
+/* A packet as the PTY master in TIOCPKT mode delivers it */
+static std::string
+make_packet(unsigned n)
+{
+        auto packet = std::string(1, char(TIOCPKT_DATA));
+        for (auto i = 0u; i < 100; i++)
+                packet.push_back(char('a' + (n + i) % 26));
+        return packet;
+}
+
+static void
+test_pty_reader_stop_full(void)
+{
+        /* A seqpacket socket keeps the packets apart, like the PTY does */
+        int fds[2];
+        g_assert_cmpint(socketpair(AF_UNIX, SOCK_SEQPACKET, 0, fds), ==, 0);
+        g_assert_cmpint(fcntl(fds[0], F_SETFL, O_NONBLOCK), ==, 0);
+
+        /* More than the queue holds */
+        auto const n_packets = 200u;
+        auto expected = std::string{};
+        for (auto n = 0u; n < n_packets; n++) {
+                auto const packet = make_packet(n);
+                g_assert_cmpint(write(fds[1], packet.data(), packet.size()), ==, ssize_t(packet.size()));
+                expected.append(packet, 1, std::string::npos);
+        }
+
+        auto reader = PtyReader::create(fds[0]);
+        g_assert_nonnull(reader.get());
+
+        /* Let the reader fill the queue and block */
+        g_usleep(200 * 1000);
+        reader->stop();
+
+        /* What the reader read, then what it left in the socket */
+        auto got = std::string{};
+        while (auto chunk = reader->pop())
+                got.append(reinterpret_cast<char const*>(chunk->data), chunk->len);
+        g_assert_cmpuint(got.size(), <, expected.size());
+
+        char buf[256];
+        ssize_t len;
+        while ((len = read(fds[0], buf, sizeof(buf))) > 0)
+                got.append(buf + 1, len - 1);
+        g_assert_true(len == -1 && errno == EAGAIN);
+
+        g_assert_cmpuint(got.size(), ==, expected.size());
+        g_assert_true(got == expected);
+
+        reader.reset();
+        close(fds[0]);
+        close(fds[1]);
+}
+
+int
+main(int argc,
+     char* argv[])
+{
+        g_test_init(&argc, &argv, nullptr);
+
+        g_test_add_func("/vte/pty-reader/stop-full", test_pty_reader_stop_full);
+
+        return g_test_run();
+}
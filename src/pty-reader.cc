@@ -0,0 +1,309 @@
+/*
+ * Copyright © 2026 The VTE developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "pty-reader.hh"
+
+#include <errno.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#ifdef HAVE_SYS_TERMIOS_H
+#include <sys/termios.h>
+#endif
+#include <termios.h>
+#include <unistd.h>
+
+#include <glib-unix.h>
+
+#include "debug.h"
+
+namespace vte {
+
+namespace base {
+
+PtyReader::PtyReader(int fd) noexcept
+        : m_fd{fd}
+{
+}
+
+PtyReader::~PtyReader() noexcept
+{
+        stop();
+
+        /* Recycle any chunks the main thread didn't consume */
+        while (pop())
+                ;
+
+        for (auto fd : {m_notify_pipe[0], m_notify_pipe[1], m_wakeup_pipe[0], m_wakeup_pipe[1]}) {
+                if (fd != -1)
+                        close(fd);
+        }
+}
+
+std::unique_ptr<PtyReader>
+PtyReader::create(int fd) noexcept
+{
+        auto reader = std::unique_ptr<PtyReader>{new PtyReader{fd}};
+        if (!reader->start())
+                return {};
+
+        return reader;
+}
+
+bool
+PtyReader::start() noexcept
+{
+        if (!g_unix_open_pipe(m_notify_pipe, FD_CLOEXEC, nullptr) ||
+            !g_unix_open_pipe(m_wakeup_pipe, FD_CLOEXEC, nullptr))
+                return false;
+
+        for (auto fd : {m_notify_pipe[0], m_notify_pipe[1], m_wakeup_pipe[0], m_wakeup_pipe[1]}) {
+                if (!g_unix_set_fd_nonblocking(fd, true, nullptr))
+                        return false;
+        }
+
+        GError* error = nullptr;
+        m_thread = g_thread_try_new("vte-pty-reader", thread_func, this, &error);
+        if (m_thread == nullptr) {
+                _vte_debug_print(VTE_DEBUG_IO, "Failed to start PTY reader thread: %s\n",
+                                 error->message);
+                g_error_free(error);
+                return false;
+        }
+
+        return true;
+}
+
+void
+PtyReader::stop() noexcept
+{
+        if (m_thread == nullptr)
+                return;
+
+        m_quit.store(true);
+        auto const c = char{0};
+        if (write(m_wakeup_pipe[1], &c, 1) == -1) {
+                /* Pipe full means the reader will wake up anyway */
+        }
+
+        g_thread_join(m_thread);
+        m_thread = nullptr;
+}
+
+gpointer
+PtyReader::thread_func(gpointer data) noexcept
+{
+        reinterpret_cast<PtyReader*>(data)->run();
+        return nullptr;
+}
+
+static void
+drain_pipe(int fd) noexcept
+{
+        char buf[64];
+        while (read(fd, buf, sizeof(buf)) > 0)
+                ;
+}
+
+void
+PtyReader::notify() noexcept
+{
+        if (m_notified.exchange(true))
+                return;
+
+        auto const c = char{0};
+        if (write(m_notify_pipe[1], &c, 1) == -1) {
+                /* The pipe is full, so the main thread will wake up anyway */
+        }
+}
+
+void
+PtyReader::add_packet_flags(unsigned add,
+                            unsigned remove) noexcept
+{
+        auto flags = m_packet_flags.load();
+        while (!m_packet_flags.compare_exchange_weak(flags, (flags & ~remove) | add))
+                ;
+}
+
+/* Waits until the main thread wakes us; returns false if we should quit */
+bool
+PtyReader::wait_wakeup() noexcept
+{
+        struct pollfd pfd{m_wakeup_pipe[0], POLLIN, 0};
+        while (poll(&pfd, 1, -1) == -1 && errno == EINTR)
+                ;
+
+        drain_pipe(m_wakeup_pipe[0]);
+        return !m_quit.load();
+}
+
+/* Queues @chunk for the main thread, waiting for room if the queue is full.
+ * Returns false if we should quit.
+ */
+bool
+PtyReader::push(Chunk::unique_type chunk) noexcept
+{
+        auto raw = chunk.release();
+        while (!m_queue.push(raw)) {
+                m_blocked.store(true);
+
+                /* Re-check after announcing that we're blocked, so that we
+                 * don't miss a wakeup from a pop() that happened in between.
+                 */
+                if (m_queue.push(raw)) {
+                        m_blocked.store(false);
+                        break;
+                }
+
+                _vte_debug_print(VTE_DEBUG_IO, "PTY reader queue full, waiting\n");
+
+                if (!wait_wakeup()) {
+                        /* Keep it for the main thread, see pop() */
+                        m_pending.store(raw);
+                        return false;
+                }
+        }
+
+        notify();
+        return !m_quit.load();
+}
+
+void
+PtyReader::run() noexcept
+{
+        auto eos = bool{false};
+
+        while (!eos && !m_quit.load()) {
+                struct pollfd pfds[2] = {
+                        {m_fd, POLLIN | POLLPRI, 0},
+                        {m_wakeup_pipe[0], POLLIN, 0},
+                };
+
+                if (poll(pfds, G_N_ELEMENTS(pfds), -1) == -1) {
+                        if (errno == EINTR)
+                                continue;
+
+                        _vte_debug_print(VTE_DEBUG_IO, "PTY reader poll failed: %m\n");
+                        eos = true;
+                        break;
+                }
+
+                if (pfds[1].revents)
+                        drain_pipe(m_wakeup_pipe[0]);
+                if (m_quit.load())
+                        break;
+
+                if (pfds[0].revents == 0)
+                        continue;
+
+                /* Read until the PTY is drained */
+                for (;;) {
+                        auto chunk = Chunk::get();
+                        auto bp = chunk->data;
+
+                        /* See Terminal::pty_io_read() for the TIOCPKT header handling */
+                        auto const save = bp[-1];
+                        errno = 0;
+                        auto ret = read(m_fd, bp - 1, chunk->capacity() + 1);
+                        auto const pkt_header = bp[-1];
+                        bp[-1] = save;
+
+                        if (ret == -1) {
+                                auto const err = errno;
+                                if (err == EINTR)
+                                        continue;
+                                if (err == EAGAIN || err == EBUSY)
+                                        break;
+
+                                /* EIO means EOS; treat any other error the same */
+                                if (err != EIO)
+                                        _vte_debug_print(VTE_DEBUG_IO, "Error reading from child: %s\n",
+                                                         g_strerror(err));
+                                eos = true;
+                                break;
+                        }
+                        if (ret == 0) {
+                                eos = true;
+                                break;
+                        }
+
+                        if (pkt_header == TIOCPKT_DATA) {
+                                chunk->len = ret - 1;
+                                if (!push(std::move(chunk)))
+                                        return;
+                                continue;
+                        }
+
+                        if (pkt_header & TIOCPKT_IOCTL)
+                                add_packet_flags(eTERMIOS_CHANGED, 0);
+                        if (pkt_header & TIOCPKT_STOP)
+                                add_packet_flags(eSCROLL_LOCKED, eSCROLL_UNLOCKED);
+                        if (pkt_header & TIOCPKT_START)
+                                add_packet_flags(eSCROLL_UNLOCKED, eSCROLL_LOCKED);
+                        notify();
+                }
+        }
+
+        if (!eos)
+                return;
+
+        _vte_debug_print(VTE_DEBUG_IO, "PTY reader got EOS\n");
+
+        auto chunk = Chunk::get();
+        chunk->set_sealed();
+        chunk->set_eos();
+        push(std::move(chunk));
+}
+
+void
+PtyReader::acknowledge() noexcept
+{
+        drain_pipe(m_notify_pipe[0]);
+
+        /* Need to use an RMW operation here to synchronise with
+         * the reader's notify(), see pop().
+         */
+        m_notified.exchange(false);
+}
+
+Chunk::unique_type
+PtyReader::pop() noexcept
+{
+        Chunk* raw = nullptr;
+        if (!m_queue.pop(raw)) {
+                /* Once the queue is empty, the chunk that didn't fit
+                 * when the reader was stopped, if any */
+                raw = m_pending.exchange(nullptr);
+                return Chunk::unique_type{raw};
+        }
+
+        /* Wake up the reader if it was waiting for room in the queue */
+        if (m_blocked.exchange(false)) {
+                auto const c = char{0};
+                if (write(m_wakeup_pipe[1], &c, 1) == -1) {
+                        /* The reader will wake up anyway */
+                }
+        }
+
+        return Chunk::unique_type{raw};
+}
+
+} // namespace base
+
+} // namespace vte
@@ -0,0 +1,109 @@
+/*
+ * Copyright © 2026 The VTE developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+
+#include <glib.h>
+
+#include "chunk.hh"
+#include "spsc-queue.hh"
+
+namespace vte {
+
+namespace base {
+
+/*
+ * PtyReader:
+ *
+ * Reads from a PTY master (in TIOCPKT mode) on a dedicated thread, and
+ * hands the data to the main thread in Chunks through a lock-free queue.
+ *
+ * The main thread watches notify_fd() for readability; when it becomes
+ * readable, it calls acknowledge() and then pop()s all available chunks.
+ * When the queue is full, the reader thread stops reading until the main
+ * thread has consumed some chunks, so the child blocks in the kernel.
+ *
+ * The final chunk the reader delivers is marked EOS, after which the
+ * thread exits.
+ *
+ * Nothing already read is lost on stop(): a chunk that didn't fit in the
+ * full queue is kept aside, and pop() returns it after the queued ones.
+ */
+class PtyReader {
+public:
+        /* Packet flags forwarded from the TIOCPKT header */
+        enum PacketFlags : unsigned {
+                eTERMIOS_CHANGED = 1u << 0,
+                eSCROLL_LOCKED   = 1u << 1,
+                eSCROLL_UNLOCKED = 1u << 2,
+        };
+
+        ~PtyReader() noexcept;
+
+        PtyReader(PtyReader const&) = delete;
+        PtyReader(PtyReader&&) = delete;
+        PtyReader& operator= (PtyReader const&) = delete;
+        PtyReader& operator= (PtyReader&&) = delete;
+
+        /* Starts a reader thread for @fd, which must stay open for the
+         * lifetime of the returned object. Returns nullptr on failure.
+         */
+        static std::unique_ptr<PtyReader> create(int fd) noexcept;
+
+        inline constexpr int notify_fd() const noexcept { return m_notify_pipe[0]; }
+
+        /* Main thread side */
+        void acknowledge() noexcept;
+        Chunk::unique_type pop() noexcept;
+        unsigned take_packet_flags() noexcept { return m_packet_flags.exchange(0); }
+        void stop() noexcept;
+
+private:
+        PtyReader(int fd) noexcept;
+
+        bool start() noexcept;
+        void run() noexcept;
+        bool push(Chunk::unique_type chunk) noexcept;
+        bool wait_wakeup() noexcept;
+        void notify() noexcept;
+        void add_packet_flags(unsigned add,
+                              unsigned remove) noexcept;
+
+        static gpointer thread_func(gpointer data) noexcept;
+
+        int m_fd{-1};
+        int m_notify_pipe[2]{-1, -1}; /* reader → main */
+        int m_wakeup_pipe[2]{-1, -1}; /* main → reader */
+        GThread* m_thread{nullptr};
+
+        std::atomic<bool> m_quit{false};
+        std::atomic<bool> m_notified{false};
+        std::atomic<bool> m_blocked{false};
+        std::atomic<unsigned> m_packet_flags{0};
+        /* The last chunk read when stop()ped with the queue full */
+        std::atomic<Chunk*> m_pending{nullptr};
+
+        static constexpr size_t const k_queue_size = 64;
+        SPSCQueue<Chunk*, k_queue_size> m_queue{};
+};
+
+} // namespace base
+
+} // namespace vte
@@ -34,6 +34,7 @@
 #include "vteptyinternal.hh"
 #include "vtetypes.hh"
 #include "vtespawn.hh"
+#include "spawn-helper.hh"
 
 #include <assert.h>
 #include <sys/types.h>
@@ -102,16 +103,9 @@ Pty::unref() noexcept
 void
 Pty::child_setup() const noexcept
 {
-        /* Unblock all signals */
-        sigset_t set;
-        sigemptyset(&set);
-        if (pthread_sigmask(SIG_SETMASK, &set, nullptr) == -1) {
-                _vte_debug_print(VTE_DEBUG_PTY, "%s failed: %m\n", "pthread_sigmask");
-                _exit(127);
-        }
-
         /* Reset the handlers for all signals to their defaults.  The parent
-         * (or one of the libraries it links to) may have changed one to be ignored. */
+         * (or one of the libraries it links to) may have changed one to be ignored.
+         * This comes first, so that no handler of the parent runs here. */
         for (int n = 1; n < NSIG; n++) {
                 if (n == SIGSTOP || n == SIGKILL)
                         continue;
@@ -119,6 +113,14 @@ Pty::child_setup() const noexcept
                 signal(n, SIG_DFL);
         }
 
+        /* Unblock all signals */
+        sigset_t set;
+        sigemptyset(&set);
+        if (pthread_sigmask(SIG_SETMASK, &set, nullptr) == -1) {
+                _vte_debug_print(VTE_DEBUG_PTY, "%s failed: %m\n", "pthread_sigmask");
+                _exit(127);
+        }
+
         auto masterfd = fd();
         if (masterfd == -1)
                 _exit(127);
@@ -245,14 +247,9 @@ Pty::child_setup() const noexcept
 		close(fd);
 	}
 
-        /* Now set the TERM environment variable */
-        /* FIXME: Setting environment here seems to have no effect, the merged envp2 will override on exec.
-         * By the way, we'd need to set the one from there, if any. */
-        g_setenv("TERM", VTE_TERMINFO_NAME, TRUE);
-
-        char version[7];
-        g_snprintf (version, sizeof (version), "%u", VTE_VERSION_NUMERIC);
-        g_setenv ("VTE_VERSION", version, TRUE);
+        /* Setting TERM and VTE_VERSION is left to vte_pty_child_setup(); spawn()
+         * passes them in the environment, see __vte_pty_merge_environ(). Nothing
+         * here may allocate, since this can run in a child sharing our memory. */
 
 	/* Finally call an extra child setup */
 	if (m_extra_child_setup.func) {
@@ -372,6 +369,10 @@ pty_child_setup_cb(void* data)
  * is unable to chdir() to it, falls back trying to spawn the command
  * in the parent's working directory.
  *
+ * With %VTE_SPAWN_USE_HELPER in @spawn_flags and no @child_setup, the
+ * command is spawned from the spawn helper, see SpawnHelper; failing that,
+ * from this process.
+ *
  * Returns: %TRUE on success, or %FALSE on failure with @error filled in
  */
 bool
@@ -432,32 +433,60 @@ Pty::spawn(char const* directory,
 	m_extra_child_setup.func = child_setup_func;
 	m_extra_child_setup.data = child_setup_data;
 
+        /* Without a child setup function of the caller's, the child only
+         * runs child_setup(), which is async-signal-safe, so it doesn't
+         * need copying the parent's memory; see fork_exec_with_pipes().
+         * Except when debugging, as it then prints. */
+        spawn_flags &= ~VTE_SPAWN_CHILD_SETUP_VFORK_SAFE;
+        if (child_setup_func == nullptr &&
+            !_vte_debug_on(VTE_DEBUG_PTY))
+                spawn_flags |= VTE_SPAWN_CHILD_SETUP_VFORK_SAFE;
+
+        /* The helper can't run a child setup function of the caller's */
+        auto use_helper = (spawn_flags & VTE_SPAWN_USE_HELPER) != 0 &&
+                child_setup_func == nullptr;
+        spawn_flags &= ~VTE_SPAWN_USE_HELPER;
+
         auto err = vte::glib::Error{};
-        ret = vte_spawn_async_with_pipes_cancellable(directory,
-                                                     argv, envp2,
-                                                     (GSpawnFlags)spawn_flags,
-                                                     (GSpawnChildSetupFunc)pty_child_setup_cb,
-                                                     this,
-                                                     child_pid,
-                                                     nullptr, nullptr, nullptr,
-                                                     timeout,
-                                                     cancellable ? &pollfd : nullptr,
-                                                     err);
+        auto spawn_in = [&](char const* dir) -> bool {
+                if (use_helper) {
+                        if (SpawnHelper::get()->spawn(*this,
+                                                      dir,
+                                                      argv, envp2,
+                                                      spawn_flags,
+                                                      child_pid,
+                                                      timeout,
+                                                      cancellable ? &pollfd : nullptr,
+                                                      err))
+                                return true;
+                        if (!err.matches(G_IO_ERROR, G_IO_ERROR_NOT_CONNECTED))
+                                return false;
+
+                        _vte_debug_print(VTE_DEBUG_PTY, "Not using the spawn helper: %s\n",
+                                         err.message());
+                        err.reset();
+                        use_helper = false;
+                }
+
+                return vte_spawn_async_with_pipes_cancellable(dir,
+                                                              argv, envp2,
+                                                              (GSpawnFlags)spawn_flags,
+                                                              (GSpawnChildSetupFunc)pty_child_setup_cb,
+                                                              this,
+                                                              child_pid,
+                                                              nullptr, nullptr, nullptr,
+                                                              timeout,
+                                                              cancellable ? &pollfd : nullptr,
+                                                              err);
+        };
+
+        ret = spawn_in(directory);
         if (!ret &&
             directory != nullptr &&
             err.matches(G_SPAWN_ERROR, G_SPAWN_ERROR_CHDIR)) {
                 /* try spawning in our working directory */
                 err.reset();
-                ret = vte_spawn_async_with_pipes_cancellable(nullptr,
-                                                             argv, envp2,
-                                                             (GSpawnFlags)spawn_flags,
-                                                             (GSpawnChildSetupFunc)pty_child_setup_cb,
-                                                             this,
-                                                             child_pid,
-                                                             nullptr, nullptr, nullptr,
-                                                             timeout,
-                                                             cancellable ? &pollfd : nullptr,
-                                                             err);
+                ret = spawn_in(nullptr);
         }
 
         g_strfreev (envp2);
@@ -21,6 +21,16 @@
 #include "debug.h"
 #include "reaper.hh"
 
+#include <cerrno>
+
+#include <sys/wait.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+#include <glib-unix.h>
+
 struct _VteReaper {
         GObject parent_instance;
 };
@@ -54,6 +64,158 @@ vte_reaper_child_watch_cb(GPid pid,
         g_spawn_close_pid (pid);
 }
 
+/* The exit statuses of the remote children reported before they were
+ * watched, and the remote children being watched. Only used on the main
+ * context, like the child watches.
+ */
+static GHashTable *remote_exited = nullptr; /* pid → RemoteExitStatus */
+static GHashTable *remote_watched = nullptr; /* pids */
+
+struct RemoteExited {
+        GPid pid;
+        int status;
+};
+
+struct RemoteExitStatus {
+        int status;
+        gint64 time; /* monotonic µs of the report */
+};
+
+/* The add_child() call for a remote child follows its spawn right away, so
+ * an exit status not claimed after this long is for a pid no one watches,
+ * and is dropped.
+ */
+static constexpr gint64 k_remote_exited_timeout = 60 * G_USEC_PER_SEC;
+
+static gboolean
+remote_exited_is_stale(gpointer key,
+                       gpointer value,
+                       gpointer now)
+{
+        auto const exit_status = reinterpret_cast<RemoteExitStatus const*>(value);
+        return *reinterpret_cast<gint64 const*>(now) - exit_status->time > k_remote_exited_timeout;
+}
+
+static gboolean
+vte_reaper_remote_exited_cb(RemoteExited *exited)
+{
+        auto reaper = vte_reaper_ref();
+        _vte_debug_print(VTE_DEBUG_SIGNALS,
+                         "Reaper emitting child-exited signal.\n");
+        g_signal_emit_by_name(reaper, "child-exited", exited->pid, exited->status);
+        g_object_unref(reaper);
+        return G_SOURCE_REMOVE;
+}
+
+/* Whether @pid is a child of ours, exited or not */
+static bool
+is_own_child(GPid pid)
+{
+        siginfo_t info;
+        return waitid(P_PID, pid, &info, WEXITED | WNOHANG | WNOWAIT) == 0 ||
+                errno != ECHILD;
+}
+
+/*
+ * vte_reaper_child_exited:
+ * @pid: the ID of a process which isn't our child
+ * @status: its exit status, as returned by waitpid()
+ *
+ * Reports the exit of a process spawned by the spawn helper. The
+ * child-exited signal is emitted for it once vte_reaper_add_child()
+ * was called for @pid, if that's not done yet.
+ */
+void
+vte_reaper_child_exited(GPid pid,
+                        int status)
+{
+        if (remote_watched != nullptr &&
+            g_hash_table_remove(remote_watched, GINT_TO_POINTER(pid))) {
+                auto exited = RemoteExited{pid, status};
+                vte_reaper_remote_exited_cb(&exited);
+                return;
+        }
+
+        auto now = g_get_monotonic_time();
+        if (remote_exited == nullptr)
+                remote_exited = g_hash_table_new_full(nullptr, nullptr, nullptr, g_free);
+        else
+                g_hash_table_foreach_remove(remote_exited, remote_exited_is_stale, &now);
+
+        auto exit_status = g_new(RemoteExitStatus, 1);
+        exit_status->status = status;
+        exit_status->time = now;
+        g_hash_table_insert(remote_exited, GINT_TO_POINTER(pid), exit_status);
+}
+
+#if defined(__linux__) && defined(SYS_pidfd_open)
+
+/* A child watched through its pidfd, which becomes readable once it exited.
+ * Unlike with g_child_watch_add(), there's no SIGCHLD handler checking every
+ * watched child whenever any child exits.
+ */
+struct PidfdWatch {
+        GPid pid;
+        int fd;
+        VteReaper *reaper;
+};
+
+static gboolean
+vte_reaper_pidfd_cb(int fd,
+                    GIOCondition condition,
+                    PidfdWatch *watch)
+{
+        int status;
+        pid_t pid;
+        do {
+                pid = waitpid(watch->pid, &status, WNOHANG);
+        } while (pid == -1 && errno == EINTR);
+
+        if (pid == 0)
+                return G_SOURCE_CONTINUE; /* spurious */
+
+        if (pid == -1) {
+                /* Reaped by someone else; as glib does then, report it as a successful exit */
+                _vte_debug_print(VTE_DEBUG_SIGNALS,
+                                 "Child %d was reaped already\n", watch->pid);
+                status = 0;
+        }
+
+        vte_reaper_child_watch_cb(watch->pid, status, watch->reaper);
+        return G_SOURCE_REMOVE;
+}
+
+static void
+vte_reaper_pidfd_watch_free(PidfdWatch *watch)
+{
+        close(watch->fd);
+        g_object_unref(watch->reaper);
+        g_free(watch);
+}
+
+static bool
+vte_reaper_add_pidfd_watch(GPid pid)
+{
+        /* pidfds are always close-on-exec */
+        auto const fd = int(syscall(SYS_pidfd_open, pid, 0));
+        if (fd == -1)
+                return false; /* e.g. ENOSYS before Linux 5.3 */
+
+        auto watch = g_new(PidfdWatch, 1);
+        watch->pid = pid;
+        watch->fd = fd;
+        watch->reaper = vte_reaper_ref();
+        g_unix_fd_add_full(G_PRIORITY_LOW,
+                           fd,
+                           G_IO_IN,
+                           (GUnixFDSourceFunc)vte_reaper_pidfd_cb,
+                           watch,
+                           (GDestroyNotify)vte_reaper_pidfd_watch_free);
+        return true;
+}
+
+#endif /* __linux__ && SYS_pidfd_open */
+
 /*
  * vte_reaper_add_child:
  * @pid: the ID of a child process which will be monitored
@@ -63,6 +225,41 @@ vte_reaper_child_watch_cb(GPid pid,
 void
 vte_reaper_add_child(GPid pid)
 {
+        /* The children spawned by the spawn helper aren't ours to wait for;
+         * the helper reports their exit, see vte_reaper_child_exited().
+         */
+        if (!is_own_child(pid)) {
+                auto exit_status = remote_exited != nullptr
+                        ? reinterpret_cast<RemoteExitStatus*>(g_hash_table_lookup(remote_exited, GINT_TO_POINTER(pid)))
+                        : nullptr;
+                if (exit_status != nullptr) {
+                        /* Emit asynchronously, as for our own children */
+                        auto exited = g_new(RemoteExited, 1);
+                        exited->pid = pid;
+                        exited->status = exit_status->status;
+                        g_hash_table_remove(remote_exited, GINT_TO_POINTER(pid));
+                        g_idle_add_full(G_PRIORITY_LOW,
+                                        (GSourceFunc)vte_reaper_remote_exited_cb,
+                                        exited,
+                                        g_free);
+                        return;
+                }
+
+                if (remote_watched == nullptr)
+                        remote_watched = g_hash_table_new(nullptr, nullptr);
+                g_hash_table_add(remote_watched, GINT_TO_POINTER(pid));
+                return;
+        }
+
+        /* A stale exit of a remote child that had this pid */
+        if (remote_exited != nullptr)
+                g_hash_table_remove(remote_exited, GINT_TO_POINTER(pid));
+
+#if defined(__linux__) && defined(SYS_pidfd_open)
+        if (vte_reaper_add_pidfd_watch(pid))
+                return;
+#endif
+
         g_child_watch_add_full(G_PRIORITY_LOW,
                                pid,
                                vte_reaper_child_watch_cb,
@@ -110,7 +307,7 @@ vte_reaper_class_init(VteReaperClass *klass)
          * @arg2: the status of the exited child, as returned by waitpid()
          *
          * Emitted when the #VteReaper object detects that a child of the
-         * current process has exited.
+         * current process, or one spawned by the spawn helper, has exited.
          */
         g_signal_new(g_intern_static_string("child-exited"),
                      G_OBJECT_CLASS_TYPE(klass),
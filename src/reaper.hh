@@ -28,3 +28,6 @@ typedef struct _VteReaper VteReaper;
 VteReaper *vte_reaper_ref(void);
 
 void vte_reaper_add_child(GPid pid);
+
+void vte_reaper_child_exited(GPid pid,
+                             int status);
@@ -21,6 +21,7 @@
 #include "vte/vteenums.h"
 #include "vte/vteregex.h"
 
+#include <algorithm>
 #include <cassert>
 
 namespace vte {
@@ -155,6 +156,96 @@ Regex::jited() const noexcept
         return r == 0 && s != 0;
 }
 
+/* Adds the bytes of the ASCII code unit @c and of whatever else it may
+ * match caselessly, for a superset; returns false for other code units.
+ */
+static bool
+add_code_unit_bytes(ByteSet& set,
+                    uint32_t c) noexcept
+{
+        /* NUL and controls turn up in the text differently than in the
+         * stream, if at all. */
+        if (c <= 0x20 || c >= 0x7f)
+                return false;
+
+        set.add(uint8_t(c));
+        if (g_ascii_isalpha(c)) {
+                set.add(uint8_t(g_ascii_tolower(c)));
+                set.add(uint8_t(g_ascii_toupper(c)));
+        }
+
+        /* U+212A KELVIN SIGN and U+017F LATIN SMALL LETTER LONG S fold to
+         * ASCII; one of their bytes is enough. */
+        if (c == 'k' || c == 'K')
+                set.add(0xaa);
+        else if (c == 's' || c == 'S')
+                set.add(0xbf);
+
+        return true;
+}
+
+/*
+ * Regex::required_bytes:
+ * @first: return location for a set of bytes
+ * @last: return location for a set of bytes
+ *
+ * Gets the code units PCRE2 found that any match must start with (or the
+ * set of them it may start with), and that any match must contain, as sets
+ * of the bytes the subject text must contain one of. A set is everything
+ * if there is no such code unit.
+ *
+ * Returns: %true iff either set is useful for skipping text
+ */
+bool
+Regex::required_bytes(ByteSet& first,
+                      ByteSet& last) const noexcept
+{
+        uint32_t type = ~0u, c = 0;
+        auto useful = false;
+
+        first = last = ByteSet::all();
+
+        if (pcre2_pattern_info_8(code(), PCRE2_INFO_FIRSTCODETYPE, &type) == 0 && type == 1 &&
+            pcre2_pattern_info_8(code(), PCRE2_INFO_FIRSTCODEUNIT, &c) == 0) {
+                auto set = ByteSet{};
+                if (add_code_unit_bytes(set, c)) {
+                        first = set;
+                        useful = true;
+                }
+        } else if (type == 0) {
+                /* PCRE2 may still know the code units a match can start with.
+                 * The bitmap already includes the other cases. */
+                uint8_t const* bitmap = nullptr;
+                if (pcre2_pattern_info_8(code(), PCRE2_INFO_FIRSTBITMAP, &bitmap) == 0 &&
+                    bitmap != nullptr) {
+                        auto set = ByteSet{};
+                        auto controls = false;
+                        for (auto i = 0; i < 256; i++) {
+                                if (!(bitmap[i / 8] & (1u << (i % 8))))
+                                        continue;
+                                set.add(uint8_t(i));
+                                if (i <= 0x20 || i == 0x7f)
+                                        controls = true;
+                        }
+                        if (!controls && !set.empty()) {
+                                first = set;
+                                useful = true;
+                        }
+                }
+        }
+
+        if (pcre2_pattern_info_8(code(), PCRE2_INFO_LASTCODETYPE, &type) == 0 && type == 1 &&
+            pcre2_pattern_info_8(code(), PCRE2_INFO_LASTCODEUNIT, &c) == 0) {
+                auto set = ByteSet{};
+                if (add_code_unit_bytes(set, c)) {
+                        last = set;
+                        useful = true;
+                }
+        }
+
+        return useful;
+}
+
 /*
  * Regex::has_compile_flags:
  * @flags:
@@ -231,5 +322,87 @@ Regex::substitute(std::string_view const& subject,
         return std::nullopt;
 }
 
+/* The JIT stack starts out at PCRE2's default size, and may grow by
+ * reallocating it with a bigger maximum, up to a limit. */
+static constexpr size_t const k_jit_stack_start = 32 * 1024;
+static constexpr size_t const k_jit_stack_first_max = 512 * 1024;
+static constexpr size_t const k_jit_stack_max = 16 * 1024 * 1024;
+
+MatchState::MatchState() noexcept
+        : m_context{pcre2_match_context_create_8(nullptr /* general context */)},
+          m_data{pcre2_match_data_create_8(256 /* should be plenty */, nullptr /* general context */)}
+{
+        pcre2_set_match_limit_8(m_context, 65536); /* should be plenty */
+        pcre2_set_recursion_limit_8(m_context, 64); /* should be plenty */
+
+        m_jit_stack = pcre2_jit_stack_create_8(k_jit_stack_start, k_jit_stack_first_max,
+                                               nullptr /* general context */);
+        if (m_jit_stack != nullptr) {
+                m_jit_stack_max = k_jit_stack_first_max;
+                pcre2_jit_stack_assign_8(m_context, nullptr, m_jit_stack);
+        }
+}
+
+MatchState::~MatchState() noexcept
+{
+        pcre2_match_context_free_8(m_context);
+        pcre2_match_data_free_8(m_data);
+        if (m_jit_stack != nullptr)
+                pcre2_jit_stack_free_8(m_jit_stack);
+}
+
+/* Returns: %true if the JIT stack could be made bigger */
+bool
+MatchState::grow_jit_stack() noexcept
+{
+        if (m_jit_stack == nullptr || m_jit_stack_max >= k_jit_stack_max)
+                return false;
+
+        auto const max = std::min(4 * m_jit_stack_max, k_jit_stack_max);
+        auto const stack = pcre2_jit_stack_create_8(k_jit_stack_start, max, nullptr /* general context */);
+        if (stack == nullptr)
+                return false;
+
+        pcre2_jit_stack_free_8(m_jit_stack);
+        m_jit_stack = stack;
+        m_jit_stack_max = max;
+        pcre2_jit_stack_assign_8(m_context, nullptr, m_jit_stack);
+        return true;
+}
+
+/*
+ * MatchState::match:
+ * @regex: the regex
+ * @subject: the text to match
+ * @length: its length
+ * @offset: where to start matching
+ * @options: the options for pcre2_match()
+ * @jit_match: whether to use pcre2_jit_match(), for a regex JITed for
+ *   the mode in @options
+ *
+ * Matches @regex like pcre2_match() does with the context and the data,
+ * and tries again with a bigger JIT stack when the JIT code ran out of it.
+ *
+ * Returns: the result of pcre2_match()
+ */
+int
+MatchState::match(Regex const* regex,
+                  char const* subject,
+                  size_t length,
+                  size_t offset,
+                  uint32_t options,
+                  bool jit_match) noexcept
+{
+        auto const match_fn = jit_match ? pcre2_jit_match_8 : pcre2_match_8;
+        for (;;) {
+                auto const r = match_fn(regex->code(),
+                                        (PCRE2_SPTR8)subject, length,
+                                        offset, options,
+                                        m_data, m_context);
+                if (r != PCRE2_ERROR_JIT_STACKLIMIT || !grow_jit_stack())
+                        return r;
+        }
+}
+
 } // namespace base
 } // namespace vte
@@ -23,6 +23,8 @@
 
 #include <glib.h>
 
+#include "textindex.hh"
+
 #include "vtepcre2.h"
 
 namespace vte {
@@ -72,6 +74,9 @@ public:
 
         bool jited() const noexcept;
 
+        bool required_bytes(ByteSet& first,
+                            ByteSet& last) const noexcept;
+
         std::optional<std::string> substitute(std::string_view const& subject,
                                               std::string_view const& replacement,
                                               uint32_t flags,
@@ -79,6 +84,39 @@ public:
 
 }; // class Regex
 
+/* A match context, with a JIT stack that grows as the regexes need it,
+ * and match data, for reusing with all the matching of some kind.
+ */
+class MatchState {
+public:
+        MatchState() noexcept;
+        ~MatchState() noexcept;
+
+        MatchState(MatchState const&) = delete;
+        MatchState(MatchState&&) = delete;
+        MatchState operator=(MatchState const&) = delete;
+        MatchState operator=(MatchState&&) = delete;
+
+        pcre2_match_context_8* context() const noexcept { return m_context; }
+        pcre2_match_data_8* data() const noexcept { return m_data; }
+        size_t const* ovector() const noexcept { return pcre2_get_ovector_pointer_8(m_data); }
+
+        int match(Regex const* regex,
+                  char const* subject,
+                  size_t length,
+                  size_t offset,
+                  uint32_t options,
+                  bool jit_match) noexcept;
+
+private:
+        pcre2_match_context_8* m_context{nullptr};
+        pcre2_match_data_8* m_data{nullptr};
+        pcre2_jit_stack_8* m_jit_stack{nullptr};
+        size_t m_jit_stack_max{0};
+
+        bool grow_jit_stack() noexcept;
+}; // class MatchState
+
 } // namespace base
 
 } // namespace vte
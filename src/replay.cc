@@ -0,0 +1,402 @@
+/*
+ * Copyright © 2026 The VTE developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * vte-replay: feeds a recorded byte stream through the full terminal
+ * emulation (sequence handlers, screen, ring and scrollback streams) of
+ * a headless, never realized VteTerminal, and reports where the time
+ * went.
+ *
+ * The decoder and the parser are run on their own first, so that their
+ * cost can be told apart from that of the emulation, which interleaves
+ * them per character.
+ */
+
+#include "config.h"
+
+#include <glib.h>
+#include <gtk/gtk.h>
+#include <locale.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#include <vte/vte.h>
+
+#include "bench.hh"
+#include "debug.h"
+#include "glib-glue.hh"
+#include "parser.hh"
+#include "parser-glue.hh"
+#include "profile.hh"
+#include "utf8.hh"
+
+using Profile = vte::base::Profile;
+
+class Options {
+private:
+        bool m_json{false};
+        int m_chunk_size{4096};
+        int m_columns{80};
+        int m_repeat{1};
+        int m_rows{24};
+        int m_scrollback{10000};
+        char** m_filenames{nullptr};
+
+        template<typename T1, typename T2 = T1>
+        class OptionArg {
+        private:
+                T1* m_return_ptr;
+                T2 m_value;
+        public:
+                OptionArg(T1* ptr, T2 v) : m_return_ptr{ptr}, m_value{v} { }
+                ~OptionArg() { *m_return_ptr = m_value; }
+
+                inline constexpr T2* ptr() noexcept { return &m_value; }
+        };
+
+        using BoolArg = OptionArg<bool, gboolean>;
+        using IntArg = OptionArg<int>;
+        using StrvArg = OptionArg<char**>;
+
+public:
+
+        Options() noexcept = default;
+        Options(Options const&) = delete;
+        Options(Options&&) = delete;
+
+        ~Options() {
+                if (m_filenames != nullptr)
+                        g_strfreev(m_filenames);
+        }
+
+        Options& operator=(Options const&) = delete;
+        Options& operator=(Options&&) = delete;
+
+        inline constexpr bool json()       const noexcept { return m_json;       }
+        inline constexpr int  chunk_size() const noexcept { return m_chunk_size; }
+        inline constexpr int  columns()    const noexcept { return m_columns;    }
+        inline constexpr int  repeat()     const noexcept { return m_repeat;     }
+        inline constexpr int  rows()       const noexcept { return m_rows;       }
+        inline constexpr int  scrollback() const noexcept { return m_scrollback; }
+        inline constexpr char const* const* filenames() const noexcept { return m_filenames; }
+
+        bool parse(int argc,
+                   char* argv[],
+                   GError** error) noexcept
+        {
+                {
+                        auto json = BoolArg{&m_json, false};
+                        auto chunk_size = IntArg{&m_chunk_size, 4096};
+                        auto columns = IntArg{&m_columns, 80};
+                        auto repeat = IntArg{&m_repeat, 1};
+                        auto rows = IntArg{&m_rows, 24};
+                        auto scrollback = IntArg{&m_scrollback, 10000};
+                        auto filenames = StrvArg{&m_filenames, nullptr};
+                        GOptionEntry const entries[] = {
+                                { "chunk-size", 'c', 0, G_OPTION_ARG_INT, chunk_size.ptr(),
+                                  "Feed the input in chunks of SIZE bytes", "SIZE" },
+                                { "columns", 0, 0, G_OPTION_ARG_INT, columns.ptr(),
+                                  "Terminal width", "COLUMNS" },
+                                { "json", 'j', 0, G_OPTION_ARG_NONE, json.ptr(),
+                                  "Output the results as JSON", nullptr },
+                                { "repeat", 'r', 0, G_OPTION_ARG_INT, repeat.ptr(),
+                                  "Repeat each file COUNT times", "COUNT" },
+                                { "rows", 0, 0, G_OPTION_ARG_INT, rows.ptr(),
+                                  "Terminal height", "ROWS" },
+                                { "scrollback", 's', 0, G_OPTION_ARG_INT, scrollback.ptr(),
+                                  "Scrollback lines", "LINES" },
+                                { G_OPTION_REMAINING, 0, 0, G_OPTION_ARG_FILENAME_ARRAY, filenames.ptr(),
+                                  nullptr, nullptr },
+                                { nullptr },
+                        };
+
+                        auto context = g_option_context_new("FILE… — replay terminal output");
+                        g_option_context_set_help_enabled(context, true);
+                        g_option_context_add_main_entries(context, entries, nullptr);
+
+                        auto rv = bool{g_option_context_parse(context, &argc, &argv, error) != false};
+                        g_option_context_free(context);
+                        if (!rv)
+                                return rv;
+                }
+
+                if (m_filenames == nullptr) {
+                        g_set_error_literal(error, G_OPTION_ERROR, G_OPTION_ERROR_FAILED,
+                                            "No input files");
+                        return false;
+                }
+                if (m_chunk_size < 1 || m_columns < 1 || m_rows < 1 || m_repeat < 1) {
+                        g_set_error_literal(error, G_OPTION_ERROR, G_OPTION_ERROR_BAD_VALUE,
+                                            "Sizes and counts must be positive");
+                        return false;
+                }
+
+                return true;
+        }
+}; // class Options
+
+/* Times, in ns, of one replay. The emulation ones are exclusive of
+ * the stages nested in them; see Profile.
+ */
+class Result {
+public:
+        int64_t decode{0};
+        int64_t parse{0};
+        int64_t emulation{0}; /* the whole feed, including all stages below */
+        int64_t handler{0};
+        int64_t ring_freeze{0};
+        int64_t stream_compress{0};
+        size_t bytes{0};
+        size_t characters{0};
+        size_t sequences{0};
+
+        void add(Result const& other) noexcept
+        {
+                decode += other.decode;
+                parse += other.parse;
+                emulation += other.emulation;
+                handler += other.handler;
+                ring_freeze += other.ring_freeze;
+                stream_compress += other.stream_compress;
+                bytes += other.bytes;
+                characters += other.characters;
+                sequences += other.sequences;
+        }
+
+        /* Decoding and parsing as interleaved inside the emulation */
+        inline constexpr int64_t emulation_other() const noexcept
+        {
+                return emulation - handler - ring_freeze - stream_compress;
+        }
+};
+
+/* Decodes @data; returns the number of characters */
+static size_t
+replay_decode(uint8_t const* data,
+              size_t len)
+{
+        auto decoder = vte::base::UTF8Decoder{};
+        auto n_chars = size_t{0};
+
+        for (auto sptr = data; sptr < data + len; ++sptr) {
+                switch (decoder.decode(*sptr)) {
+                case vte::base::UTF8Decoder::REJECT_REWIND:
+                        --sptr;
+                        [[fallthrough]];
+                case vte::base::UTF8Decoder::REJECT:
+                        decoder.reset();
+                        [[fallthrough]];
+                case vte::base::UTF8Decoder::ACCEPT:
+                        ++n_chars;
+                        break;
+                default:
+                        break;
+                }
+        }
+
+        return n_chars;
+}
+
+/* Decodes and parses @data; returns the number of sequences */
+static size_t
+replay_parse(uint8_t const* data,
+             size_t len)
+{
+        auto decoder = vte::base::UTF8Decoder{};
+        auto parser = vte::parser::Parser{};
+        auto n_seqs = size_t{0};
+
+        for (auto sptr = data; sptr < data + len; ++sptr) {
+                switch (decoder.decode(*sptr)) {
+                case vte::base::UTF8Decoder::REJECT_REWIND:
+                        --sptr;
+                        [[fallthrough]];
+                case vte::base::UTF8Decoder::REJECT:
+                        decoder.reset();
+                        [[fallthrough]];
+                case vte::base::UTF8Decoder::ACCEPT:
+                        if (parser.feed(decoder.codepoint()) > VTE_SEQ_NONE)
+                                ++n_seqs;
+                        break;
+                default:
+                        break;
+                }
+        }
+
+        return n_seqs;
+}
+
+static Result
+replay(Options const& options,
+       uint8_t const* data,
+       size_t len)
+{
+        auto result = Result{};
+        result.bytes = len;
+
+        auto start = Profile::now();
+        result.characters = replay_decode(data, len);
+        result.decode = Profile::now() - start;
+
+        start = Profile::now();
+        result.sequences = replay_parse(data, len);
+        result.parse = std::max(Profile::now() - start - result.decode, int64_t{0});
+
+        auto terminal = VTE_TERMINAL(g_object_ref_sink(vte_terminal_new()));
+        vte_terminal_set_headless(terminal, true);
+        vte_terminal_set_size(terminal, options.columns(), options.rows());
+        vte_terminal_set_scrollback_lines(terminal, options.scrollback());
+
+        Profile::reset();
+        Profile::set_enabled(true);
+
+        start = Profile::now();
+        for (auto offset = size_t{0}; offset < len; offset += options.chunk_size()) {
+                auto const n = std::min(len - offset, size_t(options.chunk_size()));
+                vte_terminal_feed(terminal, reinterpret_cast<char const*>(data + offset), n);
+        }
+        result.emulation = Profile::now() - start;
+
+        Profile::set_enabled(false);
+
+        auto const handler = Profile::elapsed(Profile::Stage::eHandler);
+        auto const ring_freeze = Profile::elapsed(Profile::Stage::eRingFreeze);
+        auto const stream_compress = Profile::elapsed(Profile::Stage::eStreamCompress);
+        result.stream_compress = stream_compress;
+        result.ring_freeze = ring_freeze - stream_compress;
+        result.handler = handler - ring_freeze;
+
+        g_object_unref(terminal);
+
+        return result;
+}
+
+static void
+print_result(char const* filename,
+             Result const& result,
+             int repeat)
+{
+        auto const total = result.decode + result.parse + result.emulation;
+        auto const print_stage = [&](char const* name,
+                                     int64_t ns) {
+                g_print("  %-20s %\'12" G_GINT64_FORMAT "µs %6.2f%%\n",
+                        name, ns / 1000 / repeat, total > 0 ? 100. * double(ns) / double(total) : 0.);
+        };
+
+        g_print("%s: %\'" G_GSIZE_FORMAT " bytes, %\'" G_GSIZE_FORMAT " characters, "
+                "%\'" G_GSIZE_FORMAT " sequences, average of %d runs\n",
+                filename, result.bytes / repeat, result.characters / repeat,
+                result.sequences / repeat, repeat);
+        print_stage("decode", result.decode);
+        print_stage("parse", result.parse);
+        print_stage("decode+parse inline", result.emulation_other());
+        print_stage("handlers", result.handler);
+        print_stage("ring freeze", result.ring_freeze);
+        print_stage("stream compression", result.stream_compress);
+        g_print("  %-20s %\'12" G_GINT64_FORMAT "µs %.2f MB/s\n",
+                "emulation",
+                result.emulation / 1000 / repeat,
+                result.emulation > 0 ? double(result.bytes) * 1000. / double(result.emulation) : 0.);
+}
+
+static void
+append_json_result(std::string& str,
+                   char const* filename,
+                   Result const& result,
+                   int repeat)
+{
+        str.append("{\"file\":");
+        vte::base::Benchmark::append_json_string(str, filename);
+        vte::base::Benchmark::append_format(str,
+                                            ",\"runs\":%d,\"bytes\":%" G_GSIZE_FORMAT
+                                            ",\"characters\":%" G_GSIZE_FORMAT
+                                            ",\"sequences\":%" G_GSIZE_FORMAT,
+                                            repeat, result.bytes / repeat,
+                                            result.characters / repeat, result.sequences / repeat);
+
+        auto const append_stage = [&](char const* name,
+                                      int64_t ns) {
+                vte::base::Benchmark::append_format(str, ",\"%s_us\":%" G_GINT64_FORMAT,
+                                                    name, ns / 1000 / repeat);
+        };
+        append_stage("decode", result.decode);
+        append_stage("parse", result.parse);
+        append_stage("inline", result.emulation_other());
+        append_stage("handler", result.handler);
+        append_stage("ring_freeze", result.ring_freeze);
+        append_stage("stream_compress", result.stream_compress);
+        append_stage("emulation", result.emulation);
+        str.push_back('}');
+}
+
+int
+main(int argc,
+     char* argv[])
+{
+        setlocale(LC_ALL, "");
+        _vte_debug_init();
+
+        auto options = Options{};
+        auto error = vte::glib::Error{};
+        if (!options.parse(argc, argv, error)) {
+                g_printerr("Failed to parse arguments: %s\n", error.message());
+                return EXIT_FAILURE;
+        }
+
+        /* The terminal is never realized, but GTK still needs a display */
+        if (!gtk_init_check(nullptr, nullptr)) {
+                g_printerr("Failed to initialise GTK\n");
+                return EXIT_FAILURE;
+        }
+
+        auto json = std::string{"["};
+        auto rv = EXIT_SUCCESS;
+        auto const filenames = options.filenames();
+        for (auto i = 0; filenames[i] != nullptr; ++i) {
+                gchar* contents = nullptr;
+                gsize len = 0;
+                if (!g_file_get_contents(filenames[i], &contents, &len, error)) {
+                        g_printerr("Error reading %s: %s\n", filenames[i], error.message());
+                        error.reset();
+                        rv = EXIT_FAILURE;
+                        continue;
+                }
+
+                auto sum = Result{};
+                for (auto r = 0; r < options.repeat(); ++r)
+                        sum.add(replay(options, reinterpret_cast<uint8_t const*>(contents), len));
+                g_free(contents);
+
+                if (options.json()) {
+                        if (json.size() > 1)
+                                json.push_back(',');
+                        append_json_result(json, filenames[i], sum, options.repeat());
+                } else {
+                        print_result(filenames[i], sum, options.repeat());
+                }
+        }
+
+        if (options.json()) {
+                json.append("]\n");
+                g_print("%s", json.c_str());
+        }
+
+        return rv;
+}
@@ -0,0 +1,366 @@
+/*
+ * Copyright © 2026 The VTE developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * ring-bench: times the Ring operations, appending rows with and without
+ * freezing them to the streams, thawing them back, clearing full screens
+ * into the history, and rewrapping to other widths, and the VteRowData
+ * operations the screen does on single rows, over rows of ASCII, CJK,
+ * emoji, and ASCII with an SGR change on every cell.
+ */
+
+#include "config.h"
+
+#include <glib.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <locale.h>
+#include <string>
+
+#include "bench.hh"
+#include "debug.h"
+#include "ring.hh"
+#include "vterowdata.hh"
+
+using Ring = vte::base::Ring;
+
+enum class Content {
+        eASCII,
+        eCJK,
+        eEmoji,
+        eSGR,
+};
+
+static char const* const content_names[] = {
+        "ascii",
+        "cjk",
+        "emoji",
+        "sgr",
+};
+
+/* Fills @row with @columns cells of @content; every third row continues
+ * on the next one, so that rewrapping has paragraphs to join.
+ *
+ * Returns: the size of the row's text in UTF-8
+ */
+static size_t
+fill_row(VteRowData* row,
+         Content content,
+         Ring::row_t position,
+         Ring::column_t columns)
+{
+        auto bytes = size_t{0};
+        auto cell = basic_cell;
+
+        for (auto col = Ring::column_t{0}; col < columns; ++col) {
+                auto const i = unsigned(position * columns + col);
+
+                switch (content) {
+                case Content::eASCII:
+                case Content::eSGR:
+                        cell.c = (i % 8) == 7 ? ' ' : 'a' + (i % 26);
+                        cell.attr.set_columns(1);
+                        break;
+                case Content::eCJK:
+                case Content::eEmoji:
+                        /* The wide characters leave the last column empty on odd widths */
+                        if (col + 1 == columns) {
+                                cell.c = ' ';
+                                cell.attr.set_columns(1);
+                                cell.attr.set_fragment(false);
+                                break;
+                        }
+                        cell.c = content == Content::eCJK ? 0x4e00 + (i % 2048) : 0x1f600 + (i % 80);
+                        cell.attr.set_columns(2);
+                        cell.attr.set_fragment(false);
+                        _vte_row_data_append(row, &cell);
+                        cell.attr.set_fragment(true);
+                        ++col;
+                        bytes += content == Content::eCJK ? 3 : 4;
+                        break;
+                }
+
+                if (content == Content::eSGR) {
+                        cell.attr.set_fore(i % 256);
+                        cell.attr.set_bold((i & 1) != 0);
+                        cell.attr.set_underline((i % 3) == 0 ? 1 : 0);
+                }
+
+                _vte_row_data_append(row, &cell);
+                if (!cell.attr.fragment())
+                        ++bytes;
+        }
+
+        row->attr.soft_wrapped = (position % 3) != 2;
+
+        return bytes;
+}
+
+/* Returns: the size of the text appended */
+static size_t
+fill_ring(Ring& ring,
+          Content content,
+          Ring::row_t n_rows,
+          Ring::column_t columns)
+{
+        auto bytes = size_t{0};
+        for (auto r = Ring::row_t{0}; r < n_rows; ++r)
+                bytes += fill_row(ring.append(0), content, r, columns);
+
+        return bytes;
+}
+
+class Bench {
+public:
+        Bench(int repeat,
+              Ring::row_t n_rows,
+              Ring::column_t columns,
+              bool json) noexcept
+                : m_repeat{repeat},
+                  m_n_rows{n_rows},
+                  m_columns{columns},
+                  m_json{json}
+        {
+        }
+
+        void run_all()
+        {
+                for (auto content : {Content::eASCII, Content::eCJK, Content::eEmoji, Content::eSGR}) {
+                        bench_append(content);
+                        bench_append_freeze_thaw(content);
+                        bench_clear(content);
+                        for (auto columns : {40, 132, 200})
+                                bench_rewrap(content, columns);
+                        bench_row_data(content);
+                }
+        }
+
+        void print_json() const
+        {
+                g_print("[%s]\n", m_json_str.c_str());
+        }
+
+private:
+        int m_repeat;
+        Ring::row_t m_n_rows;
+        Ring::column_t m_columns;
+        bool m_json;
+        std::string m_json_str{};
+
+        void report(Content content,
+                    char const* op,
+                    vte::base::Benchmark const& benchmark)
+        {
+                if (!m_json) {
+                        g_printerr("\n%s %s:", content_names[int(content)], op);
+                        benchmark.print();
+                        return;
+                }
+
+                if (!m_json_str.empty())
+                        m_json_str.push_back(',');
+                m_json_str.append("{\"content\":");
+                vte::base::Benchmark::append_json_string(m_json_str, content_names[int(content)]);
+                m_json_str.append(",\"op\":");
+                vte::base::Benchmark::append_json_string(m_json_str, op);
+                vte::base::Benchmark::append_format(m_json_str,
+                                                    ",\"rows\":%lu,\"columns\":%ld,\"result\":",
+                                                    m_n_rows, m_columns);
+                benchmark.append_json(m_json_str);
+                m_json_str.push_back('}');
+        }
+
+        /* Appending to the writable rows only, as on the alternate screen */
+        void bench_append(Content content)
+        {
+                vte::base::Benchmark append{"rows"};
+
+                for (auto r = 0; r < m_repeat; ++r) {
+                        auto ring = Ring{m_n_rows, false};
+                        ring.set_visible_rows(m_n_rows);
+
+                        auto const start = g_get_monotonic_time();
+                        auto const bytes = fill_ring(ring, content, m_n_rows, m_columns);
+                        append.add(g_get_monotonic_time() - start, bytes, m_n_rows);
+                }
+
+                report(content, "append", append);
+        }
+
+        /* Appending with the rows scrolling out to the streams, and reading
+         * them back from the bottom up as scrolling back through the
+         * history does */
+        void bench_append_freeze_thaw(Content content)
+        {
+                vte::base::Benchmark append{"rows"}, thaw{"rows"};
+
+                for (auto r = 0; r < m_repeat; ++r) {
+                        auto ring = Ring{m_n_rows, true};
+                        ring.set_visible_rows(24);
+
+                        auto start = g_get_monotonic_time();
+                        auto const bytes = fill_ring(ring, content, m_n_rows, m_columns);
+                        append.add(g_get_monotonic_time() - start, bytes, m_n_rows);
+
+                        auto const n_thawed = ring.n_rows_thawed();
+                        start = g_get_monotonic_time();
+                        for (auto pos = ring.next(); pos-- > ring.delta(); )
+                                ring.index(pos);
+                        thaw.add(g_get_monotonic_time() - start, bytes, ring.n_rows_thawed() - n_thawed);
+                }
+
+                report(content, "append-freeze", append);
+                report(content, "thaw", thaw);
+        }
+
+        /* Clearing full screens of @content, which pushes them into the
+         * history at once */
+        void bench_clear(Content content)
+        {
+                vte::base::Benchmark clear{"rows"};
+                auto const visible_rows = Ring::row_t{24};
+
+                for (auto r = 0; r < m_repeat; ++r) {
+                        auto ring = Ring{m_n_rows, true};
+                        ring.set_visible_rows(visible_rows);
+                        ring.append_rows(visible_rows, 0);
+
+                        auto bytes = size_t{0};
+                        auto n = Ring::row_t{0};
+                        auto const start = g_get_monotonic_time();
+                        for (; n + visible_rows <= m_n_rows; n += visible_rows) {
+                                for (auto i = Ring::row_t{0}; i < visible_rows; ++i)
+                                        bytes += fill_row(ring.index_writable(ring.next() - visible_rows + i),
+                                                          content, n + i, m_columns);
+                                ring.append_rows(visible_rows, 0);
+                        }
+                        clear.add(g_get_monotonic_time() - start, bytes, n);
+                }
+
+                report(content, "clear", clear);
+        }
+
+        void bench_rewrap(Content content,
+                          Ring::column_t columns)
+        {
+                vte::base::Benchmark rewrap{"rows"};
+                VteVisualPosition* markers[] = {nullptr};
+
+                for (auto r = 0; r < m_repeat; ++r) {
+                        auto ring = Ring{m_n_rows, true};
+                        ring.set_visible_rows(24);
+                        auto const bytes = fill_ring(ring, content, m_n_rows, m_columns);
+
+                        auto const start = g_get_monotonic_time();
+                        ring.rewrap(columns, markers);
+                        while (!ring.rewrap_step(G_MAXULONG))
+                                ;
+                        ring.rewrap_finish(markers);
+                        rewrap.add(g_get_monotonic_time() - start, bytes, m_n_rows);
+                }
+
+                auto const op = std::string{"rewrap-"} + std::to_string(columns);
+                report(content, op.c_str(), rewrap);
+        }
+
+        /* The row operations of inserting and deleting characters, erasing
+         * and copying, on a row of @content */
+        void bench_row_data(Content content)
+        {
+                        vte::base::Benchmark row_data{"operations"};
+                auto const n_ops_per_row = 5 * 16 + 2;
+
+                VteRowData src, dst;
+                _vte_row_data_init(&src);
+                _vte_row_data_init(&dst);
+                fill_row(&src, content, 0, m_columns);
+                auto const len = _vte_row_data_length(&src);
+
+                for (auto r = 0; r < m_repeat; ++r) {
+                        auto const start = g_get_monotonic_time();
+                        for (auto i = Ring::row_t{0}; i < m_n_rows; ++i) {
+                                _vte_row_data_copy(&src, &dst);
+                                for (auto j = 0; j < 16; ++j) {
+                                        _vte_row_data_insert(&dst, j, &basic_cell);
+                                        _vte_row_data_remove(&dst, len);
+                                        _vte_row_data_remove(&dst, j);
+                                        _vte_row_data_append(&dst, &basic_cell);
+                                        _vte_row_data_fill_range(&dst, &basic_cell, j, j + 16);
+                                }
+                                _vte_row_data_shrink(&dst, len / 2);
+                        }
+                        row_data.add(g_get_monotonic_time() - start,
+                                     m_n_rows * n_ops_per_row * len * sizeof(VteCell),
+                                     m_n_rows * n_ops_per_row);
+                }
+
+                _vte_row_data_fini(&src);
+                _vte_row_data_fini(&dst);
+
+                report(content, "row-data", row_data);
+        }
+};
+
+int
+main(int argc,
+     char *argv[])
+{
+        setlocale(LC_ALL, "");
+        _vte_debug_init();
+
+        auto repeat = 10;
+        auto rows = 10000;
+        auto columns = 80;
+        gboolean json = false;
+        GOptionEntry const entries[] = {
+                { "columns", 'c', 0, G_OPTION_ARG_INT, &columns,
+                  "Fill the rows with COLUMNS cells", "COLUMNS" },
+                { "json", 'j', 0, G_OPTION_ARG_NONE, &json,
+                  "Output the results as JSON", nullptr },
+                { "repeat", 'r', 0, G_OPTION_ARG_INT, &repeat,
+                  "Repeat each measurement COUNT times", "COUNT" },
+                { "rows", 0, 0, G_OPTION_ARG_INT, &rows,
+                  "Append ROWS rows per measurement", "ROWS" },
+                { nullptr },
+        };
+
+        auto context = g_option_context_new("— ring and row data benchmark");
+        g_option_context_set_help_enabled(context, true);
+        g_option_context_add_main_entries(context, entries, nullptr);
+
+        GError* error = nullptr;
+        auto const rv = g_option_context_parse(context, &argc, &argv, &error);
+        g_option_context_free(context);
+        if (!rv) {
+                g_printerr("Failed to parse arguments: %s\n", error->message);
+                g_error_free(error);
+                return EXIT_FAILURE;
+        }
+
+        if (rows < 100 || columns < 40 || columns > 1024) {
+                g_printerr("Need at least 100 rows and 40 to 1024 columns\n");
+                return EXIT_FAILURE;
+        }
+
+        auto bench = Bench{std::max(repeat, 1), Ring::row_t(rows), columns, json != false};
+        bench.run_all();
+        if (json)
+                bench.print_json();
+
+        return EXIT_SUCCESS;
+}
@@ -21,16 +21,26 @@
 #include "config.h"
 
 #include "debug.h"
+#include "profile.hh"
 #include "ring.hh"
+#include "trace.hh"
 #include "vterowdata.hh"
 
 #include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <utility>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 /*
  * Copy the common attributes from VteCellAttr to VteStreamCellAttr or vice versa.
  */
 static inline void
-_attrcpy (void *dst, void *src)
+_attrcpy (void *dst, void const *src)
 {
         memcpy(dst, src, VTE_CELL_ATTR_COMMON_BYTES);
 }
@@ -68,29 +78,42 @@ Ring::Ring(row_t max_rows,
 {
 	_vte_debug_print(VTE_DEBUG_RING, "New ring %p.\n", this);
 
+        s_rings.push_back(this);
+
 	m_array = (VteRowData* ) g_malloc0 (sizeof (m_array[0]) * (m_mask + 1));
 
 	if (has_streams) {
-		m_attr_stream = _vte_file_stream_new ();
-		m_text_stream = _vte_file_stream_new ();
-		m_row_stream = _vte_file_stream_new ();
+                m_streams_in_memory = streams_fit_in_memory();
+		m_attr_stream = new_stream(true);
+		m_text_stream = new_stream(true);
+		m_row_stream = new_stream(false);
 	} else {
 		m_attr_stream = m_text_stream = m_row_stream = nullptr;
 	}
 
 	m_utf8_buffer = g_string_sized_new (128);
+	m_attr_buffer = g_string_sized_new (128);
+	m_record_buffer = g_string_sized_new (128);
 
-	_vte_row_data_init (&m_cached_row);
+        resize_cached_rows(VTE_RING_CACHED_ROWS_MIN);
 
         m_hyperlinks = g_ptr_array_new();
         auto empty_str = g_string_new_len("", 0);
         g_ptr_array_add(m_hyperlinks, empty_str);
+        m_hyperlink_index = g_hash_table_new(g_str_hash, g_str_equal);
 
 	validate();
 }
 
 Ring::~Ring()
 {
+        s_rings.erase(std::find(s_rings.begin(), s_rings.end(), this));
+
+        for (auto e : m_exports)
+                e->m_ring = nullptr;
+
+        rewrap_cancel();
+
 	for (size_t i = 0; i <= m_mask; i++)
 		_vte_row_data_fini (&m_array[i]);
 
@@ -103,12 +126,17 @@ Ring::~Ring()
 	}
 
 	g_string_free (m_utf8_buffer, TRUE);
+	g_string_free (m_attr_buffer, TRUE);
+	g_string_free (m_record_buffer, TRUE);
 
+        g_hash_table_destroy (m_hyperlink_index);
         for (size_t i = 0; i < m_hyperlinks->len; i++)
                 g_string_free (hyperlink_get(i), TRUE);
         g_ptr_array_free (m_hyperlinks, TRUE);
 
-	_vte_row_data_fini(&m_cached_row);
+        for (row_t i = 0; i <= m_cached_rows_mask; i++)
+                _vte_row_data_fini(&m_cached_rows[i].row);
+        g_free(m_cached_rows);
 }
 
 #define SET_BIT(buf, n) buf[(n) / 8] |= (1 << ((n) % 8))
@@ -130,6 +158,7 @@ Ring::hyperlink_gc()
                           m_hyperlink_highest_used_idx);
 
         m_hyperlink_maybe_gc_counter = 0;
+        m_hyperlink_n_new = 0;
 
         if (m_hyperlink_highest_used_idx == 0) {
                 _vte_debug_print (VTE_DEBUG_HYPERLINK,
@@ -143,24 +172,28 @@ Ring::hyperlink_gc()
         /* A few special values not to be garbage collected. */
         SET_BIT(used, m_hyperlink_current_idx);
         SET_BIT(used, m_hyperlink_hover_idx);
-        SET_BIT(used, m_last_attr.hyperlink_idx);
+        SET_BIT(used, m_last_hyperlink_idx);
 
         for (i = m_writable; i < m_end; i++) {
                 row = get_writable_index(i);
-                for (j = 0; j < row->len; j++) {
-                        idx = row->cells[j].attr.hyperlink_idx;
+                for (j = 0; j < row->n_hyperlinks; j++) {
+                        idx = row->hyperlinks[j].idx;
                         SET_BIT(used, idx);
                 }
         }
 
+        m_hyperlink_n_live = 0;
         for (idx = 1; idx <= m_hyperlink_highest_used_idx; idx++) {
                 if (!GET_BIT(used, idx) && hyperlink_get(idx)->len != 0) {
                         _vte_debug_print (VTE_DEBUG_HYPERLINK,
                                           "hyperlink: GC purging link %d to id;uri=\"%s\"\n",
                                           idx, hyperlink_get(idx)->str);
+                        g_hash_table_remove (m_hyperlink_index, hyperlink_get(idx)->str);
                         /* Wipe out the ID and URI itself so it doesn't linger on in the memory for a long time */
                         memset(hyperlink_get(idx)->str, 0, hyperlink_get(idx)->len);
                         g_string_truncate (hyperlink_get(idx), 0);
+                } else if (hyperlink_get(idx)->len != 0) {
+                        m_hyperlink_n_live++;
                 }
         }
 
@@ -168,6 +201,13 @@ Ring::hyperlink_gc()
                m_hyperlink_highest_used_idx--;
         }
 
+        /* Hand out the lowest empty idxs first */
+        m_hyperlink_free_idxs.clear();
+        for (idx = m_hyperlinks->len - 1; idx >= 1; idx--) {
+                if (hyperlink_get(idx)->len == 0)
+                        m_hyperlink_free_idxs.push_back(idx);
+        }
+
         _vte_debug_print (VTE_DEBUG_HYPERLINK,
                           "hyperlink: GC done (highest used idx is now %d)\n",
                           m_hyperlink_highest_used_idx);
@@ -191,6 +231,81 @@ Ring::hyperlink_maybe_gc(row_t increment)
                 hyperlink_gc();
 }
 
+/*
+ * Mark the combining sequences in the writable rows (and the cached thawed rows)
+ * as used, for the vteunistr GC. The frozen rows only store UTF-8.
+ */
+void
+Ring::unistr_mark() const
+{
+        for (auto i = m_writable; i < m_end; i++) {
+                auto row = get_writable_index(i);
+                for (row_t j = 0; j < _vte_row_data_stored_length(row); j++)
+                        _vte_unistr_gc_mark(row->cells[j].c);
+        }
+
+        for (row_t i = 0; i <= m_cached_rows_mask; i++) {
+                auto const cached = &m_cached_rows[i];
+                if (cached->num == (row_t)-1)
+                        continue;
+                for (row_t j = 0; j < _vte_row_data_stored_length(&cached->row); j++)
+                        _vte_unistr_gc_mark(cached->row.cells[j].c);
+        }
+}
+
+/*
+ * Ring::resize_cached_rows:
+ * @n_rows: the number of thawed rows to keep at least
+ *
+ * Resizes the table of thawed rows to the next power of two, dropping
+ * its contents.
+ */
+void
+Ring::resize_cached_rows(row_t n_rows)
+{
+        row_t mask = 1;
+        while (mask < n_rows)
+                mask <<= 1;
+        mask--;
+
+        if (m_cached_rows != nullptr && mask == m_cached_rows_mask)
+                return;
+
+        for (row_t i = 0; m_cached_rows != nullptr && i <= m_cached_rows_mask; i++)
+                _vte_row_data_fini(&m_cached_rows[i].row);
+        g_free(m_cached_rows);
+
+        m_cached_rows = g_new0(CachedRow, mask + 1);
+        m_cached_rows_mask = mask;
+        invalidate_cached_rows();
+}
+
+void
+Ring::invalidate_cached_rows()
+{
+        for (row_t i = 0; i <= m_cached_rows_mask; i++)
+                m_cached_rows[i].num = (row_t)-1;
+}
+
+/*
+ * Do a round of vteunistr garbage collection across all rings, if enough new
+ * combining sequences were made since the last one.
+ */
+void
+Ring::unistr_maybe_gc()
+{
+        if (!_vte_unistr_gc_wanted())
+                return;
+
+        _vte_unistr_gc_begin();
+        for (auto ring : s_rings)
+                ring->unistr_mark();
+        auto n_freed = _vte_unistr_gc_end();
+
+        _vte_debug_print (VTE_DEBUG_RING,
+                          "unistr: GC done, %u sequences freed\n", n_freed);
+}
+
 /*
  * Find existing idx for the hyperlink or allocate a new one.
  *
@@ -198,7 +313,8 @@ Ring::hyperlink_maybe_gc(row_t increment)
  * Returns the idx (either already existing or newly allocated) from 1 up to
  * VTE_HYPERLINK_COUNT_MAX inclusive otherwise.
  *
- * FIXME do something more effective than a linear search
+ * This doesn't do a round of GC unless the pool is full, so that it is safe
+ * to call while building a row.
  */
 Ring::hyperlink_idx_t
 Ring::get_hyperlink_idx_no_update_current(char const* hyperlink)
@@ -210,55 +326,56 @@ Ring::get_hyperlink_idx_no_update_current(char const* hyperlink)
         if (!hyperlink || !hyperlink[0])
                 return 0;
 
+        gpointer value;
+        if (g_hash_table_lookup_extended(m_hyperlink_index, hyperlink, nullptr, &value)) {
+                idx = GPOINTER_TO_UINT(value);
+                _vte_debug_print (VTE_DEBUG_HYPERLINK,
+                                  "get_hyperlink_idx: already existing idx %d for id;uri=\"%s\"\n",
+                                  idx, hyperlink);
+                return idx;
+        }
+
         len = strlen(hyperlink);
 
-        /* Linear search for this particular URI */
-        auto const last_idx = m_hyperlink_highest_used_idx + 1;
-        for (idx = 1; idx < last_idx; ++idx) {
-                if (strcmp(hyperlink_get(idx)->str, hyperlink) == 0) {
-                        _vte_debug_print (VTE_DEBUG_HYPERLINK,
-                                          "get_hyperlink_idx: already existing idx %d for id;uri=\"%s\"\n",
-                                          idx, hyperlink);
-                        return idx;
-                }
-        }
+        /* VTE_HYPERLINK_COUNT_MAX should be big enough for this not to happen under
+           normal circumstances. Anyway, it's cheap to protect against extreme ones. */
+        if (m_hyperlink_free_idxs.empty() && m_hyperlink_highest_used_idx == VTE_HYPERLINK_COUNT_MAX)
+                hyperlink_gc();
 
-        /* FIXME it's the second time we're GCing if coming from get_hyperlink_idx */
-        hyperlink_gc();
+        if (!m_hyperlink_free_idxs.empty()) {
+                /* Reuse an empty slot where a GString is already allocated */
+                idx = m_hyperlink_free_idxs.back();
+                m_hyperlink_free_idxs.pop_back();
+                _vte_debug_print (VTE_DEBUG_HYPERLINK,
+                                  "get_hyperlink_idx: reassigning old idx %d for id;uri=\"%s\"\n",
+                                  idx, hyperlink);
+                /* Grow size if required, however, never shrink to avoid long-term memory fragmentation. */
+                str = hyperlink_get(idx);
+                g_string_append_len (str, hyperlink, len);
+                m_hyperlink_highest_used_idx = MAX (m_hyperlink_highest_used_idx, idx);
+        } else {
+                /* All allocated slots are in use. Gotta allocate a new one */
+                g_assert_cmpuint(m_hyperlink_highest_used_idx + 1, ==, m_hyperlinks->len);
 
-        /* Another linear search for an empty slot where a GString is already allocated */
-        for (idx = 1; idx < m_hyperlinks->len; idx++) {
-                if (hyperlink_get(idx)->len == 0) {
+                if (m_hyperlink_highest_used_idx == VTE_HYPERLINK_COUNT_MAX) {
                         _vte_debug_print (VTE_DEBUG_HYPERLINK,
-                                          "get_hyperlink_idx: reassigning old idx %d for id;uri=\"%s\"\n",
-                                          idx, hyperlink);
-                        /* Grow size if required, however, never shrink to avoid long-term memory fragmentation. */
-                        g_string_append_len (hyperlink_get(idx), hyperlink, len);
-                        m_hyperlink_highest_used_idx = MAX (m_hyperlink_highest_used_idx, idx);
-                        return idx;
+                                          "get_hyperlink_idx: idx 0 (ran out of available idxs) for id;uri=\"%s\"\n",
+                                          hyperlink);
+                        return 0;
                 }
-        }
 
-        /* All allocated slots are in use. Gotta allocate a new one */
-        g_assert_cmpuint(m_hyperlink_highest_used_idx + 1, ==, m_hyperlinks->len);
-
-        /* VTE_HYPERLINK_COUNT_MAX should be big enough for this not to happen under
-           normal circumstances. Anyway, it's cheap to protect against extreme ones. */
-        if (m_hyperlink_highest_used_idx == VTE_HYPERLINK_COUNT_MAX) {
+                idx = ++m_hyperlink_highest_used_idx;
                 _vte_debug_print (VTE_DEBUG_HYPERLINK,
-                                  "get_hyperlink_idx: idx 0 (ran out of available idxs) for id;uri=\"%s\"\n",
-                                  hyperlink);
-                return 0;
-        }
+                                  "get_hyperlink_idx: brand new idx %d for id;uri=\"%s\"\n",
+                                  idx, hyperlink);
+                str = g_string_new_len (hyperlink, len);
+                g_ptr_array_add(m_hyperlinks, str);
 
-        idx = ++m_hyperlink_highest_used_idx;
-        _vte_debug_print (VTE_DEBUG_HYPERLINK,
-                          "get_hyperlink_idx: brand new idx %d for id;uri=\"%s\"\n",
-                          idx, hyperlink);
-        str = g_string_new_len (hyperlink, len);
-        g_ptr_array_add(m_hyperlinks, str);
+                g_assert_cmpuint(m_hyperlink_highest_used_idx + 1, ==, m_hyperlinks->len);
+        }
 
-        g_assert_cmpuint(m_hyperlink_highest_used_idx + 1, ==, m_hyperlinks->len);
+        g_hash_table_insert(m_hyperlink_index, str->str, GUINT_TO_POINTER(idx));
+        m_hyperlink_n_new++;
 
         return idx;
 }
@@ -275,40 +392,394 @@ Ring::get_hyperlink_idx_no_update_current(char const* hyperlink)
 Ring::hyperlink_idx_t
 Ring::get_hyperlink_idx(char const* hyperlink)
 {
-        /* Release current idx and do a round of GC to possibly purge its hyperlink,
+        /* Release current idx, and do a round of GC if enough new idxs were
+         * handed out since the last one, to possibly purge its hyperlink,
          * even if new hyperlink is nullptr or empty. */
         m_hyperlink_current_idx = 0;
-        hyperlink_gc();
+        if (m_hyperlink_n_new >= MAX(m_hyperlink_n_live, VTE_HYPERLINK_GC_MIN_NEW))
+                hyperlink_gc();
 
         m_hyperlink_current_idx = get_hyperlink_idx_no_update_current(hyperlink);
         return m_hyperlink_current_idx;
 }
 
-void
+/*
+ * Returns: the length of @row without the erased cells at its end, if it is
+ * hard wrapped. Those read back the same as no cells at all, so they aren't
+ * stored; on a soft wrapped row they're part of the line and are kept.
+ */
+static inline int
+frozen_length(VteRowData const* row)
+{
+        int len = row->len;
+        if (!row->attr.soft_wrapped) {
+                if (row->n_cells < len) {
+                        if (memcmp(&row->cells[row->n_cells], &basic_cell, sizeof (basic_cell)) != 0)
+                                return len;
+                        len = row->n_cells;
+                }
+                while (len > 0 && memcmp(&row->cells[len - 1], &basic_cell, sizeof (basic_cell)) == 0)
+                        len--;
+        }
+        return len;
+}
+
+/*
+ * Copies the printable ASCII characters from the start of @cells, up to
+ * @len of them, to @out, as long as their attributes equal @attr.
+ *
+ * Returns: the number of cells copied
+ */
+static int
+copy_ascii_run(VteCell const* cells,
+               int len,
+               VteCellAttr const* attr,
+               char* out)
+{
+        int i = 0;
+
+#if defined(__SSE2__)
+        static_assert(sizeof(VteCell) == 16 && offsetof(VteCell, attr) == 4, "unexpected cell layout");
+
+        /* Four cells at a time, a cell in each register: compare their
+         * attributes, that is all but the first 4 bytes, and range check
+         * and narrow their characters together. The characters are below
+         * 2^31, so signed comparison works. */
+        VteCell ref_cell;
+        ref_cell.c = 0;
+        ref_cell.attr = *attr;
+        auto const ref = _mm_loadu_si128(reinterpret_cast<__m128i const*>(&ref_cell));
+        auto const lo = _mm_set1_epi32(31);
+        auto const hi = _mm_set1_epi32(127);
+        for (; len - i >= 4; i += 4) {
+                auto const cell = reinterpret_cast<__m128i const*>(cells + i);
+                auto const c0 = _mm_loadu_si128(cell + 0);
+                auto const c1 = _mm_loadu_si128(cell + 1);
+                auto const c2 = _mm_loadu_si128(cell + 2);
+                auto const c3 = _mm_loadu_si128(cell + 3);
+                auto const same = _mm_and_si128(_mm_and_si128(_mm_cmpeq_epi8(c0, ref), _mm_cmpeq_epi8(c1, ref)),
+                                                _mm_and_si128(_mm_cmpeq_epi8(c2, ref), _mm_cmpeq_epi8(c3, ref)));
+                auto const c = _mm_unpacklo_epi64(_mm_unpacklo_epi32(c0, c1), _mm_unpacklo_epi32(c2, c3));
+                auto const printable = _mm_and_si128(_mm_cmpgt_epi32(c, lo), _mm_cmplt_epi32(c, hi));
+                if ((_mm_movemask_epi8(same) & 0xfff0) != 0xfff0 ||
+                    _mm_movemask_epi8(printable) != 0xffff)
+                        break; /* find the exact position below */
+
+                auto const narrow = _mm_packs_epi32(c, c);
+                auto const bytes = _mm_cvtsi128_si32(_mm_packus_epi16(narrow, narrow));
+                memcpy(out + i, &bytes, 4);
+        }
+#endif
+
+        for (; i < len; i++) {
+                if (cells[i].c < 32 || cells[i].c > 126 ||
+                    memcmp(attr, &cells[i].attr, sizeof (VteCellAttr)) != 0)
+                        break;
+                out[i] = cells[i].c;
+        }
+
+        return i;
+}
+
+/* The flags of an attr_stream entry, see the Storage comment in ring.hh */
+#define VTE_ATTR_CHANGE_HAS_ATTR        (1u << 0)
+#define VTE_ATTR_CHANGE_HAS_FORE        (1u << 1)
+#define VTE_ATTR_CHANGE_HAS_BACK        (1u << 2)
+#define VTE_ATTR_CHANGE_HAS_DECO        (1u << 3)
+#define VTE_ATTR_CHANGE_HAS_HYPERLINK   (1u << 4)
+
+/* The longest entry up to its hyperlink data: the lengths and the flags,
+ * a 64 bit and four 32 bit varints, and the hyperlink's length */
+#define VTE_ATTR_CHANGE_MAX_HEADER      (2 + 10 + 4 * 5 + 2)
+
+static inline char*
+varint_encode(char* p,
+              guint64 value)
+{
+        while (value >= 0x80) {
+                *p++ = char(value | 0x80);
+                value >>= 7;
+        }
+        *p++ = char(value);
+        return p;
+}
+
+/* Returns: the position after the varint at @p, or nullptr if it doesn't end before @end */
+static inline char const*
+varint_decode(char const* p,
+              char const* end,
+              guint64* value)
+{
+        *value = 0;
+        for (unsigned shift = 0; p < end && shift < 64; shift += 7) {
+                auto const byte = guint8(*p++);
+                *value |= guint64(byte & 0x7f) << shift;
+                if (!(byte & 0x80))
+                        return p;
+        }
+        return nullptr;
+}
+
+/*
+ * Appends @attr_change with @hyperlink to @buffer, as an attr_stream entry.
+ *
+ * Returns: the length of the entry
+ */
+size_t
+Ring::append_attr_change(GString* buffer,
+                         CellAttrChange const& attr_change,
+                         GString const* hyperlink)
+{
+        char header[VTE_ATTR_CHANGE_MAX_HEADER];
+        auto const colors = attr_change.attr.colors;
+        auto const fore = vte_color_triple_get_fore(colors);
+        auto const back = vte_color_triple_get_back(colors);
+        auto const deco = vte_color_triple_get_deco(colors);
+        guint8 flags = 0;
+
+        auto p = header + 2;
+        p = varint_encode(p, attr_change.text_end_offset);
+        if (attr_change.attr.attr != basic_cell.attr.attr) {
+                flags |= VTE_ATTR_CHANGE_HAS_ATTR;
+                p = varint_encode(p, attr_change.attr.attr);
+        }
+        if (fore != vte_color_triple_get_fore(basic_cell.attr.colors())) {
+                flags |= VTE_ATTR_CHANGE_HAS_FORE;
+                p = varint_encode(p, fore);
+        }
+        if (back != vte_color_triple_get_back(basic_cell.attr.colors())) {
+                flags |= VTE_ATTR_CHANGE_HAS_BACK;
+                p = varint_encode(p, back);
+        }
+        if (deco != vte_color_triple_get_deco(basic_cell.attr.colors())) {
+                flags |= VTE_ATTR_CHANGE_HAS_DECO;
+                p = varint_encode(p, deco);
+        }
+        if (G_UNLIKELY (hyperlink->len != 0)) {
+                flags |= VTE_ATTR_CHANGE_HAS_HYPERLINK;
+                p = varint_encode(p, hyperlink->len);
+        }
+        header[0] = char(p - header);
+        header[1] = char(flags);
+
+        auto const body_len = size_t(p - header) + hyperlink->len;
+        g_string_append_len (buffer, header, p - header);
+        g_string_append_len (buffer, hyperlink->str, hyperlink->len);
+        if (body_len + 1 < 0x80) {
+                g_string_append_c (buffer, char(body_len + 1));
+                return body_len + 1;
+        }
+
+        auto const len = body_len + 2;
+        char trailer[2] = { char(len & 0xff), char(0x80 | (len >> 8)) };
+        g_string_append_len (buffer, trailer, 2);
+        return len;
+}
+
+/*
+ * Decodes the attr_stream entry at @data into @attr_change, reading at most
+ * @len bytes, and leaving its hyperlink's length in attr_change->attr.
+ *
+ * Returns: the length of the entry up to its hyperlink data, or 0 if it
+ *   is corrupt or doesn't fit in @len
+ */
+size_t
+Ring::decode_attr_change(char const* data,
+                         size_t len,
+                         CellAttrChange* attr_change)
+{
+        guint64 value;
+
+        if (len < 3 || guint8(data[0]) < 3 || guint8(data[0]) > len)
+                return 0;
+        auto const end = data + guint8(data[0]);
+        auto const flags = guint8(data[1]);
+        auto p = data + 2;
+
+        if (!(p = varint_decode(p, end, &value)))
+                return 0;
+        attr_change->text_end_offset = value;
+
+        attr_change->attr.attr = basic_cell.attr.attr;
+        if (flags & VTE_ATTR_CHANGE_HAS_ATTR) {
+                if (!(p = varint_decode(p, end, &value)) || value > G_MAXUINT32)
+                        return 0;
+                attr_change->attr.attr = value;
+        }
+
+        auto colors = basic_cell.attr.colors();
+        if (flags & VTE_ATTR_CHANGE_HAS_FORE) {
+                if (!(p = varint_decode(p, end, &value)) || value > VTE_COLOR_TRIPLE_RGB_MASK(8, 8, 8))
+                        return 0;
+                vte_color_triple_set_fore(&colors, value);
+        }
+        if (flags & VTE_ATTR_CHANGE_HAS_BACK) {
+                if (!(p = varint_decode(p, end, &value)) || value > VTE_COLOR_TRIPLE_RGB_MASK(8, 8, 8))
+                        return 0;
+                vte_color_triple_set_back(&colors, value);
+        }
+        if (flags & VTE_ATTR_CHANGE_HAS_DECO) {
+                if (!(p = varint_decode(p, end, &value)) || value > VTE_COLOR_TRIPLE_RGB_MASK(4, 5, 4))
+                        return 0;
+                vte_color_triple_set_deco(&colors, value);
+        }
+        attr_change->attr.colors = colors;
+
+        attr_change->attr.hyperlink_length = 0;
+        if (flags & VTE_ATTR_CHANGE_HAS_HYPERLINK) {
+                if (!(p = varint_decode(p, end, &value)) || value > VTE_HYPERLINK_TOTAL_LENGTH_MAX)
+                        return 0;
+                attr_change->attr.hyperlink_length = value;
+        }
+
+        return p == end ? p - data : 0;
+}
+
+/* Returns: the length of the trailer of an entry of @body_len bytes before it */
+static inline size_t
+attr_change_trailer_length(size_t body_len)
+{
+        return body_len + 1 < 0x80 ? 1 : 2;
+}
+
+/*
+ * Reads the attr_stream entry at @offset of @stream into @attr_change, and
+ * its hyperlink, NUL terminated, into @hyperlink if not %nullptr.
+ *
+ * Returns: the length of the entry, or 0 if it couldn't be read
+ */
+size_t
+Ring::read_attr_change(VteStream* stream,
+                       size_t offset,
+                       CellAttrChange* attr_change,
+                       char* hyperlink)
+{
+        char header[VTE_ATTR_CHANGE_MAX_HEADER];
+
+        /* Read no further than the entry, which may end a block of the stream */
+        if (!_vte_stream_read(stream, offset, header, 1) ||
+            guint8(header[0]) > sizeof(header) ||
+            guint8(header[0]) < 3 ||
+            offset + guint8(header[0]) > _vte_stream_head(stream) ||
+            !_vte_stream_read(stream, offset, header, guint8(header[0])))
+                return 0;
+
+        auto const header_len = decode_attr_change(header, guint8(header[0]), attr_change);
+        if (header_len == 0)
+                return 0;
+
+        auto const hyperlink_length = attr_change->attr.hyperlink_length;
+        if (hyperlink) {
+                if (hyperlink_length && !_vte_stream_read(stream, offset + header_len, hyperlink, hyperlink_length))
+                        return 0;
+                hyperlink[hyperlink_length] = '\0';
+        }
+
+        auto const body_len = header_len + hyperlink_length;
+        return body_len + attr_change_trailer_length(body_len);
+}
+
+/*
+ * Reads the attr_stream entry of @stream ending at @offset, like
+ * read_attr_change().
+ *
+ * Returns: the length of the entry, or 0 if there is none
+ */
+size_t
+Ring::read_attr_change_before(VteStream* stream,
+                              size_t offset,
+                              CellAttrChange* attr_change,
+                              char* hyperlink)
+{
+        guint8 trailer[2];
+        size_t len;
+
+        /* Any entry is at least 3 bytes long */
+        if (offset < 2 || !_vte_stream_read(stream, offset - 2, (char*) trailer, 2))
+                return 0;
+        if (trailer[1] & 0x80)
+                len = size_t(trailer[1] & 0x7f) << 8 | trailer[0];
+        else
+                len = trailer[1];
+
+        if (len > offset ||
+            read_attr_change(stream, offset - len, attr_change, hyperlink) != len)
+                return 0;
+        return len;
+}
+
+/*
+ * Appends the frozen row to m_utf8_buffer, m_attr_buffer and m_record_buffer,
+ * whose contents go to the end of the streams at @text_base and @attr_base.
+ *
+ * Returns: whether the row contained hyperlinks
+ */
+bool
 Ring::freeze_row(row_t position,
-                 VteRowData const* row)
+                 VteRowData const* row,
+                 size_t text_base,
+                 size_t attr_base)
 {
-	VteCell *cell;
+	const VteCell *cell;
 	GString *buffer = m_utf8_buffer;
+	GString *attr_buffer = m_attr_buffer;
         GString *hyperlink;
-	int i;
-        gboolean froze_hyperlink = FALSE;
+	int i, len, fast_len;
+        bool froze_hyperlink = false;
+        char *p;
+        VteCellHyperlink const* link = row->hyperlinks;
+        VteCellHyperlink const* link_end = link + row->n_hyperlinks;
 
 	_vte_debug_print (VTE_DEBUG_RING, "Freezing row %lu.\n", position);
 
-        g_assert(m_has_streams);
+        m_n_rows_frozen++;
 
 	RowRecord record;
 	memset(&record, 0, sizeof(record));
-	record.text_start_offset = _vte_stream_head(m_text_stream);
-	record.attr_start_offset = _vte_stream_head(m_attr_stream);
+	record.text_start_offset = text_base + buffer->len;
+	record.attr_start_offset = attr_base + attr_buffer->len;
 	record.is_ascii = 1;
 
-	g_string_set_size (buffer, 0);
-	for (i = 0, cell = row->cells; i < row->len; i++, cell++) {
+        len = frozen_length(row);
+
+        /* A row just like the last one frozen the slow way, after the same
+         * attributes, freezes to the same bytes */
+        if (G_UNLIKELY (size_t(len) == m_frozen_row_memo.cells.size() && len != 0) &&
+            freeze_row_again(row, len, text_base, attr_base))
+                return false;
+
+        auto const start_attr = m_last_attr;
+        auto const start_hyperlink_idx = m_last_hyperlink_idx;
+        auto const attr_start = attr_buffer->len;
+        auto remember = false;
+
+        /* Fast path: ASCII characters using the attributes of the previous
+         * character only need copying, and are usually all of the row.
+         * Hyperlinks are rare, stop at their first change. */
+        if (G_LIKELY (row->n_hyperlinks == 0))
+                fast_len = m_last_hyperlink_idx == 0 ? len : 0;
+        else if (row->hyperlinks[0].idx == m_last_hyperlink_idx && row->hyperlinks[0].start == 0)
+                fast_len = MIN(len, row->hyperlinks[0].end);
+        else
+                fast_len = m_last_hyperlink_idx == 0 ? MIN(len, row->hyperlinks[0].start) : 0;
+        fast_len = MIN(fast_len, row->n_cells);
+        g_string_set_size (buffer, buffer->len + fast_len);
+        p = buffer->str + buffer->len - fast_len;
+        i = copy_ascii_run(row->cells, fast_len, &m_last_attr, p);
+        g_string_truncate (buffer, p + i - buffer->str);
+
+        /* Worth remembering if it takes the slow path below */
+        if (i < len && len <= row->n_cells && row->n_hyperlinks == 0 && start_hyperlink_idx == 0)
+                remember = true;
+
+	for (; i < len; i++) {
 		VteCellAttr attr;
+                hyperlink_idx_t hyperlink_idx;
 		int num_chars;
 
+                /* Past the stored cells, the filled tail's cell */
+                cell = _vte_row_data_get(row, i);
+
 		/* Attr storage:
 		 *
 		 * 1. We don't store attrs for fragments.  They can be
@@ -323,46 +794,43 @@ Ring::freeze_row(row_t position,
 		attr = cell->attr;
 		if (G_LIKELY (!attr.fragment())) {
 			CellAttrChange attr_change;
-                        guint16 hyperlink_length;
+                        size_t attr_change_len;
 
-			if (memcmp(&m_last_attr, &attr, sizeof (VteCellAttr)) != 0) {
-				m_last_attr_text_start_offset = record.text_start_offset + buffer->len;
+                        while (link < link_end && link->end <= i)
+                                link++;
+                        hyperlink_idx = link < link_end && link->start <= i ? link->idx : 0;
+
+			if (memcmp(&m_last_attr, &attr, sizeof (VteCellAttr)) != 0 ||
+                            m_last_hyperlink_idx != hyperlink_idx) {
+				m_last_attr_text_start_offset = text_base + buffer->len;
 				memset(&attr_change, 0, sizeof (attr_change));
 				attr_change.text_end_offset = m_last_attr_text_start_offset;
                                 _attrcpy(&attr_change.attr, &m_last_attr);
-                                hyperlink = hyperlink_get(m_last_attr.hyperlink_idx);
-                                attr_change.attr.hyperlink_length = hyperlink->len;
-				_vte_stream_append (m_attr_stream, (char const* ) &attr_change, sizeof (attr_change));
-                                if (G_UNLIKELY (hyperlink->len != 0)) {
-                                        _vte_stream_append (m_attr_stream, hyperlink->str, hyperlink->len);
-                                        froze_hyperlink = TRUE;
-                                }
-                                hyperlink_length = attr_change.attr.hyperlink_length;
-                                _vte_stream_append (m_attr_stream, (char const* ) &hyperlink_length, 2);
-				if (!buffer->len)
+                                hyperlink = hyperlink_get(m_last_hyperlink_idx);
+                                attr_change_len = append_attr_change(attr_buffer, attr_change, hyperlink);
+                                if (G_UNLIKELY (hyperlink->len != 0))
+                                        froze_hyperlink = true;
+				if (text_base + buffer->len == record.text_start_offset)
 					/* This row doesn't use last_attr, adjust */
-                                        record.attr_start_offset += sizeof (attr_change) + hyperlink_length + 2;
+                                        record.attr_start_offset += attr_change_len;
 				m_last_attr = attr;
+                                m_last_hyperlink_idx = hyperlink_idx;
 			}
 
 			num_chars = _vte_unistr_strlen (cell->c);
 			if (num_chars > 1) {
+                                remember = false;
                                 /* Combining chars */
 				attr.set_columns(0);
-				m_last_attr_text_start_offset = record.text_start_offset + buffer->len
+				m_last_attr_text_start_offset = text_base + buffer->len
 								  + g_unichar_to_utf8 (_vte_unistr_get_base (cell->c), nullptr);
 				memset(&attr_change, 0, sizeof (attr_change));
 				attr_change.text_end_offset = m_last_attr_text_start_offset;
                                 _attrcpy(&attr_change.attr, &m_last_attr);
-                                hyperlink = hyperlink_get(m_last_attr.hyperlink_idx);
-                                attr_change.attr.hyperlink_length = hyperlink->len;
-				_vte_stream_append (m_attr_stream, (char const* ) &attr_change, sizeof (attr_change));
-                                if (G_UNLIKELY (hyperlink->len != 0)) {
-                                        _vte_stream_append (m_attr_stream, hyperlink->str, hyperlink->len);
-                                        froze_hyperlink = TRUE;
-                                }
-                                hyperlink_length = attr_change.attr.hyperlink_length;
-                                _vte_stream_append (m_attr_stream, (char const* ) &hyperlink_length, 2);
+                                hyperlink = hyperlink_get(m_last_hyperlink_idx);
+                                append_attr_change(attr_buffer, attr_change, hyperlink);
+                                if (G_UNLIKELY (hyperlink->len != 0))
+                                        froze_hyperlink = true;
 				m_last_attr = attr;
 			}
 
@@ -375,12 +843,140 @@ Ring::freeze_row(row_t position,
 	record.soft_wrapped = row->attr.soft_wrapped;
         record.bidi_flags = row->attr.bidi_flags;
 
-	_vte_stream_append(m_text_stream, buffer->str, buffer->len);
-	append_row_record(&record, position);
+	g_string_append_len (m_record_buffer, (char const* ) &record, sizeof (record));
+
+        if (remember)
+                remember_frozen_row(row, len, record, start_attr,
+                                    text_base, attr_base, attr_start);
+
+        return froze_hyperlink;
+}
+
+/*
+ * Remembers how freeze_row() froze @row, the first @len cells of it, after
+ * @start_attr, to the buffers from @text_start and @attr_start on, for
+ * freeze_row_again().
+ */
+void
+Ring::remember_frozen_row(VteRowData const* row,
+                          int len,
+                          RowRecord const& record,
+                          VteCellAttr const& start_attr,
+                          size_t text_base,
+                          size_t attr_base,
+                          size_t attr_start)
+{
+        auto& memo = m_frozen_row_memo;
+        auto const text_start = record.text_start_offset - text_base;
+
+        memo.cells.assign(row->cells, row->cells + len);
+        memo.start_attr = start_attr;
+        memo.end_attr = m_last_attr;
+        memo.text.assign(m_utf8_buffer->str + text_start, m_utf8_buffer->len - text_start);
+        memo.record = record;
+        memo.skips_first_attr_change = record.attr_start_offset != attr_base + attr_start;
+        /* Set in the row, or left as it was before */
+        memo.sets_last_attr_text_start_offset = m_last_attr_text_start_offset >= record.text_start_offset;
+        if (memo.sets_last_attr_text_start_offset)
+                memo.last_attr_text_start_offset = m_last_attr_text_start_offset - record.text_start_offset;
+
+        memo.attr_changes.clear();
+        for (auto offset = attr_start; offset < m_attr_buffer->len; ) {
+                CellAttrChange attr_change;
+                auto const header_len = decode_attr_change(m_attr_buffer->str + offset,
+                                                           m_attr_buffer->len - offset,
+                                                           &attr_change);
+                g_assert(header_len != 0 && attr_change.attr.hyperlink_length == 0);
+                attr_change.text_end_offset -= record.text_start_offset;
+                memo.attr_changes.push_back(attr_change);
+                offset += header_len + attr_change_trailer_length(header_len);
+        }
+}
+
+/*
+ * Freezes @row like freeze_row() if it is just like the row remembered by
+ * remember_frozen_row(), after the same attributes.
+ *
+ * Returns: whether it did
+ */
+bool
+Ring::freeze_row_again(VteRowData const* row,
+                       int len,
+                       size_t text_base,
+                       size_t attr_base)
+{
+        auto const& memo = m_frozen_row_memo;
+
+        if (row->n_hyperlinks != 0 ||
+            m_last_hyperlink_idx != 0 ||
+            row->attr.soft_wrapped != memo.record.soft_wrapped ||
+            row->attr.bidi_flags != memo.record.bidi_flags ||
+            memcmp(&m_last_attr, &memo.start_attr, sizeof (VteCellAttr)) != 0 ||
+            len > row->n_cells ||
+            memcmp(row->cells, memo.cells.data(), len * sizeof (VteCell)) != 0)
+                return false;
+
+        auto record = memo.record;
+        record.text_start_offset = text_base + m_utf8_buffer->len;
+        record.attr_start_offset = attr_base + m_attr_buffer->len;
+
+        auto const empty = hyperlink_get(0);
+        auto first = true;
+        for (auto attr_change : memo.attr_changes) {
+                attr_change.text_end_offset += record.text_start_offset;
+                auto const attr_change_len = append_attr_change(m_attr_buffer, attr_change, empty);
+                if (first && memo.skips_first_attr_change)
+                        record.attr_start_offset += attr_change_len;
+                first = false;
+        }
+
+        g_string_append_len (m_utf8_buffer, memo.text.data(), memo.text.size());
+        m_last_attr = memo.end_attr;
+        if (memo.sets_last_attr_text_start_offset)
+                m_last_attr_text_start_offset = record.text_start_offset + memo.last_attr_text_start_offset;
+
+	g_string_append_len (m_record_buffer, (char const* ) &record, sizeof (record));
+        return true;
+}
+
+/*
+ * Freezes the next @n writable rows, appending to each stream only once.
+ */
+void
+Ring::freeze_rows(row_t n)
+{
+        row_t end = m_writable + n;
+        row_t n_hyperlink_rows = 0;
+
+        vte::base::Profile::Scope profile_scope{vte::base::Profile::Stage::eRingFreeze};
+        vte::base::Trace::Scope trace_scope{"ring-freeze"};
+        trace_scope.set_count(n, "rows");
+
+        g_assert(m_has_streams);
+        g_assert_cmpuint(end, <=, m_end);
+
+	if (G_UNLIKELY (m_writable == m_start))
+		reset_streams(m_writable);
+
+        auto const text_base = _vte_stream_head(m_text_stream);
+        auto const attr_base = _vte_stream_head(m_attr_stream);
+	g_string_set_size (m_utf8_buffer, 0);
+	g_string_set_size (m_attr_buffer, 0);
+	g_string_set_size (m_record_buffer, 0);
+
+        for (; m_writable < end; m_writable++) {
+                if (freeze_row(m_writable, get_writable_index(m_writable), text_base, attr_base))
+                        n_hyperlink_rows++;
+        }
+
+	m_text_index.add(text_base, m_utf8_buffer->str, m_utf8_buffer->len);
+	_vte_stream_append (m_text_stream, m_utf8_buffer->str, m_utf8_buffer->len);
+	_vte_stream_append (m_attr_stream, m_attr_buffer->str, m_attr_buffer->len);
+	_vte_stream_append (m_row_stream, m_record_buffer->str, m_record_buffer->len);
 
         /* After freezing some hyperlinks, do a hyperlink GC. The constant is totally arbitrary, feel free to fine tune. */
-        if (froze_hyperlink)
-                hyperlink_maybe_gc(1024);
+        if (n_hyperlink_rows != 0)
+                hyperlink_maybe_gc(1024 * n_hyperlink_rows);
 }
 
 /* If do_truncate (data is placed back from the stream to the ring), real new hyperlink idxs are looked up or allocated.
@@ -396,8 +992,11 @@ Ring::thaw_row(row_t position,
                int hyperlink_column,
                char const** hyperlink)
 {
+        vte::base::Trace::Scope trace_scope{"ring-thaw"};
+
 	RowRecord records[2], record;
 	VteCellAttr attr;
+        hyperlink_idx_t hyperlink_idx = 0;
 	CellAttrChange attr_change;
 	VteCell cell;
 	char const* p, *q, *end;
@@ -414,6 +1013,8 @@ Ring::thaw_row(row_t position,
 
         g_assert(m_has_streams);
 
+        m_n_rows_thawed++;
+
 	_vte_row_data_clear (row);
 
 	attr_change.text_end_offset = 0;
@@ -443,32 +1044,27 @@ Ring::thaw_row(row_t position,
 	while (p < end) {
 		if (record.text_start_offset >= m_last_attr_text_start_offset) {
 			attr = m_last_attr;
-                        strcpy(hyperlink_readbuf, hyperlink_get(attr.hyperlink_idx)->str);
+                        hyperlink_idx = m_last_hyperlink_idx;
+                        strcpy(hyperlink_readbuf, hyperlink_get(hyperlink_idx)->str);
 		} else {
 			if (record.text_start_offset >= attr_change.text_end_offset) {
-				if (!_vte_stream_read (m_attr_stream, record.attr_start_offset, (char *) &attr_change, sizeof (attr_change)))
+                                auto const attr_change_len = read_attr_change(m_attr_stream, record.attr_start_offset, &attr_change, hyperlink_readbuf);
+				if (attr_change_len == 0)
 					return;
-				record.attr_start_offset += sizeof (attr_change);
-                                g_assert_cmpuint (attr_change.attr.hyperlink_length, <=, VTE_HYPERLINK_TOTAL_LENGTH_MAX);
-                                if (attr_change.attr.hyperlink_length && !_vte_stream_read (m_attr_stream, record.attr_start_offset, hyperlink_readbuf, attr_change.attr.hyperlink_length))
-                                        return;
-                                hyperlink_readbuf[attr_change.attr.hyperlink_length] = '\0';
-                                record.attr_start_offset += attr_change.attr.hyperlink_length + 2;
+				record.attr_start_offset += attr_change_len;
 
                                 _attrcpy(&attr, &attr_change.attr);
-                                attr.hyperlink_idx = 0;
+                                hyperlink_idx = 0;
                                 if (G_UNLIKELY (attr_change.attr.hyperlink_length)) {
                                         if (do_truncate) {
                                                 /* Find the existing idx or allocate a new one, just as when receiving an OSC 8 escape sequence.
                                                  * Do not update the current idx though. */
-                                                attr.hyperlink_idx = get_hyperlink_idx_no_update_current(hyperlink_readbuf);
+                                                hyperlink_idx = get_hyperlink_idx_no_update_current(hyperlink_readbuf);
                                         } else {
                                                 /* Use a special hyperlink idx, except if to be underlined because the hyperlink is the same as the hovered cell's. */
-                                                attr.hyperlink_idx = VTE_HYPERLINK_IDX_TARGET_IN_STREAM;
-                                                if (m_hyperlink_hover_idx != 0 && strcmp(hyperlink_readbuf, hyperlink_get(m_hyperlink_hover_idx)->str) == 0) {
-                                                        /* FIXME here we're calling the expensive strcmp() above and get_hyperlink_idx_no_update_current() way too many times. */
-                                                        attr.hyperlink_idx = get_hyperlink_idx_no_update_current(hyperlink_readbuf);
-                                                }
+                                                hyperlink_idx = VTE_HYPERLINK_IDX_TARGET_IN_STREAM;
+                                                if (m_hyperlink_hover_idx != 0 && strcmp(hyperlink_readbuf, hyperlink_get(m_hyperlink_hover_idx)->str) == 0)
+                                                        hyperlink_idx = m_hyperlink_hover_idx;
                                         }
                                 }
 			}
@@ -500,8 +1096,10 @@ Ring::thaw_row(row_t position,
                                 if (row->len == hyperlink_column && hyperlink != nullptr)
                                         *hyperlink = strcpy(m_hyperlink_buf, hyperlink_readbuf);
 				_vte_row_data_append (row, &cell);
+                                _vte_row_data_set_hyperlink (row, row->len - 1, row->len, hyperlink_idx);
 			}
 		} else {
+                        auto const start = row->len;
                         if (row->len == hyperlink_column && hyperlink != nullptr)
                                 *hyperlink = strcpy(m_hyperlink_buf, hyperlink_readbuf);
 			_vte_row_data_append (row, &cell);
@@ -516,55 +1114,62 @@ Ring::thaw_row(row_t position,
 					_vte_row_data_append (row, &cell);
                                 }
 			}
+                        _vte_row_data_set_hyperlink (row, start, row->len, hyperlink_idx);
 		}
 	}
 
-        /* FIXME this is extremely complicated (by design), figure out something better.
-           This is the only place where we need to walk backwards in attr_stream,
-           which is the reason for the hyperlink's length being repeated after the hyperlink itself. */
-	if (do_truncate) {
-		gsize attr_stream_truncate_at = records[0].attr_start_offset;
-		_vte_debug_print (VTE_DEBUG_RING, "Truncating\n");
-		if (records[0].text_start_offset <= m_last_attr_text_start_offset) {
-			/* Check the previous attr record. If its text ends where truncating, this attr record also needs to be removed. */
-                        guint16 hyperlink_length;
-                        if (_vte_stream_read (m_attr_stream, attr_stream_truncate_at - 2, (char *) &hyperlink_length, 2)) {
-                                g_assert_cmpuint (hyperlink_length, <=, VTE_HYPERLINK_TOTAL_LENGTH_MAX);
-                                if (_vte_stream_read (m_attr_stream, attr_stream_truncate_at - 2 - hyperlink_length - sizeof (attr_change), (char *) &attr_change, sizeof (attr_change))) {
-                                        if (records[0].text_start_offset == attr_change.text_end_offset) {
-                                                _vte_debug_print (VTE_DEBUG_RING, "... at attribute change\n");
-                                                attr_stream_truncate_at -= sizeof (attr_change) + hyperlink_length + 2;
-                                        }
-				}
-			}
-			/* Reconstruct last_attr from the first record of attr_stream that we cut off,
-			   last_attr_text_start_offset from the last record that we keep. */
-			if (_vte_stream_read (m_attr_stream, attr_stream_truncate_at, (char *) &attr_change, sizeof (attr_change))) {
-                                _attrcpy(&m_last_attr, &attr_change.attr);
-                                m_last_attr.hyperlink_idx = 0;
-                                if (attr_change.attr.hyperlink_length && _vte_stream_read (m_attr_stream, attr_stream_truncate_at + sizeof (attr_change), (char *) &hyperlink_readbuf, attr_change.attr.hyperlink_length)) {
-                                        hyperlink_readbuf[attr_change.attr.hyperlink_length] = '\0';
-                                        m_last_attr.hyperlink_idx = get_hyperlink_idx(hyperlink_readbuf);
-                                }
-                                if (_vte_stream_read (m_attr_stream, attr_stream_truncate_at - 2, (char *) &hyperlink_length, 2)) {
-                                        g_assert_cmpuint (hyperlink_length, <=, VTE_HYPERLINK_TOTAL_LENGTH_MAX);
-                                        if (_vte_stream_read (m_attr_stream, attr_stream_truncate_at - 2 - hyperlink_length - sizeof (attr_change), (char *) &attr_change, sizeof (attr_change))) {
-                                                m_last_attr_text_start_offset = attr_change.text_end_offset;
-                                        } else {
-                                                m_last_attr_text_start_offset = 0;
-                                        }
-				} else {
-					m_last_attr_text_start_offset = 0;
-				}
-			} else {
-				m_last_attr_text_start_offset = 0;
-				m_last_attr = basic_cell.attr;
-			}
-		}
-		_vte_stream_truncate (m_row_stream, position * sizeof (record));
-		_vte_stream_truncate (m_attr_stream, attr_stream_truncate_at);
-		_vte_stream_truncate (m_text_stream, records[0].text_start_offset);
-	}
+	if (do_truncate)
+                truncate_streams(position, records[0]);
+}
+
+/*
+ * Drops the rows from @position on from the streams, @record being the
+ * row record of @position.
+ *
+ * FIXME this is extremely complicated (by design), figure out something better.
+ * This is the only place where we need to walk backwards in attr_stream,
+ * which is the reason for the entries' lengths being repeated at their end.
+ */
+void
+Ring::truncate_streams(row_t position,
+                       RowRecord const& record)
+{
+        CellAttrChange attr_change;
+        char hyperlink_readbuf[VTE_HYPERLINK_TOTAL_LENGTH_MAX + 1];
+        gsize attr_stream_truncate_at = record.attr_start_offset;
+
+        _vte_debug_print (VTE_DEBUG_RING, "Truncating\n");
+        if (record.text_start_offset <= m_last_attr_text_start_offset) {
+                /* Check the previous attr record. If its text ends where truncating, this attr record also needs to be removed. */
+                auto attr_change_len = read_attr_change_before(m_attr_stream, attr_stream_truncate_at, &attr_change, nullptr);
+                if (attr_change_len != 0 &&
+                    record.text_start_offset == attr_change.text_end_offset) {
+                        _vte_debug_print (VTE_DEBUG_RING, "... at attribute change\n");
+                        attr_stream_truncate_at -= attr_change_len;
+                }
+                /* Reconstruct last_attr from the first record of attr_stream that we cut off,
+                   last_attr_text_start_offset from the last record that we keep. */
+                if (read_attr_change(m_attr_stream, attr_stream_truncate_at, &attr_change, hyperlink_readbuf) != 0) {
+                        _attrcpy(&m_last_attr, &attr_change.attr);
+                        m_last_hyperlink_idx = 0;
+                        if (attr_change.attr.hyperlink_length)
+                                m_last_hyperlink_idx = get_hyperlink_idx(hyperlink_readbuf);
+                        if (read_attr_change_before(m_attr_stream, attr_stream_truncate_at, &attr_change, nullptr) != 0) {
+                                m_last_attr_text_start_offset = attr_change.text_end_offset;
+                        } else {
+                                m_last_attr_text_start_offset = 0;
+                        }
+                } else {
+                        m_last_attr_text_start_offset = 0;
+                        m_last_attr = basic_cell.attr;
+                        m_last_hyperlink_idx = 0;
+                }
+        }
+        _vte_stream_truncate (m_row_stream, position * sizeof (record));
+        _vte_stream_truncate (m_attr_stream, attr_stream_truncate_at);
+        export_copy_on_write(record.text_start_offset);
+        _vte_stream_truncate (m_text_stream, record.text_start_offset);
+        m_text_index.truncate(record.text_start_offset);
 }
 
 void
@@ -574,12 +1179,21 @@ Ring::reset_streams(row_t position)
 
 	if (m_has_streams) {
 		_vte_stream_reset(m_row_stream, position * sizeof(RowRecord));
+                if (G_UNLIKELY(!m_exports.empty())) {
+                        /* Leave the old text stream to the exports reading it */
+                        auto head = _vte_stream_head(m_text_stream);
+                        g_object_unref(m_text_stream);
+                        m_text_stream = new_stream(true);
+                        _vte_stream_reset(m_text_stream, head);
+                }
                 _vte_stream_reset(m_text_stream, _vte_stream_head(m_text_stream));
+                m_text_index.reset(_vte_stream_head(m_text_stream));
                 _vte_stream_reset(m_attr_stream, _vte_stream_head(m_attr_stream));
 	}
 
 	m_last_attr_text_start_offset = 0;
 	m_last_attr = basic_cell.attr;
+        m_last_hyperlink_idx = 0;
 }
 
 Ring::row_t
@@ -587,9 +1201,11 @@ Ring::reset()
 {
         _vte_debug_print (VTE_DEBUG_RING, "Reseting the ring at %lu.\n", m_end);
 
+        maybe_notify_discard(m_end);
+        rewrap_cancel();
         reset_streams(m_end);
         m_start = m_writable = m_end;
-        m_cached_row_num = (row_t)-1;
+        invalidate_cached_rows();
 
         return m_end;
 }
@@ -600,13 +1216,58 @@ Ring::index(row_t position)
 	if (G_LIKELY (position >= m_writable))
 		return get_writable_index(position);
 
-	if (m_cached_row_num != position) {
+        auto const cached = get_cached_row(position);
+        if (cached->num != position) {
 		_vte_debug_print(VTE_DEBUG_RING, "Caching row %lu.\n", position);
-                thaw_row(position, &m_cached_row, false, -1, nullptr);
-		m_cached_row_num = position;
+                thaw_row(position, &cached->row, false, -1, nullptr);
+                cached->num = position;
 	}
 
-	return &m_cached_row;
+        return &cached->row;
+}
+
+/*
+ * Ring::prefetch:
+ * @start: (inout): the first row to thaw
+ * @end: (inout): the row after the last
+ * @backward: whether to go from @end rather than from @start
+ * @max_rows: the number of rows to thaw at most
+ *
+ * Thaws the frozen rows of @start..@end into the cache, the ones nearest
+ * to the view first, so that index() finds them there when they are shown.
+ * The range shrinks by the rows done, and to what fits into the cache.
+ *
+ * Returns: whether rows are left for the next call
+ */
+bool
+Ring::prefetch(row_t* start,
+               row_t* end,
+               bool backward,
+               row_t max_rows)
+{
+        *start = MAX(*start, m_start);
+        *end = MIN(*end, m_writable);
+        /* No more than the cache holds, or the farther rows would replace the nearer ones */
+        if (*start < *end && *end - *start > m_cached_rows_mask + 1) {
+                if (backward)
+                        *start = *end - (m_cached_rows_mask + 1);
+                else
+                        *end = *start + m_cached_rows_mask + 1;
+        }
+
+        for (row_t n = 0; *start < *end && n < max_rows; ) {
+                auto const position = backward ? --*end : (*start)++;
+                auto const cached = get_cached_row(position);
+                if (cached->num == position)
+                        continue;
+
+		_vte_debug_print(VTE_DEBUG_RING, "Prefetching row %lu.\n", position);
+                thaw_row(position, &cached->row, false, -1, nullptr);
+                cached->num = position;
+                n++;
+        }
+
+        return *start < *end;
 }
 
 bool
@@ -631,17 +1292,46 @@ Ring::is_soft_wrapped(row_t position)
 }
 
 /*
- * Returns the hyperlink idx at the given position.
- *
- * Updates the hyperlink parameter to point to the hyperlink's target.
- * The buffer is owned by the ring and must not be modified by the caller.
- *
- * Optionally also updates the internal concept of the hovered idx. In this case,
- * a real idx is looked up or newly allocated in the hyperlink pool even if the
- * cell is scrolled out to the streams.
- * This is to be able to underline all cells that share the same hyperlink.
- *
- * Otherwise cells from the stream might get the pseudo idx VTE_HYPERLINK_IDX_TARGET_IN_STREAM.
+ * Returns: a superset of the bytes of the text of the rows @start..@end
+ * (exclusive), which is everything unless all of them are frozen
+ */
+ByteSet
+Ring::text_bytes(row_t start,
+                 row_t end)
+{
+        RowRecord record;
+
+        if (!m_has_streams || start < m_start || end > m_writable || start >= end)
+                return ByteSet::all();
+
+        if (G_UNLIKELY(!read_row_record(&record, start)))
+                return ByteSet::all();
+        auto const text_start = record.text_start_offset;
+
+        auto text_end = size_t{0};
+        if (end < m_writable) {
+                if (G_UNLIKELY(!read_row_record(&record, end)))
+                        return ByteSet::all();
+                text_end = record.text_start_offset;
+        } else {
+                text_end = _vte_stream_head(m_text_stream);
+        }
+
+        return m_text_index.bytes(text_start, text_end);
+}
+
+/*
+ * Returns the hyperlink idx at the given position.
+ *
+ * Updates the hyperlink parameter to point to the hyperlink's target.
+ * The buffer is owned by the ring and must not be modified by the caller.
+ *
+ * Optionally also updates the internal concept of the hovered idx. In this case,
+ * a real idx is looked up or newly allocated in the hyperlink pool even if the
+ * cell is scrolled out to the streams.
+ * This is to be able to underline all cells that share the same hyperlink.
+ *
+ * Otherwise cells from the stream might get the pseudo idx VTE_HYPERLINK_IDX_TARGET_IN_STREAM.
  */
 Ring::hyperlink_idx_t
 Ring::get_hyperlink_at_position(row_t position,
@@ -658,7 +1348,7 @@ Ring::get_hyperlink_at_position(row_t position,
 
         if (update_hover_idx) {
                 /* Invalidate the cache because new hover idx might result in new idxs to report. */
-                m_cached_row_num = (row_t)-1;
+                invalidate_cached_rows();
         }
 
         if (G_UNLIKELY (!contains(position) || col < 0)) {
@@ -674,12 +1364,14 @@ Ring::get_hyperlink_at_position(row_t position,
                                 m_hyperlink_hover_idx = 0;
                         return 0;
                 }
-                *hyperlink = hyperlink_get(row->cells[col].attr.hyperlink_idx)->str;
-                idx = row->cells[col].attr.hyperlink_idx;
+                idx = _vte_row_data_get_hyperlink(row, col);
+                *hyperlink = hyperlink_get(idx)->str;
         } else {
-                thaw_row(position, &m_cached_row, false, col, hyperlink);
-                /* Note: Intentionally don't set cached_row_num. We're about to update
+                auto const cached = get_cached_row(position);
+                thaw_row(position, &cached->row, false, col, hyperlink);
+                /* Note: Intentionally don't keep the row cached. We're about to update
                  * m_hyperlink_hover_idx which makes some idxs no longer valid. */
+                cached->num = (row_t)-1;
                 idx = get_hyperlink_idx_no_update_current(*hyperlink);
         }
         if (**hyperlink == '\0')
@@ -696,20 +1388,6 @@ Ring::index_writable(row_t position)
 	return get_writable_index(position);
 }
 
-void
-Ring::freeze_one_row()
-{
-	VteRowData* row;
-
-	if (G_UNLIKELY (m_writable == m_start))
-		reset_streams(m_writable);
-
-	row = get_writable_index(m_writable);
-	freeze_row(m_writable, row);
-
-	m_writable++;
-}
-
 void
 Ring::thaw_one_row()
 {
@@ -721,8 +1399,12 @@ Ring::thaw_one_row()
 
 	m_writable--;
 
-	if (m_writable == m_cached_row_num)
-		m_cached_row_num = (row_t)-1; /* Invalidate cached row */
+	/* The rows left for rewrapping must stay frozen */
+	if (G_UNLIKELY (m_writable < m_rewrap_end))
+		rewrap_cancel();
+
+        if (get_cached_row(m_writable)->num == m_writable)
+                get_cached_row(m_writable)->num = (row_t)-1; /* Invalidate cached row */
 
 	row = get_writable_index(m_writable);
         thaw_row(m_writable, row, true, -1, nullptr);
@@ -731,28 +1413,41 @@ Ring::thaw_one_row()
 void
 Ring::discard_one_row()
 {
-	m_start++;
-	if (G_UNLIKELY(m_start == m_writable)) {
+        discard_rows(m_start + 1);
+}
+
+/*
+ * Drops the rows before @start, advancing the tails of the streams to
+ * the row record of @start in one step, however many rows that is.
+ */
+void
+Ring::discard_rows(row_t start)
+{
+        maybe_notify_discard(start);
+
+	m_start = start;
+	if (G_UNLIKELY(m_start >= m_writable)) {
+		m_writable = m_start;
 		reset_streams(m_writable);
-	} else if (m_start < m_writable) {
+	} else {
 		RowRecord record;
 		_vte_stream_advance_tail(m_row_stream, m_start * sizeof (record));
 		if (G_LIKELY(read_row_record(&record, m_start))) {
-			_vte_stream_advance_tail(m_text_stream, record.text_start_offset);
+			_vte_stream_advance_tail(m_text_stream, export_pin(record.text_start_offset));
+			m_text_index.advance_tail(record.text_start_offset);
 			_vte_stream_advance_tail(m_attr_stream, record.attr_start_offset);
 		}
-	} else {
-		m_writable = m_start;
 	}
 }
 
 void
-Ring::maybe_freeze_one_row()
+Ring::maybe_freeze_rows()
 {
-        /* See the comment about m_visible_rows + 1 at ensure_writable_room(). */
+        /* See the comment about m_visible_rows + 1 at ensure_writable_room().
+         * Freeze as many rows as that allows, up to a batch, at once. */
         if (G_LIKELY(m_mask >= m_visible_rows + 1 &&
                      m_writable + m_mask + 1 == m_end))
-		freeze_one_row();
+		freeze_rows(MIN(row_t(VTE_RING_FREEZE_BATCH_ROWS), m_mask - m_visible_rows));
 	else
 		ensure_writable_room();
 }
@@ -763,6 +1458,86 @@ Ring::maybe_discard_one_row()
 {
 	if (length() == m_max)
 		discard_one_row();
+
+        check_limits(1);
+}
+
+/* Enforces the byte limits, after adding @n_rows rows. */
+void
+Ring::check_limits(row_t n_rows)
+{
+        /* The exports keep the text stream from shrinking, see export_pin() */
+        if (G_UNLIKELY(m_max_bytes != 0) && m_exports.empty())
+                discard_to_size(m_max_bytes);
+
+        if (G_UNLIKELY(s_budget != 0) &&
+            (s_budget_counter += n_rows) >= VTE_RING_BUDGET_CHECK_ROWS) {
+                s_budget_counter = 0;
+                enforce_budget(this);
+        }
+}
+
+/*
+ * Discard rows from the streams until they take at most @max_bytes.
+ * The rows in memory are always kept. Since the streams only shrink by
+ * whole blocks, this usually discards a block's worth of rows at once.
+ *
+ * Returns: whether any rows were discarded
+ */
+bool
+Ring::discard_to_size(size_t max_bytes)
+{
+        auto discarded = false;
+
+        while (m_start < m_writable && stream_size() > max_bytes) {
+                discard_one_row();
+                discarded = true;
+        }
+
+        return discarded;
+}
+
+/*
+ * Discard the oldest rows of the rings taking the most space in their
+ * streams, until all of them together fit into the budget.
+ *
+ * @current is the ring being appended to, whose owner will notice; the
+ * owners of all other rings that lose rows are notified.
+ */
+void
+Ring::enforce_budget(Ring* current)
+{
+        auto total = size_t{0};
+        for (auto ring : s_rings)
+                total += ring->stream_size();
+
+        while (total > s_budget) {
+                Ring* largest = nullptr;
+                auto largest_size = size_t{0};
+                for (auto ring : s_rings) {
+                        if (ring->m_start == ring->m_writable ||
+                            !ring->m_exports.empty())
+                                continue;
+                        auto size = ring->stream_size();
+                        if (size > largest_size) {
+                                largest = ring;
+                                largest_size = size;
+                        }
+                }
+                if (largest == nullptr)
+                        break;
+
+                /* Drop at least one block */
+                largest->discard_to_size(largest_size - 1);
+                total -= largest_size - largest->stream_size();
+
+                _vte_debug_print(VTE_DEBUG_RING,
+                                 "Budget: ring %p trimmed from %" G_GSIZE_FORMAT " bytes, %" G_GSIZE_FORMAT " in total.\n",
+                                 largest, largest_size, total);
+
+                if (largest != current && largest->m_evict_func != nullptr)
+                        largest->m_evict_func(largest->m_evict_data);
+        }
 }
 
 void
@@ -827,15 +1602,174 @@ Ring::resize(row_t max_rows)
 	validate();
 
 	/* Adjust the start of tail chunk now */
-	if (length() > max_rows) {
-		m_start = m_end - max_rows;
-		if (m_start >= m_writable) {
-			reset_streams(m_writable);
-			m_writable = m_start;
-		}
-	}
+	if (length() > max_rows)
+                discard_rows(m_end - max_rows);
 
 	m_max = max_rows;
+        update_streams();
+}
+
+/**
+ * Ring::set_max_bytes:
+ * @max_bytes: the maximum size of the streams, or 0 for no limit
+ *
+ * Limits the number of rows by the space they take in the streams, that
+ * is, after compression, in addition to the number of rows.
+ */
+void
+Ring::set_max_bytes(size_t max_bytes)
+{
+	_vte_debug_print(VTE_DEBUG_RING, "Limiting to %" G_GSIZE_FORMAT " bytes.\n", max_bytes);
+
+        m_max_bytes = max_bytes;
+        if (m_max_bytes != 0)
+                discard_to_size(m_max_bytes);
+        update_streams();
+}
+
+/*
+ * Returns: whether the streams stay small enough at the ring's limits to
+ *   be kept in memory. They go to temporary files otherwise, which only
+ *   pays off for an unlimited or huge scrollback.
+ */
+bool
+Ring::streams_fit_in_memory() const
+{
+        if (m_max_bytes != 0 && m_max_bytes <= VTE_RING_MEM_STREAM_MAX_BYTES)
+                return true;
+
+        return m_max <= VTE_RING_MEM_STREAM_MAX_BYTES / VTE_RING_MEM_STREAM_ROW_BYTES;
+}
+
+/* Returns: a new stream of the kind the ring uses, compressed if @compress
+ * and in memory; the row records aren't, they're read for every row. */
+VteStream*
+Ring::new_stream(bool compress) const
+{
+        if (m_streams_in_memory)
+                return _vte_mem_stream_new(compress);
+
+        return _vte_file_stream_new();
+}
+
+/* Replaces @stream by @new_stream, with the same contents at the same offsets */
+static void
+move_stream(VteStream** stream,
+            VteStream* new_stream)
+{
+        char buf[4096];
+        auto const head = _vte_stream_head(*stream);
+        auto offset = _vte_stream_tail(*stream);
+
+        _vte_stream_reset(new_stream, offset);
+        while (offset < head) {
+                auto const len = MIN(sizeof (buf), head - offset);
+                if (!_vte_stream_read(*stream, offset, buf, len))
+                        memset(buf, 0, len);
+                _vte_stream_append(new_stream, buf, len);
+                offset += len;
+        }
+
+        g_object_unref(*stream);
+        *stream = new_stream;
+}
+
+/*
+ * Moves the streams between memory and temporary files when the limits
+ * change which of them fits. The exports keep reading the old text stream,
+ * as after reset_streams().
+ */
+void
+Ring::update_streams()
+{
+        auto const in_memory = streams_fit_in_memory();
+        if (in_memory == m_streams_in_memory)
+                return;
+
+        _vte_debug_print(VTE_DEBUG_RING, "Moving the streams %s.\n",
+                         in_memory ? "to memory" : "to temporary files");
+
+        m_streams_in_memory = in_memory;
+        if (!m_has_streams)
+                return;
+
+        move_stream(&m_text_stream, new_stream(true));
+        move_stream(&m_attr_stream, new_stream(true));
+        move_stream(&m_row_stream, new_stream(false));
+}
+
+/*
+ * Returns: the number of bytes the scrollback takes in the streams
+ */
+size_t
+Ring::stream_size() const
+{
+        if (!m_has_streams)
+                return 0;
+
+        return _vte_stream_size(m_text_stream) +
+                _vte_stream_size(m_attr_stream) +
+                _vte_stream_size(m_row_stream);
+}
+
+/*
+ * Returns: the number of bytes the scrollback takes in the streams before
+ *   compression
+ */
+size_t
+Ring::stream_length() const
+{
+        if (!m_has_streams)
+                return 0;
+
+        return (_vte_stream_head(m_text_stream) - _vte_stream_tail(m_text_stream)) +
+                (_vte_stream_head(m_attr_stream) - _vte_stream_tail(m_attr_stream)) +
+                (_vte_stream_head(m_row_stream) - _vte_stream_tail(m_row_stream));
+}
+
+/* All of m_array counts: the rows frozen keep their cells, for the
+ * rows that are appended next. */
+size_t
+Ring::rows_size() const
+{
+        auto size = sizeof(m_array[0]) * (m_mask + 1);
+        for (row_t i = 0; i <= m_mask; i++)
+                size += _vte_row_data_size(&m_array[i]);
+        return size;
+}
+
+size_t
+Ring::cached_rows_size() const
+{
+        auto size = sizeof(m_cached_rows[0]) * (m_cached_rows_mask + 1);
+        for (row_t i = 0; i <= m_cached_rows_mask; i++)
+                size += _vte_row_data_size(&m_cached_rows[i].row);
+        return size;
+}
+
+size_t
+Ring::hyperlinks_size() const
+{
+        auto size = sizeof(gpointer) * m_hyperlinks->len;
+        for (size_t i = 0; i < m_hyperlinks->len; i++)
+                size += sizeof(GString) + hyperlink_get(i)->allocated_len;
+        /* and about the keys, values and hashes of the index */
+        return size + g_hash_table_size(m_hyperlink_index) * 3 * sizeof(gpointer);
+}
+
+/**
+ * Ring::set_budget:
+ * @budget: the maximum size of the streams of all rings, or 0 for no limit
+ *
+ * Limits the space all rings of the process take in their streams. When
+ * over the budget, the oldest rows of the largest rings are discarded.
+ */
+void
+Ring::set_budget(size_t budget)
+{
+        s_budget = budget;
+        if (s_budget != 0)
+                enforce_budget(nullptr);
 }
 
 void
@@ -851,12 +1785,28 @@ Ring::shrink(row_t max_len)
 	if (m_writable - m_start <= max_len)
 		m_end = m_start + max_len;
 	else {
+                /* Cut the frozen rows off the streams in one step, rather
+                 * than thawing them one by one only to drop them. */
+                auto const end = m_start + max_len;
+                RowRecord record;
+                if (G_LIKELY(read_row_record(&record, end))) {
+                        truncate_streams(end, record);
+                        for (row_t i = 0; i <= m_cached_rows_mask; i++) {
+                                if (m_cached_rows[i].num >= end)
+                                        m_cached_rows[i].num = (row_t)-1;
+                        }
+                        m_writable = m_end = end;
+                }
+
 		while (m_writable - m_start > max_len) {
 			ensure_writable(m_writable - 1);
 			m_end = m_writable;
 		}
 	}
 
+	if (m_end < m_rewrap_end)
+		rewrap_cancel();
+
 	/* TODO May want to shrink down m_array */
 
 	validate();
@@ -898,7 +1848,7 @@ Ring::insert(row_t position, guint8 bidi_flags)
         row->attr.bidi_flags = bidi_flags;
 	m_end++;
 
-	maybe_freeze_one_row();
+	maybe_freeze_rows();
         validate();
 	return row;
 }
@@ -935,6 +1885,73 @@ Ring::remove(row_t position)
         validate();
 }
 
+/* Reverses the order of the rows from @start (inclusive) to @end (exclusive),
+ * which must all be writable. */
+void
+Ring::reverse_writable(row_t start,
+                       row_t end)
+{
+        while (start + 1 < end) {
+                std::swap(*get_writable_index(start), *get_writable_index(end - 1));
+                start++;
+                end--;
+        }
+}
+
+/**
+ * Ring::rotate:
+ * @start: the first row of the range
+ * @end: the row after the last one of the range
+ * @count: by how many rows to move the contents of the range
+ * @bidi_flags: the BiDi flags for the new rows
+ *
+ * Moves the rows from @start to @end down by @count rows, or up
+ * if @count is negative, within that range. The rows that move
+ * out of one end of the range are cleared and come back in at the
+ * other end. The range must be within the ring.
+ *
+ * This has the same result as @count pairs of remove() at one end and
+ * insert() at the other, but it only permutes the rows of the range,
+ * once, instead of shifting everything after the range for each row.
+ */
+void
+Ring::rotate(row_t start,
+             row_t end,
+             long count,
+             guint8 bidi_flags)
+{
+	_vte_debug_print(VTE_DEBUG_RING, "Rotating %lu..%lu by %ld.\n", start, end, count);
+        validate();
+
+        g_assert_cmpuint(start, >=, m_start);
+        g_assert_cmpuint(end, <=, m_end);
+
+        if (G_UNLIKELY(end <= start || count == 0))
+                return;
+
+        auto const length = end - start;
+        auto const down = count > 0;
+        auto const n = MIN(row_t(down ? count : -count), length);
+
+        ensure_writable(start);
+
+        /* Rotate by three reversals; the rows that wrap around are at
+         * [start, start + n) when moving down, and [end - n, end) when
+         * moving up. */
+        auto const pivot = down ? end - n : start + n;
+        reverse_writable(start, pivot);
+        reverse_writable(pivot, end);
+        reverse_writable(start, end);
+
+        auto const first = down ? start : end - n;
+        for (auto i = first; i < first + n; i++) {
+                auto row = get_writable_index(i);
+                _vte_row_data_clear(row);
+                row->attr.bidi_flags = bidi_flags;
+        }
+
+        validate();
+}
 
 /**
  * Ring::append:
@@ -951,6 +1968,43 @@ Ring::append(guint8 bidi_flags)
 }
 
 
+/**
+ * Ring::append_rows:
+ * @n: the number of rows
+ * @bidi_flags: the BiDi flags for the new rows
+ *
+ * Appends @n new, empty, rows to the ring, as @n calls to append() would.
+ * The rows this pushes out of the writable region are frozen in one
+ * batch, and the rows this pushes out of the ring are discarded before
+ * that, without being frozen first.
+ */
+void
+Ring::append_rows(row_t n,
+                  guint8 bidi_flags)
+{
+	_vte_debug_print(VTE_DEBUG_RING, "Appending %lu rows.\n", n);
+        validate();
+
+        while (length() != 0 && length() + n > m_max)
+                discard_one_row();
+
+        /* Keep m_visible_rows + 1 rows writable, see ensure_writable_room() */
+        if (m_has_streams && m_mask >= m_visible_rows + 1 &&
+            m_end + n > m_writable + m_mask + 1)
+                freeze_rows(MIN(m_end - m_writable, m_end + n - (m_writable + m_mask + 1)));
+
+        for (row_t i = 0; i < n; i++) {
+                ensure_writable_room();
+                auto row = get_writable_index(m_end);
+                _vte_row_data_clear(row);
+                row->attr.bidi_flags = bidi_flags;
+                m_end++;
+        }
+
+        check_limits(n);
+        validate();
+}
+
 /**
  * Ring::drop_scrollback:
  * @position: drop contents up to this point, which must be in the writable region.
@@ -962,10 +2016,13 @@ Ring::append(guint8 bidi_flags)
 void
 Ring::drop_scrollback(row_t position)
 {
+        maybe_notify_discard(position);
         ensure_writable(position);
 
+        rewrap_cancel();
         m_start = m_writable = position;
         reset_streams(position);
+        invalidate_cached_rows();
 }
 
 /**
@@ -980,11 +2037,43 @@ void
 Ring::set_visible_rows(row_t rows)
 {
         m_visible_rows = rows;
+        resize_cached_rows(MAX(VTE_RING_CACHED_SCREENS * rows, VTE_RING_CACHED_ROWS_MIN));
+}
+
+
+/* Reads the records of @position and the row after it, which is where the
+ * text of @position ends. Requires the row to be frozen. */
+bool
+Ring::read_row_records(row_t position,
+                       RowRecord* records)
+{
+	if (!read_row_record(&records[0], position))
+		return false;
+	if ((position + 1) * sizeof (records[0]) < _vte_stream_head(m_row_stream)) {
+		if (!read_row_record(&records[1], position + 1))
+			return false;
+	} else
+		records[1].text_start_offset = _vte_stream_head(m_text_stream);
+	return true;
 }
 
+/* Returns: the length of the text of the row of @records, without the newline */
+size_t
+Ring::row_records_text_length(RowRecord const* records)
+{
+        auto const len = records[1].text_start_offset - records[0].text_start_offset;
+
+        /* The newline is only rarely missing, if the ring ends in a soft
+         * wrapped line; see bug 181 */
+        return len - (len != 0 && !records[0].soft_wrapped ? 1 : 0);
+}
 
 /* Convert a (row,col) into a CellTextOffset.
  * Requires the row to be frozen, or be outsize the range covered by the ring.
+ *
+ * The text of an ASCII row has a byte for each cell, so the offset is
+ * known from the records alone. Otherwise, it's counted from the cells;
+ * the text doesn't need to be read back, nor decoded.
  */
 bool
 Ring::frozen_row_column_to_text_offset(row_t position,
@@ -992,10 +2081,10 @@ Ring::frozen_row_column_to_text_offset(row_t position,
 				       CellTextOffset* offset)
 {
 	RowRecord records[2];
-	VteCell *cell;
-	GString *buffer = m_utf8_buffer;
+	const VteCell *cell;
 	VteRowData const* row;
-	unsigned int i, num_chars, off;
+	unsigned int i;
+	size_t off;
 
 	if (position >= m_end) {
 		offset->text_offset = _vte_stream_head(m_text_stream) + position - m_end;
@@ -1013,48 +2102,40 @@ Ring::frozen_row_column_to_text_offset(row_t position,
 	}
 
 	g_assert_cmpuint(position, <, m_writable);
-	if (!read_row_record(&records[0], position))
+	if (!read_row_records(position, records))
 		return false;
-	if ((position + 1) * sizeof (records[0]) < _vte_stream_head(m_row_stream)) {
-		if (!read_row_record(&records[1], position + 1))
-			return false;
-	} else
-		records[1].text_start_offset = _vte_stream_head(m_text_stream);
 
-	g_string_set_size (buffer, records[1].text_start_offset - records[0].text_start_offset);
-	if (!_vte_stream_read(m_text_stream, records[0].text_start_offset, buffer->str, buffer->len))
-		return false;
+	offset->fragment_cells = 0;
+	offset->eol_cells = -1;
 
-	if (G_LIKELY (buffer->len && buffer->str[buffer->len - 1] == '\n'))
-                g_string_truncate (buffer, buffer->len - 1);
+	if (records[0].is_ascii) {
+		auto const len = row_records_text_length(records);
+		if (size_t(column) >= len) {
+			offset->eol_cells = column - len;
+			column = len;
+		}
+		offset->text_offset = records[0].text_start_offset + column;
+		return true;
+	}
 
 	row = index(position);
 
-	/* row and buffer now contain the same text, in different representation */
-
-	/* count the number of characters up to the given column */
-	offset->fragment_cells = 0;
-	offset->eol_cells = -1;
-	num_chars = 0;
-	for (i = 0, cell = row->cells; i < row->len && i < column; i++, cell++) {
+	/* count the number of UTF-8 bytes up to the given column */
+	off = 0;
+	for (i = 0; i < row->len && i < column; i++) {
+		cell = _vte_row_data_get(row, i);
 		if (G_LIKELY (!cell->attr.fragment())) {
 			if (G_UNLIKELY (i + cell->attr.columns() > column)) {
 				offset->fragment_cells = column - i;
 				break;
 			}
-			num_chars += _vte_unistr_strlen(cell->c);
+			off += _vte_unistr_utf8_len(cell->c);
 		}
 	}
 	if (i >= row->len) {
 		offset->eol_cells = column - i;
 	}
 
-	/* count the number of UTF-8 bytes for the given number of characters */
-	off = 0;
-	while (num_chars > 0 && off < buffer->len) {
-		off++;
-		if ((buffer->str[off] & 0xC0) != 0x80) num_chars--;
-	}
 	offset->text_offset = records[0].text_start_offset + off;
 	return true;
 }
@@ -1070,10 +2151,10 @@ Ring::frozen_row_text_offset_to_column(row_t position,
 				       column_t* column)
 {
 	RowRecord records[2];
-	VteCell *cell;
-	GString *buffer = m_utf8_buffer;
+	const VteCell *cell;
 	VteRowData const* row;
-	unsigned int i, off, num_chars, nc;
+	unsigned int i, len;
+	size_t off, bytes, nb;
 
 	if (position >= m_end) {
 		*column = offset->eol_cells;
@@ -1088,130 +2169,157 @@ Ring::frozen_row_text_offset_to_column(row_t position,
 	}
 
 	g_assert_cmpuint(position, <, m_writable);
-	if (!read_row_record(&records[0], position))
-		return false;
-	if ((position + 1) * sizeof (records[0]) < _vte_stream_head(m_row_stream)) {
-		if (!read_row_record(&records[1], position + 1))
-			return false;
-	} else
-		records[1].text_start_offset = _vte_stream_head (m_text_stream);
-
-	g_string_set_size (buffer, records[1].text_start_offset - records[0].text_start_offset);
-	if (!_vte_stream_read(m_text_stream, records[0].text_start_offset, buffer->str, buffer->len))
+	if (!read_row_records(position, records))
 		return false;
 
-	if (G_LIKELY (buffer->len && buffer->str[buffer->len - 1] == '\n'))
-                g_string_truncate (buffer, buffer->len - 1);
-
-        /* Now that we've chopped off the likely trailing newline (which is only rarely missing,
-         * if the ring ends in a soft wrapped line; see bug 181), the position we're about to
-         * locate can be anywhere in the string, including just after its last character,
-         * but not beyond that. */
+        /* The position we're about to locate can be anywhere in the text
+         * of the row, including just after its last character, but not
+         * beyond that. */
         g_assert_cmpuint(offset->text_offset, >=, records[0].text_start_offset);
-        g_assert_cmpuint(offset->text_offset, <=, records[0].text_start_offset + buffer->len);
-
-	row = index(position);
-
-	/* row and buffer now contain the same text, in different representation */
+        g_assert_cmpuint(offset->text_offset, <=, records[0].text_start_offset + row_records_text_length(records));
 
-	/* count the number of characters for the given UTF-8 text offset */
 	off = offset->text_offset - records[0].text_start_offset;
-	num_chars = 0;
-	for (i = 0; i < off; i++) {
-		if ((buffer->str[i] & 0xC0) != 0x80) num_chars++;
-	}
 
-	/* count the number of columns for the given number of characters */
-	for (i = 0, cell = row->cells; i < row->len; i++, cell++) {
-		if (G_LIKELY (!cell->attr.fragment())) {
-			if (num_chars == 0) break;
-			nc = _vte_unistr_strlen(cell->c);
-			if (nc > num_chars) break;
-			num_chars -= nc;
+	if (records[0].is_ascii) {
+		i = off;
+		len = row_records_text_length(records);
+	} else {
+		row = index(position);
+		len = row->len;
+
+		/* count the number of columns for the given number of UTF-8 bytes */
+		bytes = 0;
+		for (i = 0; i < row->len; i++) {
+			cell = _vte_row_data_get(row, i);
+			if (G_LIKELY (!cell->attr.fragment())) {
+				if (bytes == off) break;
+				nb = _vte_unistr_utf8_len(cell->c);
+				if (bytes + nb > off) break;
+				bytes += nb;
+			}
 		}
 	}
 
 	/* always add fragment_cells, but add eol_cells only if we're at eol */
 	i += offset->fragment_cells;
-	if (G_UNLIKELY (offset->eol_cells >= 0 && i == row->len))
+	if (G_UNLIKELY (offset->eol_cells >= 0 && i == len))
 		i += offset->eol_cells;
 	*column = i;
 	return true;
 }
 
 
-/**
- * Ring::rewrap:
- * @columns: new number of columns
- * @markers: 0-terminated array of #VteVisualPosition
- *
- * Reflow the @ring to match the new number of @columns.
- * For all @markers, find the cell at that position and update them to
- * reflect the cell's new position.
- */
-/* See ../doc/rewrap.txt for design and implementation details. */
-void
-Ring::rewrap(column_t columns,
-             VteVisualPosition** markers)
+/* Copy @n row records, starting at @position, from @src to the end of @dst. */
+static bool
+copy_row_records(VteStream* src,
+                 gsize position,
+                 gsize n,
+                 VteStream* dst,
+                 gsize record_size)
 {
-	row_t old_row_index, new_row_index;
-	int i;
-	int num_markers = 0;
-	CellTextOffset *marker_text_offsets;
-	VteVisualPosition *new_markers;
+	char buf[4096];
+	gsize offset = position * record_size;
+	gsize len = n * record_size;
+
+	while (len > 0) {
+		gsize chunk = MIN(len, sizeof (buf) / record_size * record_size);
+		if (!_vte_stream_read(src, offset, buf, chunk))
+			return false;
+		_vte_stream_append(dst, buf, chunk);
+		offset += chunk;
+		len -= chunk;
+	}
+	return true;
+}
+
+/* Find the last of the row records [@first, @last) in @stream that begins at or
+   before @text_offset; @first if there's no such record. */
+bool
+Ring::find_row_record(VteStream* stream,
+                      row_t first,
+                      row_t last,
+                      gsize text_offset,
+                      row_t* position)
+{
+	RowRecord record;
+
+	*position = first;
+	while (first + 1 < last) {
+		row_t mid = first + (last - first) / 2;
+		if (!_vte_stream_read(stream, mid * sizeof (record), (char *) &record, sizeof (record)))
+			return false;
+		if (record.text_start_offset <= text_offset)
+			*position = first = mid;
+		else
+			last = mid;
+	}
+	return true;
+}
+
+/*
+ * Ring::rewrap_rows:
+ * @source: the streams to read the rows from
+ * @start: the first row of a paragraph (or m_start)
+ * @end: the end of a paragraph (or the end of @source)
+ * @columns: new number of columns
+ * @max_rows: stop after the paragraph in which this many old rows were processed
+ * @stream: the stream to append the new row records to
+ * @n_records: (out): the number of row records appended
+ * @next: (out): the row where to continue; @end if everything was rewrapped
+ *
+ * Rewraps whole paragraphs of frozen rows. This only reads from the ring,
+ * so that rewrap_rows_parallel() can run it on several threads at once,
+ * each with a #RewrapSource of its own.
+ */
+bool
+Ring::rewrap_rows(RewrapSource const& source,
+                  row_t start,
+                  row_t end,
+                  column_t columns,
+                  row_t max_rows,
+                  VteStream* stream,
+                  row_t* n_records,
+                  row_t* next) const
+{
+	row_t old_row_index;
+	int i;
 	RowRecord old_record;
 	CellAttrChange attr_change;
-	VteStream *new_row_stream;
 	gsize paragraph_start_text_offset;
 	gsize paragraph_end_text_offset;
 	gsize paragraph_len;  /* excluding trailing '\n' */
 	gsize attr_offset;
-	gsize old_ring_end;
-
-	if (G_UNLIKELY(length() == 0))
-		return;
-	_vte_debug_print(VTE_DEBUG_RING, "Ring before rewrapping:\n");
-        validate();
-	new_row_stream = _vte_file_stream_new();
+	gsize attr_change_len;
+	gsize end_text_offset;
 
-	/* Freeze everything, because rewrapping is really complicated and we don't want to
-	   duplicate the code for frozen and thawed rows. */
-	while (m_writable < m_end)
-		freeze_one_row();
+	*n_records = 0;
+	*next = end;
+	if (start >= end)
+		return true;
 
-	/* For markers given as (row,col) pairs find their offsets in the text stream.
-	   This code requires that the rows are already frozen. */
-	while (markers[num_markers] != nullptr)
-		num_markers++;
-	marker_text_offsets = (CellTextOffset *) g_malloc(num_markers * sizeof (marker_text_offsets[0]));
-	new_markers = (VteVisualPosition *) g_malloc(num_markers * sizeof (new_markers[0]));
-	for (i = 0; i < num_markers; i++) {
-		/* Convert visual column into byte offset */
-		if (!frozen_row_column_to_text_offset(markers[i]->row, markers[i]->col, &marker_text_offsets[i]))
-			goto err;
-		new_markers[i].row = new_markers[i].col = -1;
-		_vte_debug_print(VTE_DEBUG_RING,
-				"Marker #%d old coords:  row %ld  col %ld  ->  text_offset %" G_GSIZE_FORMAT " fragment_cells %d  eol_cells %d\n",
-				i, markers[i]->row, markers[i]->col, marker_text_offsets[i].text_offset,
-				marker_text_offsets[i].fragment_cells, marker_text_offsets[i].eol_cells);
+	if (!read_row_record(source.row_stream, &old_record, start))
+		return false;
+	if (end < source.end) {
+		RowRecord end_record;
+		if (!read_row_record(source.row_stream, &end_record, end))
+			return false;
+		end_text_offset = end_record.text_start_offset;
+	} else {
+		end_text_offset = _vte_stream_head(source.text_stream);
 	}
-
-	/* Prepare for rewrapping */
-	if (!read_row_record(&old_record, m_start))
-		goto err;
 	paragraph_start_text_offset = old_record.text_start_offset;
-	paragraph_end_text_offset = _vte_stream_head(m_text_stream);  /* initialized to silence gcc */
-	new_row_index = 0;
+	paragraph_end_text_offset = end_text_offset;  /* initialized to silence gcc */
 
 	attr_offset = old_record.attr_start_offset;
-	if (!_vte_stream_read(m_attr_stream, attr_offset, (char *) &attr_change, sizeof (attr_change))) {
+	attr_change_len = read_attr_change(source.attr_stream, attr_offset, &attr_change, nullptr);
+	if (attr_change_len == 0) {
                 _attrcpy(&attr_change.attr, &m_last_attr);
-                attr_change.attr.hyperlink_length = hyperlink_get(m_last_attr.hyperlink_idx)->len;
-		attr_change.text_end_offset = _vte_stream_head(m_text_stream);
+                attr_change.attr.hyperlink_length = hyperlink_get(m_last_hyperlink_idx)->len;
+		attr_change.text_end_offset = _vte_stream_head(source.text_stream);
 	}
 
-	old_row_index = m_start + 1;
-	while (paragraph_start_text_offset < _vte_stream_head(m_text_stream)) {
+	old_row_index = start + 1;
+	while (paragraph_start_text_offset < end_text_offset) {
 		/* Find the boundaries of the next paragraph */
 		gboolean prev_record_was_soft_wrapped = FALSE;
 		gboolean paragraph_is_ascii = TRUE;
@@ -1220,19 +2328,24 @@ Ring::rewrap(column_t columns,
 		RowRecord new_record;
 		column_t col = 0;
 
+		if (old_row_index - 1 - start >= max_rows) {
+			*next = old_row_index - 1;
+			break;
+		}
+
 		_vte_debug_print(VTE_DEBUG_RING,
 				"  Old paragraph:  row %lu  (text_offset %" G_GSIZE_FORMAT ")  up to (exclusive)  ",  /* no '\n' */
                                  old_row_index - 1,
                                  paragraph_start_text_offset);
-		while (old_row_index <= m_end) {
+		while (old_row_index <= source.end) {
 			prev_record_was_soft_wrapped = old_record.soft_wrapped;
 			paragraph_is_ascii = paragraph_is_ascii && old_record.is_ascii;
-			if (G_LIKELY (old_row_index < m_end)) {
-				if (!read_row_record(&old_record, old_row_index))
-					goto err;
+			if (G_LIKELY (old_row_index < source.end)) {
+				if (!read_row_record(source.row_stream, &old_record, old_row_index))
+					return false;
 				paragraph_end_text_offset = old_record.text_start_offset;
 			} else {
-				paragraph_end_text_offset = _vte_stream_head (m_text_stream);
+				paragraph_end_text_offset = _vte_stream_head (source.text_stream);
 			}
 			old_row_index++;
 			if (!prev_record_was_soft_wrapped)
@@ -1252,11 +2365,12 @@ Ring::rewrap(column_t columns,
 		/* Wrap the paragraph */
 		if (attr_change.text_end_offset <= text_offset) {
 			/* Attr change at paragraph boundary, advance to next attr. */
-                        attr_offset += sizeof (attr_change) + attr_change.attr.hyperlink_length + 2;
-			if (!_vte_stream_read(m_attr_stream, attr_offset, (char *) &attr_change, sizeof (attr_change))) {
+                        attr_offset += attr_change_len;
+			attr_change_len = read_attr_change(source.attr_stream, attr_offset, &attr_change, nullptr);
+			if (attr_change_len == 0) {
                                 _attrcpy(&attr_change.attr, &m_last_attr);
-                                attr_change.attr.hyperlink_length = hyperlink_get(m_last_attr.hyperlink_idx)->len;
-				attr_change.text_end_offset = _vte_stream_head(m_text_stream);
+                                attr_change.attr.hyperlink_length = hyperlink_get(m_last_hyperlink_idx)->len;
+				attr_change.text_end_offset = _vte_stream_head(source.text_stream);
 			}
 		}
 		memset(&new_record, 0, sizeof (new_record));
@@ -1270,11 +2384,12 @@ Ring::rewrap(column_t columns,
 			gsize runlength;  /* number of bytes we process in one run: identical attributes, within paragraph */
 			if (attr_change.text_end_offset <= text_offset) {
 				/* Attr change at line boundary, advance to next attr. */
-                                attr_offset += sizeof (attr_change) + attr_change.attr.hyperlink_length + 2;
-				if (!_vte_stream_read(m_attr_stream, attr_offset, (char *) &attr_change, sizeof (attr_change))) {
+                                attr_offset += attr_change_len;
+				attr_change_len = read_attr_change(source.attr_stream, attr_offset, &attr_change, nullptr);
+				if (attr_change_len == 0) {
                                         _attrcpy(&attr_change.attr, &m_last_attr);
-                                        attr_change.attr.hyperlink_length = hyperlink_get(m_last_attr.hyperlink_idx)->len;
-					attr_change.text_end_offset = _vte_stream_head(m_text_stream);
+                                        attr_change.attr.hyperlink_length = hyperlink_get(m_last_hyperlink_idx)->len;
+					attr_change.text_end_offset = _vte_stream_head(source.text_stream);
 				}
 			}
 			runlength = MIN(paragraph_len, attr_change.text_end_offset - text_offset);
@@ -1288,20 +2403,12 @@ Ring::rewrap(column_t columns,
 					if (col >= columns - attr_change.attr.columns() + 1) {
 						/* Wrap now, write the soft wrapped row's record */
 						new_record.soft_wrapped = 1;
-						_vte_stream_append(new_row_stream, (char const* ) &new_record, sizeof (new_record));
+						_vte_stream_append(stream, (char const* ) &new_record, sizeof (new_record));
 						_vte_debug_print(VTE_DEBUG_RING,
 								"    New row %ld  text_offset %" G_GSIZE_FORMAT "  attr_offset %" G_GSIZE_FORMAT "  soft_wrapped\n",
-								new_row_index,
+								*n_records,
 								new_record.text_start_offset, new_record.attr_start_offset);
-						for (i = 0; i < num_markers; i++) {
-							if (G_UNLIKELY (marker_text_offsets[i].text_offset >= new_record.text_start_offset &&
-									marker_text_offsets[i].text_offset < text_offset)) {
-								new_markers[i].row = new_row_index;
-								_vte_debug_print(VTE_DEBUG_RING,
-										"      Marker #%d will be here in row %lu\n", i, new_row_index);
-							}
-						}
-						new_row_index++;
+						(*n_records)++;
 						new_record.text_start_offset = text_offset;
 						new_record.attr_start_offset = attr_offset;
 						col = 0;
@@ -1322,8 +2429,8 @@ Ring::rewrap(column_t columns,
 						/* Find beginning of next UTF-8 character */
 						text_offset++; paragraph_len--; runlength--;
 						textbuf_len = MIN(runlength, sizeof (textbuf));
-						if (!_vte_stream_read(m_text_stream, text_offset, textbuf, textbuf_len))
-							goto err;
+						if (!_vte_stream_read(source.text_stream, text_offset, textbuf, textbuf_len))
+							return false;
 						for (i = 0; i < textbuf_len && (textbuf[i] & 0xC0) == 0x80; i++) {
 							text_offset++; paragraph_len--; runlength--;
 						}
@@ -1335,35 +2442,438 @@ Ring::rewrap(column_t columns,
 		/* Write the record of the paragraph's last row. */
 		/* Hard wrapped, except maybe at the end of the very last paragraph */
 		new_record.soft_wrapped = prev_record_was_soft_wrapped;
-		_vte_stream_append(new_row_stream, (char const* ) &new_record, sizeof (new_record));
+		_vte_stream_append(stream, (char const* ) &new_record, sizeof (new_record));
 		_vte_debug_print(VTE_DEBUG_RING,
 				"    New row %ld  text_offset %" G_GSIZE_FORMAT "  attr_offset %" G_GSIZE_FORMAT "\n",
-				new_row_index,
+				*n_records,
 				new_record.text_start_offset, new_record.attr_start_offset);
-		for (i = 0; i < num_markers; i++) {
-			if (G_UNLIKELY (marker_text_offsets[i].text_offset >= new_record.text_start_offset &&
-					marker_text_offsets[i].text_offset < paragraph_end_text_offset)) {
-				new_markers[i].row = new_row_index;
-				_vte_debug_print(VTE_DEBUG_RING,
-						"      Marker #%d will be here in row %lu\n", i, new_row_index);
+		(*n_records)++;
+		paragraph_start_text_offset = paragraph_end_text_offset;
+	}
+
+	return true;
+}
+
+/* The ranges of one rewrap_rows_parallel() batch, which the main thread and
+ * the pool threads take one at a time until there are none left, as in
+ * RingView::update_paragraphs_parallel(). */
+struct Ring::RewrapJob {
+        struct Range {
+                RewrapSource source;
+                row_t start;
+                row_t end;
+                VteStream* stream;  /* the new row records */
+                row_t n_records;
+                bool ok;
+        };
+
+        Ring const* ring;
+        column_t columns;
+        std::vector<Range> ranges{};
+
+        std::atomic<size_t> next{0};
+        int n_pending{0};  /* the pool threads still running, protected by mutex */
+        GMutex mutex;
+        GCond cond;
+
+        void run() noexcept
+        {
+                for (auto i = next++; i < ranges.size(); i = next++) {
+                        auto& range = ranges[i];
+                        row_t next_row;
+                        range.ok = ring->rewrap_rows(range.source, range.start, range.end,
+                                                     columns, G_MAXULONG, range.stream,
+                                                     &range.n_records, &next_row);
+                }
+        }
+
+        void clear() noexcept
+        {
+                for (auto& range : ranges) {
+                        g_object_unref(range.source.row_stream);
+                        g_object_unref(range.source.attr_stream);
+                        g_object_unref(range.source.text_stream);
+                        g_object_unref(range.stream);
+                }
+                ranges.clear();
+                next = 0;
+        }
+};
+
+void
+Ring::rewrap_job_thread_func(void* data,
+                             void* user_data)
+{
+        auto job = reinterpret_cast<RewrapJob*>(data);
+        job->run();
+
+        g_mutex_lock(&job->mutex);
+        if (--job->n_pending == 0)
+                g_cond_signal(&job->cond);
+        g_mutex_unlock(&job->mutex);
+}
+
+/* Returns: the pool shared by all rings, or nullptr if there is only one
+ * processor */
+GThreadPool*
+Ring::rewrap_thread_pool()
+{
+        static GThreadPool* pool = nullptr;
+        static bool initialized = false;
+        if (G_LIKELY(initialized))
+                return pool;
+
+        initialized = true;
+        auto const n_threads = std::min(int(g_get_num_processors()) - 1, VTE_REWRAP_THREADS_MAX);
+        if (n_threads < 1)
+                return nullptr;
+
+        GError* error = nullptr;
+        pool = g_thread_pool_new(rewrap_job_thread_func, nullptr, n_threads, FALSE, &error);
+        if (pool == nullptr) {
+                _vte_debug_print(VTE_DEBUG_RING, "Failed to create the rewrap thread pool: %s\n",
+                                 error->message);
+                g_error_free(error);
+        }
+        return pool;
+}
+
+/*
+ * Ring::copy_rewrap_source:
+ * @start: the first row of a paragraph
+ * @end: the end of a paragraph, or m_end
+ * @source: (out): new streams in memory with just what rewrap_rows() reads
+ *   to rewrap these rows, at the same offsets as in the ring's streams
+ *
+ * The streams are created even if this fails, for the caller to free.
+ */
+bool
+Ring::copy_rewrap_source(row_t start,
+                         row_t end,
+                         RewrapSource* source)
+{
+	RowRecord first, last;
+	CellAttrChange attr_change;
+	gsize text_end, attr_end;
+
+	source->end = MIN(end + 1, m_end);  /* the record at @end is read too, for where the text ends */
+	source->row_stream = _vte_mem_stream_new(false);
+	source->attr_stream = _vte_mem_stream_new(false);
+	source->text_stream = _vte_mem_stream_new(false);
+
+	if (!read_row_record(&first, start))
+		return false;
+	if (end < m_end) {
+		if (!read_row_record(&last, end))
+			return false;
+		text_end = last.text_start_offset;
+
+		/* Up to the attributes of the last byte, wherever the last row's
+		   record points to */
+		attr_end = last.attr_start_offset;
+		for (;;) {
+			auto const len = read_attr_change(m_attr_stream, attr_end, &attr_change, nullptr);
+			if (len == 0)
+				break;
+			attr_end += len;
+			if (attr_change.text_end_offset >= text_end)
+				break;
+		}
+	} else {
+		text_end = _vte_stream_head(m_text_stream);
+		attr_end = _vte_stream_head(m_attr_stream);
+	}
+	attr_end = MAX(attr_end, first.attr_start_offset);
+
+	_vte_stream_reset(source->row_stream, start * sizeof (RowRecord));
+	_vte_stream_reset(source->attr_stream, first.attr_start_offset);
+	_vte_stream_reset(source->text_stream, first.text_start_offset);
+
+	/* Bytes are records of size 1 */
+	return copy_row_records(m_row_stream, start, source->end - start,
+				source->row_stream, sizeof (RowRecord)) &&
+	       copy_row_records(m_attr_stream, first.attr_start_offset, attr_end - first.attr_start_offset,
+				source->attr_stream, 1) &&
+	       copy_row_records(m_text_stream, first.text_start_offset, text_end - first.text_start_offset,
+				source->text_stream, 1);
+}
+
+/*
+ * Ring::rewrap_rows_parallel:
+ * @start: the first row of a paragraph (or m_start)
+ * @end: the end of a paragraph (or m_end)
+ * @columns: new number of columns
+ * @stream: the stream to append the new row records to
+ * @n_records: (out): the number of row records appended
+ *
+ * Rewraps all of the frozen rows like rewrap_rows(), spread over the pool
+ * threads. The paragraphs are independent, so the rows are split at their
+ * boundaries into ranges of about VTE_REWRAP_PARALLEL_ROWS, rewrapped each
+ * to a stream of their own, and the new row records appended in order.
+ * Only one thread can read the ring's streams, with their read buffers, so
+ * this one first copies what each range needs to streams in memory; that
+ * goes in batches of a few ranges per thread to bound the memory it takes.
+ */
+bool
+Ring::rewrap_rows_parallel(row_t start,
+                           row_t end,
+                           column_t columns,
+                           VteStream* stream,
+                           row_t* n_records)
+{
+	RowRecord record;
+	row_t next;
+	bool ok = true;
+
+	*n_records = 0;
+	auto pool = rewrap_thread_pool();
+	if (pool == nullptr || end - start < 2 * VTE_REWRAP_PARALLEL_ROWS)
+		return rewrap_rows(start, end, columns, G_MAXULONG, stream, n_records, &next);
+
+	auto const n_threads = size_t(g_thread_pool_get_max_threads(pool));
+	RewrapJob job{this, columns};
+	g_mutex_init(&job.mutex);
+	g_cond_init(&job.cond);
+
+	while (ok && start < end) {
+		/* The next batch, split after hard wrapped rows. A paragraph
+		   longer than a range stays in one. */
+		while (ok && start < end && job.ranges.size() < 2 * (n_threads + 1)) {
+			auto range_end = MIN(start + VTE_REWRAP_PARALLEL_ROWS, end);
+			while (range_end < end) {
+				if (!read_row_record(&record, range_end - 1)) {
+					ok = false;
+					break;
+				}
+				if (!record.soft_wrapped)
+					break;
+				range_end++;
 			}
+			if (!ok)
+				break;
+
+			RewrapJob::Range range;
+			if (!copy_rewrap_source(start, range_end, &range.source)) {
+				g_object_unref(range.source.row_stream);
+				g_object_unref(range.source.attr_stream);
+				g_object_unref(range.source.text_stream);
+				ok = false;
+				break;
+			}
+			range.start = start;
+			range.end = range_end;
+			range.stream = _vte_mem_stream_new(false);
+			range.n_records = 0;
+			range.ok = false;
+			job.ranges.push_back(range);
+			start = range_end;
+		}
+		if (job.ranges.empty())
+			break;
+
+		auto const n_pushed = std::min(n_threads, job.ranges.size() - 1);
+		job.n_pending = n_pushed;
+		for (size_t i = 0; i < n_pushed; i++)
+			g_thread_pool_push(pool, &job, nullptr);
+
+		job.run();
+
+		g_mutex_lock(&job.mutex);
+		while (job.n_pending > 0)
+			g_cond_wait(&job.cond, &job.mutex);
+		g_mutex_unlock(&job.mutex);
+
+		for (auto const& range : job.ranges) {
+			if (!ok || !range.ok ||
+			    !copy_row_records(range.stream, 0, range.n_records, stream, sizeof (RowRecord))) {
+				ok = false;
+				break;
+			}
+			*n_records += range.n_records;
+		}
+		_vte_debug_print(VTE_DEBUG_RING, "Rewrapped %zu ranges in parallel, up to row %lu.\n",
+				 job.ranges.size(), start);
+		job.clear();
+	}
+
+	job.clear();
+	g_cond_clear(&job.cond);
+	g_mutex_clear(&job.mutex);
+	return ok;
+}
+
+void
+Ring::rewrap_cancel()
+{
+	if (m_rewrap_stream == nullptr)
+		return;
+
+	_vte_debug_print(VTE_DEBUG_RING, "Abandoning the rewrapping of rows %lu..%lu.\n",
+			 m_start, m_rewrap_end);
+	g_object_unref(m_rewrap_stream);
+	m_rewrap_stream = nullptr;
+	m_rewrap_end = m_rewrap_next = m_rewrap_n_records = 0;
+}
+
+/* Returns: the indices of the @num_markers @markers, in the order of their positions */
+static std::vector<int>
+sort_markers(VteVisualPosition** markers,
+             int num_markers)
+{
+	auto order = std::vector<int>(num_markers);
+	for (int i = 0; i < num_markers; i++)
+		order[i] = i;
+	std::stable_sort(order.begin(), order.end(), [markers](int a, int b) {
+		return markers[a]->row < markers[b]->row ||
+		       (markers[a]->row == markers[b]->row && markers[a]->col < markers[b]->col);
+	});
+	return order;
+}
+
+/**
+ * Ring::rewrap:
+ * @columns: new number of columns
+ * @markers: 0-terminated array of #VteVisualPosition
+ *
+ * Reflow the @ring to match the new number of @columns.
+ * For all @markers, find the cell at that position and update them to
+ * reflect the cell's new position.
+ *
+ * With a long scrollback, only the bottom rows (at least the visible ones plus
+ * VTE_REWRAP_SYNC_ROWS) are rewrapped right away; the rows above them keep their
+ * old width until rewrap_step() and rewrap_finish() get to them. Markers within
+ * these rows are only moved to where the rows get renumbered for the time being.
+ *
+ * The markers are handled in the order of their positions, so that each one's
+ * new row is only searched for from the previous one's on.
+ */
+/* See ../doc/rewrap.txt for design and implementation details. */
+void
+Ring::rewrap(column_t columns,
+             VteVisualPosition** markers)
+{
+	row_t boundary, head_rows, tail_start;
+	row_t n_records, next, search_start;
+	int i;
+	int num_markers = 0;
+	CellTextOffset *marker_text_offsets;
+	VteVisualPosition *new_markers;
+	VteStream *new_row_stream;
+	gsize old_ring_end;
+	std::vector<int> order;
+
+	if (G_UNLIKELY(length() == 0))
+		return;
+	_vte_debug_print(VTE_DEBUG_RING, "Ring before rewrapping:\n");
+        validate();
+
+	/* Whatever was left from a previous resize gets rewrapped from scratch
+	   along with the rest. Paragraphs with rows of mixed width are fine. */
+	rewrap_cancel();
+
+	new_row_stream = new_stream(false);
+
+	/* Freeze everything, because rewrapping is really complicated and we don't want to
+	   duplicate the code for frozen and thawed rows. */
+	if (m_writable < m_end)
+		freeze_rows(m_end - m_writable);
+
+	/* For markers given as (row,col) pairs find their offsets in the text stream.
+	   This code requires that the rows are already frozen. */
+	while (markers[num_markers] != nullptr)
+		num_markers++;
+	marker_text_offsets = (CellTextOffset *) g_malloc(num_markers * sizeof (marker_text_offsets[0]));
+	new_markers = (VteVisualPosition *) g_malloc(num_markers * sizeof (new_markers[0]));
+	order = sort_markers(markers, num_markers);
+
+	/* Find the paragraph boundary above which the rows are left for later.
+	   Give up on this if it isn't well above m_start. */
+	boundary = m_start;
+	if (length() > m_visible_rows + 2 * VTE_REWRAP_SYNC_ROWS) {
+		RowRecord record;
+		boundary = m_end - m_visible_rows - VTE_REWRAP_SYNC_ROWS;
+		while (boundary > m_start + VTE_REWRAP_SYNC_ROWS) {
+			if (!read_row_record(&record, boundary - 1))
+				goto err;
+			if (!record.soft_wrapped)
+				break;
+			boundary--;
+		}
+		if (boundary <= m_start + VTE_REWRAP_SYNC_ROWS)
+			boundary = m_start;
+	}
+
+	/* The rows above the boundary are moved so that their rewrapped versions
+	   will fit above tail_start without renumbering the rest again. Every new
+	   row contains at least one byte of text, so the number of text bytes is an
+	   upper bound for the number of new rows. */
+	head_rows = boundary - m_start;
+	tail_start = 0;
+	if (head_rows > 0) {
+		RowRecord records[2];
+		if (!read_row_record(&records[0], m_start) ||
+		    !read_row_record(&records[1], boundary))
+			goto err;
+		tail_start = MAX(boundary, records[1].text_start_offset - records[0].text_start_offset);
+	}
+
+	for (i = 0; i < num_markers; i++) {
+		new_markers[i].row = new_markers[i].col = -1;
+		if (head_rows > 0 && markers[i]->row < (glong) boundary)
+			continue;
+		/* Convert visual column into byte offset */
+		if (!frozen_row_column_to_text_offset(markers[i]->row, markers[i]->col, &marker_text_offsets[i]))
+			goto err;
+		_vte_debug_print(VTE_DEBUG_RING,
+				"Marker #%d old coords:  row %ld  col %ld  ->  text_offset %" G_GSIZE_FORMAT " fragment_cells %d  eol_cells %d\n",
+				i, markers[i]->row, markers[i]->col, marker_text_offsets[i].text_offset,
+				marker_text_offsets[i].fragment_cells, marker_text_offsets[i].eol_cells);
+	}
+
+	/* Rewrap */
+	_vte_stream_reset(new_row_stream, (tail_start - head_rows) * sizeof (RowRecord));
+	if (!copy_row_records(m_row_stream, m_start, head_rows, new_row_stream, sizeof (RowRecord)))
+		goto err;
+	if (!rewrap_rows(boundary, m_end, columns, G_MAXULONG, new_row_stream, &n_records, &next))
+		goto err;
+
+	/* Find the markers' new rows; this needs the new row stream only.
+	   Their text offsets only grow in this order. */
+	search_start = tail_start;
+	for (auto idx : order) {
+		i = idx;
+		if (head_rows > 0 && markers[i]->row < (glong) boundary) {
+			new_markers[i].row = markers[i]->row - boundary + tail_start;
+			new_markers[i].col = markers[i]->col;
+		} else if (markers[i]->row < (glong) m_end &&
+			   marker_text_offsets[i].text_offset < _vte_stream_head(m_text_stream)) {
+			row_t row;
+			if (!find_row_record(new_row_stream, search_start, tail_start + n_records,
+					     marker_text_offsets[i].text_offset, &row))
+				goto err;
+			new_markers[i].row = row;
+			search_start = row;
+			_vte_debug_print(VTE_DEBUG_RING,
+					"      Marker #%d will be here in row %lu\n", i, row);
 		}
-		new_row_index++;
-		paragraph_start_text_offset = paragraph_end_text_offset;
 	}
 
 	/* Update the ring. */
 	old_ring_end = m_end;
 	g_object_unref(m_row_stream);
 	m_row_stream = new_row_stream;
-	m_writable = m_end = new_row_index;
-	m_start = 0;
-	if (m_end > m_max)
+	m_writable = m_end = tail_start + n_records;
+	m_start = tail_start - head_rows;
+	if (m_end - m_start > m_max)
 		m_start = m_end - m_max;
-	m_cached_row_num = (row_t) -1;
+        invalidate_cached_rows();
 
 	/* Find the markers. This requires that the ring is already updated. */
 	for (i = 0; i < num_markers; i++) {
+		if (head_rows > 0 && markers[i]->row < (glong) boundary) {
+			markers[i]->row = new_markers[i].row;
+			continue;
+		}
 		/* Compute the row for markers beyond the ring */
 		if (new_markers[i].row == -1)
 			new_markers[i].row = markers[i]->row - old_ring_end + m_end;
@@ -1380,6 +2890,17 @@ Ring::rewrap(column_t columns,
 	g_free(marker_text_offsets);
 	g_free(new_markers);
 
+	/* Leave the rest for later, unless it's gone already */
+	if (m_start < tail_start) {
+		m_rewrap_stream = new_stream(false);
+		m_rewrap_columns = columns;
+		m_rewrap_end = tail_start;
+		m_rewrap_next = m_start;
+		m_rewrap_n_records = 0;
+		_vte_debug_print(VTE_DEBUG_RING, "Rows %lu..%lu are left for rewrapping later.\n",
+				 m_start, m_rewrap_end);
+	}
+
 	_vte_debug_print(VTE_DEBUG_RING, "Ring after rewrapping:\n");
         validate();
 	return;
@@ -1395,6 +2916,171 @@ err:
 	g_free(new_markers);
 }
 
+/**
+ * Ring::rewrap_step:
+ * @max_rows: the number of rows to rewrap at most (give or take a paragraph)
+ *
+ * Continues rewrapping the rows that rewrap() left for later, without
+ * changing the ring yet; rewrap_finish() does that.
+ *
+ * Returns: %true if there's nothing left to do except for rewrap_finish()
+ */
+bool
+Ring::rewrap_step(row_t max_rows)
+{
+	row_t n_records;
+
+	if (m_rewrap_stream == nullptr)
+		return true;
+
+	/* The rows scrolled out in the meantime are skipped. If this happens in
+	   the middle of a paragraph, its rest starts a new one, as in rewrap(). */
+	m_rewrap_next = MAX(m_rewrap_next, m_start);
+	if (m_rewrap_next >= m_rewrap_end)
+		return true;
+
+	if (!rewrap_rows(m_rewrap_next, m_rewrap_end, m_rewrap_columns, max_rows,
+			 m_rewrap_stream, &n_records, &m_rewrap_next)) {
+#ifdef VTE_DEBUG
+		_vte_debug_print(VTE_DEBUG_RING,
+				"Error while rewrapping\n");
+		g_assert_not_reached();
+#endif
+		rewrap_cancel();
+		return true;
+	}
+	m_rewrap_n_records += n_records;
+
+	return m_rewrap_next >= m_rewrap_end;
+}
+
+/**
+ * Ring::rewrap_finish:
+ * @markers: 0-terminated array of #VteVisualPosition
+ *
+ * Rewraps whatever is left from the last rewrap(), and puts the new rows in
+ * place of the old ones. Only the markers above the rows already rewrapped
+ * move, the ones below stay where they are.
+ */
+void
+Ring::rewrap_finish(VteVisualPosition** markers)
+{
+	RowRecord record;
+	row_t first, n_records, old_start, new_start, search_start;
+	int i;
+	int num_markers = 0;
+	CellTextOffset *marker_text_offsets;
+	VteStream *new_row_stream;
+	std::vector<int> order;
+
+	if (m_rewrap_stream == nullptr)
+		return;
+
+	/* All of what is left at once, so on the pool threads */
+	m_rewrap_next = MAX(m_rewrap_next, m_start);
+	if (m_rewrap_next < m_rewrap_end) {
+		if (!rewrap_rows_parallel(m_rewrap_next, m_rewrap_end, m_rewrap_columns,
+					  m_rewrap_stream, &n_records)) {
+#ifdef VTE_DEBUG
+			_vte_debug_print(VTE_DEBUG_RING,
+					"Error while rewrapping\n");
+			g_assert_not_reached();
+#endif
+			rewrap_cancel();
+			return;
+		}
+		m_rewrap_n_records += n_records;
+		m_rewrap_next = m_rewrap_end;
+	}
+	if (m_start >= m_rewrap_end) {
+		rewrap_cancel();
+		return;
+	}
+
+	_vte_debug_print(VTE_DEBUG_RING, "Ring before finishing rewrapping:\n");
+        validate();
+
+	while (markers[num_markers] != nullptr)
+		num_markers++;
+	marker_text_offsets = (CellTextOffset *) g_malloc(num_markers * sizeof (marker_text_offsets[0]));
+	order = sort_markers(markers, num_markers);
+	new_row_stream = new_stream(false);
+
+	/* Skip the new rows of the text that has been scrolled out since. The
+	   first remaining one may be missing its beginning, see "Bugs" in
+	   ../doc/rewrap.txt. */
+	if (!read_row_record(&record, m_start))
+		goto err;
+	if (!find_row_record(m_rewrap_stream, 0, m_rewrap_n_records, record.text_start_offset, &first))
+		goto err;
+	if (m_rewrap_n_records > 0) {
+		RowRecord first_record;
+		if (!_vte_stream_read(m_rewrap_stream, first * sizeof (first_record),
+				      (char *) &first_record, sizeof (first_record)))
+			goto err;
+		if (first_record.text_start_offset < record.text_start_offset)
+			first++;
+	}
+	n_records = m_rewrap_n_records - first;
+	if (G_UNLIKELY (n_records > m_rewrap_end)) {
+		first += n_records - m_rewrap_end;
+		n_records = m_rewrap_end;
+	}
+	new_start = m_rewrap_end - n_records;
+
+	for (i = 0; i < num_markers; i++) {
+		if (markers[i]->row < (glong) m_start || markers[i]->row >= (glong) m_rewrap_end)
+			continue;
+		if (!frozen_row_column_to_text_offset(markers[i]->row, markers[i]->col, &marker_text_offsets[i]))
+			goto err;
+	}
+
+	_vte_stream_reset(new_row_stream, new_start * sizeof (RowRecord));
+	if (!copy_row_records(m_rewrap_stream, first, n_records, new_row_stream, sizeof (RowRecord)) ||
+	    !copy_row_records(m_row_stream, m_rewrap_end, m_writable - m_rewrap_end, new_row_stream, sizeof (RowRecord)))
+		goto err;
+
+	/* Update the ring */
+	g_object_unref(m_row_stream);
+	m_row_stream = new_row_stream;
+	old_start = m_start;
+	m_start = new_start;
+	if (m_end - m_start > m_max)
+		m_start = m_end - m_max;
+        invalidate_cached_rows();
+
+	/* As in rewrap(), each marker's row is searched for from the previous one's on */
+	search_start = new_start;
+	for (auto idx : order) {
+		row_t row;
+		i = idx;
+		if (markers[i]->row < (glong) old_start || markers[i]->row >= (glong) m_rewrap_end)
+			continue;
+		if (!find_row_record(m_row_stream, search_start, m_rewrap_end,
+				     marker_text_offsets[i].text_offset, &row))
+			goto err;
+		markers[i]->row = row;
+		search_start = row;
+		if (!frozen_row_text_offset_to_column(row, &marker_text_offsets[i], &markers[i]->col))
+			goto err;
+	}
+	g_free(marker_text_offsets);
+	rewrap_cancel();
+
+	_vte_debug_print(VTE_DEBUG_RING, "Ring after finishing rewrapping:\n");
+        validate();
+	return;
+
+err:
+#ifdef VTE_DEBUG
+	_vte_debug_print(VTE_DEBUG_RING,
+			"Error while rewrapping\n");
+	g_assert_not_reached();
+#endif
+	g_object_unref(new_row_stream);
+	g_free(marker_text_offsets);
+	rewrap_cancel();
+}
 
 bool
 Ring::write_row(GOutputStream* stream,
@@ -1403,22 +3089,31 @@ Ring::write_row(GOutputStream* stream,
                 GCancellable* cancellable,
                 GError** error)
 {
-	VteCell *cell;
 	GString *buffer = m_utf8_buffer;
-	int i;
 	gsize bytes_written;
 
+	g_string_set_size (buffer, 0);
+	append_row_text(row, buffer);
+
+	return g_output_stream_write_all (stream, buffer->str, buffer->len, &bytes_written, cancellable, error);
+}
+
+void
+Ring::append_row_text(VteRowData const* row,
+                      GString* buffer) const
+{
+	VteCell const* cell;
+	int i, len = frozen_length(row);
+
 	/* Simple version of the loop in freeze_row().
 	 * TODO Should unify one day */
-	g_string_set_size (buffer, 0);
-	for (i = 0, cell = row->cells; i < row->len; i++, cell++) {
+	for (i = 0; i < len; i++) {
+		cell = _vte_row_data_get(row, i);
 		if (G_LIKELY (!cell->attr.fragment()))
 			_vte_unistr_append_to_string (cell->c, buffer);
 	}
 	if (!row->attr.soft_wrapped)
 		g_string_append_c (buffer, '\n');
-
-	return g_output_stream_write_all (stream, buffer->str, buffer->len, &bytes_written, cancellable, error);
 }
 
 /**
@@ -1483,3 +3178,468 @@ Ring::write_contents(GOutputStream* stream,
 
 	return true;
 }
+
+/**
+ * Ring::export_contents:
+ * @flags: a set of #VteWriteFlags
+ *
+ * Takes a snapshot of the ring contents like write_contents() writes
+ * them, to be read with Export::read().
+ *
+ * Return: a new #Ring::Export, or %nullptr if the streams can't be read
+ */
+Ring::Export*
+Ring::export_contents(VteWriteFlags flags)
+{
+        auto start = size_t{0}, end = size_t{0};
+
+	_vte_debug_print(VTE_DEBUG_RING, "Exporting contents.\n");
+
+	if (m_start < m_writable) {
+		RowRecord record;
+
+		if (!read_row_record(&record, m_start))
+			return nullptr;
+
+                start = record.text_start_offset;
+                end = _vte_stream_head(m_text_stream);
+	}
+
+        auto e = new Export{this, start, end};
+	for (auto i = m_writable; i < m_end; i++)
+                append_row_text(get_writable_index(i), e->m_rest);
+        e->m_size = end - start + e->m_rest->len;
+
+        m_exports.push_back(e);
+        return e;
+}
+
+/* Returns: the offset up to which the text stream may drop its tail */
+size_t
+Ring::export_pin(size_t offset) const
+{
+        for (auto e : m_exports) {
+                if (e->m_stream == m_text_stream)
+                        offset = MIN(offset, e->m_offset);
+        }
+        return offset;
+}
+
+/* Called before truncating the text stream at @offset */
+void
+Ring::export_copy_on_write(size_t offset)
+{
+        for (auto e : m_exports) {
+                if (e->m_stream != m_text_stream || e->m_end <= offset)
+                        continue;
+
+                auto start = MAX(offset, e->m_offset);
+                auto len = e->m_end - start;
+                auto copy = g_string_sized_new(len + e->m_rest->len);
+                g_string_set_size(copy, len);
+                if (!_vte_stream_read(m_text_stream, start, copy->str, len))
+                        memset(copy->str, 0, len);
+                g_string_append_len(copy, e->m_rest->str, e->m_rest->len);
+                g_string_free(e->m_rest, TRUE);
+                e->m_rest = copy;
+                e->m_end = start;
+        }
+}
+
+Ring::Export::Export(Ring* ring,
+                     size_t start,
+                     size_t end)
+        : m_ring{ring},
+          m_stream{ring->m_has_streams ? (VteStream*)g_object_ref(ring->m_text_stream) : nullptr},
+          m_offset{start},
+          m_end{end},
+          m_rest{g_string_new(nullptr)},
+          m_size{0}
+{
+}
+
+Ring::Export::~Export()
+{
+        if (m_ring != nullptr) {
+                auto& exports = m_ring->m_exports;
+                exports.erase(std::find(exports.begin(), exports.end(), this));
+        }
+
+        if (m_stream != nullptr)
+                g_object_unref(m_stream);
+        g_string_free(m_rest, TRUE);
+}
+
+/**
+ * Ring::Export::read:
+ * @data: a buffer
+ * @len: the size of @data
+ *
+ * Reads the next part of the contents.
+ *
+ * Return: the number of bytes read into @data, 0 at the end, -1 on error
+ */
+gssize
+Ring::Export::read(char* data,
+                   size_t len)
+{
+        auto n = size_t{0};
+
+        if (m_offset < m_end) {
+                n = MIN(len, m_end - m_offset);
+                if (!_vte_stream_read(m_stream, m_offset, data, n))
+                        return -1;
+                m_offset += n;
+        } else if (m_rest_offset < m_rest->len) {
+                n = MIN(len, m_rest->len - m_rest_offset);
+                memcpy(data, m_rest->str + m_rest_offset, n);
+                m_rest_offset += n;
+        }
+
+        m_position += n;
+        return n;
+}
+
+/*
+ * The format of Ring::save():
+ *
+ * A SavedHeader, the hyperlink of its last_attr, then all the rows frozen
+ * like in the streams: the row records, the text and the attr changes,
+ * as they are in the streams. Stream offsets are kept as they were, the
+ * saved text and attr changes starting at text_start and attr_start.
+ *
+ * The data is in the native byte order and layout, since it is meant to
+ * restore sessions on the same machine.
+ */
+#define VTE_RING_SAVE_MAGIC "VTERING"
+#define VTE_RING_SAVE_VERSION 3
+
+typedef struct _SavedHeader {
+        char magic[8];
+        guint32 version;
+        guint32 record_size;       /* for checking the layout */
+        guint32 columns;
+        guint64 n_rows;
+        guint64 text_start;
+        guint64 text_len;
+        guint64 attr_start;
+        guint64 attr_len;
+        guint64 last_attr_text_start_offset;
+        gint64 cursor_row;         /* relative to the first row */
+        gint64 cursor_col;
+        VteCellAttr last_attr;
+        guint32 last_attr_hyperlink_length;
+} SavedHeader;
+
+/**
+ * Ring::save:
+ * @stream: a #GOutputStream to write to
+ * @start: the first row to save; rows before the ring's start are not there
+ * @columns: the number of columns the rows are wrapped at
+ * @cursor: the cursor position
+ * @cancellable: optional #GCancellable object, %nullptr to ignore
+ * @error: a #GError location to store the error occuring, or %nullptr to ignore
+ *
+ * Writes the ring contents from @start to @stream in a binary format that
+ * restore() reads back without parsing the text again. This also works for
+ * rings without streams, whose rows are all writable.
+ *
+ * Return: %TRUE on success, %FALSE if there was an error
+ */
+bool
+Ring::save(GOutputStream* stream,
+           row_t start,
+           column_t columns,
+           VteVisualPosition const& cursor,
+           GCancellable* cancellable,
+           GError** error)
+{
+        gsize bytes_written;
+        bool ok = false;
+
+	_vte_debug_print(VTE_DEBUG_RING, "Saving contents.\n");
+
+        auto const first = CLAMP(start, m_start, m_end);
+        auto const text_head = m_has_streams ? _vte_stream_head(m_text_stream) : 0;
+        auto const attr_head = m_has_streams ? _vte_stream_head(m_attr_stream) : 0;
+        auto text_start = text_head, attr_start = attr_head;
+	if (first < m_writable) {
+		RowRecord record;
+
+		if (!read_row_record(&record, first)) {
+                        g_set_error_literal(error, G_IO_ERROR, G_IO_ERROR_FAILED, "Failed to read the scrollback");
+			return false;
+                }
+                text_start = record.text_start_offset;
+                attr_start = record.attr_start_offset;
+	}
+
+        /* Freeze the writable rows into the buffers, as if they followed the
+         * frozen ones, leaving the ring as it is. */
+        auto const saved_last_attr = m_last_attr;
+        auto const saved_last_hyperlink_idx = m_last_hyperlink_idx;
+        auto const saved_last_attr_text_start_offset = m_last_attr_text_start_offset;
+        if (first >= m_writable) {
+                m_last_attr_text_start_offset = 0;
+                m_last_attr = basic_cell.attr;
+                m_last_hyperlink_idx = 0;
+        }
+	g_string_set_size (m_utf8_buffer, 0);
+	g_string_set_size (m_attr_buffer, 0);
+	g_string_set_size (m_record_buffer, 0);
+	for (auto i = MAX(first, m_writable); i < m_end; i++)
+                freeze_row(i, get_writable_index(i), text_head, attr_head);
+
+        auto const hyperlink = hyperlink_get(m_last_hyperlink_idx);
+        auto header = SavedHeader{};
+        memcpy(header.magic, VTE_RING_SAVE_MAGIC, sizeof(header.magic));
+        header.version = VTE_RING_SAVE_VERSION;
+        header.record_size = sizeof(RowRecord);
+        header.columns = columns;
+        header.n_rows = m_end - first;
+        header.text_start = text_start;
+        header.text_len = text_head - text_start + m_utf8_buffer->len;
+        header.attr_start = attr_start;
+        header.attr_len = attr_head - attr_start + m_attr_buffer->len;
+        header.last_attr_text_start_offset = MAX(m_last_attr_text_start_offset, text_start);
+        header.cursor_row = cursor.row - first;
+        header.cursor_col = cursor.col;
+        header.last_attr = m_last_attr;
+        header.last_attr_hyperlink_length = hyperlink->len;
+
+        m_last_attr = saved_last_attr;
+        m_last_hyperlink_idx = saved_last_hyperlink_idx;
+        m_last_attr_text_start_offset = saved_last_attr_text_start_offset;
+
+        /* Many small writes below */
+        auto out = g_buffered_output_stream_new_sized(stream, 256 * 1024);
+        g_filter_output_stream_set_close_base_stream(G_FILTER_OUTPUT_STREAM(out), false);
+
+        auto write = [&](void const* data, size_t len) -> bool {
+                return g_output_stream_write_all(out, data, len, &bytes_written, cancellable, error);
+        };
+        /* Copies @stream from @start to @end */
+        auto write_stream = [&](VteStream* from, size_t offset, size_t end) -> bool {
+                while (offset < end) {
+                        char buf[4096];
+                        auto len = MIN(sizeof(buf), end - offset);
+                        if (!_vte_stream_read(from, offset, buf, len)) {
+                                g_set_error_literal(error, G_IO_ERROR, G_IO_ERROR_FAILED, "Failed to read the scrollback");
+                                return false;
+                        }
+                        if (!write(buf, len))
+                                return false;
+                        offset += len;
+                }
+                return true;
+        };
+
+        if (!write(&header, sizeof(header)) ||
+            !write(hyperlink->str, hyperlink->len))
+                goto out;
+
+        /* Row records */
+        for (auto i = first; i < m_writable; i++) {
+                RowRecord record;
+                if (!read_row_record(&record, i)) {
+                        g_set_error_literal(error, G_IO_ERROR, G_IO_ERROR_FAILED, "Failed to read the scrollback");
+                        goto out;
+                }
+                if (!write(&record, sizeof(record)))
+                        goto out;
+        }
+        if (!write(m_record_buffer->str, m_record_buffer->len))
+                goto out;
+
+        /* Text and attr changes */
+        if (!write_stream(m_text_stream, text_start, text_head) ||
+            !write(m_utf8_buffer->str, m_utf8_buffer->len) ||
+            !write_stream(m_attr_stream, attr_start, attr_head) ||
+            !write(m_attr_buffer->str, m_attr_buffer->len))
+                goto out;
+
+        ok = g_output_stream_flush(out, cancellable, error);
+
+out:
+        g_object_unref(out);
+        return ok;
+}
+
+/**
+ * Ring::restore:
+ * @stream: a #GInputStream to read from
+ * @columns: (out): the number of columns the rows were wrapped at
+ * @cursor: (out): the saved cursor position
+ * @cancellable: optional #GCancellable object, %nullptr to ignore
+ * @error: a #GError location to store the error occuring, or %nullptr to ignore
+ *
+ * Replaces the ring contents with what save() wrote to @stream. The rows
+ * follow the current ones, and are all frozen; in a ring without streams
+ * they are all thawed instead. On error, the ring is left unchanged.
+ *
+ * Return: %TRUE on success, %FALSE if there was an error
+ */
+bool
+Ring::restore(GInputStream* stream,
+              column_t* columns,
+              VteVisualPosition* cursor,
+              GCancellable* cancellable,
+              GError** error)
+{
+        auto header = SavedHeader{};
+        char hyperlink[VTE_HYPERLINK_TOTAL_LENGTH_MAX + 1];
+        char buf[4096];
+        VteStream *text_stream, *attr_stream, *row_stream;
+        RowRecord record, prev_record;
+        TextIndex text_index{};
+        gsize bytes_read;
+        bool ok = false;
+
+	_vte_debug_print(VTE_DEBUG_RING, "Restoring contents.\n");
+
+        auto const has_streams = m_has_streams;
+        auto in = g_buffered_input_stream_new_sized(stream, 256 * 1024);
+        g_filter_input_stream_set_close_base_stream(G_FILTER_INPUT_STREAM(in), false);
+
+        /* Returns false on error, or if the data ended early */
+        auto read = [&](void* data, size_t len) -> bool {
+                if (!g_input_stream_read_all(in, data, len, &bytes_read, cancellable, error))
+                        return false;
+                if (bytes_read == len)
+                        return true;
+                g_set_error_literal(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "Truncated scrollback data");
+                return false;
+        };
+        auto invalid = [&]() {
+                g_set_error_literal(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "Invalid scrollback data");
+        };
+
+        if (!read(&header, sizeof(header)))
+                goto out_in;
+        if (memcmp(header.magic, VTE_RING_SAVE_MAGIC, sizeof(header.magic)) != 0 ||
+            header.version != VTE_RING_SAVE_VERSION ||
+            header.record_size != sizeof(RowRecord) ||
+            header.n_rows > G_MAXLONG / sizeof(RowRecord) ||
+            header.text_len > G_MAXSIZE - header.text_start ||
+            header.attr_len > G_MAXSIZE - header.attr_start ||
+            header.last_attr_text_start_offset < header.text_start ||
+            header.last_attr_text_start_offset > header.text_start + header.text_len ||
+            header.last_attr_hyperlink_length > VTE_HYPERLINK_TOTAL_LENGTH_MAX) {
+                invalid();
+                goto out_in;
+        }
+        if (!read(hyperlink, header.last_attr_hyperlink_length))
+                goto out_in;
+        hyperlink[header.last_attr_hyperlink_length] = '\0';
+
+        /* Fill new streams, with offsets as in the data, and swap them in
+         * when all of it checks out. */
+        text_stream = new_stream(true);
+        attr_stream = new_stream(true);
+        row_stream = new_stream(false);
+        _vte_stream_reset(text_stream, header.text_start);
+        _vte_stream_reset(attr_stream, header.attr_start);
+        _vte_stream_reset(row_stream, m_end * sizeof(RowRecord));
+
+        memset(&prev_record, 0, sizeof(prev_record));
+        prev_record.text_start_offset = header.text_start;
+        prev_record.attr_start_offset = header.attr_start;
+        for (auto i = guint64{0}; i < header.n_rows; i++) {
+                if (!read(&record, sizeof(record)))
+                        goto out_streams;
+                if (record.text_start_offset < prev_record.text_start_offset ||
+                    record.text_start_offset > header.text_start + header.text_len ||
+                    record.attr_start_offset < prev_record.attr_start_offset ||
+                    record.attr_start_offset > header.attr_start + header.attr_len) {
+                        invalid();
+                        goto out_streams;
+                }
+                _vte_stream_append(row_stream, (char const*)&record, sizeof(record));
+                prev_record = record;
+        }
+
+        text_index.reset(header.text_start);
+        for (auto offset = header.text_start; offset < header.text_start + header.text_len; ) {
+                auto len = MIN(sizeof(buf), header.text_start + header.text_len - offset);
+                if (!read(buf, len))
+                        goto out_streams;
+                text_index.add(offset, buf, len);
+                _vte_stream_append(text_stream, buf, len);
+                offset += len;
+        }
+
+        for (auto offset = guint64{0}; offset < header.attr_len; ) {
+                auto len = MIN(sizeof(buf), header.attr_len - offset);
+                if (!read(buf, len))
+                        goto out_streams;
+                _vte_stream_append(attr_stream, buf, len);
+                offset += len;
+        }
+
+        /* Check that the attr changes are all there */
+        for (auto offset = header.attr_start; offset < header.attr_start + header.attr_len; ) {
+                CellAttrChange attr_change;
+                auto const len = read_attr_change(attr_stream, offset, &attr_change, nullptr);
+                if (len == 0 ||
+                    len > header.attr_start + header.attr_len - offset ||
+                    attr_change.text_end_offset > header.text_start + header.text_len)
+                        goto out_invalid;
+                offset += len;
+        }
+
+        maybe_notify_discard(m_end);
+        rewrap_cancel();
+        invalidate_cached_rows();
+
+        std::swap(m_text_stream, text_stream);
+        std::swap(m_attr_stream, attr_stream);
+        std::swap(m_row_stream, row_stream);
+        m_text_index = std::move(text_index);
+
+        m_start = m_end;
+        m_writable = m_end = m_start + header.n_rows;
+        m_last_attr = header.last_attr;
+        m_last_hyperlink_idx = get_hyperlink_idx_no_update_current(hyperlink);
+        m_last_attr_text_start_offset = header.last_attr_text_start_offset;
+
+        /* Without streams of its own, the ring thaws the rows from the new
+         * ones, which then go again */
+        if (!has_streams)
+                m_has_streams = true;
+
+        /* Restored rows beyond the limits go again */
+        while (length() > m_max)
+                discard_one_row();
+        if (m_max_bytes != 0 && has_streams)
+                discard_to_size(m_max_bytes);
+
+        if (!has_streams) {
+                ensure_writable(m_start);
+                m_has_streams = false;
+                std::swap(m_text_stream, text_stream);
+                std::swap(m_attr_stream, attr_stream);
+                std::swap(m_row_stream, row_stream);
+                m_text_index.reset(0);
+                reset_streams(m_writable);
+        }
+
+        *columns = header.columns;
+        cursor->row = m_end - header.n_rows + header.cursor_row;
+        cursor->col = header.cursor_col;
+
+        _vte_debug_print(VTE_DEBUG_RING, "Restored %" G_GUINT64_FORMAT " rows.\n", header.n_rows);
+        validate();
+        ok = true;
+        goto out_streams;
+
+out_invalid:
+        invalid();
+out_streams:
+        /* The old streams on success, the new ones otherwise */
+        g_object_unref(text_stream);
+        g_object_unref(attr_stream);
+        g_object_unref(row_stream);
+out_in:
+        g_object_unref(in);
+        return ok;
+}
@@ -25,10 +25,13 @@
 #include <gio/gio.h>
 #include <vte/vte.h>
 
+#include "textindex.hh"
 #include "vterowdata.hh"
 #include "vtestream.h"
 
+#include <string>
 #include <type_traits>
+#include <vector>
 
 typedef struct _VteVisualPosition {
 	long row, col;
@@ -69,15 +72,25 @@ public:
         inline row_t delta() const { return m_start; }
         inline row_t length() const { return m_end - m_start; }
         inline row_t next() const { return m_end; }
+        /* The rows from here on are in m_array, the ones before in the streams */
+        inline row_t writable() const { return m_writable; }
 
         //FIXMEchpe rename this to at()
         //FIXMEchpe use references not pointers
         VteRowData const* index(row_t position); /* const? */
         VteRowData* index_writable(row_t position);
+        bool prefetch(row_t* start,
+                      row_t* end,
+                      bool backward,
+                      row_t max_rows);
         bool is_soft_wrapped(row_t position);
+        ByteSet text_bytes(row_t start,
+                           row_t end);
 
         void hyperlink_maybe_gc(row_t increment);
+        static void unistr_maybe_gc();
         hyperlink_idx_t get_hyperlink_idx(char const* hyperlink);
+        inline char const* hyperlink(hyperlink_idx_t idx) const { return idx < m_hyperlinks->len ? hyperlink_get(idx)->str : ""; }
         hyperlink_idx_t get_hyperlink_at_position(row_t position,
                                                   column_t col,
                                                   bool update_hover_idx,
@@ -85,19 +98,108 @@ public:
 
         row_t reset();
         void resize(row_t max_rows = kDefaultMaxRows);
+        void set_max_bytes(size_t max_bytes);
+        inline size_t max_bytes() const { return m_max_bytes; }
+        size_t stream_size() const;
+        size_t stream_length() const;
+        /* The bytes on the heap of the rows in m_array, of the thawed rows
+         * and of the hyperlink pool */
+        size_t rows_size() const;
+        size_t cached_rows_size() const;
+        size_t hyperlinks_size() const;
+        /* The number of rows written to and read back from the streams so far */
+        inline uint64_t n_rows_frozen() const noexcept { return m_n_rows_frozen; }
+        inline uint64_t n_rows_thawed() const noexcept { return m_n_rows_thawed; }
+        static void set_budget(size_t budget);
+        static inline size_t budget() { return s_budget; }
+        using evict_func_t = void(*)(void*);
+        inline void set_evict_func(evict_func_t func,
+                                   void* data) {
+                m_evict_func = func;
+                m_evict_data = data;
+        }
+        /* @func is called once, before the ring drops @row or a later row */
+        using discard_watch_func_t = void(*)(void*);
+        inline void set_discard_watch(row_t row,
+                                      discard_watch_func_t func,
+                                      void* data) {
+                m_discard_watch_row = row;
+                m_discard_watch_func = func;
+                m_discard_watch_data = data;
+        }
         void shrink(row_t max_len = kDefaultMaxRows);
         VteRowData* insert(row_t position, guint8 bidi_flags);
         VteRowData* append(guint8 bidi_flags);
+        void append_rows(row_t n,
+                         guint8 bidi_flags);
         void remove(row_t position);
+        void rotate(row_t start,
+                    row_t end,
+                    long count,
+                    guint8 bidi_flags);
         void drop_scrollback(row_t position);
         void set_visible_rows(row_t rows);
         void rewrap(column_t columns,
                     VteVisualPosition** markers);
+        bool rewrap_step(row_t max_rows);
+        void rewrap_finish(VteVisualPosition** markers);
+        inline bool rewrap_pending() const { return m_rewrap_stream != nullptr; }
+        inline row_t rewrap_pending_end() const { return m_rewrap_end; }
         bool write_contents(GOutputStream* stream,
                             VteWriteFlags flags,
                             GCancellable* cancellable,
                             GError** error);
 
+        /* A snapshot of the contents for writing them out piece by piece,
+         * while the ring goes on changing. It reads the frozen rows from the
+         * text stream as long as the ring leaves that part alone: the ring
+         * keeps the tail of the stream, copies what it is about to overwrite,
+         * and leaves the stream to the export when resetting it. */
+        class Export {
+        public:
+                ~Export();
+
+                Export(Export const&) = delete;
+                Export(Export&&) = delete;
+                Export& operator= (Export const&) = delete;
+                Export& operator= (Export&&) = delete;
+
+                gssize read(char* data,
+                            size_t len);
+                inline size_t size() const { return m_size; }
+                inline size_t position() const { return m_position; }
+
+        private:
+                friend class Ring;
+
+                Export(Ring* ring,
+                       size_t start,
+                       size_t end);
+
+                Ring* m_ring;
+                VteStream* m_stream;  /* the text stream, or nullptr */
+                size_t m_offset;      /* the part left to read from m_stream */
+                size_t m_end;
+                GString* m_rest;      /* what comes after m_end, copied */
+                size_t m_rest_offset{0};
+                size_t m_size;
+                size_t m_position{0};
+        };
+
+        Export* export_contents(VteWriteFlags flags);
+
+        bool save(GOutputStream* stream,
+                  row_t start,
+                  column_t columns,
+                  VteVisualPosition const& cursor,
+                  GCancellable* cancellable,
+                  GError** error);
+        bool restore(GInputStream* stream,
+                     column_t* columns,
+                     VteVisualPosition* cursor,
+                     GCancellable* cancellable,
+                     GError** error);
+
 private:
 
         #ifdef VTE_DEBUG
@@ -107,15 +209,34 @@ private:
         inline GString* hyperlink_get(hyperlink_idx_t idx) const { return (GString*)g_ptr_array_index(m_hyperlinks, idx); }
 
         inline VteRowData* get_writable_index(row_t position) const { return &m_array[position & m_mask]; }
+        void reverse_writable(row_t start,
+                              row_t end);
 
         void hyperlink_gc();
+        void unistr_mark() const;
         hyperlink_idx_t get_hyperlink_idx_no_update_current(char const* hyperlink);
 
+        /* An attr_stream entry, as decoded; see the Storage comment below */
         typedef struct _CellAttrChange {
                 gsize text_end_offset;  /* offset of first character no longer using this attr */
                 VteStreamCellAttr attr;
         } CellAttrChange;
 
+        static size_t append_attr_change(GString* buffer,
+                                         CellAttrChange const& attr_change,
+                                         GString const* hyperlink);
+        static size_t decode_attr_change(char const* data,
+                                         size_t len,
+                                         CellAttrChange* attr_change);
+        static size_t read_attr_change(VteStream* stream,
+                                       size_t offset,
+                                       CellAttrChange* attr_change,
+                                       char* hyperlink);
+        static size_t read_attr_change_before(VteStream* stream,
+                                              size_t offset,
+                                              CellAttrChange* attr_change,
+                                              char* hyperlink);
+
         typedef struct _RowRecord {
                 size_t text_start_offset;  /* offset where text of this row begins */
                 size_t attr_start_offset;  /* offset of the first character's attributes */
@@ -144,6 +265,16 @@ private:
                                         sizeof(*record));
         }
 
+        static inline bool read_row_record(VteStream* stream,
+                                           RowRecord* record /* out */,
+                                           row_t position)
+        {
+                return _vte_stream_read(stream,
+                                        position * sizeof(*record),
+                                        (char*)record,
+                                        sizeof(*record));
+        }
+
         inline void append_row_record(RowRecord const* record,
                                       row_t position)
         {
@@ -152,6 +283,9 @@ private:
                                    sizeof(*record));
         }
 
+        bool read_row_records(row_t position,
+                              RowRecord* records);
+        static size_t row_records_text_length(RowRecord const* records);
         bool frozen_row_column_to_text_offset(row_t position,
                                               column_t column,
                                               CellTextOffset* offset);
@@ -159,6 +293,53 @@ private:
                                               CellTextOffset const* offset,
                                               column_t* column);
 
+        bool find_row_record(VteStream* stream,
+                             row_t first,
+                             row_t last,
+                             gsize text_offset,
+                             row_t* position);
+        /* The streams that rewrap_rows() reads the frozen rows from, the
+         * ring's own or copies of a part of them */
+        struct RewrapSource {
+                VteStream* row_stream;
+                VteStream* attr_stream;
+                VteStream* text_stream;
+                row_t end;  /* of the row records */
+        };
+        struct RewrapJob;
+
+        bool rewrap_rows(row_t start,
+                         row_t end,
+                         column_t columns,
+                         row_t max_rows,
+                         VteStream* stream,
+                         row_t* n_records,
+                         row_t* next)
+        {
+                return rewrap_rows(RewrapSource{m_row_stream, m_attr_stream, m_text_stream, m_end},
+                                   start, end, columns, max_rows, stream, n_records, next);
+        }
+        bool rewrap_rows(RewrapSource const& source,
+                         row_t start,
+                         row_t end,
+                         column_t columns,
+                         row_t max_rows,
+                         VteStream* stream,
+                         row_t* n_records,
+                         row_t* next) const;
+        bool copy_rewrap_source(row_t start,
+                                row_t end,
+                                RewrapSource* source);
+        bool rewrap_rows_parallel(row_t start,
+                                  row_t end,
+                                  column_t columns,
+                                  VteStream* stream,
+                                  row_t* n_records);
+        static GThreadPool* rewrap_thread_pool();
+        static void rewrap_job_thread_func(void* data,
+                                           void* user_data);
+        void rewrap_cancel();
+
         bool write_row(GOutputStream* stream,
                        VteRowData* row,
                        VteWriteFlags flags,
@@ -168,20 +349,47 @@ private:
         void ensure_writable(row_t position);
         void ensure_writable_room();
 
-        void freeze_one_row();
-        void maybe_freeze_one_row();
+        void freeze_rows(row_t n);
+        void maybe_freeze_rows();
         void thaw_one_row();
         void discard_one_row();
+        void discard_rows(row_t start);
         void maybe_discard_one_row();
-
-        void freeze_row(row_t position,
-                        VteRowData const* row);
+        void check_limits(row_t n_rows);
+        bool discard_to_size(size_t max_bytes);
+        static void enforce_budget(Ring* current);
+
+        bool freeze_row(row_t position,
+                        VteRowData const* row,
+                        size_t text_base,
+                        size_t attr_base);
+        void remember_frozen_row(VteRowData const* row,
+                                 int len,
+                                 RowRecord const& record,
+                                 VteCellAttr const& start_attr,
+                                 size_t text_base,
+                                 size_t attr_base,
+                                 size_t attr_start);
+        bool freeze_row_again(VteRowData const* row,
+                              int len,
+                              size_t text_base,
+                              size_t attr_base);
         void thaw_row(row_t position,
                       VteRowData* row,
                       bool do_truncate,
                       int hyperlink_column,
                       char const** hyperlink);
+        void truncate_streams(row_t position,
+                              RowRecord const& record);
         void reset_streams(row_t position);
+        bool streams_fit_in_memory() const;
+        VteStream* new_stream(bool compress) const;
+        void update_streams();
+        void append_row_text(VteRowData const* row,
+                             GString* buffer) const;
+
+        size_t export_pin(size_t offset) const;
+        void export_copy_on_write(size_t offset);
 
 	row_t m_max;
 	row_t m_start{0};
@@ -200,32 +408,118 @@ private:
          * text_stream is the text in UTF-8.
          *
          * attr_stream contains entries that consist of:
-         *  - a VteCellAttrChange.
-         *  - a string of attr.hyperlink_length length containing the (typically empty) hyperlink data.
-         *    As far as the ring is concerned, this hyperlink data is opaque. Only the caller cares that
-         *    if nonempty, it actually contains the ID and URI separated with a semicolon. Not NUL terminated.
-         *  - 2 bytes repeating attr.hyperlink_length so that we can walk backwards.
+         *  - a byte with the length of the entry up to the hyperlink data, so that it can be
+         *    read without reading past its end.
+         *  - a byte of flags telling which of the fields below differ from basic_cell's,
+         *    and so are present.
+         *  - the text_end_offset of the CellAttrChange, as a varint (7 bits per byte,
+         *    least significant first, the high bit set on all but the last byte).
+         *  - the attr, fore, back and deco as varints, when present.
+         *  - the hyperlink's length as a varint, and a string of that length containing
+         *    the hyperlink data, when present. As far as the ring is concerned, this hyperlink
+         *    data is opaque. Only the caller cares that it actually contains the ID and URI
+         *    separated with a semicolon. Not NUL terminated.
+         *  - the length of the whole entry in 1 byte, or in 2 bytes with the high bit of the
+         *    last one set, so that we can walk backwards.
+         * Each entry stands on its own, so that the row records can point anywhere in the stream.
          */
 	bool m_has_streams;
+        bool m_streams_in_memory{false};  /* not in temporary files, see streams_fit_in_memory() */
 	VteStream *m_attr_stream, *m_text_stream, *m_row_stream;
 	size_t m_last_attr_text_start_offset{0};
 	VteCellAttr m_last_attr;
+        hyperlink_idx_t m_last_hyperlink_idx{0};  /* goes with m_last_attr */
 	GString *m_utf8_buffer;
-
-	VteRowData m_cached_row;
-	row_t m_cached_row_num{(row_t)-1};
+        TextIndex m_text_index{};  /* the bytes in each chunk of text_stream, for searching */
+	GString *m_attr_buffer;    /* attr_stream data of the rows being frozen */
+	GString *m_record_buffer;  /* row_stream data of the rows being frozen */
+
+        /* The last row frozen the slow way, and what it was frozen to, so that
+         * rows just like it, as polling tools and progress reports print by
+         * the thousand, are frozen to the same bytes without going over their
+         * cells again. Offsets are relative to the row's. Only rows without
+         * hyperlinks and combining characters are remembered, since their
+         * idxs may be given out again after a GC. */
+        struct {
+                std::vector<VteCell> cells{};
+                VteCellAttr start_attr;        /* m_last_attr before the row */
+                VteCellAttr end_attr;          /* and after */
+                std::string text{};
+                std::vector<CellAttrChange> attr_changes{};
+                size_t last_attr_text_start_offset{0};
+                bool sets_last_attr_text_start_offset{false};
+                bool skips_first_attr_change{false};
+                RowRecord record;
+        } m_frozen_row_memo;
+
+        /* Rows thawed from the streams for reading, in a table indexed by the row number
+         * and sized to a few screens, so that scrolling through the history, matching
+         * and getting the text again don't need to thaw the same rows again. */
+        class CachedRow {
+        public:
+                row_t num;
+                VteRowData row;
+        };
+        CachedRow* m_cached_rows{nullptr};
+        row_t m_cached_rows_mask{0};
+
+        inline CachedRow* get_cached_row(row_t position) const { return &m_cached_rows[position & m_cached_rows_mask]; }
+        void resize_cached_rows(row_t n_rows);
+        void invalidate_cached_rows();
+
+        /* The rows m_start..m_rewrap_end that rewrap() left for later still have
+         * their old width; m_rewrap_stream collects their new row records. */
+        VteStream* m_rewrap_stream{nullptr};
+        column_t m_rewrap_columns{0};
+        row_t m_rewrap_end{0};
+        row_t m_rewrap_next{0};
+        row_t m_rewrap_n_records{0};
 
         row_t m_visible_rows{0};  /* to keep at least a screenful of lines in memory, bug 646098 comment 12 */
 
+        /* The limit on stream_size() besides m_max, or 0. When the global
+         * budget makes this ring drop rows while another one is appending,
+         * m_evict_func is called so that the owner can update its view. */
+        size_t m_max_bytes{0};
+        evict_func_t m_evict_func{nullptr};
+        void* m_evict_data{nullptr};
+
+        /* See set_discard_watch() */
+        row_t m_discard_watch_row{0};
+        discard_watch_func_t m_discard_watch_func{nullptr};
+        void* m_discard_watch_data{nullptr};
+        inline void maybe_notify_discard(row_t end) {
+                /* The rows before @end are about to go */
+                if (G_UNLIKELY(m_discard_watch_func != nullptr) &&
+                    m_discard_watch_row < end) {
+                        auto func = m_discard_watch_func;
+                        m_discard_watch_func = nullptr;
+                        func(m_discard_watch_data);
+                }
+        }
+
+        std::vector<Export*> m_exports{};  /* in progress, see Ring::Export */
+
+        uint64_t m_n_rows_frozen{0};
+        uint64_t m_n_rows_thawed{0};
+
         GPtrArray *m_hyperlinks;  /* The hyperlink pool. Contains GString* items.
                                    [0] points to an empty GString, [1] to [VTE_HYPERLINK_COUNT_MAX] contain the id;uri pairs. */
         char m_hyperlink_buf[VTE_HYPERLINK_TOTAL_LENGTH_MAX + 1];  /* One more hyperlink buffer to get the value if it's not placed in the pool. */
+        GHashTable *m_hyperlink_index;  /* Maps the id;uri of the non-empty pool items (as keys owned by the pool) to their idx. */
+        std::vector<hyperlink_idx_t> m_hyperlink_free_idxs{};  /* The empty pool items, the lowest one at the back. */
         hyperlink_idx_t m_hyperlink_highest_used_idx{0};  /* 0 if no hyperlinks at all in the pool. */
+        hyperlink_idx_t m_hyperlink_n_live{0};  /* The number of idxs that survived the last GC. */
+        hyperlink_idx_t m_hyperlink_n_new{0};  /* The number of idxs handed out since the last GC. */
         hyperlink_idx_t m_hyperlink_current_idx{0};  /* The hyperlink idx used for newly created cells.
                                                    Must not be GC'd even if doesn't occur onscreen. */
         hyperlink_idx_t m_hyperlink_hover_idx{0};  /* The hyperlink idx of the hovered cell.
                                                  An idx is allocated on hover even if the cell is scrolled out to the streams. */
         row_t m_hyperlink_maybe_gc_counter{0};  /* Do a GC when it reaches 65536. */
+
+        static inline std::vector<Ring*> s_rings{};  /* All rings, for the vteunistr GC and the budget */
+        static inline size_t s_budget{0};  /* The limit on the stream_size() of all rings, or 0 */
+        static inline row_t s_budget_counter{0};  /* Check the budget when it reaches VTE_RING_BUDGET_CHECK_ROWS. */
 };
 
 }; /* namespace base */
@@ -252,7 +546,9 @@ static inline void _vte_ring_resize (VteRing *ring, gulong max_rows) { ring->res
 static inline void _vte_ring_shrink (VteRing *ring, gulong max_len) { ring->shrink(max_len); }
 static inline VteRowData *_vte_ring_insert (VteRing *ring, gulong position, guint8 bidi_flags) { return ring->insert(position, bidi_flags); }
 static inline VteRowData *_vte_ring_append (VteRing *ring, guint8 bidi_flags) { return ring->append(bidi_flags); }
+static inline void _vte_ring_append_rows (VteRing *ring, gulong n, guint8 bidi_flags) { ring->append_rows(n, bidi_flags); }
 static inline void _vte_ring_remove (VteRing *ring, gulong position) { ring->remove(position); }
+static inline void _vte_ring_rotate (VteRing *ring, gulong start, gulong end, glong count, guint8 bidi_flags) { ring->rotate(start, end, count, bidi_flags); }
 static inline void _vte_ring_drop_scrollback (VteRing *ring, gulong position) { ring->drop_scrollback(position); }
 static inline void _vte_ring_set_visible_rows (VteRing *ring, gulong rows) { ring->set_visible_rows(rows); }
 static inline void _vte_ring_rewrap (VteRing *ring, glong columns, VteVisualPosition **markers) { ring->rewrap(columns, markers); }
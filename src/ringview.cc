@@ -18,13 +18,83 @@
 
 #include <config.h>
 
+#include <algorithm>
+#include <atomic>
+#include <utility>
+#include <vector>
+
 #include "bidi.hh"
 #include "debug.h"
+#include "trace.hh"
 #include "vtedefines.hh"
 #include "vteinternal.hh"
 
 using namespace vte::base;
 
+namespace {
+
+/* The paragraphs of one RingView::update(), which the main thread and the
+ * pool threads take one at a time until there are none left. */
+struct ParagraphJob {
+        BidiRunner* runner;
+        std::pair<vte::grid::row_t, vte::grid::row_t> const* paragraphs;
+        size_t n_paragraphs;
+        bool do_bidi;
+        bool do_shaping;
+
+        std::atomic<size_t> next{0};
+        int n_pending{0};  /* the pool threads still running, protected by mutex */
+        GMutex mutex;
+        GCond cond;
+
+        void run() noexcept
+        {
+                for (auto i = next++; i < n_paragraphs; i = next++)
+                        runner->paragraph(paragraphs[i].first, paragraphs[i].second,
+                                          do_bidi, do_shaping);
+        }
+};
+
+void
+paragraph_job_thread_func(void* data,
+                          void* user_data)
+{
+        auto job = reinterpret_cast<ParagraphJob*>(data);
+        job->run();
+
+        g_mutex_lock(&job->mutex);
+        if (--job->n_pending == 0)
+                g_cond_signal(&job->cond);
+        g_mutex_unlock(&job->mutex);
+}
+
+/* Returns: the pool shared by all RingViews, or nullptr if there is only
+ * one processor */
+GThreadPool*
+paragraph_thread_pool()
+{
+        static GThreadPool* pool = nullptr;
+        static bool initialized = false;
+        if (G_LIKELY(initialized))
+                return pool;
+
+        initialized = true;
+        auto const n_threads = std::min(int(g_get_num_processors()) - 1, VTE_RINGVIEW_THREADS_MAX);
+        if (n_threads < 1)
+                return nullptr;
+
+        GError* error = nullptr;
+        pool = g_thread_pool_new(paragraph_job_thread_func, nullptr, n_threads, FALSE, &error);
+        if (pool == nullptr) {
+                _vte_debug_print (VTE_DEBUG_RINGVIEW, "Ringview: failed to create the thread pool: %s\n",
+                                                      error->message);
+                g_error_free(error);
+        }
+        return pool;
+}
+
+} // anon namespace
+
 RingView::RingView()
 {
         m_bidirunner = std::make_unique<BidiRunner>(this);
@@ -59,7 +129,17 @@ RingView::pause()
                 g_free (m_rows[i]);
         }
         g_free (m_rows);
+        m_rows = nullptr;
         m_rows_alloc_len = 0;
+        m_rows_len = 0;
+
+        for (i = 0; i < m_prev_rows_alloc_len; i++) {
+                _vte_row_data_fini(m_prev_rows[i]);
+                g_free (m_prev_rows[i]);
+        }
+        g_free (m_prev_rows);
+        m_prev_rows = nullptr;
+        m_prev_rows_alloc_len = 0;
 
         for (i = 0; i < m_bidirows_alloc_len; i++) {
                 delete m_bidirows[i];
@@ -68,6 +148,7 @@ RingView::pause()
         m_bidirows_alloc_len = 0;
 
         m_invalid = true;
+        m_reusable = false;
         m_paused = true;
 }
 
@@ -111,6 +192,7 @@ RingView::set_ring(Ring *ring)
 
         m_ring = ring;
         m_invalid = true;
+        m_reusable = false;
 }
 
 void
@@ -121,6 +203,7 @@ RingView::set_width(vte::grid::column_t width)
 
         m_width = width;
         m_invalid = true;
+        m_reusable = false;
 }
 
 void
@@ -177,6 +260,7 @@ RingView::set_enable_bidi(bool enable_bidi)
 
         m_enable_bidi = enable_bidi;
         m_invalid = true;
+        m_reusable = false;
 }
 
 void
@@ -187,13 +271,24 @@ RingView::set_enable_shaping(bool enable_shaping)
 
         m_enable_shaping = enable_shaping;
         m_invalid = true;
+        m_reusable = false;
 }
 
 void
 RingView::update()
 {
+        /* The copied rows hold vteunistr's, which a GC may have reused */
+        if (m_unistr_generation != _vte_unistr_get_generation()) {
+                m_unistr_generation = _vte_unistr_get_generation();
+                m_invalid = true;
+                m_reusable = false;
+        }
+
         if (!m_invalid)
                 return;
+
+        vte::base::Trace::Scope trace_scope{"ringview-update"};
+
         if (m_paused)
                 resume();
 
@@ -225,6 +320,14 @@ RingView::update()
          * this paragraph fragment is already longer than
          * VTE_RINGVIEW_PARAGRAPH_LENGTH_MAX lines, and thus the
          * BiDi code will skip it. */
+        /* Keep the previous rows, to tell which paragraphs changed. */
+        std::swap(m_rows, m_prev_rows);
+        std::swap(m_rows_alloc_len, m_prev_rows_alloc_len);
+        m_prev_top = m_top;
+        m_prev_rows_len = m_rows_len;
+        std::swap(m_paragraphs, m_prev_paragraphs);
+        m_paragraphs.clear();
+
         m_top = row;
         m_rows_len = 0;
         while (row < m_start + m_len + VTE_RINGVIEW_PARAGRAPH_LENGTH_MAX) {
@@ -272,26 +375,133 @@ RingView::update()
                                               m_start - m_top, (m_top + m_rows_len) - (m_start + m_len),
                                               m_top, m_top + m_rows_len - 1, m_rows_len);
 
+        /* Move the BiDi mappings along with their rows: the one of row r was at
+         * r - m_bidirows_start, and now goes to r - m_start. */
+        if (m_reusable && m_bidirows_start != m_start) {
+                auto const shift = m_start - m_bidirows_start;
+                auto const n = vte::grid::row_t{m_bidirows_alloc_len};
+                auto const first = ((shift % n) + n) % n;
+                std::rotate(m_bidirows, m_bidirows + first, m_bidirows + n);
+        }
+
         /* Loop through paragraphs of the extracted text, and do whatever we need to do on each paragraph. */
+        auto paragraphs = std::vector<std::pair<vte::grid::row_t, vte::grid::row_t>>{};
         auto top = m_top;
         row = top;
         while (row < m_top + m_rows_len) {
                 row_data = m_rows[row - m_top];
                 if (!row_data->attr.soft_wrapped || row == m_top + m_rows_len - 1) {
                         /* Found a paragraph from @top to @row, inclusive. */
-
-                        /* Run the BiDi algorithm. */
-                        m_bidirunner->paragraph(top, row + 1,
-                                                m_enable_bidi, m_enable_shaping);
-
-                        /* Doing syntax highlighting etc. come here in the future. */
-
+                        m_paragraphs.emplace_back(top, row + 1);
+                        /* Only the paragraphs that changed need BiDi again. */
+                        if (!paragraph_is_unchanged(top, row + 1))
+                                paragraphs.emplace_back(top, row + 1);
                         top = row + 1;
                 }
                 row++;
         }
 
+        _vte_debug_print (VTE_DEBUG_RINGVIEW, "Ringview: %zu of %zu paragraphs changed.\n",
+                                              paragraphs.size(), m_paragraphs.size());
+
+        /* Run the BiDi algorithm. Paragraphs only touch their own rows of
+         * m_rows and m_bidirows, so with enough work they can be done in
+         * parallel. */
+        if ((m_enable_bidi || m_enable_shaping) &&
+            m_len >= VTE_RINGVIEW_PARALLEL_ROWS &&
+            paragraphs.size() > 1)
+                update_paragraphs_parallel(paragraphs.data(), paragraphs.size());
+        else
+                for (auto const& paragraph : paragraphs)
+                        m_bidirunner->paragraph(paragraph.first, paragraph.second,
+                                                m_enable_bidi, m_enable_shaping);
+
+        /* Doing syntax highlighting etc. come here in the future. */
+
+        m_bidirows_start = m_start;
+        m_bidirows_len = m_len;
+        m_generation++;
         m_invalid = false;
+        m_reusable = true;
+}
+
+/* Returns: whether the BiDi mappings of the paragraph @start..@end that the
+ * previous update() computed are still valid: it was the same paragraph
+ * then, with the same contents, and its displayed rows were displayed then too. */
+bool
+RingView::paragraph_is_unchanged(vte::grid::row_t start,
+                                 vte::grid::row_t end) const
+{
+        if (!m_reusable)
+                return false;
+
+        auto const paragraph = std::make_pair(start, end);
+        if (!std::binary_search(m_prev_paragraphs.begin(), m_prev_paragraphs.end(), paragraph))
+                return false;
+
+        for (auto row = start; row < end; row++) {
+                if (row >= m_start && row < m_start + m_len &&
+                    (row < m_bidirows_start || row >= m_bidirows_start + m_bidirows_len))
+                        return false;
+
+                auto const old_row = m_prev_rows[row - m_prev_top];
+                auto const new_row = m_rows[row - m_top];
+                if (old_row->len != new_row->len ||
+                    old_row->n_cells != new_row->n_cells ||
+                    memcmp(&old_row->attr, &new_row->attr, sizeof(new_row->attr)) != 0 ||
+                    memcmp(old_row->cells, new_row->cells, _vte_row_data_stored_length(new_row) * sizeof(new_row->cells[0])) != 0)
+                        return false;
+        }
+
+        return true;
+}
+
+void
+RingView::update_paragraphs_parallel(std::pair<vte::grid::row_t, vte::grid::row_t> const* paragraphs,
+                                     size_t n_paragraphs)
+{
+        ParagraphJob job{m_bidirunner.get(), paragraphs, n_paragraphs,
+                         m_enable_bidi, m_enable_shaping};
+
+        auto pool = paragraph_thread_pool();
+        if (pool != nullptr) {
+                g_mutex_init(&job.mutex);
+                g_cond_init(&job.cond);
+
+                auto const n_threads = std::min(size_t(g_thread_pool_get_max_threads(pool)), n_paragraphs - 1);
+                job.n_pending = n_threads;
+                for (size_t i = 0; i < n_threads; i++)
+                        g_thread_pool_push(pool, &job, nullptr);
+        }
+
+        job.run();
+
+        if (pool != nullptr) {
+                g_mutex_lock(&job.mutex);
+                while (job.n_pending > 0)
+                        g_cond_wait(&job.cond, &job.mutex);
+                g_mutex_unlock(&job.mutex);
+
+                g_cond_clear(&job.cond);
+                g_mutex_clear(&job.mutex);
+        }
+
+        _vte_debug_print (VTE_DEBUG_RINGVIEW, "Ringview: updated %zu paragraphs in parallel.\n",
+                                              n_paragraphs);
+}
+
+size_t
+RingView::size() const noexcept
+{
+        auto size = sizeof(VteRowData*) * (m_rows_alloc_len + m_prev_rows_alloc_len) +
+                sizeof(BidiRow*) * m_bidirows_alloc_len;
+        for (int i = 0; i < m_rows_alloc_len; i++)
+                size += sizeof(VteRowData) + _vte_row_data_size(m_rows[i]);
+        for (int i = 0; i < m_prev_rows_alloc_len; i++)
+                size += sizeof(VteRowData) + _vte_row_data_size(m_prev_rows[i]);
+        for (int i = 0; i < m_bidirows_alloc_len; i++)
+                size += m_bidirows[i]->size();
+        return size;
 }
 
 BidiRow const* RingView::get_bidirow(vte::grid::row_t row) const
@@ -20,6 +20,9 @@
 
 #include <glib.h>
 
+#include <utility>
+#include <vector>
+
 #include "bidi.hh"
 #include "ring.hh"
 #include "vterowdata.hh"
@@ -77,12 +80,17 @@ public:
         inline void invalidate() { m_invalid = true; }
         inline constexpr bool is_updated() const noexcept { return !m_invalid; }
         void update();
+        /* Changes whenever update() looks at the rows again */
+        inline constexpr uint64_t generation() const noexcept { return m_generation; }
         void pause();
 
         VteRowData const* get_row(vte::grid::row_t row) const;
 
         BidiRow const* get_bidirow(vte::grid::row_t row) const;
 
+        /* The bytes on the heap of the rows copied and their BiDi mappings */
+        size_t size() const noexcept;
+
 private:
         Ring *m_ring{nullptr};
 
@@ -90,10 +98,22 @@ private:
         int m_rows_len{0};
         int m_rows_alloc_len{0};
 
+        /* The rows and paragraphs of the previous update(), whose BiDi
+         * mappings are still valid if m_reusable. */
+        VteRowData **m_prev_rows{nullptr};
+        int m_prev_rows_len{0};
+        int m_prev_rows_alloc_len{0};
+        vte::grid::row_t m_prev_top{0};
+        std::vector<std::pair<vte::grid::row_t, vte::grid::row_t>> m_paragraphs{};
+        std::vector<std::pair<vte::grid::row_t, vte::grid::row_t>> m_prev_paragraphs{};
+        bool m_reusable{false};
+
         bool m_enable_bidi{true};      /* These two are the most convenient defaults */
         bool m_enable_shaping{false};  /* for short-lived ringviews. */
         BidiRow **m_bidirows{nullptr};
         int m_bidirows_alloc_len{0};
+        vte::grid::row_t m_bidirows_start{0};  /* the rows m_bidirows had at the last update() */
+        vte::grid::row_t m_bidirows_len{0};
 
         std::unique_ptr<BidiRunner> m_bidirunner;
 
@@ -105,8 +125,14 @@ private:
 
         bool m_invalid{true};
         bool m_paused{true};
+        uint64_t m_generation{0};
+        guint32 m_unistr_generation{0};
 
         void resume();
+        bool paragraph_is_unchanged(vte::grid::row_t start,
+                                    vte::grid::row_t end) const;
+        void update_paragraphs_parallel(std::pair<vte::grid::row_t, vte::grid::row_t> const* paragraphs,
+                                        size_t n_paragraphs);
 
         BidiRow* get_bidirow_writable(vte::grid::row_t row) const;
 };
@@ -0,0 +1,92 @@
+/*
+ * Copyright © 2026 The VTE developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <glib.h>
+
+#include <memory>
+
+#include "rowchecksums.hh"
+
+using namespace vte::base;
+
+static void
+test_rowchecksums_store(void)
+{
+        auto sums = std::make_unique<RowChecksums>();
+        sums->set_columns(0, 80);
+
+        uint32_t sum;
+        g_assert_false(sums->lookup(0, &sum));
+        g_assert_false(sums->lookup(-1, &sum));
+
+        for (auto row = 1000L; row < 1024L; row++)
+                sums->store(row, row * 2);
+        for (auto row = 1000L; row < 1024L; row++) {
+                g_assert_true(sums->lookup(row, &sum));
+                g_assert_cmpuint(sum, ==, row * 2);
+        }
+
+        /* A row a table's length away takes the place of the old one */
+        sums->store(1000 + RowChecksums::k_n_rows, 7);
+        g_assert_false(sums->lookup(1000, &sum));
+        g_assert_true(sums->lookup(1000 + RowChecksums::k_n_rows, &sum));
+        g_assert_cmpuint(sum, ==, 7);
+
+        /* The same columns keep them, others drop them */
+        sums->set_columns(0, 80);
+        g_assert_true(sums->lookup(1001, &sum));
+        sums->set_columns(0, 79);
+        g_assert_false(sums->lookup(1001, &sum));
+}
+
+static void
+test_rowchecksums_invalidate(void)
+{
+        auto sums = std::make_unique<RowChecksums>();
+        sums->set_columns(0, 80);
+
+        uint32_t sum;
+        for (auto row = 0L; row < 24L; row++)
+                sums->store(row, 1);
+
+        sums->invalidate(5, 7);
+        for (auto row = 0L; row < 24L; row++)
+                g_assert_cmpint(sums->lookup(row, &sum), ==, row < 5 || row > 7);
+
+        /* Rows mapping to the same entries aren't dropped by mistake */
+        sums->invalidate(RowChecksums::k_n_rows, RowChecksums::k_n_rows + 2);
+        g_assert_true(sums->lookup(0, &sum));
+        g_assert_true(sums->lookup(2, &sum));
+
+        sums->invalidate(-1, RowChecksums::k_n_rows * 4);
+        for (auto row = 0L; row < 24L; row++)
+                g_assert_false(sums->lookup(row, &sum));
+}
+
+int
+main(int argc,
+     char* argv[])
+{
+        g_test_init(&argc, &argv, nullptr);
+
+        g_test_add_func("/vte/rowchecksums/store", test_rowchecksums_store);
+        g_test_add_func("/vte/rowchecksums/invalidate", test_rowchecksums_invalidate);
+
+        return g_test_run();
+}
@@ -0,0 +1,135 @@
+/*
+ * Copyright © 2026 The VTE developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <limits>
+
+#include "vtedefines.hh"
+
+namespace vte {
+
+namespace base {
+
+/*
+ * RowChecksums:
+ *
+ * The checksums of the text of rows over one range of columns, as
+ * DECRQCRA asks for them, kept until the rows are damaged.
+ *
+ * It's a direct-mapped table indexed by the row number, so that the
+ * rows of a screen never evict each other; only the range of columns
+ * and its owner's idea of which rows are damaged decide what's valid.
+ */
+class RowChecksums {
+public:
+        using row_t = long;
+        using column_t = long;
+
+        static constexpr row_t const k_n_rows = VTE_ROW_CHECKSUMS_ROWS;
+        static_assert((k_n_rows & (k_n_rows - 1)) == 0, "k_n_rows must be a power of 2");
+        static constexpr row_t const k_no_row = std::numeric_limits<row_t>::min();
+
+        RowChecksums() noexcept
+        {
+                clear();
+        }
+
+        RowChecksums(RowChecksums const&) = delete;
+        RowChecksums(RowChecksums&&) = delete;
+        RowChecksums& operator= (RowChecksums const&) = delete;
+        RowChecksums& operator= (RowChecksums&&) = delete;
+
+        /* set_columns:
+         *
+         * Sets the range of columns the checksums are of, dropping
+         * them all if that changes.
+         */
+        void set_columns(column_t start_column,
+                         column_t end_column) noexcept
+        {
+                if (start_column == m_start_column &&
+                    end_column == m_end_column)
+                        return;
+
+                clear();
+                m_start_column = start_column;
+                m_end_column = end_column;
+        }
+
+        void clear() noexcept
+        {
+                for (auto& entry : m_entries)
+                        entry.row = k_no_row;
+        }
+
+        /* Returns: whether the checksum of @row is known, in *@checksum */
+        inline bool lookup(row_t row,
+                           uint32_t* checksum) const noexcept
+        {
+                auto const& entry = m_entries[row & (k_n_rows - 1)];
+                if (entry.row != row)
+                        return false;
+
+                *checksum = entry.checksum;
+                return true;
+        }
+
+        inline void store(row_t row,
+                          uint32_t checksum) noexcept
+        {
+                auto& entry = m_entries[row & (k_n_rows - 1)];
+                entry.row = row;
+                entry.checksum = checksum;
+        }
+
+        /* invalidate:
+         * @row_start: the first row
+         * @row_end: the last row, inclusive
+         *
+         * Drops the checksums of the rows which changed.
+         */
+        void invalidate(row_t row_start,
+                        row_t row_end) noexcept
+        {
+                if (row_end - row_start + 1 >= k_n_rows) {
+                        clear();
+                        return;
+                }
+
+                for (auto row = row_start; row <= row_end; row++) {
+                        auto& entry = m_entries[row & (k_n_rows - 1)];
+                        if (entry.row == row)
+                                entry.row = k_no_row;
+                }
+        }
+
+private:
+        struct Entry {
+                row_t row;  /* k_no_row if unused */
+                uint32_t checksum;
+        };
+
+        Entry m_entries[k_n_rows];
+        column_t m_start_column{-1};
+        column_t m_end_column{-1};
+};
+
+} // namespace base
+
+} // namespace vte
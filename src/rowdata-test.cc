@@ -0,0 +1,195 @@
+/*
+ * Copyright © 2026 The VTE developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <glib.h>
+
+#include <string>
+
+#include "vterowdata.hh"
+
+/* Returns: the hyperlink idxs of the columns of @row, one character each */
+static std::string
+hyperlinks(VteRowData const* row)
+{
+        auto str = std::string{};
+        for (auto col = 0u; col < row->len; col++) {
+                auto const idx = _vte_row_data_get_hyperlink(row, col);
+                str.push_back(idx ? char('0' + idx) : '.');
+        }
+        return str;
+}
+
+static void
+make_row(VteRowData* row,
+         char const* links)
+{
+        _vte_row_data_init(row);
+        for (auto col = 0u; links[col]; col++) {
+                _vte_row_data_append(row, &basic_cell);
+                _vte_row_data_set_hyperlink(row, col, col + 1, links[col] == '.' ? 0 : links[col] - '0');
+        }
+}
+
+static void
+test_rowdata_hyperlink_set(void)
+{
+        VteRowData row;
+        make_row(&row, "..11122.1..");
+        g_assert_cmpstr(hyperlinks(&row).c_str(), ==, "..11122.1..");
+        /* Runs are joined as they are printed */
+        g_assert_cmpuint(row.n_hyperlinks, ==, 3);
+
+        _vte_row_data_set_hyperlink(&row, 3, 8, 3);
+        g_assert_cmpstr(hyperlinks(&row).c_str(), ==, "..1333331..");
+        _vte_row_data_set_hyperlink(&row, 1, 10, 0);
+        g_assert_cmpstr(hyperlinks(&row).c_str(), ==, "...........");
+        g_assert_cmpuint(row.n_hyperlinks, ==, 0);
+        g_assert_null(row.hyperlinks);
+
+        _vte_row_data_fini(&row);
+}
+
+static void
+test_rowdata_hyperlink_edit(void)
+{
+        VteRowData row, copy;
+        make_row(&row, "..1111.22..");
+
+        _vte_row_data_insert(&row, 3, &basic_cell);
+        g_assert_cmpstr(hyperlinks(&row).c_str(), ==, "..1.111.22..");
+        _vte_row_data_insert_n(&row, 0, &basic_cell, 2);
+        g_assert_cmpstr(hyperlinks(&row).c_str(), ==, "....1.111.22..");
+
+        /* Removing the gap joins the run again */
+        _vte_row_data_remove(&row, 5);
+        g_assert_cmpstr(hyperlinks(&row).c_str(), ==, "....1111.22..");
+        g_assert_cmpuint(row.n_hyperlinks, ==, 2);
+        _vte_row_data_remove_n(&row, 6, 4);
+        g_assert_cmpstr(hyperlinks(&row).c_str(), ==, "....112..");
+
+        _vte_row_data_fill_range(&row, &basic_cell, 5, 12);
+        g_assert_cmpstr(hyperlinks(&row).c_str(), ==, "....1.......");
+
+        _vte_row_data_init(&copy);
+        _vte_row_data_copy(&row, &copy);
+        _vte_row_data_shrink(&row, 4);
+        g_assert_cmpstr(hyperlinks(&row).c_str(), ==, "....");
+        g_assert_cmpuint(row.n_hyperlinks, ==, 0);
+        g_assert_cmpstr(hyperlinks(&copy).c_str(), ==, "....1.......");
+
+        _vte_row_data_clear(&copy);
+        g_assert_cmpuint(copy.n_hyperlinks, ==, 0);
+        g_assert_null(copy.hyperlinks);
+
+        _vte_row_data_fini(&copy);
+        _vte_row_data_fini(&row);
+}
+
+static void
+test_rowdata_size(void)
+{
+        VteRowData row;
+        _vte_row_data_init(&row);
+        g_assert_cmpuint(_vte_row_data_size(&row), ==, 0);
+
+        /* The cells come in arrays of at least 127 */
+        make_row(&row, "..11.");
+        auto const size = _vte_row_data_size(&row);
+        g_assert_cmpuint(size, >=, 127 * sizeof(VteCell) + sizeof(VteCellHyperlink));
+
+        /* Cleared, the row keeps its cells */
+        _vte_row_data_clear(&row);
+        g_assert_cmpuint(_vte_row_data_size(&row), ==, size - sizeof(VteCellHyperlink));
+
+        _vte_row_data_fini(&row);
+}
+
+/* Returns: the characters of the columns of @row, ' ' for none, '_' for the colored ones */
+static std::string
+text(VteRowData const* row)
+{
+        auto str = std::string{};
+        for (auto col = 0u; col < row->len; col++) {
+                auto const cell = _vte_row_data_get(row, col);
+                str.push_back(cell->c ? char(cell->c) : cell->attr.back() != basic_cell.attr.back() ? '_' : ' ');
+        }
+        return str;
+}
+
+static void
+test_rowdata_tail(void)
+{
+        auto colored = basic_cell;
+        colored.attr.set_back(3);
+        auto cell = basic_cell;
+
+        VteRowData row, copy;
+        _vte_row_data_init(&row);
+        for (auto c : {'a', 'b', 'c'}) {
+                cell.c = c;
+                _vte_row_data_append(&row, &cell);
+        }
+
+        /* Filled to the end, the cells are only stored once */
+        _vte_row_data_fill(&row, &colored, 8);
+        g_assert_cmpstr(text(&row).c_str(), ==, "abc_____");
+        g_assert_cmpuint(row.n_cells, ==, 3);
+        g_assert_cmpuint(_vte_row_data_nonempty_length(&row), ==, 3);
+        _vte_row_data_append(&row, &colored);
+        _vte_row_data_remove_n(&row, 1, 3);
+        _vte_row_data_insert(&row, 5, &cell);
+        g_assert_cmpstr(text(&row).c_str(), ==, "a____c_");
+        g_assert_cmpuint(row.n_cells, ==, 6);
+
+        _vte_row_data_fill_range(&row, &basic_cell, 2, 9);
+        g_assert_cmpstr(text(&row).c_str(), ==, "a_       ");
+        g_assert_cmpuint(row.n_cells, ==, 2);
+        g_assert_cmpuint(_vte_row_data_nonempty_length(&row), ==, 1);
+
+        _vte_row_data_init(&copy);
+        _vte_row_data_copy(&row, &copy);
+        g_assert_cmpstr(text(&copy).c_str(), ==, "a_       ");
+
+        /* Writing stores them all */
+        _vte_row_data_get_writable(&row, 4)->c = 'x';
+        g_assert_cmpstr(text(&row).c_str(), ==, "a_  x    ");
+        g_assert_cmpuint(row.n_cells, ==, 9);
+
+        _vte_row_data_shrink(&copy, 2);
+        g_assert_cmpuint(copy.n_cells, ==, 2);
+        _vte_row_data_fill(&copy, &colored, 4);
+        g_assert_cmpstr(text(&copy).c_str(), ==, "a___");
+
+        _vte_row_data_fini(&copy);
+        _vte_row_data_fini(&row);
+}
+
+int
+main(int argc,
+     char* argv[])
+{
+        g_test_init(&argc, &argv, nullptr);
+
+        g_test_add_func("/vte/rowdata/hyperlink/set", test_rowdata_hyperlink_set);
+        g_test_add_func("/vte/rowdata/hyperlink/edit", test_rowdata_hyperlink_edit);
+        g_test_add_func("/vte/rowdata/size", test_rowdata_size);
+        g_test_add_func("/vte/rowdata/tail", test_rowdata_tail);
+
+        return g_test_run();
+}
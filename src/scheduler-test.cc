@@ -0,0 +1,123 @@
+/*
+ * Copyright © 2026 The VTE developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <glib.h>
+
+#include "scheduler.hh"
+
+using namespace vte::base;
+
+struct Client {
+        int id;
+        Scheduler<Client>::Entry entry{this};
+};
+
+static void
+test_scheduler_list(void)
+{
+        Scheduler<Client> s{};
+        Client a{1}, b{2}, c{3};
+
+        g_assert_true(s.empty());
+        s.add(a.entry, 1, 300);
+        s.add(b.entry, 1, 300);
+        s.add(c.entry, 1, 300);
+        g_assert_cmpuint(s.size(), ==, 3);
+        g_assert_cmpuint(s.total_weight(), ==, 3);
+        g_assert_true(s.first()->owner() == &a);
+
+        s.rotate();
+        g_assert_true(s.first()->owner() == &b);
+        g_assert_true(s.next(*s.next(*s.first()))->owner() == &a);
+
+        s.remove(c.entry);
+        g_assert_false(c.entry.is_scheduled());
+        g_assert_cmpuint(s.size(), ==, 2);
+        g_assert_true(s.next(*s.first())->owner() == &a);
+        g_assert_null(s.next(*s.next(*s.first())));
+
+        /* Removing an unscheduled entry is a no-op */
+        s.remove(c.entry);
+        g_assert_cmpuint(s.size(), ==, 2);
+
+        s.remove(a.entry);
+        s.remove(b.entry);
+        g_assert_true(s.empty());
+        g_assert_cmpuint(s.total_weight(), ==, 0);
+}
+
+static void
+test_scheduler_weights(void)
+{
+        Scheduler<Client> s{};
+        Client a{1}, b{2};
+
+        s.add(a.entry, 1, 1000);
+        s.add(b.entry, 3, 1000);
+        g_assert_cmpuint(s.total_weight(), ==, 4);
+
+        s.end_round(a.entry, 0, 1000);
+        s.end_round(b.entry, 0, 1000);
+        g_assert_cmpint(a.entry.allowance(), ==, 250);
+        g_assert_cmpint(b.entry.allowance(), ==, 750);
+
+        s.set_weight(a.entry, 3);
+        g_assert_cmpuint(s.total_weight(), ==, 6);
+        s.end_round(a.entry, 0, 1200);
+        g_assert_cmpint(a.entry.allowance(), ==, 600);
+}
+
+static void
+test_scheduler_deficit(void)
+{
+        Scheduler<Client> s{};
+        Client a{1}, b{2};
+
+        s.add(a.entry, 1, 1000);
+        s.add(b.entry, 1, 1000);
+        s.end_round(a.entry, 0, 1000);
+        g_assert_cmpint(a.entry.allowance(), ==, 500);
+
+        /* Overshooting is taken off the next round */
+        s.end_round(a.entry, 600, 1000);
+        g_assert_cmpint(a.entry.allowance(), ==, 400);
+
+        /* Reading less than allowed starts afresh */
+        s.end_round(a.entry, 100, 1000);
+        g_assert_cmpint(a.entry.allowance(), ==, 500);
+
+        /* The deficit is bounded by one quantum */
+        s.end_round(a.entry, 5000, 1000);
+        g_assert_cmpint(a.entry.allowance(), ==, 0);
+        s.end_round(a.entry, 5000, 1000);
+        g_assert_cmpint(a.entry.allowance(), ==, 0);
+}
+
+int
+main(int argc,
+     char* argv[])
+{
+        g_test_init(&argc, &argv, nullptr);
+
+        g_test_add_func("/vte/scheduler/list", test_scheduler_list);
+        g_test_add_func("/vte/scheduler/weights", test_scheduler_weights);
+        g_test_add_func("/vte/scheduler/deficit", test_scheduler_deficit);
+
+        return g_test_run();
+}
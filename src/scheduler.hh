@@ -0,0 +1,188 @@
+/*
+ * Copyright © 2026 The VTE developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+
+namespace vte {
+
+namespace base {
+
+/*
+ * Scheduler:
+ *
+ * Weighted deficit round-robin scheduler over an intrusive list of
+ * entries. Each entry embeds its links, so adding, removing and
+ * reweighting are O(1).
+ *
+ * Every round, an entry gets a quantum of the shared budget in
+ * proportion to its weight. Whatever it overshoots that quantum by
+ * (reads happen in whole chunks) is taken off the next round;
+ * whatever it didn't get to use because it was throttled is carried over.
+ */
+template<typename T>
+class Scheduler {
+public:
+        class Entry {
+        public:
+                explicit constexpr Entry(T* owner) noexcept
+                        : m_owner{owner}
+                {
+                }
+
+                Entry(Entry const&) = delete;
+                Entry(Entry&&) = delete;
+                Entry& operator= (Entry const&) = delete;
+                Entry& operator= (Entry&&) = delete;
+
+                inline constexpr T* owner() const noexcept { return m_owner; }
+                inline constexpr bool is_scheduled() const noexcept { return m_scheduled; }
+                inline constexpr unsigned int weight() const noexcept { return m_weight; }
+                inline constexpr long allowance() const noexcept { return m_allowance; }
+
+        private:
+                friend class Scheduler;
+
+                T* m_owner;
+                Entry* m_prev{nullptr};
+                Entry* m_next{nullptr};
+                unsigned int m_weight{1};
+                long m_deficit{0};
+                long m_allowance{0};
+                bool m_scheduled{false};
+        };
+
+        Scheduler() = default;
+        Scheduler(Scheduler const&) = delete;
+        Scheduler(Scheduler&&) = delete;
+        Scheduler& operator= (Scheduler const&) = delete;
+        Scheduler& operator= (Scheduler&&) = delete;
+
+        inline constexpr bool empty() const noexcept { return m_head == nullptr; }
+        inline constexpr size_t size() const noexcept { return m_size; }
+        inline constexpr unsigned int total_weight() const noexcept { return m_total_weight; }
+
+        inline constexpr Entry* first() const noexcept { return m_head; }
+        static inline constexpr Entry* next(Entry const& entry) noexcept { return entry.m_next; }
+
+        void add(Entry& entry,
+                 unsigned int weight,
+                 long budget) noexcept
+        {
+                assert(!entry.m_scheduled);
+
+                entry.m_prev = m_tail;
+                entry.m_next = nullptr;
+                if (m_tail)
+                        m_tail->m_next = &entry;
+                else
+                        m_head = &entry;
+                m_tail = &entry;
+
+                entry.m_scheduled = true;
+                entry.m_weight = std::max(weight, 1u);
+                entry.m_deficit = 0;
+                m_total_weight += entry.m_weight;
+                ++m_size;
+
+                entry.m_allowance = quantum(entry, budget);
+        }
+
+        void remove(Entry& entry) noexcept
+        {
+                if (!entry.m_scheduled)
+                        return;
+
+                if (entry.m_prev)
+                        entry.m_prev->m_next = entry.m_next;
+                else
+                        m_head = entry.m_next;
+                if (entry.m_next)
+                        entry.m_next->m_prev = entry.m_prev;
+                else
+                        m_tail = entry.m_prev;
+
+                entry.m_prev = entry.m_next = nullptr;
+                entry.m_scheduled = false;
+                m_total_weight -= entry.m_weight;
+                --m_size;
+        }
+
+        void set_weight(Entry& entry,
+                        unsigned int weight) noexcept
+        {
+                weight = std::max(weight, 1u);
+                if (entry.m_scheduled)
+                        m_total_weight = m_total_weight - entry.m_weight + weight;
+                entry.m_weight = weight;
+        }
+
+        /* Ends @entry's round, having consumed @used of its allowance, and
+         * computes its allowance for the next round out of @budget.
+         */
+        void end_round(Entry& entry,
+                       long used,
+                       long budget) noexcept
+        {
+                if (!entry.m_scheduled)
+                        return;
+
+                auto const q = quantum(entry, budget);
+                /* Only a throttled (or overshooting) entry keeps its deficit; one
+                 * that had less to read than it was allowed starts afresh.
+                 */
+                auto const deficit = used >= entry.m_allowance ? entry.m_allowance - used : 0;
+                entry.m_deficit = std::clamp(deficit, -q, q);
+                entry.m_allowance = std::max(q + entry.m_deficit, 0L);
+        }
+
+        /* Moves the first entry to the back, so that the order in which
+         * entries are served rotates between rounds.
+         */
+        void rotate() noexcept
+        {
+                if (m_head == m_tail)
+                        return;
+
+                auto entry = m_head;
+                m_head = entry->m_next;
+                m_head->m_prev = nullptr;
+                entry->m_prev = m_tail;
+                entry->m_next = nullptr;
+                m_tail->m_next = entry;
+                m_tail = entry;
+        }
+
+private:
+        Entry* m_head{nullptr};
+        Entry* m_tail{nullptr};
+        size_t m_size{0};
+        unsigned int m_total_weight{0};
+
+        inline constexpr long quantum(Entry const& entry,
+                                      long budget) const noexcept
+        {
+                return m_total_weight ? budget * long(entry.m_weight) / long(m_total_weight) : budget;
+        }
+};
+
+} // namespace base
+
+} // namespace vte
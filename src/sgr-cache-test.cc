@@ -0,0 +1,95 @@
+/*
+ * Copyright © 2026 The VTE developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <glib.h>
+
+#include "sgr-cache.hh"
+
+using namespace vte::base;
+
+using Cache = SGRCache<int>;
+
+struct Attr {
+        uint32_t attr;
+        uint64_t m_colors;
+};
+
+static void
+test_sgr_cache_delta(void)
+{
+        /* A sequence that sets bit 0, clears bit 1, and replaces
+         * the low byte of the colours with 0x42.
+         */
+        auto zero = Attr{0x1, 0x42};
+        auto ones = Attr{~uint32_t{0x2}, ~uint64_t{0xff} | 0x42};
+        auto const delta = Cache::Delta::from_probes(zero, ones, false);
+
+        g_assert_cmphex(delta.attr_mask, ==, 0x3);
+        g_assert_cmphex(delta.attr_value, ==, 0x1);
+        g_assert_cmphex(delta.colors_mask, ==, 0xff);
+        g_assert_cmphex(delta.colors_value, ==, 0x42);
+        g_assert_false(delta.reset);
+
+        auto a = Attr{0xf0f2, 0x1234};
+        delta.apply(a);
+        g_assert_cmphex(a.attr, ==, 0xf0f1);
+        g_assert_cmphex(a.m_colors, ==, 0x1242);
+}
+
+static void
+test_sgr_cache_lookup(void)
+{
+        Cache cache{};
+        int const bold_red[] = {1, 31};
+        int const red_bold[] = {31, 1};
+
+        g_assert_null(cache.lookup(bold_red, 2));
+        g_assert_cmpuint(cache.misses(), ==, 1);
+
+        auto delta = Cache::Delta{};
+        delta.attr_mask = delta.attr_value = 0x4;
+        cache.insert(bold_red, 2, delta);
+
+        auto const cached = cache.lookup(bold_red, 2);
+        g_assert_nonnull(cached);
+        g_assert_cmphex(cached->attr_value, ==, 0x4);
+        g_assert_cmpuint(cache.hits(), ==, 1);
+
+        /* Order and length are part of the key */
+        g_assert_null(cache.lookup(red_bold, 2));
+        g_assert_null(cache.lookup(bold_red, 1));
+        g_assert_cmpuint(cache.misses(), ==, 3);
+
+        /* Overlong parameter vectors are not cached */
+        int const many[Cache::k_max_args + 1] = {};
+        cache.insert(many, Cache::k_max_args + 1, delta);
+        g_assert_null(cache.lookup(many, Cache::k_max_args + 1));
+}
+
+int
+main(int argc,
+     char* argv[])
+{
+        g_test_init(&argc, &argv, nullptr);
+
+        g_test_add_func("/vte/sgr-cache/delta", test_sgr_cache_delta);
+        g_test_add_func("/vte/sgr-cache/lookup", test_sgr_cache_lookup);
+
+        return g_test_run();
+}
@@ -0,0 +1,156 @@
+/*
+ * Copyright © 2026 The VTE developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+namespace vte {
+
+namespace base {
+
+/*
+ * SGRCache:
+ *
+ * Small direct-mapped cache from the raw parameter vector of an SGR
+ * sequence to its net effect on the packed cell attributes.
+ *
+ * SGR only ever sets, clears or replaces whole bit fields, so its
+ * effect is fully described by a mask of the bits it determines and
+ * their values; bits outside the mask are left alone. Such a Delta is
+ * derived by applying the sequence once to an all-zeros and once to an
+ * all-ones attribute: the bits that come out the same in both are the
+ * ones the sequence determines.
+ */
+template<typename Arg>
+class SGRCache {
+public:
+        static constexpr unsigned int const k_size = 32;
+        static constexpr unsigned int const k_max_args = 8;
+
+        class Delta {
+        public:
+                uint32_t attr_mask{0};
+                uint32_t attr_value{0};
+                uint64_t colors_mask{0};
+                uint64_t colors_value{0};
+                bool reset{false};
+
+                /* from_probes:
+                 * @zero: the result of applying the sequence to all-zeros attributes
+                 * @ones: the result of applying the sequence to all-ones attributes
+                 * @reset_: whether the sequence contained a reset
+                 */
+                template<typename T>
+                static constexpr Delta from_probes(T const& zero,
+                                                   T const& ones,
+                                                   bool reset_) noexcept
+                {
+                        auto delta = Delta{};
+                        delta.attr_mask = ~(zero.attr ^ ones.attr);
+                        delta.attr_value = zero.attr & delta.attr_mask;
+                        delta.colors_mask = ~(zero.m_colors ^ ones.m_colors);
+                        delta.colors_value = zero.m_colors & delta.colors_mask;
+                        delta.reset = reset_;
+                        return delta;
+                }
+
+                template<typename T>
+                inline constexpr void apply(T& attr) const noexcept
+                {
+                        attr.attr = (attr.attr & ~attr_mask) | attr_value;
+                        attr.m_colors = (attr.m_colors & ~colors_mask) | colors_value;
+                }
+        };
+
+        SGRCache() = default;
+        SGRCache(SGRCache const&) = delete;
+        SGRCache(SGRCache&&) = delete;
+        SGRCache& operator= (SGRCache const&) = delete;
+        SGRCache& operator= (SGRCache&&) = delete;
+
+        /* lookup:
+         *
+         * Returns: the cached delta for the @n_args parameters at @args,
+         *   or %nullptr if there is none
+         */
+        Delta const* lookup(Arg const* args,
+                            unsigned int n_args) noexcept
+        {
+                if (n_args > k_max_args)
+                        return nullptr;
+
+                auto const& entry = m_entries[hash(args, n_args)];
+                if (entry.n_args == n_args &&
+                    memcmp(entry.args, args, n_args * sizeof(Arg)) == 0) {
+                        ++m_hits;
+                        return &entry.delta;
+                }
+
+                ++m_misses;
+                return nullptr;
+        }
+
+        /* insert:
+         *
+         * Caches @delta for the @n_args parameters at @args, evicting
+         * whatever occupied its slot before. Parameter vectors longer
+         * than k_max_args are not cached.
+         */
+        void insert(Arg const* args,
+                    unsigned int n_args,
+                    Delta const& delta) noexcept
+        {
+                if (n_args > k_max_args)
+                        return;
+
+                auto& entry = m_entries[hash(args, n_args)];
+                memcpy(entry.args, args, n_args * sizeof(Arg));
+                entry.n_args = n_args;
+                entry.delta = delta;
+        }
+
+        inline constexpr unsigned long hits() const noexcept { return m_hits; }
+        inline constexpr unsigned long misses() const noexcept { return m_misses; }
+
+private:
+        class Entry {
+        public:
+                Arg args[k_max_args];
+                unsigned int n_args{k_max_args + 1}; /* never matches */
+                Delta delta;
+        };
+
+        Entry m_entries[k_size];
+        unsigned long m_hits{0};
+        unsigned long m_misses{0};
+
+        /* FNV-1a over the parameter values */
+        static inline constexpr unsigned int hash(Arg const* args,
+                                                  unsigned int n_args) noexcept
+        {
+                auto h = uint32_t{2166136261u};
+                for (auto i = 0u; i < n_args; ++i)
+                        h = (h ^ uint32_t(args[i])) * 16777619u;
+                return (h ^ (h >> 16)) & (k_size - 1);
+        }
+};
+
+} // namespace base
+
+} // namespace vte
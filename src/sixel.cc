@@ -0,0 +1,299 @@
+/*
+ * Copyright © 2026 The VTE developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "sixel.hh"
+
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+
+#include "vtedefines.hh"
+
+namespace vte {
+
+namespace base {
+
+static constexpr inline uint32_t
+argb(unsigned r,
+     unsigned g,
+     unsigned b) noexcept
+{
+        return 0xff000000u | r << 16 | g << 8 | b;
+}
+
+/* Returns: the colour of @r, @g, @b in percent */
+static constexpr inline uint32_t
+argb_from_percent(unsigned r,
+                  unsigned g,
+                  unsigned b) noexcept
+{
+        return argb((std::min(r, 100u) * 255 + 50) / 100,
+                    (std::min(g, 100u) * 255 + 50) / 100,
+                    (std::min(b, 100u) * 255 + 50) / 100);
+}
+
+/* The VT340 default colour registers */
+static uint32_t const default_registers[16] = {
+        argb_from_percent( 0,  0,  0),
+        argb_from_percent(20, 20, 80),
+        argb_from_percent(80, 13, 13),
+        argb_from_percent(20, 80, 20),
+        argb_from_percent(80, 20, 80),
+        argb_from_percent(20, 80, 80),
+        argb_from_percent(80, 80, 20),
+        argb_from_percent(53, 53, 53),
+        argb_from_percent(26, 26, 26),
+        argb_from_percent(33, 33, 60),
+        argb_from_percent(60, 26, 26),
+        argb_from_percent(33, 60, 33),
+        argb_from_percent(60, 33, 60),
+        argb_from_percent(33, 60, 60),
+        argb_from_percent(60, 60, 33),
+        argb_from_percent(80, 80, 80),
+};
+
+/* Returns: the colour of hue @h in degrees, lightness @l and saturation @s
+ * in percent; the SIXEL hue has blue at 0° and red at 120° */
+static uint32_t
+argb_from_hls(unsigned h,
+              unsigned l,
+              unsigned s) noexcept
+{
+        auto const hue = double((h + 240) % 360) / 60.;
+        auto const light = std::min(l, 100u) / 100.;
+        auto const chroma = (1. - std::abs(2. * light - 1.)) * std::min(s, 100u) / 100.;
+        auto const x = chroma * (1. - std::abs(std::fmod(hue, 2.) - 1.));
+        auto const m = light - chroma / 2.;
+
+        double r, g, b;
+        switch (int(hue)) {
+        case 0: r = chroma; g = x; b = 0; break;
+        case 1: r = x; g = chroma; b = 0; break;
+        case 2: r = 0; g = chroma; b = x; break;
+        case 3: r = 0; g = x; b = chroma; break;
+        case 4: r = x; g = 0; b = chroma; break;
+        default: r = chroma; g = 0; b = x; break;
+        }
+
+        return argb(unsigned(std::lround((r + m) * 255.)),
+                    unsigned(std::lround((g + m) * 255.)),
+                    unsigned(std::lround((b + m) * 255.)));
+}
+
+void
+SixelDecoder::begin(bool transparent) noexcept
+{
+        std::copy(std::begin(default_registers), std::end(default_registers), m_registers);
+        std::fill(m_registers + std::size(default_registers), m_registers + k_n_registers, argb(0, 0, 0));
+
+        m_state = State::eGround;
+        m_n_params = 0;
+        m_color = m_registers[0];
+        m_repeat = 1;
+        m_x = m_y = 0;
+        m_transparent = transparent;
+
+        m_data.clear();
+        m_stride = m_rows = 0;
+        m_raster_width = m_raster_height = 0;
+        m_width = m_height = 0;
+}
+
+/* Makes room for @width by @height pixels, as far as they fit in the
+ * maximum size. Returns: false if nothing fits */
+bool
+SixelDecoder::reserve(unsigned width,
+                      unsigned height) noexcept
+{
+        width = std::min(width, unsigned(VTE_SIXEL_MAX_WIDTH));
+        height = std::min(height, unsigned(VTE_SIXEL_MAX_HEIGHT));
+        if (width <= m_stride && height <= m_rows)
+                return width != 0 && height != 0;
+
+        /* Grow geometrically, the size is rarely known in advance; but only
+         * the dimension that needs it, a tall strip stays narrow */
+        auto const stride = width > m_stride
+                ? std::max(width, std::min(m_stride * 2, unsigned(VTE_SIXEL_MAX_WIDTH)))
+                : m_stride;
+        auto const rows = height > m_rows
+                ? std::max(height, std::min(m_rows * 2, unsigned(VTE_SIXEL_MAX_HEIGHT)))
+                : m_rows;
+        auto data = std::vector<uint32_t>(size_t(stride) * rows, 0);
+        for (auto y = 0u; y < m_rows; ++y)
+                std::copy_n(m_data.begin() + size_t(y) * m_stride, m_stride,
+                            data.begin() + size_t(y) * stride);
+
+        m_data = std::move(data);
+        m_stride = stride;
+        m_rows = rows;
+        return true;
+}
+
+void
+SixelDecoder::define_color() noexcept
+{
+        auto const reg = m_params[0];
+        if (reg >= k_n_registers)
+                return;
+
+        if (m_n_params >= 5) {
+                switch (m_params[1]) {
+                case 1:
+                        m_registers[reg] = argb_from_hls(m_params[2], m_params[3], m_params[4]);
+                        break;
+                case 2:
+                        m_registers[reg] = argb_from_percent(m_params[2], m_params[3], m_params[4]);
+                        break;
+                default:
+                        break;
+                }
+        }
+
+        m_color = m_registers[reg];
+}
+
+void
+SixelDecoder::dispatch() noexcept
+{
+        switch (m_state) {
+        case State::eRepeat:
+                m_repeat = std::clamp(m_params[0], 1u, unsigned(VTE_SIXEL_MAX_WIDTH));
+                break;
+        case State::eColor:
+                define_color();
+                break;
+        case State::eRaster:
+                /* Pan;Pad;Ph;Pv, of which the aspect ratio is ignored */
+                if (m_n_params >= 4) {
+                        m_raster_width = std::min(m_params[2], unsigned(VTE_SIXEL_MAX_WIDTH));
+                        m_raster_height = std::min(m_params[3], unsigned(VTE_SIXEL_MAX_HEIGHT));
+                        reserve(m_raster_width, m_raster_height);
+                }
+                break;
+        case State::eGround:
+                break;
+        }
+
+        m_state = State::eGround;
+}
+
+void
+SixelDecoder::draw(uint32_t sixel) noexcept
+{
+        auto const bits = sixel - 0x3f;
+        auto const x_end = std::min(m_x + m_repeat, unsigned(VTE_SIXEL_MAX_WIDTH));
+        m_repeat = 1;
+
+        if (bits != 0 && reserve(x_end, m_y + 6)) {
+                for (auto bit = 0u; bit < 6 && m_y + bit < m_rows; ++bit) {
+                        if ((bits & (1u << bit)) == 0)
+                                continue;
+
+                        auto const row = m_data.begin() + size_t(m_y + bit) * m_stride;
+                        std::fill(row + m_x, row + x_end, m_color);
+                        m_height = std::max(m_height, m_y + bit + 1);
+                }
+        }
+
+        m_width = std::max(m_width, x_end);
+        m_x = x_end;
+}
+
+void
+SixelDecoder::feed(std::u32string_view data) noexcept
+{
+        for (auto const c : data) {
+                if (m_state != State::eGround) {
+                        if (c >= '0' && c <= '9') {
+                                auto& param = m_params[m_n_params - 1];
+                                param = std::min(param * 10 + (c - '0'), 0xffffu);
+                                continue;
+                        }
+                        if (c == ';') {
+                                if (m_n_params < k_max_params)
+                                        m_params[m_n_params++] = 0;
+                                continue;
+                        }
+
+                        dispatch();
+                }
+
+                switch (c) {
+                case '!':
+                        m_state = State::eRepeat;
+                        break;
+                case '#':
+                        m_state = State::eColor;
+                        break;
+                case '"':
+                        m_state = State::eRaster;
+                        break;
+                case '$':
+                        m_x = 0;
+                        continue;
+                case '-':
+                        m_x = 0;
+                        m_y = std::min(m_y + 6, unsigned(VTE_SIXEL_MAX_HEIGHT));
+                        continue;
+                default:
+                        if (c >= 0x3f && c <= 0x7e)
+                                draw(c);
+                        continue;
+                }
+
+                m_params[0] = 0;
+                m_n_params = 1;
+        }
+}
+
+bool
+SixelDecoder::finish(uint32_t background,
+                     std::vector<uint32_t>& pixels,
+                     unsigned& width,
+                     unsigned& height) noexcept
+{
+        if (m_state != State::eGround)
+                dispatch();
+
+        width = std::max(m_width, m_raster_width);
+        height = std::max(m_height, m_raster_height);
+        if (!reserve(width, height)) {
+                m_data.clear();
+                return false;
+        }
+
+        if (m_transparent)
+                background = 0;
+
+        pixels.resize(size_t(width) * height);
+        for (auto y = 0u; y < height; ++y) {
+                auto const row = m_data.cbegin() + size_t(y) * m_stride;
+                std::transform(row, row + width, pixels.begin() + size_t(y) * width,
+                               [background](uint32_t pixel) { return pixel != 0 ? pixel : background; });
+        }
+
+        /* The image can be large, don't keep it around twice */
+        m_data = std::vector<uint32_t>{};
+        m_stride = m_rows = 0;
+        return true;
+}
+
+} // namespace base
+
+} // namespace vte
@@ -0,0 +1,115 @@
+/*
+ * Copyright © 2026 The VTE developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+namespace vte {
+
+namespace base {
+
+/*
+ * SixelDecoder:
+ *
+ * Decodes the data of a DECSIXEL sequence into pixels. The data can be fed
+ * in several pieces, as the parser dispatches it in chunks.
+ *
+ * The colours are resolved as the sixels are drawn, so redefining a colour
+ * register only affects what's drawn after. The aspect ratio is ignored;
+ * pixels are always square.
+ */
+class SixelDecoder {
+public:
+        /* The number of colour registers */
+        static constexpr unsigned const k_n_registers = 256;
+
+        SixelDecoder() noexcept = default;
+        SixelDecoder(SixelDecoder const&) = delete;
+        SixelDecoder(SixelDecoder&&) = delete;
+        SixelDecoder& operator= (SixelDecoder const&) = delete;
+        SixelDecoder& operator= (SixelDecoder&&) = delete;
+
+        /* begin:
+         *
+         * Starts a new image, with the colour registers at their defaults.
+         * With @transparent, the pixels not drawn stay transparent, otherwise
+         * they get the background colour.
+         */
+        void begin(bool transparent) noexcept;
+
+        void feed(std::u32string_view data) noexcept;
+
+        /* finish:
+         *
+         * Writes the image to @pixels, in rows of @width premultiplied
+         * ARGB32 pixels; the pixels not drawn get @background, unless the
+         * image is transparent.
+         *
+         * Returns: false if the image is empty
+         */
+        bool finish(uint32_t background,
+                    std::vector<uint32_t>& pixels,
+                    unsigned& width,
+                    unsigned& height) noexcept;
+
+        inline bool transparent() const noexcept { return m_transparent; }
+
+private:
+        enum class State {
+                eGround,
+                eRepeat,
+                eColor,
+                eRaster,
+        };
+
+        static constexpr unsigned const k_max_params = 5;
+
+        void dispatch() noexcept;
+        void define_color() noexcept;
+        void draw(uint32_t sixel) noexcept;
+        bool reserve(unsigned width,
+                     unsigned height) noexcept;
+
+        State m_state{State::eGround};
+        unsigned m_params[k_max_params];
+        unsigned m_n_params{0};
+
+        uint32_t m_registers[k_n_registers];
+        uint32_t m_color{0};
+        unsigned m_repeat{1};
+        unsigned m_x{0};
+        unsigned m_y{0};
+        bool m_transparent{false};
+
+        /* The pixels, in rows of m_stride, 0 where not drawn */
+        std::vector<uint32_t> m_data{};
+        unsigned m_stride{0};
+        unsigned m_rows{0};
+
+        /* The size from the raster attributes, and the extent drawn to */
+        unsigned m_raster_width{0};
+        unsigned m_raster_height{0};
+        unsigned m_width{0};
+        unsigned m_height{0};
+};
+
+} // namespace base
+
+} // namespace vte
@@ -0,0 +1,547 @@
+/*
+ * Copyright © 2026 The VTE developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * The spawn helper: a small process started once by libvte (see
+ * spawn-helper.hh), which forks the children of the PTYs on request.
+ * Forking it costs the same whatever the size of the host process.
+ *
+ * It doesn't link to GLib on purpose, to stay small.
+ */
+
+#include "config.h"
+
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <termios.h>
+#include <unistd.h>
+#if defined(__sun) && defined(HAVE_STROPTS_H)
+#include <stropts.h>
+#endif
+
+#include "spawn-helper-protocol.hh"
+
+/* NSIG isn't in POSIX, so if it doesn't exist use this here. See bug #759196 */
+#ifndef NSIG
+#define NSIG (8 * sizeof(sigset_t))
+#endif
+
+using namespace vte::base::spawn_helper;
+
+namespace {
+
+/* Written to by the SIGCHLD handler, so that poll() wakes up */
+int s_sigchld_pipe[2]{-1, -1};
+
+struct ChildError {
+        Error error;
+        int32_t errsv;
+};
+
+void
+sigchld_handler(int)
+{
+        auto const errsv = errno;
+        char c = 0;
+        (void)write(s_sigchld_pipe[1], &c, 1);
+        errno = errsv;
+}
+
+bool
+set_cloexec(int fd)
+{
+        auto const flags = fcntl(fd, F_GETFD);
+        return flags != -1 &&
+                fcntl(fd, F_SETFD, flags | FD_CLOEXEC) != -1;
+}
+
+bool
+read_all(int fd,
+         void* buf,
+         size_t size)
+{
+        auto data = reinterpret_cast<char*>(buf);
+        while (size != 0) {
+                auto const n = read(fd, data, size);
+                if (n == -1 && errno == EINTR)
+                        continue;
+                if (n <= 0)
+                        return false;
+
+                data += n;
+                size -= n;
+        }
+
+        return true;
+}
+
+bool
+write_all(int fd,
+          void const* buf,
+          size_t size)
+{
+        auto data = reinterpret_cast<char const*>(buf);
+        while (size != 0) {
+                auto const n = write(fd, data, size);
+                if (n == -1 && errno == EINTR)
+                        continue;
+                if (n <= 0)
+                        return false;
+
+                data += n;
+                size -= n;
+        }
+
+        return true;
+}
+
+/* Reads the Request and the PTY descriptor sent along with its first byte */
+bool
+receive_request(int fd,
+                Request* request,
+                int* pty_fd)
+{
+        union {
+                struct cmsghdr header;
+                char buf[CMSG_SPACE(sizeof(int))];
+        } control;
+        auto iov = iovec{request, sizeof(*request)};
+        auto msg = msghdr{};
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control.buf;
+        msg.msg_controllen = sizeof(control.buf);
+
+        auto flags = int{0};
+#ifdef MSG_CMSG_CLOEXEC
+        flags |= MSG_CMSG_CLOEXEC;
+#endif
+
+        ssize_t n;
+        do {
+                n = recvmsg(fd, &msg, flags);
+        } while (n == -1 && errno == EINTR);
+        if (n <= 0)
+                return false;
+
+        *pty_fd = -1;
+        for (auto cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+                if (cmsg->cmsg_level == SOL_SOCKET &&
+                    cmsg->cmsg_type == SCM_RIGHTS &&
+                    cmsg->cmsg_len == CMSG_LEN(sizeof(int))) {
+                        memcpy(pty_fd, CMSG_DATA(cmsg), sizeof(int));
+                        set_cloexec(*pty_fd);
+                }
+        }
+        if (*pty_fd == -1)
+                return false;
+
+        if (!read_all(fd, reinterpret_cast<char*>(request) + n, sizeof(*request) - n)) {
+                close(*pty_fd);
+                return false;
+        }
+
+        return true;
+}
+
+void
+execute_script(char const* file,
+               char** argv,
+               char** envp)
+{
+        auto n = size_t{0};
+        while (argv[n] != nullptr)
+                ++n;
+
+        auto script_argv = std::vector<char*>(n + 2, nullptr);
+        script_argv[0] = const_cast<char*>("/bin/sh");
+        script_argv[1] = const_cast<char*>(file);
+        for (auto i = size_t{1}; i < n; ++i)
+                script_argv[i + 1] = argv[i];
+
+        execve(script_argv[0], script_argv.data(), envp);
+}
+
+/* Like g_execute() in vtespawn.cc, returning with errno set on failure */
+void
+execute(char const* file,
+        char** argv,
+        char** envp,
+        char const* path)
+{
+        if (*file == '\0') {
+                errno = ENOENT;
+                return;
+        }
+
+        if (path == nullptr || strchr(file, '/') != nullptr) {
+                execve(file, argv, envp);
+                if (errno == ENOEXEC)
+                        execute_script(file, argv, envp);
+                return;
+        }
+
+        auto const len = strlen(file);
+        auto name = std::vector<char>(strlen(path) + len + 2);
+        auto got_eacces = false;
+
+        for (auto p = path; ; ) {
+                auto end = strchr(p, ':');
+                if (end == nullptr)
+                        end = p + strlen(p);
+
+                /* An empty element means the current directory */
+                auto q = name.data();
+                if (end != p) {
+                        memcpy(q, p, end - p);
+                        q += end - p;
+                        *q++ = '/';
+                }
+                memcpy(q, file, len + 1);
+
+                execve(name.data(), argv, envp);
+                if (errno == ENOEXEC)
+                        execute_script(name.data(), argv, envp);
+
+                switch (errno) {
+                case EACCES:
+                        /* Record that we got a 'Permission denied' error. If we
+                         * end up finding no executable we can use, we want to
+                         * diagnose that we did find one but were denied access.
+                         */
+                        got_eacces = true;
+                        [[fallthrough]];
+                case ENOENT:
+#ifdef ESTALE
+                case ESTALE:
+#endif
+#ifdef ENOTDIR
+                case ENOTDIR:
+#endif
+#ifdef ENODEV
+                case ENODEV:
+#endif
+#ifdef ETIMEDOUT
+                case ETIMEDOUT:
+#endif
+                        /* Try the next element of the path */
+                        break;
+
+                default:
+                        /* Some other error means we found an executable file,
+                         * but something went wrong executing it; return the
+                         * error to our caller.
+                         */
+                        return;
+                }
+
+                if (*end == '\0')
+                        break;
+                p = end + 1;
+        }
+
+        if (got_eacces)
+                errno = EACCES;
+}
+
+[[noreturn]] void
+report_and_exit(int err_fd,
+                Error error)
+{
+        auto const child_error = ChildError{error, errno};
+        write_all(err_fd, &child_error, sizeof(child_error));
+        _exit(127);
+}
+
+/* Runs in the forked child. This does what Pty::child_setup() does in
+ * the host, then the chdir() and exec of vtespawn.cc's do_exec().
+ * All of our own descriptors are FD_CLOEXEC, except for the stdio ones.
+ */
+[[noreturn]] void
+exec_child(int err_fd,
+           Request const& request,
+           int masterfd,
+           char const* directory,
+           char const* path,
+           char** argv,
+           char** envp)
+{
+        for (int n = 1; n < NSIG; n++) {
+                if (n == SIGSTOP || n == SIGKILL)
+                        continue;
+
+                signal(n, SIG_DFL);
+        }
+
+        sigset_t set;
+        sigemptyset(&set);
+        if (sigprocmask(SIG_SETMASK, &set, nullptr) == -1)
+                _exit(127);
+
+        if (grantpt(masterfd) != 0 ||
+            unlockpt(masterfd) != 0)
+                _exit(127);
+
+        if (!(request.flags & k_flag_no_session) &&
+            setsid() == -1)
+                _exit(127);
+
+        /* Note: *not* O_CLOEXEC! */
+        auto const fd_flags = int{O_RDWR | ((request.flags & k_flag_no_ctty) ? O_NOCTTY : 0)};
+        auto fd = int{-1};
+
+#ifdef __linux__
+        fd = ioctl(masterfd, TIOCGPTPEER, fd_flags);
+        if (fd == -1 &&
+            errno != EINVAL &&
+            errno != ENOTTY)
+                _exit(127);
+#endif
+
+        if (fd == -1) {
+                auto const name = ptsname(masterfd);
+                if (name == nullptr)
+                        _exit(127);
+
+                fd = open(name, fd_flags);
+                if (fd == -1)
+                        _exit(127);
+        }
+
+#ifdef TIOCSCTTY
+        if (!(request.flags & k_flag_no_ctty) &&
+            ioctl(fd, TIOCSCTTY, fd) != 0)
+                _exit(127);
+#endif
+
+#if defined(__sun) && defined(HAVE_STROPTS_H)
+        if (isastream(fd) == 1) {
+                if ((ioctl(fd, I_FIND, "ptem") == 0) &&
+                    (ioctl(fd, I_PUSH, "ptem") == -1))
+                        _exit(127);
+                if ((ioctl(fd, I_FIND, "ldterm") == 0) &&
+                    (ioctl(fd, I_PUSH, "ldterm") == -1))
+                        _exit(127);
+                if ((ioctl(fd, I_FIND, "ttcompat") == 0) &&
+                    (ioctl(fd, I_PUSH, "ttcompat") == -1))
+                        _exit(127);
+        }
+#endif
+
+        for (auto i = STDIN_FILENO; i <= STDERR_FILENO; ++i) {
+                if (fd != i &&
+                    dup2(fd, i) != i)
+                        _exit(127);
+        }
+        if (fd > STDERR_FILENO)
+                close(fd);
+
+        if (chdir(directory) == -1)
+                report_and_exit(err_fd, Error::eChdir);
+
+        if (request.flags & k_flag_file_and_argv_zero)
+                execute(argv[0], argv + 1, envp, path);
+        else
+                execute(argv[0], argv, envp, path);
+
+        report_and_exit(err_fd, Error::eExec);
+}
+
+bool
+handle_request(int request_fd)
+{
+        auto request = Request{};
+        auto pty_fd = int{-1};
+        if (!receive_request(request_fd, &request, &pty_fd))
+                return false;
+
+        auto reply = Reply{request.serial, -1, Error::eNone, 0};
+
+        /* Check the sizes before allocating for them; each string takes at
+         * least its terminator */
+        auto const n_strings = size_t{2} + request.n_argv + request.n_envp;
+        if (request.size > k_max_request_size ||
+            request.n_argv == 0 ||
+            n_strings > request.size) {
+                close(pty_fd);
+                return false;
+        }
+
+        auto data = std::vector<char>(request.size);
+        auto strings = std::vector<char*>{};
+        if (!read_all(request_fd, data.data(), data.size()) ||
+            data.empty() ||
+            data.back() != '\0') {
+                close(pty_fd);
+                return false;
+        }
+
+        /* Split the strings, leaving a nullptr after the argv and the envp */
+        strings.reserve(n_strings + 2);
+        for (auto p = data.data(); p < data.data() + data.size(); p += strlen(p) + 1) {
+                strings.push_back(p);
+                if (strings.size() == 2 + request.n_argv)
+                        strings.push_back(nullptr);
+        }
+        strings.push_back(nullptr);
+        if (strings.size() != n_strings + 2) {
+                close(pty_fd);
+                return false;
+        }
+
+        auto const directory = strings[0];
+        auto const path = (request.flags & k_flag_search_path) ? strings[1] : nullptr;
+        auto const argv = &strings[2];
+        auto const envp = &strings[3 + request.n_argv];
+
+        int err_pipe[2];
+        if (pipe(err_pipe) == -1) {
+                reply.error = Error::eFork;
+                reply.errsv = errno;
+        } else {
+                set_cloexec(err_pipe[0]);
+                set_cloexec(err_pipe[1]);
+
+                auto const pid = fork();
+                if (pid == 0)
+                        exec_child(err_pipe[1], request, pty_fd, directory, path, argv, envp);
+
+                auto const errsv = errno;
+                close(err_pipe[1]);
+
+                if (pid == -1) {
+                        reply.error = Error::eFork;
+                        reply.errsv = errsv;
+                } else {
+                        /* Read until the exec closes the pipe, or the child reports an error */
+                        auto child_error = ChildError{};
+                        if (read_all(err_pipe[0], &child_error, sizeof(child_error))) {
+                                reply.error = child_error.error;
+                                reply.errsv = child_error.errsv;
+
+                                /* Reap it now, so it isn't reported as exited */
+                                while (waitpid(pid, nullptr, 0) == -1 && errno == EINTR)
+                                        ;
+                        } else {
+                                reply.pid = pid;
+                        }
+                }
+
+                close(err_pipe[0]);
+        }
+
+        close(pty_fd);
+
+        return write_all(request_fd, &reply, sizeof(reply));
+}
+
+/* Reports the exit of all the children that exited */
+bool
+reap_children(int event_fd)
+{
+        for (;;) {
+                int status;
+                auto const pid = waitpid(-1, &status, WNOHANG);
+                if (pid == -1 && errno == EINTR)
+                        continue;
+                if (pid <= 0)
+                        return true;
+
+                auto const exited = Exited{pid, status};
+                if (!write_all(event_fd, &exited, sizeof(exited)))
+                        return false;
+        }
+}
+
+} // anonymous namespace
+
+int
+main(int argc,
+     char* argv[])
+{
+        if (argc != 3) {
+                fprintf(stderr, "%s is run by libvte, and not meant to be run directly.\n", argv[0]);
+                return EXIT_FAILURE;
+        }
+
+        auto const request_fd = atoi(argv[1]);
+        auto const event_fd = atoi(argv[2]);
+        if (!set_cloexec(request_fd) ||
+            !set_cloexec(event_fd))
+                return EXIT_FAILURE;
+
+        /* Leave the session of the host, so that its job control doesn't
+         * reach us, and don't keep its working directory busy.
+         */
+        (void)setsid();
+        (void)chdir("/");
+
+        /* The host went away if writing fails; we then exit */
+        signal(SIGPIPE, SIG_IGN);
+
+        if (pipe(s_sigchld_pipe) == -1)
+                return EXIT_FAILURE;
+        for (auto fd : s_sigchld_pipe) {
+                set_cloexec(fd);
+                fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        }
+
+        struct sigaction action{};
+        action.sa_handler = sigchld_handler;
+        action.sa_flags = SA_RESTART | SA_NOCLDSTOP;
+        sigemptyset(&action.sa_mask);
+        if (sigaction(SIGCHLD, &action, nullptr) == -1)
+                return EXIT_FAILURE;
+
+        for (;;) {
+                struct pollfd fds[2] = {
+                        { request_fd, POLLIN, 0 },
+                        { s_sigchld_pipe[0], POLLIN, 0 },
+                };
+                if (poll(fds, 2, -1) == -1) {
+                        if (errno == EINTR)
+                                continue;
+                        return EXIT_FAILURE;
+                }
+
+                if (fds[1].revents) {
+                        char buf[64];
+                        while (read(s_sigchld_pipe[0], buf, sizeof(buf)) > 0)
+                                ;
+                        if (!reap_children(event_fd))
+                                break;
+                }
+
+                /* EOF when the host closed its end */
+                if (fds[0].revents &&
+                    !handle_request(request_fd))
+                        break;
+        }
+
+        return EXIT_SUCCESS;
+}
@@ -0,0 +1,99 @@
+/*
+ * Copyright © 2026 The VTE developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/*
+ * The protocol between SpawnHelper (spawn-helper.cc) and the spawn helper
+ * process (spawn-helper-main.cc). The helper is started with the numbers
+ * of two descriptors as its arguments: a stream socket for the requests
+ * and their replies, and a pipe it writes the Exited events to.
+ *
+ * Everything is in the host's byte order, since both ends run on it.
+ */
+
+namespace vte {
+
+namespace base {
+
+namespace spawn_helper {
+
+/* Request flags */
+enum : uint32_t {
+        k_flag_search_path        = 1u << 0, /* look up the file in the search path */
+        k_flag_file_and_argv_zero = 1u << 1, /* like G_SPAWN_FILE_AND_ARGV_ZERO */
+        k_flag_no_session         = 1u << 2, /* like VTE_PTY_NO_SESSION */
+        k_flag_no_ctty            = 1u << 3, /* like VTE_PTY_NO_CTTY */
+};
+
+/* The largest Request::size the helper accepts */
+static constexpr size_t const k_max_request_size = 16 * 1024 * 1024;
+
+/*
+ * Request:
+ *
+ * Sent with the PTY master descriptor attached (SCM_RIGHTS), and followed
+ * by @size bytes of NUL-terminated strings: the working directory, the
+ * search path (empty unless k_flag_search_path), the @n_argv arguments,
+ * and the @n_envp environment variables.
+ */
+struct Request {
+        uint32_t serial;
+        uint32_t flags;
+        uint32_t n_argv;
+        uint32_t n_envp;
+        uint32_t size;
+};
+
+enum class Error : int32_t {
+        eNone,
+        eChdir, /* the child failed to change to the working directory */
+        eExec,  /* the child failed to execute the file */
+        eFork,  /* the helper failed to fork */
+};
+
+/*
+ * Reply:
+ *
+ * Sent for every Request, with its @serial. On success @pid is the
+ * child's; otherwise it is -1, and @errsv the errno of the @error.
+ */
+struct Reply {
+        uint32_t serial;
+        int32_t pid;
+        Error error;
+        int32_t errsv;
+};
+
+/*
+ * Exited:
+ *
+ * Written to the event pipe by the helper after reaping a child.
+ */
+struct Exited {
+        int32_t pid;
+        int32_t status; /* as returned by waitpid() */
+};
+
+} // namespace spawn_helper
+
+} // namespace base
+
+} // namespace vte
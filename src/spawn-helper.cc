@@ -0,0 +1,478 @@
+/*
+ * Copyright © 2026 The VTE developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "spawn-helper.hh"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <glib-unix.h>
+#include <gio/gio.h>
+#include <glib/gi18n-lib.h>
+
+#include "debug.h"
+#include "glib-glue.hh"
+#include "reaper.hh"
+#include "vtespawn.hh"
+#include "vtetypes.hh"
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+namespace vte {
+
+namespace base {
+
+using namespace spawn_helper;
+
+namespace {
+
+/* The reading end of an event pipe, and the part of an Exited read so far */
+struct EventPipe {
+        int fd;
+        size_t len{0};
+        char buf[sizeof(Exited)];
+};
+
+gboolean
+event_pipe_readable_cb(int fd,
+                       GIOCondition condition,
+                       void* data)
+{
+        auto event_pipe = reinterpret_cast<EventPipe*>(data);
+
+        char buf[64 * sizeof(Exited)];
+        auto const n = read(fd, buf, sizeof(buf));
+        if (n == -1 && (errno == EINTR || errno == EAGAIN))
+                return G_SOURCE_CONTINUE;
+        if (n <= 0) {
+                /* The helper exited */
+                _vte_debug_print(VTE_DEBUG_PTY, "Spawn helper went away\n");
+                return G_SOURCE_REMOVE;
+        }
+
+        for (auto p = buf; p < buf + n; ) {
+                auto const len = std::min(size_t(buf + n - p), sizeof(event_pipe->buf) - event_pipe->len);
+                memcpy(event_pipe->buf + event_pipe->len, p, len);
+                event_pipe->len += len;
+                p += len;
+
+                if (event_pipe->len < sizeof(event_pipe->buf))
+                        break;
+
+                auto exited = Exited{};
+                memcpy(&exited, event_pipe->buf, sizeof(exited));
+                event_pipe->len = 0;
+
+                vte_reaper_child_exited(exited.pid, exited.status);
+        }
+
+        return G_SOURCE_CONTINUE;
+}
+
+void
+event_pipe_free(void* data)
+{
+        auto event_pipe = reinterpret_cast<EventPipe*>(data);
+        close(event_pipe->fd);
+        delete event_pipe;
+}
+
+void
+helper_exited_cb(GPid pid,
+                 int status,
+                 void* data)
+{
+        g_spawn_close_pid(pid);
+}
+
+/* Runs in the vfork()ed child: let the helper inherit its descriptors */
+void
+helper_child_setup_cb(void* data)
+{
+        auto fds = reinterpret_cast<int const*>(data);
+        fcntl(fds[0], F_SETFD, 0);
+        fcntl(fds[1], F_SETFD, 0);
+}
+
+void
+set_helper_error(GError** error,
+                 char const* message)
+{
+        g_set_error_literal(error, G_IO_ERROR, G_IO_ERROR_NOT_CONNECTED, message);
+}
+
+} // anonymous namespace
+
+SpawnHelper::SpawnHelper() noexcept
+{
+        g_mutex_init(&m_lock);
+}
+
+SpawnHelper*
+SpawnHelper::get() noexcept
+{
+        static SpawnHelper s_helper{};
+        return &s_helper;
+}
+
+bool
+SpawnHelper::start() noexcept
+{
+        int request_fds[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, request_fds) == -1)
+                return false;
+
+        auto our_request_fd = vte::util::smart_fd{request_fds[0]};
+        auto helper_request_fd = vte::util::smart_fd{request_fds[1]};
+
+        int event_fds[2];
+        if (!g_unix_open_pipe(event_fds, FD_CLOEXEC, nullptr))
+                return false;
+
+        auto our_event_fd = vte::util::smart_fd{event_fds[0]};
+        auto helper_event_fd = vte::util::smart_fd{event_fds[1]};
+
+        if (fcntl(our_request_fd, F_SETFD, FD_CLOEXEC) == -1 ||
+            fcntl(helper_request_fd, F_SETFD, FD_CLOEXEC) == -1 ||
+            !g_unix_set_fd_nonblocking(our_event_fd, true, nullptr))
+                return false;
+
+        auto path = g_build_filename(LIBEXECDIR, VTE_SPAWN_HELPER_NAME, nullptr);
+        auto request_arg = g_strdup_printf("%d", int(helper_request_fd));
+        auto event_arg = g_strdup_printf("%d", int(helper_event_fd));
+        char* argv[] = { path, request_arg, event_arg, nullptr };
+        int const helper_fds[2] = { helper_request_fd, helper_event_fd };
+
+        auto pid = GPid{-1};
+        auto err = vte::glib::Error{};
+        auto const ret = vte_spawn_async_cancellable(nullptr,
+                                                     argv,
+                                                     nullptr, /* our environment */
+                                                     GSpawnFlags(G_SPAWN_DO_NOT_REAP_CHILD |
+                                                                 VTE_SPAWN_CHILD_SETUP_VFORK_SAFE),
+                                                     helper_child_setup_cb,
+                                                     const_cast<int*>(helper_fds),
+                                                     &pid,
+                                                     -1, /* no timeout */
+                                                     nullptr, /* not cancellable */
+                                                     err);
+        g_free(path);
+        g_free(request_arg);
+        g_free(event_arg);
+
+        if (!ret) {
+                _vte_debug_print(VTE_DEBUG_PTY, "Failed to start the spawn helper: %s\n",
+                                 err.message());
+                return false;
+        }
+
+        _vte_debug_print(VTE_DEBUG_PTY, "Started the spawn helper, pid %d\n", int(pid));
+
+        g_child_watch_add_full(G_PRIORITY_LOW, pid, helper_exited_cb, nullptr, nullptr);
+
+        /* The exit events are dispatched on the main context, where the
+         * terminals watch their children. */
+        auto event_pipe = new EventPipe{};
+        event_pipe->fd = our_event_fd.steal();
+        auto source = g_unix_fd_source_new(event_pipe->fd, GIOCondition(G_IO_IN | G_IO_HUP | G_IO_ERR));
+        g_source_set_callback(source,
+                              (GSourceFunc)(void*)event_pipe_readable_cb,
+                              event_pipe,
+                              event_pipe_free);
+        g_source_set_priority(source, G_PRIORITY_LOW);
+        g_source_attach(source, nullptr);
+        g_source_unref(source);
+
+        m_request_fd = our_request_fd.steal();
+        return true;
+}
+
+/* Closing the request socket makes the helper exit, once it's done with
+ * the request at hand. */
+void
+SpawnHelper::stop() noexcept
+{
+        if (m_request_fd != -1)
+                close(m_request_fd);
+        m_request_fd = -1;
+}
+
+bool
+SpawnHelper::send_request(Request const& request,
+                          int pty_fd,
+                          GString const* strings) noexcept
+{
+        /* The PTY descriptor goes along with the first byte of the request */
+        union {
+                struct cmsghdr header;
+                char buf[CMSG_SPACE(sizeof(int))];
+        } control;
+        memset(&control, 0, sizeof(control));
+
+        struct iovec iov[2] = {
+                { const_cast<Request*>(&request), sizeof(request) },
+                { strings->str, strings->len },
+        };
+        auto msg = msghdr{};
+        msg.msg_iov = iov;
+        msg.msg_iovlen = G_N_ELEMENTS(iov);
+        msg.msg_control = control.buf;
+        msg.msg_controllen = sizeof(control.buf);
+
+        auto cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+        memcpy(CMSG_DATA(cmsg), &pty_fd, sizeof(int));
+
+        while (msg.msg_iovlen != 0) {
+                auto n = sendmsg(m_request_fd, &msg, MSG_NOSIGNAL);
+                if (n == -1 && errno == EINTR)
+                        continue;
+                if (n == -1)
+                        return false;
+
+                msg.msg_control = nullptr;
+                msg.msg_controllen = 0;
+
+                while (msg.msg_iovlen != 0 && size_t(n) >= msg.msg_iov->iov_len) {
+                        n -= msg.msg_iov->iov_len;
+                        ++msg.msg_iov;
+                        --msg.msg_iovlen;
+                }
+                if (msg.msg_iovlen != 0) {
+                        msg.msg_iov->iov_base = reinterpret_cast<char*>(msg.msg_iov->iov_base) + n;
+                        msg.msg_iov->iov_len -= n;
+                }
+        }
+
+        return true;
+}
+
+/* Waits for the reply to the request @serial. Replies to earlier requests,
+ * which timed out or were cancelled, are skipped; like vtespawn.cc does for
+ * those, their child is left running.
+ */
+bool
+SpawnHelper::receive_reply(uint32_t serial,
+                           Reply* reply,
+                           int timeout,
+                           GPollFD* cancellable_pollfd,
+                           GError** error) noexcept
+{
+        GPollFD pollfds[2];
+        pollfds[0].fd = m_request_fd;
+        pollfds[0].events = G_IO_IN | G_IO_HUP | G_IO_ERR;
+        auto n_pollfds = 1u;
+        if (cancellable_pollfd != nullptr)
+                pollfds[n_pollfds++] = *cancellable_pollfd;
+
+        auto const deadline = timeout >= 0 ? g_get_monotonic_time() + timeout * G_GINT64_CONSTANT(1000) : 0;
+
+        for (;;) {
+                auto remaining = int{-1};
+                if (timeout >= 0)
+                        remaining = int(MAX(deadline - g_get_monotonic_time(), 0) / 1000);
+
+                pollfds[0].revents = pollfds[1].revents = 0;
+                auto const r = g_poll(pollfds, n_pollfds, remaining);
+                if (r == -1 && errno == EINTR)
+                        continue;
+                if (r == -1) {
+                        vte::util::restore_errno errsv;
+                        g_set_error(error, G_IO_ERROR, g_io_error_from_errno(errsv),
+                                    "poll error: %s", g_strerror(errsv));
+                        return false;
+                }
+                if (r == 0) {
+                        g_set_error_literal(error, G_IO_ERROR, G_IO_ERROR_TIMED_OUT,
+                                            _("Operation timed out"));
+                        return false;
+                }
+                if (n_pollfds == 2 && pollfds[1].revents) {
+                        g_set_error_literal(error, G_IO_ERROR, G_IO_ERROR_CANCELLED,
+                                            _("Operation was cancelled"));
+                        return false;
+                }
+
+                /* The helper writes the reply at once, so the rest of it follows */
+                auto data = reinterpret_cast<char*>(reply);
+                auto len = size_t{0};
+                while (len < sizeof(*reply)) {
+                        auto const n = read(m_request_fd, data + len, sizeof(*reply) - len);
+                        if (n == -1 && errno == EINTR)
+                                continue;
+                        if (n <= 0) {
+                                stop();
+                                g_set_error_literal(error, G_SPAWN_ERROR, G_SPAWN_ERROR_FAILED,
+                                                    _("The spawn helper exited"));
+                                return false;
+                        }
+
+                        len += n;
+                }
+
+                if (reply->serial == serial)
+                        return true;
+        }
+}
+
+bool
+SpawnHelper::spawn(Pty const& pty,
+                   char const* directory,
+                   char** argv,
+                   char** envp,
+                   unsigned spawn_flags,
+                   GPid* child_pid,
+                   int timeout,
+                   GPollFD* cancellable_pollfd,
+                   GError** error) noexcept
+{
+        auto request = Request{};
+        if (spawn_flags & G_SPAWN_FILE_AND_ARGV_ZERO)
+                request.flags |= k_flag_file_and_argv_zero;
+        if (pty.flags() & VTE_PTY_NO_SESSION)
+                request.flags |= k_flag_no_session;
+        if (pty.flags() & VTE_PTY_NO_CTTY)
+                request.flags |= k_flag_no_ctty;
+
+        /* Look up the search path here, as vtespawn.cc's exec_buffers_init() does */
+        auto path = (char const*){nullptr};
+        if ((spawn_flags & (G_SPAWN_SEARCH_PATH | G_SPAWN_SEARCH_PATH_FROM_ENVP)) &&
+            strchr(argv[0], '/') == nullptr) {
+                if (spawn_flags & G_SPAWN_SEARCH_PATH_FROM_ENVP)
+                        path = g_environ_getenv(envp, "PATH");
+                if ((spawn_flags & G_SPAWN_SEARCH_PATH) && path == nullptr)
+                        path = g_getenv("PATH");
+                if (path == nullptr)
+                        path = "/bin:/usr/bin:.";
+
+                request.flags |= k_flag_search_path;
+        }
+
+        /* The helper doesn't share our working directory */
+        auto cwd = directory ? nullptr : g_get_current_dir();
+        auto const dir = directory ? directory : cwd;
+
+        auto strings = g_string_new(nullptr);
+        g_string_append_len(strings, dir, strlen(dir) + 1);
+        g_string_append_len(strings, path ? path : "", strlen(path ? path : "") + 1);
+        for (auto i = 0; argv[i] != nullptr; ++i, ++request.n_argv)
+                g_string_append_len(strings, argv[i], strlen(argv[i]) + 1);
+        for (auto i = 0; envp[i] != nullptr; ++i, ++request.n_envp)
+                g_string_append_len(strings, envp[i], strlen(envp[i]) + 1);
+        request.size = strings->len;
+
+        auto reply = Reply{};
+        auto ret = false;
+
+        g_mutex_lock(&m_lock);
+
+        if (strings->len > k_max_request_size) {
+                set_helper_error(error, "Request too large for the spawn helper");
+                goto out;
+        }
+
+        request.serial = ++m_serial;
+
+        /* If the helper went away, we only notice when sending to it fails;
+         * then start another one, once.
+         */
+        for (auto attempt = 0; ; ++attempt) {
+                if (m_request_fd == -1 && !m_failed && !start())
+                        m_failed = true;
+                if (m_request_fd == -1) {
+                        set_helper_error(error, "Failed to start the spawn helper");
+                        goto out;
+                }
+
+                if (send_request(request, pty.fd(), strings))
+                        break;
+
+                stop();
+                if (attempt > 0) {
+                        set_helper_error(error, "Failed to send to the spawn helper");
+                        goto out;
+                }
+        }
+
+        if (!receive_reply(request.serial, &reply, timeout, cancellable_pollfd, error))
+                goto out;
+
+        switch (reply.error) {
+        case Error::eNone:
+                if (child_pid)
+                        *child_pid = reply.pid;
+                ret = true;
+                break;
+
+        case Error::eChdir:
+                g_set_error(error,
+                            G_SPAWN_ERROR,
+                            G_SPAWN_ERROR_CHDIR,
+                            _("Failed to change to directory “%s” (%s)"),
+                            dir,
+                            g_strerror(reply.errsv));
+                break;
+
+        case Error::eExec:
+                g_set_error(error,
+                            G_SPAWN_ERROR,
+                            vte_spawn_exec_error_from_errno(reply.errsv),
+                            _("Failed to execute child process “%s” (%s)"),
+                            argv[0],
+                            g_strerror(reply.errsv));
+                break;
+
+        case Error::eFork:
+                g_set_error(error,
+                            G_SPAWN_ERROR,
+                            G_SPAWN_ERROR_FORK,
+                            _("Failed to fork child process (%s)"),
+                            g_strerror(reply.errsv));
+                break;
+
+        default:
+                g_set_error(error,
+                            G_SPAWN_ERROR,
+                            G_SPAWN_ERROR_FAILED,
+                            _("Unknown error executing child process “%s”"),
+                            argv[0]);
+                break;
+        }
+
+ out:
+        g_mutex_unlock(&m_lock);
+        g_string_free(strings, true);
+        g_free(cwd);
+
+        return ret;
+}
+
+} // namespace base
+
+} // namespace vte
@@ -0,0 +1,95 @@
+/*
+ * Copyright © 2026 The VTE developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+
+#include <glib.h>
+
+#include "pty.hh"
+#include "spawn-helper-protocol.hh"
+
+namespace vte {
+
+namespace base {
+
+/*
+ * SpawnHelper:
+ *
+ * Spawns the children of PTYs from the spawn helper process (see
+ * spawn-helper-main.cc), which is started on first use and kept running.
+ * It is small, so that forking it is fast whatever the size of the host.
+ *
+ * Its children aren't ours; the helper reaps them, and their exit is
+ * reported through vte_reaper_child_exited().
+ *
+ * Thread-safe: spawning can happen on any thread. The exits are reported
+ * on the main context.
+ */
+class SpawnHelper {
+public:
+        /* Returns: the spawn helper; it's started on the first spawn() */
+        static SpawnHelper* get() noexcept;
+
+        /* spawn:
+         *
+         * Spawns the command in @argv with @envp, as Pty::spawn() does.
+         * Only G_SPAWN_SEARCH_PATH, G_SPAWN_SEARCH_PATH_FROM_ENVP and
+         * G_SPAWN_FILE_AND_ARGV_ZERO of @spawn_flags apply; the other flags
+         * concern the stdio descriptors, which the PTY replaces anyway.
+         *
+         * Fails with G_IO_ERROR_NOT_CONNECTED if the helper can't be used,
+         * in which case the caller should spawn the command itself.
+         */
+        bool spawn(Pty const& pty,
+                   char const* directory,
+                   char** argv,
+                   char** envp,
+                   unsigned spawn_flags,
+                   GPid* child_pid,
+                   int timeout,
+                   GPollFD* cancellable_pollfd,
+                   GError** error) noexcept;
+
+private:
+        SpawnHelper() noexcept;
+        SpawnHelper(SpawnHelper const&) = delete;
+        SpawnHelper(SpawnHelper&&) = delete;
+        SpawnHelper& operator= (SpawnHelper const&) = delete;
+        SpawnHelper& operator= (SpawnHelper&&) = delete;
+
+        bool start() noexcept;
+        void stop() noexcept;
+        bool send_request(spawn_helper::Request const& request,
+                          int pty_fd,
+                          GString const* strings) noexcept;
+        bool receive_reply(uint32_t serial,
+                           spawn_helper::Reply* reply,
+                           int timeout,
+                           GPollFD* cancellable_pollfd,
+                           GError** error) noexcept;
+
+        GMutex m_lock;          /* protects all of the below */
+        int m_request_fd{-1};   /* our end of the request socket, or -1 if not running */
+        bool m_failed{false};   /* starting the helper failed; don't retry */
+        uint32_t m_serial{0};   /* of the last request */
+};
+
+} // namespace base
+
+} // namespace vte
@@ -0,0 +1,104 @@
+/*
+ * Copyright © 2026 The VTE developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+
+namespace vte {
+
+namespace base {
+
+/*
+ * SPSCQueue:
+ *
+ * A bounded, lock-free queue for exactly one producer thread and
+ * exactly one consumer thread.
+ *
+ * @N must be a power of two; the queue can hold up to @N - 1 elements.
+ */
+template<typename T, size_t N>
+class SPSCQueue {
+        static_assert(N >= 2 && (N & (N - 1)) == 0, "N must be a power of two");
+        static_assert(std::is_nothrow_move_assignable_v<T>, "T must be nothrow move assignable");
+
+public:
+        SPSCQueue() noexcept = default;
+        ~SPSCQueue() noexcept = default;
+
+        SPSCQueue(SPSCQueue const&) = delete;
+        SPSCQueue(SPSCQueue&&) = delete;
+        SPSCQueue& operator= (SPSCQueue const&) = delete;
+        SPSCQueue& operator= (SPSCQueue&&) = delete;
+
+        /* Producer side. Returns false if the queue is full, in which
+         * case @value is left unchanged.
+         */
+        bool push(T& value) noexcept
+        {
+                auto const tail = m_tail.load(std::memory_order_relaxed);
+                auto const next = (tail + 1) & k_mask;
+                if (next == m_head.load(std::memory_order_acquire))
+                        return false;
+
+                m_elements[tail] = std::move(value);
+                m_tail.store(next, std::memory_order_release);
+                return true;
+        }
+
+        /* Consumer side. Returns false if the queue is empty. */
+        bool pop(T& value) noexcept
+        {
+                auto const head = m_head.load(std::memory_order_relaxed);
+                if (head == m_tail.load(std::memory_order_acquire))
+                        return false;
+
+                value = std::move(m_elements[head]);
+                m_head.store((head + 1) & k_mask, std::memory_order_release);
+                return true;
+        }
+
+        /* May be called from either side; the result is only a snapshot */
+        bool empty() const noexcept
+        {
+                return m_head.load(std::memory_order_acquire) ==
+                        m_tail.load(std::memory_order_acquire);
+        }
+
+        size_t size() const noexcept
+        {
+                return (m_tail.load(std::memory_order_acquire) -
+                        m_head.load(std::memory_order_acquire)) & k_mask;
+        }
+
+        static constexpr size_t capacity() noexcept { return N - 1; }
+
+private:
+        static constexpr size_t const k_mask = N - 1;
+
+        /* Keep producer and consumer indices on separate cache lines */
+        alignas(64) std::atomic<size_t> m_head{0};
+        alignas(64) std::atomic<size_t> m_tail{0};
+        alignas(64) T m_elements[N]{};
+};
+
+} // namespace base
+
+} // namespace vte
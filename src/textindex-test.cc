@@ -0,0 +1,129 @@
+/*
+ * Copyright © 2026 The VTE developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <glib.h>
+
+#include <string>
+
+#include "textindex.hh"
+
+using namespace vte::base;
+
+static ByteSet
+bytes_of(char const* str)
+{
+        auto set = ByteSet{};
+        for (auto p = str; *p; p++)
+                set.add(uint8_t(*p));
+        return set;
+}
+
+static void
+test_textindex_byteset(void)
+{
+        auto set = ByteSet{};
+        g_assert_true(set.empty());
+        g_assert_false(set.full());
+
+        set.add('a');
+        set.add(0xff);
+        g_assert_false(set.empty());
+        g_assert_true(set.contains('a'));
+        g_assert_true(set.contains(0xff));
+        g_assert_false(set.contains('b'));
+        g_assert_true(set.intersects(bytes_of("xyza")));
+        g_assert_false(set.intersects(bytes_of("xyz")));
+
+        set |= bytes_of("b");
+        g_assert_true(set.contains('b'));
+
+        auto all = ByteSet::all();
+        g_assert_true(all.full());
+        g_assert_true(all.contains(0));
+        g_assert_true(all.intersects(set));
+}
+
+static void
+test_textindex_chunks(void)
+{
+        auto const n = TextIndex::k_chunk_size;
+        auto index = TextIndex{};
+        index.reset(0);
+
+        auto text = std::string(n, 'a');
+        text.append(n, 'b');
+        text.append(10, 'c');
+        index.add(0, text.data(), text.size());
+
+        /* Each chunk only has its own bytes */
+        auto set = index.bytes(0, n);
+        g_assert_true(set.contains('a'));
+        g_assert_false(set.contains('b'));
+        set = index.bytes(n + 1, n + 2);
+        g_assert_false(set.contains('a'));
+        g_assert_true(set.contains('b'));
+        g_assert_false(set.contains('c'));
+        set = index.bytes(n - 1, 2 * n + 1);
+        g_assert_true(set.contains('a'));
+        g_assert_true(set.contains('b'));
+        g_assert_true(set.contains('c'));
+
+        /* Text that isn't indexed may contain anything */
+        g_assert_true(index.bytes(0, text.size() + 1).full());
+        g_assert_true(index.bytes(5, 5).empty());
+
+        /* Text written again after truncating adds to the chunk */
+        index.truncate(2 * n);
+        g_assert_true(index.bytes(2 * n, 2 * n + 1).full());
+        index.add(2 * n, "d", 1);
+        set = index.bytes(2 * n, 2 * n + 1);
+        g_assert_true(set.contains('c'));
+        g_assert_true(set.contains('d'));
+
+        /* Dropping the tail */
+        index.advance_tail(n + 5);
+        g_assert_true(index.bytes(0, n).full());
+        set = index.bytes(n + 5, n + 6);
+        g_assert_true(set.contains('b'));
+        g_assert_false(set.contains('a'));
+
+        /* Non-contiguous text starts over */
+        index.add(10 * n, "e", 1);
+        g_assert_true(index.bytes(n + 5, n + 6).full());
+        g_assert_true(index.bytes(10 * n, 10 * n + 1).contains('e'));
+
+        index.reset(20 * n + 7);
+        g_assert_true(index.bytes(10 * n, 10 * n + 1).full());
+        index.add(20 * n + 7, "f", 1);
+        set = index.bytes(20 * n + 7, 20 * n + 8);
+        g_assert_true(set.contains('f'));
+        g_assert_false(set.contains('e'));
+}
+
+int
+main(int argc,
+     char* argv[])
+{
+        g_test_init(&argc, &argv, nullptr);
+
+        g_test_add_func("/vte/textindex/byteset", test_textindex_byteset);
+        g_test_add_func("/vte/textindex/chunks", test_textindex_chunks);
+
+        return g_test_run();
+}
@@ -0,0 +1,198 @@
+/*
+ * Copyright © 2026 The VTE developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+
+namespace vte {
+
+namespace base {
+
+/*
+ * ByteSet:
+ *
+ * A set of byte values, as a bitmap.
+ */
+class ByteSet {
+public:
+        constexpr ByteSet() noexcept = default;
+
+        static constexpr ByteSet all() noexcept
+        {
+                auto set = ByteSet{};
+                for (auto& word : set.m_bits)
+                        word = ~uint64_t{0};
+                return set;
+        }
+
+        inline constexpr void add(uint8_t c) noexcept { m_bits[c >> 6] |= uint64_t{1} << (c & 63); }
+        inline constexpr bool contains(uint8_t c) const noexcept { return (m_bits[c >> 6] >> (c & 63)) & 1; }
+
+        inline constexpr bool empty() const noexcept
+        {
+                return (m_bits[0] | m_bits[1] | m_bits[2] | m_bits[3]) == 0;
+        }
+
+        inline constexpr bool full() const noexcept
+        {
+                return (m_bits[0] & m_bits[1] & m_bits[2] & m_bits[3]) == ~uint64_t{0};
+        }
+
+        inline constexpr bool intersects(ByteSet const& other) const noexcept
+        {
+                return ((m_bits[0] & other.m_bits[0]) |
+                        (m_bits[1] & other.m_bits[1]) |
+                        (m_bits[2] & other.m_bits[2]) |
+                        (m_bits[3] & other.m_bits[3])) != 0;
+        }
+
+        inline constexpr ByteSet& operator|= (ByteSet const& other) noexcept
+        {
+                for (auto i = 0; i < 4; i++)
+                        m_bits[i] |= other.m_bits[i];
+                return *this;
+        }
+
+private:
+        uint64_t m_bits[4]{0, 0, 0, 0};
+};
+
+/*
+ * TextIndex:
+ *
+ * Records which byte values occur in each chunk of a text stream, so that
+ * a search can skip the text that doesn't contain the bytes any match
+ * needs to contain.
+ *
+ * It is indexed by stream offset rather than by row, so it doesn't care
+ * about rewrapping. Text that is truncated and then written again only
+ * adds to its chunk's set; a superset never makes a search miss a match.
+ */
+class TextIndex {
+public:
+        static constexpr size_t const k_chunk_size = 4096;
+
+        TextIndex() = default;
+        TextIndex(TextIndex const&) = delete;
+        TextIndex(TextIndex&&) = default;
+        TextIndex& operator= (TextIndex const&) = delete;
+        TextIndex& operator= (TextIndex&&) = default;
+
+        /* reset:
+         * @offset: the stream offset where the indexed text starts
+         *
+         * Forgets everything. Text before @offset is unknown.
+         */
+        void reset(size_t offset)
+        {
+                m_chunks.clear();
+                m_start = m_end = offset;
+                m_first_chunk = offset / k_chunk_size;
+        }
+
+        /* add:
+         * @offset: the stream offset of @data
+         * @data: the text
+         * @len: the length of @data
+         *
+         * Adds the text appended to the stream at @offset, which is not
+         * after the end of the already indexed text.
+         */
+        void add(size_t offset,
+                 char const* data,
+                 size_t len)
+        {
+                if (offset > m_end || offset < m_start) {
+                        /* Not contiguous, start over */
+                        reset(offset);
+                }
+
+                while (len > 0) {
+                        auto const chunk = offset / k_chunk_size;
+                        while (m_first_chunk + m_chunks.size() <= chunk)
+                                m_chunks.emplace_back();
+                        auto& set = m_chunks[chunk - m_first_chunk];
+
+                        auto const n = std::min(len, (chunk + 1) * k_chunk_size - offset);
+                        for (size_t i = 0; i < n; i++)
+                                set.add(uint8_t(data[i]));
+
+                        data += n;
+                        offset += n;
+                        len -= n;
+                }
+
+                m_end = std::max(m_end, offset);
+        }
+
+        /* truncate:
+         * @offset: the new end of the stream
+         */
+        inline void truncate(size_t offset) noexcept
+        {
+                m_end = std::max(std::min(m_end, offset), m_start);
+        }
+
+        /* advance_tail:
+         * @offset: the new start of the stream
+         *
+         * Drops the chunks before @offset.
+         */
+        void advance_tail(size_t offset)
+        {
+                while (!m_chunks.empty() && (m_first_chunk + 1) * k_chunk_size <= offset) {
+                        m_chunks.pop_front();
+                        m_first_chunk++;
+                }
+                m_start = std::max(m_start, std::min(offset, m_end));
+        }
+
+        /* bytes:
+         * @start: the first offset
+         * @end: the offset after the last one
+         *
+         * Returns: a superset of the bytes at @start..@end, which is
+         *   everything if that text isn't indexed
+         */
+        ByteSet bytes(size_t start,
+                      size_t end) const
+        {
+                auto set = ByteSet{};
+                if (start >= end)
+                        return set;
+                if (start < m_start || end > m_end)
+                        return ByteSet::all();
+
+                for (auto chunk = start / k_chunk_size; chunk <= (end - 1) / k_chunk_size; chunk++)
+                        set |= m_chunks[chunk - m_first_chunk];
+                return set;
+        }
+
+private:
+        std::deque<ByteSet> m_chunks{};
+        size_t m_first_chunk{0};  /* the chunk number of m_chunks[0] */
+        size_t m_start{0};        /* the indexed text is m_start..m_end */
+        size_t m_end{0};
+};
+
+} // namespace base
+
+} // namespace vte
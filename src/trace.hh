@@ -0,0 +1,157 @@
+/*
+ * Copyright © 2026 The VTE developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+
+#include <glib.h>
+
+#ifdef WITH_SYSPROF
+#include <sysprof-capture.h>
+#endif
+
+namespace vte {
+
+namespace base {
+
+/*
+ * Trace:
+ *
+ * Marks the time spent in the stages of the processing and paint pipeline,
+ * for looking at them in a profiler's timeline. When built with sysprof
+ * support, the marks go to sysprof's capture whenever running under it.
+ * Setting VTE_TRACE=1 in the environment prints them to stderr instead.
+ *
+ * Disabled otherwise, in which case a Scope costs a single well-predicted
+ * branch. Unlike Profile, marks can be made from any thread.
+ */
+class Trace {
+public:
+        class Scope {
+        public:
+                explicit Scope(char const* name) noexcept
+                        : m_name{name},
+                          m_begin{enabled() ? now() : 0}
+                {
+                }
+
+                ~Scope() noexcept
+                {
+                        if (m_begin == 0)
+                                return;
+
+                        char message[32];
+                        if (m_count_unit != nullptr)
+                                g_snprintf(message, sizeof(message), "%" G_GSIZE_FORMAT " %s",
+                                           m_count, m_count_unit);
+                        else
+                                message[0] = '\0';
+
+                        mark(m_begin, now() - m_begin, m_name, message);
+                }
+
+                Scope(Scope const&) = delete;
+                Scope(Scope&&) = delete;
+                Scope& operator= (Scope const&) = delete;
+                Scope& operator= (Scope&&) = delete;
+
+                /* Adds "@count @unit" to the mark; @unit must be static */
+                inline void set_count(size_t count,
+                                      char const* unit) noexcept
+                {
+                        m_count = count;
+                        m_count_unit = unit;
+                }
+
+        private:
+                char const* m_name;
+                int64_t m_begin;
+                size_t m_count{0};
+                char const* m_count_unit{nullptr};
+        };
+
+        static inline bool enabled() noexcept
+        {
+                auto const state = s_state.load(std::memory_order_relaxed);
+                if (G_LIKELY(state == eDisabled))
+                        return false;
+                if (state == eUnknown)
+                        return init();
+                return true;
+        }
+
+        static void mark(int64_t begin,
+                         int64_t duration,
+                         char const* name,
+                         char const* message) noexcept
+        {
+#ifdef WITH_SYSPROF
+                if (s_state.load(std::memory_order_relaxed) == eSysprof) {
+                        sysprof_collector_mark(begin, duration, "vte", name, message);
+                        return;
+                }
+#endif
+                g_printerr("vte-trace: %-20s %" G_GINT64_FORMAT ".%06" G_GINT64_FORMAT " +%.3fms %s\n",
+                           name,
+                           begin / 1000000000, (begin % 1000000000) / 1000,
+                           double(duration) / 1000000.,
+                           message);
+        }
+
+        /* Returns: CLOCK_MONOTONIC, in ns, the clock sysprof uses */
+        static inline int64_t now() noexcept
+        {
+                struct timespec ts;
+                clock_gettime(CLOCK_MONOTONIC, &ts);
+                return int64_t(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+        }
+
+private:
+        enum State {
+                eUnknown,
+                eDisabled,
+                eStderr,
+                eSysprof,
+        };
+
+        static bool init() noexcept
+        {
+                /* Racing initialisations all come to the same result */
+                auto state = eDisabled;
+#ifdef WITH_SYSPROF
+                if (sysprof_collector_is_active())
+                        state = eSysprof;
+#endif
+                auto const env = g_getenv("VTE_TRACE");
+                if (state == eDisabled && env != nullptr && strcmp(env, "0") != 0 && env[0] != '\0')
+                        state = eStderr;
+
+                s_state.store(state, std::memory_order_relaxed);
+                return state != eDisabled;
+        }
+
+        static inline std::atomic<int> s_state{eUnknown};
+};
+
+} // namespace base
+
+} // namespace vte
@@ -0,0 +1,62 @@
+/*
+ * Copyright © 2026 The VTE developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <glib.h>
+
+#include "unichar-width.hh"
+
+using namespace vte::base;
+
+static void
+test_unichar_width_glib(void)
+{
+        /* All of Unicode, and some beyond */
+        for (auto c = gunichar{0}; c < 0x110100u; c++) {
+                for (auto ambiguous_width = 1; ambiguous_width <= 2; ambiguous_width++) {
+                        auto const width = UnicharWidths::width(c, ambiguous_width);
+                        auto const expected = UnicharWidths::glib_width(c, ambiguous_width);
+                        if (width != expected)
+                                g_test_message("U+%04X with ambiguous width %d", c, ambiguous_width);
+                        g_assert_cmpint(width, ==, expected);
+                }
+        }
+}
+
+static void
+test_unichar_width_examples(void)
+{
+        g_assert_cmpint(UnicharWidths::width('a', 2), ==, 1);
+        g_assert_cmpint(UnicharWidths::width(0x0301, 1), ==, 0); /* COMBINING ACUTE ACCENT */
+        g_assert_cmpint(UnicharWidths::width(0x4e00, 1), ==, 2); /* CJK */
+        g_assert_cmpint(UnicharWidths::width(0x05d0, 2), ==, 1); /* HEBREW LETTER ALEF */
+        g_assert_cmpint(UnicharWidths::width(0x00a7, 1), ==, 1); /* § is ambiguous */
+        g_assert_cmpint(UnicharWidths::width(0x00a7, 2), ==, 2);
+}
+
+int
+main(int argc,
+     char* argv[])
+{
+        g_test_init(&argc, &argv, nullptr);
+
+        g_test_add_func("/vte/unichar-width/glib", test_unichar_width_glib);
+        g_test_add_func("/vte/unichar-width/examples", test_unichar_width_examples);
+
+        return g_test_run();
+}
@@ -0,0 +1,97 @@
+/*
+ * Copyright © 2026 The VTE developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "unichar-width.hh"
+
+#include <array>
+
+namespace vte {
+
+namespace base {
+
+std::atomic<uint8_t const*> UnicharWidths::s_blocks[UnicharWidths::k_n_blocks];
+
+/* The blocks whose characters all have the same width share these */
+static constexpr auto
+make_uniform_blocks() noexcept
+{
+        auto blocks = std::array<std::array<uint8_t, UnicharWidths::k_block_size>, 4>{};
+        for (auto w = 0u; w < blocks.size(); w++)
+                for (auto& width : blocks[w])
+                        width = uint8_t(w);
+        return blocks;
+}
+
+static constexpr auto const k_uniform_blocks = make_uniform_blocks();
+
+int
+UnicharWidths::glib_width(gunichar c,
+                          int ambiguous_width) noexcept
+{
+        if (G_LIKELY(c < 0x80))
+                return 1;
+        if (G_UNLIKELY(g_unichar_iszerowidth(c)))
+                return 0;
+        if (G_UNLIKELY(g_unichar_iswide(c)))
+                return 2;
+        if (G_LIKELY(ambiguous_width == 1))
+                return 1;
+        if (G_UNLIKELY(g_unichar_iswide_cjk(c)))
+                return 2;
+        return 1;
+}
+
+/* Looks up the widths of the characters of @block in glib, and puts them
+ * in the table. Terminals on other threads may do the same at the same
+ * time, and the first to be done wins.
+ *
+ * Returns: the widths
+ */
+uint8_t const*
+UnicharWidths::fill_block(unsigned block) noexcept
+{
+        auto widths = g_new(uint8_t, k_block_size);
+        auto uniform = true;
+        for (auto i = 0u; i < k_block_size; i++) {
+                auto const c = gunichar(block << k_block_bits | i);
+                auto const narrow = glib_width(c, 1);
+                widths[i] = narrow == glib_width(c, 2) ? narrow : eAMBIGUOUS;
+                uniform &= widths[i] == widths[0];
+        }
+
+        uint8_t const* filled = widths;
+        if (uniform) {
+                filled = k_uniform_blocks[widths[0]].data();
+                g_free(widths);
+        }
+
+        uint8_t const* expected = nullptr;
+        if (!s_blocks[block].compare_exchange_strong(expected, filled,
+                                                     std::memory_order_acq_rel)) {
+                if (!uniform)
+                        g_free(const_cast<uint8_t*>(filled));
+                filled = expected;
+        }
+
+        return filled;
+}
+
+} // namespace base
+
+} // namespace vte
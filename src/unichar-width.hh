@@ -0,0 +1,80 @@
+/*
+ * Copyright © 2026 The VTE developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <glib.h>
+
+#include <atomic>
+#include <cstdint>
+
+namespace vte {
+
+namespace base {
+
+/* The widths of the characters in cells, as g_unichar_iszerowidth(),
+ * g_unichar_iswide() and g_unichar_iswide_cjk() have them, in a two-stage
+ * table: a pointer for each block of 256 characters, to the widths of its
+ * characters. A block gets its widths from glib the first time one of its
+ * characters is looked up, so the table is always in sync with the Unicode
+ * version of glib, and only has the blocks in use.
+ */
+class UnicharWidths {
+public:
+        /* The width of an ambiguous width character is up to the caller */
+        enum Width : uint8_t {
+                eZERO = 0,
+                eNARROW = 1,
+                eWIDE = 2,
+                eAMBIGUOUS = 3,
+        };
+
+        static constexpr unsigned const k_block_bits = 8;
+        static constexpr unsigned const k_block_size = 1u << k_block_bits;
+        static constexpr unsigned const k_n_blocks = (0x10ffffu >> k_block_bits) + 1;
+
+        /* Returns: the width of @c in cells, with @ambiguous_width (1 or 2)
+         * for the ambiguous width characters */
+        static inline int width(gunichar c,
+                                int ambiguous_width) noexcept
+        {
+                if (G_LIKELY(c < 0x80))
+                        return 1;
+                if (G_UNLIKELY(c > 0x10ffffu))
+                        return glib_width(c, ambiguous_width);
+
+                auto block = s_blocks[c >> k_block_bits].load(std::memory_order_acquire);
+                if (G_UNLIKELY(block == nullptr))
+                        block = fill_block(c >> k_block_bits);
+
+                auto const w = block[c & (k_block_size - 1)];
+                return G_LIKELY(w != eAMBIGUOUS) ? w : ambiguous_width;
+        }
+
+        /* Returns: the width of @c as glib has it, see width() */
+        static int glib_width(gunichar c,
+                              int ambiguous_width) noexcept;
+
+private:
+        static std::atomic<uint8_t const*> s_blocks[k_n_blocks];
+
+        static uint8_t const* fill_block(unsigned block) noexcept;
+}; // class UnicharWidths
+
+} // namespace base
+
+} // namespace vte
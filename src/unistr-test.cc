@@ -0,0 +1,110 @@
+/*
+ * Copyright © 2026 The VTE developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <glib.h>
+
+#include <string>
+
+#include "vteunistr.h"
+
+static std::string
+to_string(vteunistr s)
+{
+        auto gs = g_string_new(nullptr);
+        _vte_unistr_append_to_string(s, gs);
+        auto str = std::string{gs->str, gs->len};
+        g_string_free(gs, TRUE);
+        return str;
+}
+
+static void
+test_unistr_append(void)
+{
+        /* A single character is its own value */
+        g_assert_cmpuint(_vte_unistr_append_unistr(0, 'a'), ==, _vte_unistr_append_unichar(0, 'a'));
+
+        auto e_acute = _vte_unistr_append_unichar('e', 0x0301);
+        g_assert_cmphex(e_acute, >, 0x10FFFF);
+        g_assert_cmpuint(_vte_unistr_append_unichar('e', 0x0301), ==, e_acute);
+        g_assert_cmpuint(_vte_unistr_get_base(e_acute), ==, 'e');
+        g_assert_cmpint(_vte_unistr_strlen(e_acute), ==, 2);
+        g_assert_cmpint(_vte_unistr_utf8_len(e_acute), ==, 3);
+        g_assert_cmpstr(to_string(e_acute).c_str(), ==, "e\xcc\x81");
+
+        auto e_acute_grave = _vte_unistr_append_unichar(e_acute, 0x0300);
+        g_assert_cmpint(_vte_unistr_strlen(e_acute_grave), ==, 3);
+        g_assert_cmpuint(_vte_unistr_append_unistr('e', _vte_unistr_append_unichar(0x0301, 0x0300)), ==, e_acute_grave);
+
+        auto a_acute_grave = _vte_unistr_replace_base(e_acute_grave, 'a');
+        g_assert_cmpstr(to_string(a_acute_grave).c_str(), ==, "a\xcc\x81\xcc\x80");
+        g_assert_cmpint(_vte_unistr_utf8_len(a_acute_grave), ==, 5);
+        g_assert_cmpint(_vte_unistr_utf8_len(0x1F600), ==, 4);
+
+        /* Enough of them to grow the table a few times */
+        for (gunichar c = 0x4E00; c < 0x4E00 + 2000; c++) {
+                auto s = _vte_unistr_append_unichar(c, 0x0301);
+                g_assert_cmpuint(_vte_unistr_append_unichar(c, 0x0301), ==, s);
+                g_assert_cmpuint(_vte_unistr_get_base(s), ==, c);
+        }
+        g_assert_cmpuint(_vte_unistr_append_unichar('e', 0x0301), ==, e_acute);
+}
+
+static void
+test_unistr_gc(void)
+{
+        auto keep = _vte_unistr_append_unichar(_vte_unistr_append_unichar('o', 0x0308), 0x0304);
+        auto lose = _vte_unistr_append_unichar('u', 0x0308);
+        auto generation = _vte_unistr_get_generation();
+
+        /* Marking the longer sequence keeps the ones it was built from */
+        _vte_unistr_gc_begin();
+        _vte_unistr_gc_mark(keep);
+        _vte_unistr_gc_mark('x');
+        g_assert_cmpuint(_vte_unistr_gc_end(), >, 0);
+        g_assert_cmpuint(_vte_unistr_get_generation(), !=, generation);
+        g_assert_false(_vte_unistr_gc_wanted());
+
+        g_assert_cmpstr(to_string(keep).c_str(), ==, "o\xcc\x88\xcc\x84");
+        g_assert_cmpuint(_vte_unistr_append_unichar(_vte_unistr_append_unichar('o', 0x0308), 0x0304), ==, keep);
+
+        /* The freed values are handed out again */
+        auto reused = _vte_unistr_append_unichar('a', 0x030A);
+        g_assert_cmpuint(reused, ==, lose);
+        g_assert_cmpstr(to_string(reused).c_str(), ==, "a\xcc\x8a");
+
+        /* Nothing to free, nothing changes */
+        generation = _vte_unistr_get_generation();
+        _vte_unistr_gc_begin();
+        _vte_unistr_gc_mark(keep);
+        _vte_unistr_gc_mark(reused);
+        g_assert_cmpuint(_vte_unistr_gc_end(), ==, 0);
+        g_assert_cmpuint(_vte_unistr_get_generation(), ==, generation);
+}
+
+int
+main(int argc,
+     char* argv[])
+{
+        g_test_init(&argc, &argv, nullptr);
+
+        g_test_add_func("/vte/unistr/append", test_unistr_append);
+        g_test_add_func("/vte/unistr/gc", test_unistr_gc);
+
+        return g_test_run();
+}
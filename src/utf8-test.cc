@@ -296,6 +296,40 @@ test_utf8_decoder_replacement(void)
         assert_decode("a\xF4\x8F\xBF\xFFZ", -1, U"a\uFFFD\uFFFDZ"s);
 }
 
+static void
+assert_printable_ascii_end(std::string const& str,
+                           size_t expected)
+{
+        auto const* begin = reinterpret_cast<uint8_t const*>(str.data());
+        auto const* end = begin + str.size();
+        g_assert_cmpuint(find_printable_ascii_end(begin, end) - begin, ==, expected);
+}
+
+static void
+test_utf8_printable_ascii_end(void)
+{
+        assert_printable_ascii_end(""s, 0);
+        assert_printable_ascii_end("a"s, 1);
+        assert_printable_ascii_end("\x1f"s, 0);
+        assert_printable_ascii_end("\x7f"s, 0);
+        assert_printable_ascii_end(" ~"s, 2);
+        assert_printable_ascii_end("abc\x1b[m"s, 3);
+
+        /* Test all positions across and after the block boundaries of the vectorised scanner */
+        for (auto len = size_t{0}; len < 80; ++len) {
+                auto str = std::string(len, 'x');
+                assert_printable_ascii_end(str, len);
+
+                for (auto c : {'\0', '\n', '\x1b', '\x7f', '\x80', '\xc3', '\xff'}) {
+                        for (auto pos = size_t{0}; pos < len; ++pos) {
+                                auto s = str;
+                                s[pos] = c;
+                                assert_printable_ascii_end(s, pos);
+                        }
+                }
+        }
+}
+
 int
 main(int argc,
      char* argv[])
@@ -304,6 +338,7 @@ main(int argc,
 
         g_test_add_func("/vte/utf8/decoder/decode", test_utf8_decoder_decode);
         g_test_add_func("/vte/utf8/decoder/replacement", test_utf8_decoder_replacement);
+        g_test_add_func("/vte/utf8/printable-ascii-end", test_utf8_printable_ascii_end);
 
         return g_test_run();
 }
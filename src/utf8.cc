@@ -111,3 +111,54 @@ uint8_t const vte::base::UTF8Decoder::kTable[] = {
         RW, 36, RW, RW, RW, RW, RW, RW, RW, RW, RW, RW, // state 96
         RJ, RJ, RJ, RJ, RJ, RJ, RJ, RJ, RJ, RJ, RJ, RJ, // state 108 (reject-rewind)
 };
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+uint8_t const*
+vte::base::find_printable_ascii_end(uint8_t const* begin,
+                                    uint8_t const* end) noexcept
+{
+        auto p = begin;
+
+        /* 16 bytes at a time, with what is baseline for the architecture.
+         * The runs are cut at the end of the row anyway, so AVX2 wouldn't
+         * be measurably faster, and it would need runtime dispatch.
+         */
+#if defined(__SSE2__)
+        /* Using signed comparision, bytes >= 0x80 are negative and thus
+         * fail the > 0x1f test, so we only need two compares per block.
+         */
+        auto const lo = _mm_set1_epi8(0x1f);
+        auto const hi = _mm_set1_epi8(0x7f);
+        while (end - p >= 16) {
+                auto const v = _mm_loadu_si128(reinterpret_cast<__m128i const*>(p));
+                auto const printable = _mm_and_si128(_mm_cmpgt_epi8(v, lo),
+                                                     _mm_cmplt_epi8(v, hi));
+                auto const mask = unsigned(_mm_movemask_epi8(printable));
+                if (mask != 0xffffu)
+                        return p + __builtin_ctz(~mask);
+
+                p += 16;
+        }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+        auto const lo = vdupq_n_u8(0x1f);
+        auto const hi = vdupq_n_u8(0x7f);
+        while (end - p >= 16) {
+                auto const v = vld1q_u8(p);
+                auto const printable = vandq_u8(vcgtq_u8(v, lo), vcltq_u8(v, hi));
+                if (vminvq_u8(printable) != 0xffu)
+                        break; /* find the exact position below */
+
+                p += 16;
+        }
+#endif
+
+        while (p < end && *p >= 0x20 && *p < 0x7f)
+                ++p;
+
+        return p;
+}
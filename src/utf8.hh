@@ -51,6 +51,7 @@ public:
         UTF8Decoder& operator= (UTF8Decoder&&) = delete;
 
         inline constexpr uint32_t codepoint() const noexcept { return m_codepoint; }
+        inline constexpr uint32_t state() const noexcept { return m_state; }
 
         inline uint32_t decode(uint32_t byte) noexcept {
                 uint32_t type = kTable[byte];
@@ -82,6 +83,16 @@ private:
 
 }; // class UTF8Decoder
 
+/* find_printable_ascii_end:
+ * @begin: start of the buffer
+ * @end: end of the buffer
+ *
+ * Returns: a pointer to the first byte in [@begin, @end) that is not
+ *   printable ASCII (0x20..0x7e), or @end if there is no such byte
+ */
+uint8_t const* find_printable_ascii_end(uint8_t const* begin,
+                                        uint8_t const* end) noexcept;
+
 } // namespace base
 
 } // namespace vte
@@ -24,6 +24,8 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/ioctl.h>
+#include <sys/uio.h>
+#include <poll.h>
 #include <errno.h>
 #include <fcntl.h>
 #ifdef HAVE_SYS_TERMIOS_H
@@ -38,7 +40,11 @@
 #include "vteinternal.hh"
 #include "bidi.hh"
 #include "buffer.h"
+#include "color-cache.hh"
 #include "debug.h"
+#include "profile.hh"
+#include "trace.hh"
+#include "unichar-width.hh"
 #include "vtedraw.hh"
 #include "reaper.hh"
 #include "ring.hh"
@@ -61,6 +67,7 @@
 #include <gtk/gtk.h>
 #include <pango/pango.h>
 #include "keymap.h"
+#include "paste.hh"
 #include "marshal.h"
 #include "vtepty.h"
 #include "vtegtk.hh"
@@ -69,6 +76,9 @@
 #include "vteaccess.h"
 #endif
 
+#include <algorithm>
+#include <array>
+#include <map>
 #include <new> /* placement new */
 
 using namespace std::literals;
@@ -92,7 +102,8 @@ namespace terminal {
 
 static int _vte_unichar_width(gunichar c, int utf8_ambiguous_width);
 static void stop_processing(vte::terminal::Terminal* that);
-static void add_process_timeout(vte::terminal::Terminal* that);
+static void add_process_timeout(vte::terminal::Terminal* that,
+                                bool use_frame_clock = true);
 static void add_update_timeout(vte::terminal::Terminal* that);
 static void remove_update_timeout(vte::terminal::Terminal* that);
 
@@ -105,22 +116,12 @@ static guint process_timeout_tag = 0;
 static gboolean in_process_timeout;
 static guint update_timeout_tag = 0;
 static gboolean in_update_timeout;
-static GList *g_active_terminals;
+static vte::base::Scheduler<vte::terminal::Terminal> g_active_terminals;
 
 static int
 _vte_unichar_width(gunichar c, int utf8_ambiguous_width)
 {
-        if (G_LIKELY (c < 0x80))
-                return 1;
-        if (G_UNLIKELY (g_unichar_iszerowidth (c)))
-                return 0;
-        if (G_UNLIKELY (g_unichar_iswide (c)))
-                return 2;
-        if (G_LIKELY (utf8_ambiguous_width == 1))
-                return 1;
-        if (G_UNLIKELY (g_unichar_iswide_cjk (c)))
-                return 2;
-        return 1;
+        return vte::base::UnicharWidths::width(c, utf8_ambiguous_width);
 }
 
 static void
@@ -177,14 +178,38 @@ Terminal::ring_remove(vte::grid::row_t position)
 	_vte_ring_remove(m_screen->row_data, position);
 }
 
+/* Moves the rows from @start to @end down by @count rows (up if negative),
+ * bringing in new rows at the other end, as @count pairs of ring_remove()
+ * at one end and ring_insert(…, true) at the other would.
+ */
+void
+Terminal::ring_rotate(vte::grid::row_t start,
+                      vte::grid::row_t end,
+                      vte::grid::row_t count)
+{
+	VteRing *ring = m_screen->row_data;
+
+        while (_vte_ring_next(ring) <= end)
+                ring_append(true);
+
+        _vte_ring_rotate(ring, start, end + 1, count, get_bidi_flags());
+
+        if (m_color_defaults.attr.back() != VTE_DEFAULT_BG) {
+                auto const n = MIN(ABS(count), end - start + 1);
+                auto const first = count > 0 ? start : end + 1 - n;
+                for (auto i = first; i < first + n; i++)
+                        _vte_row_data_fill(_vte_ring_index_writable(ring, i),
+                                           &m_color_defaults, m_column_count);
+        }
+}
+
 /* Reset defaults for character insertion. */
 void
 Terminal::reset_default_attributes(bool reset_hyperlink)
 {
-        auto const hyperlink_idx_save = m_defaults.attr.hyperlink_idx;
         m_defaults = m_color_defaults = basic_cell;
-        if (!reset_hyperlink)
-                m_defaults.attr.hyperlink_idx = hyperlink_idx_save;
+        if (reset_hyperlink)
+                m_hyperlink_idx = 0;
 }
 
 //FIXMEchpe this function is bad
@@ -268,9 +293,13 @@ void
 Terminal::invalidate_rows(vte::grid::row_t row_start,
                           vte::grid::row_t row_end /* inclusive */)
 {
+        record_query_damage(row_start, row_end, 0, vte::base::Damage::k_all_columns);
+
 	if (G_UNLIKELY (!widget_realized()))
                 return;
 
+        frame_damage_rows(row_start, row_end);
+
         if (m_invalidated_all)
 		return;
 
@@ -293,31 +322,13 @@ Terminal::invalidate_rows(vte::grid::row_t row_start,
 		return;
 	}
 
-        cairo_rectangle_int_t rect;
-	/* Convert the column and row start and end to pixel values
-	 * by multiplying by the size of a character cell.
-	 * Always include the extra pixel border and overlap pixel.
-	 */
-        // FIXMEegmont invalidate the left and right padding too
-        rect.x = -1;
-        int xend = m_column_count * m_cell_width + 1;
-        rect.width = xend - rect.x;
-
-        /* Always add at least VTE_LINE_WIDTH pixels so the outline block cursor fits */
-        rect.y = row_to_pixel(row_start) - std::max(cell_overflow_top(), VTE_LINE_WIDTH);
-        int yend = row_to_pixel(row_end + 1) + std::max(cell_overflow_bottom(), VTE_LINE_WIDTH);
-        rect.height = yend - rect.y;
-
-	_vte_debug_print (VTE_DEBUG_UPDATES,
-			"Invalidating pixels at (%d,%d)x(%d,%d).\n",
-			rect.x, rect.y, rect.width, rect.height);
-
-	if (m_active_terminals_link != nullptr) {
-                g_array_append_val(m_update_rects, rect);
-		/* Wait a bit before doing any invalidation, just in
-		 * case updates are coming in really soon. */
-		add_update_timeout(this);
+	if (is_processing()) {
+                /* Only record which rows changed; flush_damage() turns
+                 * them into rectangles. */
+                damage_cells(row_start, row_end,
+                             0, vte::base::Damage::k_all_columns);
 	} else {
+                auto rect = damage_rect(row_start, row_end, 0, m_column_count);
                 auto allocation = get_allocated_rect();
                 rect.x += allocation.x + m_padding.left;
                 rect.y += allocation.y + m_padding.top;
@@ -342,10 +353,13 @@ void
 Terminal::invalidate_rows_and_context(vte::grid::row_t row_start,
                                       vte::grid::row_t row_end /* inclusive */)
 {
+        record_query_damage(row_start, row_end, 0, vte::base::Damage::k_all_columns);
+
         if (G_UNLIKELY (!widget_realized()))
                 return;
 
-        if (m_invalidated_all)
+        /* The frame still needs to know about the changed rows */
+        if (m_invalidated_all && !m_frame_valid)
                 return;
 
         if (G_UNLIKELY (row_end < row_start))
@@ -390,6 +404,322 @@ Terminal::invalidate_rows_and_context(vte::grid::row_t row_start,
         invalidate_rows(row_start, row_end);
 }
 
+/* Invalidate the given columns of @row, e.g. after inserting text there.
+ * If the row is part of a longer paragraph, or is subject to BiDi, any
+ * change may move text beyond these columns, so this then falls back to
+ * invalidate_rows_and_context().
+ */
+void
+Terminal::invalidate_cells_and_context(vte::grid::row_t row,
+                                       vte::grid::column_t column_start,
+                                       vte::grid::column_t column_end)
+{
+        record_query_damage(row, row, column_start - 1, column_end + 1);
+
+        if (G_UNLIKELY (!widget_realized()))
+                return;
+
+        if (m_invalidated_all && !m_frame_valid)
+                return;
+
+        auto const rowdata = find_row_data(row);
+        if (!is_processing() ||
+            rowdata == nullptr ||
+            rowdata->attr.soft_wrapped ||
+            (rowdata->attr.bidi_flags & (VTE_BIDI_FLAG_IMPLICIT | VTE_BIDI_FLAG_RTL)) ||
+            (row > m_screen->insert_delta && m_screen->row_data->is_soft_wrapped(row - 1))) {
+                invalidate_rows_and_context(row, row);
+                return;
+        }
+
+        frame_damage_rows(row, row);
+
+        if (m_invalidated_all)
+                return;
+
+        _vte_debug_print (VTE_DEBUG_UPDATES,
+                          "Invalidating row %ld columns %ld..%ld.\n",
+                          row, column_start, column_end);
+
+        /* Include a column on each side for combining characters and
+         * glyphs overflowing their cells. */
+        damage_cells(row, row, column_start - 1, column_end + 1);
+}
+
+/* Returns the rectangle, in view coordinates, covering the cells,
+ * including the extra pixel border and overlap pixel.
+ */
+cairo_rectangle_int_t
+Terminal::damage_rect(vte::grid::row_t row_start,
+                      vte::grid::row_t row_end /* inclusive */,
+                      vte::grid::column_t column_start,
+                      vte::grid::column_t column_end) const
+{
+        column_start = std::max(column_start, vte::grid::column_t{0});
+        column_end = std::min(column_end, m_column_count);
+
+        cairo_rectangle_int_t rect;
+	/* Convert the column and row start and end to pixel values
+	 * by multiplying by the size of a character cell.
+	 * Always include the extra pixel border and overlap pixel.
+	 */
+        // FIXMEegmont invalidate the left and right padding too
+        rect.x = column_start * m_cell_width - 1;
+        int xend = column_end * m_cell_width + 1;
+        rect.width = xend - rect.x;
+
+        /* Always add at least VTE_LINE_WIDTH pixels so the outline block cursor fits */
+        rect.y = row_to_pixel(row_start) - std::max(cell_overflow_top(), VTE_LINE_WIDTH);
+        int yend = row_to_pixel(row_end + 1) + std::max(cell_overflow_bottom(), VTE_LINE_WIDTH);
+        rect.height = yend - rect.y;
+
+	_vte_debug_print (VTE_DEBUG_UPDATES,
+			"Invalidating pixels at (%d,%d)x(%d,%d).\n",
+			rect.x, rect.y, rect.width, rect.height);
+
+        return rect;
+}
+
+/* Records the cells in m_damage, while processing. The damage is kept
+ * relative to the displayed rows, so if the view moved since the damage
+ * was started, it's flushed first.
+ */
+void
+Terminal::damage_cells(vte::grid::row_t row_start,
+                       vte::grid::row_t row_end /* inclusive */,
+                       vte::grid::column_t column_start,
+                       vte::grid::column_t column_end)
+{
+        auto const first_row = first_displayed_row();
+        auto const n_rows = last_displayed_row() - first_row + 1;
+        if (G_UNLIKELY (m_damage.origin() != first_row ||
+                        m_damage.n_rows() != n_rows)) {
+                flush_damage();
+                m_damage.reset(first_row, n_rows);
+        }
+
+        m_damage.add(row_start, row_end, column_start, column_end);
+
+        /* Wait a bit before doing any invalidation, just in
+         * case updates are coming in really soon. */
+        add_update_timeout(this);
+}
+
+/* Turns m_damage into update rects, one per span of consecutive rows
+ * with the same changed columns. */
+void
+Terminal::flush_damage()
+{
+        if (m_damage.empty())
+                return;
+
+        m_damage.for_each_span([&](vte::grid::row_t row_start,
+                                   vte::grid::row_t row_end,
+                                   vte::grid::column_t column_start,
+                                   vte::grid::column_t column_end) {
+                auto rect = damage_rect(row_start, row_end, column_start, column_end);
+                g_array_append_val(m_update_rects, rect);
+        });
+        m_damage.clear();
+}
+
+/* Ends the frame for get_frame_stats() */
+void
+Terminal::frame_stats_commit()
+{
+        using Counter = vte::base::FrameStats::Counter;
+
+        auto const rows_frozen = m_normal_screen.row_data->n_rows_frozen() +
+                m_alternate_screen.row_data->n_rows_frozen();
+        auto const rows_thawed = m_normal_screen.row_data->n_rows_thawed() +
+                m_alternate_screen.row_data->n_rows_thawed();
+        m_frame_stats.add(Counter::eRowsFrozen, rows_frozen - m_frame_stats_rows_frozen);
+        m_frame_stats.add(Counter::eRowsThawed, rows_thawed - m_frame_stats_rows_thawed);
+        m_frame_stats_rows_frozen = rows_frozen;
+        m_frame_stats_rows_thawed = rows_thawed;
+
+        m_frame_stats.commit();
+}
+
+/* Returns: the last frames' stats, oldest first, as a g_free()able array */
+VteFrameStats*
+Terminal::get_frame_stats(gsize* n_frames)
+{
+        using Counter = vte::base::FrameStats::Counter;
+        using Stage = vte::base::FrameStats::Stage;
+
+        *n_frames = m_frame_stats.n_frames();
+        if (*n_frames == 0)
+                return nullptr;
+
+        auto stats = g_new(VteFrameStats, *n_frames);
+        for (gsize i = 0; i < *n_frames; i++) {
+                auto const& frame = m_frame_stats.frame(i);
+                stats[i] = VteFrameStats{frame.time,
+                                         frame.counters[int(Counter::eBytes)],
+                                         frame.counters[int(Counter::eSequences)],
+                                         frame.counters[int(Counter::eRowsFrozen)],
+                                         frame.counters[int(Counter::eRowsThawed)],
+                                         frame.counters[int(Counter::eDrawItems)],
+                                         frame.counters[int(Counter::eFills)],
+                                         frame.elapsed[int(Stage::eProcess)],
+                                         frame.elapsed[int(Stage::eRingview)],
+                                         frame.elapsed[int(Stage::eDraw)],
+                                         frame.elapsed[int(Stage::eSignals)],
+                                         frame.elapsed[int(Stage::eFrame)]};
+        }
+        return stats;
+}
+
+static_assert(VTE_INPUT_LATENCY_N_BUCKETS == vte::base::InputLatency::k_n_buckets,
+              "VteInputLatency's buckets don't match InputLatency's");
+
+void
+Terminal::get_input_latency(VteInputLatencyStage stage,
+                            VteInputLatency* latency) const noexcept
+{
+        auto const& histogram = m_input_latency.histogram(vte::base::InputLatency::Stage(stage));
+
+        latency->n_samples = histogram.n_samples;
+        latency->min_us = histogram.min;
+        latency->max_us = histogram.max;
+        latency->total_us = histogram.total;
+        std::copy(std::begin(histogram.buckets), std::end(histogram.buckets),
+                  latency->buckets);
+}
+
+void
+Terminal::get_memory_stats(VteMemoryStats* stats) const noexcept
+{
+        for (auto screen_ : {&m_normal_screen, &m_alternate_screen}) {
+                auto const ring = screen_->row_data;
+                stats->ring_rows += ring->next() - ring->writable();
+                stats->ring_bytes += ring->rows_size();
+                stats->row_cache_bytes += ring->cached_rows_size();
+                stats->hyperlink_bytes += ring->hyperlinks_size();
+                stats->stream_bytes += ring->stream_size();
+                stats->stream_uncompressed_bytes += ring->stream_length();
+        }
+
+        stats->unistr_bytes = _vte_unistr_get_size();
+        stats->bidi_bytes = m_ringview.size();
+        stats->image_bytes = m_image_cache.size();
+        stats->incoming_bytes = m_queued_bytes;
+        stats->outgoing_bytes = m_outgoing.size();
+}
+
+/* Records the cells for get_damage(), and the rows for the accessible.
+ * This happens regardless of whether the widget is realized, since
+ * embedders may mirror a terminal that is never shown.
+ */
+void
+Terminal::record_query_damage(vte::grid::row_t row_start,
+                              vte::grid::row_t row_end /* inclusive */,
+                              vte::grid::column_t column_start,
+                              vte::grid::column_t column_end)
+{
+        if (row_start <= row_end) {
+                if (m_contents_damage_start > m_contents_damage_end) {
+                        m_contents_damage_start = row_start;
+                        m_contents_damage_end = row_end;
+                } else {
+                        m_contents_damage_start = std::min(m_contents_damage_start, row_start);
+                        m_contents_damage_end = std::max(m_contents_damage_end, row_end);
+                }
+        }
+
+        /* The accessible's window doesn't move with the view; it catches
+         * up with scrolling itself, see a11y_damage(). */
+        if (G_UNLIKELY (m_a11y_damage_enabled) && !m_a11y_damage_all)
+                m_a11y_damage.add(row_start, row_end);
+
+#ifdef VTE_DEBUG
+        m_row_checksums.invalidate(row_start, row_end);
+#endif
+
+        if (G_LIKELY (!m_query_damage_enabled) || m_query_damage_all)
+                return;
+
+        /* If the rows moved, everything changed as far as the embedder
+         * is concerned. */
+        if (m_query_damage_screen != m_screen ||
+            m_query_damage.origin() != m_screen->insert_delta ||
+            m_query_damage.n_rows() != m_row_count) {
+                m_query_damage_all = true;
+                return;
+        }
+
+        m_query_damage.add(row_start, row_end, column_start, column_end);
+}
+
+/* Returns: the spans changed since the last call, as a g_free()able array */
+VteDamageSpan*
+Terminal::get_damage(gsize* n_spans)
+{
+        auto spans = std::vector<VteDamageSpan>{};
+
+        /* Catch up with a scroll since the last change */
+        if (m_query_damage_screen != m_screen ||
+            m_query_damage.origin() != m_screen->insert_delta ||
+            m_query_damage.n_rows() != m_row_count)
+                m_query_damage_all = true;
+
+        if (!m_query_damage_enabled || m_query_damage_all) {
+                spans.push_back(VteDamageSpan{m_screen->insert_delta, 0,
+                                              m_screen->insert_delta + m_row_count - 1,
+                                              m_column_count - 1});
+        } else {
+                m_query_damage.for_each_span([&](vte::grid::row_t row_start,
+                                                 vte::grid::row_t row_end,
+                                                 vte::grid::column_t column_start,
+                                                 vte::grid::column_t column_end) {
+                        column_start = std::max(column_start, vte::grid::column_t{0});
+                        column_end = std::min(column_end, m_column_count);
+                        if (column_start < column_end)
+                                spans.push_back(VteDamageSpan{row_start, column_start,
+                                                              row_end, column_end - 1});
+                });
+        }
+
+        m_query_damage_enabled = true;
+        m_query_damage_all = false;
+        m_query_damage_screen = m_screen;
+        m_query_damage.reset(m_screen->insert_delta, m_row_count);
+
+        *n_spans = spans.size();
+        if (spans.empty())
+                return nullptr;
+
+        return (VteDamageSpan*)g_memdup(spans.data(), spans.size() * sizeof(spans[0]));
+}
+
+/* Returns: the rows changed since the last a11y_damage_reset(), as
+ *   absolute rows in the window of the rows displayed then; or %nullptr
+ *   if the accessible needs to read all of the displayed rows again
+ */
+vte::base::Damage const*
+Terminal::a11y_damage() noexcept
+{
+        if (!m_a11y_damage_enabled ||
+            m_a11y_damage_all ||
+            m_a11y_damage_screen != m_screen ||
+            m_a11y_damage.n_rows() != m_row_count)
+                return nullptr;
+
+        return &m_a11y_damage;
+}
+
+/* Starts recording the changes to the rows displayed now for the
+ * accessible, after it read them. */
+void
+Terminal::a11y_damage_reset()
+{
+        m_a11y_damage_enabled = true;
+        m_a11y_damage_all = false;
+        m_a11y_damage_screen = m_screen;
+        m_a11y_damage.reset(a11y_first_row(), m_row_count);
+}
+
 /* Convenience methods */
 void
 Terminal::invalidate_row(vte::grid::row_t row)
@@ -442,6 +772,17 @@ Terminal::invalidate_symmetrical_difference(vte::grid::span const& a, vte::grid:
 void
 Terminal::invalidate_all()
 {
+        if (m_query_damage_enabled)
+                m_query_damage_all = true;
+        if (m_a11y_damage_enabled)
+                m_a11y_damage_all = true;
+        m_contents_damage_all = true;
+#ifdef VTE_DEBUG
+        m_row_checksums.clear();
+#endif
+
+        m_frame_valid = false;
+
 	if (G_UNLIKELY (!widget_realized()))
                 return;
 
@@ -456,7 +797,7 @@ Terminal::invalidate_all()
 	reset_update_rects();
 	m_invalidated_all = TRUE;
 
-        if (m_active_terminals_link != nullptr) {
+        if (is_processing()) {
                 auto allocation = get_allocated_rect();
                 cairo_rectangle_int_t rect;
                 rect.x = -m_padding.left;
@@ -473,6 +814,338 @@ Terminal::invalidate_all()
 	}
 }
 
+/* Like invalidate_all(), but for when the view only moved, or only the
+ * rows recorded by frame_damage_rows() may look different, so that
+ * widget_draw() can keep the pixels of the last frame, shifted, instead
+ * of painting everything again.
+ */
+void
+Terminal::invalidate_view()
+{
+        auto const frame_valid = m_frame_valid;
+        auto const a11y_damage_all = m_a11y_damage_all;
+        invalidate_all();
+        m_frame_valid = frame_valid;
+        m_a11y_damage_all = a11y_damage_all;
+}
+
+/* Records changed rows for repainting them in the last frame. */
+void
+Terminal::frame_damage_rows(vte::grid::row_t row_start,
+                            vte::grid::row_t row_end /* inclusive */)
+{
+        if (!m_frame_valid || row_end < row_start)
+                return;
+
+        /* Output and typing mostly extend the last range */
+        if (!m_frame_damage.empty()) {
+                auto& last = m_frame_damage.back();
+                if (row_start <= last.second + 1 && row_end + 1 >= last.first) {
+                        last.first = std::min(last.first, row_start);
+                        last.second = std::max(last.second, row_end);
+                        return;
+                }
+        }
+
+        /* Too scattered to be worth it, just paint everything */
+        if (m_frame_damage.size() >= 64) {
+                m_frame_valid = false;
+                return;
+        }
+
+        m_frame_damage.emplace_back(row_start, row_end);
+}
+
+void
+Terminal::frame_free() noexcept
+{
+        if (m_frame_surface != nullptr) {
+                cairo_surface_destroy(m_frame_surface);
+                m_frame_surface = nullptr;
+        }
+        if (m_frame_back_surface != nullptr) {
+                cairo_surface_destroy(m_frame_back_surface);
+                m_frame_back_surface = nullptr;
+        }
+        if (m_frame_saved_surface != nullptr) {
+                cairo_surface_destroy(m_frame_saved_surface);
+                m_frame_saved_surface = nullptr;
+        }
+        m_frame_valid = false;
+        m_frame_saved_screen = nullptr;
+}
+
+/* Returns: a hash of what, besides the rows' row_draw_key(), determines how
+ * the rows are painted, for telling whether a kept frame can still be used
+ */
+uint64_t
+Terminal::frame_look_key() const
+{
+        auto hash = uint64_t{0xcbf29ce484222325}; /* FNV-1a */
+        auto const add = [&hash](uint64_t value) {
+                hash = (hash ^ value) * uint64_t{0x100000001b3};
+        };
+
+        for (auto i = 0; i < VTE_PALETTE_SIZE; i++) {
+                auto const color = get_color(i);
+                add(color ? uint64_t(color->red) << 32 | uint64_t(color->green) << 16 | color->blue
+                          : uint64_t{1} << 48);
+        }
+        add(uint64_t(m_cell_width) << 32 | uint64_t(m_cell_height));
+        add(uint64_t(m_char_ascent) << 32 | uint64_t(m_char_descent));
+        add(uint64_t(m_padding.left) << 16 | uint64_t(m_padding.top));
+        add(uint64_t(uintptr_t(m_fontdesc.get())));
+        add(uint64_t(m_background_alpha * 65535.) << 2 | m_clear_background << 1 | m_bold_is_bright);
+
+        return hash;
+}
+
+/* Keeps the frame of the screen switched away from, and takes up the one
+ * kept of the screen switched to, if it is still painted the same way.
+ * Applications toggle the alternate screen all the time; switching back
+ * then only paints the rows whose row_draw_key() changed since.
+ */
+void
+Terminal::frame_switch_screen(GdkWindow* window,
+                              int width,
+                              int height)
+{
+        if (m_frame_saved_surface == nullptr) {
+                m_frame_saved_surface = gdk_window_create_similar_surface(window, CAIRO_CONTENT_COLOR_ALPHA,
+                                                                          width, height);
+                m_frame_saved_screen = nullptr;
+                if (cairo_surface_status(m_frame_saved_surface) != CAIRO_STATUS_SUCCESS) {
+                        cairo_surface_destroy(m_frame_saved_surface);
+                        m_frame_saved_surface = nullptr;
+                        m_frame_valid = false;
+                        m_frame_screen = m_screen;
+                        return;
+                }
+        }
+
+        auto const look = frame_look_key();
+        auto const restore = m_frame_saved_screen == m_screen && m_frame_saved_look == look;
+
+        _vte_debug_print(VTE_DEBUG_UPDATES, "Switching the frame to the %s screen, %s.\n",
+                         m_screen == &m_normal_screen ? "normal" : "alternate",
+                         restore ? "reusing the kept one" : "painting it all");
+
+        std::swap(m_frame_surface, m_frame_saved_surface);
+        std::swap(m_frame_scroll_offset, m_frame_saved_scroll_offset);
+        std::swap(m_frame_text_blink_state, m_frame_saved_text_blink_state);
+        std::swap(m_text_to_blink, m_frame_saved_text_to_blink);
+        std::swap(m_frame_rows, m_frame_saved_rows);
+        std::swap(m_frame_keys_first_row, m_frame_saved_keys_first_row);
+        m_frame_saved_screen = m_frame_valid ? m_frame_screen : nullptr;
+        m_frame_saved_look = look;
+
+        m_frame_screen = m_screen;
+        m_frame_valid = restore;
+        /* The damage was to the other screen. Going by the keys, only the
+         * rows that changed while this screen wasn't shown get painted. */
+        m_frame_damage.clear();
+        if (restore)
+                m_frame_damage.emplace_back(first_displayed_row(), last_displayed_row());
+}
+
+/* Brings m_frame_surface up to date with the view, except for the area
+ * that needs to be painted again, which is returned (in widget coordinates).
+ * If the view scrolled by less than its height, its rows are shifted, and
+ * only the rows scrolled into view and the changed ones need painting.
+ *
+ * Returns: the area to paint, or %nullptr if the frame surface can't be used
+ */
+cairo_region_t*
+Terminal::frame_update()
+{
+        auto const width = get_allocated_width();
+        auto const height = get_allocated_height();
+        auto const window = gtk_widget_get_window(m_widget);
+        auto const scale = gdk_window_get_scale_factor(window);
+
+        if (m_frame_surface == nullptr ||
+            m_frame_width != width ||
+            m_frame_height != height ||
+            m_frame_scale != scale) {
+                frame_free();
+                m_frame_surface = gdk_window_create_similar_surface(window, CAIRO_CONTENT_COLOR_ALPHA,
+                                                                    width, height);
+                m_frame_back_surface = gdk_window_create_similar_surface(window, CAIRO_CONTENT_COLOR_ALPHA,
+                                                                         width, height);
+                if (cairo_surface_status(m_frame_surface) != CAIRO_STATUS_SUCCESS ||
+                    cairo_surface_status(m_frame_back_surface) != CAIRO_STATUS_SUCCESS) {
+                        frame_free();
+                        return nullptr;
+                }
+                m_frame_width = width;
+                m_frame_height = height;
+                m_frame_scale = scale;
+        }
+
+        if (m_frame_screen != m_screen && m_frame_screen != nullptr)
+                frame_switch_screen(window, width, height);
+
+        auto const view_height = height - m_padding.top - m_padding.bottom;
+        auto const offset = long(round(m_screen->scroll_delta * m_cell_height));
+        auto const shift = offset - m_frame_scroll_offset;
+        m_frame_scroll_offset = offset;
+
+        /* The keys of the displayed rows' looks in the frame, see row_draw_key() */
+        ringview_update();
+        auto const first_row = first_displayed_row();
+        auto const last_row = last_displayed_row();
+        auto rows = std::vector<FrameRow>(last_row - first_row + 1);
+        auto const key_row = [&](vte::grid::row_t row) -> bool {
+                auto& frame_row = rows[row - first_row];
+                auto const key = row_draw_key(row, frame_row);
+                auto const changed = key != frame_row.key;
+                frame_row.key = key;
+                return changed;
+        };
+
+        if (!m_frame_valid ||
+            m_frame_screen != m_screen ||
+            std::abs(shift) >= view_height) {
+                m_frame_valid = false;
+                m_frame_screen = m_screen;
+                for (auto row = first_row; row <= last_row; row++)
+                        key_row(row);
+                m_frame_rows = std::move(rows);
+                m_frame_keys_first_row = first_row;
+                auto const rect = cairo_rectangle_int_t{0, 0, width, height};
+                return cairo_region_create_rectangle(&rect);
+        }
+
+        for (auto row = std::max(first_row, m_frame_keys_first_row);
+             row <= last_row && row < m_frame_keys_first_row + long(m_frame_rows.size());
+             row++)
+                rows[row - first_row] = m_frame_rows[row - m_frame_keys_first_row];
+
+        /* Only the rows with blinking text look different when it blinked since */
+        if (m_frame_text_blink_state != m_text_blink_state) {
+                for (auto row = first_row; row <= last_row; row++) {
+                        auto const& frame_row = rows[row - first_row];
+                        if (frame_row.blink_start >= frame_row.blink_end)
+                                continue;
+                        if (!m_frame_damage.empty() && m_frame_damage.back().second == row - 1)
+                                m_frame_damage.back().second = row;
+                        else
+                                m_frame_damage.emplace_back(row, row);
+                }
+        }
+
+        auto region = cairo_region_create();
+        auto const extra = std::max({cell_overflow_top(), cell_overflow_bottom(), int(VTE_LINE_WIDTH)});
+
+        if (shift != 0) {
+                _vte_debug_print(VTE_DEBUG_UPDATES, "Shifting the frame by %ld pixels.\n", shift);
+
+                auto bcr = cairo_create(m_frame_back_surface);
+                cairo_rectangle(bcr, 0, m_padding.top, width, view_height);
+                cairo_clip(bcr);
+                cairo_set_operator(bcr, CAIRO_OPERATOR_SOURCE);
+                cairo_set_source_surface(bcr, m_frame_surface, 0, -shift);
+                cairo_paint(bcr);
+                cairo_destroy(bcr);
+                std::swap(m_frame_surface, m_frame_back_surface);
+
+                /* The paddings weren't copied; and the rows scrolled into
+                 * view, together with the glyphs overflowing from them */
+                auto rect = cairo_rectangle_int_t{0, 0, width, m_padding.top};
+                cairo_region_union_rectangle(region, &rect);
+                rect = cairo_rectangle_int_t{0, m_padding.top + view_height, width, m_padding.bottom};
+                cairo_region_union_rectangle(region, &rect);
+                if (shift > 0)
+                        rect = cairo_rectangle_int_t{0, int(m_padding.top + view_height - shift - extra),
+                                                     width, int(shift + extra)};
+                else
+                        rect = cairo_rectangle_int_t{0, m_padding.top, width, int(-shift + extra)};
+                cairo_region_union_rectangle(region, &rect);
+
+                auto const start = std::max(pixel_to_row(rect.y - m_padding.top), first_row);
+                auto const end = std::min(pixel_to_row(rect.y + rect.height - 1 - m_padding.top), last_row);
+                for (auto row = start; row <= end; row++)
+                        key_row(row);
+        }
+
+        /* The rows changed since, unless they still look the same; for
+         * example, the cursor moving or blinking doesn't change the frame. */
+        for (auto const& range : m_frame_damage) {
+                auto const start = std::max(range.first, first_row);
+                auto const end = std::min(range.second, last_row);
+                for (auto row = start; row <= end; row++) {
+                        if (!key_row(row))
+                                continue;
+
+                        auto rect = damage_rect(row, row, 0, m_column_count);
+                        rect.x = 0;
+                        rect.width = width;
+                        rect.y += m_padding.top;
+                        cairo_region_union_rectangle(region, &rect);
+                }
+        }
+
+        m_frame_rows = std::move(rows);
+        m_frame_keys_first_row = first_row;
+
+        return region;
+}
+
+/* Stores the visual columns of @row with blinking text in @frame_row.
+ *
+ * Returns: a hash of everything that determines how draw_rows() paints @row,
+ *   which is never 0, so that 0 can stand for unknown
+ */
+uint64_t
+Terminal::row_draw_key(vte::grid::row_t row,
+                       FrameRow& frame_row)
+{
+        auto const row_data = find_row_data(row);
+        auto const bidirow = m_ringview.get_bidirow(row);
+        uint32_t const attr_mask = m_allow_bold ? ~0 : ~VTE_ATTR_BOLD_MASK;
+        auto hash = uint64_t{0xcbf29ce484222325}; /* FNV-1a */
+        auto const add = [&hash](uint64_t value) {
+                hash = (hash ^ value) * uint64_t{0x100000001b3};
+        };
+        frame_row.blink_start = frame_row.blink_end = 0;
+
+        add(row_data ? row_data->attr.bidi_flags : 0);
+        for (vte::grid::column_t vcol = 0; vcol < m_column_count; vcol++) {
+                auto const lcol = bidirow->vis2log(vcol);
+                auto const cell = row_data ? _vte_row_data_get(row_data, lcol) : nullptr;
+                guint fore, back, deco;
+                determine_colors(cell, cell_is_selected_vis(vcol, row), &fore, &back, &deco);
+                add(lcol);
+                add(uint64_t(fore) << 32 | back);
+                add(uint64_t(deco) << 1 | bidirow->vis_is_rtl(vcol));
+                if (cell == nullptr)
+                        continue;
+
+                auto const hyperlink_idx = _vte_row_data_get_hyperlink(row_data, lcol);
+                auto const hyperlink = m_allow_hyperlink && hyperlink_idx != 0;
+                auto const hilite = (hyperlink && hyperlink_idx == m_hyperlink_hover_idx) ||
+                                    (!hyperlink && regex_match_has_current() && m_match_span.contains(row, lcol));
+                add(bidirow->vis_get_shaped_char(vcol, cell->c));
+                add(uint64_t(cell->attr.attr & attr_mask) << 2 | hyperlink << 1 | hilite);
+                if (cell->attr.attr & VTE_ATTR_BLINK) {
+                        if (frame_row.blink_start >= frame_row.blink_end)
+                                frame_row.blink_start = vcol;
+                        frame_row.blink_end = vcol + 1;
+                }
+        }
+
+        /* Blinking text is only painted in the "on" state */
+        if (frame_row.blink_start < frame_row.blink_end)
+                add(m_text_blink_state);
+
+        m_image_cache.for_each(image_screen(m_screen), row, row + 1, [&](vte::base::Image const& image) {
+                add(image.id());
+                add(uint64_t(row - image.row()) << 32 | uint64_t(image.column()));
+        });
+
+        return hash | 1;
+}
+
 /* Find the row in the given position in the backscroll buffer.
  * Note that calling this method may invalidate the return value of
  * a previous find_row_data() call. */
@@ -772,15 +1445,69 @@ Terminal::queue_cursor_moved()
 	m_cursor_moved_pending = true;
 }
 
+/* Emit a "contents-updated" signal, with what changed since the last one. */
 void
-Terminal::emit_eof()
+Terminal::emit_contents_updated()
 {
-        if (widget())
-                widget()->emit_eof();
-}
+        auto scrolled = m_screen->insert_delta - m_contents_insert_delta;
+        auto first_row = m_contents_damage_start;
+        auto last_row = m_contents_damage_end;
 
-static gboolean
-emit_eof_idle_cb(VteTerminal *terminal)
+        /* Everything changed; as far as a listener can tell, also when
+         * switching screens or scrolling backwards, e.g. on reset */
+        if (m_contents_damage_all ||
+            m_screen != m_contents_screen ||
+            scrolled < 0) {
+                first_row = _vte_ring_delta(m_screen->row_data);
+                last_row = m_screen->insert_delta + m_row_count - 1;
+        }
+        if (m_screen != m_contents_screen || scrolled < 0)
+                scrolled = 0;
+
+        m_contents_damage_start = 0;
+        m_contents_damage_end = -1;
+        m_contents_damage_all = false;
+        m_contents_screen = m_screen;
+        m_contents_insert_delta = m_screen->insert_delta;
+
+        if (!widget() || !widget()->should_emit_signal(SIGNAL_CONTENTS_UPDATED))
+                return;
+
+        if (first_row > last_row)
+                first_row = last_row = -1;
+
+	_vte_debug_print(VTE_DEBUG_SIGNALS,
+                         "Emitting `contents-updated', scrolled %ld, rows %ld..%ld.\n",
+                         scrolled, first_row, last_row);
+
+	g_signal_emit(m_terminal, signals[SIGNAL_CONTENTS_UPDATED], 0,
+                      int(MIN(scrolled, vte::grid::row_t{G_MAXINT})), glong(first_row), glong(last_row));
+}
+
+/* Emit a "paste-progress" signal. */
+void
+Terminal::emit_paste_progress(uint64_t sent,
+                              uint64_t total)
+{
+        if (!widget() || !widget()->should_emit_signal(SIGNAL_PASTE_PROGRESS))
+                return;
+
+	_vte_debug_print(VTE_DEBUG_SIGNALS,
+                         "Emitting `paste-progress' of %" G_GUINT64_FORMAT " of %" G_GUINT64_FORMAT " bytes.\n",
+                         sent, total);
+
+	g_signal_emit(m_terminal, signals[SIGNAL_PASTE_PROGRESS], 0, guint64(sent), guint64(total));
+}
+
+void
+Terminal::emit_eof()
+{
+        if (widget())
+                widget()->emit_eof();
+}
+
+static gboolean
+emit_eof_idle_cb(VteTerminal *terminal)
 {
         _vte_terminal_get_impl(terminal)->emit_eof();
         // @terminal might be destroyed at this point
@@ -1156,22 +1883,24 @@ Terminal::match_rowcol_to_offset(vte::grid::column_t column,
         return true;
 }
 
-/* creates a pcre match context with appropriate limits */
-pcre2_match_context_8 *
-Terminal::create_match_context()
+vte::base::MatchState&
+Terminal::match_state()
 {
-        pcre2_match_context_8 *match_context;
-
-        match_context = pcre2_match_context_create_8(nullptr /* general context */);
-        pcre2_set_match_limit_8(match_context, 65536); /* should be plenty */
-        pcre2_set_recursion_limit_8(match_context, 64); /* should be plenty */
+        if (!m_match_state)
+                m_match_state = std::make_unique<vte::base::MatchState>();
+        return *m_match_state;
+}
 
-        return match_context;
+vte::base::MatchState&
+Terminal::search_match_state()
+{
+        if (!m_search_match_state)
+                m_search_match_state = std::make_unique<vte::base::MatchState>();
+        return *m_search_match_state;
 }
 
 bool
-Terminal::match_check_pcre(pcre2_match_data_8 *match_data,
-                           pcre2_match_context_8 *match_context,
+Terminal::match_check_pcre(vte::base::MatchState& state,
                            vte::base::Regex const* regex,
                            uint32_t match_flags,
                            gsize sattr,
@@ -1183,18 +1912,11 @@ Terminal::match_check_pcre(pcre2_match_data_8 *match_data,
                            gsize *sblank_ptr,
                            gsize *eblank_ptr)
 {
-        int (* match_fn) (const pcre2_code_8 *,
-                          PCRE2_SPTR8, PCRE2_SIZE, PCRE2_SIZE, uint32_t,
-                          pcre2_match_data_8 *, pcre2_match_context_8 *);
         gsize sblank = 0, eblank = G_MAXSIZE;
         gsize position, line_length;
         const char *line;
         int r = 0;
-
-        if (regex->jited())
-                match_fn = pcre2_jit_match_8;
-        else
-                match_fn = pcre2_match_8;
+        auto const jited = regex->jited();
 
         line = m_match_contents;
         /* FIXME: what we really want is to pass the whole data to pcre2_match, but
@@ -1206,21 +1928,19 @@ Terminal::match_check_pcre(pcre2_match_data_8 *match_data,
         /* Iterate throught the matches until we either find one which contains the
          * offset, or we get no more matches.
          */
-        pcre2_set_offset_limit_8(match_context, eattr);
+        pcre2_set_offset_limit_8(state.context(), eattr);
         position = sattr;
         while (position < eattr &&
-               ((r = match_fn(regex->code(),
-                              (PCRE2_SPTR8)line, line_length, /* subject, length */
-                              position, /* start offset */
-                              match_flags |
-                              PCRE2_NO_UTF_CHECK | PCRE2_NOTEMPTY | PCRE2_PARTIAL_SOFT /* FIXME: HARD? */,
-                              match_data,
-                              match_context)) >= 0 || r == PCRE2_ERROR_PARTIAL)) {
+               ((r = state.match(regex,
+                                 line, line_length, /* subject, length */
+                                 position, /* start offset */
+                                 match_flags |
+                                 PCRE2_NO_UTF_CHECK | PCRE2_NOTEMPTY | PCRE2_PARTIAL_SOFT /* FIXME: HARD? */,
+                                 jited)) >= 0 || r == PCRE2_ERROR_PARTIAL)) {
                 gsize ko = offset;
                 gsize rm_so, rm_eo;
-                gsize *ovector;
+                auto const ovector = state.ovector();
 
-                ovector = pcre2_get_ovector_pointer_8(match_data);
                 rm_so = ovector[0];
                 rm_eo = ovector[1];
                 if (G_UNLIKELY(rm_so == PCRE2_UNSET || rm_eo == PCRE2_UNSET))
@@ -1287,6 +2007,98 @@ Terminal::match_check_pcre(pcre2_match_data_8 *match_data,
         return false;
 }
 
+/*
+ * Terminal::match_line_lookup:
+ * @sattr: the start of a line in m_match_contents
+ * @eattr: its end
+ *
+ * Gets the matches of all of m_match_regexes in the line, from the cache
+ * if the same text was checked before, so that moving the pointer over
+ * the contents doesn't run the regexes again and again.
+ *
+ * The line is matched on its own, the same way match_check_pcre() goes
+ * through the matches, except that lookbehind assertions can't see into
+ * the previous line.
+ *
+ * Returns: the matches
+ */
+Terminal::MatchLine const&
+Terminal::match_line_lookup(gsize sattr,
+                            gsize eattr)
+{
+        auto const text = m_match_contents + sattr;
+        auto const len = eattr - sattr;
+
+        for (auto i = m_match_lines.begin(); i != m_match_lines.end(); ++i) {
+                if (i->m_text.size() != len ||
+                    memcmp(i->m_text.data(), text, len) != 0)
+                        continue;
+
+                std::rotate(i, i + 1, m_match_lines.end());
+                return m_match_lines.back();
+        }
+
+        if (m_match_lines.size() >= VTE_MATCH_CACHE_LINES)
+                m_match_lines.erase(m_match_lines.begin());
+
+        auto& line = m_match_lines.emplace_back();
+        line.m_text.assign(text, len);
+        line.m_matches.resize(m_match_regexes.size());
+
+        auto& state = match_state();
+        pcre2_set_offset_limit_8(state.context(), len);
+
+        /* Only run the regexes whose required bytes occur in the line, so
+         * that the many a host registers don't all run on every line. */
+        auto bytes = vte::base::ByteSet{};
+        for (auto p = size_t{0}; p < len; p++)
+                bytes.add(uint8_t(text[p]));
+
+        for (auto i = size_t{0}; i < m_match_regexes.size(); i++) {
+                if (!m_match_regexes[i].may_match(bytes))
+                        continue;
+
+                auto const regex = m_match_regexes[i].regex();
+                auto& matches = line.m_matches[i];
+                auto const jited = regex->jited();
+                int r = 0;
+
+                auto position = size_t{0};
+                while (position < len &&
+                       ((r = state.match(regex,
+                                         line.m_text.data(), len, /* subject, length */
+                                         position, /* start offset */
+                                         m_match_regexes[i].match_flags() |
+                                         PCRE2_NO_UTF_CHECK | PCRE2_NOTEMPTY | PCRE2_PARTIAL_SOFT /* FIXME: HARD? */,
+                                         jited)) >= 0 || r == PCRE2_ERROR_PARTIAL)) {
+                        auto const ovector = state.ovector();
+                        auto const rm_so = ovector[0];
+                        auto const rm_eo = ovector[1];
+                        if (G_UNLIKELY(rm_so == PCRE2_UNSET || rm_eo == PCRE2_UNSET))
+                                break;
+
+                        /* The offsets should be "sane". We set NOTEMPTY, but check anyway */
+                        if (G_UNLIKELY(position == rm_eo)) {
+                                position = g_utf8_next_char(line.m_text.data() + rm_eo) - line.m_text.data();
+                                continue;
+                        }
+
+                        position = rm_eo;
+
+                        /* FIXME: do handle newline / partial matches at end of line/start of next line */
+                        if (r == PCRE2_ERROR_PARTIAL)
+                                continue;
+
+                        matches.push_back({rm_so, rm_eo});
+                }
+
+                if (G_UNLIKELY(r < PCRE2_ERROR_PARTIAL))
+                        _vte_debug_print(VTE_DEBUG_REGEX, "Unexpected pcre2_match error code: %d\n", r);
+        }
+
+        return line;
+}
+
 char *
 Terminal::match_check_internal_pcre(vte::grid::column_t column,
                                     vte::grid::row_t row,
@@ -1295,8 +2107,6 @@ Terminal::match_check_internal_pcre(vte::grid::column_t column,
                                     size_t* end)
 {
 	gsize offset, sattr, eattr, start_blank, end_blank;
-        pcre2_match_data_8 *match_data;
-        pcre2_match_context_8 *match_context;
 
 	_vte_debug_print(VTE_DEBUG_REGEX,
                          "Checking for pcre match at (%ld,%ld).\n", row, column);
@@ -1308,32 +2118,30 @@ Terminal::match_check_internal_pcre(vte::grid::column_t column,
 	start_blank = sattr;
 	end_blank = eattr;
 
-        match_context = create_match_context();
-        match_data = pcre2_match_data_create_8(256 /* should be plenty */, NULL /* general context */);
+        auto const& line = match_line_lookup(sattr, eattr);
+        auto const position = offset - sattr;
 
 	/* Now iterate over each regex we need to match against. */
         char* dingu_match{nullptr};
-        for (auto const& rem : m_match_regexes) {
-                gsize sblank, eblank;
-
-                if (match_check_pcre(match_data, match_context,
-                                     rem.regex(),
-                                     rem.match_flags(),
-                                     sattr, eattr, offset,
-                                     &dingu_match,
-                                     start, end,
-                                     &sblank, &eblank)) {
-                        _vte_debug_print(VTE_DEBUG_REGEX, "Matched dingu with tag %d\n", rem.tag());
-                        *match = std::addressof(rem);
+        for (auto i = size_t{0}; i < m_match_regexes.size(); i++) {
+                auto const& matches = line.m_matches[i];
+
+                /* The first match ending after the pointer */
+                auto m = std::upper_bound(std::begin(matches), std::end(matches), position,
+                                          [](size_t pos, MatchLine::Match const& mi) { return pos < mi.end; });
+                if (m != std::end(matches) && m->start <= position) {
+                        dingu_match = g_strndup(m_match_contents + sattr + m->start, m->end - m->start);
+                        *start = sattr + m->start;
+                        *end = sattr + m->end - 1;
+                        *match = std::addressof(m_match_regexes[i]);
+                        _vte_debug_print(VTE_DEBUG_REGEX, "Matched dingu with tag %d\n", (*match)->tag());
                         break;
                 }
 
-                if (sblank > start_blank) {
-                        start_blank = sblank;
-                }
-                if (eblank < end_blank) {
-                        end_blank = eblank;
-                }
+                if (m != std::begin(matches))
+                        start_blank = MAX(start_blank, sattr + std::prev(m)->end);
+                if (m != std::end(matches))
+                        end_blank = MIN(end_blank, sattr + m->start);
 	}
 
         if (dingu_match == nullptr) {
@@ -1358,9 +2166,6 @@ Terminal::match_check_internal_pcre(vte::grid::column_t column,
                 }
         }
 
-        pcre2_match_data_free_8(match_data);
-        pcre2_match_context_free_8(match_context);
-
 	return dingu_match;
 }
 
@@ -1758,8 +2563,6 @@ Terminal::regex_match_check_extra(GdkEvent *event,
                                   char** matches)
 {
 	gsize offset, sattr, eattr;
-        pcre2_match_data_8 *match_data;
-        pcre2_match_context_8 *match_context;
         bool any_matches = false;
         long col, row;
         guint i;
@@ -1782,16 +2585,25 @@ Terminal::regex_match_check_extra(GdkEvent *event,
                                     &offset, &sattr, &eattr))
                 return false;
 
-        match_context = create_match_context();
-        match_data = pcre2_match_data_create_8(256 /* should be plenty */, nullptr /* general context */);
+        auto& state = match_state();
+
+        auto bytes = vte::base::ByteSet{};
+        for (auto p = sattr; p < eattr; p++)
+                bytes.add(uint8_t(m_match_contents[p]));
 
         for (i = 0; i < n_regexes; i++) {
                 gsize start, end, sblank, eblank;
                 char *match_string;
+                vte::base::ByteSet first_bytes, last_bytes;
 
                 g_return_val_if_fail(regexes[i] != nullptr, false);
 
-                if (match_check_pcre(match_data, match_context,
+                matches[i] = nullptr;
+                regexes[i]->required_bytes(first_bytes, last_bytes);
+                if (!bytes.intersects(first_bytes) || !bytes.intersects(last_bytes))
+                        continue;
+
+                if (match_check_pcre(state,
                                      regexes[i], match_flags,
                                      sattr, eattr, offset,
                                      &match_string,
@@ -1804,104 +2616,77 @@ Terminal::regex_match_check_extra(GdkEvent *event,
                         matches[i] = nullptr;
         }
 
-        pcre2_match_data_free_8(match_data);
-        pcre2_match_context_free_8(match_context);
-
         return any_matches;
 }
 
-/* Emit an adjustment changed signal on our adjustment object. */
+/* Emit an adjustment changed signal on our adjustment object.
+ *
+ * All of the adjustment is updated with one gtk_adjustment_configure(), so
+ * that the scrollbar only sees one change however many properties changed,
+ * and nothing at all when none did.
+ */
 void
 Terminal::emit_adjustment_changed()
 {
-	if (m_adjustment_changed_pending) {
-		bool changed = false;
-		gdouble current, v;
-
-                auto vadjustment = m_vadjustment.get();
-
-                g_object_freeze_notify(G_OBJECT(vadjustment));
-
-		v = _vte_ring_delta (m_screen->row_data);
-                current = gtk_adjustment_get_lower(vadjustment);
-		if (!_vte_double_equal(current, v)) {
-			_vte_debug_print(VTE_DEBUG_ADJ,
-					"Changing lower bound from %.0f to %f\n",
-					 current, v);
-                        gtk_adjustment_set_lower(vadjustment, v);
-			changed = true;
-		}
+        if (!m_adjustment_changed_pending && !m_adjustment_value_changed_pending)
+                return;
 
-		v = m_screen->insert_delta + m_row_count;
-                current = gtk_adjustment_get_upper(vadjustment);
-		if (!_vte_double_equal(current, v)) {
-			_vte_debug_print(VTE_DEBUG_ADJ,
-					"Changing upper bound from %.0f to %f\n",
-					 current, v);
-                        gtk_adjustment_set_upper(vadjustment, v);
-			changed = true;
-		}
+        auto vadjustment = m_vadjustment.get();
+        double const current_value = gtk_adjustment_get_value(vadjustment);
+        double const current_lower = gtk_adjustment_get_lower(vadjustment);
+        double const current_upper = gtk_adjustment_get_upper(vadjustment);
+        double const current_step = gtk_adjustment_get_step_increment(vadjustment);
+        double const current_page_increment = gtk_adjustment_get_page_increment(vadjustment);
+        double const current_page_size = gtk_adjustment_get_page_size(vadjustment);
+
+        double value = current_value;
+        double lower = current_lower;
+        double upper = current_upper;
+        double step = current_step;
+        double page_increment = current_page_increment;
+        double page_size = current_page_size;
 
+	if (m_adjustment_changed_pending) {
+		lower = _vte_ring_delta (m_screen->row_data);
+		upper = m_screen->insert_delta + m_row_count;
 		/* The step increment should always be one. */
-                v = gtk_adjustment_get_step_increment(vadjustment);
-		if (!_vte_double_equal(v, 1)) {
-			_vte_debug_print(VTE_DEBUG_ADJ,
-					"Changing step increment from %.0lf to 1\n", v);
-                        gtk_adjustment_set_step_increment(vadjustment, 1);
-			changed = true;
-		}
-
+		step = 1;
 		/* Set the number of rows the user sees to the number of rows the
-		 * user sees. */
-                v = gtk_adjustment_get_page_size(vadjustment);
-		if (!_vte_double_equal(v, m_row_count)) {
-			_vte_debug_print(VTE_DEBUG_ADJ,
-					"Changing page size from %.0f to %ld\n",
-					 v, m_row_count);
-                        gtk_adjustment_set_page_size(vadjustment,
-						     m_row_count);
-			changed = true;
-		}
-
-		/* Clicking in the empty area should scroll one screen, so set the
-		 * page size to the number of visible rows. */
-                v = gtk_adjustment_get_page_increment(vadjustment);
-		if (!_vte_double_equal(v, m_row_count)) {
-			_vte_debug_print(VTE_DEBUG_ADJ,
-					"Changing page increment from "
-					"%.0f to %ld\n",
-					v, m_row_count);
-                        gtk_adjustment_set_page_increment(vadjustment,
-							  m_row_count);
-			changed = true;
-		}
-
-                g_object_thaw_notify(G_OBJECT(vadjustment));
-
-		if (changed)
-			_vte_debug_print(VTE_DEBUG_SIGNALS,
-					"Emitting adjustment_changed.\n");
+		 * user sees. Clicking in the empty area should scroll one screen,
+		 * so set the page increment to the number of visible rows too. */
+		page_size = m_row_count;
+		page_increment = m_row_count;
 		m_adjustment_changed_pending = FALSE;
 	}
 	if (m_adjustment_value_changed_pending) {
-		double v, delta;
-		_vte_debug_print(VTE_DEBUG_SIGNALS,
-				"Emitting adjustment_value_changed.\n");
 		m_adjustment_value_changed_pending = FALSE;
 
-                auto vadjustment = m_vadjustment.get();
-                v = gtk_adjustment_get_value(vadjustment);
-		if (!_vte_double_equal(v, m_screen->scroll_delta)) {
+		if (!_vte_double_equal(current_value, m_screen->scroll_delta)) {
 			/* this little dance is so that the scroll_delta is
 			 * updated immediately, but we still handled scrolling
 			 * via the adjustment - e.g. user interaction with the
 			 * scrollbar
 			 */
-			delta = m_screen->scroll_delta;
-			m_screen->scroll_delta = v;
-                        gtk_adjustment_set_value(vadjustment, delta);
+			value = m_screen->scroll_delta;
+			m_screen->scroll_delta = current_value;
 		}
 	}
+
+        if (_vte_double_equal(value, current_value) &&
+            _vte_double_equal(lower, current_lower) &&
+            _vte_double_equal(upper, current_upper) &&
+            _vte_double_equal(step, current_step) &&
+            _vte_double_equal(page_increment, current_page_increment) &&
+            _vte_double_equal(page_size, current_page_size))
+                return;
+
+        _vte_debug_print(VTE_DEBUG_ADJ,
+                         "Configuring adjustment: value %.0f, lower %.0f, upper %.0f, page size %.0f\n",
+                         value, lower, upper, page_size);
+        _vte_debug_print(VTE_DEBUG_SIGNALS,
+                         "Emitting adjustment_changed.\n");
+        gtk_adjustment_configure(vadjustment, value, lower, upper,
+                                 step, page_increment, page_size);
 }
 
 /* Queue an adjustment-changed signal to be delivered when convenient. */
@@ -2033,7 +2818,8 @@ Terminal::set_encoding(char const* charset,
          * Do not clear the incoming queue.
          */
 
-        _vte_byte_array_clear(m_outgoing);
+        m_outgoing.clear();
+        paste_stop();
 
         if (using_utf8) {
                 m_converter.reset();
@@ -2074,6 +2860,7 @@ Terminal::set_cjk_ambiguous_width(int width)
                 return false;
 
         m_utf8_ambiguous_width = width;
+        update_charset_map();
         return true;
 }
 
@@ -2598,8 +3385,16 @@ void
 Terminal::cleanup_fragments(long start,
                                       long end)
 {
-        VteRowData *row = ensure_row();
-        const VteCell *cell_start;
+        cleanup_fragments(ensure_row(), start, end);
+}
+
+/* Same as above, for when the caller already has the cursor's @row */
+void
+Terminal::cleanup_fragments(VteRowData* row,
+                            long start,
+                            long end)
+{
+        const VteCell *cell_start, *cell_end_ro;
         VteCell *cell_end, *cell_col;
         gboolean cell_start_is_fragment;
         long col;
@@ -2615,8 +3410,10 @@ Terminal::cleanup_fragments(long start,
         /* On the right hand side, try to replace a TAB by a shorter TAB if we can.
          * This requires that the TAB on the left (which might be the same TAB) is
          * not yet converted to spaces, so start on the right hand side. */
-        cell_end = _vte_row_data_get_writable (row, end);
-        if (G_UNLIKELY (cell_end != NULL && cell_end->attr.fragment())) {
+        /* Only cells that change are taken writable, keeping the row's filled tail */
+        cell_end_ro = _vte_row_data_get (row, end);
+        if (G_UNLIKELY (cell_end_ro != NULL && cell_end_ro->attr.fragment())) {
+                cell_end = _vte_row_data_get_writable (row, end);
                 col = end;
                 do {
                         col--;
@@ -2716,8 +3513,7 @@ Terminal::cursor_down(bool explicit_sequence)
                                 set_hard_wrapped(start - 1);
                                 set_hard_wrapped(end);
                                 /* Scroll by removing a line and inserting a new one. */
-				ring_remove(start);
-				ring_insert(end, true);
+				ring_rotate(start, end, -1);
                                 /* Repaint the affected lines. No need to extend,
                                  * set_hard_wrapped() took care of invalidating
                                  * the context lines if necessary. */
@@ -2775,9 +3571,11 @@ Terminal::restore_cursor(VteScreen *screen__)
 
         m_defaults = screen__->saved.defaults;
         m_color_defaults = screen__->saved.color_defaults;
+        m_hyperlink_idx = screen__->saved.hyperlink_idx;
         m_character_replacements[0] = screen__->saved.character_replacements[0];
         m_character_replacements[1] = screen__->saved.character_replacements[1];
         m_character_replacement = screen__->saved.character_replacement;
+        update_charset_map();
 }
 
 /* Save cursor on a screen__. */
@@ -2794,11 +3592,79 @@ Terminal::save_cursor(VteScreen *screen__)
 
         screen__->saved.defaults = m_defaults;
         screen__->saved.color_defaults = m_color_defaults;
+        screen__->saved.hyperlink_idx = m_hyperlink_idx;
         screen__->saved.character_replacements[0] = m_character_replacements[0];
         screen__->saved.character_replacements[1] = m_character_replacements[1];
         screen__->saved.character_replacement = m_character_replacement;
 }
 
+/* DEC Special Character and Line Drawing Set.  VT100 and higher (per XTerm docs). */
+static constexpr gunichar const line_drawing_map[32] = {
+        0x0020,  /* _ => blank (space) */
+        0x25c6,  /* ` => diamond */
+        0x2592,  /* a => checkerboard */
+        0x2409,  /* b => HT symbol */
+        0x240c,  /* c => FF symbol */
+        0x240d,  /* d => CR symbol */
+        0x240a,  /* e => LF symbol */
+        0x00b0,  /* f => degree */
+        0x00b1,  /* g => plus/minus */
+        0x2424,  /* h => NL symbol */
+        0x240b,  /* i => VT symbol */
+        0x2518,  /* j => downright corner */
+        0x2510,  /* k => upright corner */
+        0x250c,  /* l => upleft corner */
+        0x2514,  /* m => downleft corner */
+        0x253c,  /* n => cross */
+        0x23ba,  /* o => scan line 1/9 */
+        0x23bb,  /* p => scan line 3/9 */
+        0x2500,  /* q => horizontal line (also scan line 5/9) */
+        0x23bc,  /* r => scan line 7/9 */
+        0x23bd,  /* s => scan line 9/9 */
+        0x251c,  /* t => left t */
+        0x2524,  /* u => right t */
+        0x2534,  /* v => bottom t */
+        0x252c,  /* w => top t */
+        0x2502,  /* x => vertical line */
+        0x2264,  /* y => <= */
+        0x2265,  /* z => >= */
+        0x03c0,  /* { => pi */
+        0x2260,  /* | => not equal */
+        0x00a3,  /* } => pound currency sign */
+        0x00b7,  /* ~ => bullet */
+};
+
+/* What the characters 0x20..0x7f map to in each VteCharacterReplacement,
+ * so that mapping a run of them is a lookup per character. */
+static constexpr auto const charset_maps = [] {
+        std::array<std::array<gunichar, 96>, 3> maps{};
+        for (auto& map : maps) {
+                for (auto i = 0u; i < map.size(); ++i)
+                        map[i] = 0x20 + i;
+        }
+        for (auto i = 0u; i < G_N_ELEMENTS(line_drawing_map); ++i)
+                maps[VTE_CHARACTER_REPLACEMENT_LINE_DRAWING]['_' - 0x20 + i] = line_drawing_map[i];
+        maps[VTE_CHARACTER_REPLACEMENT_BRITISH]['#' - 0x20] = 0x00a3;  /* pound sign */
+        return maps;
+}();
+
+/* Updates the map of the active character set, after it or the width of
+ * the ambiguous characters changed. */
+void
+Terminal::update_charset_map() noexcept
+{
+        auto const replacement = *m_character_replacement;
+        if (replacement == VTE_CHARACTER_REPLACEMENT_NONE) {
+                m_charset_map = nullptr;
+                return;
+        }
+
+        m_charset_map = charset_maps[replacement].data();
+        m_charset_map_narrow = std::all_of(m_charset_map, m_charset_map + 96, [&](gunichar c) {
+                        return _vte_unichar_width(c, m_utf8_ambiguous_width) == 1;
+                });
+}
+
 /* Insert a single character into the stored data array. */
 void
 Terminal::insert_char(gunichar c,
@@ -2812,53 +3678,11 @@ Terminal::insert_char(gunichar c,
 	bool line_wrapped = false; /* cursor moved before char inserted */
         gunichar c_unmapped = c;
 
-        /* DEC Special Character and Line Drawing Set.  VT100 and higher (per XTerm docs). */
-        static const gunichar line_drawing_map[32] = {
-                0x0020,  /* _ => blank (space) */
-                0x25c6,  /* ` => diamond */
-                0x2592,  /* a => checkerboard */
-                0x2409,  /* b => HT symbol */
-                0x240c,  /* c => FF symbol */
-                0x240d,  /* d => CR symbol */
-                0x240a,  /* e => LF symbol */
-                0x00b0,  /* f => degree */
-                0x00b1,  /* g => plus/minus */
-                0x2424,  /* h => NL symbol */
-                0x240b,  /* i => VT symbol */
-                0x2518,  /* j => downright corner */
-                0x2510,  /* k => upright corner */
-                0x250c,  /* l => upleft corner */
-                0x2514,  /* m => downleft corner */
-                0x253c,  /* n => cross */
-                0x23ba,  /* o => scan line 1/9 */
-                0x23bb,  /* p => scan line 3/9 */
-                0x2500,  /* q => horizontal line (also scan line 5/9) */
-                0x23bc,  /* r => scan line 7/9 */
-                0x23bd,  /* s => scan line 9/9 */
-                0x251c,  /* t => left t */
-                0x2524,  /* u => right t */
-                0x2534,  /* v => bottom t */
-                0x252c,  /* w => top t */
-                0x2502,  /* x => vertical line */
-                0x2264,  /* y => <= */
-                0x2265,  /* z => >= */
-                0x03c0,  /* { => pi */
-                0x2260,  /* | => not equal */
-                0x00a3,  /* } => pound currency sign */
-                0x00b7,  /* ~ => bullet */
-        };
-
         insert |= m_modes_ecma.IRM();
 
 	/* If we've enabled the special drawing set, map the characters to
 	 * Unicode. */
-        if (G_UNLIKELY (*m_character_replacement == VTE_CHARACTER_REPLACEMENT_LINE_DRAWING)) {
-                if (c >= 95 && c <= 126)
-                        c = line_drawing_map[c - 95];
-        } else if (G_UNLIKELY (*m_character_replacement == VTE_CHARACTER_REPLACEMENT_BRITISH)) {
-                if (G_UNLIKELY (c == '#'))
-                        c = 0x00a3;  /* pound sign */
-        }
+        c = map_graphic(c);
 
 	/* Figure out how many columns this character should occupy. */
         columns = _vte_unichar_width(c, m_utf8_ambiguous_width);
@@ -2866,23 +3690,7 @@ Terminal::insert_char(gunichar c,
 	/* If we're autowrapping here, do it. */
         col = m_screen->cursor.col;
 	if (G_UNLIKELY (columns && col + columns > m_column_count)) {
-		if (m_modes_private.DEC_AUTOWRAP()) {
-			_vte_debug_print(VTE_DEBUG_ADJ,
-					"Autowrapping before character\n");
-			/* Wrap. */
-			/* XXX clear to the end of line */
-                        col = m_screen->cursor.col = 0;
-			/* Mark this line as soft-wrapped. */
-			row = ensure_row();
-                        set_soft_wrapped(m_screen->cursor.row);
-                        cursor_down(false);
-                        ensure_row();
-                        apply_bidi_attributes(m_screen->cursor.row, row->attr.bidi_flags, VTE_BIDI_FLAG_ALL);
-		} else {
-			/* Don't wrap, stay at the rightmost column. */
-                        col = m_screen->cursor.col =
-				m_column_count - columns;
-		}
+                col = wrap_for_insert(columns);
 		line_wrapped = true;
 	}
 
@@ -2990,6 +3798,7 @@ Terminal::insert_char(gunichar c,
 		pcell->attr = attr;
 		col++;
 	}
+        _vte_row_data_set_hyperlink (row, col - columns, col, m_hyperlink_idx);
 	if (_vte_row_data_length (row) > m_column_count)
 		cleanup_fragments(m_column_count, _vte_row_data_length (row));
 	_vte_row_data_shrink (row, m_column_count);
@@ -3013,6 +3822,203 @@ not_inserted:
         m_line_wrapped = line_wrapped;
 }
 
+/* Makes room for inserting a character @columns wide at the cursor, when
+ * it doesn't fit on the rest of the row: with autowrap, moves to the start
+ * of the next row, marking this one as soft-wrapped, otherwise moves back
+ * far enough for it to fit in the rightmost columns.
+ *
+ * Returns: the new cursor column
+ */
+vte::grid::column_t
+Terminal::wrap_for_insert(int columns)
+{
+        if (m_modes_private.DEC_AUTOWRAP()) {
+                _vte_debug_print(VTE_DEBUG_ADJ,
+                                 "Autowrapping before character\n");
+                /* Wrap. */
+                /* XXX clear to the end of line */
+                m_screen->cursor.col = 0;
+                /* Mark this line as soft-wrapped. */
+                auto row = ensure_row();
+                set_soft_wrapped(m_screen->cursor.row);
+                cursor_down(false);
+                ensure_row();
+                apply_bidi_attributes(m_screen->cursor.row, row->attr.bidi_flags, VTE_BIDI_FLAG_ALL);
+        } else {
+                /* Don't wrap, stay at the rightmost column. */
+                m_screen->cursor.col = m_column_count - columns;
+        }
+
+        return m_screen->cursor.col;
+}
+
+/* Insert a run of printable ASCII characters (0x20..0x7e) at the cursor.
+ *
+ * This is the bulk equivalent of calling insert_char(c, false, false) for
+ * each character, for the case where no wrapping is necessary. It never
+ * wraps, but only inserts as many characters as fit on the current row,
+ * and returns that number.
+ *
+ * Must only be called when can_insert_printable_ascii() is true.
+ */
+size_t
+Terminal::insert_printable_ascii(uint8_t const* data,
+                                 size_t len)
+{
+        g_assert(can_insert_printable_ascii());
+
+        auto const col = m_screen->cursor.col;
+        auto const n = std::min(len, size_t(m_column_count - col));
+        if (G_UNLIKELY(n == 0))
+                return 0;
+
+        _vte_debug_print(VTE_DEBUG_PARSER,
+                         "Inserting %" G_GSIZE_FORMAT " ASCII characters at (%ld, %ld)\n",
+                         n, col, (long)m_screen->cursor.row);
+
+	/* Make sure we have enough rows to hold this data. */
+        auto row = ensure_cursor();
+        g_assert(row != nullptr);
+
+        cleanup_fragments(row, col, col + n);
+        _vte_row_data_fill(row, &basic_cell, col + n);
+
+        auto attr = m_defaults.attr;
+        attr.set_columns(1);
+
+        auto cell = _vte_row_data_get_writable(row, col);
+        if (G_UNLIKELY(m_charset_map != nullptr)) {
+                for (size_t i = 0; i < n; ++i) {
+                        cell[i].c = m_charset_map[data[i] - 0x20];
+                        cell[i].attr = attr;
+                }
+        } else {
+                for (size_t i = 0; i < n; ++i) {
+                        cell[i].c = data[i];
+                        cell[i].attr = attr;
+                }
+        }
+        _vte_row_data_set_hyperlink(row, col, col + n, m_hyperlink_idx);
+
+        if (_vte_row_data_length(row) > m_column_count)
+                cleanup_fragments(row, m_column_count, _vte_row_data_length(row));
+        _vte_row_data_shrink(row, m_column_count);
+
+        m_screen->cursor.col = col + n;
+        m_last_graphic_character = data[n - 1];
+
+	/* We added text, so make a note of it. */
+        m_text_inserted_flag = TRUE;
+        m_line_wrapped = false;
+
+        return n;
+}
+
+/* Insert a run of graphic characters at the cursor.
+ *
+ * This is equivalent to calling insert_char(c, false, false) for each
+ * character, but writes as many of them as fit on the row in one go,
+ * working out their widths and wrapping once per row, and cleaning up
+ * fragments only at the boundaries of what it writes. In insert mode,
+ * the room for them is made in one go too. Only characters that combine
+ * with the previous cell go through insert_char(). The characters of a
+ * mapped character set are mapped on the way.
+ */
+void
+Terminal::insert_chars(gunichar const* chars,
+                       size_t len)
+{
+        auto const insert = m_modes_ecma.IRM();
+
+        auto attr = m_defaults.attr;
+        attr.set_columns(1);
+        auto attr_wide = m_defaults.attr;
+        attr_wide.set_columns(2);
+        auto attr_fragment = attr_wide;
+        attr_fragment.set_fragment(true);
+
+        auto line_wrapped = false;
+        size_t i = 0;
+        while (i < len) {
+                /* Find the characters that fit on the row as they are */
+                uint8_t widths[VTE_GRAPHIC_RUN_MAX];
+                auto const start = m_screen->cursor.col;
+                auto col = start;
+                auto const n_max = std::min(len - i, size_t(VTE_GRAPHIC_RUN_MAX));
+                size_t n = 0;
+                int columns = 0;
+                while (n < n_max) {
+                        auto const c = map_graphic(chars[i + n]);
+                        columns = _vte_unichar_width(c, m_utf8_ambiguous_width);
+                        if (G_UNLIKELY(columns == 0 || c == 0 || col + columns > m_column_count))
+                                break;
+
+                        widths[n++] = columns;
+                        col += columns;
+                }
+
+                if (n == 0) {
+                        if (columns != 0 && chars[i] != 0 && start > 0) {
+                                /* Doesn't fit; wrap once, then carry on with the next row */
+                                wrap_for_insert(columns);
+                                line_wrapped = true;
+                        } else {
+                                insert_char(chars[i++], false, false);
+                                line_wrapped |= m_line_wrapped;
+                        }
+                        continue;
+                }
+
+                _vte_debug_print(VTE_DEBUG_PARSER,
+                                 "Inserting %" G_GSIZE_FORMAT " characters at (%ld, %ld)\n",
+                                 n, start, (long)m_screen->cursor.row);
+
+                /* Make sure we have enough rows to hold this data. */
+                auto row = ensure_cursor();
+                g_assert(row != nullptr);
+
+                if (G_UNLIKELY(insert)) {
+                        cleanup_fragments(row, start, start);
+                        _vte_row_data_insert_n(row, start, &basic_cell, col - start);
+                } else {
+                        cleanup_fragments(row, start, col);
+                        _vte_row_data_fill(row, &basic_cell, col);
+                }
+
+                auto cell = _vte_row_data_get_writable(row, start);
+                for (size_t k = 0; k < n; ++k) {
+                        auto const c = map_graphic(chars[i + k]);
+                        if (G_LIKELY(widths[k] == 1)) {
+                                cell->c = c;
+                                cell->attr = attr;
+                                ++cell;
+                        } else {
+                                /* Wide character and its fragment */
+                                cell[0].c = c;
+                                cell[0].attr = attr_wide;
+                                cell[1].c = c;
+                                cell[1].attr = attr_fragment;
+                                cell += 2;
+                        }
+                }
+                _vte_row_data_set_hyperlink(row, start, col, m_hyperlink_idx);
+
+                if (_vte_row_data_length(row) > m_column_count)
+                        cleanup_fragments(row, m_column_count, _vte_row_data_length(row));
+                _vte_row_data_shrink(row, m_column_count);
+
+                m_screen->cursor.col = col;
+                m_last_graphic_character = chars[i + n - 1];
+
+                /* We added text, so make a note of it. */
+                m_text_inserted_flag = TRUE;
+
+                i += n;
+        }
+
+        m_line_wrapped = line_wrapped;
+}
+
 guint8
 Terminal::get_bidi_flags() const noexcept
 {
@@ -3141,7 +4147,26 @@ Terminal::child_watch_done(pid_t pid,
                 m_child_exit_status = status;
                 m_child_exited_after_eos_pending = true;
 
-                m_child_exited_eos_wait_timer.schedule_seconds(5); // FIXME: better value?
+                /* The child's descriptors are closed before its exit is
+                 * reported. If it was the last one to have the PTY open, the
+                 * PTY has hung up already, and the EOS is sure to come: read
+                 * the rest of the output right away, so it comes in this
+                 * round. The reader thread sees the hangup by itself.
+                 * Otherwise, e.g. with background processes still writing to
+                 * the PTY, wait for the EOS, but not forever.
+                 */
+                auto hung_up = bool{false};
+                if (pty()) {
+                        auto pfd = pollfd{pty()->fd(), POLLIN, 0};
+                        hung_up = poll(&pfd, 1, 0) == 1 && (pfd.revents & POLLHUP);
+                }
+
+                if (!hung_up) {
+                        m_child_exited_eos_wait_timer.schedule_seconds(5); // FIXME: better value?
+                } else if (m_pty_input_source != 0 && !m_pty_reader) {
+                        if (!pty_io_read(pty()->fd(), GIOCondition(G_IO_IN | G_IO_HUP)))
+                                disconnect_pty_read();
+                }
         } else {
                 m_child_exited_after_eos_pending = false;
 
@@ -3166,12 +4191,40 @@ io_read_cb(int fd,
         return that->pty_io_read(fd, condition);
 }
 
+/* Handle data from the PTY reader thread. */
+static gboolean
+io_reader_ready_cb(int fd,
+                   GIOCondition condition,
+                   vte::terminal::Terminal* that)
+{
+        return that->pty_reader_ready();
+}
+
 void
 Terminal::connect_pty_read()
 {
-	if (m_pty_input_source != 0 || !pty())
+	if (m_pty_input_source != 0 || !pty() || m_input_throttled)
 		return;
 
+        if (m_enable_io_thread && !m_pty_reader)
+                m_pty_reader = vte::base::PtyReader::create(pty()->fd());
+
+        if (m_enable_io_thread) {
+                if (m_pty_reader) {
+                        _vte_debug_print (VTE_DEBUG_IO, "Adding PTY reader thread source\n");
+
+                        m_pty_input_source = g_unix_fd_add_full(VTE_CHILD_INPUT_PRIORITY,
+                                                                m_pty_reader->notify_fd(),
+                                                                G_IO_IN,
+                                                                (GUnixFDSourceFunc)io_reader_ready_cb,
+                                                                this,
+                                                                (GDestroyNotify)mark_input_source_invalid_cb);
+                        return;
+                }
+
+                _vte_debug_print (VTE_DEBUG_IO, "Failed to start PTY reader thread, falling back\n");
+        }
+
         _vte_debug_print (VTE_DEBUG_IO, "Adding PTY input source\n");
 
         m_pty_input_source = g_unix_fd_add_full(VTE_CHILD_INPUT_PRIORITY,
@@ -3207,7 +4260,7 @@ Terminal::connect_pty_write()
         g_warn_if_fail(m_input_enabled);
 
         /* Anything to write? */
-        if (_vte_byte_array_length(m_outgoing) == 0)
+        if (m_outgoing.empty())
                 return;
 
         /* Do one write. FIXMEchpe why? */
@@ -3233,6 +4286,13 @@ Terminal::disconnect_pty_read()
                 // FIXMEchpe the destroy notify should already have done this!
 		m_pty_input_source = 0;
 	}
+
+        if (m_pty_reader) {
+                /* Stop the thread, but keep the data it has already read */
+                m_pty_reader->stop();
+                pty_reader_drain(true);
+                m_pty_reader.reset();
+        }
 }
 
 void
@@ -3325,33 +4385,141 @@ Terminal::im_reset()
         im_preedit_reset();
 }
 
+enum class DecodeResult {
+        eNothing   = 0,
+        eSomething = 1,
+        eError     = 2,
+};
+
+/* Decoder policies for process_incoming_decoder(); see there. */
+
+class UTF8DecoderPolicy {
+public:
+        constexpr UTF8DecoderPolicy(vte::base::UTF8Decoder& decoder) noexcept
+                : m_decoder{decoder}
+        {
+        }
+
+        inline DecodeResult decode(uint8_t const** sptr,
+                                   uint8_t const* /* send */,
+                                   bool flush) noexcept
+        {
+                /* If there's an unfinished character, flushing yields a replacement character */
+                if (G_UNLIKELY(flush))
+                        return m_decoder.flush() ? DecodeResult::eSomething : DecodeResult::eNothing;
+
+                switch (m_decoder.decode(**sptr)) {
+                case vte::base::UTF8Decoder::REJECT_REWIND:
+                        /* Don't consume the byte; this will never lead to a loop,
+                         * since in the next round this byte *will* be consumed.
+                         */
+                        m_decoder.reset();
+                        return DecodeResult::eSomething; /* U+FFFD */
+                case vte::base::UTF8Decoder::REJECT:
+                        m_decoder.reset();
+                        ++*sptr;
+                        return DecodeResult::eSomething; /* U+FFFD */
+                case vte::base::UTF8Decoder::ACCEPT:
+                        ++*sptr;
+                        return DecodeResult::eSomething;
+                default:
+                        ++*sptr;
+                        return DecodeResult::eNothing;
+                }
+        }
+
+        inline constexpr uint32_t codepoint() const noexcept { return m_decoder.codepoint(); }
+        inline void reset() noexcept { m_decoder.reset(); }
+        inline constexpr bool can_pass_ascii() const noexcept
+        {
+                return m_decoder.state() == vte::base::UTF8Decoder::ACCEPT;
+        }
+
+private:
+        vte::base::UTF8Decoder& m_decoder;
+};
+
+#ifdef WITH_ICU
+
+class ICUDecoderPolicy {
+public:
+        constexpr ICUDecoderPolicy(vte::base::ICUDecoder& decoder) noexcept
+                : m_decoder{decoder}
+        {
+        }
+
+        inline DecodeResult decode(uint8_t const** sptr,
+                                   uint8_t const* send,
+                                   bool flush) noexcept
+        {
+                switch (m_decoder.decode(sptr, send, flush)) {
+                case vte::base::ICUDecoder::Result::eSomething: return DecodeResult::eSomething;
+                case vte::base::ICUDecoder::Result::eNothing:   return DecodeResult::eNothing;
+                case vte::base::ICUDecoder::Result::eError:
+                default:                                        return DecodeResult::eError;
+                }
+        }
+
+        inline uint32_t codepoint() const noexcept { return m_decoder.codepoint(); }
+        inline void reset() noexcept { m_decoder.reset(); }
+        inline bool can_pass_ascii() const noexcept { return m_decoder.can_pass_ascii(); }
+
+private:
+        vte::base::ICUDecoder& m_decoder;
+};
+
+#endif /* WITH_ICU */
+
 void
 Terminal::process_incoming()
 {
+        vte::base::FrameStats::Scope stats_scope{m_frame_stats, vte::base::FrameStats::Stage::eProcess};
+        vte::base::Trace::Scope trace_scope{"process-incoming"};
+        auto const queued_bytes = m_queued_bytes;
+
         switch (data_syntax()) {
-        case DataSyntax::eECMA48_UTF8:   process_incoming_utf8();    break;
+        case DataSyntax::eECMA48_UTF8: {
+                auto policy = UTF8DecoderPolicy{m_utf8_decoder};
+                process_incoming_decoder(policy);
+                break;
+        }
 #ifdef WITH_ICU
-        case DataSyntax::eECMA48_PCTERM: process_incoming_pcterm(); break;
+        case DataSyntax::eECMA48_PCTERM: {
+                auto policy = ICUDecoderPolicy{m_converter->decoder()};
+                process_incoming_decoder(policy);
+                break;
+        }
 #endif
         default: g_assert_not_reached(); break;
         }
-}
 
+        trace_scope.set_count(queued_bytes - m_queued_bytes, "bytes");
+
+        if (!m_image_cache.empty())
+                prune_images();
+}
 
-/* Note that this code is mostly copied to process_incoming_pcterm() below; any non-charset-decoding
- * related changes made here need to be made there, too.
- * FIXMEchpe: refactor this to share more code with process_incoming_pcterm().
+/* The incoming data loop, specialised for each decoder policy.
+ *
+ * A decoder policy wraps a decoder behind one interface:
+ *   decode(&ip, iend, flush): decodes, consuming some of the input up to
+ *     @iend, and returns whether a code point is available (eSomething),
+ *     none is (eNothing), or the decoder needs a reset() (eError). When
+ *     @flush is true, no input is consumed, and any incomplete character
+ *     is flushed.
+ *   codepoint(): the code point decoded.
+ *   reset(): resets the decoder after an error.
+ *   can_pass_ascii(): whether printable ASCII at the current position
+ *     decodes to itself, so that it can bypass the decoder.
  */
+template<class P>
 void
-Terminal::process_incoming_utf8()
+Terminal::process_incoming_decoder(P& decoder)
 {
 	VteVisualPosition saved_cursor;
 	gboolean saved_cursor_visible;
         CursorStyle saved_cursor_style;
-        vte::grid::row_t bbox_top, bbox_bottom;
 	gboolean modified, bottom;
-	gboolean invalidated_text;
-	gboolean in_scroll_region;
 
 	_vte_debug_print(VTE_DEBUG_IO,
                          "Handler processing %" G_GSIZE_FORMAT " bytes over %" G_GSIZE_FORMAT " chunks.\n",
@@ -3363,28 +4531,77 @@ Terminal::process_incoming_utf8()
 
         bottom = m_screen->insert_delta == (long)m_screen->scroll_delta;
 
+        /* Turn the copies of the rows that may change into text now, and
+         * keep the selected text to tell if it changes; the rows above the
+         * screen can only go away, which moves the ring's start past them. */
+        selection_copied_serialize_mutable();
+        auto previous_selection = (GString*)nullptr;
+        if (!m_selection_resolved.empty() &&
+            m_selection_resolved.end_row() >= m_screen->insert_delta - 1)
+                previous_selection = get_selected_text();
+
 	/* Save the current cursor position. */
         saved_cursor = m_screen->cursor;
 	saved_cursor_visible = m_modes_private.DEC_TEXT_CURSOR();
         saved_cursor_style = m_cursor_style;
 
-        in_scroll_region = m_scrolling_restricted
-            && (m_screen->cursor.row >= (m_screen->insert_delta + m_scrolling_region.start))
-            && (m_screen->cursor.row <= (m_screen->insert_delta + m_scrolling_region.end));
-
 	/* We should only be called when there's data to process. */
 	g_assert(!m_incoming_queue.empty());
 
 	modified = FALSE;
-	invalidated_text = FALSE;
-
-        bbox_bottom = -G_MAXINT;
-        bbox_top = G_MAXINT;
 
         vte::parser::Sequence seq{m_parser};
 
         m_line_wrapped = false;
 
+        /* Printable characters are gathered into a run, and inserted
+         * together when something else comes along.
+         */
+        gunichar run[VTE_GRAPHIC_RUN_MAX];
+        size_t run_len = 0;
+        auto flush_run = [&]() {
+                if (run_len == 0)
+                        return;
+
+                size_t n_consumed;
+                auto const rv = m_parser.feed(run, run + run_len, &n_consumed);
+                g_assert_cmpint(rv, ==, VTE_SEQ_GRAPHIC);
+                g_assert_cmpuint(n_consumed, ==, run_len);
+
+                _VTE_DEBUG_IF(VTE_DEBUG_PARSER) {
+                        seq.print();
+                }
+
+                auto const row = m_screen->cursor.row;
+                auto const col = m_screen->cursor.col;
+                auto const insert = m_modes_ecma.IRM();
+
+                {
+                        vte::base::Profile::Scope profile_scope{vte::base::Profile::Stage::eHandler};
+                        insert_chars(run, run_len);
+                }
+                run_len = 0;
+                m_line_wrapped = false;
+
+                _vte_debug_print(VTE_DEBUG_PARSER,
+                                 "Last graphic is now U+%04X %lc\n",
+                                 m_last_graphic_character,
+                                 g_unichar_isprint(m_last_graphic_character) ? m_last_graphic_character : 0xfffd);
+
+                /* Add the cells over which we have moved to the damage
+                 * which we need to refresh for the user. In insert mode,
+                 * the rest of the row moved too. */
+                if (m_screen->cursor.row == row && m_screen->cursor.col >= col)
+                        invalidate_cells_and_context(row, col,
+                                                     insert ? m_column_count : m_screen->cursor.col);
+                else
+                        invalidate_rows_and_context(std::min(row, m_screen->cursor.row),
+                                                    std::max(row, m_screen->cursor.row));
+
+                /* We *don't* emit flush pending signals here. */
+                modified = TRUE;
+        };
+
         size_t bytes_processed = 0;
 
         while (!m_incoming_queue.empty()) {
@@ -3394,307 +4611,61 @@ Terminal::process_incoming_utf8()
                 g_assert_nonnull(chunk.get());
 
                 _VTE_DEBUG_IF(VTE_DEBUG_IO) {
-                        _vte_debug_hexdump("Incoming buffer", chunk->data, chunk->len);
+                        _vte_debug_hexdump("Incoming buffer", chunk->begin_reading(), chunk->len);
                 }
 
                 bytes_processed += chunk->len;
+                m_queued_bytes -= chunk->len;
 
-                auto const* ip = chunk->data;
-                auto const* iend = chunk->data + chunk->len;
-
-                for ( ; ip < iend; ++ip) {
-
-                        switch (m_utf8_decoder.decode(*ip)) {
-                        case vte::base::UTF8Decoder::REJECT_REWIND:
-                                /* Rewind the stream.
-                                 * Note that this will never lead to a loop, since in the
-                                 * next round this byte *will* be consumed.
-                                 */
-                                --ip;
-                                [[fallthrough]];
-                        case vte::base::UTF8Decoder::REJECT:
-                                m_utf8_decoder.reset();
-                                /* Fall through to insert the U+FFFD replacement character. */
-                                [[fallthrough]];
-                        case vte::base::UTF8Decoder::ACCEPT: {
-                                auto rv = m_parser.feed(m_utf8_decoder.codepoint());
-                                if (G_UNLIKELY(rv < 0)) {
-#ifdef DEBUG
-                                        uint32_t c = m_utf8_decoder.codepoint();
-                                        char c_buf[7];
-                                        g_snprintf(c_buf, sizeof(c_buf), "%lc", c);
-                                        char const* wp_str = g_unichar_isprint(c) ? c_buf : _vte_debug_sequence_to_string(c_buf, -1);
-                                        _vte_debug_print(VTE_DEBUG_PARSER, "Parser error on U+%04X [%s]!\n",
-                                                         c, wp_str);
-#endif
-                                        break;
-                                }
+                auto const* ip = chunk->begin_reading();
+                auto const* iend = chunk->end_reading();
 
-#ifdef VTE_DEBUG
-                                if (rv != VTE_SEQ_NONE)
-                                        g_assert((bool)seq);
-#endif
-
-                                _VTE_DEBUG_IF(VTE_DEBUG_PARSER) {
-                                        if (rv != VTE_SEQ_NONE) {
-                                                seq.print();
-                                        }
-                                }
-
-                                // FIXMEchpe this assumes that the only handler inserting
-                                // a character is GRAPHIC, which isn't true (at least ICH, REP, SUB
-                                // also do, and invalidate directly for now)...
-
-                                switch (rv) {
-                                case VTE_SEQ_GRAPHIC: {
-
-                                        bbox_top = std::min(bbox_top,
-                                                            m_screen->cursor.row);
-
-                                        // does insert_char(c, false, false)
-                                        GRAPHIC(seq);
-                                        _vte_debug_print(VTE_DEBUG_PARSER,
-                                                         "Last graphic is now U+%04X %lc\n",
-                                                         m_last_graphic_character,
-                                                         g_unichar_isprint(m_last_graphic_character) ? m_last_graphic_character : 0xfffd);
-
-                                        if (m_line_wrapped) {
-                                                m_line_wrapped = false;
-                                                /* line wrapped, correct bbox */
-                                                if (invalidated_text &&
-                                                    (m_screen->cursor.row > bbox_bottom + VTE_CELL_BBOX_SLACK ||
-                                                     m_screen->cursor.row < bbox_top - VTE_CELL_BBOX_SLACK)) {
-                                                        invalidate_rows_and_context(bbox_top, bbox_bottom);
-                                                        bbox_bottom = -G_MAXINT;
-                                                        bbox_top = G_MAXINT;
-                                                }
-                                                bbox_top = std::min(bbox_top,
-                                                                    m_screen->cursor.row);
-                                        }
-                                        /* Add the cells over which we have moved to the region
-                                         * which we need to refresh for the user. */
-                                        bbox_bottom = std::max(bbox_bottom,
-                                                               m_screen->cursor.row);
-                                        invalidated_text = TRUE;
-
-                                        /* We *don't* emit flush pending signals here. */
-                                        modified = TRUE;
-
-                                        break;
-                                }
-
-                                case VTE_SEQ_NONE:
-                                case VTE_SEQ_IGNORE:
-                                        break;
-
-                                default: {
-                                        switch (seq.command()) {
-#define _VTE_CMD(cmd)   case VTE_CMD_##cmd: cmd(seq); break;
-#define _VTE_NOP(cmd)
-#include "parser-cmd.hh"
-#undef _VTE_CMD
-#undef _VTE_NOP
-                                        default:
-                                                _vte_debug_print(VTE_DEBUG_PARSER,
-                                                                 "Unknown parser command %d\n", seq.command());
-                                                break;
-                                        }
+                auto eos = bool{false};
+                auto flush = bool{false};
 
-                                        m_last_graphic_character = 0;
+        start:
+                while (ip < iend || flush) {
 
-                                        modified = TRUE;
+                        /* Fast path: insert runs of printable ASCII directly,
+                         * bypassing the decoder and the parser, as long as both are
+                         * in their ground state and the run fits on the current row.
+                         */
+                        if (!flush &&
+                            *ip >= 0x20 && *ip < 0x7f &&
+                            m_parser.is_ground() &&
+                            decoder.can_pass_ascii() &&
+                            can_insert_printable_ascii()) {
+                                flush_run();
 
-                                        // FIXME m_screen may be != previous_screen, check for that!
+                                vte::base::Profile::Scope profile_scope{vte::base::Profile::Stage::eHandler};
 
-                                        gboolean new_in_scroll_region = m_scrolling_restricted
-                                                && (m_screen->cursor.row >= (m_screen->insert_delta + m_scrolling_region.start))
-                                                && (m_screen->cursor.row <= (m_screen->insert_delta + m_scrolling_region.end));
+                                auto const col = m_screen->cursor.col;
+                                auto const avail = size_t(m_column_count - col);
+                                auto const run_end = vte::base::find_printable_ascii_end(ip, ip + std::min(avail, size_t(iend - ip)));
+                                auto const n = insert_printable_ascii(ip, run_end - ip);
 
-                                        /* if we have moved greatly during the sequence handler, or moved
-                                         * into a scroll_region from outside it, restart the bbox.
-                                         */
-                                        if (invalidated_text &&
-                                            ((new_in_scroll_region && !in_scroll_region) ||
-                                             (m_screen->cursor.row > bbox_bottom + VTE_CELL_BBOX_SLACK ||
-                                              m_screen->cursor.row < bbox_top - VTE_CELL_BBOX_SLACK))) {
-                                                invalidate_rows_and_context(bbox_top, bbox_bottom);
-                                                invalidated_text = FALSE;
-                                                bbox_bottom = -G_MAXINT;
-                                                bbox_top = G_MAXINT;
-                                        }
+                                invalidate_cells_and_context(m_screen->cursor.row, col, m_screen->cursor.col);
+                                modified = TRUE;
 
-                                        in_scroll_region = new_in_scroll_region;
+                                ip += n;
+                                continue;
+                        }
 
+                        switch (decoder.decode(&ip, iend, flush)) {
+                        case DecodeResult::eSomething: {
+                                auto const c = decoder.codepoint();
+                                if (m_parser.is_graphic(c)) {
+                                        run[run_len++] = c;
+                                        if (run_len == G_N_ELEMENTS(run))
+                                                flush_run();
                                         break;
                                 }
-                                }
-                                break;
-                        }
-                        }
-                }
-
-                if (chunk->eos()) {
-                        m_eos_pending = true;
-                        /* If there's an unfinished character in the queue, insert a replacement character */
-                        if (m_utf8_decoder.flush()) {
-                                insert_char(m_utf8_decoder.codepoint(), false, true);
-                        }
-
-                        break;
-                }
-        }
-
-#ifdef VTE_DEBUG
-		/* Some safety checks: ensure the visible parts of the buffer
-		 * are all in the buffer. */
-		g_assert_cmpint(m_screen->insert_delta, >=, _vte_ring_delta(m_screen->row_data));
-
-		/* The cursor shouldn't be above or below the addressable
-		 * part of the display buffer. */
-                g_assert_cmpint(m_screen->cursor.row, >=, m_screen->insert_delta);
-#endif
-
-	if (modified) {
-		/* Keep the cursor on-screen if we scroll on output, or if
-		 * we're currently at the bottom of the buffer. */
-		update_insert_delta();
-		if (m_scroll_on_output || bottom) {
-			maybe_scroll_to_bottom();
-		}
-		/* Deselect the current selection if its contents are changed
-		 * by this insertion. */
-                if (!m_selection_resolved.empty()) {
-                        //FIXMEchpe: this is atrocious
-			auto selection = get_selected_text();
-			if ((selection == nullptr) ||
-			    (m_selection[VTE_SELECTION_PRIMARY] == nullptr) ||
-			    (strcmp(selection->str, m_selection[VTE_SELECTION_PRIMARY]->str) != 0)) {
-				deselect_all();
-			}
-                        if (selection)
-                                g_string_free(selection, TRUE);
-		}
-	}
-
-	if (modified || (m_screen != previous_screen)) {
-                m_ringview.invalidate();
-		/* Signal that the visible contents changed. */
-		queue_contents_changed();
-	}
-
-	emit_pending_signals();
-
-	if (invalidated_text) {
-                invalidate_rows_and_context(bbox_top, bbox_bottom);
-	}
-
-        if ((saved_cursor.col != m_screen->cursor.col) ||
-            (saved_cursor.row != m_screen->cursor.row)) {
-		/* invalidate the old and new cursor positions */
-		if (saved_cursor_visible)
-                        invalidate_row(saved_cursor.row);
-		invalidate_cursor_once();
-		check_cursor_blink();
-		/* Signal that the cursor moved. */
-		queue_cursor_moved();
-        } else if ((saved_cursor_visible != m_modes_private.DEC_TEXT_CURSOR()) ||
-                   (saved_cursor_style != m_cursor_style)) {
-                invalidate_row(saved_cursor.row);
-		check_cursor_blink();
-	}
-
-	/* Tell the input method where the cursor is. */
-        im_update_cursor();
-
-        /* After processing some data, do a hyperlink GC. The multiplier is totally arbitrary, feel free to fine tune. */
-        _vte_ring_hyperlink_maybe_gc(m_screen->row_data, bytes_processed * 8);
-
-	_vte_debug_print (VTE_DEBUG_WORK, ")");
-	_vte_debug_print (VTE_DEBUG_IO,
-                          "%" G_GSIZE_FORMAT " bytes in %" G_GSIZE_FORMAT " chunks left to process.\n",
-                          m_input_bytes,
-                          m_incoming_queue.size());
-}
 
-#ifdef WITH_ICU
-
-/* Note that this is mostly a copy of process_incoming_utf8() above; any non-charset-decoding
- * related changes made here need to be made there, too.
- * FIXMEchpe: refactor this to share more code with process_incoming_utf8().
- */
-void
-Terminal::process_incoming_pcterm()
-{
-	VteVisualPosition saved_cursor;
-	gboolean saved_cursor_visible;
-        CursorStyle saved_cursor_style;
-        vte::grid::row_t bbox_top, bbox_bottom;
-	gboolean modified, bottom;
-	gboolean invalidated_text;
-	gboolean in_scroll_region;
-
-	_vte_debug_print(VTE_DEBUG_IO,
-                         "Handler processing %" G_GSIZE_FORMAT " bytes over %" G_GSIZE_FORMAT " chunks.\n",
-                         m_input_bytes,
-                         m_incoming_queue.size());
-	_vte_debug_print (VTE_DEBUG_WORK, "(");
-
-        auto previous_screen = m_screen;
-
-        bottom = m_screen->insert_delta == (long)m_screen->scroll_delta;
-
-	/* Save the current cursor position. */
-        saved_cursor = m_screen->cursor;
-	saved_cursor_visible = m_modes_private.DEC_TEXT_CURSOR();
-        saved_cursor_style = m_cursor_style;
-
-        in_scroll_region = m_scrolling_restricted
-            && (m_screen->cursor.row >= (m_screen->insert_delta + m_scrolling_region.start))
-            && (m_screen->cursor.row <= (m_screen->insert_delta + m_scrolling_region.end));
-
-	/* We should only be called when there's data to process. */
-	g_assert(!m_incoming_queue.empty());
-
-	modified = FALSE;
-	invalidated_text = FALSE;
-
-        bbox_bottom = -G_MAXINT;
-        bbox_top = G_MAXINT;
-
-        vte::parser::Sequence seq{m_parser};
-
-        m_line_wrapped = false;
-
-        size_t bytes_processed = 0;
-
-        auto& decoder = m_converter->decoder();
-
-        while (!m_incoming_queue.empty()) {
-                auto chunk = std::move(m_incoming_queue.front());
-                m_incoming_queue.pop();
-
-                g_assert_nonnull(chunk.get());
-
-                _VTE_DEBUG_IF(VTE_DEBUG_IO) {
-                        _vte_debug_hexdump("Incoming buffer", chunk->data, chunk->len);
-                }
-
-                bytes_processed += chunk->len;
-
-                auto const* ip = chunk->data;
-                auto const* iend = chunk->data + chunk->len;
-
-                auto eos = bool{false};
-                auto flush = bool{false};
+                                flush_run();
 
-        start:
-                while (ip < iend || flush) {
-                        switch (decoder.decode(&ip, flush)) {
-                        case vte::base::ICUDecoder::Result::eSomething: {
-                                auto rv = m_parser.feed(decoder.codepoint());
+                                auto rv = m_parser.feed(c);
                                 if (G_UNLIKELY(rv < 0)) {
 #ifdef VTE_DEBUG
-                                        uint32_t c = decoder.codepoint();
                                         char c_buf[7];
                                         g_snprintf(c_buf, sizeof(c_buf), "%lc", c);
                                         char const* wp_str = g_unichar_isprint(c) ? c_buf : _vte_debug_sequence_to_string(c_buf, -1);
@@ -3720,48 +4691,19 @@ Terminal::process_incoming_pcterm()
                                 // also do, and invalidate directly for now)...
 
                                 switch (rv) {
-                                case VTE_SEQ_GRAPHIC: {
-
-                                        bbox_top = std::min(bbox_top,
-                                                            m_screen->cursor.row);
-
-                                        // does insert_char(c, false, false)
-                                        GRAPHIC(seq);
-                                        _vte_debug_print(VTE_DEBUG_PARSER,
-                                                         "Last graphic is now U+%04X %lc\n",
-                                                         m_last_graphic_character,
-                                                         g_unichar_isprint(m_last_graphic_character) ? m_last_graphic_character : 0xfffd);
-
-                                        if (m_line_wrapped) {
-                                                m_line_wrapped = false;
-                                                /* line wrapped, correct bbox */
-                                                if (invalidated_text &&
-                                                    (m_screen->cursor.row > bbox_bottom + VTE_CELL_BBOX_SLACK ||
-                                                     m_screen->cursor.row < bbox_top - VTE_CELL_BBOX_SLACK)) {
-                                                        invalidate_rows_and_context(bbox_top, bbox_bottom);
-                                                        bbox_bottom = -G_MAXINT;
-                                                        bbox_top = G_MAXINT;
-                                                }
-                                                bbox_top = std::min(bbox_top,
-                                                                    m_screen->cursor.row);
-                                        }
-                                        /* Add the cells over which we have moved to the region
-                                         * which we need to refresh for the user. */
-                                        bbox_bottom = std::max(bbox_bottom,
-                                                               m_screen->cursor.row);
-                                        invalidated_text = TRUE;
-
-                                        /* We *don't* emit flush pending signals here. */
-                                        modified = TRUE;
-
+                                case VTE_SEQ_GRAPHIC:
+                                        /* Printable characters go into the run above */
+                                        g_assert_not_reached();
                                         break;
-                                }
 
                                 case VTE_SEQ_NONE:
                                 case VTE_SEQ_IGNORE:
                                         break;
 
                                 default: {
+                                        vte::base::Profile::Scope profile_scope{vte::base::Profile::Stage::eHandler};
+                                        m_frame_stats.add(vte::base::FrameStats::Counter::eSequences);
+
                                         switch (seq.command()) {
 #define _VTE_CMD(cmd)   case VTE_CMD_##cmd: cmd(seq); break;
 #define _VTE_NOP(cmd)
@@ -3780,42 +4722,23 @@ Terminal::process_incoming_pcterm()
 
                                         // FIXME m_screen may be != previous_screen, check for that!
 
-                                        gboolean new_in_scroll_region = m_scrolling_restricted
-                                                && (m_screen->cursor.row >= (m_screen->insert_delta + m_scrolling_region.start))
-                                                && (m_screen->cursor.row <= (m_screen->insert_delta + m_scrolling_region.end));
-
-                                        /* if we have moved greatly during the sequence handler, or moved
-                                         * into a scroll_region from outside it, restart the bbox.
-                                         */
-                                        if (invalidated_text &&
-                                            ((new_in_scroll_region && !in_scroll_region) ||
-                                             (m_screen->cursor.row > bbox_bottom + VTE_CELL_BBOX_SLACK ||
-                                              m_screen->cursor.row < bbox_top - VTE_CELL_BBOX_SLACK))) {
-                                                invalidate_rows_and_context(bbox_top, bbox_bottom);
-                                                invalidated_text = FALSE;
-                                                bbox_bottom = -G_MAXINT;
-                                                bbox_top = G_MAXINT;
-                                        }
-
-                                        in_scroll_region = new_in_scroll_region;
-
                                         break;
                                 }
                                 }
                                 break;
                         }
-                        case vte::base::ICUDecoder::Result::eNothing:
+                        case DecodeResult::eNothing:
                                 flush = false;
                                 break;
 
-                        case vte::base::ICUDecoder::Result::eError:
-                                // FIXMEchpe do we need ++ip here?
+                        case DecodeResult::eError:
                                 decoder.reset();
                                 break;
-
                         }
                 }
 
+                flush_run();
+
                 if (eos) {
                         /* Done processing the last chunk */
                         m_eos_pending = true;
@@ -3849,30 +4772,27 @@ Terminal::process_incoming_pcterm()
 		/* Deselect the current selection if its contents are changed
 		 * by this insertion. */
                 if (!m_selection_resolved.empty()) {
-                        //FIXMEchpe: this is atrocious
-			auto selection = get_selected_text();
-			if ((selection == nullptr) ||
-			    (m_selection[VTE_SELECTION_PRIMARY] == nullptr) ||
-			    (strcmp(selection->str, m_selection[VTE_SELECTION_PRIMARY]->str) != 0)) {
+                        if (m_screen != previous_screen ||
+                            m_selection_resolved.start_row() < _vte_ring_delta(m_screen->row_data)) {
 				deselect_all();
-			}
-                        if (selection)
+                        } else if (previous_selection != nullptr) {
+                                auto selection = get_selected_text();
+                                if (!g_string_equal(selection, previous_selection))
+                                        deselect_all();
                                 g_string_free(selection, TRUE);
+                        }
 		}
 	}
 
+        if (previous_selection != nullptr)
+                g_string_free(previous_selection, TRUE);
+
 	if (modified || (m_screen != previous_screen)) {
                 m_ringview.invalidate();
 		/* Signal that the visible contents changed. */
 		queue_contents_changed();
 	}
 
-	emit_pending_signals();
-
-	if (invalidated_text) {
-                invalidate_rows_and_context(bbox_top, bbox_bottom);
-	}
-
         if ((saved_cursor.col != m_screen->cursor.col) ||
             (saved_cursor.row != m_screen->cursor.row)) {
 		/* invalidate the old and new cursor positions */
@@ -3894,6 +4814,11 @@ Terminal::process_incoming_pcterm()
         /* After processing some data, do a hyperlink GC. The multiplier is totally arbitrary, feel free to fine tune. */
         _vte_ring_hyperlink_maybe_gc(m_screen->row_data, bytes_processed * 8);
 
+        m_frame_stats.add(vte::base::FrameStats::Counter::eBytes, bytes_processed);
+
+        if (bytes_processed != 0 && m_input_latency.waiting_for_process())
+                m_input_latency.processed(g_get_monotonic_time());
+
 	_vte_debug_print (VTE_DEBUG_WORK, ")");
 	_vte_debug_print (VTE_DEBUG_IO,
                           "%" G_GSIZE_FORMAT " bytes in %" G_GSIZE_FORMAT " chunks left to process.\n",
@@ -3901,7 +4826,6 @@ Terminal::process_incoming_pcterm()
                           m_incoming_queue.size());
 }
 
-#endif /* WITH_ICU */
 
 bool
 Terminal::pty_io_read(int const fd,
@@ -3939,13 +4863,8 @@ Terminal::pty_io_read(int const fd,
 		 *    maximum number of bytes we can read/process in between
 		 *    updates.
 		 */
-		max_bytes = m_active_terminals_link != nullptr ?
-		            g_list_length(g_active_terminals) - 1 : 0;
-		if (max_bytes) {
-			max_bytes = m_max_input_bytes / max_bytes;
-		} else {
-			max_bytes = m_max_input_bytes;
-		}
+		max_bytes = m_scheduler_entry.is_scheduled() ?
+                        m_scheduler_entry.allowance() : m_max_input_bytes;
 		bytes = m_input_bytes;
 
                 /* If possible, try adding more data to the chunk at the back of the queue */
@@ -3962,80 +4881,129 @@ Terminal::pty_io_read(int const fd,
                                 chunk = m_incoming_queue.back().get();
 			}
 
-			rem = chunk->remaining_capacity();
-			bp = chunk->data + chunk->len;
-			len = 0;
-			do {
-                                /* We'd like to read (fd, bp, rem); but due to TIOCPKT mode
-                                 * there's an extra input byte returned at the beginning.
-                                 * We need to see what that byte is, but otherwise drop it
-                                 * and write continuously to chunk->data.
-                                 */
-                                char pkt_header;
-                                char save = bp[-1];
-                                errno = 0;
-                                int ret = read (fd, bp - 1, rem + 1);
-                                pkt_header = bp[-1];
-                                bp[-1] = save;
-				switch (ret){
-					case -1:
-						err = errno;
-						goto out;
-					case 0:
-						eos = true;
-						goto out;
-					default:
-                                                ret--;
-
-                                                if (pkt_header == TIOCPKT_DATA) {
-                                                        bp += ret;
-                                                        rem -= ret;
-                                                        len += ret;
-                                                } else {
-                                                        if (pkt_header & TIOCPKT_IOCTL) {
-                                                                /* We'd like to always be informed when the termios change,
-                                                                 * so we can e.g. detect when no-echo is en/disabled and
-                                                                 * change the cursor/input method/etc., but unfortunately
-                                                                 * the kernel only sends this flag when (old or new) 'local flags'
-                                                                 * include EXTPROC, which is not used often, and due to its side
-                                                                 * effects, cannot be enabled by vte by default.
-                                                                 *
-                                                                 * FIXME: improve the kernel! see discussion in bug 755371
-                                                                 * starting at comment 12
-                                                                 */
-                                                                pty_termios_changed();
-                                                        }
-                                                        if (pkt_header & TIOCPKT_STOP) {
-                                                                pty_scroll_lock_changed(true);
-                                                        }
-                                                        if (pkt_header & TIOCPKT_START) {
-                                                                pty_scroll_lock_changed(false);
-                                                        }
-                                                }
-						break;
-				}
-			} while (rem);
-out:
-			chunk->len += len;
-			bytes += len;
-		} while (bytes < max_bytes &&
-		         chunk->len == chunk->capacity());
+                        /* Read into the rest of this chunk and, when the output is
+                         * coming in fast, into some fresh chunks too, all with one
+                         * readv(). Due to TIOCPKT mode there's an extra input byte
+                         * returned at the beginning. We need to see what that byte
+                         * is, but otherwise drop it and write continuously to
+                         * chunk->data.
+                         */
+                        struct iovec iov[VTE_MAX_READ_BATCH];
+                        vte::base::Chunk::unique_type spare[VTE_MAX_READ_BATCH];
+                        bp = chunk->data + chunk->len;
+                        rem = chunk->remaining_capacity();
+                        iov[0].iov_base = bp - 1;
+                        iov[0].iov_len = rem + 1;
+                        auto space = size_t(rem);
+                        auto n_iov = 1u;
+                        for ( ; n_iov < m_pty_read_batch; ++n_iov) {
+                                spare[n_iov] = vte::base::Chunk::get();
+                                iov[n_iov].iov_base = spare[n_iov]->data;
+                                iov[n_iov].iov_len = spare[n_iov]->capacity();
+                                space += iov[n_iov].iov_len;
+                        }
+
+                        char pkt_header;
+                        char save = bp[-1];
+                        errno = 0;
+                        auto ret = readv(fd, iov, n_iov);
+                        pkt_header = bp[-1];
+                        bp[-1] = save;
+                        ++m_pty_read_syscalls;
+
+                        if (ret == -1) {
+                                err = errno;
+                                break;
+                        }
+                        if (ret == 0) {
+                                eos = true;
+                                break;
+                        }
+
+                        ret--;
+                        if (pkt_header != TIOCPKT_DATA) {
+                                if (pkt_header & TIOCPKT_IOCTL) {
+                                        /* We'd like to always be informed when the termios change,
+                                         * so we can e.g. detect when no-echo is en/disabled and
+                                         * change the cursor/input method/etc., but unfortunately
+                                         * the kernel only sends this flag when (old or new) 'local flags'
+                                         * include EXTPROC, which is not used often, and due to its side
+                                         * effects, cannot be enabled by vte by default.
+                                         *
+                                         * FIXME: improve the kernel! see discussion in bug 755371
+                                         * starting at comment 12
+                                         */
+                                        pty_termios_changed();
+                                }
+                                if (pkt_header & TIOCPKT_STOP) {
+                                        pty_scroll_lock_changed(true);
+                                }
+                                if (pkt_header & TIOCPKT_START) {
+                                        pty_scroll_lock_changed(false);
+                                }
+                                continue;
+                        }
+
+                        bytes += ret;
+                        m_pty_read_bytes += ret;
+
+                        /* Grow the batch while reads fill all the space offered,
+                         * and shrink it back when they fit into the first chunk.
+                         */
+                        if (size_t(ret) == space)
+                                m_pty_read_batch = std::min(m_pty_read_batch * 2, unsigned{VTE_MAX_READ_BATCH});
+                        else if (ret < rem && m_pty_read_batch > 1)
+                                m_pty_read_batch /= 2;
+
+                        /* Distribute the data over the chunks, queueing the spare
+                         * chunks that got some; the others are recycled.
+                         */
+                        len = std::min<ssize_t>(ret, rem);
+                        chunk->len += len;
+                        ret -= len;
+                        for (auto i = 1u; ret > 0 && i < n_iov; ++i) {
+                                chunk = spare[i].get();
+                                chunk->len = std::min<ssize_t>(ret, chunk->capacity());
+                                ret -= chunk->len;
+                                m_incoming_queue.push(std::move(spare[i]));
+                        }
+		} while (bytes < max_bytes);
 
                 /* We may have an empty chunk at the back of the queue, but
                  * that doesn't matter, we'll fill it next time.
                  */
 
-		if (!is_processing()) {
-			add_process_timeout(this);
-		}
-		m_pty_input_active = len != 0;
+		m_pty_input_active = bytes != m_input_bytes;
+                if (m_pty_input_active && m_input_latency.waiting_for_read())
+                        m_input_latency.read(g_get_monotonic_time());
+                m_queued_bytes += bytes - m_input_bytes;
 		m_input_bytes = bytes;
 		again = bytes < max_bytes;
 
-		_vte_debug_print (VTE_DEBUG_IO, "read %d/%d bytes, again? %s, active? %s\n",
+                update_input_throttle();
+                if (m_input_throttled)
+                        again = false;
+
+                if (eos || !m_pty_input_active || !process_echo()) {
+                        if (!is_processing())
+                                add_process_timeout(this);
+                }
+
+		_vte_debug_print (VTE_DEBUG_IO, "read %d/%d bytes, %" G_GSIZE_FORMAT " queued, again? %s, active? %s\n",
 				bytes, max_bytes,
+                                m_queued_bytes,
 				again ? "yes" : "no",
 				m_pty_input_active ? "yes" : "no");
+
+                _VTE_DEBUG_IF(VTE_DEBUG_IO) {
+                        if (m_pty_read_bytes >= 1024 * 1024) {
+                                g_printerr("PTY read: %.1f syscalls/MB, batch %u\n",
+                                           m_pty_read_syscalls * 1024. * 1024. / m_pty_read_bytes,
+                                           m_pty_read_batch);
+                                m_pty_read_syscalls = 0;
+                                m_pty_read_bytes = 0;
+                        }
+                }
 	}
 
         if (condition & G_IO_ERR)
@@ -4084,22 +5052,231 @@ out:
 	return again;
 }
 
-/*
- * Terminal::feed:
- * @data: data
- *
- * Interprets @data as if it were data received from a child process.
+/* Moves the chunks the PTY reader thread has read into the incoming queue;
+ * all of them if @force, otherwise only up to the input queue limit, so that
+ * the reader thread blocks and the child with it.
  */
 void
-Terminal::feed(std::string_view const& data,
-               bool start_processing_)
-{
-        auto length = data.size();
-        auto ptr = data.data();
+Terminal::pty_reader_drain(bool force)
+{
+        auto const flags = m_pty_reader->take_packet_flags();
+        if (flags & vte::base::PtyReader::eTERMIOS_CHANGED)
+                pty_termios_changed();
+        if (flags & vte::base::PtyReader::eSCROLL_LOCKED)
+                pty_scroll_lock_changed(true);
+        if (flags & vte::base::PtyReader::eSCROLL_UNLOCKED)
+                pty_scroll_lock_changed(false);
+
+        auto n_chunks = size_t{0};
+        auto eos = bool{false};
+        while (force || !m_input_throttled) {
+                auto chunk = m_pty_reader->pop();
+                if (!chunk)
+                        break;
 
-        vte::base::Chunk* chunk = nullptr;
-        if (!m_incoming_queue.empty()) {
-                auto& achunk = m_incoming_queue.back();
+                m_input_bytes += chunk->len;
+                m_queued_bytes += chunk->len;
+                eos |= chunk->eos();
+                m_incoming_queue.push(std::move(chunk));
+                ++n_chunks;
+
+                if (!force)
+                        update_input_throttle();
+        }
+
+        _vte_debug_print(VTE_DEBUG_IO, "PTY reader delivered %" G_GSIZE_FORMAT " chunks, %" G_GSIZE_FORMAT " queued, eos? %s\n",
+                         n_chunks, m_queued_bytes, eos ? "yes" : "no");
+
+        if (n_chunks == 0)
+                return;
+
+        /* The time the reader thread read it would be more exact */
+        if (m_input_latency.waiting_for_read())
+                m_input_latency.read(g_get_monotonic_time());
+
+        if (eos) {
+		_vte_debug_print(VTE_DEBUG_IO, "got PTY EOF\n");
+
+                /* Cancel wait timer */
+                m_child_exited_eos_wait_timer.abort();
+        } else if (!force && process_echo()) {
+                return;
+        }
+
+        if (!is_processing())
+                add_process_timeout(this);
+}
+
+/* Stops reading from the PTY while more than m_input_queue_limit bytes
+ * are queued for processing, so that the child blocks in the kernel,
+ * and resumes once the queue is down to half of that.
+ */
+void
+Terminal::update_input_throttle()
+{
+        if (!m_input_throttled) {
+                if (m_input_queue_limit == 0 ||
+                    m_queued_bytes <= m_input_queue_limit)
+                        return;
+
+                _vte_debug_print(VTE_DEBUG_IO, "%" G_GSIZE_FORMAT " bytes queued, pausing PTY reads\n",
+                                 m_queued_bytes);
+
+                m_input_throttled = true;
+                if (m_pty_reader) {
+                        /* Keep the thread; it stops once its queue is full */
+                        if (m_pty_input_source != 0) {
+                                g_source_remove(m_pty_input_source);
+                                m_pty_input_source = 0;
+                        }
+                } else {
+                        disconnect_pty_read();
+                }
+                return;
+        }
+
+        if (m_input_queue_limit != 0 &&
+            m_queued_bytes > m_input_queue_limit / 2)
+                return;
+
+        _vte_debug_print(VTE_DEBUG_IO, "%" G_GSIZE_FORMAT " bytes queued, resuming PTY reads\n",
+                         m_queued_bytes);
+
+        m_input_throttled = false;
+        connect_pty_read();
+
+        /* Pick up what the reader thread read while we weren't watching */
+        if (m_pty_reader)
+                pty_reader_drain();
+}
+
+/* A headless terminal is never drawn, so it does no invalidation, keeps
+ * no adjustments up to date, and doesn't blink, beep or talk to the input
+ * method; it can be used to run the emulation on data from feed() without
+ * a main loop, and read back the results with get_text_range().
+ * Realizing the widget ends headless mode.
+ */
+bool
+Terminal::set_headless(bool headless)
+{
+        if (headless == m_headless)
+                return false;
+
+        if (headless && widget_realized())
+                return false;
+
+        m_headless = headless;
+        if (m_headless) {
+                remove_cursor_timeout();
+                reset_update_rects();
+                if (!m_incoming_queue.empty()) {
+                        process_incoming();
+                        m_input_bytes = 0;
+                        emit_pending_signals();
+                }
+        } else {
+                /* Catch up on what was skipped */
+                m_adjustment_changed_pending = true;
+                m_adjustment_value_changed_pending = true;
+                if (!m_incoming_queue.empty())
+                        start_processing();
+                else
+                        add_update_timeout(this);
+                check_cursor_blink();
+        }
+
+        return true;
+}
+
+/* A background terminal is unmapped, e.g. in a hidden tab: it processes
+ * with a larger budget, and skips the invalidation, the drawing and the
+ * accessibility updates. Everything is invalidated once it's mapped again.
+ */
+void
+Terminal::set_background(bool background) noexcept
+{
+        if (background == m_background)
+                return;
+
+        _vte_debug_print(VTE_DEBUG_UPDATES, "%s background mode\n",
+                         background ? "Entering" : "Leaving");
+
+        m_background = background;
+        if (m_background) {
+                /* Whatever changes, the whole view gets painted when shown,
+                 * so the invalidation functions have nothing to do. */
+                reset_update_rects();
+                m_invalidated_all = true;
+                m_frame_valid = false;
+        } else {
+                m_invalidated_all = false;
+                invalidate_all();
+
+                /* Run an update, to emit the signals that were held back */
+                add_update_timeout(this);
+        }
+}
+
+bool
+Terminal::set_resize_delay(unsigned int delay)
+{
+        if (delay == m_resize_delay)
+                return false;
+
+        m_resize_delay = delay;
+
+        /* Apply a size held back by the old delay now */
+        if (delay == 0 && m_resize_timer) {
+                m_resize_timer.abort();
+                resize_timer_callback();
+        }
+
+        return true;
+}
+
+bool
+Terminal::set_input_queue_limit(unsigned int limit)
+{
+        if (limit == m_input_queue_limit)
+                return false;
+
+        m_input_queue_limit = limit;
+        update_input_throttle();
+
+        return true;
+}
+
+bool
+Terminal::pty_reader_ready()
+{
+	_vte_debug_print (VTE_DEBUG_WORK, ".");
+
+        m_pty_reader->acknowledge();
+        pty_reader_drain();
+
+        /* Keep the source even after EOS; the reader thread has exited then
+         * and the notification fd won't become readable again. The source
+         * is removed when the PTY is unset after the EOS has been processed.
+         */
+        return true;
+}
+
+/*
+ * Terminal::feed:
+ * @data: data
+ *
+ * Interprets @data as if it were data received from a child process.
+ */
+void
+Terminal::feed(std::string_view const& data,
+               bool start_processing_)
+{
+        auto length = data.size();
+        auto ptr = data.data();
+
+        vte::base::Chunk* chunk = nullptr;
+        if (!m_incoming_queue.empty()) {
+                auto& achunk = m_incoming_queue.back();
                 if (length < achunk->remaining_capacity() && !achunk->sealed())
                         chunk = achunk.get();
         }
@@ -4125,6 +5302,54 @@ Terminal::feed(std::string_view const& data,
                 chunk = m_incoming_queue.back().get();
         } while (true);
 
+        m_queued_bytes += data.size();
+
+        feed_queued(start_processing_);
+}
+
+/* Queues @bytes by reference instead of copying them into chunks, unless
+ * it's so small that a copy is cheaper than a chunk of its own.
+ */
+void
+Terminal::feed(GBytes* bytes,
+               bool start_processing_)
+{
+        auto size = gsize{0};
+        auto data = reinterpret_cast<uint8_t const*>(g_bytes_get_data(bytes, &size));
+        if (size == 0)
+                return;
+
+        if (size <= VTE_FEED_BYTES_COPY_MAX) {
+                feed({reinterpret_cast<char const*>(data), size}, start_processing_);
+                return;
+        }
+
+        do {
+                auto const len = unsigned(std::min(size, gsize{G_MAXUINT}));
+                m_incoming_queue.push(vte::base::Chunk::get_external(data, len,
+                                                                     [](void* b) { g_bytes_unref(reinterpret_cast<GBytes*>(b)); },
+                                                                     g_bytes_ref(bytes)));
+                m_queued_bytes += len;
+                data += len;
+                size -= len;
+        } while (size > 0);
+
+        feed_queued(start_processing_);
+}
+
+void
+Terminal::feed_queued(bool start_processing_)
+{
+        /* Without a display to update there's no need to wait for the
+         * process timeout; process everything right away.
+         */
+        if (m_headless) {
+                process_incoming();
+                m_input_bytes = 0;
+                emit_pending_signals();
+                return;
+        }
+
         if (start_processing_)
                 start_processing();
 }
@@ -4133,20 +5358,25 @@ bool
 Terminal::pty_io_write(int const fd,
                        GIOCondition const condition)
 {
-        auto const count = write(fd,
-                                 m_outgoing->data,
-                                 _vte_byte_array_length(m_outgoing));
-	if (count != -1) {
+        auto const count = m_outgoing.write(fd);
+	if (count > 0) {
 		_VTE_DEBUG_IF (VTE_DEBUG_IO) {
-                        _vte_debug_hexdump("Outgoing buffer written",
-                                           (uint8_t const*)m_outgoing->data,
-                                           count);
+                        m_outgoing.peek(count, [](uint8_t const* data, size_t len) {
+                                _vte_debug_hexdump("Outgoing buffer written", data, len);
+                        });
 		}
-		_vte_byte_array_consume(m_outgoing, count);
+		m_outgoing.consume(count);
+
+                if (m_input_latency.waiting_for_write())
+                        m_input_latency.written(g_get_monotonic_time());
 	}
 
+        /* Queue more of a paste in progress */
+        if (m_paste.pasting() && m_outgoing.size() < VTE_PASTE_QUEUE_HIGH_WATER / 2)
+                paste_continue();
+
         /* Run again if there are more bytes to write */
-        return _vte_byte_array_length(m_outgoing) != 0;
+        return !m_outgoing.empty();
 }
 
 /* Send some UTF-8 data to the child. */
@@ -4162,17 +5392,33 @@ Terminal::send_child(std::string_view const& data)
         if (!pty())
                 return;
 
+        /* Behind all of the paste in progress, so as not to end up in it */
+        if (m_paste.pasting() && !m_paste_continuing)
+                paste_continue(true);
+
+        m_last_input_time = g_get_monotonic_time();
+        m_low_latency = true;
+
+        /* Input for a key press starts its latency measurement */
+        if (m_key_press_time != 0) {
+                m_input_latency.key_pressed(m_key_press_time);
+                m_key_press_time = 0;
+        }
+
         switch (data_syntax()) {
         case DataSyntax::eECMA48_UTF8:
                 emit_commit(data);
-                _vte_byte_array_append(m_outgoing, data.data(), data.size());
+                m_outgoing.append(data.data(), data.size());
                 break;
 
         case DataSyntax::eECMA48_PCTERM: {
-                auto converted = m_converter->convert(data);
+                /* This is the converter's buffer, which a commit handler
+                 * sending input would reuse; so queue it first.
+                 */
+                auto const converted = m_converter->convert(data);
 
+                m_outgoing.append(converted.data(), converted.size());
                 emit_commit(converted);
-                _vte_byte_array_append(m_outgoing, converted.data(), converted.size());
                 break;
         }
 
@@ -4223,8 +5469,15 @@ Terminal::feed_child_binary(std::string_view const& data)
         if (!pty())
                 return;
 
+        /* See send_child() */
+        if (m_paste.pasting() && !m_paste_continuing)
+                paste_continue(true);
+
+        m_last_input_time = g_get_monotonic_time();
+        m_low_latency = true;
+
         emit_commit(data);
-        _vte_byte_array_append(m_outgoing, data.data(), data.size());
+        m_outgoing.append(data.data(), data.size());
 
         /* If we need to start waiting for the child pty to
          * become available for writing, set that up here. */
@@ -4472,7 +5725,8 @@ Terminal::remove_cursor_timeout()
 void
 Terminal::check_cursor_blink()
 {
-	if (m_has_focus &&
+	if (!m_headless &&
+            m_has_focus &&
 	    m_cursor_blinks &&
 	    m_modes_private.DEC_TEXT_CURSOR())
 		add_cursor_timeout();
@@ -4483,7 +5737,7 @@ Terminal::check_cursor_blink()
 void
 Terminal::beep()
 {
-	if (m_audible_bell)
+	if (m_audible_bell && !m_headless)
                 m_real_widget->beep();
 }
 
@@ -4556,6 +5810,9 @@ Terminal::widget_key_press(GdkEventKey *event)
 	gunichar keychar = 0;
 	char keybuf[VTE_UTF8_BPC];
 
+        /* For the input latency, see send_child() */
+        m_key_press_time = event->type == GDK_KEY_PRESS ? g_get_monotonic_time() : 0;
+
 	/* If it's a keypress, record that we got the event, in case the
 	 * input method takes the event from us. */
 	if (event->type == GDK_KEY_PRESS) {
@@ -4675,6 +5932,7 @@ Terminal::widget_key_press(GdkEventKey *event)
                 if (m_real_widget->im_filter_keypress(event)) {
 			_vte_debug_print(VTE_DEBUG_EVENTS,
 					"Keypress taken by IM.\n");
+                        m_key_press_time = 0;
 			return true;
 		}
 	}
@@ -5001,8 +6259,10 @@ Terminal::widget_key_press(GdkEventKey *event)
                     m_scroll_on_keystroke && m_input_enabled) {
 			maybe_scroll_to_bottom();
 		}
+                m_key_press_time = 0;
 		return true;
 	}
+        m_key_press_time = 0;
 	return false;
 }
 
@@ -5061,6 +6321,19 @@ static const guint8 word_char_by_category[] = {
  */
 bool
 Terminal::is_word_char(gunichar c) const
+{
+        /* Selecting by words asks this for every cell, so the BMP is
+         * looked up in a bitmap; the other planes are rare enough. */
+        if (G_LIKELY(c < m_word_char_bmp.size()))
+                return m_word_char_bmp[c];
+
+        return is_word_char_uncached(c);
+}
+
+/* Like is_word_char(), but from the character's category and the
+ * word char exceptions, see set_word_char_exceptions(). */
+bool
+Terminal::is_word_char_uncached(gunichar c) const
 {
         const guint8 v = word_char_by_category[g_unichar_type(c)];
 
@@ -5068,7 +6341,7 @@ Terminal::is_word_char(gunichar c) const
                 return v == 1;
 
         /* Do we have an exception? */
-        return std::find(std::begin(m_word_char_exceptions), std::end(m_word_char_exceptions), char32_t(c)) != std::end(m_word_char_exceptions);
+        return std::binary_search(std::begin(m_word_char_exceptions), std::end(m_word_char_exceptions), char32_t(c));
 }
 
 /* Check if the characters in the two given locations are in the same class
@@ -5483,75 +6756,152 @@ Terminal::cell_is_selected_vis(vte::grid::column_t vcol,
         return cell_is_selected_log(lcol, row);
 }
 
+/* Appends the runs of the visual columns of @row that cell_is_selected_vis()
+ * has as selected to @runs, from left to right. */
 void
-Terminal::widget_paste_received(char const* text)
+Terminal::append_selection_runs(vte::grid::row_t row,
+                                std::vector<SelectionRun>& runs) const
 {
-	gchar *paste, *p;
-        gsize run;
-        unsigned char c;
+        /* Our caller had to update the ringview (we can't do because we're const). */
+        g_assert(m_ringview.is_updated());
+
+        if (m_selection_resolved.empty() ||
+            row < m_selection_resolved.start_row() ||
+            row > m_selection_resolved.end_row())
+                return;
+
+        auto const column_count = m_column_count;
+
+        /* In normal modes without BiDi, the selection is one run of the row */
+        if (!m_selection_block_mode && m_ringview.get_bidirow(row)->is_trivial_ltr()) {
+                auto const start = row == m_selection_resolved.start_row() ? m_selection_resolved.start_column() : 0;
+                auto const end = row == m_selection_resolved.end_row() ? m_selection_resolved.end_column() : column_count;
+                auto const run = SelectionRun{std::max(start, vte::grid::column_t{0}), std::min(end, column_count)};
+                if (run.start < run.end)
+                        runs.push_back(run);
+                return;
+        }
+
+        /* Otherwise, ask for each column once */
+        auto const first = runs.size();
+        for (auto vcol = vte::grid::column_t{0}; vcol < column_count; vcol++) {
+                if (!cell_is_selected_vis(vcol, row))
+                        continue;
+                if (runs.size() > first && runs.back().end == vcol)
+                        runs.back().end = vcol + 1;
+                else
+                        runs.push_back({vcol, vcol + 1});
+        }
+}
 
+void
+Terminal::widget_paste_received(char const* text)
+{
 	if (text == nullptr)
                 return;
 
-        gsize len = strlen(text);
+        auto const len = strlen(text);
         _vte_debug_print(VTE_DEBUG_SELECTION,
                          "Pasting %" G_GSIZE_FORMAT " UTF-8 bytes.\n", len);
-        // FIXMEchpe this cannot happen ever
-        if (!g_utf8_validate(text, len, NULL)) {
-                g_warning("Paste not valid UTF-8, dropping.");
+
+        /* Queue all of a previous paste first, so they don't interleave */
+        if (m_paste.pasting())
+                paste_continue(true);
+
+        if (!m_input_enabled || !pty())
                 return;
+
+        /* The paste is filtered and queued for the child a slice at a
+         * time, as the PTY drains, so that a large paste doesn't block
+         * the main loop nor take the memory for all of it several times.
+         */
+        m_paste_filtered.clear();
+        m_paste.start({text, len}, m_modes_private.XTERM_READLINE_BRACKETED_PASTE(),
+                      m_paste_filtered);
+        if (!m_paste_filtered.empty()) {
+                m_paste_continuing = true;
+                feed_child(m_paste_filtered);
+                m_paste_continuing = false;
         }
 
-        /* Convert newlines to carriage returns, which more software
-         * is able to cope with (cough, pico, cough).
-         * Filter out control chars except HT, CR (even stricter than xterm).
-         * Also filter out C1 controls: U+0080 (0xC2 0x80) - U+009F (0xC2 0x9F). */
-        p = paste = (gchar *) g_malloc(len + 1);
-        while (p != nullptr && text[0] != '\0') {
-                run = strcspn(text, "\x01\x02\x03\x04\x05\x06\x07"
-                              "\x08\x0A\x0B\x0C\x0E\x0F"
-                              "\x10\x11\x12\x13\x14\x15\x16\x17"
-                              "\x18\x19\x1A\x1B\x1C\x1D\x1E\x1F"
-                              "\x7F\xC2");
-                memcpy(p, text, run);
-                p += run;
-                text += run;
-                switch (text[0]) {
-                case '\x00':
-                        break;
-                case '\x0A':
-                        *p = '\x0D';
-                        p++;
-                        text++;
-                        break;
-                case '\xC2':
-                        c = text[1];
-                        if (c >= 0x80 && c <= 0x9F) {
-                                /* Skip both bytes of a C1 */
-                                text += 2;
-                        } else {
-                                /* Move along, nothing to see here */
-                                *p = '\xC2';
-                                p++;
-                                text++;
-                        }
-                        break;
-                default:
-                        /* Swallow this byte */
-                        text++;
-                        break;
-                }
+        paste_continue();
+}
+
+/*
+ * Terminal::paste_continue:
+ * @all: whether to queue all of the rest of the paste
+ *
+ * Filters slices of the paste in progress and queues them for the child,
+ * until VTE_PASTE_QUEUE_HIGH_WATER bytes are waiting; pty_io_write() calls
+ * this again once that's down to half. Ends the paste when it's all queued.
+ * Other input for the child calls this to queue all of it first.
+ */
+void
+Terminal::paste_continue(bool all)
+{
+        /* Queueing the data may write it right away, and get here again */
+        if (!m_paste.pasting() || m_paste_continuing)
+                return;
+
+        m_paste_continuing = true;
+
+        auto const start = m_paste.offset();
+        auto more = true;
+        while (more &&
+               m_paste.pasting() &&
+               (all || m_outgoing.size() < VTE_PASTE_QUEUE_HIGH_WATER)) {
+                m_paste_filtered.clear();
+                more = m_paste.next(VTE_PASTE_SLICE_SIZE, m_paste_filtered);
+                feed_child(m_paste_filtered);
         }
 
-        bool const bracketed_paste = m_modes_private.XTERM_READLINE_BRACKETED_PASTE();
-        // FIXMEchpe can we not hardcode C0 controls here?
-        if (bracketed_paste)
-                feed_child("\e[200~"sv);
-        // FIXMEchpe add a way to avoid the extra string copy done here
-        feed_child(paste, p - paste);
-        if (bracketed_paste)
-                feed_child("\e[201~"sv);
-        g_free(paste);
+        m_paste_continuing = false;
+
+        /* A "commit" handler may have cancelled it */
+        auto const offset = m_paste.offset();
+        auto const size = m_paste.size();
+        if (!m_paste.pasting())
+                paste_stop();
+        if (size == 0)
+                return;
+
+        if (offset != start)
+                emit_paste_progress(offset, size);
+}
+
+/* Forgets the paste in progress, e.g. when its PTY goes away. */
+void
+Terminal::paste_stop() noexcept
+{
+        m_paste.stop();
+        m_paste_filtered.clear();
+        m_paste_filtered.shrink_to_fit();
+}
+
+/*
+ * Terminal::paste_cancel:
+ *
+ * Stops the paste in progress. What of it was already queued is still
+ * sent to the child, and then the end of the bracketed paste if it began
+ * with one.
+ */
+void
+Terminal::paste_cancel()
+{
+        if (!m_paste.pasting())
+                return;
+
+        _vte_debug_print(VTE_DEBUG_SELECTION,
+                         "Cancelling paste at %" G_GSIZE_FORMAT " of %" G_GSIZE_FORMAT " bytes.\n",
+                         m_paste.offset(), m_paste.size());
+
+        auto end = std::string{};
+        m_paste.cancel(end);
+        /* From a "commit" handler, paste_continue() does this */
+        if (!m_paste_continuing)
+                paste_stop();
+        if (!end.empty())
+                feed_child(end);
 }
 
 bool
@@ -5755,6 +7105,56 @@ Terminal::maybe_send_mouse_drag(vte::grid::coords const& unconfined_rowcol,
                                 false /* not release */);
 }
 
+/*
+ * Terminal::hyperlink_spans_update:
+ *
+ * Collects the hyperlinks of the displayed rows into m_hyperlink_spans, by
+ * idx, unless they are there already. The ringview changes along with the
+ * contents, so the spans are valid as long as it and the displayed rows are
+ * the same.
+ *
+ * Only the rows in the ring's array are looked at. The rows from the stream
+ * give the pseudo idx VTE_HYPERLINK_IDX_TARGET_IN_STREAM to the hyperlinks
+ * not hovered, and real idxs to the ones that become hovered, so these are
+ * looked at as the hover changes instead.
+ */
+void
+Terminal::hyperlink_spans_update()
+{
+        /* Our caller had to update the ringview. */
+        g_assert(m_ringview.is_updated());
+
+        auto const first_row = first_displayed_row();
+        auto const end_row = last_displayed_row() + 1;
+        if (m_hyperlink_spans_generation == m_ringview.generation() &&
+            m_hyperlink_spans_first_row == first_row &&
+            m_hyperlink_spans_end_row == end_row)
+                return;
+
+        m_hyperlink_spans.clear();
+        auto const ring = m_screen->row_data;
+        auto const start_row = std::max(first_row, vte::grid::row_t(ring->writable()));
+        auto const stop_row = std::min(end_row, vte::grid::row_t(ring->next()));
+        for (auto row = start_row; row < stop_row; row++) {
+                auto const rowdata = ring->index(row);
+                for (auto i = 0u; i < rowdata->n_hyperlinks; i++) {
+                        auto const link = &rowdata->hyperlinks[i];
+                        if (link->start < rowdata->len)
+                                m_hyperlink_spans.push_back({link->idx, row,
+                                                             vte::grid::column_t(link->start),
+                                                             vte::grid::column_t(MIN(link->end, rowdata->len))});
+                }
+        }
+        std::stable_sort(m_hyperlink_spans.begin(), m_hyperlink_spans.end(),
+                         [](HyperlinkSpan const& a, HyperlinkSpan const& b) {
+                                 return a.idx < b.idx;
+                         });
+
+        m_hyperlink_spans_generation = m_ringview.generation();
+        m_hyperlink_spans_first_row = first_row;
+        m_hyperlink_spans_end_row = end_row;
+}
+
 /*
  * Terminal::hyperlink_invalidate_and_get_bbox
  *
@@ -5769,37 +7169,82 @@ Terminal::hyperlink_invalidate_and_get_bbox(vte::base::Ring::hyperlink_idx_t idx
         auto first_row = first_displayed_row();
         auto end_row = last_displayed_row() + 1;
         vte::grid::row_t row, top = LONG_MAX, bottom = -1;
-        vte::grid::column_t col, left = LONG_MAX, right = -1;
+        vte::grid::column_t left = LONG_MAX, right = -1;
         const VteRowData *rowdata;
 
         g_assert (idx != 0);
 
+        hyperlink_spans_update();
+
+        auto const allocation = get_allocated_rect();
+        auto region = cairo_region_create();
+        auto const add_span = [&](vte::grid::row_t row_,
+                                  vte::grid::column_t start,
+                                  vte::grid::column_t end) {
+                top = MIN(top, row_);
+                bottom = MAX(bottom, row_);
+                left = MIN(left, start);
+                right = MAX(right, end - 1);
+
+                /* With BiDi, the columns are elsewhere on the screen */
+                if (!m_ringview.get_bidirow(row_)->is_trivial_ltr()) {
+                        start = 0;
+                        end = m_column_count;
+                }
+                /* Include a column on each side for glyphs overflowing their cells */
+                record_query_damage(row_, row_, start - 1, end + 1);
+                if (G_UNLIKELY (!widget_realized()))
+                        return;
+
+                frame_damage_rows(row_, row_);
+                if (m_invalidated_all)
+                        return;
+
+                if (is_processing()) {
+                        damage_cells(row_, row_, start - 1, end + 1);
+                } else {
+                        auto rect = damage_rect(row_, row_, start - 1, end + 1);
+                        rect.x += allocation.x + m_padding.left;
+                        rect.y += allocation.y + m_padding.top;
+                        cairo_region_union_rectangle(region, &rect);
+                }
+        };
+
+        /* The rows in the ring's array */
+        auto const spans = std::equal_range(m_hyperlink_spans.cbegin(), m_hyperlink_spans.cend(),
+                                            HyperlinkSpan{idx, 0, 0, 0},
+                                            [](HyperlinkSpan const& a, HyperlinkSpan const& b) {
+                                                    return a.idx < b.idx;
+                                            });
+        for (auto span = spans.first; span != spans.second; ++span)
+                add_span(span->row, span->start, span->end);
+
+        /* The rows from the stream */
+        end_row = std::min(end_row, vte::grid::row_t(m_screen->row_data->writable()));
         for (row = first_row; row < end_row; row++) {
                 rowdata = _vte_ring_index(m_screen->row_data, row);
                 if (rowdata != NULL) {
-                        bool do_invalidate_row = false;
-                        for (col = 0; col < rowdata->len; col++) {
-                                if (G_UNLIKELY (rowdata->cells[col].attr.hyperlink_idx == idx)) {
-                                        do_invalidate_row = true;
-                                        top = MIN(top, row);
-                                        bottom = MAX(bottom, row);
-                                        left = MIN(left, col);
-                                        right = MAX(right, col);
+                        for (guint i = 0; i < rowdata->n_hyperlinks; i++) {
+                                auto const link = &rowdata->hyperlinks[i];
+                                if (G_UNLIKELY (link->idx == idx && link->start < rowdata->len)) {
+                                        add_span(row,
+                                                 vte::grid::column_t(link->start),
+                                                 vte::grid::column_t(MIN(link->end, rowdata->len)));
                                 }
                         }
-                        if (G_UNLIKELY (do_invalidate_row)) {
-                                invalidate_row(row);
-                        }
                 }
         }
 
+        if (!cairo_region_is_empty(region))
+                gtk_widget_queue_draw_region(m_widget, region);
+        cairo_region_destroy(region);
+
         if (bbox == NULL)
                 return;
 
         /* If bbox != NULL, we're looking for the new hovered hyperlink which always has onscreen bits. */
         g_assert (top != LONG_MAX && bottom != -1 && left != LONG_MAX && right != -1);
 
-        auto allocation = get_allocated_rect();
         bbox->x = allocation.x + m_padding.left + left * m_cell_width;
         bbox->y = allocation.y + m_padding.top + row_to_pixel(top);
         bbox->width = (right - left + 1) * m_cell_width;
@@ -5846,7 +7291,7 @@ Terminal::hyperlink_hilite_update()
                 rowcol = grid_coords_from_view_coords(pos);
                 rowdata = find_row_data(rowcol.row());
                 if (rowdata && rowcol.column() < rowdata->len) {
-                        new_hyperlink_hover_idx = rowdata->cells[rowcol.column()].attr.hyperlink_idx;
+                        new_hyperlink_hover_idx = _vte_row_data_get_hyperlink(rowdata, rowcol.column());
                 }
         }
 
@@ -6029,9 +7474,12 @@ Terminal::widget_clipboard_cleared(GtkClipboard *clipboard_)
 			deselect_all();
 		}
                 m_selection_owned[VTE_SELECTION_PRIMARY] = false;
+                m_selection_copied[VTE_SELECTION_PRIMARY].screen = nullptr;
 	} else if (clipboard_ == m_clipboard[VTE_SELECTION_CLIPBOARD]) {
                 m_selection_owned[VTE_SELECTION_CLIPBOARD] = false;
+                m_selection_copied[VTE_SELECTION_CLIPBOARD].screen = nullptr;
         }
+        selection_copied_update_watch();
 }
 
 /* Supply the selected text to the clipboard. */
@@ -6066,6 +7514,8 @@ Terminal::widget_clipboard_requested(GtkClipboard *target_clipboard,
                                                guint info)
 {
 	for (auto sel = 0; sel < LAST_VTE_SELECTION; sel++) {
+		if (target_clipboard == m_clipboard[sel])
+                        selection_copied_serialize(VteSelection(sel));
 		if (target_clipboard == m_clipboard[sel] &&
                     m_selection[sel] != nullptr) {
 			_VTE_DEBUG_IF(VTE_DEBUG_SELECTION) {
@@ -6137,27 +7587,302 @@ Terminal::rgb_from_index(guint index,
 	}
 }
 
-GString*
-Terminal::get_text(vte::grid::row_t start_row,
-                             vte::grid::column_t start_col,
-                             vte::grid::row_t end_row,
-                             vte::grid::column_t end_col,
-                             bool block,
-                             bool wrap,
-                             GArray *attributes)
+/*
+ * Compares the visual attributes of a VteCellAttr for equality, but ignores
+ * attributes that tend to change from character to character or are otherwise
+ * strange (in particular: fragment, columns).
+ */
+// FIXMEchpe: make VteCellAttr a class with operator==
+static bool
+vte_terminal_cellattr_equal(VteCellAttr const* attr1,
+                            VteCellAttr const* attr2)
 {
-	const VteCell *pcell = NULL;
-	GString *string;
-	struct _VteCharAttributes attr;
-	vte::color::rgb fore, back;
-        std::unique_ptr<vte::base::RingView> ringview;
-        vte::base::BidiRow const *bidirow = nullptr;
-        vte::grid::column_t vcol;
+        //FIXMEchpe why exclude DIM here?
+	return (((attr1->attr ^ attr2->attr) & VTE_ATTR_ALL_MASK) == 0 &&
+                attr1->colors()       == attr2->colors());
+}
 
-	if (attributes)
-		g_array_set_size (attributes, 0);
+namespace {
+
+/* Appends the text to a GString, and if there is @attributes, the
+ * attributes of each of its bytes to that. */
+class StringTextSink final : public vte::terminal::TextSink {
+public:
+        StringTextSink(GString* string,
+                       GArray* attributes) noexcept
+                : TextSink{attributes ? Attributes::eChars : Attributes::eNone},
+                  m_string{string},
+                  m_attributes{attributes}
+        {
+        }
+
+        void append(char const* text,
+                    size_t len,
+                    VteCellAttr const* attr,
+                    VteCharAttributes const& chattr) override
+        {
+                g_string_append_len(m_string, text, len);
+                if (m_attributes)
+                        vte_g_array_fill(m_attributes, &chattr, m_string->len);
+        }
+
+private:
+        GString* m_string;
+        GArray* m_attributes;
+};
+
+#ifdef VTE_DEBUG
+/* Sums up the characters of each of the rows @start_row to @end_row,
+ * leaving out the newlines, as DECRQCRA wants them. */
+class ChecksumTextSink final : public vte::terminal::TextSink {
+public:
+        ChecksumTextSink(vte::grid::row_t start_row,
+                         vte::grid::row_t end_row)
+                : m_start_row{start_row},
+                  m_sums(end_row - start_row + 1, 0)
+        {
+        }
+
+        void append(char const* text,
+                    size_t len,
+                    VteCellAttr const* attr,
+                    VteCharAttributes const& chattr) override
+        {
+                auto& sum = m_sums[chattr.row - m_start_row];
+                for (auto p = text; p < text + len; p = g_utf8_next_char(p)) {
+                        auto const c = g_utf8_get_char(p);
+                        if (c != '\n')
+                                sum += c;
+                }
+        }
+
+        /* Stores the sums into @checksums, and returns their total. */
+        uint32_t store(vte::base::RowChecksums& checksums) const noexcept
+        {
+                auto total = uint32_t{0};
+                for (size_t i = 0; i < m_sums.size(); i++) {
+                        checksums.store(m_start_row + i, m_sums[i]);
+                        total += m_sums[i];
+                }
+                return total;
+        }
+
+private:
+        vte::grid::row_t m_start_row;
+        std::vector<uint32_t> m_sums;
+};
+#endif /* VTE_DEBUG */
+
+/* Writes the text as HTML, with the attributes of each run of cells as a
+ * CSS class. It needs two walks of the text: the first one interns the
+ * distinct attributes into the classes; after write_styles(), the second
+ * one writes the text, to the stream in chunks if there is one. */
+class HtmlTextSink final : public vte::terminal::TextSink {
+public:
+        HtmlTextSink(vte::terminal::Terminal const& terminal,
+                     GString* string,
+                     GOutputStream* stream,
+                     GCancellable* cancellable) noexcept
+                : TextSink{Attributes::eRuns},
+                  m_terminal{terminal},
+                  m_string{string},
+                  m_stream{stream},
+                  m_cancellable{cancellable}
+        {
+        }
+
+        ~HtmlTextSink() override
+        {
+                g_clear_error(&m_error);
+        }
+
+        void append(char const* text,
+                    size_t len,
+                    VteCellAttr const* attr,
+                    VteCharAttributes const& chattr) override
+        {
+                if (m_interning) {
+                        if (attr != nullptr)
+                                intern(attr);
+                        return;
+                }
+
+                /* Newlines are kept out of the markup, so that the
+                 * spans do not cover multiple lines. */
+                auto const style = attr ? style_of(attr) : k_no_style;
+                if (style != k_no_style)
+                        g_string_append_printf(m_string, "<span class=\"vte-%u\">", style);
+                write_escaped(text, len);
+                if (style != k_no_style)
+                        g_string_append(m_string, "</span>");
+
+                maybe_flush();
+        }
+
+        /* Writes the classes, and starts writing the text */
+        void write_styles()
+        {
+                g_string_append(m_string, "<style>");
+                for (auto i = size_t{0}; i < m_css.size(); i++)
+                        g_string_append_printf(m_string, ".vte-%u{%s}",
+                                               unsigned(i), m_css[i].c_str());
+                g_string_append(m_string, "</style>");
+                m_css.clear();
+                m_interning = false;
+        }
+
+        void write(char const* text)
+        {
+                g_string_append(m_string, text);
+                maybe_flush();
+        }
+
+        /* Returns: whether all of it was written */
+        bool finish(GError** error)
+        {
+                flush();
+                if (m_error == nullptr)
+                        return true;
+
+                g_propagate_error(error, m_error);
+                m_error = nullptr;
+                return false;
+        }
+
+private:
+        static constexpr auto const k_no_style = unsigned(-1);
+
+        static inline std::pair<uint32_t, uint64_t> key(VteCellAttr const* attr) noexcept
+        {
+                return {attr->attr & VTE_ATTR_ALL_MASK, attr->colors()};
+        }
+
+        /* The text may have changed since it was interned, when it is
+         * written asynchronously; attributes that weren't are left out. */
+        unsigned style_of(VteCellAttr const* attr) const
+        {
+                auto const it = m_styles.find(key(attr));
+                return it != m_styles.end() ? it->second : k_no_style;
+        }
+
+        void intern(VteCellAttr const* attr)
+        {
+                auto const [it, inserted] = m_styles.emplace(key(attr), k_no_style);
+                if (!inserted)
+                        return;
+
+                auto css = g_string_new(nullptr);
+                m_terminal.cellattr_to_css(attr, css);
+                if (css->len > 0) {
+                        it->second = m_css.size();
+                        m_css.emplace_back(css->str, css->len);
+                }
+                g_string_free(css, TRUE);
+        }
+
+        void write_escaped(char const* text,
+                           size_t len)
+        {
+                auto const end = text + len;
+                auto start = text;
+                for (auto p = text; p < end; p++) {
+                        char const* entity;
+                        switch (*p) {
+                        case '&': entity = "&amp;"; break;
+                        case '<': entity = "&lt;"; break;
+                        case '>': entity = "&gt;"; break;
+                        default: continue;
+                        }
+                        g_string_append_len(m_string, start, p - start);
+                        g_string_append(m_string, entity);
+                        start = p + 1;
+                }
+                g_string_append_len(m_string, start, end - start);
+        }
+
+        inline void maybe_flush()
+        {
+                if (m_stream != nullptr && m_string->len >= VTE_WRITE_CONTENTS_CHUNK_SIZE)
+                        flush();
+        }
+
+        void flush()
+        {
+                if (m_stream == nullptr)
+                        return;
+
+                /* After an error, the rest is dropped. */
+                if (m_error == nullptr)
+                        g_output_stream_write_all(m_stream, m_string->str, m_string->len,
+                                                  nullptr, m_cancellable, &m_error);
+                g_string_truncate(m_string, 0);
+        }
+
+        vte::terminal::Terminal const& m_terminal;
+        GString* m_string;
+        GOutputStream* m_stream;
+        GCancellable* m_cancellable;
+        GError* m_error{nullptr};
+        bool m_interning{true};
+        /* The class of each of the distinct attributes, or k_no_style */
+        std::map<std::pair<uint32_t, uint64_t>, unsigned> m_styles{};
+        std::vector<std::string> m_css{};  /* the declarations of each class, while interning */
+};
+
+} // anon namespace
+
+/*
+ * Terminal::get_text:
+ * @sink: where to put the text
+ *
+ * Walks the text of the given range, and hands it to @sink: a row at a
+ * time, or by runs of cells with equal attributes, or by characters,
+ * depending on which attributes the sink wants.
+ */
+void
+Terminal::get_text(vte::grid::row_t start_row,
+                   vte::grid::column_t start_col,
+                   vte::grid::row_t end_row,
+                   vte::grid::column_t end_col,
+                   bool block,
+                   bool wrap,
+                   vte::terminal::TextSink& sink)
+{
+	const VteCell *pcell = NULL;
+	struct _VteCharAttributes attr;
+	vte::color::rgb fore, back;
+        std::unique_ptr<vte::base::RingView> ringview;
+        vte::base::BidiRow const *bidirow = nullptr;
+        vte::grid::column_t vcol;
+        auto const want = sink.attributes();
+
+        /* The text of the row, and for the sinks that want attributes,
+         * its cells, with where their text ends. */
+        struct TextCell {
+                VteCell const* cell;
+                vte::grid::column_t column;
+                gsize end;
+        };
+        auto text = g_string_new(NULL);
+        auto cells = std::vector<TextCell>{};
+
+        auto set_char_attributes = [&](VteCell const* cell) {
+                // FIXMEchpe shouldn't this use determine_colors?
+                uint32_t fg, bg, dc;
+                vte_color_triple_get(cell->attr.colors(), &fg, &bg, &dc);
+                rgb_from_index<8, 8, 8>(fg, fore);
+                rgb_from_index<8, 8, 8>(bg, back);
+                attr.fore.red = fore.red;
+                attr.fore.green = fore.green;
+                attr.fore.blue = fore.blue;
+                attr.back.red = back.red;
+                attr.back.green = back.green;
+                attr.back.blue = back.blue;
+                attr.underline = (cell->attr.underline() == 1);
+                attr.strikethrough = cell->attr.strikethrough();
+                attr.columns = cell->attr.columns();
+        };
 
-	string = g_string_new(NULL);
 	memset(&attr, 0, sizeof(attr));
 
         if (start_col < 0)
@@ -6183,8 +7908,12 @@ Terminal::get_text(vte::grid::row_t start_row,
                 gsize last_empty, last_nonempty;
                 vte::grid::column_t last_emptycol, last_nonemptycol;
                 vte::grid::column_t line_last_column = (!block && row == end_row) ? end_col : m_column_count;
+                size_t n_nonempty_cells = 0;
+                VteCell const* last_cell = nullptr;
 
-                last_empty = last_nonempty = string->len;
+                g_string_truncate(text, 0);
+                cells.clear();
+                last_empty = last_nonempty = 0;
                 last_emptycol = last_nonemptycol = -1;
 
 		attr.row = row;
@@ -6211,42 +7940,26 @@ Terminal::get_text(vte::grid::row_t start_row,
 				 * and passes the selection criterion, add it to
 				 * the selection. */
 				if (!pcell->attr.fragment()) {
-					/* Store the attributes of this character. */
-                                        // FIXMEchpe shouldn't this use determine_colors?
-                                        uint32_t fg, bg, dc;
-                                        vte_color_triple_get(pcell->attr.colors(), &fg, &bg, &dc);
-                                        rgb_from_index<8, 8, 8>(fg, fore);
-                                        rgb_from_index<8, 8, 8>(bg, back);
-					attr.fore.red = fore.red;
-					attr.fore.green = fore.green;
-					attr.fore.blue = fore.blue;
-					attr.back.red = back.red;
-					attr.back.green = back.green;
-					attr.back.blue = back.blue;
-					attr.underline = (pcell->attr.underline() == 1);
-					attr.strikethrough = pcell->attr.strikethrough();
-                                        attr.columns = pcell->attr.columns();
-
 					/* Store the cell string */
 					if (pcell->c == 0) {
                                                 /* Empty cells of nondefault background color are
                                                  * stored as NUL characters. Treat them as spaces,
                                                  * but make a note of the last occurrence. */
-						g_string_append_c (string, ' ');
-                                                last_empty = string->len;
+						g_string_append_c (text, ' ');
+                                                last_empty = text->len;
                                                 last_emptycol = lcol;
 					} else {
-						_vte_unistr_append_to_string (pcell->c, string);
-                                                last_nonempty = string->len;
+						_vte_unistr_append_to_string (pcell->c, text);
+                                                last_nonempty = text->len;
                                                 last_nonemptycol = lcol;
 					}
 
-					/* If we added text to the string, record its
-					 * attributes, one per byte. */
-					if (attributes) {
-						vte_g_array_fill(attributes,
-								&attr, string->len);
-					}
+                                        if (want != vte::terminal::TextSink::Attributes::eNone) {
+                                                cells.push_back(TextCell{pcell, lcol, text->len});
+                                                if (pcell->c != 0)
+                                                        n_nonempty_cells = cells.size();
+                                        }
+                                        last_cell = pcell;
 				}
 
                                 lcol++;
@@ -6273,20 +7986,57 @@ Terminal::get_text(vte::grid::row_t start_row,
                                 }
                         }
                         if (pcell == NULL) {
-                                g_string_truncate(string, last_nonempty);
-                                if (attributes)
-                                        g_array_set_size(attributes, string->len);
+                                g_string_truncate(text, last_nonempty);
+                                cells.resize(n_nonempty_cells);
                                 attr.column = last_nonemptycol;
                         }
                 }
 
+                /* Hand the row over */
+                auto const last_column = attr.column;
+                switch (want) {
+                case vte::terminal::TextSink::Attributes::eNone:
+                        if (text->len > 0)
+                                sink.append(text->str, text->len, nullptr, attr);
+                        break;
+
+                case vte::terminal::TextSink::Attributes::eRuns:
+                        for (size_t i = 0; i < cells.size(); ) {
+                                auto j = i + 1;
+                                while (j < cells.size() &&
+                                       vte_terminal_cellattr_equal(&cells[i].cell->attr, &cells[j].cell->attr))
+                                        j++;
+
+                                auto const start = i > 0 ? cells[i - 1].end : 0;
+                                attr.column = cells[i].column;
+                                sink.append(text->str + start, cells[j - 1].end - start,
+                                            &cells[i].cell->attr, attr);
+                                i = j;
+                        }
+                        break;
+
+                case vte::terminal::TextSink::Attributes::eChars:
+                        for (size_t i = 0; i < cells.size(); i++) {
+                                auto const start = i > 0 ? cells[i - 1].end : 0;
+                                set_char_attributes(cells[i].cell);
+                                attr.column = cells[i].column;
+                                sink.append(text->str + start, cells[i].end - start,
+                                            &cells[i].cell->attr, attr);
+                        }
+                        /* The newline gets the attributes of the last cell,
+                         * even if that was stripped off. */
+                        if (last_cell != nullptr)
+                                set_char_attributes(last_cell);
+                        break;
+                }
+
 		/* Adjust column, in case we want to append a newline */
                 //FIXMEchpe MIN ?
-		attr.column = MAX(m_column_count, attr.column + 1);
+		attr.column = MAX(m_column_count, last_column + 1);
 
 		/* Add a newline in block mode. */
 		if (block) {
-			string = g_string_append_c(string, '\n');
+                        sink.append("\n", 1, nullptr, attr);
 		}
 		/* Else, if the last visible column on this line was in range and
 		 * not soft-wrapped, append a newline. */
@@ -6294,16 +8044,30 @@ Terminal::get_text(vte::grid::row_t start_row,
 			/* If we didn't softwrap, add a newline. */
 			/* XXX need to clear row->soft_wrap on deletion! */
                         if (!m_screen->row_data->is_soft_wrapped(row)) {
-				string = g_string_append_c(string, '\n');
+                                sink.append("\n", 1, nullptr, attr);
 			}
 		}
-
-		/* Make sure that the attributes array is as long as the string. */
-		if (attributes) {
-			vte_g_array_fill (attributes, &attr, string->len);
-		}
 	}
 
+        g_string_free(text, TRUE);
+}
+
+GString*
+Terminal::get_text(vte::grid::row_t start_row,
+                   vte::grid::column_t start_col,
+                   vte::grid::row_t end_row,
+                   vte::grid::column_t end_col,
+                   bool block,
+                   bool wrap,
+                   GArray *attributes)
+{
+	if (attributes)
+		g_array_set_size (attributes, 0);
+
+        auto string = g_string_new(NULL);
+        auto sink = StringTextSink{string, attributes};
+        get_text(start_row, start_col, end_row, end_col, block, wrap, sink);
+
 	/* Sanity check. */
         if (attributes != nullptr)
                 g_assert_cmpuint(string->len, ==, attributes->len);
@@ -6346,216 +8110,355 @@ Terminal::get_selected_text(GArray *attributes)
                         attributes);
 }
 
-#ifdef VTE_DEBUG
-unsigned int
-Terminal::checksum_area(vte::grid::row_t start_row,
-                                  vte::grid::column_t start_col,
-                                  vte::grid::row_t end_row,
-                                  vte::grid::column_t end_col)
+/*
+ * Terminal::write_html:
+ * @span: the text to write
+ * @block: whether @span is a block
+ * @string: where the HTML goes
+ * @stream: (nullable): if given, where @string is written to in chunks
+ * @cancellable: (nullable): a #GCancellable
+ * @error: (nullable): a location for a #GError
+ *
+ * Writes the text of @span as HTML: a style sheet for the distinct
+ * attributes of the text, then the text inside a <pre> element.
+ *
+ * Returns: %true on success
+ */
+bool
+Terminal::write_html(vte::grid::span const& span,
+                     bool block,
+                     GString* string,
+                     GOutputStream* stream,
+                     GCancellable* cancellable,
+                     GError** error)
+{
+        auto sink = HtmlTextSink{*this, string, stream, cancellable};
+        auto const walk = [&] {
+                get_text(span.start_row(),
+                         span.start_column(),
+                         span.end_row(),
+                         span.end_column(),
+                         block,
+                         true /* wrap */,
+                         sink);
+        };
+
+        walk();
+        sink.write_styles();
+        sink.write("<pre>");
+        walk();
+        sink.write("</pre>");
+
+        return sink.finish(error);
+}
+
+/* The state of an asynchronous write_text_range, see Terminal::write_text_range_async(). */
+struct WriteTextRangeData {
+        WriteTextRangeData(Terminal const& terminal,
+                           VteFormat format,
+                           GOutputStream* stream_) noexcept
+                : stream{(GOutputStream*)g_object_ref(stream_)},
+                  string{g_string_new(nullptr)},
+                  text{string, nullptr}
+        {
+                if (format == VTE_FORMAT_HTML)
+                        html = std::make_unique<HtmlTextSink>(terminal, string, nullptr, nullptr);
+        }
+
+        ~WriteTextRangeData()
+        {
+                html.reset();
+                g_string_free(string, TRUE);
+                g_object_unref(stream);
+        }
+
+        GOutputStream* stream;
+        GString* string;               /* the text to write next */
+        StringTextSink text;
+        std::unique_ptr<HtmlTextSink> html;
+        VteScreen* screen{nullptr};
+        vte::grid::row_t start_row{0};
+        vte::grid::column_t start_col{0};
+        vte::grid::row_t end_row{0};
+        vte::grid::column_t end_col{0};
+        vte::grid::row_t row{0};       /* the next row to walk */
+        bool interning{false};         /* whether walking for the HTML styles */
+        bool done{false};              /* whether all of the text is in @string */
+};
+
+static void
+write_text_range_data_free(gpointer ptr)
+{
+        delete reinterpret_cast<WriteTextRangeData*>(ptr);
+}
+
+static gboolean
+write_text_range_step_cb(gpointer user_data)
 {
-        unsigned int checksum = 0;
+        auto task = G_TASK(user_data);
+        auto terminal = VTE_TERMINAL(g_task_get_source_object(task));
 
-        auto text = get_text(start_row, start_col, end_row, end_col,
-                             true /* block */, false /* wrap */,
-                             nullptr /* not interested in attributes */);
-        if (text == nullptr)
-                return checksum;
+        if (_vte_terminal_get_impl(terminal)->write_text_range_step(task))
+                return G_SOURCE_CONTINUE;
 
-        char const* end = (char const*)text->str + text->len;
-        for (char const *p = text->str; p < end; p = g_utf8_next_char(p)) {
-                auto const c = g_utf8_get_char(p);
-                if (c == '\n')
-                        continue;
-                checksum += c;
+        return G_SOURCE_REMOVE;
+}
+
+static void
+write_text_range_written_cb(GObject* source,
+                            GAsyncResult* result,
+                            gpointer user_data)
+{
+        auto task = G_TASK(user_data);
+        auto data = reinterpret_cast<WriteTextRangeData*>(g_task_get_task_data(task));
+        GError* error = nullptr;
+
+        if (!g_output_stream_write_all_finish(G_OUTPUT_STREAM(source), result, nullptr, &error)) {
+                g_task_return_error(task, error);
+                g_object_unref(task);
+                return;
         }
-        g_string_free(text, true);
 
-        return checksum & 0xffff;
+        g_string_truncate(data->string, 0);
+
+        auto idle = g_idle_source_new();
+        g_task_attach_source(task, idle, write_text_range_step_cb);
+        g_source_unref(idle);
 }
-#endif /* VTE_DEBUG */
 
 /*
- * Compares the visual attributes of a VteCellAttr for equality, but ignores
- * attributes that tend to change from character to character or are otherwise
- * strange (in particular: fragment, columns).
+ * Terminal::write_text_range_async:
+ * @format: the #VteFormat to write in
+ * @stream: a #GOutputStream to write to
+ *
+ * Writes the text get_text() returns for the range, a slice of time at a
+ * time from an idle source, and a chunk at a time, so that neither the
+ * whole text is in memory nor the widget is blocked.
+ *
+ * The range is clamped to the rows the ring has when this starts. The
+ * rows are read as they are written, so what the terminal receives in
+ * the meantime may show up in them.
  */
-// FIXMEchpe: make VteCellAttr a class with operator==
-static bool
-vte_terminal_cellattr_equal(VteCellAttr const* attr1,
-                            VteCellAttr const* attr2)
-{
-        //FIXMEchpe why exclude DIM here?
-	return (((attr1->attr ^ attr2->attr) & VTE_ATTR_ALL_MASK) == 0 &&
-                attr1->colors()       == attr2->colors()   &&
-                attr1->hyperlink_idx  == attr2->hyperlink_idx);
+void
+Terminal::write_text_range_async(vte::grid::row_t start_row,
+                                 vte::grid::column_t start_col,
+                                 vte::grid::row_t end_row,
+                                 vte::grid::column_t end_col,
+                                 VteFormat format,
+                                 GOutputStream* stream,
+                                 GCancellable* cancellable,
+                                 GAsyncReadyCallback callback,
+                                 gpointer user_data)
+{
+        auto task = g_task_new(m_terminal, cancellable, callback, user_data);
+        g_task_set_source_tag(task, (void*)vte_terminal_write_text_range_async);
+        g_task_set_priority(task, G_PRIORITY_LOW);
+
+        auto const ring = m_screen->row_data;
+        if (start_row < long(_vte_ring_delta(ring))) {
+                start_row = _vte_ring_delta(ring);
+                start_col = 0;
+        }
+        if (end_row >= long(_vte_ring_next(ring))) {
+                end_row = _vte_ring_next(ring) - 1;
+                end_col = m_column_count;
+        }
+
+        auto data = new WriteTextRangeData{*this, format, stream};
+        data->screen = m_screen;
+        data->start_row = start_row;
+        data->start_col = start_col;
+        data->end_row = end_row;
+        data->end_col = end_col;
+        data->row = start_row;
+        data->interning = data->html != nullptr;
+        data->done = start_row > end_row;
+        g_task_set_task_data(task, data, write_text_range_data_free);
+
+        auto source = g_idle_source_new();
+        g_task_attach_source(task, source, write_text_range_step_cb);
+        g_source_unref(source);
 }
 
 /*
- * Wraps a given string according to the VteCellAttr in HTML tags. Used
- * old-style HTML (and not CSS) for better compatibility with, for example,
- * evolution's mail editor component.
+ * Terminal::write_text_range_step:
+ * @task: the #GTask of a write_text_range_async()
+ *
+ * Walks the rows of the next slice of time, and when that made a chunk,
+ * or reached the end of the range, starts writing it out. Returns the
+ * result to @task when all is written.
+ *
+ * Returns: %true iff there is more to walk before writing
  */
-char *
-Terminal::cellattr_to_html(VteCellAttr const* attr,
-                                     char const* text) const
+bool
+Terminal::write_text_range_step(GTask* task)
 {
-	GString *string;
-        guint fore, back, deco;
-
-	string = g_string_new(text);
-
-        determine_colors(attr, false, false, &fore, &back, &deco);
+        auto data = reinterpret_cast<WriteTextRangeData*>(g_task_get_task_data(task));
 
-	if (attr->bold()) {
-		g_string_prepend(string, "<b>");
-		g_string_append(string, "</b>");
-	}
-	if (attr->italic()) {
-		g_string_prepend(string, "<i>");
-		g_string_append(string, "</i>");
-	}
-        /* <u> should be inside <font> so that it inherits its color by default */
-        if (attr->underline() != 0) {
-                static const char styles[][7] = {"", "single", "double", "wavy"};
-                char *tag, *colorattr;
+        if (g_task_return_error_if_cancelled(task)) {
+                g_object_unref(task);
+                return false;
+        }
 
-                if (deco != VTE_DEFAULT_FG) {
-                        vte::color::rgb color;
+        if (m_screen != data->screen) {
+                g_task_return_new_error(task, G_IO_ERROR, G_IO_ERROR_FAILED,
+                                        "The terminal switched screens during the write");
+                g_object_unref(task);
+                return false;
+        }
 
-                        rgb_from_index<4, 5, 4>(deco, color);
-                        colorattr = g_strdup_printf(";text-decoration-color:#%02X%02X%02X",
-                                                    color.red >> 8,
-                                                    color.green >> 8,
-                                                    color.blue >> 8);
-                } else {
-                        colorattr = g_strdup("");
+        auto const deadline = g_get_monotonic_time() + VTE_WRITE_TEXT_SLICE_TIME;
+        while (!data->done && data->string->len < VTE_WRITE_CONTENTS_CHUNK_SIZE) {
+                vte::terminal::TextSink& sink = data->html ? static_cast<vte::terminal::TextSink&>(*data->html)
+                                                           : data->text;
+                auto const row = data->row++;
+                auto const col = row == data->start_row ? data->start_col : 0;
+
+                /* Ending the walk at the start of the next row gives the
+                 * row's newline, as the walk of the whole range has it. */
+                if (row < data->end_row)
+                        get_text(row, col, row + 1, 0, false, true /* wrap */, sink);
+                else
+                        get_text(row, col, data->end_row, data->end_col, false, true /* wrap */, sink);
+
+                if (data->row > data->end_row) {
+                        if (data->interning) {
+                                data->interning = false;
+                                data->row = data->start_row;
+                                data->html->write_styles();
+                                data->html->write("<pre>");
+                        } else {
+                                if (data->html)
+                                        data->html->write("</pre>");
+                                data->done = true;
+                        }
                 }
 
-                tag = g_strdup_printf("<u style=\"text-decoration-style:%s%s\">",
-                                      styles[attr->underline()],
-                                      colorattr);
-                g_string_prepend(string, tag);
-                g_free(tag);
-                g_free(colorattr);
-                g_string_append(string, "</u>");
+                if (g_get_monotonic_time() >= deadline)
+                        break;
         }
-	if (fore != VTE_DEFAULT_FG || attr->reverse()) {
-		vte::color::rgb color;
-                char *tag;
 
-                rgb_from_index<8, 8, 8>(fore, color);
-		tag = g_strdup_printf("<font color=\"#%02X%02X%02X\">",
-                                      color.red >> 8,
-                                      color.green >> 8,
-                                      color.blue >> 8);
-		g_string_prepend(string, tag);
-		g_free(tag);
-		g_string_append(string, "</font>");
-	}
-	if (back != VTE_DEFAULT_BG || attr->reverse()) {
-		vte::color::rgb color;
-                char *tag;
+        if (data->string->len > 0) {
+                g_output_stream_write_all_async(data->stream,
+                                                data->string->str, data->string->len,
+                                                g_task_get_priority(task),
+                                                g_task_get_cancellable(task),
+                                                write_text_range_written_cb,
+                                                task);
+                return false;
+        }
 
-                rgb_from_index<8, 8, 8>(back, color);
-		tag = g_strdup_printf("<span style=\"background-color:#%02X%02X%02X\">",
-                                      color.red >> 8,
-                                      color.green >> 8,
-                                      color.blue >> 8);
-		g_string_prepend(string, tag);
-		g_free(tag);
-		g_string_append(string, "</span>");
-	}
-	if (attr->strikethrough()) {
-		g_string_prepend(string, "<strike>");
-		g_string_append(string, "</strike>");
-	}
-	if (attr->overline()) {
-		g_string_prepend(string, "<span style=\"text-decoration-line:overline\">");
-		g_string_append(string, "</span>");
-	}
-	if (attr->blink()) {
-		g_string_prepend(string, "<blink>");
-		g_string_append(string, "</blink>");
-	}
-	/* reverse and invisible are not supported */
+        if (!data->done)
+                return true;
 
-	return g_string_free(string, FALSE);
+        g_task_return_boolean(task, TRUE);
+        g_object_unref(task);
+        return false;
 }
 
-/*
- * Similar to find_charcell(), but takes a VteCharAttribute for
- * indexing and returns the VteCellAttr.
- */
-VteCellAttr const*
-Terminal::char_to_cell_attr(VteCharAttributes const* attr) const
+#ifdef VTE_DEBUG
+unsigned int
+Terminal::checksum_area(vte::grid::row_t start_row,
+                                  vte::grid::column_t start_col,
+                                  vte::grid::row_t end_row,
+                                  vte::grid::column_t end_col)
 {
-	VteCell const* cell = find_charcell(attr->column, attr->row);
-	if (cell)
-		return &cell->attr;
-	return nullptr;
+        /* Test suites ask for the checksums over and over, so those of
+         * the rows that haven't changed since are kept; the others are
+         * read in runs of consecutive rows. */
+        if (m_row_checksums_screen != m_screen) {
+                m_row_checksums.clear();
+                m_row_checksums_screen = m_screen;
+        }
+        m_row_checksums.set_columns(start_col, end_col);
+
+        auto checksum = uint32_t{0};
+        auto row = start_row;
+        while (row <= end_row) {
+                uint32_t sum;
+                if (m_row_checksums.lookup(row, &sum)) {
+                        checksum += sum;
+                        row++;
+                        continue;
+                }
+
+                auto run_end = row;
+                while (run_end < end_row &&
+                       !m_row_checksums.lookup(run_end + 1, &sum))
+                        run_end++;
+
+                auto sink = ChecksumTextSink{row, run_end};
+                get_text(row, start_col, run_end, end_col,
+                         true /* block */, false /* wrap */,
+                         sink);
+                checksum += sink.store(m_row_checksums);
+                row = run_end + 1;
+        }
+
+        return checksum & 0xffff;
 }
+#endif /* VTE_DEBUG */
 
 /*
- * Terminal::attributes_to_html:
- * @text: A string as returned by the vte_terminal_get_* family of functions.
- * @attrs: (array) (element-type Vte.CharAttributes): text attributes, as created by vte_terminal_get_*
- *
- * Marks the given text up according to the given attributes, using HTML <span>
- * commands, and wraps the string in a <pre> element. The attributes have to be
- * "fresh" in the sense that the terminal must not have changed since they were
- * obtained using the vte_terminal_get* function.
- *
- * Returns: (transfer full): a newly allocated text string, or %NULL.
+ * Appends the CSS declarations for the given VteCellAttr to @css, or
+ * nothing if it looks like the default.
  */
-GString*
-Terminal::attributes_to_html(GString* text_string,
-                                       GArray* attrs)
+void
+Terminal::cellattr_to_css(VteCellAttr const* attr,
+                          GString* css) const
 {
-	GString *string;
-	guint from,to;
-	const VteCellAttr *attr;
-	char *escaped, *marked;
-
-        char const* text = text_string->str;
-        auto len = text_string->len;
-        g_assert_cmpuint(len, ==, attrs->len);
+        guint fore, back, deco;
+        vte::color::rgb color;
 
-	/* Initial size fits perfectly if the text has no attributes and no
-	 * characters that need to be escaped
-         */
-	string = g_string_sized_new (len + 11);
+        determine_colors(attr, false, false, &fore, &back, &deco);
 
-	g_string_append(string, "<pre>");
-	/* Find streches with equal attributes. Newlines are treated specially,
-	 * so that the <span> do not cover multiple lines.
-         */
-	from = to = 0;
-	while (text[from] != '\0') {
-		g_assert(from == to);
-		if (text[from] == '\n') {
-			g_string_append_c(string, '\n');
-			from = ++to;
-		} else {
-			attr = char_to_cell_attr(
-				&g_array_index(attrs, VteCharAttributes, from));
-			while (text[to] != '\0' && text[to] != '\n' &&
-			       vte_terminal_cellattr_equal(attr,
-                                                           char_to_cell_attr(
-						&g_array_index(attrs, VteCharAttributes, to))))
-			{
-				to++;
-			}
-			escaped = g_markup_escape_text(text + from, to - from);
-			marked = cellattr_to_html(attr, escaped);
-			g_string_append(string, marked);
-			g_free(escaped);
-			g_free(marked);
-			from = to;
-		}
+	if (attr->bold())
+		g_string_append(css, "font-weight:bold;");
+	if (attr->italic())
+		g_string_append(css, "font-style:italic;");
+	if (fore != VTE_DEFAULT_FG || attr->reverse()) {
+                rgb_from_index<8, 8, 8>(fore, color);
+		g_string_append_printf(css, "color:#%02X%02X%02X;",
+                                       color.red >> 8,
+                                       color.green >> 8,
+                                       color.blue >> 8);
 	}
-	g_string_append(string, "</pre>");
+	if (back != VTE_DEFAULT_BG || attr->reverse()) {
+                rgb_from_index<8, 8, 8>(back, color);
+		g_string_append_printf(css, "background-color:#%02X%02X%02X;",
+                                       color.red >> 8,
+                                       color.green >> 8,
+                                       color.blue >> 8);
+	}
+        /* The lines share the style and color of the underline, which
+         * defaults to that of the text. */
+        if (attr->underline() != 0 || attr->strikethrough() ||
+            attr->overline() || attr->blink()) {
+                g_string_append(css, "text-decoration-line:");
+                if (attr->underline() != 0)
+                        g_string_append(css, " underline");
+                if (attr->strikethrough())
+                        g_string_append(css, " line-through");
+                if (attr->overline())
+                        g_string_append(css, " overline");
+                if (attr->blink())
+                        g_string_append(css, " blink");
+                g_string_append_c(css, ';');
+        }
+        if (attr->underline() != 0) {
+                static const char styles[][7] = {"", "solid", "double", "wavy"};
 
-	return string;
+                g_string_append_printf(css, "text-decoration-style:%s;",
+                                       styles[attr->underline()]);
+                if (deco != VTE_DEFAULT_FG) {
+                        rgb_from_index<4, 5, 4>(deco, color);
+                        g_string_append_printf(css, "text-decoration-color:#%02X%02X%02X;",
+                                               color.red >> 8,
+                                               color.green >> 8,
+                                               color.blue >> 8);
+                }
+        }
+	/* reverse and invisible are not supported */
 }
 
 static GtkTargetEntry*
@@ -6612,29 +8515,18 @@ Terminal::widget_copy(VteSelection sel,
         /* Only put HTML on the CLIPBOARD, not PRIMARY */
         g_assert(sel == VTE_SELECTION_CLIPBOARD || format == VTE_FORMAT_TEXT);
 
-	/* Chuck old selected text and retrieve the newly-selected text. */
-        GArray *attributes = g_array_new(FALSE, TRUE, sizeof(struct _VteCharAttributes));
-        auto selection = get_selected_text(attributes);
-
+	/* Chuck old selected text, and only note what is newly selected;
+         * it's turned into text when the clipboard is asked for it. */
         if (m_selection[sel]) {
                 g_string_free(m_selection[sel], TRUE);
                 m_selection[sel] = nullptr;
         }
 
-        if (selection == nullptr) {
-                g_array_free(attributes, TRUE);
-                m_selection_owned[sel] = false;
-                return;
-        }
-
-        if (format == VTE_FORMAT_HTML) {
-                m_selection[sel] = attributes_to_html(selection, attributes);
-                g_string_free(selection, TRUE);
-        } else {
-                m_selection[sel] = selection;
-        }
-
-	g_array_free (attributes, TRUE);
+        m_selection_copied[sel].screen = m_screen;
+        m_selection_copied[sel].span = m_selection_resolved;
+        m_selection_copied[sel].block_mode = m_selection_block_mode;
+        m_selection_format[sel] = format;
+        selection_copied_update_watch();
 
 	/* Place the text on the clipboard. */
         _vte_debug_print(VTE_DEBUG_SELECTION,
@@ -6654,37 +8546,124 @@ Terminal::widget_copy(VteSelection sel,
 
         gtk_clipboard_set_can_store(m_clipboard[sel], nullptr, 0);
         m_selection_owned[sel] = true;
-        m_selection_format[sel] = format;
 }
 
-/* Paste from the given clipboard. */
+/* Turns what was copied to @sel into text, if not done yet. */
 void
-Terminal::widget_paste(GdkAtom board)
+Terminal::selection_copied_serialize(VteSelection sel)
 {
-        if (!m_input_enabled)
+        auto& copied = m_selection_copied[sel];
+        if (copied.screen == nullptr)
                 return;
 
-	auto clip = gtk_clipboard_get_for_display(gtk_widget_get_display(m_widget), board);
-	if (!clip)
-                return;
+        /* The copy is turned into text before its rows change, except when
+         * the screen goes away; then there's nothing to copy anymore. */
+        auto span = copied.span;
+        if (copied.screen != m_screen)
+                span.clear();
+        else if (span.start_row() < _vte_ring_delta(m_screen->row_data))
+                span.set_start(vte::grid::coords(_vte_ring_delta(m_screen->row_data), 0));
 
-        _vte_debug_print(VTE_DEBUG_SELECTION, "Requesting clipboard contents.\n");
+        _vte_debug_print(VTE_DEBUG_SELECTION,
+                         "Serializing selection %d (rows %ld to %ld).\n",
+                         sel, span.start_row(), span.end_row());
+
+        if (span.empty()) {
+                m_selection[sel] = g_string_new(nullptr);
+        } else if (m_selection_format[sel] == VTE_FORMAT_HTML) {
+                m_selection[sel] = g_string_new(nullptr);
+                write_html(span, copied.block_mode,
+                           m_selection[sel], nullptr, nullptr, nullptr);
+        } else {
+                m_selection[sel] = get_text(span.start_row(),
+                                            span.start_column(),
+                                            span.end_row(),
+                                            span.end_column(),
+                                            copied.block_mode,
+                                            true /* wrap */,
+                                            nullptr /* attributes */);
+        }
 
-        m_paste_request.request_text(clip, &Terminal::widget_paste_received, this);
+        copied.screen = nullptr;
+        selection_copied_update_watch();
 }
 
-/* Confine coordinates into the visible area. Padding is already subtracted. */
 void
-Terminal::confine_coordinates(long *xp,
-                                        long *yp)
+Terminal::selection_copied_serialize_all()
 {
-	long x = *xp;
-	long y = *yp;
-        long y_stop;
+	for (auto sel = 0; sel < LAST_VTE_SELECTION; sel++)
+                selection_copied_serialize(VteSelection(sel));
+}
 
-        /* Allow to use the bottom extra padding only if there's content there. */
-        y_stop = MIN(m_view_usable_extents.height(),
-                     row_to_pixel(m_screen->insert_delta + m_row_count));
+/* Turns the copies into text which include rows that the incoming data can
+ * alter: the ones on the screen, and the one just above that a clear may
+ * hard wrap. The others only change when dropped, see the discard watch. */
+void
+Terminal::selection_copied_serialize_mutable()
+{
+	for (auto sel = 0; sel < LAST_VTE_SELECTION; sel++) {
+                auto const& copied = m_selection_copied[sel];
+                if (copied.screen != nullptr &&
+                    (copied.screen != m_screen ||
+                     copied.span.end_row() >= m_screen->insert_delta - 1))
+                        selection_copied_serialize(VteSelection(sel));
+        }
+}
+
+/* Asks the ring to tell before dropping the first row of a copy. */
+void
+Terminal::selection_copied_update_watch()
+{
+        auto row = G_MAXLONG;
+	for (auto sel = 0; sel < LAST_VTE_SELECTION; sel++) {
+                auto const& copied = m_selection_copied[sel];
+                if (copied.screen != nullptr)
+                        row = MIN(row, copied.span.start_row());
+        }
+
+        m_normal_screen.row_data->set_discard_watch(0, nullptr, nullptr);
+        m_alternate_screen.row_data->set_discard_watch(0, nullptr, nullptr);
+        if (row != G_MAXLONG)
+                m_screen->row_data->set_discard_watch(MAX(row, 0),
+                                                      selection_copied_discard_cb,
+                                                      this);
+}
+
+void
+Terminal::selection_copied_discard_cb(void* data)
+{
+        auto that = reinterpret_cast<Terminal*>(data);
+        that->selection_copied_serialize_all();
+}
+
+/* Paste from the given clipboard. */
+void
+Terminal::widget_paste(GdkAtom board)
+{
+        if (!m_input_enabled)
+                return;
+
+	auto clip = gtk_clipboard_get_for_display(gtk_widget_get_display(m_widget), board);
+	if (!clip)
+                return;
+
+        _vte_debug_print(VTE_DEBUG_SELECTION, "Requesting clipboard contents.\n");
+
+        m_paste_request.request_text(clip, &Terminal::widget_paste_received, this);
+}
+
+/* Confine coordinates into the visible area. Padding is already subtracted. */
+void
+Terminal::confine_coordinates(long *xp,
+                                        long *yp)
+{
+	long x = *xp;
+	long y = *yp;
+        long y_stop;
+
+        /* Allow to use the bottom extra padding only if there's content there. */
+        y_stop = MIN(m_view_usable_extents.height(),
+                     row_to_pixel(m_screen->insert_delta + m_row_count));
 
 	if (y < 0) {
 		y = 0;
@@ -6908,8 +8887,18 @@ Terminal::widget_motion_notify(GdkEventMotion *event)
                 m_mouse_last_position = pos;
 
                 set_pointer_autohidden(false);
-                hyperlink_hilite_update();
-                match_hilite_update();
+
+                /* Within a cell, the hovered hyperlink and match stay the same;
+                 * anything else changing them updates them itself. */
+                auto const visible = view_coords_visible(pos);
+                if (rowcol != m_mouse_last_hover_cell ||
+                    visible != m_mouse_last_hover_visible) {
+                        m_mouse_last_hover_cell = rowcol;
+                        m_mouse_last_hover_visible = visible;
+
+                        hyperlink_hilite_update();
+                        match_hilite_update();
+                }
         }
 
 	return handled;
@@ -7345,6 +9334,18 @@ Terminal::ensure_font()
 	}
 }
 
+bool
+Terminal::font_validation_timer_callback() noexcept
+{
+        if (m_draw != nullptr && _vte_draw_validate_fonts(m_draw)) {
+                m_fontdirty = true;
+                ensure_font();
+                invalidate_all();
+        }
+
+        return false; /* don't repeat */
+}
+
 void
 Terminal::update_font()
 {
@@ -7494,6 +9495,79 @@ Terminal::refresh_size()
         m_tabstops.resize(columns);
 }
 
+/* Drops the images of the current screen covering any of the rows
+ * @start..@end (exclusive), as the text under them is erased. */
+void
+Terminal::remove_images(vte::grid::row_t start,
+                        vte::grid::row_t end)
+{
+        auto const screen = image_screen(m_screen);
+        m_image_cache.for_each(screen, start, end, [&](vte::base::Image const& image) {
+                invalidate_rows(image.row(), image.end_row() - 1);
+        });
+        m_image_cache.remove_rows(screen, start, end);
+}
+
+/* Drops the images that scrolled out of the rings, and compresses the ones
+ * that scrolled off the screens, unless they are displayed. */
+void
+Terminal::prune_images()
+{
+        for (auto screen_ : {&m_normal_screen, &m_alternate_screen}) {
+                auto scrollback_end = screen_->insert_delta;
+                if (screen_ == m_screen)
+                        scrollback_end = std::min(scrollback_end, long(screen_->scroll_delta));
+
+                m_image_cache.prune(image_screen(screen_),
+                                    _vte_ring_delta(screen_->row_data), G_MAXLONG,
+                                    scrollback_end);
+        }
+}
+
+/* Adds the positions of the marks of @screen_ that are still in its ring
+ * to @markers, for moving them along with their text when rewrapping */
+void
+Terminal::mark_positions(VteScreen const* screen_,
+                         std::vector<VteVisualPosition*>& markers)
+{
+        if (screen_ != &m_normal_screen)
+                return;
+
+        auto const delta = _vte_ring_delta(screen_->row_data);
+        for (auto& mark : m_marks) {
+                if (mark.position.row >= delta)
+                        markers.push_back(&mark.position);
+        }
+        for (auto& mark : m_shell_marks) {
+                if (mark.position.row >= delta)
+                        markers.push_back(&mark.position);
+        }
+}
+
+/* Returns: the positions of the images of @screen_, for moving them
+ * along with the rows they start on when rewrapping */
+std::vector<VteVisualPosition>
+Terminal::image_positions(VteScreen const* screen_)
+{
+        auto positions = std::vector<VteVisualPosition>{};
+        m_image_cache.for_each(image_screen(screen_), [&](vte::base::Image const& image) {
+                positions.push_back({image.row(), image.column()});
+        });
+        return positions;
+}
+
+/* Sets the image positions got from image_positions(), in the same order */
+void
+Terminal::set_image_positions(VteScreen const* screen_,
+                              std::vector<VteVisualPosition> const& positions)
+{
+        auto it = positions.cbegin();
+        m_image_cache.for_each(image_screen(screen_), [&](vte::base::Image& image) {
+                image.set_position(it->row, it->col);
+                ++it;
+        });
+}
+
 /* Resize the given screen (normal or alternate) of the terminal. */
 void
 Terminal::screen_set_size(VteScreen *screen_,
@@ -7506,7 +9580,7 @@ Terminal::screen_set_size(VteScreen *screen_,
 	VteVisualPosition below_viewport;
 	VteVisualPosition below_current_paragraph;
         VteVisualPosition selection_start, selection_end;
-	VteVisualPosition *markers[7];
+        auto markers = std::vector<VteVisualPosition*>{};
         gboolean was_scrolled_to_top = ((long) ceil(screen_->scroll_delta) == _vte_ring_delta(ring));
         gboolean was_scrolled_to_bottom = ((long) screen_->scroll_delta == screen_->insert_delta);
 	glong old_top_lines;
@@ -7535,24 +9609,33 @@ Terminal::screen_set_size(VteScreen *screen_,
 		below_current_paragraph.row++;
 	}
 	below_current_paragraph.col = 0;
-        memset(&markers, 0, sizeof(markers));
-        markers[0] = &cursor_saved_absolute;
-        markers[1] = &below_viewport;
-        markers[2] = &below_current_paragraph;
-        markers[3] = &screen_->cursor;
+        markers.push_back(&cursor_saved_absolute);
+        markers.push_back(&below_viewport);
+        markers.push_back(&below_current_paragraph);
+        markers.push_back(&screen_->cursor);
         if (!m_selection_resolved.empty()) {
                 selection_start.row = m_selection_resolved.start_row();
                 selection_start.col = m_selection_resolved.start_column();
                 selection_end.row = m_selection_resolved.end_row();
                 selection_end.col = m_selection_resolved.end_column();
-                markers[4] = &selection_start;
-                markers[5] = &selection_end;
+                markers.push_back(&selection_start);
+                markers.push_back(&selection_end);
 	}
+        mark_positions(screen_, markers);
+        auto images = image_positions(screen_);
+        for (auto& position : images)
+                markers.push_back(&position);
+        markers.push_back(nullptr);
 
 	old_top_lines = below_current_paragraph.row - screen_->insert_delta;
 
-	if (do_rewrap && old_columns != m_column_count)
-		_vte_ring_rewrap(ring, m_column_count, markers);
+	if (do_rewrap && old_columns != m_column_count) {
+		_vte_ring_rewrap(ring, m_column_count, markers.data());
+                set_image_positions(screen_, images);
+                /* Rewrap the rest of the scrollback once the resizing stops */
+                if (ring->rewrap_pending())
+                        m_rewrap_timer.schedule(VTE_REWRAP_DELAY, vte::glib::Timer::Priority::eDEFAULT_IDLE);
+        }
 
 	if (_vte_ring_length(ring) > m_row_count) {
 		/* The content won't fit without scrollbars. Before figuring out the position, we might need to
@@ -7634,6 +9717,115 @@ Terminal::screen_set_size(VteScreen *screen_,
 		screen_->scroll_delta = new_scroll_delta;
 }
 
+/* Put the scrollback rows that screen_set_size() left for rewrapping later
+ * in place, see Ring::rewrap(). */
+void
+Terminal::rewrap_finish()
+{
+        VteScreen *screen_ = &m_normal_screen;
+	VteRing *ring = screen_->row_data;
+	VteVisualPosition cursor_saved_absolute;
+	VteVisualPosition below_viewport;
+        VteVisualPosition selection_start, selection_end;
+        auto markers = std::vector<VteVisualPosition*>{};
+        gboolean was_scrolled_to_top = ((long) ceil(screen_->scroll_delta) == _vte_ring_delta(ring));
+	double new_scroll_delta;
+
+        if (!ring->rewrap_pending())
+                return;
+
+        cursor_saved_absolute.row = screen_->saved.cursor.row + screen_->insert_delta;
+        cursor_saved_absolute.col = screen_->saved.cursor.col;
+	below_viewport.row = screen_->scroll_delta + m_row_count;
+	below_viewport.col = 0;
+        markers.push_back(&cursor_saved_absolute);
+        markers.push_back(&below_viewport);
+        auto const has_selection = screen_ == m_screen && !m_selection_resolved.empty();
+        if (has_selection) {
+                selection_start.row = m_selection_resolved.start_row();
+                selection_start.col = m_selection_resolved.start_column();
+                selection_end.row = m_selection_resolved.end_row();
+                selection_end.col = m_selection_resolved.end_column();
+                markers.push_back(&selection_start);
+                markers.push_back(&selection_end);
+        }
+        mark_positions(screen_, markers);
+        auto images = image_positions(screen_);
+        for (auto& position : images)
+                markers.push_back(&position);
+        markers.push_back(nullptr);
+
+        ring->rewrap_finish(markers.data());
+        set_image_positions(screen_, images);
+
+        if (has_selection) {
+                m_selection_resolved.set ({ selection_start.row, selection_start.col },
+                                          { selection_end.row, selection_end.col });
+        }
+        screen_->saved.cursor.row = cursor_saved_absolute.row - screen_->insert_delta;
+        screen_->saved.cursor.col = cursor_saved_absolute.col;
+
+        /* The rows at and below insert_delta didn't move, only the ones above them */
+        if (was_scrolled_to_top) {
+                new_scroll_delta = _vte_ring_delta(ring);
+        } else {
+                new_scroll_delta = below_viewport.row - m_row_count;
+                new_scroll_delta += screen_->scroll_delta - floor(screen_->scroll_delta);
+        }
+
+	_vte_debug_print(VTE_DEBUG_RESIZE,
+			"Finished rewrapping, new scroll_delta=%f\n", new_scroll_delta);
+
+	if (screen_ == m_screen) {
+		queue_adjustment_value_changed(new_scroll_delta);
+                adjust_adjustments_full();
+                m_ringview.invalidate();
+                invalidate_all();
+        } else {
+		screen_->scroll_delta = new_scroll_delta;
+        }
+}
+
+bool
+Terminal::rewrap_timer_callback() noexcept
+{
+        VteRing *ring = m_normal_screen.row_data;
+
+        /* Finish right away if the rows are (about to be) shown, otherwise
+         * go on in slices so as not to block the main loop for long. */
+        auto const shown = m_screen == &m_normal_screen &&
+                m_screen->scroll_delta < ring->rewrap_pending_end();
+        if (!shown && !ring->rewrap_step(VTE_REWRAP_SLICE_ROWS)) {
+                m_rewrap_timer.schedule_idle(vte::glib::Timer::Priority::eDEFAULT_IDLE);
+                return false;
+        }
+
+        rewrap_finish();
+        return false; /* don't repeat */
+}
+
+bool
+Terminal::resize_timer_callback() noexcept
+{
+        if (!m_resize_pending)
+                return false; /* don't repeat */
+
+        _vte_debug_print(VTE_DEBUG_RESIZE,
+                         "Resizing stopped at %ldx%ld.\n",
+                         m_pending_columns, m_pending_rows);
+
+        m_resize_pending = false;
+        set_size(m_pending_columns, m_pending_rows);
+        queue_contents_changed();
+
+        if (widget_realized()) {
+                reset_update_rects();
+                invalidate_all();
+        }
+
+        return false; /* don't repeat */
+}
+
 void
 Terminal::set_size(long columns,
                              long rows)
@@ -7660,6 +9852,9 @@ Terminal::set_size(long columns,
                 m_tabstops.resize(columns);
 	}
 	if (old_rows != m_row_count || old_columns != m_column_count) {
+                /* The rewrap moves the rows of the copies */
+                selection_copied_serialize_all();
+
                 m_scrolling_restricted = FALSE;
 
                 _vte_ring_set_visible_rows(m_normal_screen.row_data, m_row_count);
@@ -7702,6 +9897,13 @@ Terminal::vadjustment_value_changed()
 	double dy = adj - m_screen->scroll_delta;
 	m_screen->scroll_delta = adj;
 
+        /* Scrolled to rows that still await rewrapping; unless still resizing */
+        if (m_screen == &m_normal_screen &&
+            !m_rewrap_timer &&
+            m_screen->row_data->rewrap_pending() &&
+            adj < m_screen->row_data->rewrap_pending_end())
+                m_rewrap_timer.schedule_idle(vte::glib::Timer::Priority::eHIGH);
+
 	/* Sanity checks. */
         if (G_UNLIKELY(!widget_realized()))
                 return;
@@ -7710,8 +9912,9 @@ Terminal::vadjustment_value_changed()
 	if (!_vte_double_equal(dy, 0)) {
 		_vte_debug_print(VTE_DEBUG_ADJ,
 			    "Scrolling by %f\n", dy);
-                invalidate_all();
+                invalidate_view();
                 match_contents_clear();
+                prefetch_scrollback(dy);
 		emit_text_scrolled(dy);
 		queue_contents_changed();
 	} else {
@@ -7719,6 +9922,50 @@ Terminal::vadjustment_value_changed()
 	}
 }
 
+/* Guesses from the direction and the speed of scrolling which rows of the
+ * scrollback come into view next, and has them thawed while idle, so that
+ * the frames don't have to read, decrypt and uncompress them. Reading
+ * them also gets the streams to unseal their next blocks on their worker. */
+void
+Terminal::prefetch_scrollback(double dy)
+{
+        auto const now = g_get_monotonic_time();
+        auto const dt = now - m_scroll_time;
+        m_scroll_time = now;
+        if (dt <= 0 || dt > VTE_SCROLL_SPEED_RESET_TIME)
+                m_scroll_speed = 0;
+        else  /* smoothed over the last few changes */
+                m_scroll_speed = (m_scroll_speed + dy * G_USEC_PER_SEC / dt) / 2;
+
+        auto const ring = m_screen->row_data;
+        auto const ahead = CLAMP(long(std::abs(m_scroll_speed) * VTE_PREFETCH_LEAD_TIME / G_USEC_PER_SEC),
+                                 m_row_count, VTE_PREFETCH_MAX_SCREENS * m_row_count);
+        auto const top = std::max(long(m_screen->scroll_delta), long(ring->delta()));
+
+        m_prefetch_backward = dy < 0;
+        if (m_prefetch_backward) {
+                m_prefetch_start = std::max(top - ahead, long(ring->delta()));
+                m_prefetch_end = top;
+        } else {
+                m_prefetch_start = top + m_row_count;
+                m_prefetch_end = top + m_row_count + ahead;
+        }
+
+        if (m_prefetch_start >= std::min(m_prefetch_end, ring->writable()))
+                m_prefetch_timer.abort();
+        else if (!m_prefetch_timer)
+                m_prefetch_timer.schedule_idle(vte::glib::Timer::Priority::eDEFAULT_IDLE);
+}
+
+bool
+Terminal::prefetch_timer_callback() noexcept
+{
+        /* A few rows at a time, to keep out of the way of the frames */
+        return m_screen->row_data->prefetch(&m_prefetch_start, &m_prefetch_end,
+                                            m_prefetch_backward,
+                                            VTE_PREFETCH_SLICE_ROWS);
+}
+
 void
 Terminal::widget_set_vadjustment(vte::glib::RefPtr<GtkAdjustment>&& adjustment)
 {
@@ -7796,15 +10043,13 @@ Terminal::Terminal(vte::platform::Widget* w,
 	for (i = 0; i < VTE_PALETTE_SIZE; i++)
 		m_palette[i].sources[VTE_COLOR_SOURCE_ESCAPE].is_set = FALSE;
 
-	/* Set up I/O encodings. */
-	m_outgoing = _vte_byte_array_new();
-
 	/* Setting the terminal type and size requires the PTY master to
 	 * be set up properly first. */
         set_size(VTE_COLUMNS, VTE_ROWS);
 
         /* Default is 0, forces update in vte_terminal_set_scrollback_lines */
 	set_scrollback_lines(VTE_SCROLLBACK_INIT);
+        m_normal_screen.row_data->set_evict_func(scrollback_evicted_cb, this);
 
 	/* Selection info. */
 	display = gtk_widget_get_display(m_widget);
@@ -7943,15 +10188,31 @@ Terminal::widget_size_allocate(GtkAllocation *allocation)
 	gtk_widget_set_allocation(m_widget, allocation);
         set_allocated_rect(*allocation);
 
-	if (width != m_column_count
-			|| height != m_row_count
-			|| update_scrollback)
-	{
+        auto const resize = width != m_column_count
+                || height != m_row_count
+                || update_scrollback;
+
+        /* The first size is applied right away, but while the resizing
+         * goes on only the last one is, once no new size came for
+         * m_resize_delay; the contents are clipped or padded until then.
+         * This saves rewrapping, and the child redrawing on SIGWINCH,
+         * for every size in between.
+         */
+        if (m_resize_timer) {
+                m_pending_columns = width;
+                m_pending_rows = height;
+                m_resize_pending = resize;
+                if (resize)
+                        m_resize_timer.schedule(m_resize_delay, vte::glib::Timer::Priority::eDEFAULT);
+        } else if (resize) {
 		/* Set the size of the pseudo-terminal. */
 		set_size(width, height);
 
 		/* Notify viewers that the contents have changed. */
 		queue_contents_changed();
+
+                if (m_resize_delay != 0)
+                        m_resize_timer.schedule(m_resize_delay, vte::glib::Timer::Priority::eDEFAULT);
 	}
 
 	if (widget_realized()) {
@@ -7963,10 +10224,29 @@ Terminal::widget_size_allocate(GtkAllocation *allocation)
 	}
 }
 
+void
+Terminal::widget_map()
+{
+        set_background(false);
+}
+
 void
 Terminal::widget_unmap()
 {
         m_ringview.pause();
+
+        /* Nothing blinks while not shown; drawing after mapping again restarts it */
+        m_text_blink_timer.abort();
+
+        /* The frame clock won't tick for us anymore; hand over
+         * to the timeouts if still processing.
+         */
+        if (m_tick_callback_id != 0) {
+                unschedule_frame();
+                add_process_timeout(this, false);
+        }
+
+        set_background(true);
 }
 
 void
@@ -7984,6 +10264,7 @@ Terminal::widget_unrealize()
 		_vte_draw_free(m_draw);
 		m_draw = NULL;
 	}
+        frame_free();
 	m_fontdirty = true;
 
 	/* Unmap the widget if it hasn't been already. */
@@ -8051,6 +10332,7 @@ Terminal::~Terminal()
 	if (m_draw != NULL) {
 		_vte_draw_free(m_draw);
 	}
+        frame_free();
 
 	/* Free matching data. */
 	if (m_match_attributes != NULL) {
@@ -8058,8 +10340,8 @@ Terminal::~Terminal()
 	}
 	g_free(m_match_contents);
 
-	if (m_search_attrs)
-		g_array_free (m_search_attrs, TRUE);
+	if (m_search_text)
+		g_string_free (m_search_text, TRUE);
 
 	/* Disconnect from autoscroll requests. */
 	stop_autoscroll();
@@ -8071,6 +10353,9 @@ Terminal::~Terminal()
 	 * throw the text onto the clipboard without an owner so that it
 	 * doesn't just disappear. */
 	for (sel = VTE_SELECTION_PRIMARY; sel < LAST_VTE_SELECTION; sel++) {
+                if (m_selection_owned[sel])
+                        selection_copied_serialize(VteSelection(sel));
+                m_selection_copied[sel].screen = nullptr;
 		if (m_selection[sel] != nullptr) {
 			if (m_selection_owned[sel]) {
                                 // FIXMEchpe we should check m_selection_format[sel]
@@ -8093,8 +10378,8 @@ Terminal::~Terminal()
         }
 
 	/* Discard any pending data. */
-	_vte_byte_array_free(m_outgoing);
-        m_outgoing = nullptr;
+        m_outgoing.clear();
+        paste_stop();
 
 	/* Free public-facing data. */
         if (m_vadjustment) {
@@ -8111,6 +10396,11 @@ Terminal::~Terminal()
 void
 Terminal::widget_realize()
 {
+        if (m_headless) {
+                set_headless(false);
+                g_object_notify_by_pspec(G_OBJECT(m_terminal), pspecs[PROP_HEADLESS]);
+        }
+
         m_mouse_cursor_over_widget = FALSE;  /* We'll receive an enter_notify_event if the window appears under the cursor. */
 
 	/* Create rendering data if this is a re-realise */
@@ -8250,11 +10540,51 @@ Terminal::determine_cursor_colors(VteCell const* cell,
                          fore, back, deco);
 }
 
+/* Invalidates the cells with blinking text, as the frame recorded them;
+ * or everything when there is no frame.
+ */
+void
+Terminal::invalidate_text_blink()
+{
+        if (!m_frame_valid || m_frame_screen != m_screen) {
+                invalidate_all();
+                return;
+        }
+
+        auto const first_row = std::max(first_displayed_row(), m_frame_keys_first_row);
+        auto const last_row = std::min(last_displayed_row(),
+                                       m_frame_keys_first_row + long(m_frame_rows.size()) - 1);
+        auto const allocation = get_allocated_rect();
+        auto region = cairo_region_create();
+        for (auto row = first_row; row <= last_row; row++) {
+                auto const& frame_row = m_frame_rows[row - m_frame_keys_first_row];
+                if (frame_row.blink_start >= frame_row.blink_end)
+                        continue;
+
+                frame_damage_rows(row, row);
+
+                /* Include a column on each side for glyphs overflowing their cells */
+                auto rect = damage_rect(row, row, frame_row.blink_start - 1, frame_row.blink_end + 1);
+                rect.x += allocation.x + m_padding.left;
+                rect.y += allocation.y + m_padding.top;
+                cairo_region_union_rectangle(region, &rect);
+        }
+
+        if (!cairo_region_is_empty(region))
+                gtk_widget_queue_draw_region(m_widget, region);
+        cairo_region_destroy(region);
+}
+
 // FIXMEchpe this constantly removes and reschedules the timer. improve this!
 bool
 Terminal::text_blink_timer_callback() noexcept
 {
-        invalidate_all();
+        /* Blinking may have been turned off since, by losing the focus */
+        if (!((unsigned)m_text_blink_mode & (unsigned)(m_has_focus ? TextBlinkMode::eFOCUSED : TextBlinkMode::eUNFOCUSED)))
+                return false;
+
+        /* Only the cells with blinking text need painting again */
+        invalidate_text_blink();
         return false; /* don't run again */
 }
 
@@ -8717,7 +11047,7 @@ Terminal::draw_cells_with_attributes(struct _vte_draw_text_request *items,
                                         deco,
 					TRUE, draw_default_bg,
 					cells[j].attr.attr & attr_mask,
-                                        m_allow_hyperlink && cells[j].attr.hyperlink_idx != 0,
+                                        FALSE, /* the preedit text is not a hyperlink */
 					FALSE, column_width, height);
 		j += g_unichar_to_utf8(items[i].c, scratch_buf);
 	}
@@ -8727,6 +11057,8 @@ Terminal::draw_cells_with_attributes(struct _vte_draw_text_request *items,
 void
 Terminal::ringview_update()
 {
+        vte::base::FrameStats::Scope stats_scope{m_frame_stats, vte::base::FrameStats::Stage::eRingview};
+
         auto first_row = first_displayed_row();
         auto last_row = last_displayed_row();
         if (cursor_is_onscreen())
@@ -8743,6 +11075,32 @@ Terminal::ringview_update()
 /* Paint the contents of a given row at the given location.  Take advantage
  * of multiple-draw APIs by finding runs of characters with identical
  * attributes and bundling them together. */
+/* Paints the images of @screen_ on the rows @start_row..@end_row (exclusive),
+ * from their cairo surfaces, which are made as they are first needed. */
+void
+Terminal::draw_images(VteScreen *screen_,
+                      vte::grid::row_t start_row,
+                      vte::grid::row_t end_row,
+                      gint start_y,
+                      gint column_width,
+                      gint row_height)
+{
+        m_image_cache.for_each_shown(image_screen(screen_), start_row, end_row, [&](vte::base::Image& image) {
+                auto surface = reinterpret_cast<cairo_surface_t*>(image.surface());
+                if (surface == nullptr) {
+                        surface = cairo_image_surface_create_for_data(reinterpret_cast<unsigned char*>(image.pixels()),
+                                                                      CAIRO_FORMAT_ARGB32,
+                                                                      image.width(), image.height(),
+                                                                      image.stride());
+                        image.set_surface(surface, GDestroyNotify(cairo_surface_destroy));
+                }
+
+                _vte_draw_draw_surface(m_draw, surface,
+                                       image.column() * column_width,
+                                       start_y + (image.row() - start_row) * row_height);
+        });
+}
+
 void
 Terminal::draw_rows(VteScreen *screen_,
                     cairo_region_t const* region,
@@ -8758,6 +11116,7 @@ Terminal::draw_rows(VteScreen *screen_,
         int y;
         guint fore = VTE_DEFAULT_FG, nfore, back = VTE_DEFAULT_BG, nback, deco = VTE_DEFAULT_FG, ndeco;
         gboolean hyperlink = FALSE, nhyperlink, hilite = FALSE, nhilite;
+        vte::base::Ring::hyperlink_idx_t hyperlink_idx;
         gboolean selected;
         gboolean nrtl = FALSE, rtl;  /* for debugging */
         uint32_t attr = 0, nattr;
@@ -8769,11 +11128,64 @@ Terminal::draw_rows(VteScreen *screen_,
         auto const column_count = m_column_count;
         uint32_t const attr_mask = m_allow_bold ? ~0 : ~VTE_ATTR_BOLD_MASK;
 
+        vte::base::Trace::Scope trace_scope{"draw-rows"};
+        trace_scope.set_count(end_row - start_row, "rows");
+
         /* Need to ensure the ringview is updated. */
         ringview_update();
 
+        vte::base::FrameStats::Scope stats_scope{m_frame_stats, vte::base::FrameStats::Stage::eDraw};
+
         items = g_newa (struct _vte_draw_text_request, column_count);
 
+        /* Look up the selection once per row, for both the background and the text,
+         * rather than for each of their cells. The runs of row are
+         * selection_runs[selection_row_runs[row - start_row]..selection_row_runs[row - start_row + 1]]. */
+        auto selection_runs = std::vector<SelectionRun>{};
+        auto selection_row_runs = std::vector<size_t>{};
+        selection_row_runs.reserve(end_row - start_row + 1);
+        for (row = start_row; row < end_row; row++) {
+                selection_row_runs.push_back(selection_runs.size());
+                append_selection_runs(row, selection_runs);
+        }
+        selection_row_runs.push_back(selection_runs.size());
+
+        auto const is_selected_vis = [&](vte::grid::column_t col,
+                                         vte::grid::row_t row_) -> gboolean {
+                auto const runs_begin = selection_runs.cbegin() + selection_row_runs[row_ - start_row];
+                auto const runs_end = selection_runs.cbegin() + selection_row_runs[row_ - start_row + 1];
+                /* The first run not ending before or at the column */
+                auto const run = std::upper_bound(runs_begin, runs_end, col,
+                                                  [](vte::grid::column_t c, SelectionRun const& r) {
+                                                          return c < r.end;
+                                                  });
+                return run != runs_end && run->start <= col;
+        };
+
+        /* Resolve the colours once per look of the cells, rather than for each */
+        auto color_cache = vte::base::ColorCache{};
+        auto const determine_cell_colors = [&](VteCell const* cell_,
+                                               gboolean selected_,
+                                               guint* pfore,
+                                               guint* pback,
+                                               guint* pdeco) {
+                auto const& cell_attr = cell_ ? cell_->attr : basic_cell.attr;
+                auto const bits = cell_attr.attr & (VTE_ATTR_BOLD_MASK |
+                                                    VTE_ATTR_DIM_MASK |
+                                                    VTE_ATTR_REVERSE_MASK |
+                                                    VTE_ATTR_INVISIBLE_MASK);
+                if (auto const cached = color_cache.lookup(cell_attr.colors(), bits, selected_)) {
+                        *pfore = cached->fore;
+                        *pback = cached->back;
+                        *pdeco = cached->deco;
+                        return;
+                }
+
+                determine_colors(cell_, selected_, pfore, pback, pdeco);
+                color_cache.insert(cell_attr.colors(), bits, selected_,
+                                   vte::base::ColorCache::Colors{*pfore, *pback, *pdeco});
+        };
+
         /* Paint the background.
          * Do it first for all the cells we're about to paint, before drawing the glyphs,
          * so that overflowing bits of a glyph (to the right or downwards) won't be
@@ -8782,6 +11194,32 @@ Terminal::draw_rows(VteScreen *screen_,
          * Process each row independently. */
         int const rect_width = get_allocated_width();
 
+        /* The default background has already been painted. Runs of another
+         * background at the same columns of consecutive rows are merged into one
+         * rectangle, so that a full-screen coloured UI needs few fills.
+         * bg_rects holds the ones that may still grow downwards, by column. */
+        struct bg_rect {
+                vte::grid::column_t start, end;
+                int y, height;
+                guint back;
+        };
+        auto bg_rects = std::vector<bg_rect>{};
+        auto next_bg_rects = std::vector<bg_rect>{};
+        auto n_fills = 0;
+        /* The BiDi debugging shades the backgrounds as they are painted */
+        auto const merge_bg = !_vte_debug_on(VTE_DEBUG_BIDI);
+        auto const fill_bg_rect = [&](bg_rect const& r) {
+                vte::color::rgb bg;
+                rgb_from_index<8, 8, 8>(r.back, bg);
+                _vte_draw_fill_rectangle (m_draw,
+                                          r.start * column_width,
+                                          r.y,
+                                          (r.end - r.start) * column_width,
+                                          r.height,
+                                          &bg, VTE_DRAW_OPAQUE);
+                n_fills++;
+        };
+
         /* The rect contains the area of the row, and is moved row-wise in the loop. */
         auto rect = cairo_rectangle_int_t{-m_padding.left, start_y, rect_width, row_height};
         for (row = start_row, y = start_y;
@@ -8791,6 +11229,15 @@ Terminal::draw_rows(VteScreen *screen_,
                 if (cairo_region_contains_rectangle(region, &rect) == CAIRO_REGION_OVERLAP_OUT)
                         continue;
 
+                /* A skipped row ends all the rectangles */
+                if (!bg_rects.empty() && bg_rects.front().y + bg_rects.front().height != y) {
+                        for (auto const& r : bg_rects)
+                                fill_bg_rect(r);
+                        bg_rects.clear();
+                }
+                next_bg_rects.clear();
+                size_t k = 0;
+
 		row_data = find_row_data(row);
                 bidirow = m_ringview.get_bidirow(row);
 
@@ -8825,8 +11272,8 @@ Terminal::draw_rows(VteScreen *screen_,
                         /* Get the first cell's contents. */
                         cell = row_data ? _vte_row_data_get (row_data, bidirow->vis2log(i)) : nullptr;
                         /* Find the colors for this cell. */
-                        selected = cell_is_selected_vis(i, row);
-                        determine_colors(cell, selected, &fore, &back, &deco);
+                        selected = is_selected_vis(i, row);
+                        determine_cell_colors(cell, selected, &fore, &back, &deco);
                         rtl = bidirow->vis_is_rtl(i);
 
                         while (++j < column_count) {
@@ -8835,22 +11282,30 @@ Terminal::draw_rows(VteScreen *screen_,
                                 /* Resolve attributes to colors where possible and
                                  * compare visual attributes to the first character
                                  * in this chunk. */
-                                selected = cell_is_selected_vis(j, row);
-                                determine_colors(cell, selected, &nfore, &nback, &ndeco);
+                                selected = is_selected_vis(j, row);
+                                determine_cell_colors(cell, selected, &nfore, &nback, &ndeco);
                                 nrtl = bidirow->vis_is_rtl(j);
                                 if (nback != back || (_vte_debug_on (VTE_DEBUG_BIDI) && nrtl != rtl)) {
                                         break;
                                 }
                         }
                         if (back != VTE_DEFAULT_BG) {
-                                vte::color::rgb bg;
-                                rgb_from_index<8, 8, 8>(back, bg);
-                                _vte_draw_fill_rectangle (m_draw,
-                                                          i * column_width,
-                                                          y,
-                                                          (j - i) * column_width,
-                                                          row_height,
-                                                          &bg, VTE_DRAW_OPAQUE);
+                                auto r = bg_rect{i, j, y, row_height, back};
+                                if (!merge_bg) {
+                                        fill_bg_rect(r);
+                                } else {
+                                        /* Either it continues the rectangle above, or that one ends */
+                                        while (k < bg_rects.size() && bg_rects[k].start < i)
+                                                fill_bg_rect(bg_rects[k++]);
+                                        if (k < bg_rects.size() &&
+                                            bg_rects[k].start == i &&
+                                            bg_rects[k].end == j &&
+                                            bg_rects[k].back == back) {
+                                                r.y = bg_rects[k].y;
+                                                r.height += bg_rects[k++].height;
+                                        }
+                                        next_bg_rects.push_back(r);
+                                }
                         }
 
                         _VTE_DEBUG_IF (VTE_DEBUG_BIDI) {
@@ -8895,8 +11350,24 @@ Terminal::draw_rows(VteScreen *screen_,
                          * match the first one in this set. */
                         i = j;
                 } while (i < column_count);
+
+                /* The rectangles not continued in this row are complete */
+                while (k < bg_rects.size())
+                        fill_bg_rect(bg_rects[k++]);
+                std::swap(bg_rects, next_bg_rects);
         }
 
+        for (auto const& r : bg_rects)
+                fill_bg_rect(r);
+
+        _vte_debug_print(VTE_DEBUG_DRAW,
+                         "draw_rows: %d background fills for rows %ld..%ld\n",
+                         n_fills, long(start_row), long(end_row));
+        m_frame_stats.add(vte::base::FrameStats::Counter::eFills, n_fills);
+
+        /* The images go over the background, and under the text */
+        draw_images(screen_, start_row, end_row, start_y, column_width, row_height);
+
 
         /* Render the text.
          * The rect contains the area of the row (enlarged a bit at the top and bottom
@@ -8907,6 +11378,10 @@ Terminal::draw_rows(VteScreen *screen_,
                                      rect_width,
                                      row_height + cell_overflow_top() + cell_overflow_bottom()};
 
+        /* Queue the glyphs of each row and draw them per font and colour,
+         * rather than once per run of cells. */
+        _vte_draw_begin_glyph_batch(m_draw);
+
         for (row = start_row, y = start_y;
              row < end_row;
              row++, y += row_height, rect.y += row_height) {
@@ -8934,7 +11409,8 @@ Terminal::draw_rows(VteScreen *screen_,
                         cell = _vte_row_data_get (row_data, lcol);
                         g_assert(cell != nullptr);
 
-                        nhyperlink = (m_allow_hyperlink && cell->attr.hyperlink_idx != 0);
+                        hyperlink_idx = _vte_row_data_get_hyperlink(row_data, lcol);
+                        nhyperlink = (m_allow_hyperlink && hyperlink_idx != 0);
                         if (cell->c == 0 ||
                                 ((cell->c == ' ' || cell->c == '\t') &&  // FIXME '\t' is newly added now, double check
                                  cell->attr.has_none(VTE_ATTR_UNDERLINE_MASK |
@@ -8950,10 +11426,10 @@ Terminal::draw_rows(VteScreen *screen_,
 
                         /* Find the colors for this cell. */
                         nattr = cell->attr.attr;
-                        selected = cell_is_selected_log(lcol, row);
-                        determine_colors(cell, selected, &nfore, &nback, &ndeco);
+                        selected = is_selected_vis(vcol, row);
+                        determine_cell_colors(cell, selected, &nfore, &nback, &ndeco);
 
-                        nhilite = (nhyperlink && cell->attr.hyperlink_idx == m_hyperlink_hover_idx) ||
+                        nhilite = (nhyperlink && hyperlink_idx == m_hyperlink_hover_idx) ||
                                   (!nhyperlink && regex_match_has_current() && m_match_span.contains(row, lcol));
 
                         /* See if it no longer fits the run. */
@@ -8972,6 +11448,7 @@ Terminal::draw_rows(VteScreen *screen_,
                                     hyperlink != nhyperlink ||
                                     hilite != nhilite)) {
                                 /* Draw the completed run of cells and start a new one. */
+                                m_frame_stats.add(vte::base::FrameStats::Counter::eDrawItems, item_count);
                                 draw_cells(items, item_count,
                                            fore, back, deco, FALSE, FALSE,
                                            attr & attr_mask,
@@ -9025,6 +11502,7 @@ Terminal::draw_rows(VteScreen *screen_,
 
                 /* Draw the last run of cells in the row. */
                 if (item_count > 0) {
+                        m_frame_stats.add(vte::base::FrameStats::Counter::eDrawItems, item_count);
                         draw_cells(items, item_count,
                                    fore, back, deco, FALSE, FALSE,
                                    attr & attr_mask,
@@ -9032,6 +11510,8 @@ Terminal::draw_rows(VteScreen *screen_,
                                    column_width, row_height);
                 }
         }
+
+        _vte_draw_end_glyph_batch(m_draw);
 }
 
 void
@@ -9194,7 +11674,7 @@ Terminal::paint_cursor()
                                                         &item, 1,
                                                         fore, back, deco, TRUE, FALSE,
                                                         cell->attr.attr & attr_mask,
-                                                        m_allow_hyperlink && cell->attr.hyperlink_idx != 0,
+                                                        m_allow_hyperlink && _vte_row_data_get_hyperlink(row_data, lcol) != 0,
                                                         FALSE,
                                                         width,
                                                         height);
@@ -9299,34 +11779,20 @@ Terminal::paint_im_preedit_string()
 	}
 }
 
+/* Paints the rows in @region (in widget coordinates) into @cr. */
 void
-Terminal::widget_draw(cairo_t *cr)
+Terminal::draw_frame(cairo_t* cr,
+                     cairo_region_t const* region)
 {
-        cairo_rectangle_int_t clip_rect;
-        cairo_region_t *region;
-        int allocated_width, allocated_height;
-        int extra_area_for_cursor;
-        bool text_blink_enabled_now;
-        gint64 now = 0;
+        auto const allocated_width = get_allocated_width();
+        auto const allocated_height = get_allocated_height();
 
-        if (!gdk_cairo_get_clip_rectangle (cr, &clip_rect))
-                return;
+        cairo_save(cr);
+        gdk_cairo_region(cr, region);
+        cairo_clip(cr);
 
-        _vte_debug_print(VTE_DEBUG_LIFECYCLE, "vte_terminal_draw()\n");
-        _vte_debug_print (VTE_DEBUG_WORK, "+");
-        _vte_debug_print (VTE_DEBUG_UPDATES, "Draw (%d,%d)x(%d,%d)\n",
-                          clip_rect.x, clip_rect.y,
-                          clip_rect.width, clip_rect.height);
-
-        region = vte_cairo_get_clip_region (cr);
-        if (region == NULL)
-                return;
-
-        allocated_width = get_allocated_width();
-        allocated_height = get_allocated_height();
-
-	/* Designate the start of the drawing operation and clear the area. */
-	_vte_draw_set_cairo(m_draw, cr);
+	/* Designate the start of the drawing operation and clear the area. */
+	_vte_draw_set_cairo(m_draw, cr);
 
         if (G_LIKELY(m_clear_background)) {
                 _vte_draw_clear (m_draw, 0, 0,
@@ -9336,14 +11802,58 @@ Terminal::widget_draw(cairo_t *cr)
 
         /* Clip vertically, for the sake of smooth scrolling. We want the top and bottom paddings to be unused.
          * Don't clip horizontally so that antialiasing can legally overflow to the right padding. */
-        cairo_save(cr);
         cairo_rectangle(cr, 0, m_padding.top, allocated_width, allocated_height - m_padding.top - m_padding.bottom);
         cairo_clip(cr);
 
         cairo_translate(cr, m_padding.left, m_padding.top);
 
         /* Transform to view coordinates */
-        cairo_region_translate(region, -m_padding.left, -m_padding.top);
+        auto view_region = cairo_region_copy(region);
+        cairo_region_translate(view_region, -m_padding.left, -m_padding.top);
+
+        /* and now paint them */
+        auto const first_row = first_displayed_row();
+        draw_rows(m_screen,
+                  view_region,
+                  first_row,
+                  last_displayed_row() + 1,
+                  row_to_pixel(first_row),
+                  m_cell_width,
+                  m_cell_height);
+
+        cairo_region_destroy(view_region);
+	_vte_draw_set_cairo(m_draw, NULL);
+        cairo_restore(cr);
+}
+
+void
+Terminal::widget_draw(cairo_t *cr)
+{
+        cairo_rectangle_int_t clip_rect;
+        cairo_region_t *region;
+        int allocated_width, allocated_height;
+        int extra_area_for_cursor;
+        bool text_blink_enabled_now;
+        gint64 now = 0;
+
+        if (!gdk_cairo_get_clip_rectangle (cr, &clip_rect))
+                return;
+
+        vte::base::Trace::Scope trace_scope{"widget-draw"};
+        auto const paint_start = g_get_monotonic_time();
+
+        _vte_debug_print(VTE_DEBUG_LIFECYCLE, "vte_terminal_draw()\n");
+        _vte_debug_print (VTE_DEBUG_WORK, "+");
+        _vte_debug_print (VTE_DEBUG_UPDATES, "Draw (%d,%d)x(%d,%d)\n",
+                          clip_rect.x, clip_rect.y,
+                          clip_rect.width, clip_rect.height);
+
+        region = vte_cairo_get_clip_region (cr);
+        if (region == NULL)
+                return;
+
+        allocated_width = get_allocated_width();
+        allocated_height = get_allocated_height();
 
         /* Whether blinking text should be visible now */
         m_text_blink_state = true;
@@ -9353,18 +11863,55 @@ Terminal::widget_draw(cairo_t *cr)
                 if (now % (m_text_blink_cycle * 2) >= m_text_blink_cycle)
                         m_text_blink_state = false;
         }
-        /* Painting will flip this if it encounters any cell with blink attribute */
-        m_text_to_blink = false;
 
-        /* and now paint them */
-        auto const first_row = first_displayed_row();
-        draw_rows(m_screen,
-                  region,
-                  first_row,
-                  last_displayed_row() + 1,
-                  row_to_pixel(first_row),
-                  m_cell_width,
-                  m_cell_height);
+        /* Paint the rows into the frame kept from the last time, and copy
+         * that to the window. Without the frame, paint them directly. */
+        auto frame_region = frame_update();
+        if (frame_region != nullptr) {
+                if (!cairo_region_is_empty(frame_region)) {
+                        auto fcr = cairo_create(m_frame_surface);
+                        if (!m_clear_background) {
+                                /* Otherwise nothing paints over the old contents */
+                                cairo_save(fcr);
+                                gdk_cairo_region(fcr, frame_region);
+                                cairo_clip(fcr);
+                                cairo_set_operator(fcr, CAIRO_OPERATOR_CLEAR);
+                                cairo_paint(fcr);
+                                cairo_restore(fcr);
+                        }
+                        draw_frame(fcr, frame_region);
+                        cairo_destroy(fcr);
+                }
+                cairo_region_destroy(frame_region);
+
+                /* The rows left alone have blinking text too */
+                m_text_to_blink = std::any_of(m_frame_rows.begin(), m_frame_rows.end(),
+                                              [](FrameRow const& frame_row) {
+                                                      return frame_row.blink_start < frame_row.blink_end;
+                                              });
+
+                m_frame_valid = true;
+                m_frame_text_blink_state = m_text_blink_state;
+                m_frame_damage.clear();
+
+                cairo_save(cr);
+                cairo_set_operator(cr, m_clear_background ? CAIRO_OPERATOR_SOURCE : CAIRO_OPERATOR_OVER);
+                cairo_set_source_surface(cr, m_frame_surface, 0, 0);
+                cairo_paint(cr);
+                cairo_restore(cr);
+        } else {
+                m_text_to_blink = false;
+                draw_frame(cr, region);
+        }
+
+	/* The preedit string and the cursor are painted on top, not into the frame. */
+	_vte_draw_set_cairo(m_draw, cr);
+
+        cairo_save(cr);
+        cairo_rectangle(cr, 0, m_padding.top, allocated_width, allocated_height - m_padding.top - m_padding.bottom);
+        cairo_clip(cr);
+
+        cairo_translate(cr, m_padding.left, m_padding.top);
 
 	paint_im_preedit_string();
 
@@ -9383,6 +11930,22 @@ Terminal::widget_draw(cairo_t *cr)
 
 	cairo_restore(cr);
 
+        /* Outline what was repainted; the outlines of earlier updates
+         * stay around until their area is repainted in turn. */
+        _VTE_DEBUG_IF(VTE_DEBUG_UPDATES) {
+                cairo_save(cr);
+                auto const n_rects = cairo_region_num_rectangles(region);
+                for (auto i = 0; i < n_rects; i++) {
+                        cairo_rectangle_int_t rect;
+                        cairo_region_get_rectangle(region, i, &rect);
+                        cairo_rectangle(cr, rect.x + .5, rect.y + .5, rect.width - 1, rect.height - 1);
+                }
+                cairo_set_source_rgba(cr, 1., 0., 0., .6);
+                cairo_set_line_width(cr, 1.);
+                cairo_stroke(cr);
+                cairo_restore(cr);
+        }
+
 	/* Done with various structures. */
 	_vte_draw_set_cairo(m_draw, NULL);
 
@@ -9398,7 +11961,38 @@ Terminal::widget_draw(cairo_t *cr)
                 m_text_blink_timer.schedule(m_text_blink_cycle - now % m_text_blink_cycle,
                                             vte::glib::Timer::Priority::eLOW);
 
+        /* Now that the fonts painted, measure those whose metrics were taken
+         * from the metrics cache */
+        if (G_UNLIKELY (!m_font_validation_timer && _vte_draw_fonts_need_validation(m_draw)))
+                m_font_validation_timer.schedule_idle(vte::glib::Timer::Priority::eLOW);
+
         m_invalidated_all = FALSE;
+
+        /* Keep a running average of the paint time, to be subtracted
+         * from the frame's processing budget.
+         */
+        auto const paint_time = g_get_monotonic_time() - paint_start;
+        m_paint_time = (3 * m_paint_time + paint_time) / 4;
+
+        m_frame_stats.add_elapsed(vte::base::FrameStats::Stage::eFrame, paint_time);
+        frame_stats_commit();
+
+        if (m_input_latency.waiting_for_present() &&
+            m_input_latency.presented(g_get_monotonic_time())) {
+                using Stage = vte::base::InputLatency::Stage;
+                _vte_debug_print(VTE_DEBUG_LATENCY,
+                                 "Input latency: written %" G_GINT64_FORMAT "µs "
+                                 "read %" G_GINT64_FORMAT "µs "
+                                 "processed %" G_GINT64_FORMAT "µs "
+                                 "presented %" G_GINT64_FORMAT "µs\n",
+                                 m_input_latency.histogram(Stage::eWrite).last,
+                                 m_input_latency.histogram(Stage::eRead).last,
+                                 m_input_latency.histogram(Stage::eProcess).last,
+                                 m_input_latency.histogram(Stage::ePresent).last);
+        }
+
+        /* We're painting, so the frame clock is alive again */
+        m_frame_clock_stalled = false;
 }
 
 /* Handle an expose event by painting the exposed area. */
@@ -9583,6 +12177,23 @@ Terminal::set_enable_bidi(bool setting)
         return true;
 }
 
+bool
+Terminal::set_enable_io_thread(bool setting)
+{
+        if (setting == m_enable_io_thread)
+                return false;
+
+        m_enable_io_thread = setting;
+
+        /* Switch an existing PTY over */
+        if (pty() && m_pty_input_source != 0) {
+                disconnect_pty_read();
+                connect_pty_read();
+        }
+
+        return true;
+}
+
 bool
 Terminal::set_enable_shaping(bool setting)
 {
@@ -9636,8 +12247,8 @@ Terminal::set_allow_hyperlink(bool setting)
                 g_assert (m_hyperlink_hover_idx == 0);
                 m_hyperlink_hover_uri = NULL;
                 emit_hyperlink_hover_uri_changed(NULL);  /* FIXME only emit if really changed */
-                m_defaults.attr.hyperlink_idx = _vte_ring_get_hyperlink_idx(m_screen->row_data, NULL);
-                g_assert (m_defaults.attr.hyperlink_idx == 0);
+                m_hyperlink_idx = _vte_ring_get_hyperlink_idx(m_screen->row_data, NULL);
+                g_assert (m_hyperlink_idx == 0);
         }
 
         m_allow_hyperlink = setting;
@@ -9820,6 +12431,12 @@ Terminal::set_scrollback_lines(long lines)
 
 	m_scrollback_lines = lines;
 
+        selection_copied_serialize_all();
+#ifdef VTE_DEBUG
+        /* Shrinking the ring gives its row numbers out again */
+        m_row_checksums.clear();
+#endif
+
         /* The main screen gets the full scrollback buffer. */
         scrn = &m_normal_screen;
         lines = MAX (lines, m_row_count);
@@ -9855,6 +12472,33 @@ Terminal::set_scrollback_lines(long lines)
         return true;
 }
 
+bool
+Terminal::set_scrollback_bytes(size_t bytes)
+{
+        auto ring = m_normal_screen.row_data;
+        if (bytes == ring->max_bytes())
+                return false;
+
+	_vte_debug_print (VTE_DEBUG_MISC,
+			"Setting scrollback bytes to %" G_GSIZE_FORMAT "\n", bytes);
+
+        ring->set_max_bytes(bytes);
+        if (m_screen == &m_normal_screen)
+                adjust_adjustments_full();
+
+        return true;
+}
+
+/* Called when the global scrollback budget discarded rows from the normal
+ * screen while another terminal was processing output. */
+void
+Terminal::scrollback_evicted_cb(void* data)
+{
+        auto that = reinterpret_cast<Terminal*>(data);
+        if (that->m_screen == &that->m_normal_screen)
+                that->adjust_adjustments();
+}
+
 bool
 Terminal::set_backspace_binding(EraseMode binding)
 {
@@ -9930,10 +12574,13 @@ Terminal::reset(bool clear_tabstops,
         GObject *object = G_OBJECT(m_terminal);
         g_object_freeze_notify(object);
 
+        selection_copied_serialize_all();
+
         m_bell_pending = false;
 
 	/* Clear the output buffer. */
-	_vte_byte_array_clear(m_outgoing);
+	m_outgoing.clear();
+        paste_stop();
 
 	/* Reset charset substitution state. */
 
@@ -9945,6 +12592,8 @@ Terminal::reset(bool clear_tabstops,
         m_last_graphic_character = 0;
 
         /* Reset modes */
+        if (synchronized_output())
+                end_synchronized_output();
         m_modes_ecma.reset();
         m_modes_private.clear_saved();
         m_modes_private.reset();
@@ -9971,8 +12620,12 @@ Terminal::reset(bool clear_tabstops,
         m_character_replacements[0] = VTE_CHARACTER_REPLACEMENT_NONE;
         m_character_replacements[1] = VTE_CHARACTER_REPLACEMENT_NONE;
         m_character_replacement = &m_character_replacements[0];
+        update_charset_map();
 	/* Clear the scrollback buffers and reset the cursors. Switch to normal screen. */
 	if (clear_history) {
+                m_image_cache.clear();
+                m_marks.clear();
+        m_shell_marks.clear();
                 m_screen = &m_normal_screen;
                 m_normal_screen.scroll_delta = m_normal_screen.insert_delta =
                         _vte_ring_reset(m_normal_screen.row_data);
@@ -10040,7 +12693,10 @@ Terminal::unset_pty(bool notify_widget)
         /* Clear incoming and outgoing queues */
         m_input_bytes = 0;
         m_incoming_queue = {};
-        _vte_byte_array_clear(m_outgoing);
+        m_queued_bytes = 0;
+        m_input_throttled = false;
+        m_outgoing.clear();
+        paste_stop();
 
         stop_processing(this); // FIXMEchpe only if m_incoming_queue.empty() !!!
 
@@ -10143,6 +12799,15 @@ remove_process_timeout_source(void)
 static void
 add_update_timeout(vte::terminal::Terminal* that)
 {
+        /* The tick callback processes updates on each frame */
+        if (that->m_tick_callback_id != 0)
+                return;
+
+        /* Nothing to update; the pending adjustments wait for set_headless(false),
+         * and the rest for set_background(false) */
+        if (that->m_headless || that->m_background)
+                return;
+
 	if (update_timeout_tag == 0) {
 		_vte_debug_print (VTE_DEBUG_TIMEOUT,
 				"Starting update timeout\n");
@@ -10155,11 +12820,12 @@ add_update_timeout(vte::terminal::Terminal* that)
 	if (!in_process_timeout) {
                 remove_process_timeout_source();
         }
-	if (that->m_active_terminals_link == nullptr) {
+	if (!that->m_scheduler_entry.is_scheduled()) {
 		_vte_debug_print (VTE_DEBUG_TIMEOUT,
 				"Adding terminal to active list\n");
-		that->m_active_terminals_link = g_active_terminals =
-			g_list_prepend(g_active_terminals, that);
+                g_active_terminals.add(that->m_scheduler_entry,
+                                       that->scheduler_weight(),
+                                       that->m_max_input_bytes);
 	}
 }
 
@@ -10167,29 +12833,37 @@ void
 Terminal::reset_update_rects()
 {
         g_array_set_size(m_update_rects, 0);
+        m_damage.clear();
 	m_invalidated_all = FALSE;
 }
 
 static bool
 remove_from_active_list(vte::terminal::Terminal* that)
 {
-	if (that->m_active_terminals_link == nullptr ||
-            that->m_update_rects->len != 0)
+        /* The damage held during synchronized output or in the background
+         * is picked up again by end_synchronized_output() or set_background(). */
+	if (!that->m_scheduler_entry.is_scheduled() ||
+            (!that->updates_held() &&
+             (that->m_update_rects->len != 0 ||
+              !that->m_damage.empty())))
                 return false;
 
         _vte_debug_print(VTE_DEBUG_TIMEOUT, "Removing terminal from active list\n");
-        g_active_terminals = g_list_delete_link(g_active_terminals, that->m_active_terminals_link);
-        that->m_active_terminals_link = nullptr;
+        g_active_terminals.remove(that->m_scheduler_entry);
         return true;
 }
 
 static void
 stop_processing(vte::terminal::Terminal* that)
 {
+        if (that->m_update_rects->len == 0 &&
+            that->m_damage.empty())
+                that->unschedule_frame();
+
         if (!remove_from_active_list(that))
                 return;
 
-        if (g_active_terminals != nullptr)
+        if (!g_active_terminals.empty())
                 return;
 
         if (!in_process_timeout) {
@@ -10211,12 +12885,19 @@ remove_update_timeout(vte::terminal::Terminal* that)
 }
 
 static void
-add_process_timeout(vte::terminal::Terminal* that)
+add_process_timeout(vte::terminal::Terminal* that,
+                    bool use_frame_clock)
 {
-	_vte_debug_print(VTE_DEBUG_TIMEOUT,
-			"Adding terminal to active list\n");
-	that->m_active_terminals_link = g_active_terminals =
-		g_list_prepend(g_active_terminals, that);
+        if (use_frame_clock && that->schedule_frame())
+                return;
+
+        if (!that->m_scheduler_entry.is_scheduled()) {
+                _vte_debug_print(VTE_DEBUG_TIMEOUT,
+                                 "Adding terminal to active list\n");
+                g_active_terminals.add(that->m_scheduler_entry,
+                                       that->scheduler_weight(),
+                                       that->m_max_input_bytes);
+        }
 	if (update_timeout_tag == 0 &&
 			process_timeout_tag == 0) {
 		_vte_debug_print(VTE_DEBUG_TIMEOUT,
@@ -10227,6 +12908,19 @@ add_process_timeout(vte::terminal::Terminal* that)
 	}
 }
 
+/* The focused terminal, and those recently typed into, get a larger
+ * share of the input budget than those just producing output.
+ */
+unsigned int
+Terminal::scheduler_weight() const noexcept
+{
+        if (m_has_focus)
+                return VTE_SCHEDULER_WEIGHT_FOCUSED;
+        if (g_get_monotonic_time() - m_last_input_time < VTE_SCHEDULER_INTERACTIVE_TIME)
+                return VTE_SCHEDULER_WEIGHT_INTERACTIVE;
+        return 1;
+}
+
 void
 Terminal::start_processing()
 {
@@ -10234,9 +12928,176 @@ Terminal::start_processing()
 		add_process_timeout(this);
 }
 
+bool
+Terminal::frame_clock_usable() const noexcept
+{
+        return !m_frame_clock_stalled &&
+                widget_realized() &&
+                gtk_widget_get_mapped(m_widget) &&
+                gtk_widget_get_frame_clock(m_widget) != nullptr;
+}
+
+static gboolean
+frame_tick_cb(GtkWidget* widget,
+              GdkFrameClock* clock,
+              gpointer data)
+{
+        auto that = reinterpret_cast<vte::terminal::Terminal*>(data);
+        return that->frame_tick(clock) ? G_SOURCE_CONTINUE : G_SOURCE_REMOVE;
+}
+
+/* Starts driving processing and updates from the widget's frame clock.
+ * Returns false if there is no usable frame clock, in which case the
+ * caller must fall back to the timeouts.
+ */
+bool
+Terminal::schedule_frame() noexcept
+{
+        if (m_tick_callback_id != 0)
+                return true;
+        if (!frame_clock_usable())
+                return false;
+
+        _vte_debug_print(VTE_DEBUG_TIMEOUT, "Adding frame clock tick callback\n");
+        m_tick_callback_id = gtk_widget_add_tick_callback(m_widget,
+                                                          frame_tick_cb,
+                                                          this,
+                                                          nullptr);
+        m_frame_watchdog_timer.schedule(VTE_FRAME_CLOCK_STALL_TIMEOUT);
+
+        return true;
+}
+
+void
+Terminal::unschedule_frame() noexcept
+{
+        m_frame_watchdog_timer.abort();
+
+        if (m_tick_callback_id == 0)
+                return;
+
+        _vte_debug_print(VTE_DEBUG_TIMEOUT, "Removing frame clock tick callback\n");
+        gtk_widget_remove_tick_callback(m_widget, m_tick_callback_id);
+        m_tick_callback_id = 0;
+}
+
+/* Called when the frame clock hasn't ticked for VTE_FRAME_CLOCK_STALL_TIMEOUT,
+ * e.g. when the toplevel is hidden and the compositor stops sending frames.
+ * Fall back to the timeouts until the next paint, so the child isn't stalled.
+ */
+bool
+Terminal::frame_watchdog_callback() noexcept
+{
+        _vte_debug_print(VTE_DEBUG_TIMEOUT, "Frame clock stalled, falling back to timeouts\n");
+
+        m_frame_clock_stalled = true;
+        if (m_tick_callback_id != 0) {
+                gtk_widget_remove_tick_callback(m_widget, m_tick_callback_id);
+                m_tick_callback_id = 0;
+        }
+        add_process_timeout(this, false);
+
+        return false; /* don't repeat */
+}
+
+/* The processing budget is what is left of the refresh interval
+ * after painting, but at least VTE_MIN_PROCESS_BUDGET so that fast
+ * output still makes progress when painting is slow.
+ */
+void
+Terminal::update_process_budget(GdkFrameClock* clock) noexcept
+{
+        auto refresh_interval = gint64{0};
+        gdk_frame_clock_get_refresh_info(clock,
+                                         gdk_frame_clock_get_frame_time(clock),
+                                         &refresh_interval,
+                                         nullptr);
+        if (refresh_interval <= 0)
+                refresh_interval = VTE_DEFAULT_REFRESH_INTERVAL;
+
+        m_process_budget = std::max(refresh_interval - m_paint_time,
+                                    int64_t{VTE_MIN_PROCESS_BUDGET});
+
+        _vte_debug_print(VTE_DEBUG_TIMEOUT,
+                         "Frame budget %" G_GINT64_FORMAT "µs (refresh interval %" G_GINT64_FORMAT "µs, paint %" G_GINT64_FORMAT "µs)\n",
+                         m_process_budget, refresh_interval, m_paint_time);
+}
+
+/* Returns the memory cached for processing to the heap, and collects the
+ * combining sequences no longer on any screen; called once all terminals
+ * are idle. */
+static void
+free_idle_memory()
+{
+        vte::base::Chunk::prune();
+        _vte_cells_prune();
+        vte::base::Ring::unistr_maybe_gc();
+}
+
+bool
+Terminal::frame_tick(GdkFrameClock* clock) noexcept
+{
+        _vte_debug_print (VTE_DEBUG_WORK, "|");
+
+        update_process_budget(clock);
+        m_frame_watchdog_timer.schedule(VTE_FRAME_CLOCK_STALL_TIMEOUT);
+
+        /* Updates queued here get painted in this same frame */
+        auto const active = process(true);
+        auto const updated = invalidate_dirty_rects_and_process_updates();
+        if (active || updated)
+                return true;
+
+        _vte_debug_print(VTE_DEBUG_TIMEOUT, "Removing frame clock tick callback\n");
+        m_tick_callback_id = 0;
+        m_frame_watchdog_timer.abort();
+
+        /* Free up memory used to capture incoming data */
+        if (g_active_terminals.empty())
+                free_idle_memory();
+
+        return false;
+}
+
+/* Commits what was received during synchronized output: the damage held
+ * back by invalidate_dirty_rects_and_process_updates(), and the signals
+ * held back by emit_pending_signals().
+ */
+void
+Terminal::end_synchronized_output() noexcept
+{
+        _vte_debug_print(VTE_DEBUG_UPDATES, "Ending synchronized output\n");
+
+        m_synchronized_output_timer.abort();
+        m_modes_private.set_VTE_SYNCHRONIZED_OUTPUT(false);
+
+        if (m_update_rects->len != 0 || !m_damage.empty())
+                add_update_timeout(this);
+}
+
+/* Called when an application didn't end synchronized output in time,
+ * e.g. because it crashed; show what we have.
+ */
+bool
+Terminal::synchronized_output_timer_callback() noexcept
+{
+        _vte_debug_print(VTE_DEBUG_UPDATES, "Synchronized output timed out\n");
+
+        end_synchronized_output();
+        emit_pending_signals();
+
+        return false; /* don't repeat */
+}
+
 void
 Terminal::emit_pending_signals()
 {
+        vte::base::FrameStats::Scope stats_scope{m_frame_stats, vte::base::FrameStats::Stage::eSignals};
+
+        /* The child is gone, so it won't end it */
+        if (m_eos_pending && synchronized_output())
+                end_synchronized_output();
+
 	GObject *object = G_OBJECT(m_terminal);
         g_object_freeze_notify(object);
 
@@ -10284,33 +13145,42 @@ Terminal::emit_pending_signals()
                 m_current_file_uri_changed = false;
         }
 
-	/* Flush any pending "inserted" signals. */
+	/* Flush any pending "inserted" signals; but not during synchronized
+         * output or in the background, since these feed the accessibility
+         * layer with the contents. In the background, contents-changed is
+         * still emitted now and then, for those watching for activity.
+         */
+        auto const hold = updates_held();
+        auto const now = g_get_monotonic_time();
+        auto const hold_contents = synchronized_output() ||
+                (m_background &&
+                 now - m_background_contents_changed_time < VTE_BACKGROUND_CONTENTS_CHANGED_INTERVAL);
 
-        if (m_cursor_moved_pending) {
+        if (!hold && m_cursor_moved_pending) {
                 _vte_debug_print(VTE_DEBUG_SIGNALS,
                                  "Emitting `cursor-moved'.\n");
                 g_signal_emit(object, signals[SIGNAL_CURSOR_MOVED], 0);
                 m_cursor_moved_pending = false;
         }
-        if (m_text_modified_flag) {
+        if (!hold && m_text_modified_flag) {
                 _vte_debug_print(VTE_DEBUG_SIGNALS,
                                  "Emitting buffered `text-modified'.\n");
                 emit_text_modified();
                 m_text_modified_flag = false;
         }
-        if (m_text_inserted_flag) {
+        if (!hold && m_text_inserted_flag) {
                 _vte_debug_print(VTE_DEBUG_SIGNALS,
                                  "Emitting buffered `text-inserted'\n");
                 emit_text_inserted();
                 m_text_inserted_flag = false;
         }
-        if (m_text_deleted_flag) {
+        if (!hold && m_text_deleted_flag) {
                 _vte_debug_print(VTE_DEBUG_SIGNALS,
                                  "Emitting buffered `text-deleted'\n");
                 emit_text_deleted();
                 m_text_deleted_flag = false;
 	}
-	if (m_contents_changed_pending) {
+	if (!hold_contents && m_contents_changed_pending) {
                 /* Update hyperlink and dingus match set. */
 		match_contents_clear();
 		if (m_mouse_cursor_over_widget) {
@@ -10322,6 +13192,8 @@ Terminal::emit_pending_signals()
 				"Emitting `contents-changed'.\n");
 		g_signal_emit(m_terminal, signals[SIGNAL_CONTENTS_CHANGED], 0);
 		m_contents_changed_pending = false;
+                emit_contents_updated();
+                m_background_contents_changed_time = now;
 	}
         if (m_bell_pending) {
                 auto const timestamp = g_get_monotonic_time();
@@ -10358,14 +13230,28 @@ Terminal::time_process_incoming()
 	g_timer_reset(process_timer);
 	process_incoming();
 	auto elapsed = g_timer_elapsed(process_timer, NULL) * 1000;
-	gssize target = VTE_MAX_PROCESS_TIME / elapsed * m_input_bytes;
+        /* When driven by the frame clock, aim at the frame's budget;
+         * in the background, at a larger one since nothing's drawn */
+        auto const budget = m_tick_callback_id != 0 ? m_process_budget / 1000. :
+                m_background ? double(VTE_BACKGROUND_PROCESS_TIME) : double(VTE_MAX_PROCESS_TIME);
+	gssize target = budget / elapsed * m_input_bytes;
 	m_max_input_bytes = (m_max_input_bytes + target) / 2;
+
+        _vte_debug_print(VTE_DEBUG_TIMEOUT,
+                         "Processed %" G_GSIZE_FORMAT " bytes in %.3fms, budget %.3fms, max input %ld bytes\n",
+                         m_input_bytes, elapsed, budget, m_max_input_bytes);
 }
 
+/* Processes the incoming data, and with @flush_signals, emits the signals
+ * queued since the last time. That is done once per frame, right before
+ * the update, so the adjustment and the listeners see one change per frame
+ * however often the data got processed in between; without frames to
+ * wait for, it's done right away.
+ */
 bool
-Terminal::process(bool emit_adj_changed)
+Terminal::process(bool flush_signals)
 {
-        if (pty()) {
+        if (pty() && !m_pty_reader && !m_input_throttled) {
                 if (m_pty_input_active ||
                     m_pty_input_source == 0) {
                         m_pty_input_active = false;
@@ -10374,8 +13260,6 @@ Terminal::process(bool emit_adj_changed)
                 }
                 connect_pty_read();
         }
-        if (emit_adj_changed)
-                emit_adjustment_changed();
 
         bool is_active = !m_incoming_queue.empty();
         if (is_active) {
@@ -10384,40 +13268,86 @@ Terminal::process(bool emit_adj_changed)
                 } else {
                         process_incoming();
                 }
+
+                g_active_terminals.set_weight(m_scheduler_entry, scheduler_weight());
+                g_active_terminals.end_round(m_scheduler_entry, m_input_bytes, m_max_input_bytes);
                 m_input_bytes = 0;
-        } else
+
+                update_input_throttle();
+        }
+
+        if (flush_signals ||
+            (m_tick_callback_id == 0 && update_timeout_tag == 0))
                 emit_pending_signals();
 
         return is_active;
 }
 
+/* For a short while after the user sent input, small reads are most
+ * likely its echo. Process them right away and queue the draw, instead of
+ * waiting for the process and update timeouts; processing only invalidates
+ * the cells it touched, so this stays cheap. Output that isn't small ends
+ * this until the next input, so that it's batched as usual.
+ *
+ * Returns: true if the incoming queue was processed
+ */
+bool
+Terminal::process_echo()
+{
+        if (!m_low_latency)
+                return false;
+
+        if (m_queued_bytes > VTE_LOW_LATENCY_MAX_BYTES ||
+            g_get_monotonic_time() - m_last_input_time > VTE_LOW_LATENCY_TIME) {
+                _vte_debug_print(VTE_DEBUG_TIMEOUT,
+                                 "Leaving low-latency mode, %" G_GSIZE_FORMAT " bytes queued\n",
+                                 m_queued_bytes);
+                m_low_latency = false;
+                return false;
+        }
+
+        if (m_headless || !widget_realized())
+                return false;
+
+        _vte_debug_print(VTE_DEBUG_TIMEOUT,
+                         "Processing %" G_GSIZE_FORMAT " bytes of echo right away\n",
+                         m_queued_bytes);
+
+        process_incoming();
+        m_input_bytes = 0;
+        emit_pending_signals();
+        invalidate_dirty_rects_and_process_updates();
+
+        return true;
+}
+
 /* This function is called after DISPLAY_TIMEOUT ms.
  * It makes sure initial output is never delayed by more than DISPLAY_TIMEOUT
  */
 static gboolean
 process_timeout (gpointer data)
 {
-	GList *l, *next;
+	vte::base::Scheduler<vte::terminal::Terminal>::Entry *l, *next;
 	gboolean again;
 
 	in_process_timeout = TRUE;
 
 	_vte_debug_print (VTE_DEBUG_WORK, "<");
 	_vte_debug_print (VTE_DEBUG_TIMEOUT,
-                          "Process timeout:  %d active\n",
-                          g_list_length(g_active_terminals));
+                          "Process timeout:  %" G_GSIZE_FORMAT " active\n",
+                          g_active_terminals.size());
 
-	for (l = g_active_terminals; l != NULL; l = next) {
-		auto that = reinterpret_cast<vte::terminal::Terminal*>(l->data);
+	for (l = g_active_terminals.first(); l != nullptr; l = next) {
+		auto that = l->owner();
 		bool active;
 
-		next = l->next;
+		next = g_active_terminals.next(*l);
 
-		if (l != g_active_terminals) {
+		if (l != g_active_terminals.first()) {
 			_vte_debug_print (VTE_DEBUG_WORK, "T");
 		}
 
-                // FIXMEchpe find out why we don't emit_adjustment_changed() here!!
+                /* The signals wait for the update, unless there's none to wait for */
                 active = that->process(false);
 
 		if (!active) {
@@ -10427,7 +13357,10 @@ process_timeout (gpointer data)
 
 	_vte_debug_print (VTE_DEBUG_WORK, ">");
 
-	if (g_active_terminals != nullptr && update_timeout_tag == 0) {
+	/* Serve terminals in a different order next time */
+        g_active_terminals.rotate();
+
+	if (!g_active_terminals.empty() && update_timeout_tag == 0) {
 		again = TRUE;
 	} else {
 		_vte_debug_print(VTE_DEBUG_TIMEOUT,
@@ -10445,7 +13378,7 @@ process_timeout (gpointer data)
 		g_usleep (0);
 	} else if (update_timeout_tag == 0) {
 		/* otherwise free up memory used to capture incoming data */
-                vte::base::Chunk::prune();
+                free_idle_memory();
 	}
 
 	return again;
@@ -10457,6 +13390,13 @@ Terminal::invalidate_dirty_rects_and_process_updates()
         if (G_UNLIKELY(!widget_realized()))
                 return false;
 
+        /* Hold the damage until the synchronized output ends, or
+         * the terminal is mapped again */
+        if (updates_held())
+                return false;
+
+        flush_damage();
+
 	if (G_UNLIKELY (!m_update_rects->len))
 		return false;
 
@@ -10484,22 +13424,22 @@ Terminal::invalidate_dirty_rects_and_process_updates()
 static gboolean
 update_repeat_timeout (gpointer data)
 {
-	GList *l, *next;
+	vte::base::Scheduler<vte::terminal::Terminal>::Entry *l, *next;
 	bool again;
 
 	in_update_timeout = TRUE;
 
 	_vte_debug_print (VTE_DEBUG_WORK, "[");
 	_vte_debug_print (VTE_DEBUG_TIMEOUT,
-                          "Repeat timeout:  %d active\n",
-                          g_list_length(g_active_terminals));
+                          "Repeat timeout:  %" G_GSIZE_FORMAT " active\n",
+                          g_active_terminals.size());
 
-	for (l = g_active_terminals; l != NULL; l = next) {
-		auto that = reinterpret_cast<vte::terminal::Terminal*>(l->data);
+	for (l = g_active_terminals.first(); l != nullptr; l = next) {
+		auto that = l->owner();
 
-                next = l->next;
+                next = g_active_terminals.next(*l);
 
-		if (l != g_active_terminals) {
+		if (l != g_active_terminals.first()) {
 			_vte_debug_print (VTE_DEBUG_WORK, "T");
 		}
 
@@ -10518,7 +13458,9 @@ update_repeat_timeout (gpointer data)
          * reinstall a new one because we need to delay by the amount of time
          * it took to repaint the screen: bug 730732.
 	 */
-	if (g_active_terminals == nullptr) {
+        g_active_terminals.rotate();
+
+	if (g_active_terminals.empty()) {
 		_vte_debug_print(VTE_DEBUG_TIMEOUT,
 				"Stopping update timeout\n");
 		update_timeout_tag = 0;
@@ -10541,7 +13483,7 @@ update_repeat_timeout (gpointer data)
 		g_usleep (0);
 	} else {
 		/* otherwise free up memory used to capture incoming data */
-                vte::base::Chunk::prune();
+                free_idle_memory();
 	}
 
         return FALSE;  /* If we need to go again, we already have a new timer for that. */
@@ -10550,23 +13492,23 @@ update_repeat_timeout (gpointer data)
 static gboolean
 update_timeout (gpointer data)
 {
-	GList *l, *next;
+	vte::base::Scheduler<vte::terminal::Terminal>::Entry *l, *next;
 
 	in_update_timeout = TRUE;
 
 	_vte_debug_print (VTE_DEBUG_WORK, "{");
 	_vte_debug_print (VTE_DEBUG_TIMEOUT,
-                          "Update timeout:  %d active\n",
-                          g_list_length(g_active_terminals));
+                          "Update timeout:  %" G_GSIZE_FORMAT " active\n",
+                          g_active_terminals.size());
 
         remove_process_timeout_source();
 
-	for (l = g_active_terminals; l != NULL; l = next) {
-		auto that = reinterpret_cast<vte::terminal::Terminal*>(l->data);
+	for (l = g_active_terminals.first(); l != nullptr; l = next) {
+		auto that = l->owner();
 
-                next = l->next;
+                next = g_active_terminals.next(*l);
 
-		if (l != g_active_terminals) {
+		if (l != g_active_terminals.first()) {
 			_vte_debug_print (VTE_DEBUG_WORK, "T");
 		}
 
@@ -10600,160 +13542,1118 @@ Terminal::write_contents_sync (GOutputStream *stream,
 					 cancellable, error);
 }
 
-/*
- * Buffer search
- */
+/* The state of an asynchronous write_contents, see Terminal::write_contents_async(). */
+typedef struct {
+        vte::base::Ring::Export* contents;
+        GOutputStream* stream;
+        char* buf;
+        GFileProgressCallback progress_callback;
+        gpointer progress_data;
+        GDestroyNotify progress_data_destroy;
+} WriteContentsData;
 
-/* TODO Add properties & signals */
+static void
+write_contents_data_free(gpointer ptr)
+{
+        auto data = reinterpret_cast<WriteContentsData*>(ptr);
 
-/*
- * Terminal::search_set_regex:
- * @regex: (allow-none): a #VteRegex, or %nullptr
- * @flags: PCRE2 match flags, or 0
- *
- * Sets the regex to search for. Unsets the search regex when passed %nullptr.
- */
-bool
-Terminal::search_set_regex (vte::base::RefPtr<vte::base::Regex>&& regex,
-                            uint32_t flags)
+        delete data->contents;
+        g_object_unref(data->stream);
+        g_free(data->buf);
+        if (data->progress_data_destroy)
+                data->progress_data_destroy(data->progress_data);
+        g_free(data);
+}
+
+static void write_contents_step(GTask* task);
+
+static void
+write_contents_written_cb(GObject* source,
+                          GAsyncResult* result,
+                          gpointer user_data)
 {
-        if (regex == m_search_regex &&
-            flags == m_search_regex_match_flags)
-                return false;
+        auto task = G_TASK(user_data);
+        auto data = reinterpret_cast<WriteContentsData*>(g_task_get_task_data(task));
+        GError* error = nullptr;
 
-        m_search_regex = std::move(regex);
-        m_search_regex_match_flags = flags;
+        if (!g_output_stream_write_all_finish(G_OUTPUT_STREAM(source), result, nullptr, &error)) {
+                g_task_return_error(task, error);
+                g_object_unref(task);
+                return;
+        }
 
-	invalidate_all();
+        if (data->progress_callback)
+                data->progress_callback(data->contents->position(),
+                                        data->contents->size(),
+                                        data->progress_data);
 
-        return true;
+        write_contents_step(task);
 }
 
+/*
+ * Terminal::save_scrollback:
+ * @stream: a #GOutputStream to write to
+ * @cancellable: optional #GCancellable object, %nullptr to ignore
+ * @error: a #GError location to store the error occuring, or %nullptr to ignore
+ *
+ * Writes the contents of the normal screen, including the scrollback, with
+ * their attributes and the cursor position, for restore_scrollback().
+ */
 bool
-Terminal::search_set_wrap_around(bool wrap)
+Terminal::save_scrollback(GOutputStream *stream,
+                          GCancellable *cancellable,
+                          GError **error)
 {
-        if (wrap == m_search_wrap_around)
+        return m_normal_screen.row_data->save(stream,
+                                              0,
+                                              m_column_count,
+                                              m_normal_screen.cursor,
+                                              cancellable,
+                                              error);
+}
+
+/*
+ * Terminal::restore_scrollback:
+ * @stream: a #GInputStream to read from
+ * @cancellable: optional #GCancellable object, %nullptr to ignore
+ * @error: a #GError location to store the error occuring, or %nullptr to ignore
+ *
+ * Replaces the contents of the normal screen with what save_scrollback()
+ * wrote, rewrapping them if the number of columns changed since.
+ */
+bool
+Terminal::restore_scrollback(GInputStream *stream,
+                             GCancellable *cancellable,
+                             GError **error)
+{
+        auto ring = m_normal_screen.row_data;
+        auto columns = long{0};
+        auto cursor = VteVisualPosition{};
+
+        if (!ring->restore(stream, &columns, &cursor, cancellable, error))
                 return false;
 
-        m_search_wrap_around = wrap;
+        deselect_all();
+        /* The images and marks were on the rows replaced */
+        m_image_cache.remove_rows(image_screen(&m_normal_screen), G_MINLONG, G_MAXLONG);
+        m_marks.clear();
+        m_shell_marks.clear();
+
+        if (columns != m_column_count) {
+                VteVisualPosition *markers[2] = { &cursor, nullptr };
+                _vte_ring_rewrap(ring, m_column_count, markers);
+                if (ring->rewrap_pending())
+                        m_rewrap_timer.schedule(VTE_REWRAP_DELAY, vte::glib::Timer::Priority::eDEFAULT_IDLE);
+        }
+
+        m_normal_screen.insert_delta = MAX(_vte_ring_delta(ring), _vte_ring_next(ring) - m_row_count);
+        m_normal_screen.cursor.row = CLAMP(cursor.row,
+                                           m_normal_screen.insert_delta,
+                                           m_normal_screen.insert_delta + m_row_count - 1);
+        m_normal_screen.cursor.col = CLAMP(cursor.col, 0, m_column_count - 1);
+
+        _vte_debug_print(VTE_DEBUG_MISC,
+                         "Restored the scrollback, insert_delta=%ld cursor=%ld,%ld\n",
+                         m_normal_screen.insert_delta,
+                         m_normal_screen.cursor.row, m_normal_screen.cursor.col);
+
+        if (m_screen == &m_normal_screen) {
+                /* Hack: force a change in scroll_delta even if the value remains, so that
+                   vte_term_q_adj_val_changed() doesn't shortcut to no-op, see bug 676075. */
+                m_screen->scroll_delta = -1;
+                queue_adjustment_value_changed(m_screen->insert_delta);
+                adjust_adjustments_full();
+        } else {
+                m_normal_screen.scroll_delta = m_normal_screen.insert_delta;
+        }
+        invalidate_all();
+
         return true;
 }
 
+/*
+ * The format of Terminal::save_state():
+ *
+ * A SavedState, the strings it has the lengths of, and the tabstops. Then
+ * the alternate screen as Ring::save() writes it, and last the normal
+ * screen, so that its scrollback is read straight from the stream on
+ * restoring. Like Ring::save(), this is in the native byte order and layout.
+ */
+#define VTE_STATE_SAVE_MAGIC "VTESTATE"
+#define VTE_STATE_SAVE_VERSION 1
+#define VTE_STATE_SAVE_STRING_MAX (64 * 1024)
+
+enum {
+        SAVED_STRING_HYPERLINK,
+        SAVED_STRING_NORMAL_SAVED_HYPERLINK,
+        SAVED_STRING_ALTERNATE_SAVED_HYPERLINK,
+        SAVED_STRING_WINDOW_TITLE,
+        SAVED_STRING_CURRENT_DIRECTORY_URI,
+        SAVED_STRING_CURRENT_FILE_URI,
+        SAVED_N_STRINGS
+};
+
+/* The stuff saved along with the cursor of a screen, see VteScreen */
+typedef struct _SavedCursor {
+        gint64 row;
+        gint64 col;
+        guint32 modes_ecma;
+        guint8 reverse_mode;
+        guint8 origin_mode;
+        guint8 character_replacements[2];
+        guint32 character_replacement;
+        VteCell defaults;
+        VteCell color_defaults;
+} SavedCursor;
+
+typedef struct _SavedColor {
+        guint16 red;
+        guint16 green;
+        guint16 blue;
+        guint16 is_set;
+} SavedColor;
+
+typedef struct _SavedState {
+        char magic[8];
+        guint32 version;
+        guint32 cell_size;         /* for checking the layout */
+        guint32 flags;
+        guint32 alternate_screen;
+        guint32 modes_ecma;
+        guint32 modes_private;
+        guint32 character_replacements[2];
+        guint32 character_replacement;
+        guint32 cursor_style;
+        guint32 last_graphic_character;
+        gint32 scrolling_region_start;
+        gint32 scrolling_region_end;
+        guint32 scrolling_restricted;
+        guint32 n_tabstops;
+        VteCell defaults;
+        VteCell color_defaults;
+        SavedCursor saved[2];      /* normal, alternate */
+        SavedColor palette[VTE_PALETTE_SIZE];
+        guint32 string_lengths[SAVED_N_STRINGS];
+        guint64 alternate_length;
+} SavedState;
+
+/*
+ * Terminal::save_state:
+ * @stream: a #GOutputStream to write to
+ * @flags: a set of #VteStateFlags
+ * @cancellable: optional #GCancellable object, %nullptr to ignore
+ * @error: a #GError location to store the error occuring, or %nullptr to ignore
+ *
+ * Writes the state of the terminal emulation, both screens and the
+ * scrollback unless @flags say otherwise, for restore_state().
+ */
 bool
-Terminal::search_rows(pcre2_match_context_8 *match_context,
-                      pcre2_match_data_8 *match_data,
-                      vte::grid::row_t start_row,
-                      vte::grid::row_t end_row,
-                      bool backward)
+Terminal::save_state(GOutputStream *stream,
+                     VteStateFlags flags,
+                     GCancellable *cancellable,
+                     GError **error)
+{
+        VteScreen* screens[2] = { &m_normal_screen, &m_alternate_screen };
+        std::string strings[SAVED_N_STRINGS];
+        std::vector<guint32> tabstops;
+        gsize bytes_written;
+
+        auto state = SavedState{};
+        memcpy(state.magic, VTE_STATE_SAVE_MAGIC, sizeof(state.magic));
+        state.version = VTE_STATE_SAVE_VERSION;
+        state.cell_size = sizeof(VteCell);
+        state.flags = flags;
+        state.alternate_screen = m_screen == &m_alternate_screen;
+        state.modes_ecma = m_modes_ecma.get_modes();
+        state.modes_private = m_modes_private.get_modes();
+        state.character_replacements[0] = m_character_replacements[0];
+        state.character_replacements[1] = m_character_replacements[1];
+        state.character_replacement = m_character_replacement - m_character_replacements;
+        state.cursor_style = unsigned(m_cursor_style);
+        state.last_graphic_character = m_last_graphic_character;
+        state.scrolling_region_start = m_scrolling_region.start;
+        state.scrolling_region_end = m_scrolling_region.end;
+        state.scrolling_restricted = m_scrolling_restricted;
+        state.defaults = m_defaults;
+        state.color_defaults = m_color_defaults;
+
+        for (auto i = 0; i < 2; i++) {
+                auto const& saved = screens[i]->saved;
+                auto& to = state.saved[i];
+                to.row = saved.cursor.row;
+                to.col = saved.cursor.col;
+                to.modes_ecma = saved.modes_ecma;
+                to.reverse_mode = saved.reverse_mode;
+                to.origin_mode = saved.origin_mode;
+                to.character_replacements[0] = saved.character_replacements[0];
+                to.character_replacements[1] = saved.character_replacements[1];
+                to.character_replacement = saved.character_replacement - saved.character_replacements;
+                to.defaults = saved.defaults;
+                to.color_defaults = saved.color_defaults;
+                strings[SAVED_STRING_NORMAL_SAVED_HYPERLINK + i] = screens[i]->row_data->hyperlink(saved.hyperlink_idx);
+        }
+
+        for (auto i = 0; i < VTE_PALETTE_SIZE; i++) {
+                auto const& source = m_palette[i].sources[VTE_COLOR_SOURCE_ESCAPE];
+                state.palette[i] = SavedColor{source.color.red, source.color.green, source.color.blue,
+                                              guint16(source.is_set)};
+        }
+
+        strings[SAVED_STRING_HYPERLINK] = m_screen->row_data->hyperlink(m_hyperlink_idx);
+        strings[SAVED_STRING_WINDOW_TITLE] = m_window_title;
+        strings[SAVED_STRING_CURRENT_DIRECTORY_URI] = m_current_directory_uri;
+        strings[SAVED_STRING_CURRENT_FILE_URI] = m_current_file_uri;
+        for (auto i = 0; i < SAVED_N_STRINGS; i++)
+                state.string_lengths[i] = strings[i].size();
+
+        for (auto col = 0u; col < m_tabstops.size(); col++)
+                if (m_tabstops.get(col))
+                        tabstops.push_back(col);
+        state.n_tabstops = tabstops.size();
+
+        /* The alternate screen has no scrollback, so it's small enough to
+         * go through memory, which gives its length. */
+        auto alternate = vte::glib::take_ref(g_memory_output_stream_new_resizable());
+        if (!m_alternate_screen.row_data->save(alternate.get(),
+                                               m_alternate_screen.insert_delta,
+                                               m_column_count,
+                                               m_alternate_screen.cursor,
+                                               cancellable,
+                                               error) ||
+            !g_output_stream_close(alternate.get(), cancellable, error))
+                return false;
+
+        auto const memory = G_MEMORY_OUTPUT_STREAM(alternate.get());
+        state.alternate_length = g_memory_output_stream_get_data_size(memory);
+
+        auto write = [&](void const* data, size_t len) -> bool {
+                return g_output_stream_write_all(stream, data, len, &bytes_written, cancellable, error);
+        };
+
+        if (!write(&state, sizeof(state)))
+                return false;
+        for (auto i = 0; i < SAVED_N_STRINGS; i++)
+                if (!write(strings[i].data(), strings[i].size()))
+                        return false;
+        if (!write(tabstops.data(), tabstops.size() * sizeof(tabstops[0])) ||
+            !write(g_memory_output_stream_get_data(memory), state.alternate_length))
+                return false;
+
+        auto const start = (flags & VTE_STATE_NO_SCROLLBACK) ? m_normal_screen.insert_delta : 0;
+        return m_normal_screen.row_data->save(stream,
+                                              start,
+                                              m_column_count,
+                                              m_normal_screen.cursor,
+                                              cancellable,
+                                              error);
+}
+
+/*
+ * Terminal::restore_state:
+ * @stream: a #GInputStream to read from
+ * @cancellable: optional #GCancellable object, %nullptr to ignore
+ * @error: a #GError location to store the error occuring, or %nullptr to ignore
+ *
+ * Replaces the state of the terminal emulation with what save_state()
+ * wrote. Like restore_scrollback(), the normal screen is rewrapped if the
+ * number of columns changed since.
+ */
+bool
+Terminal::restore_state(GInputStream *stream,
+                        GCancellable *cancellable,
+                        GError **error)
+{
+        VteScreen* screens[2] = { &m_normal_screen, &m_alternate_screen };
+        VteVisualPosition cursors[2];
+        std::string strings[SAVED_N_STRINGS];
+        std::vector<guint32> tabstops;
+        std::vector<char> alternate;
+        auto columns = long{0};
+        gsize bytes_read;
+
+        /* Returns false on error, or if the data ended early */
+        auto read = [&](void* data, size_t len) -> bool {
+                if (!g_input_stream_read_all(stream, data, len, &bytes_read, cancellable, error))
+                        return false;
+                if (bytes_read == len)
+                        return true;
+                g_set_error_literal(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "Truncated state data");
+                return false;
+        };
+        auto const valid_replacement = [](guint32 replacement) {
+                return replacement <= VTE_CHARACTER_REPLACEMENT_BRITISH;
+        };
+
+        auto state = SavedState{};
+        if (!read(&state, sizeof(state)))
+                return false;
+
+        auto valid = memcmp(state.magic, VTE_STATE_SAVE_MAGIC, sizeof(state.magic)) == 0 &&
+                state.version == VTE_STATE_SAVE_VERSION &&
+                state.cell_size == sizeof(VteCell) &&
+                state.alternate_screen <= 1 &&
+                valid_replacement(state.character_replacements[0]) &&
+                valid_replacement(state.character_replacements[1]) &&
+                state.character_replacement <= 1 &&
+                state.cursor_style <= unsigned(CursorStyle::eSTEADY_IBEAM) &&
+                state.n_tabstops <= VTE_STATE_SAVE_STRING_MAX &&
+                state.alternate_length <= G_MAXINT32;
+        for (auto const& saved : state.saved)
+                valid = valid &&
+                        valid_replacement(saved.character_replacements[0]) &&
+                        valid_replacement(saved.character_replacements[1]) &&
+                        saved.character_replacement <= 1;
+        for (auto const len : state.string_lengths)
+                valid = valid && len <= VTE_STATE_SAVE_STRING_MAX;
+        if (!valid) {
+                g_set_error_literal(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "Invalid state data");
+                return false;
+        }
+
+        for (auto i = 0; i < SAVED_N_STRINGS; i++) {
+                strings[i].resize(state.string_lengths[i]);
+                if (!read(&strings[i][0], strings[i].size()))
+                        return false;
+        }
+        tabstops.resize(state.n_tabstops);
+        alternate.resize(state.alternate_length);
+        if (!read(tabstops.data(), tabstops.size() * sizeof(tabstops[0])) ||
+            !read(alternate.data(), alternate.size()))
+                return false;
+
+        /* The rows and the hyperlinks are about to go */
+        if (synchronized_output())
+                end_synchronized_output();
+        deselect_all();
+        selection_copied_serialize_all();
+        m_hyperlink_hover_idx = _vte_ring_get_hyperlink_at_position(m_screen->row_data, -1, -1, true, NULL);
+        m_hyperlink_hover_uri = NULL;
+        emit_hyperlink_hover_uri_changed(NULL);
+
+        /* Up to here, nothing changed on error */
+        if (!m_normal_screen.row_data->restore(stream, &columns, &cursors[0], cancellable, error))
+                return false;
+
+        auto alternate_stream = vte::glib::take_ref(g_memory_input_stream_new_from_data(alternate.data(),
+                                                                                         alternate.size(),
+                                                                                         nullptr));
+        auto alternate_columns = long{0};
+        if (!m_alternate_screen.row_data->restore(alternate_stream.get(), &alternate_columns, &cursors[1],
+                                                  cancellable, error)) {
+                /* Too late to go back, leave a consistent terminal at least */
+                reset(true, true);
+                return false;
+        }
+
+        m_image_cache.clear();
+        m_marks.clear();
+        m_shell_marks.clear();
+
+        if (columns != m_column_count) {
+                VteVisualPosition *markers[2] = { &cursors[0], nullptr };
+                _vte_ring_rewrap(m_normal_screen.row_data, m_column_count, markers);
+                if (m_normal_screen.row_data->rewrap_pending())
+                        m_rewrap_timer.schedule(VTE_REWRAP_DELAY, vte::glib::Timer::Priority::eDEFAULT_IDLE);
+        }
+
+        m_screen = screens[state.alternate_screen];
+        for (auto i = 0; i < 2; i++) {
+                auto screen = screens[i];
+                auto const ring = screen->row_data;
+                screen->insert_delta = MAX(_vte_ring_delta(ring), _vte_ring_next(ring) - m_row_count);
+                screen->cursor.row = CLAMP(cursors[i].row,
+                                           screen->insert_delta,
+                                           screen->insert_delta + m_row_count - 1);
+                screen->cursor.col = CLAMP(cursors[i].col, 0, m_column_count - 1);
+
+                auto const& from = state.saved[i];
+                auto& saved = screen->saved;
+                saved.cursor.row = from.row;
+                saved.cursor.col = from.col;
+                saved.modes_ecma = from.modes_ecma;
+                saved.reverse_mode = from.reverse_mode;
+                saved.origin_mode = from.origin_mode;
+                saved.defaults = from.defaults;
+                saved.color_defaults = from.color_defaults;
+                saved.character_replacements[0] = VteCharacterReplacement(from.character_replacements[0]);
+                saved.character_replacements[1] = VteCharacterReplacement(from.character_replacements[1]);
+                saved.character_replacement = &saved.character_replacements[from.character_replacement];
+
+                /* The screen's ring keeps this hyperlink as its current one, except
+                 * for the one on the screen, which gets the terminal's below */
+                auto const& hyperlink = strings[SAVED_STRING_NORMAL_SAVED_HYPERLINK + i];
+                saved.hyperlink_idx = _vte_ring_get_hyperlink_idx(ring,
+                                                                  m_allow_hyperlink && !hyperlink.empty()
+                                                                  ? hyperlink.c_str() : nullptr);
+        }
+
+        auto const& hyperlink = strings[SAVED_STRING_HYPERLINK];
+        m_hyperlink_idx = _vte_ring_get_hyperlink_idx(m_screen->row_data,
+                                                      m_allow_hyperlink && !hyperlink.empty()
+                                                      ? hyperlink.c_str() : nullptr);
+
+        m_modes_ecma.set_modes(state.modes_ecma);
+        m_modes_private.set_modes(state.modes_private);
+        /* The timer ending it wasn't saved */
+        m_modes_private.set_VTE_SYNCHRONIZED_OUTPUT(false);
+        update_mouse_protocol();
+
+        m_defaults = state.defaults;
+        m_color_defaults = state.color_defaults;
+        m_character_replacements[0] = VteCharacterReplacement(state.character_replacements[0]);
+        m_character_replacements[1] = VteCharacterReplacement(state.character_replacements[1]);
+        m_character_replacement = &m_character_replacements[state.character_replacement];
+        update_charset_map();
+        m_last_graphic_character = state.last_graphic_character;
+        m_scrolling_region.start = state.scrolling_region_start;
+        m_scrolling_region.end = state.scrolling_region_end;
+        m_scrolling_restricted = state.scrolling_restricted &&
+                state.scrolling_region_start >= 0 &&
+                state.scrolling_region_start <= state.scrolling_region_end &&
+                state.scrolling_region_end < m_row_count;
+        set_cursor_style(CursorStyle(state.cursor_style));
+
+        m_tabstops.clear();
+        for (auto const col : tabstops)
+                if (col < m_tabstops.size())
+                        m_tabstops.set(col);
+
+        for (auto i = 0; i < VTE_PALETTE_SIZE; i++) {
+                auto const& color = state.palette[i];
+                auto& source = m_palette[i].sources[VTE_COLOR_SOURCE_ESCAPE];
+                source.color = vte::color::rgb{color.red, color.green, color.blue};
+                source.is_set = color.is_set != 0;
+        }
+
+        m_window_title_pending = strings[SAVED_STRING_WINDOW_TITLE].substr(0, VTE_WINDOW_TITLE_MAX_LENGTH);
+        m_window_title_changed = true;
+        m_current_directory_uri_pending = strings[SAVED_STRING_CURRENT_DIRECTORY_URI];
+        m_current_directory_uri_changed = true;
+        m_current_file_uri_pending = strings[SAVED_STRING_CURRENT_FILE_URI];
+        m_current_file_uri_changed = true;
+
+        _vte_debug_print(VTE_DEBUG_MISC,
+                         "Restored the state, %s screen, cursor=%ld,%ld\n",
+                         state.alternate_screen ? "alternate" : "normal",
+                         m_screen->cursor.row, m_screen->cursor.col);
+
+        /* Hack: force a change in scroll_delta even if the value remains, so that
+           vte_term_q_adj_val_changed() doesn't shortcut to no-op, see bug 676075. */
+        screens[!state.alternate_screen]->scroll_delta = screens[!state.alternate_screen]->insert_delta;
+        m_screen->scroll_delta = -1;
+        queue_adjustment_value_changed(m_screen->insert_delta);
+        adjust_adjustments_full();
+        queue_contents_changed();
+        invalidate_all();
+        emit_pending_signals();
+
+        return true;
+}
+
+unsigned
+Terminal::add_mark(long column,
+                   long row)
 {
-	int start, end;
-	long start_col, end_col;
-	VteCharAttributes *ca;
-	GArray *attrs;
-	gdouble value, page_size;
+        auto const id = m_next_mark_id++;
+        m_marks.push_back({id, {row, column}});
+        return id;
+}
 
-	auto row_text = get_text(start_row, 0,
-                                 end_row, 0,
-                                 false /* block */,
-                                 true /* wrap */,
-                                 nullptr);
+bool
+Terminal::get_mark(unsigned id,
+                   long* column,
+                   long* row) const
+{
+        auto const it = std::lower_bound(m_marks.cbegin(), m_marks.cend(), id,
+                                         [](Mark const& mark, unsigned value) {
+                                                 return mark.id < value;
+                                         });
+        if (it == m_marks.cend() || it->id != id ||
+            it->position.row < _vte_ring_delta(m_normal_screen.row_data))
+                return false;
 
-        int (* match_fn) (const pcre2_code_8 *,
-                          PCRE2_SPTR8, PCRE2_SIZE, PCRE2_SIZE, uint32_t,
-                          pcre2_match_data_8 *, pcre2_match_context_8 *);
-        gsize *ovector, so, eo;
-        int r;
+        if (column)
+                *column = it->position.col;
+        if (row)
+                *row = it->position.row;
+        return true;
+}
 
-        if (m_search_regex->jited())
-                match_fn = pcre2_jit_match_8;
-        else
-                match_fn = pcre2_match_8;
-
-        r = match_fn(m_search_regex->code(),
-                     (PCRE2_SPTR8)row_text->str, row_text->len , /* subject, length */
-                     0, /* start offset */
-                     m_search_regex_match_flags |
-                     PCRE2_NO_UTF_CHECK | PCRE2_NOTEMPTY | PCRE2_PARTIAL_SOFT /* FIXME: HARD? */,
-                     match_data,
-                     match_context);
-
-        if (r == PCRE2_ERROR_NOMATCH) {
-                g_string_free (row_text, TRUE);
+void
+Terminal::remove_mark(unsigned id)
+{
+        auto const it = std::lower_bound(m_marks.begin(), m_marks.end(), id,
+                                         [](Mark const& mark, unsigned value) {
+                                                 return mark.id < value;
+                                         });
+        if (it != m_marks.end() && it->id == id)
+                m_marks.erase(it);
+}
+
+static inline bool
+position_less(VteVisualPosition const& a,
+              VteVisualPosition const& b) noexcept
+{
+        return a.row < b.row || (a.row == b.row && a.col < b.col);
+}
+
+/* Marks the cursor position as @kind, for an OSC 133 sequence */
+void
+Terminal::add_shell_mark(VteShellMark kind,
+                         int exit_status)
+{
+        /* Full screen applications don't have prompts */
+        if (m_screen != &m_normal_screen)
+                return;
+
+        /* Forget the marks scrolled out, and the oldest ones over the limit */
+        auto const delta = _vte_ring_delta(m_screen->row_data);
+        auto first = std::find_if(m_shell_marks.begin(), m_shell_marks.end(),
+                                  [delta](ShellMark const& mark) {
+                                          return mark.position.row >= delta;
+                                  });
+        if (m_shell_marks.end() - first >= VTE_SHELL_MARKS_MAX)
+                first = m_shell_marks.end() - (VTE_SHELL_MARKS_MAX - 1);
+        m_shell_marks.erase(m_shell_marks.begin(), first);
+
+        /* They come in order, unless the shell moved the cursor back */
+        auto const position = VteVisualPosition{m_screen->cursor.row, m_screen->cursor.col};
+        auto const it = std::upper_bound(m_shell_marks.begin(), m_shell_marks.end(), position,
+                                         [](VteVisualPosition const& value, ShellMark const& mark) {
+                                                 return position_less(value, mark.position);
+                                         });
+        m_shell_marks.insert(it, {position, kind, exit_status});
+}
+
+/*
+ * Terminal::find_shell_mark:
+ * @kind: the kind of mark to find
+ * @row: the absolute row to start at
+ * @backward: whether to find the last mark before @row, rather than the
+ *   first one after it
+ *
+ * Returns: whether there is such a mark, with its position
+ */
+bool
+Terminal::find_shell_mark(VteShellMark kind,
+                          long row,
+                          bool backward,
+                          long* column,
+                          long* mark_row) const
+{
+        auto const delta = long(_vte_ring_delta(m_normal_screen.row_data));
+        auto const by_row = [](ShellMark const& mark, long value) {
+                return mark.position.row < value;
+        };
+
+        auto found = m_shell_marks.cend();
+        if (backward) {
+                auto it = std::lower_bound(m_shell_marks.cbegin(), m_shell_marks.cend(), row, by_row);
+                while (it != m_shell_marks.cbegin()) {
+                        --it;
+                        if (it->position.row < delta)
+                                break;
+                        if (it->kind == kind) {
+                                found = it;
+                                break;
+                        }
+                }
+        } else {
+                auto it = std::lower_bound(m_shell_marks.cbegin(), m_shell_marks.cend(), row + 1, by_row);
+                for (; it != m_shell_marks.cend(); ++it) {
+                        if (it->kind == kind && it->position.row >= delta) {
+                                found = it;
+                                break;
+                        }
+                }
+        }
+
+        if (found == m_shell_marks.cend())
                 return false;
+
+        if (column)
+                *column = found->position.col;
+        if (mark_row)
+                *mark_row = found->position.row;
+        return true;
+}
+
+/*
+ * Terminal::get_command_output:
+ * @row: an absolute row
+ *
+ * Finds the output of the last command whose output starts at or before
+ * @row. It ends at the next mark, normally where the command finished,
+ * or at the cursor while the command runs.
+ *
+ * Returns: whether there is such a command, with the range of its output
+ *   and its exit status, or -1 if that isn't known (yet)
+ */
+bool
+Terminal::get_command_output(long row,
+                             long* start_row,
+                             long* start_col,
+                             long* end_row,
+                             long* end_col,
+                             int* exit_status) const
+{
+        auto output_col = long{0}, output_row = long{0};
+        if (!find_shell_mark(VTE_SHELL_MARK_OUTPUT, row + 1, true, &output_col, &output_row))
+                return false;
+
+        auto const output = VteVisualPosition{output_row, output_col};
+        auto const next = std::upper_bound(m_shell_marks.cbegin(), m_shell_marks.cend(), output,
+                                           [](VteVisualPosition const& value, ShellMark const& mark) {
+                                                   return position_less(value, mark.position);
+                                           });
+
+        auto end = VteVisualPosition{m_normal_screen.cursor.row, m_normal_screen.cursor.col};
+        auto status = -1;
+        if (next != m_shell_marks.cend()) {
+                end = next->position;
+                if (next->kind == VTE_SHELL_MARK_END)
+                        status = next->exit_status;
+        }
+
+        if (start_row)
+                *start_row = output.row;
+        if (start_col)
+                *start_col = output.col;
+        if (end_row)
+                *end_row = end.row;
+        if (end_col)
+                *end_col = end.col;
+        if (exit_status)
+                *exit_status = status;
+        return true;
+}
+
+/* Reads the next chunk, and writes it asynchronously. Sequential reads of
+ * the text stream have the next blocks unsealed on its worker thread, so
+ * this takes little time on the main thread. Consumes the reference to
+ * @task when done. */
+static void
+write_contents_step(GTask* task)
+{
+        auto data = reinterpret_cast<WriteContentsData*>(g_task_get_task_data(task));
+
+        if (g_task_return_error_if_cancelled(task)) {
+                g_object_unref(task);
+                return;
+        }
+
+        auto len = data->contents->read(data->buf, VTE_WRITE_CONTENTS_CHUNK_SIZE);
+        if (len <= 0) {
+                if (len == 0)
+                        g_task_return_boolean(task, TRUE);
+                else
+                        g_task_return_new_error(task, G_IO_ERROR, G_IO_ERROR_FAILED,
+                                                "Failed to read the terminal contents");
+                g_object_unref(task);
+                return;
+        }
+
+        g_output_stream_write_all_async(data->stream,
+                                        data->buf, len,
+                                        g_task_get_priority(task),
+                                        g_task_get_cancellable(task),
+                                        write_contents_written_cb,
+                                        task);
+}
+
+void
+Terminal::write_contents_async(GOutputStream *stream,
+                               VteWriteFlags flags,
+                               GCancellable *cancellable,
+                               GFileProgressCallback progress_callback,
+                               gpointer progress_data,
+                               GDestroyNotify progress_data_destroy,
+                               GAsyncReadyCallback callback,
+                               gpointer user_data)
+{
+        auto task = g_task_new(m_terminal, cancellable, callback, user_data);
+        g_task_set_source_tag(task, (void*)vte_terminal_write_contents_async);
+        g_task_set_priority(task, G_PRIORITY_LOW);
+
+        auto contents = m_screen->row_data->export_contents(flags);
+        if (contents == nullptr) {
+                if (progress_data_destroy)
+                        progress_data_destroy(progress_data);
+                g_task_return_new_error(task, G_IO_ERROR, G_IO_ERROR_FAILED,
+                                        "Failed to read the terminal contents");
+                g_object_unref(task);
+                return;
         }
-        // FIXME: handle partial matches (PCRE2_ERROR_PARTIAL)
-        if (r < 0) {
-                g_string_free (row_text, TRUE);
+
+        auto data = g_new0(WriteContentsData, 1);
+        data->contents = contents;
+        data->stream = (GOutputStream*)g_object_ref(stream);
+        data->buf = (char*)g_malloc(VTE_WRITE_CONTENTS_CHUNK_SIZE);
+        data->progress_callback = progress_callback;
+        data->progress_data = progress_data;
+        data->progress_data_destroy = progress_data_destroy;
+        g_task_set_task_data(task, data, write_contents_data_free);
+
+        write_contents_step(task);
+}
+
+/*
+ * Buffer search
+ */
+
+/* TODO Add properties & signals */
+
+/*
+ * Terminal::search_set_regex:
+ * @regex: (allow-none): a #VteRegex, or %nullptr
+ * @flags: PCRE2 match flags, or 0
+ *
+ * Sets the regex to search for. Unsets the search regex when passed %nullptr.
+ */
+bool
+Terminal::search_set_regex (vte::base::RefPtr<vte::base::Regex>&& regex,
+                            uint32_t flags)
+{
+        if (regex == m_search_regex &&
+            flags == m_search_regex_match_flags)
                 return false;
+
+        m_search_regex = std::move(regex);
+        m_search_regex_match_flags = flags;
+
+        if (!m_search_regex ||
+            !m_search_regex->required_bytes(m_search_first_bytes, m_search_last_bytes))
+                m_search_first_bytes = m_search_last_bytes = vte::base::ByteSet::all();
+
+        /* search_rows() matches row by row with PCRE2_PARTIAL_HARD; add
+         * that mode if the caller JITed the regex for the others. */
+        if (m_search_regex && m_search_regex->jited()) {
+                auto error = vte::glib::Error{};
+                if (!m_search_regex->jit(PCRE2_JIT_PARTIAL_HARD, error))
+                        _vte_debug_print(VTE_DEBUG_REGEX,
+                                         "JIT compiling the search regex for partial matching failed, "
+                                         "it falls back to the interpreter: %s\n",
+                                         error.message());
+        } else if (m_search_regex) {
+                _vte_debug_print(VTE_DEBUG_REGEX, "The search regex isn't JIT compiled, it uses the interpreter.\n");
         }
 
-        ovector = pcre2_get_ovector_pointer_8(match_data);
-        so = ovector[0];
-        eo = ovector[1];
-        if (G_UNLIKELY(so == PCRE2_UNSET || eo == PCRE2_UNSET)) {
-                g_string_free (row_text, TRUE);
+	invalidate_all();
+
+        return true;
+}
+
+bool
+Terminal::search_set_wrap_around(bool wrap)
+{
+        if (wrap == m_search_wrap_around)
                 return false;
+
+        m_search_wrap_around = wrap;
+        return true;
+}
+
+/*
+ * Terminal::search_append_row:
+ * @text: the string to append to
+ * @row: the row
+ *
+ * Appends the text of @row to @text the same way get_text() would, but
+ * without computing any attributes.
+ */
+void
+Terminal::search_append_row(GString* text,
+                            vte::grid::row_t row)
+{
+        auto const row_data = find_row_data(row);
+        if (row_data != nullptr) {
+                auto last_nonempty = text->len;
+                for (vte::grid::column_t col = 0; col < m_column_count; col++) {
+                        auto const cell = _vte_row_data_get(row_data, col);
+                        if (cell == nullptr)
+                                break;
+                        if (cell->attr.fragment())
+                                continue;
+
+                        /* Empty cells of nondefault background color are NULs;
+                         * the trailing ones are dropped, see get_text(). */
+                        if (cell->c == 0) {
+                                g_string_append_c(text, ' ');
+                        } else {
+                                _vte_unistr_append_to_string(cell->c, text);
+                                last_nonempty = text->len;
+                        }
+                }
+                g_string_truncate(text, last_nonempty);
         }
 
-        start = so;
-        end = eo;
+        if (!m_screen->row_data->is_soft_wrapped(row))
+                g_string_append_c(text, '\n');
+}
+
+/*
+ * Terminal::search_column_at:
+ * @row: the row
+ * @offset: a byte offset into the text search_append_row() gave for @row
+ * @len: the length of that text without the newline
+ * @end: whether to return the column after the character
+ *
+ * Returns: the column of the character at @offset, or the one after it
+ */
+vte::grid::column_t
+Terminal::search_column_at(vte::grid::row_t row,
+                           size_t offset,
+                           size_t len,
+                           bool end)
+{
+        auto const row_data = find_row_data(row);
+        if (row_data == nullptr || offset >= len)
+                return m_column_count;
+
+        /* Measure the characters by appending them past the end of the
+         * search text, which is no longer needed once a match is found. */
+        auto const text = m_search_text;
+        auto const base = text->len;
+        auto column = vte::grid::column_t{m_column_count};
+        for (vte::grid::column_t col = 0; col < m_column_count; col++) {
+                auto const cell = _vte_row_data_get(row_data, col);
+                if (cell == nullptr)
+                        break;
+                if (cell->attr.fragment())
+                        continue;
+
+                if (cell->c == 0)
+                        g_string_append_c(text, ' ');
+                else
+                        _vte_unistr_append_to_string(cell->c, text);
+                if (text->len - base > offset) {
+                        column = end ? col + cell->attr.columns() : col;
+                        break;
+                }
+        }
+        g_string_truncate(text, base);
+
+        return column;
+}
+
+/*
+ * Terminal::search_paragraph:
+ * @regex: the regex
+ * @match_flags: PCRE2 match flags
+ * @start_row: the first row of the paragraph
+ * @end_row: the row after the last one
+ * @func: called with the span of each match in turn, returning whether
+ *   to go on
+ *
+ * Searches the paragraph, feeding PCRE2 one row at a time: a hard partial
+ * match asks for more text, and anything short of one rules out the text
+ * so far. This stops reading rows at the match, and only the columns of
+ * the matches need working out.
+ *
+ * Returns: %false iff @func asked to stop
+ */
+template<typename F>
+bool
+Terminal::search_paragraph(vte::base::MatchState& state,
+                           vte::base::Regex const* regex,
+                           uint32_t match_flags,
+                           vte::grid::row_t start_row,
+                           vte::grid::row_t end_row,
+                           F&& func)
+{
+        auto const jited = regex->jited();
+
+        if (!m_search_text)
+                m_search_text = g_string_sized_new(256);
+        auto const text = m_search_text;
+        g_string_truncate(text, 0);
+        m_search_row_offsets.clear();
+
+        /* Finding the rows of a match, and the columns within them */
+        auto const& offsets = m_search_row_offsets;
+        auto row_of = [&](size_t offset) -> size_t {
+                return std::upper_bound(offsets.begin(), offsets.end(), offset) - offsets.begin() - 1;
+        };
+        auto row_len = [&](size_t i) -> size_t {
+                auto const row_end = i + 1 < offsets.size() ? offsets[i + 1] : text->len;
+                auto const row = start_row + vte::grid::row_t(i);
+                return row_end - offsets[i] - (m_screen->row_data->is_soft_wrapped(row) ? 0 : 1);
+        };
+
+        auto const ovector = state.ovector();
+
+        /* After a partial match, only try again once the text past its
+         * start has doubled, so that a long one isn't rescanned each row. */
+        auto start_offset = size_t{0};
+        auto next_try = size_t{0};
+        auto row = start_row;
+        auto more = true;
+        for (;;) {
+                if (more && row < end_row) {
+                        m_search_row_offsets.push_back(text->len);
+                        search_append_row(text, row++);
+                }
+                more = true;
 
-	/* Fetch text again, with attributes */
-	g_string_free(row_text, TRUE);
-	if (!m_search_attrs)
-		m_search_attrs = g_array_new (FALSE, TRUE, sizeof (VteCharAttributes));
-	attrs = m_search_attrs;
-	row_text = get_text(start_row, 0,
-                            end_row, 0,
-                            false /* block */,
-                            true /* wrap */,
-                            attrs);
+                auto const last = row == end_row;
+                if (!last && text->len < next_try)
+                        continue;
 
-	ca = &g_array_index (attrs, VteCharAttributes, start);
-	start_row = ca->row;
-	start_col = ca->column;
-	ca = &g_array_index (attrs, VteCharAttributes, end - 1);
-	end_row = ca->row;
-        end_col = ca->column + ca->columns;
+                /* pcre2_match() uses the JIT code for hard partial matching
+                 * if there is any, see search_set_regex(). */
+                auto const r = state.match(regex,
+                                           text->str, text->len, /* subject, length */
+                                           start_offset,
+                                           match_flags |
+                                           PCRE2_NO_UTF_CHECK | PCRE2_NOTEMPTY |
+                                           (last ? 0 : PCRE2_PARTIAL_HARD),
+                                           last && jited);
+                if (r == PCRE2_ERROR_PARTIAL) {
+                        start_offset = ovector[0];
+                        next_try = 2 * text->len - start_offset;
+                        continue;
+                }
+                if (r == PCRE2_ERROR_NOMATCH && !last) {
+                        start_offset = next_try = text->len;
+                        continue;
+                }
+                if (r < 0)
+                        return true;
+
+                auto const so = ovector[0];
+                auto const eo = ovector[1];
+                if (G_UNLIKELY(so == PCRE2_UNSET || eo == PCRE2_UNSET || eo <= so))
+                        return true;
+
+                auto const i_start = row_of(so);
+                auto const i_end = row_of(eo - 1);
+                auto const match_start_row = start_row + vte::grid::row_t(i_start);
+                auto const match_end_row = start_row + vte::grid::row_t(i_end);
+                auto const match = vte::grid::span(match_start_row,
+                                                   search_column_at(match_start_row, so - offsets[i_start],
+                                                                    row_len(i_start), false),
+                                                   match_end_row,
+                                                   search_column_at(match_end_row, eo - 1 - offsets[i_end],
+                                                                    row_len(i_end), true));
+                if (!func(match))
+                        return false;
+
+                /* Go on right after this match, before reading more rows */
+                start_offset = eo;
+                more = false;
+        }
+}
 
-	g_string_free (row_text, TRUE);
+/*
+ * Terminal::search_select_match:
+ * @match: the span of the match
+ * @backward: whether the search went backward
+ *
+ * Selects the match, and scrolls to it unless it's displayed.
+ */
+void
+Terminal::search_select_match(vte::grid::span const& match,
+                              bool backward)
+{
+	gdouble value, page_size;
 
-	select_text(start_col, start_row, end_col, end_row);
+	select_text(match.start_column(), match.start_row(),
+                    match.end_column(), match.end_row());
 	/* Quite possibly the math here should not access adjustment directly... */
         value = gtk_adjustment_get_value(m_vadjustment.get());
         page_size = gtk_adjustment_get_page_size(m_vadjustment.get());
 	if (backward) {
-		if (end_row < value || end_row > value + page_size - 1)
-			queue_adjustment_value_changed_clamped(end_row - page_size + 1);
+		if (match.end_row() < value || match.end_row() > value + page_size - 1)
+			queue_adjustment_value_changed_clamped(match.end_row() - page_size + 1);
 	} else {
-		if (start_row < value || start_row > value + page_size - 1)
-			queue_adjustment_value_changed_clamped(start_row);
+		if (match.start_row() < value || match.start_row() > value + page_size - 1)
+			queue_adjustment_value_changed_clamped(match.start_row());
 	}
+}
 
+bool
+Terminal::search_rows(vte::base::MatchState& state,
+                      vte::grid::row_t start_row,
+                      vte::grid::row_t end_row,
+                      bool backward)
+{
+        auto match = vte::grid::span{};
+        auto found = false;
+
+        search_paragraph(state,
+                         m_search_regex.get(), m_search_regex_match_flags,
+                         start_row, end_row,
+                         [&](vte::grid::span const& span) -> bool {
+                                 match = span;
+                                 found = true;
+                                 return false;
+                         });
+        if (!found)
+                return false;
+
+        search_select_match(match, backward);
 	return true;
 }
 
+/* Returns: the first row of the paragraph ending before @row */
+static vte::grid::row_t
+search_paragraph_start(vte::base::Ring* ring,
+                       vte::grid::row_t row)
+{
+        auto const limit = ring->delta();
+        auto start = row - 1;
+        while (start > limit && ring->is_soft_wrapped(start - 1))
+                start--;
+        return start;
+}
+
+/* Returns: the row after the paragraph starting at @row */
+static vte::grid::row_t
+search_paragraph_end(vte::base::Ring* ring,
+                     vte::grid::row_t row)
+{
+        auto const limit = ring->next();
+        auto end = row + 1;
+        while (end < limit && ring->is_soft_wrapped(end - 1))
+                end++;
+        return end;
+}
+
+/* Skip the paragraphs whose text lacks a byte any match needs; the ring
+ * only knows that for the rows that are frozen, but that's where the
+ * bulk of the text is. */
+static bool
+search_may_match(vte::base::Ring* ring,
+                 vte::base::ByteSet const& first_bytes,
+                 vte::base::ByteSet const& last_bytes,
+                 vte::grid::row_t start_row,
+                 vte::grid::row_t end_row)
+{
+        if (first_bytes.full() && last_bytes.full())
+                return true;
+
+        auto const bytes = ring->text_bytes(start_row, end_row);
+        return bytes.intersects(first_bytes) && bytes.intersects(last_bytes);
+}
+
 bool
-Terminal::search_rows_iter(pcre2_match_context_8 *match_context,
-                                     pcre2_match_data_8 *match_data,
+Terminal::search_rows_iter(vte::base::MatchState& state,
                                      vte::grid::row_t start_row,
                                      vte::grid::row_t end_row,
                                      bool backward)
 {
-	const VteRowData *row;
 	long iter_start_row, iter_end_row;
+        auto ring = m_screen->row_data;
 
 	if (backward) {
 		iter_start_row = end_row;
 		while (iter_start_row > start_row) {
 			iter_end_row = iter_start_row;
+                        iter_start_row = search_paragraph_start(ring, iter_end_row);
 
-			do {
-				iter_start_row--;
-				row = find_row_data(iter_start_row);
-			} while (row && row->attr.soft_wrapped);
-
-			if (search_rows(match_context, match_data,
+			if (search_may_match(ring, m_search_first_bytes, m_search_last_bytes,
+                                             iter_start_row, iter_end_row) &&
+                            search_rows(state,
                                         iter_start_row, iter_end_row, backward))
 				return true;
 		}
@@ -10761,13 +14661,11 @@ Terminal::search_rows_iter(pcre2_match_context_8 *match_context,
 		iter_end_row = start_row;
 		while (iter_end_row < end_row) {
 			iter_start_row = iter_end_row;
+                        iter_end_row = search_paragraph_end(ring, iter_start_row);
 
-			do {
-				row = find_row_data(iter_end_row);
-				iter_end_row++;
-			} while (row && row->attr.soft_wrapped);
-
-			if (search_rows(match_context, match_data,
+			if (search_may_match(ring, m_search_first_bytes, m_search_last_bytes,
+                                             iter_start_row, iter_end_row) &&
+                            search_rows(state,
                                         iter_start_row, iter_end_row, backward))
 				return true;
 		}
@@ -10776,23 +14674,24 @@ Terminal::search_rows_iter(pcre2_match_context_8 *match_context,
 	return false;
 }
 
-bool
-Terminal::search_find (bool backward)
+/*
+ * Terminal::search_find_ranges:
+ * @backward: whether to search backward
+ * @ranges: return location for the ranges of rows, each from the first
+ *   row to the one after the last
+ *
+ * Gets the rows search_find() goes through, in order: from the selection
+ * (or the displayed rows) onwards, and then from the other end of the
+ * buffer if the search wraps around.
+ *
+ * Returns: the number of ranges
+ */
+int
+Terminal::search_find_ranges(bool backward,
+                             vte::grid::row_t ranges[2][2])
 {
         vte::grid::row_t buffer_start_row, buffer_end_row;
         vte::grid::row_t last_start_row, last_end_row;
-        bool match_found = true;
-
-        if (!m_search_regex)
-                return false;
-
-	/* TODO
-	 * Currently We only find one result per extended line, and ignore columns
-	 * Moreover, the whole search thing is implemented very inefficiently.
-	 */
-
-        auto match_context = create_match_context();
-        auto match_data = pcre2_match_data_create_8(256 /* should be plenty */, nullptr /* general context */);
 
 	buffer_start_row = _vte_ring_delta (m_screen->row_data);
 	buffer_end_row = _vte_ring_next (m_screen->row_data);
@@ -10807,46 +14706,315 @@ Terminal::search_find (bool backward)
 	last_start_row = MAX (buffer_start_row, last_start_row);
 	last_end_row = MIN (buffer_end_row, last_end_row);
 
+        if (backward) {
+                ranges[0][0] = buffer_start_row;
+                ranges[0][1] = last_start_row;
+                ranges[1][0] = last_end_row;
+                ranges[1][1] = buffer_end_row;
+        } else {
+                ranges[0][0] = last_end_row;
+                ranges[0][1] = buffer_end_row;
+                ranges[1][0] = buffer_start_row;
+                ranges[1][1] = last_start_row;
+        }
+
+        return m_search_wrap_around ? 2 : 1;
+}
+
+/*
+ * Terminal::search_find_failed:
+ * @backward: whether the search went backward
+ *
+ * Makes an empty selection at the last searched position.
+ */
+void
+Terminal::search_find_failed(bool backward)
+{
+        if (m_selection_resolved.empty())
+                return;
+
+        if (backward) {
+                if (m_search_wrap_around)
+                        select_empty(m_selection_resolved.start_column(), m_selection_resolved.start_row());
+                else
+                        select_empty(-1, _vte_ring_delta(m_screen->row_data) - 1);
+        } else {
+                if (m_search_wrap_around)
+                        select_empty(m_selection_resolved.end_column(), m_selection_resolved.end_row());
+                else
+                        select_empty(0, _vte_ring_next(m_screen->row_data));
+        }
+}
+
+bool
+Terminal::search_find (bool backward)
+{
+        vte::grid::row_t ranges[2][2];
+        bool match_found = false;
+
+        if (!m_search_regex)
+                return false;
+
+	/* TODO
+	 * Currently We only find one result per extended line, and ignore columns
+	 */
+
+        auto& state = search_match_state();
+        auto const n_ranges = search_find_ranges(backward, ranges);
+        for (auto i = 0; i < n_ranges && !match_found; i++)
+                match_found = search_rows_iter(state,
+                                               ranges[i][0], ranges[i][1], backward);
+
 	/* If search fails, we make an empty selection at the last searched
 	 * position... */
-	if (backward) {
-		if (search_rows_iter (match_context, match_data,
-                                      buffer_start_row, last_start_row, backward))
-			goto found;
-		if (m_search_wrap_around &&
-		    search_rows_iter (match_context, match_data,
-                                      last_end_row, buffer_end_row, backward))
-			goto found;
-                if (!m_selection_resolved.empty()) {
-			if (m_search_wrap_around)
-                            select_empty(m_selection_resolved.start_column(), m_selection_resolved.start_row());
-			else
-			    select_empty(-1, buffer_start_row - 1);
-		}
-                match_found = false;
-	} else {
-		if (search_rows_iter (match_context, match_data,
-                                      last_end_row, buffer_end_row, backward))
-			goto found;
-		if (m_search_wrap_around &&
-		    search_rows_iter (match_context, match_data,
-                                      buffer_start_row, last_start_row, backward))
-			goto found;
-                if (!m_selection_resolved.empty()) {
-			if (m_search_wrap_around)
-                                select_empty(m_selection_resolved.end_column(), m_selection_resolved.end_row());
-			else
-                                select_empty(0, buffer_end_row);
-		}
-                match_found = false;
-	}
+        if (!match_found)
+                search_find_failed(backward);
 
- found:
+	return match_found;
+}
 
-        pcre2_match_data_free_8(match_data);
-        pcre2_match_context_free_8(match_context);
+/* The state of an asynchronous search, see Terminal::search_find_async(). */
+typedef struct {
+        vte::base::Regex* regex;
+        uint32_t match_flags;
+        vte::base::ByteSet first_bytes;
+        vte::base::ByteSet last_bytes;
+        VteScreen* screen;
+        bool backward;
+        bool find_all;
+        gsize max_matches;
+        vte::grid::row_t ranges[2][2];
+        int n_ranges;
+        int range;              /* the range being searched */
+        vte::grid::row_t row;   /* where to go on in it */
+        goffset n_rows_searched;
+        goffset n_rows;
+        GArray* matches;        /* of vte::grid::span */
+        GFileProgressCallback progress_callback;
+        gpointer progress_data;
+        GDestroyNotify progress_data_destroy;
+} SearchData;
 
-	return match_found;
+static void
+search_data_free(gpointer ptr)
+{
+        auto data = reinterpret_cast<SearchData*>(ptr);
+
+        data->regex->unref();
+        g_array_free(data->matches, TRUE);
+        if (data->progress_data_destroy)
+                data->progress_data_destroy(data->progress_data);
+        g_free(data);
+}
+
+static gboolean
+search_step_cb(gpointer user_data)
+{
+        auto task = G_TASK(user_data);
+        auto terminal = VTE_TERMINAL(g_task_get_source_object(task));
+
+        if (_vte_terminal_get_impl(terminal)->search_step(task))
+                return G_SOURCE_CONTINUE;
+
+        g_object_unref(task);
+        return G_SOURCE_REMOVE;
+}
+
+/*
+ * Terminal::search_async:
+ * @find_all: whether to collect all matches, instead of selecting the next one
+ * @backward: whether to search backward, when not @find_all
+ * @max_matches: the number of matches to stop at, or 0
+ *
+ * Searches like search_find(), or for all matches from the top, a slice of
+ * time at a time from an idle source, so that searching a long scrollback
+ * doesn't block the widget.
+ *
+ * The search goes through the rows there are when it starts, as far as the
+ * ring keeps them; what the terminal receives in the meantime isn't searched.
+ */
+void
+Terminal::search_async(bool find_all,
+                       bool backward,
+                       gsize max_matches,
+                       GCancellable* cancellable,
+                       GFileProgressCallback progress_callback,
+                       gpointer progress_data,
+                       GDestroyNotify progress_data_destroy,
+                       GAsyncReadyCallback callback,
+                       gpointer user_data)
+{
+        auto task = g_task_new(m_terminal, cancellable, callback, user_data);
+        g_task_set_source_tag(task, find_all ? (void*)vte_terminal_search_find_all_async
+                                             : (void*)vte_terminal_search_find_async);
+        g_task_set_priority(task, G_PRIORITY_LOW);
+
+        if (!m_search_regex) {
+                if (progress_data_destroy)
+                        progress_data_destroy(progress_data);
+                g_task_return_new_error(task, G_IO_ERROR, G_IO_ERROR_NOT_INITIALIZED,
+                                        "No search regex set");
+                g_object_unref(task);
+                return;
+        }
+
+        auto data = g_new0(SearchData, 1);
+        data->regex = m_search_regex->ref();
+        data->match_flags = m_search_regex_match_flags;
+        data->first_bytes = m_search_first_bytes;
+        data->last_bytes = m_search_last_bytes;
+        data->screen = m_screen;
+        data->backward = find_all ? false : backward;
+        data->find_all = find_all;
+        data->max_matches = find_all ? max_matches : 1;
+        if (find_all) {
+                data->ranges[0][0] = _vte_ring_delta(m_screen->row_data);
+                data->ranges[0][1] = _vte_ring_next(m_screen->row_data);
+                data->n_ranges = 1;
+        } else {
+                data->n_ranges = search_find_ranges(backward, data->ranges);
+        }
+        for (auto i = 0; i < data->n_ranges; i++)
+                data->n_rows += MAX(data->ranges[i][1] - data->ranges[i][0], 0);
+        data->row = data->backward ? data->ranges[0][1] : data->ranges[0][0];
+        data->matches = g_array_new(FALSE, FALSE, sizeof(vte::grid::span));
+        data->progress_callback = progress_callback;
+        data->progress_data = progress_data;
+        data->progress_data_destroy = progress_data_destroy;
+        g_task_set_task_data(task, data, search_data_free);
+
+        auto source = g_idle_source_new();
+        g_task_attach_source(task, source, search_step_cb);
+        g_source_unref(source);
+}
+
+/*
+ * Terminal::search_step:
+ * @task: the #GTask of a search_async()
+ *
+ * Searches the paragraphs of the next slice of time, and returns the
+ * result to @task when done.
+ *
+ * Returns: %true iff there is more to search
+ */
+bool
+Terminal::search_step(GTask* task)
+{
+        auto data = reinterpret_cast<SearchData*>(g_task_get_task_data(task));
+
+        if (g_task_return_error_if_cancelled(task))
+                return false;
+
+        if (m_screen != data->screen) {
+                g_task_return_new_error(task, G_IO_ERROR, G_IO_ERROR_FAILED,
+                                        "The terminal switched screens during the search");
+                return false;
+        }
+
+        auto ring = m_screen->row_data;
+        auto const deadline = g_get_monotonic_time() + VTE_SEARCH_SLICE_TIME;
+        auto done = false;
+        auto add_match = [&](vte::grid::span const& span) -> bool {
+                g_array_append_val(data->matches, span);
+                done = data->max_matches != 0 && data->matches->len >= data->max_matches;
+                return !done;
+        };
+
+        while (!done && data->range < data->n_ranges) {
+                /* The ring may have dropped rows since */
+                auto const range = data->ranges[data->range];
+                auto const range_start = CLAMP(range[0], _vte_ring_delta(ring), _vte_ring_next(ring));
+                auto const range_end = CLAMP(range[1], range_start, _vte_ring_next(ring));
+                auto const row = CLAMP(data->row, range_start, range_end);
+
+                if (data->backward ? row <= range_start : row >= range_end) {
+                        if (++data->range < data->n_ranges)
+                                data->row = data->ranges[data->range][data->backward ? 1 : 0];
+                        continue;
+                }
+
+                vte::grid::row_t start_row, end_row;
+                if (data->backward) {
+                        end_row = row;
+                        start_row = MAX(search_paragraph_start(ring, end_row), range_start);
+                        data->row = start_row;
+                } else {
+                        start_row = row;
+                        end_row = MIN(search_paragraph_end(ring, start_row), range_end);
+                        data->row = end_row;
+                }
+
+                if (search_may_match(ring, data->first_bytes, data->last_bytes, start_row, end_row))
+                        search_paragraph(search_match_state(),
+                                         data->regex, data->match_flags,
+                                         start_row, end_row,
+                                         add_match);
+
+                data->n_rows_searched += end_row - start_row;
+                if (g_get_monotonic_time() >= deadline)
+                        break;
+        }
+
+        if (data->progress_callback)
+                data->progress_callback(MIN(data->n_rows_searched, data->n_rows),
+                                        data->n_rows,
+                                        data->progress_data);
+
+        if (!done && data->range < data->n_ranges)
+                return true;
+
+        if (data->find_all) {
+                g_task_return_boolean(task, TRUE);
+        } else if (done) {
+                search_select_match(g_array_index(data->matches, vte::grid::span, 0), data->backward);
+                g_task_return_boolean(task, TRUE);
+        } else {
+                search_find_failed(data->backward);
+                g_task_return_boolean(task, FALSE);
+        }
+
+        return false;
+}
+
+/*
+ * Terminal::search_find_all_finish:
+ * @result: the #GAsyncResult of a search_async() with @find_all
+ * @ranges: return location for the matches
+ * @n_matches: return location for the number of matches
+ * @error: return location for a #GError, or %nullptr
+ *
+ * Returns: %true with the matches as the start row and column, and the end
+ *   row and the column after the end, one after the other in @ranges; or
+ *   %false with @error filled in
+ */
+bool
+Terminal::search_find_all_finish(GAsyncResult* result,
+                                 long** ranges,
+                                 gsize* n_matches,
+                                 GError** error)
+{
+        auto task = G_TASK(result);
+
+        if (!g_task_propagate_boolean(task, error)) {
+                *ranges = nullptr;
+                *n_matches = 0;
+                return false;
+        }
+
+        auto data = reinterpret_cast<SearchData*>(g_task_get_task_data(task));
+        auto const n = data->matches->len;
+        auto matches = g_new(long, 4 * n);
+        for (auto i = 0u; i < n; i++) {
+                auto const& match = g_array_index(data->matches, vte::grid::span, i);
+                matches[4 * i + 0] = match.start_row();
+                matches[4 * i + 1] = match.start_column();
+                matches[4 * i + 2] = match.end_row();
+                matches[4 * i + 3] = match.end_column();
+        }
+
+        *ranges = matches;
+        *n_matches = n;
+        return true;
 }
 
 /*
@@ -10882,7 +15050,8 @@ Terminal::set_input_enabled (bool enabled)
                         m_real_widget->im_focus_out();
 
                 disconnect_pty_write();
-                _vte_byte_array_clear(m_outgoing);
+                m_outgoing.clear();
+                paste_stop();
 
                 gtk_style_context_add_class (context, GTK_STYLE_CLASS_READ_ONLY);
         }
@@ -10963,6 +15132,8 @@ Terminal::set_word_char_exceptions(std::optional<std::string_view> stropt)
 {
         if (auto array = process_word_char_exceptions(stropt ? stropt.value() : WORD_CHAR_EXCEPTIONS_DEFAULT)) {
                 m_word_char_exceptions = *array;
+                for (gunichar c = 0; c < m_word_char_bmp.size(); c++)
+                        m_word_char_bmp[c] = is_word_char_uncached(c);
                 return true;
         }
 
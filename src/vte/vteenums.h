@@ -177,6 +177,78 @@ typedef enum {
         VTE_FORMAT_HTML = 2
 } VteFormat;
 
+/**
+ * VteScrollbackEncryption:
+ * @VTE_SCROLLBACK_ENCRYPTION_ALWAYS: Always encrypt the scrollback
+ * @VTE_SCROLLBACK_ENCRYPTION_AUTO: Encrypt the scrollback unless the
+ *   temporary directory is on a file system in memory, like tmpfs or ramfs
+ * @VTE_SCROLLBACK_ENCRYPTION_NEVER: Never encrypt the scrollback
+ *
+ * An enumeration type that can be used to specify whether the scrollback
+ * is encrypted before it is written to temporary files.
+ *
+ * Since: 0.60
+ */
+typedef enum {
+        VTE_SCROLLBACK_ENCRYPTION_ALWAYS = 0,
+        VTE_SCROLLBACK_ENCRYPTION_AUTO   = 1,
+        VTE_SCROLLBACK_ENCRYPTION_NEVER  = 2
+} VteScrollbackEncryption;
+
+/**
+ * VteInputLatencyStage:
+ * @VTE_INPUT_LATENCY_STAGE_WRITE: until the input for the key was written
+ *   to the PTY
+ * @VTE_INPUT_LATENCY_STAGE_READ: until output from the child was read
+ *   afterwards, normally the echo of the key
+ * @VTE_INPUT_LATENCY_STAGE_PROCESS: until that output was processed
+ * @VTE_INPUT_LATENCY_STAGE_PRESENT: until a frame was painted after that
+ *
+ * The times from a key press that vte_terminal_get_input_latency() reports.
+ *
+ * Since: 0.60
+ */
+typedef enum {
+        VTE_INPUT_LATENCY_STAGE_WRITE   = 0,
+        VTE_INPUT_LATENCY_STAGE_READ    = 1,
+        VTE_INPUT_LATENCY_STAGE_PROCESS = 2,
+        VTE_INPUT_LATENCY_STAGE_PRESENT = 3
+} VteInputLatencyStage;
+
+/**
+ * VteStateFlags:
+ * @VTE_STATE_DEFAULT: Save all of the state, including the scrollback
+ * @VTE_STATE_NO_SCROLLBACK: Leave out the scrollback, saving only the rows
+ *   on the screen
+ *
+ * Flags for vte_terminal_save_state().
+ *
+ * Since: 0.60
+ */
+typedef enum {
+        VTE_STATE_DEFAULT       = 0,
+        VTE_STATE_NO_SCROLLBACK = 1 << 0
+} VteStateFlags;
+
+/**
+ * VteShellMark:
+ * @VTE_SHELL_MARK_PROMPT: where a prompt starts
+ * @VTE_SHELL_MARK_COMMAND: where the command line starts, after the prompt
+ * @VTE_SHELL_MARK_OUTPUT: where the output of the command starts
+ * @VTE_SHELL_MARK_END: where the command finished
+ *
+ * The positions that shell integration marks with the OSC 133 A, B, C and D
+ * sequences, see vte_terminal_find_shell_mark().
+ *
+ * Since: 0.60
+ */
+typedef enum {
+        VTE_SHELL_MARK_PROMPT  = 0,
+        VTE_SHELL_MARK_COMMAND = 1,
+        VTE_SHELL_MARK_OUTPUT  = 2,
+        VTE_SHELL_MARK_END     = 3
+} VteShellMark;
+
 G_END_DECLS
 
 #endif /* __VTE_VTE_ENUMS_H__ */
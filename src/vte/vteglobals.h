@@ -21,6 +21,7 @@
 
 #include <glib.h>
 
+#include "vteenums.h"
 #include "vtemacros.h"
 
 G_BEGIN_DECLS
@@ -37,6 +38,26 @@ const char *vte_get_features (void);
 _VTE_PUBLIC
 void vte_set_test_flags(guint64 flags);
 
+_VTE_PUBLIC
+void vte_set_scrollback_budget(guint64 bytes);
+_VTE_PUBLIC
+guint64 vte_get_scrollback_budget(void);
+
+_VTE_PUBLIC
+void vte_get_glyph_cache_stats(guint *n_fonts,
+                               guint *n_glyphs,
+                               gsize *n_bytes);
+
+_VTE_PUBLIC
+void vte_set_font_metrics_cache_file(const char *filename);
+_VTE_PUBLIC
+const char *vte_get_font_metrics_cache_file(void);
+
+_VTE_PUBLIC
+void vte_set_scrollback_encryption(VteScrollbackEncryption encryption);
+_VTE_PUBLIC
+VteScrollbackEncryption vte_get_scrollback_encryption(void);
+
 G_END_DECLS
 
 #endif /* __VTE_VTE_GLOBALS_H__ */
@@ -32,6 +32,21 @@ G_BEGIN_DECLS
 
 #define VTE_SPAWN_NO_PARENT_ENVV (1 << 25)
 
+/**
+ * VTE_SPAWN_USE_HELPER:
+ *
+ * A #GSpawnFlags flag for vte_pty_spawn_async() and vte_terminal_spawn_async():
+ * fork the child from a small helper process that is started once and kept
+ * running, instead of from this process. The time taken by spawning then
+ * doesn't grow with the memory size of this process.
+ *
+ * The flag is ignored when there is a child setup function, since that
+ * would have to run in the helper, or when the helper can't be started.
+ *
+ * Since: 0.60
+ */
+#define VTE_SPAWN_USE_HELPER (1 << 26)
+
 _VTE_PUBLIC
 GQuark vte_pty_error_quark (void);
 
@@ -46,6 +46,10 @@ typedef struct _VteTerminal             VteTerminal;
 typedef struct _VteTerminalClass        VteTerminalClass;
 typedef struct _VteTerminalClassPrivate VteTerminalClassPrivate;
 typedef struct _VteCharAttributes       VteCharAttributes;
+typedef struct _VteDamageSpan           VteDamageSpan;
+typedef struct _VteFrameStats           VteFrameStats;
+typedef struct _VteInputLatency         VteInputLatency;
+typedef struct _VteMemoryStats          VteMemoryStats;
 
 /**
  * VteTerminal:
@@ -118,6 +122,133 @@ struct _VteCharAttributes {
 	guint underline:1, strikethrough:1, columns:4;
 };
 
+/**
+ * VteDamageSpan:
+ * @start_row: the first row
+ * @start_col: the first column
+ * @end_row: the last row
+ * @end_col: the last column
+ *
+ * A block of cells that changed, in the coordinates that
+ * vte_terminal_get_text_range() takes. All four bounds are inclusive.
+ *
+ * Since: 0.60
+ */
+struct _VteDamageSpan {
+        glong start_row;
+        glong start_col;
+        glong end_row;
+        glong end_col;
+};
+
+/**
+ * VteFrameStats:
+ * @time: the monotonic time at the end of the frame, in microseconds
+ * @bytes_parsed: the bytes of the child's output processed
+ * @sequences: the control sequences handled
+ * @rows_frozen: the rows moved to the scrollback storage
+ * @rows_thawed: the rows read back from the scrollback storage
+ * @draw_items: the characters drawn
+ * @fills: the background rectangles filled
+ * @process_us: the time spent processing the child's output
+ * @ringview_us: the time spent in BiDi and shaping of the displayed rows
+ * @draw_us: the time spent drawing the rows
+ * @signals_us: the time spent emitting signals, which includes updating
+ *   the accessibility information
+ * @frame_us: the time spent painting the frame, which includes
+ *   @ringview_us and @draw_us
+ *
+ * The work the terminal did for a frame it painted, including the work
+ * done since the previous frame.
+ *
+ * Since: 0.60
+ */
+struct _VteFrameStats {
+        gint64 time;
+        guint64 bytes_parsed;
+        guint64 sequences;
+        guint64 rows_frozen;
+        guint64 rows_thawed;
+        guint64 draw_items;
+        guint64 fills;
+        gint64 process_us;
+        gint64 ringview_us;
+        gint64 draw_us;
+        gint64 signals_us;
+        gint64 frame_us;
+};
+
+/**
+ * VTE_INPUT_LATENCY_N_BUCKETS:
+ *
+ * The number of buckets in #VteInputLatency.
+ *
+ * Since: 0.60
+ */
+#define VTE_INPUT_LATENCY_N_BUCKETS (24)
+
+/**
+ * VteInputLatency:
+ * @n_samples: the number of key presses measured
+ * @min_us: the shortest time, in microseconds
+ * @max_us: the longest time, in microseconds
+ * @total_us: the sum of the times, in microseconds
+ * @buckets: the number of times in each range: the first bucket counts
+ *   the times below 2µs, the bucket @i the times from 2^@i up to
+ *   2^(@i + 1) µs, and the last bucket also all the longer ones
+ *
+ * A histogram of the times a stage of the key presses took,
+ * see vte_terminal_get_input_latency().
+ *
+ * Since: 0.60
+ */
+struct _VteInputLatency {
+        guint64 n_samples;
+        gint64 min_us;
+        gint64 max_us;
+        gint64 total_us;
+        guint64 buckets[VTE_INPUT_LATENCY_N_BUCKETS];
+};
+
+/**
+ * VteMemoryStats:
+ * @ring_rows: the rows of the screens kept in memory, rather than in the
+ *   scrollback streams
+ * @ring_bytes: the bytes those rows take, with the space kept for the rows
+ *   appended next
+ * @row_cache_bytes: the bytes of the rows read back from the scrollback
+ *   streams and kept for scrolling through it
+ * @hyperlink_bytes: the bytes of the hyperlink pools
+ * @unistr_bytes: the bytes of the table of the combined characters, which
+ *   all terminals in the process share
+ * @bidi_bytes: the bytes of the displayed rows' BiDi mappings
+ * @image_bytes: the bytes of the images, after compression
+ * @incoming_bytes: the bytes of the child's output waiting to be processed
+ * @outgoing_bytes: the bytes of input waiting to be written to the child
+ * @stream_bytes: the bytes the scrollback streams take in their files,
+ *   that is, after compression
+ * @stream_uncompressed_bytes: the bytes of the scrollback streams before
+ *   compression
+ *
+ * The memory and the disk space a terminal uses, see
+ * vte_terminal_get_memory_stats(). All but @stream_bytes are in memory.
+ *
+ * Since: 0.60
+ */
+struct _VteMemoryStats {
+        guint64 ring_rows;
+        guint64 ring_bytes;
+        guint64 row_cache_bytes;
+        guint64 hyperlink_bytes;
+        guint64 unistr_bytes;
+        guint64 bidi_bytes;
+        guint64 image_bytes;
+        guint64 incoming_bytes;
+        guint64 outgoing_bytes;
+        guint64 stream_bytes;
+        guint64 stream_uncompressed_bytes;
+};
+
 typedef gboolean (*VteSelectionFunc)(VteTerminal *terminal,
                                      glong column,
                                      glong row,
@@ -167,9 +298,14 @@ void vte_terminal_feed(VteTerminal *terminal,
                        const char *data,
                        gssize length) _VTE_GNUC_NONNULL(1);
 _VTE_PUBLIC
+void vte_terminal_feed_bytes(VteTerminal *terminal,
+                             GBytes *bytes) _VTE_GNUC_NONNULL(1) _VTE_GNUC_NONNULL(2);
+_VTE_PUBLIC
 void vte_terminal_feed_child(VteTerminal *terminal,
                              const char *text,
                              gssize length) _VTE_GNUC_NONNULL(1);
+_VTE_PUBLIC
+gsize vte_terminal_get_pending_input_size(VteTerminal *terminal) _VTE_GNUC_NONNULL(1);
 
 /* Copy currently-selected text to the clipboard, or from the clipboard to
  * the terminal. */
@@ -183,6 +319,8 @@ void vte_terminal_copy_primary(VteTerminal *terminal) _VTE_GNUC_NONNULL(1);
 _VTE_PUBLIC
 void vte_terminal_paste_primary(VteTerminal *terminal) _VTE_GNUC_NONNULL(1);
 _VTE_PUBLIC
+void vte_terminal_cancel_paste(VteTerminal *terminal) _VTE_GNUC_NONNULL(1);
+_VTE_PUBLIC
 void vte_terminal_select_all(VteTerminal *terminal) _VTE_GNUC_NONNULL(1);
 _VTE_PUBLIC
 void vte_terminal_unselect_all(VteTerminal *terminal) _VTE_GNUC_NONNULL(1);
@@ -291,6 +429,11 @@ void vte_terminal_set_scrollback_lines(VteTerminal *terminal,
                                        glong lines) _VTE_GNUC_NONNULL(1);
 _VTE_PUBLIC
 glong vte_terminal_get_scrollback_lines(VteTerminal *terminal) _VTE_GNUC_NONNULL(1);
+_VTE_PUBLIC
+void vte_terminal_set_scrollback_bytes(VteTerminal *terminal,
+                                       guint64 bytes) _VTE_GNUC_NONNULL(1);
+_VTE_PUBLIC
+guint64 vte_terminal_get_scrollback_bytes(VteTerminal *terminal) _VTE_GNUC_NONNULL(1);
 
 /* Set or retrieve the current font. */
 _VTE_PUBLIC
@@ -336,6 +479,30 @@ void vte_terminal_set_enable_shaping(VteTerminal *terminal,
 _VTE_PUBLIC
 gboolean vte_terminal_get_enable_shaping(VteTerminal *terminal) _VTE_GNUC_NONNULL(1);
 
+_VTE_PUBLIC
+void vte_terminal_set_enable_io_thread(VteTerminal *terminal,
+                                       gboolean enable_io_thread) _VTE_GNUC_NONNULL(1);
+_VTE_PUBLIC
+gboolean vte_terminal_get_enable_io_thread(VteTerminal *terminal) _VTE_GNUC_NONNULL(1);
+
+_VTE_PUBLIC
+void vte_terminal_set_headless(VteTerminal *terminal,
+                               gboolean headless) _VTE_GNUC_NONNULL(1);
+_VTE_PUBLIC
+gboolean vte_terminal_get_headless(VteTerminal *terminal) _VTE_GNUC_NONNULL(1);
+
+_VTE_PUBLIC
+void vte_terminal_set_input_queue_limit(VteTerminal *terminal,
+                                        guint limit) _VTE_GNUC_NONNULL(1);
+_VTE_PUBLIC
+guint vte_terminal_get_input_queue_limit(VteTerminal *terminal) _VTE_GNUC_NONNULL(1);
+
+_VTE_PUBLIC
+void vte_terminal_set_resize_delay(VteTerminal *terminal,
+                                   guint delay) _VTE_GNUC_NONNULL(1);
+_VTE_PUBLIC
+guint vte_terminal_get_resize_delay(VteTerminal *terminal) _VTE_GNUC_NONNULL(1);
+
 /* Manipulate the autohide setting. */
 _VTE_PUBLIC
 void vte_terminal_set_mouse_autohide(VteTerminal *terminal,
@@ -368,6 +535,21 @@ char *vte_terminal_get_text_range(VteTerminal *terminal,
 				  gpointer user_data,
 				  GArray *attributes) _VTE_GNUC_NONNULL(1) G_GNUC_MALLOC;
 _VTE_PUBLIC
+VteDamageSpan *vte_terminal_get_damage(VteTerminal *terminal,
+                                       gsize *n_spans) _VTE_GNUC_NONNULL(1) _VTE_GNUC_NONNULL(2) G_GNUC_MALLOC;
+_VTE_PUBLIC
+VteFrameStats *vte_terminal_get_frame_stats(VteTerminal *terminal,
+                                            gsize *n_frames) _VTE_GNUC_NONNULL(1) _VTE_GNUC_NONNULL(2) G_GNUC_MALLOC;
+_VTE_PUBLIC
+void vte_terminal_get_input_latency(VteTerminal *terminal,
+                                    VteInputLatencyStage stage,
+                                    VteInputLatency *latency) _VTE_GNUC_NONNULL(1) _VTE_GNUC_NONNULL(3);
+_VTE_PUBLIC
+void vte_terminal_reset_input_latency(VteTerminal *terminal) _VTE_GNUC_NONNULL(1);
+_VTE_PUBLIC
+void vte_terminal_get_memory_stats(VteTerminal *terminal,
+                                   VteMemoryStats *stats) _VTE_GNUC_NONNULL(1) _VTE_GNUC_NONNULL(2);
+_VTE_PUBLIC
 void vte_terminal_get_cursor_position(VteTerminal *terminal,
 				      glong *column,
                                       glong *row) _VTE_GNUC_NONNULL(1);
@@ -423,6 +605,34 @@ _VTE_PUBLIC
 gboolean  vte_terminal_search_find_previous   (VteTerminal *terminal) _VTE_GNUC_NONNULL(1);
 _VTE_PUBLIC
 gboolean  vte_terminal_search_find_next       (VteTerminal *terminal) _VTE_GNUC_NONNULL(1);
+_VTE_PUBLIC
+void      vte_terminal_search_find_async      (VteTerminal *terminal,
+                                               gboolean backward,
+                                               GCancellable *cancellable,
+                                               GFileProgressCallback progress_callback,
+                                               gpointer progress_data,
+                                               GDestroyNotify progress_data_destroy,
+                                               GAsyncReadyCallback callback,
+                                               gpointer user_data) _VTE_GNUC_NONNULL(1);
+_VTE_PUBLIC
+gboolean  vte_terminal_search_find_finish     (VteTerminal *terminal,
+                                               GAsyncResult *result,
+                                               GError **error) _VTE_GNUC_NONNULL(1) _VTE_GNUC_NONNULL(2);
+_VTE_PUBLIC
+void      vte_terminal_search_find_all_async  (VteTerminal *terminal,
+                                               gsize max_matches,
+                                               GCancellable *cancellable,
+                                               GFileProgressCallback progress_callback,
+                                               gpointer progress_data,
+                                               GDestroyNotify progress_data_destroy,
+                                               GAsyncReadyCallback callback,
+                                               gpointer user_data) _VTE_GNUC_NONNULL(1);
+_VTE_PUBLIC
+gboolean  vte_terminal_search_find_all_finish (VteTerminal *terminal,
+                                               GAsyncResult *result,
+                                               glong **ranges,
+                                               gsize *n_matches,
+                                               GError **error) _VTE_GNUC_NONNULL(1) _VTE_GNUC_NONNULL(2) _VTE_GNUC_NONNULL(3) _VTE_GNUC_NONNULL(4);
 
 
 /* CJK compatibility setting */
@@ -477,6 +687,93 @@ gboolean vte_terminal_write_contents_sync (VteTerminal *terminal,
                                            GCancellable *cancellable,
                                            GError **error) _VTE_GNUC_NONNULL(1) _VTE_GNUC_NONNULL(2);
 
+_VTE_PUBLIC
+void vte_terminal_write_contents_async(VteTerminal *terminal,
+                                       GOutputStream *stream,
+                                       VteWriteFlags flags,
+                                       GCancellable *cancellable,
+                                       GFileProgressCallback progress_callback,
+                                       gpointer progress_data,
+                                       GDestroyNotify progress_data_destroy,
+                                       GAsyncReadyCallback callback,
+                                       gpointer user_data) _VTE_GNUC_NONNULL(1) _VTE_GNUC_NONNULL(2);
+
+_VTE_PUBLIC
+gboolean vte_terminal_write_contents_finish(VteTerminal *terminal,
+                                            GAsyncResult *result,
+                                            GError **error) _VTE_GNUC_NONNULL(1) _VTE_GNUC_NONNULL(2);
+
+_VTE_PUBLIC
+void vte_terminal_write_text_range_async(VteTerminal *terminal,
+                                         long start_row,
+                                         long start_col,
+                                         long end_row,
+                                         long end_col,
+                                         VteFormat format,
+                                         GOutputStream *stream,
+                                         GCancellable *cancellable,
+                                         GAsyncReadyCallback callback,
+                                         gpointer user_data) _VTE_GNUC_NONNULL(1) _VTE_GNUC_NONNULL(7);
+
+_VTE_PUBLIC
+gboolean vte_terminal_write_text_range_finish(VteTerminal *terminal,
+                                              GAsyncResult *result,
+                                              GError **error) _VTE_GNUC_NONNULL(1) _VTE_GNUC_NONNULL(2);
+
+_VTE_PUBLIC
+gboolean vte_terminal_save_scrollback(VteTerminal *terminal,
+                                      GOutputStream *stream,
+                                      GCancellable *cancellable,
+                                      GError **error) _VTE_GNUC_NONNULL(1) _VTE_GNUC_NONNULL(2);
+
+_VTE_PUBLIC
+gboolean vte_terminal_restore_scrollback(VteTerminal *terminal,
+                                         GInputStream *stream,
+                                         GCancellable *cancellable,
+                                         GError **error) _VTE_GNUC_NONNULL(1) _VTE_GNUC_NONNULL(2);
+
+_VTE_PUBLIC
+gboolean vte_terminal_save_state(VteTerminal *terminal,
+                                 GOutputStream *stream,
+                                 VteStateFlags flags,
+                                 GCancellable *cancellable,
+                                 GError **error) _VTE_GNUC_NONNULL(1) _VTE_GNUC_NONNULL(2);
+
+_VTE_PUBLIC
+gboolean vte_terminal_restore_state(VteTerminal *terminal,
+                                    GInputStream *stream,
+                                    GCancellable *cancellable,
+                                    GError **error) _VTE_GNUC_NONNULL(1) _VTE_GNUC_NONNULL(2);
+
+_VTE_PUBLIC
+guint vte_terminal_add_mark(VteTerminal *terminal,
+                            long column,
+                            long row) _VTE_GNUC_NONNULL(1);
+_VTE_PUBLIC
+gboolean vte_terminal_get_mark(VteTerminal *terminal,
+                               guint mark,
+                               long *column,
+                               long *row) _VTE_GNUC_NONNULL(1);
+_VTE_PUBLIC
+void vte_terminal_remove_mark(VteTerminal *terminal,
+                              guint mark) _VTE_GNUC_NONNULL(1);
+
+_VTE_PUBLIC
+gboolean vte_terminal_find_shell_mark(VteTerminal *terminal,
+                                      VteShellMark kind,
+                                      long row,
+                                      gboolean backward,
+                                      long *column,
+                                      long *mark_row) _VTE_GNUC_NONNULL(1);
+_VTE_PUBLIC
+gboolean vte_terminal_get_command_output(VteTerminal *terminal,
+                                         long row,
+                                         long *start_row,
+                                         long *start_col,
+                                         long *end_row,
+                                         long *end_col,
+                                         int *exit_status) _VTE_GNUC_NONNULL(1);
+
 G_DEFINE_AUTOPTR_CLEANUP_FUNC(VteTerminal, g_object_unref)
 
 G_END_DECLS
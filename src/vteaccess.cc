@@ -51,15 +51,24 @@ enum {
         LAST_ACTION
 };
 
+typedef struct _VteTerminalAccessibleRow {
+	guint byte_offset;	/* Into snapshot_text. */
+	guint char_offset;	/* Into snapshot_characters. */
+} VteTerminalAccessibleRow;
+
 typedef struct _VteTerminalAccessiblePrivate {
-	gboolean snapshot_contents_invalid;	/* This data is stale. */
+	gboolean snapshot_contents_invalid;	/* This data was never read. */
 	gboolean snapshot_caret_invalid;	/* This data is stale. */
 	GString *snapshot_text;		/* Pointer to UTF-8 text. */
 	GArray *snapshot_characters;	/* Offsets to character begin points. */
 	GArray *snapshot_attributes;	/* Attributes, per byte. */
 	GArray *snapshot_linebreaks;	/* Offsets to line breaks. */
+	GArray *snapshot_rows;		/* Offsets to each displayed row. */
+	glong snapshot_first_row;	/* The row snapshot_rows starts at. */
 	gint snapshot_caret;       /* Location of the cursor (in characters). */
         gboolean text_caret_moved_pending;
+	guint update_source;		/* Emits the deferred changes. */
+	gint64 last_update_time;	/* When the changes were last emitted. */
 
 	char *action_descriptions[LAST_ACTION];
 } VteTerminalAccessiblePrivate;
@@ -158,192 +167,345 @@ emit_text_caret_moved(GObject *object, glong caret)
 
 static void
 emit_text_changed_insert(GObject *object,
-			 const char *text, glong offset, glong len)
+			 const char *text, glong len,
+			 glong start, glong count)
 {
-	glong start, count;
-	if (len == 0) {
+	if (count == 0) {
 		return;
 	}
-	/* Convert the byte offsets to character offsets. */
-	start = g_utf8_pointer_to_offset (text, text + offset);
-	count = g_utf8_pointer_to_offset (text + offset, text + offset + len);
 	_vte_debug_print(VTE_DEBUG_SIGNALS|VTE_DEBUG_ALLY,
 			"Accessibility peer emitting "
-			"`text-changed::insert' (%ld, %ld) (%ld, %ld).\n"
+			"`text-changed::insert' (%ld, %ld).\n"
 			"Inserted text was `%.*s'.\n",
-			offset, len, start, count,
-			(int) len, text + offset);
+			start, count,
+			(int) len, text);
 	g_signal_emit_by_name(object, "text-changed::insert", start, count);
 }
 
 static void
 emit_text_changed_delete(GObject *object,
-			 const char *text, glong offset, glong len)
+			 const char *text, glong len,
+			 glong start, glong count)
 {
-	glong start, count;
-	if (len == 0) {
+	if (count == 0) {
 		return;
 	}
-	/* Convert the byte offsets to characters. */
-	start = g_utf8_pointer_to_offset (text, text + offset);
-	count = g_utf8_pointer_to_offset (text + offset, text + offset + len);
 	_vte_debug_print(VTE_DEBUG_SIGNALS|VTE_DEBUG_ALLY,
 			"Accessibility peer emitting "
-			"`text-changed::delete' (%ld, %ld) (%ld, %ld).\n"
+			"`text-changed::delete' (%ld, %ld).\n"
 			"Deleted text was `%.*s'.\n",
-			offset, len, start, count,
-			(int) len, text + offset);
+			start, count,
+			(int) len, text);
 	g_signal_emit_by_name(object, "text-changed::delete", start, count);
 }
 
+/* Returns the offsets of the text of row @i of the snapshot, or of the
+ * end of the text if @i is past the last row. */
+static VteTerminalAccessibleRow
+snapshot_row_offsets(VteTerminalAccessiblePrivate *priv, guint i)
+{
+	VteTerminalAccessibleRow end;
+
+	if (i < priv->snapshot_rows->len)
+		return g_array_index(priv->snapshot_rows, VteTerminalAccessibleRow, i);
+
+	end.byte_offset = priv->snapshot_text->len;
+	end.char_offset = priv->snapshot_characters->len;
+	return end;
+}
+
+/* Replaces the text of the @n_old rows of the snapshot from @first with
+ * the text of the @n_new rows of the terminal from @row, and emits the
+ * part of it that changed, if @emit.
+ *
+ * Returns: whether the text changed
+ */
+static gboolean
+vte_terminal_accessible_replace_rows(VteTerminalAccessible *accessible,
+				     guint first, guint n_old,
+				     glong row, guint n_new,
+				     gboolean emit)
+{
+	VteTerminalAccessiblePrivate *priv = (VteTerminalAccessiblePrivate *)_vte_terminal_accessible_get_instance_private(accessible);
+	auto impl = IMPL_FROM_ACCESSIBLE(accessible);
+	VteTerminalAccessibleRow start, end, offsets;
+	GArray *attributes, *characters, *rows;
+	GString *text;
+	guint i, r;
+
+	start = snapshot_row_offsets(priv, first);
+	end = snapshot_row_offsets(priv, first + n_old);
+	glong const old_len = end.byte_offset - start.byte_offset;
+	glong const old_count = end.char_offset - start.char_offset;
+
+	/* Get the new text, and find the offsets of its characters and
+	 * rows in the snapshot it goes into. */
+	attributes = g_array_new(FALSE, FALSE, sizeof(struct _VteCharAttributes));
+	if (n_new > 0) {
+		text = impl->get_text(row, 0, row + n_new, 0,
+				      false /* block */, true /* wrap */,
+				      attributes);
+	} else {
+		text = g_string_new(NULL);
+	}
+
+	characters = g_array_new(FALSE, FALSE, sizeof(int));
+	rows = g_array_sized_new(FALSE, FALSE, sizeof(VteTerminalAccessibleRow), n_new);
+	r = 0;
+	for (i = 0; i < attributes->len; i = g_utf8_next_char(text->str + i) - text->str) {
+		auto const attr_row = g_array_index(attributes, struct _VteCharAttributes, i).row - row;
+		for (; r < n_new && r <= attr_row; r++) {
+			offsets.byte_offset = start.byte_offset + i;
+			offsets.char_offset = start.char_offset + characters->len;
+			g_array_append_val(rows, offsets);
+		}
+		int const offset = start.byte_offset + i;
+		g_array_append_val(characters, offset);
+	}
+	for (; r < n_new; r++) {
+		offsets.byte_offset = start.byte_offset + text->len;
+		offsets.char_offset = start.char_offset + characters->len;
+		g_array_append_val(rows, offsets);
+	}
+
+	/* Only the middle part, between what's the same at both ends,
+	 * was deleted and inserted. */
+	char const* old_text = priv->snapshot_text->str + start.byte_offset;
+	glong const new_len = text->len;
+	glong const new_count = characters->len;
+	glong prefix = 0, prefix_len = 0;
+	while (prefix < old_count && prefix < new_count &&
+	       g_utf8_get_char(old_text + prefix_len) == g_utf8_get_char(text->str + prefix_len)) {
+		prefix_len = g_utf8_next_char(old_text + prefix_len) - old_text;
+		prefix++;
+	}
+	glong suffix = 0, old_suffix_len = 0, new_suffix_len = 0;
+	while (prefix + suffix < old_count && prefix + suffix < new_count) {
+		char const* op = g_utf8_prev_char(old_text + old_len - old_suffix_len);
+		char const* np = g_utf8_prev_char(text->str + new_len - new_suffix_len);
+		if (g_utf8_get_char(op) != g_utf8_get_char(np))
+			break;
+		old_suffix_len = old_text + old_len - op;
+		new_suffix_len = text->str + new_len - np;
+		suffix++;
+	}
+	glong const n_deleted = old_count - prefix - suffix;
+	glong const n_inserted = new_count - prefix - suffix;
+
+	/* The deleted text is still there while emitting. */
+	if (emit) {
+		emit_text_changed_delete(G_OBJECT(accessible),
+					 old_text + prefix_len,
+					 old_len - prefix_len - old_suffix_len,
+					 start.char_offset + prefix,
+					 n_deleted);
+	}
+
+	/* Splice the new text into the snapshot. */
+	if (new_len != old_len) {
+		g_string_erase(priv->snapshot_text, start.byte_offset, old_len);
+		g_string_insert_len(priv->snapshot_text, start.byte_offset, text->str, new_len);
+		g_array_remove_range(priv->snapshot_attributes, start.byte_offset, old_len);
+		g_array_insert_vals(priv->snapshot_attributes, start.byte_offset,
+				    attributes->data, attributes->len);
+	} else if (new_len > 0) {
+		memcpy(priv->snapshot_text->str + start.byte_offset, text->str, new_len);
+		memcpy(&g_array_index(priv->snapshot_attributes, struct _VteCharAttributes, start.byte_offset),
+		       attributes->data, new_len * sizeof(struct _VteCharAttributes));
+	}
+
+	g_array_remove_range(priv->snapshot_characters, start.char_offset, old_count);
+	g_array_insert_vals(priv->snapshot_characters, start.char_offset,
+			    characters->data, characters->len);
+	if (new_len != old_len) {
+		for (i = start.char_offset + new_count; i < priv->snapshot_characters->len; i++)
+			g_array_index(priv->snapshot_characters, int, i) += new_len - old_len;
+	}
+
+	g_array_remove_range(priv->snapshot_rows, first, n_old);
+	g_array_insert_vals(priv->snapshot_rows, first, rows->data, rows->len);
+	if (new_len != old_len || new_count != old_count) {
+		for (i = first + n_new; i < priv->snapshot_rows->len; i++) {
+			auto& row_offsets = g_array_index(priv->snapshot_rows, VteTerminalAccessibleRow, i);
+			row_offsets.byte_offset += new_len - old_len;
+			row_offsets.char_offset += new_count - old_count;
+		}
+	}
+
+	if (emit) {
+		emit_text_changed_insert(G_OBJECT(accessible),
+					 text->str + prefix_len,
+					 new_len - prefix_len - new_suffix_len,
+					 start.char_offset + prefix,
+					 n_inserted);
+	}
+
+	g_array_free(rows, TRUE);
+	g_array_free(characters, TRUE);
+	g_array_free(attributes, TRUE);
+	g_string_free(text, TRUE);
+
+	return n_deleted > 0 || n_inserted > 0;
+}
+
+/* Brings the snapshot up to date with the displayed rows, reading only
+ * the rows that scrolled into view or changed since the last update, and
+ * emits the changes if @emit. If @bulk, all of the rows are compared at
+ * once instead, so the changes are emitted as one.
+ *
+ * Returns: whether the text changed
+ */
+static gboolean
+vte_terminal_accessible_update_rows(VteTerminalAccessible *accessible,
+				    gboolean emit,
+				    gboolean bulk)
+{
+	VteTerminalAccessiblePrivate *priv = (VteTerminalAccessiblePrivate *)_vte_terminal_accessible_get_instance_private(accessible);
+	VteTerminal *terminal = TERMINAL_FROM_ACCESSIBLE(accessible);
+	auto impl = IMPL(terminal);
+	VteTerminalAccessibleRow offsets, next;
+	gboolean changed = FALSE;
+	guint i;
+
+	if (priv->snapshot_text == NULL) {
+		priv->snapshot_text = g_string_new(NULL);
+		priv->snapshot_characters = g_array_new(FALSE, FALSE, sizeof(int));
+		priv->snapshot_attributes = g_array_new(FALSE, FALSE, sizeof(struct _VteCharAttributes));
+		priv->snapshot_linebreaks = g_array_new(FALSE, FALSE, sizeof(int));
+		priv->snapshot_rows = g_array_new(FALSE, FALSE, sizeof(VteTerminalAccessibleRow));
+	}
+
+	auto const damage = impl->a11y_damage();
+	glong const first_row = impl->a11y_first_row();
+	glong const n_rows = vte_terminal_get_row_count(terminal);
+	glong const n_old = priv->snapshot_rows->len;
+	glong const shift = first_row - priv->snapshot_first_row;
+	gboolean const all = priv->snapshot_contents_invalid ||
+		bulk ||
+		damage == nullptr ||
+		n_old != n_rows ||
+		ABS(shift) >= n_rows;
+
+	/* Anything asking for the text while the changes are emitted gets
+	 * the text as far as it's updated. */
+	priv->snapshot_contents_invalid = FALSE;
+
+	if (all) {
+		changed = vte_terminal_accessible_replace_rows(accessible, 0, n_old,
+							       first_row, n_rows, emit);
+	} else {
+		/* Drop the rows that scrolled out of view, and read the
+		 * ones that scrolled in. */
+		if (shift > 0) {
+			changed |= vte_terminal_accessible_replace_rows(accessible, 0, shift,
+									first_row, 0, emit);
+			changed |= vte_terminal_accessible_replace_rows(accessible, n_rows - shift, 0,
+									first_row + n_rows - shift, shift, emit);
+		} else if (shift < 0) {
+			changed |= vte_terminal_accessible_replace_rows(accessible, n_rows + shift, -shift,
+									first_row, 0, emit);
+			changed |= vte_terminal_accessible_replace_rows(accessible, 0, 0,
+									first_row, -shift, emit);
+		}
+
+		/* Read the rows that changed again. */
+		damage->for_each_span([&](vte::grid::row_t row_start,
+					  vte::grid::row_t row_end,
+					  vte::grid::column_t,
+					  vte::grid::column_t) {
+			row_start = MAX(row_start, first_row);
+			row_end = MIN(row_end, first_row + n_rows - 1);
+			if (row_start > row_end)
+				return;
+			changed |= vte_terminal_accessible_replace_rows(accessible,
+									row_start - first_row,
+									row_end - row_start + 1,
+									row_start,
+									row_end - row_start + 1,
+									emit);
+		});
+	}
+
+	priv->snapshot_first_row = first_row;
+	impl->a11y_damage_reset();
+
+	/* Find offsets for the beginning of lines, that is, of the rows
+	 * that have any characters. */
+	g_array_set_size(priv->snapshot_linebreaks, 0);
+	for (i = 0; i < priv->snapshot_rows->len; i++) {
+		offsets = snapshot_row_offsets(priv, i);
+		next = snapshot_row_offsets(priv, i + 1);
+		if (next.char_offset > offsets.char_offset) {
+			_vte_debug_print(VTE_DEBUG_ALLY,
+					"Row %d/%ld begins at %u.\n",
+					priv->snapshot_linebreaks->len,
+					first_row + i, offsets.char_offset);
+			g_array_append_val(priv->snapshot_linebreaks, offsets.char_offset);
+		}
+	}
+	/* Add the final line break. */
+	g_array_append_val(priv->snapshot_linebreaks, priv->snapshot_characters->len);
+
+	_vte_debug_print(VTE_DEBUG_ALLY,
+			"Updated accessibility snapshot%s, "
+			"%ld cells, %ld characters.\n",
+			all ? " from scratch" : "",
+			(long)priv->snapshot_attributes->len,
+			(long)priv->snapshot_characters->len);
+
+	return changed;
+}
+
 static void
-vte_terminal_accessible_update_private_data_if_needed(VteTerminalAccessible *accessible,
-                                                      GString **old_text,
-                                                      GArray **old_characters)
+vte_terminal_accessible_update_private_data_if_needed(VteTerminalAccessible *accessible)
 {
 	VteTerminalAccessiblePrivate *priv = (VteTerminalAccessiblePrivate *)_vte_terminal_accessible_get_instance_private(accessible);
 	struct _VteCharAttributes attrs;
-	char *next;
-	long row, offset, caret;
+	VteTerminalAccessibleRow offsets, next;
+	long offset, caret;
 	long ccol, crow;
 	guint i;
 
 	/* If nothing's changed, just return immediately. */
 	if ((priv->snapshot_contents_invalid == FALSE) &&
 	    (priv->snapshot_caret_invalid == FALSE)) {
-                if (old_text) {
-			if (priv->snapshot_text) {
-                                *old_text = g_string_new_len(priv->snapshot_text->str,
-                                                             priv->snapshot_text->len);
-			} else {
-                                *old_text = g_string_new("");
-			}
-                }
-                if (old_characters) {
-                        if (priv->snapshot_characters) {
-                                *old_characters = g_array_sized_new(FALSE, FALSE, sizeof(int),
-                                                                    priv->snapshot_characters->len);
-                                g_array_append_vals(*old_characters,
-                                                    priv->snapshot_characters->data,
-                                                    priv->snapshot_characters->len);
-                        } else {
-                                *old_characters = g_array_new(FALSE, FALSE, sizeof(int));
-			}
-		}
 		return;
 	}
 
-	/* Re-read the contents of the widget if the contents have changed. */
-        VteTerminal* terminal = TERMINAL_FROM_ACCESSIBLE(accessible);
-        auto impl = IMPL(terminal);
+	/* Read the contents of the widget if they haven't been yet; after
+	 * that, the signal handlers keep them up to date. */
 	if (priv->snapshot_contents_invalid) {
-		/* Free the outdated snapshot data, unless the caller
-		 * wants it. */
-                if (old_text) {
-			if (priv->snapshot_text != NULL) {
-                                *old_text = priv->snapshot_text;
-			} else {
-                                *old_text = g_string_new("");
-			}
-		} else {
-			if (priv->snapshot_text != NULL) {
-				g_string_free(priv->snapshot_text, TRUE);
-			}
-		}
-		priv->snapshot_text = NULL;
-
-                /* Free the character offsets unless the caller wants it,
-                 * and allocate a new array to hold them. */
-                if (old_characters) {
-                        if (priv->snapshot_characters != NULL) {
-                                *old_characters = priv->snapshot_characters;
-                        } else {
-                                *old_characters = g_array_new(FALSE, FALSE, sizeof(int));
-                        }
-                } else {
-                        if (priv->snapshot_characters != NULL) {
-                                g_array_free(priv->snapshot_characters, TRUE);
-                        }
-		}
-		priv->snapshot_characters = g_array_new(FALSE, FALSE, sizeof(int));
-
-		/* Free the attribute lists and allocate a new array to hold
-		 * them. */
-		if (priv->snapshot_attributes != NULL) {
-			g_array_free(priv->snapshot_attributes, TRUE);
-		}
-		priv->snapshot_attributes = g_array_new(FALSE, FALSE,
-							sizeof(struct _VteCharAttributes));
+		vte_terminal_accessible_update_rows(accessible, FALSE, FALSE);
+	}
 
-		/* Free the linebreak offsets and allocate a new array to hold
-		 * them. */
-		if (priv->snapshot_linebreaks != NULL) {
-			g_array_free(priv->snapshot_linebreaks, TRUE);
-		}
-		priv->snapshot_linebreaks = g_array_new(FALSE, FALSE, sizeof(int));
+	/* Update the caret position. */
+	VteTerminal* terminal = TERMINAL_FROM_ACCESSIBLE(accessible);
+	vte_terminal_get_cursor_position(terminal, &ccol, &crow);
+	_vte_debug_print(VTE_DEBUG_ALLY,
+			"Cursor at (%ld, " "%ld).\n", ccol, crow);
 
-		/* Get a new view of the uber-label. */
-		priv->snapshot_text = impl->get_text_displayed_a11y(true /* wrap */,
-                                                                             priv->snapshot_attributes);
-
-		/* Get the offsets to the beginnings of each character. */
-		i = 0;
-		next = priv->snapshot_text->str;
-		while (i < priv->snapshot_attributes->len) {
-			g_array_append_val(priv->snapshot_characters, i);
-			next = g_utf8_next_char(next);
-			if (next == NULL) {
-				break;
-			} else {
-				i = next - priv->snapshot_text->str;
-			}
-		}
-		/* Find offsets for the beginning of lines. */
-		for (i = 0, row = 0; i < priv->snapshot_characters->len; i++) {
+	/* The caret is after the characters of the rows above the cursor,
+	 * and of the cells before it. */
+	if (crow < priv->snapshot_first_row) {
+		caret = 0;
+	} else if (crow - priv->snapshot_first_row >= (long)priv->snapshot_rows->len) {
+		caret = priv->snapshot_characters->len;
+	} else {
+		offsets = snapshot_row_offsets(priv, crow - priv->snapshot_first_row);
+		next = snapshot_row_offsets(priv, crow - priv->snapshot_first_row + 1);
+		caret = offsets.char_offset;
+		for (i = offsets.char_offset; i < next.char_offset; i++) {
 			/* Get the attributes for the current cell. */
 			offset = g_array_index(priv->snapshot_characters,
 					       int, i);
 			attrs = g_array_index(priv->snapshot_attributes,
 					      struct _VteCharAttributes,
 					      offset);
-			/* If this character is on a row different from the row
-			 * the character we looked at previously was on, then
-			 * it's a new line and we need to keep track of where
-			 * it is. */
-			if ((i == 0) || (attrs.row != row)) {
-				_vte_debug_print(VTE_DEBUG_ALLY,
-						"Row %d/%ld begins at %u.\n",
-						priv->snapshot_linebreaks->len,
-						attrs.row, i);
-				g_array_append_val(priv->snapshot_linebreaks, i);
+			/* If this cell is "before" the cursor, move the
+			 * caret to be "here". */
+			if (attrs.column < ccol) {
+				caret = i + 1;
 			}
-			row = attrs.row;
-		}
-		/* Add the final line break. */
-		g_array_append_val(priv->snapshot_linebreaks, i);
-		/* We're finished updating this. */
-		priv->snapshot_contents_invalid = FALSE;
-	}
-
-	/* Update the caret position. */
-	vte_terminal_get_cursor_position(terminal, &ccol, &crow);
-	_vte_debug_print(VTE_DEBUG_ALLY,
-			"Cursor at (%ld, " "%ld).\n", ccol, crow);
-
-	/* Get the offsets to the beginnings of each line. */
-	caret = 0;
-	for (i = 0; i < priv->snapshot_characters->len; i++) {
-		/* Get the attributes for the current cell. */
-		offset = g_array_index(priv->snapshot_characters,
-				       int, i);
-		attrs = g_array_index(priv->snapshot_attributes,
-				      struct _VteCharAttributes,
-				      offset);
-		/* If this cell is "before" the cursor, move the
-		 * caret to be "here". */
-		if ((attrs.row < crow) ||
-		    ((attrs.row == crow) && (attrs.column < ccol))) {
-			caret = i + 1;
 		}
 	}
 
@@ -356,12 +518,6 @@ vte_terminal_accessible_update_private_data_if_needed(VteTerminalAccessible *acc
 
 	/* Done updating the caret position, whether we needed to or not. */
 	priv->snapshot_caret_invalid = FALSE;
-
-	_vte_debug_print(VTE_DEBUG_ALLY,
-			"Refreshed accessibility snapshot, "
-			"%ld cells, %ld characters.\n",
-			(long)priv->snapshot_attributes->len,
-			(long)priv->snapshot_characters->len);
 }
 
 static void
@@ -375,117 +531,88 @@ vte_terminal_accessible_maybe_emit_text_caret_moved(VteTerminalAccessible *acces
         }
 }
 
-/* A signal handler to catch "text-inserted/deleted/modified" signals. */
+/* Brings the snapshot up to date, and emits the changes; if @bulk, as
+ * one change spanning all of them. */
 static void
-vte_terminal_accessible_text_modified(VteTerminal *terminal, gpointer data)
+vte_terminal_accessible_update(VteTerminalAccessible *accessible,
+			       gboolean bulk)
 {
-        VteTerminalAccessible *accessible = (VteTerminalAccessible *)data;
 	VteTerminalAccessiblePrivate *priv = (VteTerminalAccessiblePrivate *)_vte_terminal_accessible_get_instance_private(accessible);
-        GString *old_text;
-        GArray *old_characters;
-	char *old, *current;
-	glong offset, caret_offset, olen, clen;
 	gint old_snapshot_caret;
+	gboolean changed;
 
-	old_snapshot_caret = priv->snapshot_caret;
-	priv->snapshot_contents_invalid = TRUE;
-	vte_terminal_accessible_update_private_data_if_needed(accessible,
-                                                              &old_text,
-                                                              &old_characters);
-        g_assert(old_text != NULL);
-        g_assert(old_characters != NULL);
-
-	current = priv->snapshot_text->str;
-	clen = priv->snapshot_text->len;
-        old = old_text->str;
-        olen = old_text->len;
-
-	if ((guint) priv->snapshot_caret < priv->snapshot_characters->len) {
-		caret_offset = g_array_index(priv->snapshot_characters,
-				int, priv->snapshot_caret);
-	} else {
-		/* caret was not in the line */
-		caret_offset = clen;
-	}
+	priv->last_update_time = g_get_monotonic_time();
 
-	/* Find the offset where they don't match. */
-	offset = 0;
-	while ((offset < olen) && (offset < clen)) {
-		if (old[offset] != current[offset]) {
-			break;
-		}
-		offset++;
-	}
+	old_snapshot_caret = priv->snapshot_caret;
+	changed = vte_terminal_accessible_update_rows(accessible, TRUE, bulk);
+	priv->snapshot_caret_invalid = TRUE;
+	vte_terminal_accessible_update_private_data_if_needed(accessible);
 
         /* Check if we just backspaced over a space. */
-	if ((olen == offset) &&
-		       	(caret_offset < olen && old[caret_offset] == ' ') &&
-			(old_snapshot_caret == priv->snapshot_caret + 1)) {
-                GString *saved_text = priv->snapshot_text;
-                GArray *saved_characters = priv->snapshot_characters;
-
-                priv->snapshot_text = old_text;
-                priv->snapshot_characters = old_characters;
-		emit_text_changed_delete(G_OBJECT(accessible),
-					 old, caret_offset, 1);
-                priv->snapshot_text = saved_text;
-                priv->snapshot_characters = saved_characters;
-		emit_text_changed_insert(G_OBJECT(accessible),
-					 old, caret_offset, 1);
-	}
-
-
-	/* At least one of them had better have more data, right? */
-	if ((offset < olen) || (offset < clen)) {
-		/* Back up from both end points until we find the *last* point
-		 * where they differed. */
-		gchar *op = old + olen;
-		gchar *cp = current + clen;
-		while (op > old + offset && cp > current + offset) {
-			gchar *opp = g_utf8_prev_char (op);
-			gchar *cpp = g_utf8_prev_char (cp);
-			if (g_utf8_get_char (opp) != g_utf8_get_char (cpp)) {
-				break;
-			}
-			op = opp;
-			cp = cpp;
-		}
-		/* recompute the respective lengths */
-		olen = op - old;
-		clen = cp - current;
-		/* At least one of them has to have text the other
-		 * doesn't. */
-		g_assert((clen > offset) || (olen > offset));
-		g_assert((clen >= 0) && (olen >= 0));
-		/* Now emit a deleted signal for text that was in the old
-		 * string but isn't in the new one... */
-		if (olen > offset) {
-                        GString *saved_text = priv->snapshot_text;
-                        GArray *saved_characters = priv->snapshot_characters;
-
-                        priv->snapshot_text = old_text;
-                        priv->snapshot_characters = old_characters;
+	if (!changed &&
+	    (guint) priv->snapshot_caret < priv->snapshot_characters->len &&
+	    old_snapshot_caret == priv->snapshot_caret + 1) {
+		char const* caret_text = priv->snapshot_text->str +
+			g_array_index(priv->snapshot_characters, int, priv->snapshot_caret);
+		if (*caret_text == ' ') {
 			emit_text_changed_delete(G_OBJECT(accessible),
-						 old,
-						 offset,
-						 olen - offset);
-                        priv->snapshot_text = saved_text;
-                        priv->snapshot_characters = saved_characters;
-		}
-		/* .. and an inserted signal for text that wasn't in the old
-		 * string but is in the new one. */
-		if (clen > offset) {
+						 caret_text, 1,
+						 priv->snapshot_caret, 1);
 			emit_text_changed_insert(G_OBJECT(accessible),
-						 current,
-						 offset,
-						 clen - offset);
+						 caret_text, 1,
+						 priv->snapshot_caret, 1);
 		}
 	}
 
         vte_terminal_accessible_maybe_emit_text_caret_moved(accessible);
+}
 
-        g_string_free(old_text, TRUE);
-        g_array_free(old_characters, TRUE);
+static gboolean
+vte_terminal_accessible_update_timeout(gpointer data)
+{
+        VteTerminalAccessible *accessible = (VteTerminalAccessible *)data;
+	VteTerminalAccessiblePrivate *priv = (VteTerminalAccessiblePrivate *)_vte_terminal_accessible_get_instance_private(accessible);
+
+	priv->update_source = 0;
+	vte_terminal_accessible_update(accessible, TRUE);
+
+	return G_SOURCE_REMOVE;
+}
+
+/* Updates right away if the last update was long enough ago, so that
+ * typing is spoken without delay. Otherwise the terminal is busy with
+ * output, and all of the changes until VTE_A11Y_UPDATE_INTERVAL after
+ * the last update are emitted together then, instead of flooding the
+ * assistive technologies with them. */
+static void
+vte_terminal_accessible_queue_update(VteTerminalAccessible *accessible)
+{
+	VteTerminalAccessiblePrivate *priv = (VteTerminalAccessiblePrivate *)_vte_terminal_accessible_get_instance_private(accessible);
+
+	if (priv->update_source != 0)
+		return;
+
+	auto const elapsed = (g_get_monotonic_time() - priv->last_update_time) / 1000;
+	if (elapsed >= VTE_A11Y_UPDATE_INTERVAL) {
+		vte_terminal_accessible_update(accessible, FALSE);
+		return;
+	}
+
+	_vte_debug_print(VTE_DEBUG_ALLY,
+			"Deferring accessibility update by %ldms.\n",
+			(long)(VTE_A11Y_UPDATE_INTERVAL - elapsed));
+	priv->update_source = g_timeout_add(VTE_A11Y_UPDATE_INTERVAL - elapsed,
+					    vte_terminal_accessible_update_timeout,
+					    accessible);
+}
+
+/* A signal handler to catch "text-inserted/deleted/modified" signals. */
+static void
+vte_terminal_accessible_text_modified(VteTerminal *terminal, gpointer data)
+{
+        VteTerminalAccessible *accessible = (VteTerminalAccessible *)data;
+
+	vte_terminal_accessible_queue_update(accessible);
 }
 
 /* A signal handler to catch "text-scrolled" signals. */
@@ -495,144 +622,14 @@ vte_terminal_accessible_text_scrolled(VteTerminal *terminal,
 				      gpointer data)
 {
         VteTerminalAccessible *accessible = (VteTerminalAccessible *)data;
-	VteTerminalAccessiblePrivate *priv = (VteTerminalAccessiblePrivate *)_vte_terminal_accessible_get_instance_private(accessible);
-	struct _VteCharAttributes attr;
-	long delta, row_count;
-	guint i, len;
 
         /* TODOegmont: Fix this for smooth scrolling */
         /* g_assert(howmuch != 0); */
         if (howmuch == 0) return;
 
-        row_count = vte_terminal_get_row_count(terminal);
-	if (((howmuch < 0) && (howmuch <= -row_count)) ||
-	    ((howmuch > 0) && (howmuch >= row_count))) {
-		/* All of the text was removed. */
-		if (priv->snapshot_text != NULL) {
-			if (priv->snapshot_text->str != NULL) {
-				emit_text_changed_delete(G_OBJECT(accessible),
-							 priv->snapshot_text->str,
-							 0,
-							 priv->snapshot_text->len);
-			}
-		}
-		priv->snapshot_contents_invalid = TRUE;
-		vte_terminal_accessible_update_private_data_if_needed(accessible,
-								      NULL,
-								      NULL);
-		/* All of the present text was added. */
-		if (priv->snapshot_text != NULL) {
-			if (priv->snapshot_text->str != NULL) {
-				emit_text_changed_insert(G_OBJECT(accessible),
-							 priv->snapshot_text->str,
-							 0,
-							 priv->snapshot_text->len);
-			}
-		}
-                vte_terminal_accessible_maybe_emit_text_caret_moved(accessible);
-		return;
-	}
-	/* Find the start point. */
-	delta = 0;
-	if (priv->snapshot_attributes != NULL) {
-		if (priv->snapshot_attributes->len > 0) {
-			attr = g_array_index(priv->snapshot_attributes,
-					     struct _VteCharAttributes,
-					     0);
-			delta = attr.row;
-		}
-	}
-	/* We scrolled up, so text was added at the top and removed
-	 * from the bottom. */
-	if ((howmuch < 0) && (howmuch > -row_count)) {
-		gboolean inserted = FALSE;
-		howmuch = -howmuch;
-		if (priv->snapshot_attributes != NULL &&
-				priv->snapshot_text != NULL) {
-			/* Find the first byte that scrolled off. */
-			for (i = 0; i < priv->snapshot_attributes->len; i++) {
-				attr = g_array_index(priv->snapshot_attributes,
-						struct _VteCharAttributes,
-						i);
-				if (attr.row >= delta + row_count - howmuch) {
-					break;
-				}
-			}
-			if (i < priv->snapshot_attributes->len) {
-				/* The rest of the string was deleted -- make a note. */
-				emit_text_changed_delete(G_OBJECT(accessible),
-						priv->snapshot_text->str,
-						i,
-						priv->snapshot_attributes->len - i);
-			}
-			inserted = TRUE;
-		}
-		/* Refresh.  Note that i is now the length of the data which
-		 * we expect to have left over. */
-		priv->snapshot_contents_invalid = TRUE;
-		vte_terminal_accessible_update_private_data_if_needed(accessible,
-								      NULL,
-								      NULL);
-		/* If we now have more text than before, the initial portion
-		 * was added. */
-		if (inserted) {
-			len = priv->snapshot_text->len;
-			if (len > i) {
-				emit_text_changed_insert(G_OBJECT(accessible),
-							 priv->snapshot_text->str,
-							 0,
-							 len - i);
-			}
-		}
-                vte_terminal_accessible_maybe_emit_text_caret_moved(accessible);
-		return;
-	}
-	/* We scrolled down, so text was added at the bottom and removed
-	 * from the top. */
-	if ((howmuch > 0) && (howmuch < row_count)) {
-		gboolean inserted = FALSE;
-		if (priv->snapshot_attributes != NULL &&
-				priv->snapshot_text != NULL) {
-			/* Find the first byte that wasn't scrolled off the top. */
-			for (i = 0; i < priv->snapshot_attributes->len; i++) {
-				attr = g_array_index(priv->snapshot_attributes,
-						struct _VteCharAttributes,
-						i);
-				if (attr.row >= delta + howmuch) {
-					break;
-				}
-			}
-			/* That many bytes disappeared -- make a note. */
-			emit_text_changed_delete(G_OBJECT(accessible),
-					priv->snapshot_text->str,
-					0,
-					i);
-			/* Figure out how much text was left, and refresh. */
-			i = strlen(priv->snapshot_text->str + i);
-			inserted = TRUE;
-		}
-		priv->snapshot_contents_invalid = TRUE;
-		vte_terminal_accessible_update_private_data_if_needed(accessible,
-								      NULL,
-								      NULL);
-		/* Any newly-added string data is new, so note that it was
-		 * inserted. */
-		if (inserted) {
-			len = priv->snapshot_text->len;
-			if (len > i) {
-				/* snapshot_text always contains a trailing '\n',
-				 * insertion happens in front of it: bug 657960 */
-				g_assert(i >= 1);
-				emit_text_changed_insert(G_OBJECT(accessible),
-							 priv->snapshot_text->str,
-							 i - 1,
-							 len - i);
-			}
-		}
-                vte_terminal_accessible_maybe_emit_text_caret_moved(accessible);
-		return;
-	}
-	g_assert_not_reached();
+	/* The rows that stayed in view are kept; the ones that scrolled
+	 * out are deleted, and the ones that scrolled in are inserted. */
+	vte_terminal_accessible_queue_update(accessible);
 }
 
 /* A signal handler to catch "cursor-moved" signals. */
@@ -645,8 +642,12 @@ vte_terminal_accessible_invalidate_cursor(VteTerminal *terminal, gpointer data)
 	_vte_debug_print(VTE_DEBUG_ALLY,
 			"Invalidating accessibility cursor.\n");
 	priv->snapshot_caret_invalid = TRUE;
-	vte_terminal_accessible_update_private_data_if_needed(accessible,
-							      NULL, NULL);
+
+	/* The caret moves with the text, once that's updated. */
+	if (priv->update_source != 0)
+		return;
+
+	vte_terminal_accessible_update_private_data_if_needed(accessible);
         vte_terminal_accessible_maybe_emit_text_caret_moved(accessible);
 }
 
@@ -762,10 +763,14 @@ _vte_terminal_accessible_init (VteTerminalAccessible *accessible)
 	priv->snapshot_characters = NULL;
 	priv->snapshot_attributes = NULL;
 	priv->snapshot_linebreaks = NULL;
+	priv->snapshot_rows = NULL;
+	priv->snapshot_first_row = 0;
 	priv->snapshot_caret = -1;
 	priv->snapshot_contents_invalid = TRUE;
 	priv->snapshot_caret_invalid = TRUE;
         priv->text_caret_moved_pending = FALSE;
+	priv->update_source = 0;
+	priv->last_update_time = 0;
 }
 
 static void
@@ -808,6 +813,9 @@ vte_terminal_accessible_finalize(GObject *object)
 						     object);
 	}
 
+	if (priv->update_source != 0) {
+		g_source_remove(priv->update_source);
+	}
 	if (priv->snapshot_text != NULL) {
 		g_string_free(priv->snapshot_text, TRUE);
 	}
@@ -820,6 +828,9 @@ vte_terminal_accessible_finalize(GObject *object)
 	if (priv->snapshot_linebreaks != NULL) {
 		g_array_free(priv->snapshot_linebreaks, TRUE);
 	}
+	if (priv->snapshot_rows != NULL) {
+		g_array_free(priv->snapshot_rows, TRUE);
+	}
 	for (i = 0; i < LAST_ACTION; i++) {
 		g_free (priv->action_descriptions[i]);
 	}
@@ -849,8 +860,7 @@ vte_terminal_accessible_get_text(AtkText *text,
 
 	g_assert((start_offset >= 0) && (end_offset >= -1));
 
-	vte_terminal_accessible_update_private_data_if_needed(accessible,
-							      NULL, NULL);
+	vte_terminal_accessible_update_private_data_if_needed(accessible);
 
 	_vte_debug_print(VTE_DEBUG_ALLY,
 			"Getting text from %d to %d of %d.\n",
@@ -899,8 +909,7 @@ vte_terminal_accessible_get_text_somewhere(AtkText *text,
 	gunichar current, prev, next;
 	guint start, end, line;
 
-	vte_terminal_accessible_update_private_data_if_needed(accessible,
-							      NULL, NULL);
+	vte_terminal_accessible_update_private_data_if_needed(accessible);
 
         auto impl = IMPL_FROM_ACCESSIBLE(text);
 
@@ -1144,8 +1153,7 @@ vte_terminal_accessible_get_text_before_offset(AtkText *text, gint offset,
 {
         VteTerminalAccessible *accessible = VTE_TERMINAL_ACCESSIBLE(text);
 
-	vte_terminal_accessible_update_private_data_if_needed(accessible,
-							      NULL, NULL);
+	vte_terminal_accessible_update_private_data_if_needed(accessible);
 	return vte_terminal_accessible_get_text_somewhere(text,
 							  offset,
 							  boundary_type,
@@ -1162,8 +1170,7 @@ vte_terminal_accessible_get_text_after_offset(AtkText *text, gint offset,
 {
         VteTerminalAccessible *accessible = VTE_TERMINAL_ACCESSIBLE(text);
 
-	vte_terminal_accessible_update_private_data_if_needed(accessible,
-							      NULL, NULL);
+	vte_terminal_accessible_update_private_data_if_needed(accessible);
 	return vte_terminal_accessible_get_text_somewhere(text,
 							  offset,
 							  boundary_type,
@@ -1180,8 +1187,7 @@ vte_terminal_accessible_get_text_at_offset(AtkText *text, gint offset,
 {
         VteTerminalAccessible *accessible = VTE_TERMINAL_ACCESSIBLE(text);
 
-	vte_terminal_accessible_update_private_data_if_needed(accessible,
-							      NULL, NULL);
+	vte_terminal_accessible_update_private_data_if_needed(accessible);
 	return vte_terminal_accessible_get_text_somewhere(text,
 							  offset,
 							  boundary_type,
@@ -1198,8 +1204,7 @@ vte_terminal_accessible_get_character_at_offset(AtkText *text, gint offset)
 	char *unichar;
 	gunichar ret;
 
-	vte_terminal_accessible_update_private_data_if_needed(accessible,
-							      NULL, NULL);
+	vte_terminal_accessible_update_private_data_if_needed(accessible);
 
 	g_assert(offset < (int) priv->snapshot_characters->len);
 
@@ -1216,8 +1221,7 @@ vte_terminal_accessible_get_caret_offset(AtkText *text)
         VteTerminalAccessible *accessible = VTE_TERMINAL_ACCESSIBLE(text);
 	VteTerminalAccessiblePrivate *priv = (VteTerminalAccessiblePrivate *)_vte_terminal_accessible_get_instance_private(accessible);
 
-	vte_terminal_accessible_update_private_data_if_needed(accessible,
-							      NULL, NULL);
+	vte_terminal_accessible_update_private_data_if_needed(accessible);
 
 	return priv->snapshot_caret;
 }
@@ -1274,8 +1278,7 @@ vte_terminal_accessible_get_run_attributes(AtkText *text, gint offset,
 	struct _VteCharAttributes cur_attr;
 	struct _VteCharAttributes attr;
 
-	vte_terminal_accessible_update_private_data_if_needed(accessible,
-							      NULL, NULL);
+	vte_terminal_accessible_update_private_data_if_needed(accessible);
 
 	attr = g_array_index (priv->snapshot_attributes,
 			      struct _VteCharAttributes,
@@ -1328,8 +1331,7 @@ vte_terminal_accessible_get_character_extents(AtkText *text, gint offset,
 	glong cell_width, cell_height;
 	gint base_x, base_y, w, h;
 
-	vte_terminal_accessible_update_private_data_if_needed(accessible,
-							      NULL, NULL);
+	vte_terminal_accessible_update_private_data_if_needed(accessible);
 	terminal = VTE_TERMINAL (gtk_accessible_get_widget (GTK_ACCESSIBLE (text)));
 
 	atk_component_get_extents (ATK_COMPONENT (text), &base_x, &base_y, &w, &h, coords);
@@ -1350,8 +1352,7 @@ vte_terminal_accessible_get_character_count(AtkText *text)
         VteTerminalAccessible *accessible = VTE_TERMINAL_ACCESSIBLE(text);
 	VteTerminalAccessiblePrivate *priv = (VteTerminalAccessiblePrivate *)_vte_terminal_accessible_get_instance_private(accessible);
 
-	vte_terminal_accessible_update_private_data_if_needed(accessible,
-							      NULL, NULL);
+	vte_terminal_accessible_update_private_data_if_needed(accessible);
 
 	return priv->snapshot_attributes->len;
 }
@@ -1367,8 +1368,7 @@ vte_terminal_accessible_get_offset_at_point(AtkText *text,
 	glong cell_width, cell_height;
 	gint base_x, base_y, w, h;
 
-	vte_terminal_accessible_update_private_data_if_needed(accessible,
-							      NULL, NULL);
+	vte_terminal_accessible_update_private_data_if_needed(accessible);
 	terminal = VTE_TERMINAL (gtk_accessible_get_widget (GTK_ACCESSIBLE (text)));
 
 	atk_component_get_extents (ATK_COMPONENT (text), &base_x, &base_y, &w, &h, coords);
@@ -1388,8 +1388,7 @@ vte_terminal_accessible_get_n_selections(AtkText *text)
 	GtkWidget *widget;
 	VteTerminal *terminal;
 
-	vte_terminal_accessible_update_private_data_if_needed(accessible,
-							      NULL, NULL);
+	vte_terminal_accessible_update_private_data_if_needed(accessible);
 	widget = gtk_accessible_get_widget (GTK_ACCESSIBLE(text));
 	if (widget == NULL) {
 		/* State is defunct */
@@ -1411,8 +1410,7 @@ vte_terminal_accessible_get_selection(AtkText *text, gint selection_number,
 	if (selection_number != 0)
 		return NULL;
 
-	vte_terminal_accessible_update_private_data_if_needed(accessible,
-							      NULL, NULL);
+	vte_terminal_accessible_update_private_data_if_needed(accessible);
 	widget = gtk_accessible_get_widget (GTK_ACCESSIBLE(text));
 	if (widget == NULL) {
 		/* State is defunct */
@@ -1438,8 +1436,7 @@ vte_terminal_accessible_add_selection(AtkText *text,
 	VteTerminalAccessiblePrivate *priv = (VteTerminalAccessiblePrivate *)_vte_terminal_accessible_get_instance_private(accessible);
 	GtkWidget *widget;
 
-	vte_terminal_accessible_update_private_data_if_needed(accessible,
-							      NULL, NULL);
+	vte_terminal_accessible_update_private_data_if_needed(accessible);
 	widget = gtk_accessible_get_widget (GTK_ACCESSIBLE(text));
 	if (widget == NULL) {
 		/* State is defunct */
@@ -1461,8 +1458,7 @@ vte_terminal_accessible_remove_selection(AtkText *text,
 	GtkWidget *widget;
 	VteTerminal *terminal;
 
-	vte_terminal_accessible_update_private_data_if_needed(accessible,
-							      NULL, NULL);
+	vte_terminal_accessible_update_private_data_if_needed(accessible);
 	widget = gtk_accessible_get_widget (GTK_ACCESSIBLE(text));
 	if (widget == NULL) {
 		/* State is defunct */
@@ -1487,8 +1483,7 @@ vte_terminal_accessible_set_selection(AtkText *text, gint selection_number,
 	GtkWidget *widget;
 	VteTerminal *terminal;
 
-	vte_terminal_accessible_update_private_data_if_needed(accessible,
-							      NULL, NULL);
+	vte_terminal_accessible_update_private_data_if_needed(accessible);
 	widget = gtk_accessible_get_widget (GTK_ACCESSIBLE(text));
 	if (widget == NULL) {
 		/* State is defunct */
@@ -1512,8 +1507,7 @@ vte_terminal_accessible_set_caret_offset(AtkText *text, gint offset)
 {
         VteTerminalAccessible *accessible = VTE_TERMINAL_ACCESSIBLE(text);
 
-	vte_terminal_accessible_update_private_data_if_needed(accessible,
-							      NULL, NULL);
+	vte_terminal_accessible_update_private_data_if_needed(accessible);
 	/* Whoa, very not allowed. */
 	return FALSE;
 }
@@ -82,11 +82,50 @@
 #define VTE_CHILD_INPUT_PRIORITY	G_PRIORITY_DEFAULT_IDLE
 #define VTE_CHILD_OUTPUT_PRIORITY	G_PRIORITY_HIGH
 #define VTE_MAX_INPUT_READ		0x1000
+#define VTE_MAX_READ_BATCH		8 /* chunks */
+#define VTE_DEFAULT_INPUT_QUEUE_LIMIT	(8 * 1024 * 1024) /* bytes */
+#define VTE_FEED_BYTES_COPY_MAX		1024 /* bytes; smaller GBytes are copied */
+#define VTE_PASTE_SLICE_SIZE		0x10000 /* bytes filtered and queued at a time */
+#define VTE_PASTE_QUEUE_HIGH_WATER	(1024 * 1024) /* bytes; more of a paste is queued below half that */
 #define VTE_DISPLAY_TIMEOUT		10
 #define VTE_UPDATE_TIMEOUT		15
 #define VTE_UPDATE_REPEAT_TIMEOUT	30
 #define VTE_MAX_PROCESS_TIME		100
-#define VTE_CELL_BBOX_SLACK		1
+#define VTE_FRAME_CLOCK_STALL_TIMEOUT	100 /* ms */
+#define VTE_DEFAULT_REFRESH_INTERVAL	16667 /* µs */
+#define VTE_MIN_PROCESS_BUDGET		2000 /* µs */
+#define VTE_BACKGROUND_PROCESS_TIME	250 /* ms; processing budget of an unmapped terminal */
+#define VTE_BACKGROUND_CONTENTS_CHANGED_INTERVAL (1000 * 1000) /* µs; contents-changed is emitted at most this often when unmapped */
+#define VTE_SCHEDULER_WEIGHT_FOCUSED	4
+#define VTE_SCHEDULER_WEIGHT_INTERACTIVE 2
+#define VTE_SCHEDULER_INTERACTIVE_TIME	(1000 * 1000) /* µs */
+#define VTE_LOW_LATENCY_TIME		(200 * 1000) /* µs after input during which small reads are echo */
+#define VTE_LOW_LATENCY_MAX_BYTES	512 /* bytes; more queued is bulk output */
+#define VTE_GRAPHIC_RUN_MAX		256 /* characters inserted at once */
+#define VTE_REWRAP_SYNC_ROWS		1000 /* rows above the visible ones rewrapped on resize right away */
+#define VTE_REWRAP_SLICE_ROWS		5000 /* rows rewrapped in one go after that */
+#define VTE_A11Y_UPDATE_INTERVAL	100 /* ms; changes are emitted to the accessibility layer at most this often */
+#define VTE_SYNCHRONIZED_OUTPUT_TIMEOUT	200 /* ms; synchronized output is committed after this at the latest */
+#define VTE_DEFAULT_RESIZE_DELAY	50 /* ms without resizing before applying the last size */
+#define VTE_REWRAP_DELAY		100 /* ms without resizing before rewrapping the rest */
+#define VTE_RING_CACHED_ROWS_MIN	64 /* thawed scrollback rows kept, at least two screens' worth */
+#define VTE_RING_CACHED_SCREENS		4 /* screens' worth of thawed rows kept: the shown ones, and those prefetched around them */
+#define VTE_PREFETCH_LEAD_TIME		(250 * 1000) /* µs of scrolling at the current speed whose rows are thawed ahead */
+#define VTE_PREFETCH_MAX_SCREENS	2 /* screens' worth of rows thawed ahead at most */
+#define VTE_PREFETCH_SLICE_ROWS		16 /* rows thawed in one go while idle */
+#define VTE_RING_MEM_STREAM_MAX_BYTES	(16 * 1024 * 1024) /* scrollback up to this size is kept in memory rather than in temporary files */
+#define VTE_RING_MEM_STREAM_ROW_BYTES	256 /* estimated stream bytes per row, for the above */
+#define VTE_SCROLL_SPEED_RESET_TIME	(200 * 1000) /* µs without scrolling after which its speed is measured anew */
+#define VTE_RING_BUDGET_CHECK_ROWS	256 /* rows appended between checks of the global scrollback budget */
+#define VTE_RING_FREEZE_BATCH_ROWS	16 /* rows frozen to the streams at once, at most */
+#define VTE_WRITE_CONTENTS_CHUNK_SIZE	(256 * 1024) /* bytes written at once by vte_terminal_write_contents_async() */
+#define VTE_MATCH_CACHE_LINES		64 /* lines whose dingu matches are kept */
+#define VTE_SEARCH_SLICE_TIME		(5 * 1000) /* µs spent searching at once by vte_terminal_search_find_async() */
+#define VTE_WRITE_TEXT_SLICE_TIME	(5 * 1000) /* µs spent walking the text at once by vte_terminal_write_text_range_async() */
+#define VTE_FRAME_STATS_FRAMES		128 /* frames kept for vte_terminal_get_frame_stats() */
+#define VTE_INPUT_LATENCY_TIMEOUT	(1000 * 1000) /* µs from a key press after which its measurement is dropped */
+#define VTE_INPUT_LATENCY_BUCKETS	24 /* power of 2 µs buckets of the latency histograms */
+#define VTE_ROW_CHECKSUMS_ROWS		256 /* rows whose DECRQCRA checksums are kept, a power of 2 */
 #define VTE_DEFAULT_UTF8_AMBIGUOUS_WIDTH 1
 
 #define VTE_UTF8_BPC                    (4) /* Maximum number of bytes used per UTF-8 character */
@@ -113,13 +152,19 @@
  * VTE_HYPERLINK_COUNT_MAX inclusive, plus one more technical idx is also required, see below.
  * This is just a safety cap because the number of URIs is bound by the number of cells in the ring
  * (excluding the stream) which should be way lower than this at sane window sizes.
- * Make sure there are enough bits to store them in VteCellAttr.hyperlink_idx.
+ * Make sure there are enough bits to store them in VteCellHyperlink.idx.
  * Also make sure _vte_ring_hyperlink_gc() can allocate a large enough bitmap. */
 #define VTE_HYPERLINK_COUNT_MAX         ((1 << 20) - 2)
 
+/* Minimum number of idxs to hand out between two rounds of hyperlink GC when
+ * receiving OSC 8 sequences. GC runs once as many idxs were handed out as were
+ * alive after the previous round, so its cost stays proportional to the
+ * number of new hyperlinks. */
+#define VTE_HYPERLINK_GC_MIN_NEW        256
+
 /* Used when thawing a row from the stream in order to display it, to denote
  * hyperlinks whose target is currently irrelevant.
- * Make sure there are enough bits to store this in VteCellAttr.hyperlink_idx */
+ * Make sure there are enough bits to store this in VteCellHyperlink.idx */
 #define VTE_HYPERLINK_IDX_TARGET_IN_STREAM      (VTE_HYPERLINK_COUNT_MAX + 1)
 
 /* Max length allowed in the id= parameter of an OSC 8 sequence.
@@ -139,3 +184,29 @@
 
 /* Maximum length of a paragraph, in lines, that might get proper RingView (BiDi) treatment. */
 #define VTE_RINGVIEW_PARAGRAPH_LENGTH_MAX   500
+
+/* The number of rows from which RingView spreads the BiDi and shaping work
+ * of the paragraphs over threads, and the most threads it uses besides
+ * the main thread. */
+#define VTE_RINGVIEW_PARALLEL_ROWS          64
+#define VTE_RINGVIEW_THREADS_MAX            3
+
+/* The rows from which Ring::rewrap_finish() rewraps the scrollback left
+ * over in ranges of about this many on threads, and the most threads it
+ * uses besides the main thread. */
+#define VTE_REWRAP_PARALLEL_ROWS            20000
+#define VTE_REWRAP_THREADS_MAX              7
+
+/* The number of Arabic words whose shaping is kept, per thread. */
+#define VTE_SHAPING_CACHE_SIZE              1024
+
+/* The largest SIXEL image, in pixels; what's drawn beyond it is dropped */
+#define VTE_SIXEL_MAX_WIDTH                 2048
+#define VTE_SIXEL_MAX_HEIGHT                2048
+
+/* The most memory the images of a terminal may take, uncompressed or not,
+ * before the least recently shown ones are dropped. */
+#define VTE_IMAGE_CACHE_BUDGET              (64 * 1024 * 1024)
+
+/* The most OSC 133 shell integration marks kept; the oldest go first */
+#define VTE_SHELL_MARKS_MAX                 (64 * 1024)
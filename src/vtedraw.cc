@@ -126,6 +126,12 @@ _vte_double_equal(double a,
  *
  *       * Zooming in and out a terminal reuses the font info structs.
  *
+ *   - The size of the character info caches of all font info structs is
+ *     accounted for; while it's over FONT_CACHE_MAX_BYTES, the unused font
+ *     info structs are destroyed right away, least recently used first.
+ *     The ones in use are left alone, since their character infos may be
+ *     in use while drawing.
+ *
  *
  * Pre-caching ASCII letters:
  *
@@ -135,11 +141,22 @@ _vte_double_equal(double a,
  * letters if we can do that easily using COVERAGE_USE_CAIRO_GLYPH.  This
  * means that we precache all ASCII letters without any extra pango shaping
  * involved.
+ *
+ *
+ * Persisting the metrics:
+ *
+ * Measuring and shaping the ASCII letters makes up much of the time to the
+ * first frame of a terminal.  If enabled with vte_set_font_metrics_cache_file(),
+ * the results are kept in a file, keyed like the font infos, and a new font
+ * info takes them from there, loading the font but not laying out any text.
+ * Once the terminal painted, such a font info is measured after all, and
+ * fixed, along with the file, if anything changed.
  */
 
 
 
 #define FONT_CACHE_TIMEOUT (30) /* seconds */
+#define FONT_CACHE_MAX_BYTES (16 * 1024 * 1024)
 
 
 /* All shared data structures are implicitly protected by GDK mutex, because
@@ -187,6 +204,16 @@ struct unistr_info {
 	union unistr_font_info ufi;
 };
 
+/* The BMP is cached in pages of 256 characters, allocated on first use. */
+#define UNISTR_PAGE_SHIFT 8
+#define UNISTR_PAGE_SIZE (1 << UNISTR_PAGE_SHIFT)
+#define UNISTR_N_PAGES (0x10000 >> UNISTR_PAGE_SHIFT)
+
+struct unistr_page {
+	struct unistr_info info[UNISTR_PAGE_SIZE];
+	gboolean cached; /* font_info_cache_page() was run */
+};
+
 static struct unistr_info *
 unistr_info_create (void)
 {
@@ -234,13 +261,15 @@ struct font_info {
 	/* lifecycle */
 	int ref_count;
 	guint destroy_timeout; /* only used when ref_count == 0 */
+	GList unused_link; /* in font_info_unused, when ref_count == 0 */
 
 	/* reusable layout set with font and everything set */
 	PangoLayout *layout;
 
 	/* cache of character info */
-	struct unistr_info ascii_unistr_info[128];
-	GHashTable *other_unistr_info;
+	struct unistr_page *bmp_unistr_pages[UNISTR_N_PAGES];
+	GHashTable *other_unistr_info; /* outside the BMP, and combining sequences */
+	guint32 unistr_generation; /* of the combining sequences in other_unistr_info */
 
         /* cell metrics as taken from the font, not yet scaled by cell_{width,height}_scale */
 	gint width, height, ascent;
@@ -248,6 +277,13 @@ struct font_info {
 	/* reusable string for UTF-8 conversion */
 	GString *string;
 
+	/* size of the character info cache */
+	gsize n_bytes;
+	guint n_glyphs;
+
+	/* the metrics came from the metrics cache, and weren't measured yet */
+	gboolean from_metrics_cache;
+
 #ifdef VTE_DEBUG
 	/* profiling info */
 	int coverage_count[4];
@@ -255,24 +291,75 @@ struct font_info {
 };
 
 
+/* The character infos outside the BMP take up an entry in the hash table too */
+#define OTHER_UNISTR_INFO_SIZE (sizeof (struct unistr_info) + 4 * sizeof (gpointer))
+
+static GHashTable *font_info_for_context;
+static GQueue font_info_unused = G_QUEUE_INIT; /* least recently used first */
+static gsize font_cache_bytes;
+
+static void font_cache_trim (void);
+
+static void
+font_info_add_bytes (struct font_info *info,
+		     gssize n_bytes)
+{
+	info->n_bytes += n_bytes;
+	font_cache_bytes += n_bytes;
+
+	if (n_bytes > 0 && font_cache_bytes > FONT_CACHE_MAX_BYTES)
+		font_cache_trim ();
+}
+
+static gboolean
+unistr_info_is_combining_sequence (gpointer key,
+				   gpointer value,
+				   gpointer data)
+{
+	if (GPOINTER_TO_UINT (key) <= 0x10FFFF)
+		return FALSE;
+
+	struct font_info *info = (struct font_info *)data;
+	if (((struct unistr_info *)value)->coverage != COVERAGE_UNKNOWN)
+		info->n_glyphs--;
+	font_info_add_bytes (info, -gssize (OTHER_UNISTR_INFO_SIZE));
+
+	return TRUE;
+}
+
 static struct unistr_info *
 font_info_find_unistr_info (struct font_info    *info,
 			    vteunistr            c)
 {
 	struct unistr_info *uinfo;
 
-	if (G_LIKELY (c < G_N_ELEMENTS (info->ascii_unistr_info)))
-		return &info->ascii_unistr_info[c];
+	if (G_LIKELY (c < 0x10000)) {
+		struct unistr_page **page = &info->bmp_unistr_pages[c >> UNISTR_PAGE_SHIFT];
+		if (G_UNLIKELY (*page == NULL)) {
+			*page = g_new0 (struct unistr_page, 1);
+			font_info_add_bytes (info, sizeof (struct unistr_page));
+		}
+		return &(*page)->info[c & (UNISTR_PAGE_SIZE - 1)];
+	}
 
 	if (G_UNLIKELY (info->other_unistr_info == NULL))
 		info->other_unistr_info = g_hash_table_new_full (NULL, NULL, NULL, (GDestroyNotify) unistr_info_destroy);
 
+	/* Combining sequences may have been garbage collected, and
+	 * their values reused */
+	if (G_UNLIKELY (info->unistr_generation != _vte_unistr_get_generation ())) {
+		g_hash_table_foreach_remove (info->other_unistr_info,
+					     unistr_info_is_combining_sequence, info);
+		info->unistr_generation = _vte_unistr_get_generation ();
+	}
+
 	uinfo = (struct unistr_info *)g_hash_table_lookup (info->other_unistr_info, GINT_TO_POINTER (c));
 	if (G_LIKELY (uinfo))
 		return uinfo;
 
 	uinfo = unistr_info_create ();
 	g_hash_table_insert (info->other_unistr_info, GINT_TO_POINTER (c), uinfo);
+	font_info_add_bytes (info, OTHER_UNISTR_INFO_SIZE);
 	return uinfo;
 }
 
@@ -365,6 +452,7 @@ font_info_cache_ascii (struct font_info *info)
 
 		ufi->using_cairo_glyph.scaled_font = cairo_scaled_font_reference (scaled_font);
 		ufi->using_cairo_glyph.glyph_index = glyph;
+		info->n_glyphs++;
 
 #ifdef VTE_DEBUG
 		info->coverage_count[0]++;
@@ -379,6 +467,116 @@ font_info_cache_ascii (struct font_info *info)
 #endif
 }
 
+/* Shape all the characters of a BMP page together, the first time one
+ * of them is drawn, and cache the ones that map to a single glyph. This
+ * saves shaping CJK and other large scripts one character at a time. */
+static void
+font_info_cache_page (struct font_info *info,
+		      guint page)
+{
+	PangoLayoutLine *line;
+	GSList *runs;
+	GString *string;
+	const char *text;
+	int n_cached = 0;
+
+	string = g_string_sized_new (UNISTR_PAGE_SIZE * 4);
+	for (vteunistr c = MAX (page << UNISTR_PAGE_SHIFT, 0x80);
+	     c < (page + 1) << UNISTR_PAGE_SHIFT;
+	     c++) {
+		if (font_info_find_unistr_info (info, c)->coverage != COVERAGE_UNKNOWN)
+			continue;
+		/* Leave the characters that may shape differently alone to be
+		 * looked up individually: common characters take their font
+		 * from their neighbours, and marks combine with them. */
+		if (!g_unichar_validate (c) ||
+		    !g_unichar_isgraph (c) ||
+		    g_unichar_ismark (c) ||
+		    g_unichar_iszerowidth (c) ||
+		    g_unichar_get_script (c) <= G_UNICODE_SCRIPT_INHERITED)
+			continue;
+
+		/* Separated by spaces so they don't join or form ligatures */
+		g_string_append_unichar (string, c);
+		g_string_append_c (string, ' ');
+	}
+
+	if (string->len == 0) {
+		g_string_free (string, TRUE);
+		return;
+	}
+
+	pango_layout_set_text (info->layout, string->str, string->len);
+	text = pango_layout_get_text (info->layout);
+	line = pango_layout_get_line_readonly (info->layout, 0);
+
+	for (runs = line ? line->runs : NULL; runs != NULL; runs = runs->next) {
+		PangoGlyphItem *glyph_item = (PangoGlyphItem *)runs->data;
+		PangoGlyphString *glyph_string = glyph_item->glyphs;
+		PangoFont *pango_font = glyph_item->item->analysis.font;
+		PangoGlyphItemIter iter;
+		cairo_scaled_font_t *scaled_font;
+		gboolean more;
+
+		/* Right-to-left runs are left to the individual lookups */
+		if (!pango_font || (glyph_item->item->analysis.level & 1))
+			continue;
+		scaled_font = pango_cairo_font_get_scaled_font ((PangoCairoFont *) pango_font);
+		if (!scaled_font)
+			continue;
+
+		for (more = pango_glyph_item_iter_init_start (&iter, glyph_item, text);
+		     more;
+		     more = pango_glyph_item_iter_next_cluster (&iter)) {
+			struct unistr_info *uinfo;
+			PangoGlyphGeometry *geometry;
+			PangoGlyph glyph;
+			vteunistr c;
+
+			/* Only cache simple clusters */
+			if (iter.start_char + 1 != iter.end_char ||
+			    iter.start_glyph + 1 != iter.end_glyph)
+				continue;
+
+			c = g_utf8_get_char (text + iter.start_index);
+			if (c == ' ')
+				continue;
+
+			glyph = glyph_string->glyphs[iter.start_glyph].glyph;
+			geometry = &glyph_string->glyphs[iter.start_glyph].geometry;
+
+			/* Only cache simple glyphs, this also skips the unknown ones */
+			if (!(glyph <= 0xFFFF) || (geometry->x_offset | geometry->y_offset) != 0)
+				continue;
+
+			uinfo = font_info_find_unistr_info (info, c);
+			if (uinfo->coverage != COVERAGE_UNKNOWN)
+				continue;
+
+			uinfo->width = PANGO_PIXELS_CEIL (geometry->width);
+			uinfo->has_unknown_chars = FALSE;
+			uinfo->coverage = COVERAGE_USE_CAIRO_GLYPH;
+			uinfo->ufi.using_cairo_glyph.scaled_font = cairo_scaled_font_reference (scaled_font);
+			uinfo->ufi.using_cairo_glyph.glyph_index = glyph;
+			info->n_glyphs++;
+			n_cached++;
+
+#ifdef VTE_DEBUG
+			info->coverage_count[0]++;
+			info->coverage_count[uinfo->coverage]++;
+#endif
+		}
+	}
+
+	/* release internal layout resources */
+	pango_layout_set_text (info->layout, "", -1);
+	g_string_free (string, TRUE);
+
+	_vte_debug_print (VTE_DEBUG_PANGOCAIRO,
+			  "vtepangocairo: %p cached %d letters of page U+%04X\n",
+			  info, n_cached, page << UNISTR_PAGE_SHIFT);
+}
+
 static void
 font_info_measure_font (struct font_info *info)
 {
@@ -426,6 +624,253 @@ font_info_measure_font (struct font_info *info)
 			  info, info->width, info->height, info->ascent);
 }
 
+/* The characters font_info_cache_ascii() caches, whose glyphs are kept in the metrics cache */
+#define FONT_METRICS_CACHE_FIRST_CHAR 0x20
+#define FONT_METRICS_CACHE_LAST_CHAR 0x7e
+#define FONT_METRICS_CACHE_N_CHARS (FONT_METRICS_CACHE_LAST_CHAR - FONT_METRICS_CACHE_FIRST_CHAR + 1)
+#define FONT_METRICS_CACHE_MAX_FONTS (256)
+#define FONT_METRICS_CACHE_VERSION (1)
+#define FONT_METRICS_CACHE_GROUP "vte"
+
+static char *font_metrics_cache_file;
+static GKeyFile *font_metrics_cache;
+static guint font_metrics_cache_save_source;
+static guint font_metrics_generation; /* changes when measuring changed the metrics of a font info */
+
+static guint vte_pango_context_get_fontconfig_timestamp (PangoContext *context);
+
+static char *
+font_metrics_cache_key (PangoContext *context)
+{
+	PangoLanguage *language = pango_context_get_language (context);
+	char *desc = pango_font_description_to_string (pango_context_get_font_description (context));
+	char *key = g_strdup_printf ("%s|%s|%.3f|%lx|%u",
+				     desc,
+				     language ? pango_language_to_string (language) : "",
+				     pango_cairo_context_get_resolution (context),
+				     cairo_font_options_hash (pango_cairo_context_get_font_options (context)),
+				     vte_pango_context_get_fontconfig_timestamp (context));
+	g_free (desc);
+
+	/* Group names can't have brackets */
+	return g_strdelimit (key, "[]", '_');
+}
+
+static GKeyFile *
+font_metrics_cache_get (void)
+{
+	GError *error = NULL;
+
+	if (font_metrics_cache_file == NULL)
+		return NULL;
+	if (font_metrics_cache != NULL)
+		return font_metrics_cache;
+
+	font_metrics_cache = g_key_file_new ();
+	if (!g_key_file_load_from_file (font_metrics_cache, font_metrics_cache_file, G_KEY_FILE_NONE, &error)) {
+		_vte_debug_print (VTE_DEBUG_PANGOCAIRO,
+				  "vtepangocairo: not loading the metrics cache: %s\n",
+				  error->message);
+		g_clear_error (&error);
+	}
+
+	/* Start over if written by another version */
+	if (g_key_file_get_integer (font_metrics_cache, FONT_METRICS_CACHE_GROUP, "version", NULL) != FONT_METRICS_CACHE_VERSION) {
+		g_key_file_free (font_metrics_cache);
+		font_metrics_cache = g_key_file_new ();
+	}
+
+	return font_metrics_cache;
+}
+
+static gboolean
+font_metrics_cache_save (gpointer data)
+{
+	GError *error = NULL;
+	char *dir;
+
+	font_metrics_cache_save_source = 0;
+	if (font_metrics_cache == NULL || font_metrics_cache_file == NULL)
+		return G_SOURCE_REMOVE;
+
+	g_key_file_set_integer (font_metrics_cache, FONT_METRICS_CACHE_GROUP, "version", FONT_METRICS_CACHE_VERSION);
+
+	dir = g_path_get_dirname (font_metrics_cache_file);
+	g_mkdir_with_parents (dir, 0700);
+	g_free (dir);
+
+	if (!g_key_file_save_to_file (font_metrics_cache, font_metrics_cache_file, &error)) {
+		_vte_debug_print (VTE_DEBUG_PANGOCAIRO,
+				  "vtepangocairo: failed to save the metrics cache: %s\n",
+				  error->message);
+		g_error_free (error);
+	}
+
+	return G_SOURCE_REMOVE;
+}
+
+/* Gets the glyphs font_info_cache_ascii() cached, and their widths, or -1 */
+static void
+font_info_get_ascii (struct font_info *info,
+		     gint *glyphs,
+		     gint *widths)
+{
+	for (guint i = 0; i < FONT_METRICS_CACHE_N_CHARS; i++) {
+		struct unistr_info *uinfo = font_info_find_unistr_info (info, FONT_METRICS_CACHE_FIRST_CHAR + i);
+		if (uinfo->coverage == COVERAGE_USE_CAIRO_GLYPH) {
+			glyphs[i] = uinfo->ufi.using_cairo_glyph.glyph_index;
+			widths[i] = uinfo->width;
+		} else {
+			glyphs[i] = widths[i] = -1;
+		}
+	}
+}
+
+static void
+font_info_store_metrics (struct font_info *info)
+{
+	GKeyFile *cache = font_metrics_cache_get ();
+	gint glyphs[FONT_METRICS_CACHE_N_CHARS], widths[FONT_METRICS_CACHE_N_CHARS];
+	char *key;
+
+	if (cache == NULL)
+		return;
+
+	key = font_metrics_cache_key (pango_layout_get_context (info->layout));
+	font_info_get_ascii (info, glyphs, widths);
+	g_key_file_set_integer (cache, key, "width", info->width);
+	g_key_file_set_integer (cache, key, "height", info->height);
+	g_key_file_set_integer (cache, key, "ascent", info->ascent);
+	g_key_file_set_integer_list (cache, key, "glyphs", glyphs, G_N_ELEMENTS (glyphs));
+	g_key_file_set_integer_list (cache, key, "widths", widths, G_N_ELEMENTS (widths));
+	g_free (key);
+
+	/* Beyond the limit, drop the fonts stored first */
+	gsize n_groups, n_fonts;
+	char **groups = g_key_file_get_groups (cache, &n_groups);
+	n_fonts = n_groups - (g_key_file_has_group (cache, FONT_METRICS_CACHE_GROUP) ? 1 : 0);
+	for (gsize i = 0; i < n_groups && n_fonts > FONT_METRICS_CACHE_MAX_FONTS; i++) {
+		if (strcmp (groups[i], FONT_METRICS_CACHE_GROUP) == 0)
+			continue;
+		g_key_file_remove_group (cache, groups[i], NULL);
+		n_fonts--;
+	}
+	g_strfreev (groups);
+
+	if (font_metrics_cache_save_source == 0)
+		font_metrics_cache_save_source = g_idle_add_full (G_PRIORITY_LOW, font_metrics_cache_save, NULL, NULL);
+}
+
+/* Takes the metrics and the ASCII glyphs from the metrics cache, if there */
+static gboolean
+font_info_load_metrics (struct font_info *info)
+{
+	GKeyFile *cache = font_metrics_cache_get ();
+	PangoContext *context = pango_layout_get_context (info->layout);
+	PangoFont *pango_font;
+	cairo_scaled_font_t *scaled_font;
+	gint *glyphs = NULL, *widths = NULL;
+	gsize n_glyphs = 0, n_widths = 0;
+	gint width, height, ascent;
+	char *key;
+
+	if (cache == NULL)
+		return FALSE;
+
+	key = font_metrics_cache_key (context);
+	width = g_key_file_get_integer (cache, key, "width", NULL);
+	height = g_key_file_get_integer (cache, key, "height", NULL);
+	ascent = g_key_file_get_integer (cache, key, "ascent", NULL);
+	glyphs = g_key_file_get_integer_list (cache, key, "glyphs", &n_glyphs, NULL);
+	widths = g_key_file_get_integer_list (cache, key, "widths", &n_widths, NULL);
+	g_free (key);
+
+	if (width <= 0 || height <= 0 || ascent <= 0 ||
+	    n_glyphs != FONT_METRICS_CACHE_N_CHARS || n_widths != FONT_METRICS_CACHE_N_CHARS) {
+		g_free (glyphs);
+		g_free (widths);
+		return FALSE;
+	}
+
+	info->width = width;
+	info->height = height;
+	info->ascent = ascent;
+
+	/* The glyphs are those of the font of the ASCII letters, which is
+	 * normally the one the description names */
+	pango_font = pango_context_load_font (context, pango_context_get_font_description (context));
+	scaled_font = pango_font ? pango_cairo_font_get_scaled_font ((PangoCairoFont *) pango_font) : NULL;
+	for (guint i = 0; scaled_font != NULL && i < FONT_METRICS_CACHE_N_CHARS; i++) {
+		struct unistr_info *uinfo;
+
+		if (glyphs[i] < 0 || glyphs[i] > 0xFFFF)
+			continue;
+
+		uinfo = font_info_find_unistr_info (info, FONT_METRICS_CACHE_FIRST_CHAR + i);
+		uinfo->width = widths[i];
+		uinfo->has_unknown_chars = FALSE;
+		uinfo->coverage = COVERAGE_USE_CAIRO_GLYPH;
+		uinfo->ufi.using_cairo_glyph.scaled_font = cairo_scaled_font_reference (scaled_font);
+		uinfo->ufi.using_cairo_glyph.glyph_index = glyphs[i];
+		info->n_glyphs++;
+	}
+	if (pango_font)
+		g_object_unref (pango_font);
+	g_free (glyphs);
+	g_free (widths);
+
+	info->from_metrics_cache = TRUE;
+
+	_vte_debug_print (VTE_DEBUG_MISC,
+			  "vtepangocairo: %p font metrics = %dx%d (%d) from the cache\n",
+			  info, info->width, info->height, info->ascent);
+
+	return TRUE;
+}
+
+/* Measures a font info taken from the metrics cache after all, fixing it
+ * and the cache if anything changed.
+ * Returns: whether anything changed */
+static gboolean
+font_info_validate_metrics (struct font_info *info)
+{
+	gint glyphs[FONT_METRICS_CACHE_N_CHARS], widths[FONT_METRICS_CACHE_N_CHARS];
+	gint new_glyphs[FONT_METRICS_CACHE_N_CHARS], new_widths[FONT_METRICS_CACHE_N_CHARS];
+	gint width = info->width, height = info->height, ascent = info->ascent;
+	gboolean changed;
+
+	info->from_metrics_cache = FALSE;
+	font_info_get_ascii (info, glyphs, widths);
+
+	/* Cache the ASCII letters again from the measuring */
+	for (guint i = 0; i < FONT_METRICS_CACHE_N_CHARS; i++) {
+		struct unistr_info *uinfo = font_info_find_unistr_info (info, FONT_METRICS_CACHE_FIRST_CHAR + i);
+		if (uinfo->coverage != COVERAGE_USE_CAIRO_GLYPH)
+			continue;
+		unistr_info_finish (uinfo);
+		uinfo->coverage = COVERAGE_UNKNOWN;
+		info->n_glyphs--;
+	}
+	font_info_measure_font (info);
+	font_info_get_ascii (info, new_glyphs, new_widths);
+
+	changed = width != info->width || height != info->height || ascent != info->ascent;
+	if (changed)
+		font_metrics_generation++;
+	changed = changed ||
+		memcmp (glyphs, new_glyphs, sizeof (glyphs)) != 0 ||
+		memcmp (widths, new_widths, sizeof (widths)) != 0;
+
+	_vte_debug_print (VTE_DEBUG_PANGOCAIRO,
+			  "vtepangocairo: %p cached metrics %s\n",
+			  info, changed ? "changed" : "valid");
+
+	if (changed)
+		font_info_store_metrics (info);
+
+	return changed;
+}
+
 static struct font_info *
 font_info_allocate (PangoContext *context)
 {
@@ -445,7 +890,10 @@ font_info_allocate (PangoContext *context)
 
 	info->string = g_string_sized_new (VTE_UTF8_BPC+1);
 
-	font_info_measure_font (info);
+	if (!font_info_load_metrics (info)) {
+		font_info_measure_font (info);
+		font_info_store_metrics (info);
+	}
 
 	return info;
 }
@@ -468,19 +916,25 @@ font_info_free (struct font_info *info)
 	g_string_free (info->string, TRUE);
 	g_object_unref (info->layout);
 
-	for (i = 0; i < G_N_ELEMENTS (info->ascii_unistr_info); i++)
-		unistr_info_finish (&info->ascii_unistr_info[i]);
-		
+	for (i = 0; i < G_N_ELEMENTS (info->bmp_unistr_pages); i++) {
+		struct unistr_page *page = info->bmp_unistr_pages[i];
+		if (page == NULL)
+			continue;
+		for (guint j = 0; j < G_N_ELEMENTS (page->info); j++)
+			unistr_info_finish (&page->info[j]);
+		g_free (page);
+	}
+
 	if (info->other_unistr_info) {
 		g_hash_table_destroy (info->other_unistr_info);
 	}
 
+	font_cache_bytes -= info->n_bytes;
+
 	g_slice_free (struct font_info, info);
 }
 
 
-static GHashTable *font_info_for_context;
-
 static struct font_info *
 font_info_register (struct font_info *info)
 {
@@ -510,6 +964,7 @@ font_info_reference (struct font_info *info)
 	if (info->destroy_timeout) {
 		g_source_remove (info->destroy_timeout);
 		info->destroy_timeout = 0;
+		g_queue_unlink (&font_info_unused, &info->unused_link);
 	}
 
 	info->ref_count++;
@@ -521,6 +976,7 @@ static gboolean
 font_info_destroy_delayed (struct font_info *info)
 {
 	info->destroy_timeout = 0;
+	g_queue_unlink (&font_info_unused, &info->unused_link);
 
 	font_info_unregister (info);
 	font_info_free (info);
@@ -528,6 +984,23 @@ font_info_destroy_delayed (struct font_info *info)
 	return FALSE;
 }
 
+/* Destroys unused font infos until the cache is within its budget */
+static void
+font_cache_trim (void)
+{
+	while (font_cache_bytes > FONT_CACHE_MAX_BYTES &&
+	       !g_queue_is_empty (&font_info_unused)) {
+		struct font_info *info = (struct font_info *)g_queue_peek_head (&font_info_unused);
+
+		_vte_debug_print (VTE_DEBUG_PANGOCAIRO,
+				  "vtepangocairo: %p evicting font_info of %" G_GSIZE_FORMAT " bytes\n",
+				  info, info->n_bytes);
+
+		g_source_remove (info->destroy_timeout);
+		font_info_destroy_delayed (info);
+	}
+}
+
 static void
 font_info_destroy (struct font_info *info)
 {
@@ -544,6 +1017,11 @@ font_info_destroy (struct font_info *info)
 	info->destroy_timeout = gdk_threads_add_timeout_seconds (FONT_CACHE_TIMEOUT,
 								 (GSourceFunc) font_info_destroy_delayed,
 								 info);
+	info->unused_link.data = info;
+	g_queue_push_tail_link (&font_info_unused, &info->unused_link);
+
+	if (font_cache_bytes > FONT_CACHE_MAX_BYTES)
+		font_cache_trim ();
 }
 
 static GQuark
@@ -692,6 +1170,16 @@ font_info_get_unistr_info (struct font_info *info,
 	if (G_LIKELY (uinfo->coverage != COVERAGE_UNKNOWN))
 		return uinfo;
 
+	if (c >= 0x80 && c < 0x10000) {
+		struct unistr_page *page = info->bmp_unistr_pages[c >> UNISTR_PAGE_SHIFT];
+		if (!page->cached) {
+			page->cached = TRUE;
+			font_info_cache_page (info, c >> UNISTR_PAGE_SHIFT);
+			if (uinfo->coverage != COVERAGE_UNKNOWN)
+				return uinfo;
+		}
+	}
+
 	ufi = &uinfo->ufi;
 
 	g_string_set_size (info->string, 0);
@@ -749,6 +1237,8 @@ font_info_get_unistr_info (struct font_info *info,
 	/* release internal layout resources */
 	pango_layout_set_text (info->layout, "", -1);
 
+	info->n_glyphs++;
+
 #ifdef VTE_DEBUG
 	info->coverage_count[0]++;
 	info->coverage_count[uinfo->coverage]++;
@@ -768,14 +1258,32 @@ guint _vte_draw_get_style(gboolean bold, gboolean italic) {
 
 struct _vte_draw {
 	struct font_info *fonts[4];
+        guint font_metrics_generation; /* when the fonts were set */
         /* cell metrics, already adjusted by cell_{width,height}_scale */
         int cell_width, cell_height;
         GtkBorder char_spacing;
 
 	cairo_t *cr;
 
-        /* Cache the undercurl's rendered look. */
+        /* Cache the undercurl's rendered look, of one cell with the ends
+         * overflowing, and as a pattern repeating it seamlessly. */
         cairo_surface_t *undercurl_surface;
+        cairo_pattern_t *undercurl_pattern;
+
+        /* Cache the rendered look of the locally drawn graphics, as masks. */
+        GHashTable *graphic_surfaces;
+
+        /* The glyphs queued while batching, one run per font and colour. */
+        gboolean batching;
+        GArray *glyph_runs;
+        guint n_glyph_runs;
+};
+
+struct glyph_run {
+        cairo_scaled_font_t *scaled_font;
+        vte::color::rgb color;
+        double alpha;
+        GArray *glyphs; /* of cairo_glyph_t */
 };
 
 struct _vte_draw *
@@ -811,6 +1319,22 @@ _vte_draw_free (struct _vte_draw *draw)
                 draw->undercurl_surface = NULL;
         }
 
+        if (draw->undercurl_pattern != NULL) {
+                cairo_pattern_destroy (draw->undercurl_pattern);
+                draw->undercurl_pattern = NULL;
+        }
+
+        if (draw->graphic_surfaces != NULL) {
+                g_hash_table_destroy (draw->graphic_surfaces);
+                draw->graphic_surfaces = NULL;
+        }
+
+        if (draw->glyph_runs != NULL) {
+                for (guint i = 0; i < draw->glyph_runs->len; i++)
+                        g_array_free(g_array_index(draw->glyph_runs, struct glyph_run, i).glyphs, TRUE);
+                g_array_free(draw->glyph_runs, TRUE);
+        }
+
 	g_slice_free (struct _vte_draw, draw);
 }
 
@@ -839,9 +1363,13 @@ _vte_draw_clip(struct _vte_draw *draw,
         cairo_clip(draw->cr);
 }
 
+static void _vte_draw_flush_glyphs(struct _vte_draw *draw);
+
 void
 _vte_draw_unclip(struct _vte_draw *draw)
 {
+        /* The queued glyphs were clipped to this */
+        _vte_draw_flush_glyphs(draw);
         cairo_restore(draw->cr);
 }
 
@@ -938,6 +1466,8 @@ _vte_draw_set_text_font (struct _vte_draw *draw,
 		draw->fonts[bold] = draw->fonts[normal];
 	}
 
+        draw->font_metrics_generation = font_metrics_generation;
+
         /* Apply letter spacing and line spacing. */
         draw->cell_width = draw->fonts[VTE_DRAW_NORMAL]->width * cell_width_scale;
         draw->char_spacing.left = (draw->cell_width - draw->fonts[VTE_DRAW_NORMAL]->width) / 2;
@@ -951,6 +1481,43 @@ _vte_draw_set_text_font (struct _vte_draw *draw,
                 cairo_surface_destroy (draw->undercurl_surface);
                 draw->undercurl_surface = NULL;
         }
+        if (draw->undercurl_pattern != NULL) {
+                cairo_pattern_destroy (draw->undercurl_pattern);
+                draw->undercurl_pattern = NULL;
+        }
+
+        /* Likewise for the graphics, they depend on the cell size */
+        if (draw->graphic_surfaces != NULL)
+                g_hash_table_remove_all (draw->graphic_surfaces);
+}
+
+/* Whether _vte_draw_validate_fonts() has any work to do */
+gboolean
+_vte_draw_fonts_need_validation(struct _vte_draw *draw)
+{
+        if (draw->font_metrics_generation != font_metrics_generation)
+                return TRUE;
+
+        for (guint style = 0; style < G_N_ELEMENTS (draw->fonts); style++) {
+                if (draw->fonts[style] != NULL && draw->fonts[style]->from_metrics_cache)
+                        return TRUE;
+        }
+        return FALSE;
+}
+
+/* Measures the fonts that were taken from the metrics cache.
+ * Returns: whether the fonts need to be set again, since what they
+ *   draw or their metrics changed */
+gboolean
+_vte_draw_validate_fonts(struct _vte_draw *draw)
+{
+        gboolean changed = draw->font_metrics_generation != font_metrics_generation;
+
+        for (guint style = 0; style < G_N_ELEMENTS (draw->fonts); style++) {
+                if (draw->fonts[style] != NULL && draw->fonts[style]->from_metrics_cache)
+                        changed |= font_info_validate_metrics (draw->fonts[style]);
+        }
+        return changed;
 }
 
 void
@@ -1251,18 +1818,18 @@ pattern(cairo_t* cr,
 /* Draw the graphic representation of a line-drawing or special graphics
  * character. */
 static void
-_vte_draw_terminal_draw_graphic(struct _vte_draw *draw,
-                                vteunistr c,
-                                uint32_t attr,
-                                vte::color::rgb const* fg,
-                                gint x, gint y,
-                                gint font_width, gint columns, gint font_height)
+_vte_draw_terminal_render_graphic(struct _vte_draw *draw,
+                                  cairo_t *cr,
+                                  vteunistr c,
+                                  uint32_t attr,
+                                  vte::color::rgb const* fg,
+                                  gint x, gint y,
+                                  gint font_width, gint columns, gint font_height)
 {
         gint width, height, xcenter, xright, ycenter, ybottom;
         int upper_half, left_half;
         int light_line_width, heavy_line_width;
         double adjust;
-        cairo_t *cr = draw->cr;
 
         cairo_save (cr);
 
@@ -2234,6 +2801,147 @@ _vte_draw_terminal_draw_graphic(struct _vte_draw *draw,
         cairo_restore(cr);
 }
 
+/* Draws the graphic using its cached look, rendered as a mask on first use,
+ * in the current source colour. */
+static void
+_vte_draw_terminal_draw_graphic(struct _vte_draw *draw,
+                                vteunistr c,
+                                uint32_t attr,
+                                vte::color::rgb const* fg,
+                                gint x, gint y,
+                                gint font_width, gint columns, gint font_height)
+{
+        /* Some lines and diagonals slightly overflow the cell */
+        gint const padding = MAX (font_width / 5, 1) + 1;
+
+        /* Only the separated mosaic attribute changes the look */
+        gint64 key = c;
+        key |= gint64(columns & 0xff) << 21;
+        key |= gint64(font_width & 0xffff) << 29;
+#ifdef WITH_UNICODE_NEXT
+        if (vte_attr_get_bool(attr, VTE_ATTR_SEPARATED_MOSAIC_SHIFT) && _vte_draw_is_separable_mosaic(c))
+                key |= gint64(1) << 45;
+#endif
+
+        if (G_UNLIKELY (draw->graphic_surfaces == NULL))
+                draw->graphic_surfaces = g_hash_table_new_full (g_int64_hash, g_int64_equal,
+                                                                g_free,
+                                                                (GDestroyNotify) cairo_surface_destroy);
+
+        auto surface = (cairo_surface_t *)g_hash_table_lookup (draw->graphic_surfaces, &key);
+        if (G_UNLIKELY (surface == NULL)) {
+                _vte_debug_print (VTE_DEBUG_DRAW,
+                                  "caching graphic U+%04X\n", c);
+
+                surface = cairo_surface_create_similar (cairo_get_target (draw->cr),
+                                                        CAIRO_CONTENT_ALPHA,
+                                                        draw->cell_width * columns + 2 * padding,
+                                                        draw->cell_height + 2 * padding);
+                auto mask_cr = cairo_create (surface);
+                cairo_set_operator (mask_cr, CAIRO_OPERATOR_OVER);
+                _vte_draw_terminal_render_graphic (draw, mask_cr, c, attr, fg,
+                                                   padding, padding,
+                                                   font_width, columns, font_height);
+                cairo_destroy (mask_cr);
+
+                g_hash_table_insert (draw->graphic_surfaces, g_memdup (&key, sizeof (key)), surface);
+        }
+
+        cairo_mask_surface (draw->cr, surface, x - padding, y - padding);
+}
+
+/* Queue a glyph into the batch's run for its font and colour. */
+static void
+_vte_draw_queue_glyph(struct _vte_draw *draw,
+                      cairo_scaled_font_t *scaled_font,
+                      vte::color::rgb const* color,
+                      double alpha,
+                      cairo_glyph_t const* glyph)
+{
+        struct glyph_run *run = NULL;
+
+        /* Most glyphs go to the same run as the previous one */
+        for (guint i = draw->n_glyph_runs; i > 0; i--) {
+                auto r = &g_array_index(draw->glyph_runs, struct glyph_run, i - 1);
+                if (r->scaled_font == scaled_font &&
+                    r->color.red == color->red &&
+                    r->color.green == color->green &&
+                    r->color.blue == color->blue &&
+                    r->alpha == alpha) {
+                        run = r;
+                        break;
+                }
+        }
+
+        if (run == NULL) {
+                if (draw->glyph_runs == NULL)
+                        draw->glyph_runs = g_array_new(FALSE, FALSE, sizeof(struct glyph_run));
+                if (draw->n_glyph_runs == draw->glyph_runs->len) {
+                        struct glyph_run r;
+                        r.glyphs = g_array_sized_new(FALSE, FALSE, sizeof(cairo_glyph_t), MAX_RUN_LENGTH);
+                        g_array_append_val(draw->glyph_runs, r);
+                }
+                /* Reuse the run's array, it keeps its size across frames */
+                run = &g_array_index(draw->glyph_runs, struct glyph_run, draw->n_glyph_runs++);
+                run->scaled_font = scaled_font;
+                run->color = *color;
+                run->alpha = alpha;
+        }
+
+        g_array_append_vals(run->glyphs, glyph, 1);
+}
+
+/* Draw the queued glyphs, one cairo_show_glyphs() per run. */
+static void
+_vte_draw_flush_glyphs(struct _vte_draw *draw)
+{
+        if (draw->n_glyph_runs == 0)
+                return;
+
+        g_assert(draw->cr);
+        cairo_set_operator (draw->cr, CAIRO_OPERATOR_OVER);
+
+        for (guint i = 0; i < draw->n_glyph_runs; i++) {
+                auto run = &g_array_index(draw->glyph_runs, struct glyph_run, i);
+                auto glyphs = reinterpret_cast<cairo_glyph_t*>(run->glyphs->data);
+
+                _vte_draw_set_source_color_alpha (draw, &run->color, run->alpha);
+                cairo_set_scaled_font (draw->cr, run->scaled_font);
+                for (guint j = 0; j < run->glyphs->len; j += MAX_RUN_LENGTH)
+                        cairo_show_glyphs (draw->cr,
+                                           glyphs + j,
+                                           MIN(run->glyphs->len - j, MAX_RUN_LENGTH));
+                g_array_set_size(run->glyphs, 0);
+        }
+
+        draw->n_glyph_runs = 0;
+}
+
+/*
+ * _vte_draw_begin_glyph_batch:
+ * @draw: a #_vte_draw
+ *
+ * Starts queueing the glyphs drawn with the cairo glyph path instead of
+ * drawing them right away, so that the glyphs of all the runs of cells
+ * with the same font and colour are drawn in one go. They are drawn
+ * on top of everything drawn in the meantime, when the clip changes at
+ * the latest, and at _vte_draw_end_glyph_batch().
+ */
+void
+_vte_draw_begin_glyph_batch(struct _vte_draw *draw)
+{
+        g_assert(!draw->batching);
+        draw->batching = TRUE;
+}
+
+void
+_vte_draw_end_glyph_batch(struct _vte_draw *draw)
+{
+        g_assert(draw->batching);
+        _vte_draw_flush_glyphs(draw);
+        draw->batching = FALSE;
+}
+
 static void
 _vte_draw_text_internal (struct _vte_draw *draw,
 			 struct _vte_draw_text_request *requests, gsize n_requests,
@@ -2295,6 +3003,15 @@ _vte_draw_text_internal (struct _vte_draw *draw,
 						       ufi->using_pango_glyph_string.glyph_string);
 			break;
 		case COVERAGE_USE_CAIRO_GLYPH:
+                        if (draw->batching) {
+                                cairo_glyph_t glyph;
+                                glyph.index = ufi->using_cairo_glyph.glyph_index;
+                                glyph.x = x;
+                                glyph.y = y;
+                                _vte_draw_queue_glyph(draw, ufi->using_cairo_glyph.scaled_font,
+                                                      color, alpha, &glyph);
+                                break;
+                        }
 			if (last_scaled_font != ufi->using_cairo_glyph.scaled_font || n_cr_glyphs == MAX_RUN_LENGTH) {
 				if (n_cr_glyphs) {
 					cairo_set_scaled_font (draw->cr, last_scaled_font);
@@ -2347,6 +3064,54 @@ _vte_draw_text (struct _vte_draw *draw,
 	_vte_draw_text_internal (draw, requests, n_requests, attr, color, alpha, style);
 }
 
+void
+_vte_draw_set_metrics_cache_file (const char *filename)
+{
+	if (g_strcmp0 (filename, font_metrics_cache_file) == 0)
+		return;
+
+	if (font_metrics_cache_save_source != 0) {
+		g_source_remove (font_metrics_cache_save_source);
+		font_metrics_cache_save (NULL);
+	}
+	g_clear_pointer (&font_metrics_cache, g_key_file_free);
+
+	g_free (font_metrics_cache_file);
+	font_metrics_cache_file = g_strdup (filename);
+}
+
+const char *
+_vte_draw_get_metrics_cache_file (void)
+{
+	return font_metrics_cache_file;
+}
+
+void
+_vte_draw_get_cache_stats (guint *n_fonts,
+			   guint *n_glyphs,
+			   gsize *n_bytes)
+{
+	guint fonts = 0, glyphs = 0;
+
+	if (font_info_for_context != NULL) {
+		GHashTableIter iter;
+		gpointer value;
+
+		g_hash_table_iter_init (&iter, font_info_for_context);
+		while (g_hash_table_iter_next (&iter, NULL, &value)) {
+			fonts++;
+			glyphs += ((struct font_info *)value)->n_glyphs;
+		}
+	}
+
+	if (n_fonts)
+		*n_fonts = fonts;
+	if (n_glyphs)
+		*n_glyphs = glyphs;
+	if (n_bytes)
+		*n_bytes = font_cache_bytes;
+}
+
 /* The following two functions are unused since commit 154abade902850afb44115cccf8fcac51fc082f0,
  * but let's keep them for now since they may become used again.
  */
@@ -2427,6 +3192,26 @@ _vte_draw_fill_rectangle (struct _vte_draw *draw,
 	cairo_fill (draw->cr);
 }
 
+/* Paints all of the image @surface at @x, @y */
+void
+_vte_draw_draw_surface(struct _vte_draw *draw,
+                       cairo_surface_t *surface,
+                       gint x, gint y)
+{
+        g_assert(draw->cr);
+
+        auto const width = cairo_image_surface_get_width(surface);
+        auto const height = cairo_image_surface_get_height(surface);
+
+	_vte_debug_print (VTE_DEBUG_DRAW,
+			"draw_surface (%d, %d, %d, %d)\n",
+			x, y, width, height);
+
+	cairo_set_operator (draw->cr, CAIRO_OPERATOR_OVER);
+	cairo_set_source_surface (draw->cr, surface, x, y);
+	cairo_rectangle (draw->cr, x, y, width, height);
+	cairo_fill (draw->cr);
+}
 
 void
 _vte_draw_draw_line(struct _vte_draw *draw,
@@ -2470,6 +3255,8 @@ _vte_draw_draw_undercurl(struct _vte_draw *draw,
         gint x_padding = line_width + 1;  /* ceil, kind of */
 
         gint surface_top = y;  /* floor */
+        double y_bottom = y + _vte_draw_get_undercurl_height(draw->cell_width, line_width);
+        gint surface_bottom = y_bottom + 1;  /* ceil, kind of */
 
         g_assert(draw->cr);
 
@@ -2487,9 +3274,15 @@ _vte_draw_draw_undercurl(struct _vte_draw *draw,
                 cairo_t *undercurl_cr;
 
                 double rad = _vte_draw_get_undercurl_rad(draw->cell_width);
-                double y_bottom = y + _vte_draw_get_undercurl_height(draw->cell_width, line_width);
                 double y_center = (y + y_bottom) / 2.;
-                gint surface_bottom = y_bottom + 1;  /* ceil, kind of */
+
+                auto const add_curl = [&](cairo_t *cr, double x0) {
+                        /* First quarter circle, similar to the left half of the tilde symbol. */
+                        cairo_new_sub_path (cr);
+                        cairo_arc (cr, x0 + draw->cell_width / 4., y_center - surface_top + draw->cell_width / 4., rad, M_PI * 5 / 4, M_PI * 7 / 4);
+                        /* Second quarter circle, similar to the right half of the tilde symbol. */
+                        cairo_arc_negative (cr, x0 + draw->cell_width * 3 / 4., y_center - surface_top - draw->cell_width / 4., rad, M_PI * 3 / 4, M_PI / 4);
+                };
 
                 _vte_debug_print (VTE_DEBUG_DRAW,
                                   "caching undercurl shape\n");
@@ -2501,23 +3294,58 @@ _vte_draw_draw_undercurl(struct _vte_draw *draw,
                                                                         surface_bottom - surface_top);
                 undercurl_cr = cairo_create (draw->undercurl_surface);
                 cairo_set_operator (undercurl_cr, CAIRO_OPERATOR_OVER);
-                /* First quarter circle, similar to the left half of the tilde symbol. */
-                cairo_arc (undercurl_cr, x_padding + draw->cell_width / 4., y_center - surface_top + draw->cell_width / 4., rad, M_PI * 5 / 4, M_PI * 7 / 4);
-                /* Second quarter circle, similar to the right half of the tilde symbol. */
-                cairo_arc_negative (undercurl_cr, x_padding + draw->cell_width * 3 / 4., y_center - surface_top - draw->cell_width / 4., rad, M_PI * 3 / 4, M_PI / 4);
+                add_curl (undercurl_cr, x_padding);
                 cairo_set_line_width (undercurl_cr, line_width);
                 cairo_stroke (undercurl_cr);
                 cairo_destroy (undercurl_cr);
+
+                /* The repeated tile is exactly one cell wide, and has the overflowing
+                 * ends of the neighbouring cells' curls too. */
+                auto tile = cairo_surface_create_similar (cairo_get_target (draw->cr),
+                                                          CAIRO_CONTENT_ALPHA,
+                                                          draw->cell_width,
+                                                          surface_bottom - surface_top);
+                undercurl_cr = cairo_create (tile);
+                cairo_set_operator (undercurl_cr, CAIRO_OPERATOR_OVER);
+                for (int i = -1; i <= 1; i++)
+                        add_curl (undercurl_cr, i * draw->cell_width);
+                cairo_set_line_width (undercurl_cr, line_width);
+                cairo_stroke (undercurl_cr);
+                cairo_destroy (undercurl_cr);
+
+                draw->undercurl_pattern = cairo_pattern_create_for_surface (tile);
+                cairo_pattern_set_extend (draw->undercurl_pattern, CAIRO_EXTEND_REPEAT);
+                cairo_surface_destroy (tile);
         }
 
         /* Paint the cached look of the undercurl using the desired look.
          * The cached look takes the fractional part of "y" into account,
-         * here we only offset by its integer part. */
+         * here we only offset by its integer part.
+         * The run is one fill with the repeating pattern, and only its
+         * overflowing ends come from the single cell's look. */
+        gint surface_height = surface_bottom - surface_top;
+
         cairo_save (draw->cr);
         cairo_set_operator (draw->cr, CAIRO_OPERATOR_OVER);
         _vte_draw_set_source_color_alpha (draw, color, alpha);
-        for (int i = 0; i < count; i++) {
-                cairo_mask_surface (draw->cr, draw->undercurl_surface, x - x_padding + i * draw->cell_width, surface_top);
-        }
+
+        cairo_matrix_t matrix;
+        cairo_matrix_init_translate (&matrix, -x, -surface_top);
+        cairo_pattern_set_matrix (draw->undercurl_pattern, &matrix);
+        cairo_save (draw->cr);
+        cairo_rectangle (draw->cr, x, surface_top, count * draw->cell_width, surface_height);
+        cairo_clip (draw->cr);
+        cairo_mask (draw->cr, draw->undercurl_pattern);
+        cairo_restore (draw->cr);
+
+        cairo_save (draw->cr);
+        cairo_rectangle (draw->cr, x - x_padding, surface_top, x_padding, surface_height);
+        cairo_clip (draw->cr);
+        cairo_mask_surface (draw->cr, draw->undercurl_surface, x - x_padding, surface_top);
+        cairo_restore (draw->cr);
+
+        cairo_rectangle (draw->cr, x + count * draw->cell_width, surface_top, x_padding, surface_height);
+        cairo_clip (draw->cr);
+        cairo_mask_surface (draw->cr, draw->undercurl_surface, x - x_padding + (count - 1) * draw->cell_width, surface_top);
         cairo_restore (draw->cr);
 }
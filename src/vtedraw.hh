@@ -62,14 +62,25 @@ void _vte_draw_clip(struct _vte_draw *draw,
 
 void _vte_draw_unclip(struct _vte_draw *draw);
 
+void _vte_draw_begin_glyph_batch(struct _vte_draw *draw);
+void _vte_draw_end_glyph_batch(struct _vte_draw *draw);
+
 void _vte_draw_clear(struct _vte_draw *draw,
 		     gint x, gint y, gint width, gint height,
                      vte::color::rgb const* color, double alpha);
 
+void _vte_draw_get_cache_stats(guint *n_fonts,
+                               guint *n_glyphs,
+                               gsize *n_bytes);
+void _vte_draw_set_metrics_cache_file(const char *filename);
+const char *_vte_draw_get_metrics_cache_file(void);
+
 void _vte_draw_set_text_font(struct _vte_draw *draw,
                              GtkWidget *widget,
                              const PangoFontDescription *fontdesc,
                              double cell_width_scale, double cell_height_scale);
+gboolean _vte_draw_fonts_need_validation(struct _vte_draw *draw);
+gboolean _vte_draw_validate_fonts(struct _vte_draw *draw);
 void _vte_draw_get_text_metrics(struct _vte_draw *draw,
                                 int *cell_width, int *cell_height,
                                 int *char_ascent, int *char_descent,
@@ -94,6 +105,10 @@ void _vte_draw_draw_rectangle(struct _vte_draw *draw,
 			      gint x, gint y, gint width, gint height,
 			      vte::color::rgb const* color, double alpha);
 
+void _vte_draw_draw_surface(struct _vte_draw *draw,
+                            cairo_surface_t *surface,
+                            gint x, gint y);
+
 void _vte_draw_draw_line(struct _vte_draw *draw,
                          gint x, gint y, gint xp, gint yp,
                          int line_width,
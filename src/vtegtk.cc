@@ -501,6 +501,12 @@ vte_terminal_get_property (GObject *object,
                 case PROP_ENABLE_SHAPING:
                         g_value_set_boolean (value, vte_terminal_get_enable_shaping (terminal));
                         break;
+                case PROP_ENABLE_IO_THREAD:
+                        g_value_set_boolean (value, vte_terminal_get_enable_io_thread (terminal));
+                        break;
+                case PROP_HEADLESS:
+                        g_value_set_boolean (value, vte_terminal_get_headless (terminal));
+                        break;
                 case PROP_ENCODING:
                         g_value_set_string (value, vte_terminal_get_encoding (terminal));
                         break;
@@ -519,15 +525,24 @@ vte_terminal_get_property (GObject *object,
                 case PROP_INPUT_ENABLED:
                         g_value_set_boolean (value, vte_terminal_get_input_enabled (terminal));
                         break;
+                case PROP_INPUT_QUEUE_LIMIT:
+                        g_value_set_uint (value, vte_terminal_get_input_queue_limit (terminal));
+                        break;
                 case PROP_MOUSE_POINTER_AUTOHIDE:
                         g_value_set_boolean (value, vte_terminal_get_mouse_autohide (terminal));
                         break;
                 case PROP_PTY:
                         g_value_set_object (value, vte_terminal_get_pty(terminal));
                         break;
+                case PROP_RESIZE_DELAY:
+                        g_value_set_uint (value, vte_terminal_get_resize_delay (terminal));
+                        break;
                 case PROP_REWRAP_ON_RESIZE:
                         g_value_set_boolean (value, vte_terminal_get_rewrap_on_resize (terminal));
                         break;
+                case PROP_SCROLLBACK_BYTES:
+                        g_value_set_uint64 (value, vte_terminal_get_scrollback_bytes(terminal));
+                        break;
                 case PROP_SCROLLBACK_LINES:
                         g_value_set_uint (value, vte_terminal_get_scrollback_lines(terminal));
                         break;
@@ -614,6 +629,12 @@ vte_terminal_set_property (GObject *object,
                 case PROP_ENABLE_SHAPING:
                         vte_terminal_set_enable_shaping (terminal, g_value_get_boolean (value));
                         break;
+                case PROP_ENABLE_IO_THREAD:
+                        vte_terminal_set_enable_io_thread (terminal, g_value_get_boolean (value));
+                        break;
+                case PROP_HEADLESS:
+                        vte_terminal_set_headless (terminal, g_value_get_boolean (value));
+                        break;
                 case PROP_ENCODING:
                         vte_terminal_set_encoding (terminal, g_value_get_string (value), NULL);
                         break;
@@ -626,15 +647,24 @@ vte_terminal_set_property (GObject *object,
                 case PROP_INPUT_ENABLED:
                         vte_terminal_set_input_enabled (terminal, g_value_get_boolean (value));
                         break;
+                case PROP_INPUT_QUEUE_LIMIT:
+                        vte_terminal_set_input_queue_limit (terminal, g_value_get_uint (value));
+                        break;
                 case PROP_MOUSE_POINTER_AUTOHIDE:
                         vte_terminal_set_mouse_autohide (terminal, g_value_get_boolean (value));
                         break;
                 case PROP_PTY:
                         vte_terminal_set_pty (terminal, (VtePty *)g_value_get_object (value));
                         break;
+                case PROP_RESIZE_DELAY:
+                        vte_terminal_set_resize_delay (terminal, g_value_get_uint (value));
+                        break;
                 case PROP_REWRAP_ON_RESIZE:
                         vte_terminal_set_rewrap_on_resize (terminal, g_value_get_boolean (value));
                         break;
+                case PROP_SCROLLBACK_BYTES:
+                        vte_terminal_set_scrollback_bytes (terminal, g_value_get_uint64 (value));
+                        break;
                 case PROP_SCROLLBACK_LINES:
                         vte_terminal_set_scrollback_lines (terminal, g_value_get_uint (value));
                         break;
@@ -1031,6 +1061,34 @@ vte_terminal_class_init(VteTerminalClass *klass)
                                    G_OBJECT_CLASS_TYPE(klass),
                                    g_cclosure_marshal_VOID__VOIDv);
 
+        /**
+         * VteTerminal::contents-updated:
+         * @vteterminal: the object which received the signal
+         * @scrolled: the number of rows the contents scrolled up by
+         * @first_row: the first row that may look different, or -1 if none
+         * @last_row: the last row that may look different, or -1 if none
+         *
+         * Emitted right after #VteTerminal::contents-changed, with a summary
+         * of what changed since the last time, so that listeners don't
+         * need to fetch all of the text again to find out. The rows are in
+         * the coordinates of vte_terminal_get_text_range(), and account
+         * for the scrolling already.
+         *
+         * Since: 0.60
+         */
+        signals[SIGNAL_CONTENTS_UPDATED] =
+                g_signal_new(I_("contents-updated"),
+                             G_OBJECT_CLASS_TYPE(klass),
+                             G_SIGNAL_RUN_LAST,
+                             0,
+                             NULL,
+                             NULL,
+                             _vte_marshal_VOID__INT_LONG_LONG,
+                             G_TYPE_NONE, 3, G_TYPE_INT, G_TYPE_LONG, G_TYPE_LONG);
+        g_signal_set_va_marshaller(signals[SIGNAL_CONTENTS_UPDATED],
+                                   G_OBJECT_CLASS_TYPE(klass),
+                                   _vte_marshal_VOID__INT_LONG_LONGv);
+
         /**
          * VteTerminal::cursor-moved:
          * @vteterminal: the object which received the signal
@@ -1403,6 +1461,32 @@ vte_terminal_class_init(VteTerminalClass *klass)
                                    G_OBJECT_CLASS_TYPE(klass),
                                    g_cclosure_marshal_VOID__VOIDv);
 
+        /**
+         * VteTerminal::paste-progress:
+         * @vteterminal: the object which received the signal
+         * @sent: the number of bytes of the pasted text queued for the child so far
+         * @total: the length of the pasted text in bytes
+         *
+         * Emitted as a paste is sent to the child. A large paste is sent
+         * a slice at a time, as fast as the child reads it; this is emitted
+         * after each, and lastly with @sent equal to @total. See
+         * vte_terminal_cancel_paste().
+         *
+         * Since: 0.60
+         */
+        signals[SIGNAL_PASTE_PROGRESS] =
+                g_signal_new(I_("paste-progress"),
+                             G_OBJECT_CLASS_TYPE(klass),
+                             G_SIGNAL_RUN_LAST,
+                             0,
+                             NULL,
+                             NULL,
+                             _vte_marshal_VOID__UINT64_UINT64,
+                             G_TYPE_NONE, 2, G_TYPE_UINT64, G_TYPE_UINT64);
+        g_signal_set_va_marshaller(signals[SIGNAL_PASTE_PROGRESS],
+                                   G_OBJECT_CLASS_TYPE(klass),
+                                   _vte_marshal_VOID__UINT64_UINT64v);
+
         /**
          * VteTerminal::bell:
          * @vteterminal: the object which received the signal
@@ -1588,6 +1672,30 @@ vte_terminal_class_init(VteTerminalClass *klass)
                                       TRUE,
                                       (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | G_PARAM_EXPLICIT_NOTIFY));
 
+        /**
+         * VteTerminal:enable-io-thread:
+         *
+         * Controls whether the terminal reads from its PTY on a separate thread.
+         *
+         * Since: 0.60
+         */
+        pspecs[PROP_ENABLE_IO_THREAD] =
+                g_param_spec_boolean ("enable-io-thread", NULL, NULL,
+                                      FALSE,
+                                      (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | G_PARAM_EXPLICIT_NOTIFY));
+
+        /**
+         * VteTerminal:headless:
+         *
+         * Whether the terminal is headless, see vte_terminal_set_headless().
+         *
+         * Since: 0.60
+         */
+        pspecs[PROP_HEADLESS] =
+                g_param_spec_boolean ("headless", NULL, NULL,
+                                      FALSE,
+                                      (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | G_PARAM_EXPLICIT_NOTIFY));
+
         /**
          * VteTerminal:font-scale:
          *
@@ -1652,6 +1760,21 @@ vte_terminal_class_init(VteTerminalClass *klass)
                                       TRUE,
                                       (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | G_PARAM_EXPLICIT_NOTIFY));
 
+        /**
+         * VteTerminal:input-queue-limit:
+         *
+         * The number of bytes of unprocessed data from the child above which
+         * the terminal stops reading from its PTY, until the backlog has been
+         * processed down to half that. 0 means no limit.
+         *
+         * Since: 0.60
+         */
+        pspecs[PROP_INPUT_QUEUE_LIMIT] =
+                g_param_spec_uint ("input-queue-limit", NULL, NULL,
+                                   0, G_MAXUINT,
+                                   VTE_DEFAULT_INPUT_QUEUE_LIMIT,
+                                   (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | G_PARAM_EXPLICIT_NOTIFY));
+
         /**
          * VteTerminal:pointer-autohide:
          *
@@ -1674,6 +1797,22 @@ vte_terminal_class_init(VteTerminalClass *klass)
                                      VTE_TYPE_PTY,
                                      (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | G_PARAM_EXPLICIT_NOTIFY));
 
+        /**
+         * VteTerminal:resize-delay:
+         *
+         * The time in milliseconds a resize of the terminal waits for further
+         * resizes, such as while the user drags the window's edge, before the
+         * last size is applied to the contents and the PTY. 0 applies each
+         * size immediately.
+         *
+         * Since: 0.60
+         */
+        pspecs[PROP_RESIZE_DELAY] =
+                g_param_spec_uint ("resize-delay", NULL, NULL,
+                                   0, G_MAXUINT,
+                                   VTE_DEFAULT_RESIZE_DELAY,
+                                   (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | G_PARAM_EXPLICIT_NOTIFY));
+
         /**
          * VteTerminal:rewrap-on-resize:
          *
@@ -1687,6 +1826,21 @@ vte_terminal_class_init(VteTerminalClass *klass)
                                       TRUE,
                                       (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | G_PARAM_EXPLICIT_NOTIFY));
 
+        /**
+         * VteTerminal:scrollback-bytes:
+         *
+         * The maximum number of bytes the scrollback buffer may take, as stored,
+         * that is, after compression; or 0 for no limit other than
+         * #VteTerminal:scrollback-lines.
+         *
+         * Since: 0.60
+         */
+        pspecs[PROP_SCROLLBACK_BYTES] =
+                g_param_spec_uint64 ("scrollback-bytes", NULL, NULL,
+                                     0, G_MAXUINT64,
+                                     0,
+                                     (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | G_PARAM_EXPLICIT_NOTIFY));
+
         /**
          * VteTerminal:scrollback-lines:
          *
@@ -1954,6 +2108,158 @@ vte_set_test_flags(guint64 flags)
 #endif
 }
 
+/**
+ * vte_set_scrollback_budget:
+ * @bytes: the maximum size of the history of all terminals, or 0
+ *
+ * Limits the space the scrollback buffers of all terminals in the process
+ * take together, as stored, that is, after compression. When over the
+ * budget, the oldest lines of the terminals with the largest scrollback
+ * buffers are discarded first.
+ *
+ * This applies in addition to the limits of each terminal. A value of 0,
+ * the default, means no limit.
+ *
+ * Since: 0.60
+ */
+void
+vte_set_scrollback_budget(guint64 bytes)
+{
+        vte::base::Ring::set_budget(MIN(bytes, G_MAXSIZE));
+}
+
+/**
+ * vte_get_scrollback_budget:
+ *
+ * Returns: the maximum size of the history of all terminals, or 0 for no
+ *   limit
+ *
+ * Since: 0.60
+ */
+guint64
+vte_get_scrollback_budget(void)
+{
+        return vte::base::Ring::budget();
+}
+
+/**
+ * vte_get_glyph_cache_stats:
+ * @n_fonts: (out) (optional): a location to store the number of fonts cached
+ * @n_glyphs: (out) (optional): a location to store the number of glyphs cached
+ * @n_bytes: (out) (optional): a location to store the size of the cache
+ *
+ * Gets statistics on the cache of fonts and their glyphs that all terminals
+ * in the process share. Terminals using the same font share its cached
+ * glyphs; the fonts no longer used are kept for a while, as long as the
+ * cache stays within its size limit.
+ *
+ * Since: 0.60
+ */
+void
+vte_get_glyph_cache_stats(guint *n_fonts,
+                          guint *n_glyphs,
+                          gsize *n_bytes)
+{
+        _vte_draw_get_cache_stats(n_fonts, n_glyphs, n_bytes);
+}
+
+/**
+ * vte_set_font_metrics_cache_file:
+ * @filename: (type filename) (nullable): the file to keep the font metrics in, or %NULL
+ *
+ * Sets a file in which the terminals keep the metrics they measured of
+ * their fonts, and the glyphs of the ASCII letters, so that terminals
+ * created later, also by other runs of the application, can start
+ * without measuring the same fonts again. A file in the user's cache
+ * directory, see g_get_user_cache_dir(), is a good choice.
+ *
+ * The metrics are keyed by the font description, the resolution, the font
+ * options and the fontconfig configuration, and are measured again after
+ * the terminal is first painted, to correct them if the font changed
+ * regardless.
+ *
+ * The default is %NULL, to not keep the metrics.
+ *
+ * Since: 0.60
+ */
+void
+vte_set_font_metrics_cache_file(const char *filename)
+{
+        _vte_draw_set_metrics_cache_file(filename);
+}
+
+/**
+ * vte_get_font_metrics_cache_file:
+ *
+ * Returns: (type filename) (nullable) (transfer none): the file set with
+ *   vte_set_font_metrics_cache_file(), or %NULL
+ *
+ * Since: 0.60
+ */
+const char *
+vte_get_font_metrics_cache_file(void)
+{
+        return _vte_draw_get_metrics_cache_file();
+}
+
+/**
+ * vte_set_scrollback_encryption:
+ * @encryption: a #VteScrollbackEncryption
+ *
+ * Sets whether the scrollback of terminals created from now on gets
+ * encrypted before it is written to temporary files. Encryption protects
+ * the history from being read back from the disk, at some cost in CPU time.
+ *
+ * %VTE_SCROLLBACK_ENCRYPTION_AUTO skips encryption when the temporary
+ * directory is in memory. Note that the pages of a tmpfs can still be
+ * swapped out to disk, so only use this on systems without swap or with
+ * encrypted swap.
+ *
+ * The default is %VTE_SCROLLBACK_ENCRYPTION_ALWAYS. If VTE was built
+ * without GnuTLS, the scrollback is never encrypted.
+ *
+ * Since: 0.60
+ */
+void
+vte_set_scrollback_encryption(VteScrollbackEncryption encryption)
+{
+        g_return_if_fail(encryption >= VTE_SCROLLBACK_ENCRYPTION_ALWAYS &&
+                         encryption <= VTE_SCROLLBACK_ENCRYPTION_NEVER);
+
+        switch (encryption) {
+        case VTE_SCROLLBACK_ENCRYPTION_ALWAYS:
+                _vte_file_stream_set_encryption(VTE_STREAM_ENCRYPTION_ALWAYS);
+                break;
+        case VTE_SCROLLBACK_ENCRYPTION_AUTO:
+                _vte_file_stream_set_encryption(VTE_STREAM_ENCRYPTION_AUTO);
+                break;
+        case VTE_SCROLLBACK_ENCRYPTION_NEVER:
+                _vte_file_stream_set_encryption(VTE_STREAM_ENCRYPTION_NEVER);
+                break;
+        }
+}
+
+/**
+ * vte_get_scrollback_encryption:
+ *
+ * Returns: the #VteScrollbackEncryption set with vte_set_scrollback_encryption()
+ *
+ * Since: 0.60
+ */
+VteScrollbackEncryption
+vte_get_scrollback_encryption(void)
+{
+        switch (_vte_file_stream_get_encryption()) {
+        case VTE_STREAM_ENCRYPTION_AUTO:
+                return VTE_SCROLLBACK_ENCRYPTION_AUTO;
+        case VTE_STREAM_ENCRYPTION_NEVER:
+                return VTE_SCROLLBACK_ENCRYPTION_NEVER;
+        case VTE_STREAM_ENCRYPTION_ALWAYS:
+        default:
+                return VTE_SCROLLBACK_ENCRYPTION_ALWAYS;
+        }
+}
+
 /**
  * vte_get_encodings:
  * @include_aliases: whether to include alias names
@@ -2118,6 +2424,24 @@ vte_terminal_paste_primary(VteTerminal *terminal)
 	WIDGET(terminal)->paste(GDK_SELECTION_PRIMARY);
 }
 
+/**
+ * vte_terminal_cancel_paste:
+ * @terminal: a #VteTerminal
+ *
+ * Stops sending the paste in progress, if any, to the child. What was
+ * already queued of it is still sent, followed by the end of the bracketed
+ * paste if the child asked for those.
+ *
+ * Since: 0.60
+ */
+void
+vte_terminal_cancel_paste(VteTerminal *terminal)
+{
+	g_return_if_fail(VTE_IS_TERMINAL(terminal));
+
+        IMPL(terminal)->paste_cancel();
+}
+
 /**
  * vte_terminal_match_add_gregex:
  * @terminal: a #VteTerminal
@@ -2449,6 +2773,149 @@ vte_terminal_search_find_next (VteTerminal *terminal)
 	return IMPL(terminal)->search_find(false);
 }
 
+/**
+ * vte_terminal_search_find_async:
+ * @terminal: a #VteTerminal
+ * @backward: whether to search backward
+ * @cancellable: (allow-none): a #GCancellable object, or %NULL
+ * @progress_callback: (allow-none) (scope notified): function to call with
+ *   the number of rows searched so far and in total, or %NULL
+ * @progress_data: (closure progress_callback) (allow-none): user data for @progress_callback
+ * @progress_data_destroy: (destroy progress_data) (allow-none): a #GDestroyNotify for @progress_data, or %NULL
+ * @callback: (allow-none): a #GAsyncReadyCallback, or %NULL
+ * @user_data: (closure callback): user data for @callback
+ *
+ * Like vte_terminal_search_find_next() or vte_terminal_search_find_previous(),
+ * but without blocking the widget while searching a long scrollback. The
+ * search goes through the rows there are at the time of this call, using the
+ * search regex set then.
+ *
+ * When the operation is finished, @callback will be called. You can then call
+ * vte_terminal_search_find_finish() to get the result of the operation.
+ *
+ * Since: 0.60
+ */
+void
+vte_terminal_search_find_async(VteTerminal *terminal,
+                               gboolean backward,
+                               GCancellable *cancellable,
+                               GFileProgressCallback progress_callback,
+                               gpointer progress_data,
+                               GDestroyNotify progress_data_destroy,
+                               GAsyncReadyCallback callback,
+                               gpointer user_data)
+{
+        g_return_if_fail(VTE_IS_TERMINAL(terminal));
+        g_return_if_fail(cancellable == nullptr || G_IS_CANCELLABLE(cancellable));
+        g_return_if_fail(!progress_data_destroy || progress_data);
+
+        IMPL(terminal)->search_async(false, backward != FALSE, 1, cancellable,
+                                     progress_callback, progress_data, progress_data_destroy,
+                                     callback, user_data);
+}
+
+/**
+ * vte_terminal_search_find_finish:
+ * @terminal: a #VteTerminal
+ * @result: a #GAsyncResult
+ * @error: (allow-none): return location for a #GError, or %NULL
+ *
+ * Finishes an operation started with vte_terminal_search_find_async().
+ * The match found is selected and scrolled to by now.
+ *
+ * Returns: %TRUE if a match was found, or %FALSE if not or on error with
+ *   @error filled in
+ *
+ * Since: 0.60
+ */
+gboolean
+vte_terminal_search_find_finish(VteTerminal *terminal,
+                                GAsyncResult *result,
+                                GError **error)
+{
+        g_return_val_if_fail(VTE_IS_TERMINAL(terminal), FALSE);
+        g_return_val_if_fail(g_task_is_valid(result, terminal), FALSE);
+        g_return_val_if_fail(error == nullptr || *error == nullptr, FALSE);
+
+        return g_task_propagate_boolean(G_TASK(result), error);
+}
+
+/**
+ * vte_terminal_search_find_all_async:
+ * @terminal: a #VteTerminal
+ * @max_matches: the number of matches to stop at, or 0 for no limit
+ * @cancellable: (allow-none): a #GCancellable object, or %NULL
+ * @progress_callback: (allow-none) (scope notified): function to call with
+ *   the number of rows searched so far and in total, or %NULL
+ * @progress_data: (closure progress_callback) (allow-none): user data for @progress_callback
+ * @progress_data_destroy: (destroy progress_data) (allow-none): a #GDestroyNotify for @progress_data, or %NULL
+ * @callback: (allow-none): a #GAsyncReadyCallback, or %NULL
+ * @user_data: (closure callback): user data for @callback
+ *
+ * Searches the whole buffer for the search regex set with
+ * vte_terminal_search_set_regex(), from the top, collecting all
+ * matches in one pass, for example to highlight them. This doesn't
+ * change the selection.
+ *
+ * When the operation is finished, @callback will be called. You can then call
+ * vte_terminal_search_find_all_finish() to get the result of the operation.
+ *
+ * Since: 0.60
+ */
+void
+vte_terminal_search_find_all_async(VteTerminal *terminal,
+                                   gsize max_matches,
+                                   GCancellable *cancellable,
+                                   GFileProgressCallback progress_callback,
+                                   gpointer progress_data,
+                                   GDestroyNotify progress_data_destroy,
+                                   GAsyncReadyCallback callback,
+                                   gpointer user_data)
+{
+        g_return_if_fail(VTE_IS_TERMINAL(terminal));
+        g_return_if_fail(cancellable == nullptr || G_IS_CANCELLABLE(cancellable));
+        g_return_if_fail(!progress_data_destroy || progress_data);
+
+        IMPL(terminal)->search_async(true, false, max_matches, cancellable,
+                                     progress_callback, progress_data, progress_data_destroy,
+                                     callback, user_data);
+}
+
+/**
+ * vte_terminal_search_find_all_finish:
+ * @terminal: a #VteTerminal
+ * @result: a #GAsyncResult
+ * @ranges: (out) (array length=n_matches) (transfer full): return location
+ *   for the matches
+ * @n_matches: (out): return location for the number of matches
+ * @error: (allow-none): return location for a #GError, or %NULL
+ *
+ * Finishes an operation started with vte_terminal_search_find_all_async().
+ *
+ * Each match takes four elements of @ranges: its start row and column,
+ * and its end row and the column after its end, in the coordinates of
+ * vte_terminal_get_text_range(). Free @ranges with g_free().
+ *
+ * Returns: %TRUE on success, or %FALSE on error with @error filled in
+ *
+ * Since: 0.60
+ */
+gboolean
+vte_terminal_search_find_all_finish(VteTerminal *terminal,
+                                    GAsyncResult *result,
+                                    glong **ranges,
+                                    gsize *n_matches,
+                                    GError **error)
+{
+        g_return_val_if_fail(VTE_IS_TERMINAL(terminal), FALSE);
+        g_return_val_if_fail(g_task_is_valid(result, terminal), FALSE);
+        g_return_val_if_fail(ranges != nullptr, FALSE);
+        g_return_val_if_fail(n_matches != nullptr, FALSE);
+        g_return_val_if_fail(error == nullptr || *error == nullptr, FALSE);
+
+        return IMPL(terminal)->search_find_all_finish(result, ranges, n_matches, error);
+}
+
 /**
  * vte_terminal_search_set_regex:
  * @terminal: a #VteTerminal
@@ -2969,6 +3436,27 @@ vte_terminal_feed(VteTerminal *terminal,
         WIDGET(terminal)->feed({data, len});
 }
 
+/**
+ * vte_terminal_feed_bytes:
+ * @terminal: a #VteTerminal
+ * @bytes: (transfer none): data in the terminal's current encoding
+ *
+ * Like vte_terminal_feed(), but without copying the data. Instead, @terminal
+ * keeps a reference to @bytes until it has processed them, so their contents
+ * must not be changed in the meantime.
+ *
+ * Since: 0.60
+ */
+void
+vte_terminal_feed_bytes(VteTerminal *terminal,
+                        GBytes *bytes)
+{
+        g_return_if_fail(VTE_IS_TERMINAL(terminal));
+        g_return_if_fail(bytes != NULL);
+
+        WIDGET(terminal)->feed(bytes);
+}
+
 /**
  * vte_terminal_feed_child:
  * @terminal: a #VteTerminal
@@ -2993,6 +3481,28 @@ vte_terminal_feed_child(VteTerminal *terminal,
         WIDGET(terminal)->feed_child({text, len});
 }
 
+/**
+ * vte_terminal_get_pending_input_size:
+ * @terminal: a #VteTerminal
+ *
+ * Returns the number of bytes of input for the child, typed or sent with
+ * vte_terminal_feed_child() and the like, that were not written to the
+ * PTY yet, for example because the child doesn't read them. A program
+ * sending much data can check this to not queue more than the child
+ * takes.
+ *
+ * Returns: the number of bytes queued
+ *
+ * Since: 0.60
+ */
+gsize
+vte_terminal_get_pending_input_size(VteTerminal *terminal)
+{
+        g_return_val_if_fail(VTE_IS_TERMINAL(terminal), 0);
+
+        return IMPL(terminal)->pending_input_size();
+}
+
 /**
  * vte_terminal_feed_child_binary:
  * @terminal: a #VteTerminal
@@ -3155,37 +3665,166 @@ vte_terminal_get_text_range(VteTerminal *terminal,
 }
 
 /**
- * vte_terminal_reset:
+ * vte_terminal_get_damage:
  * @terminal: a #VteTerminal
- * @clear_tabstops: whether to reset tabstops
- * @clear_history: whether to empty the terminal's scrollback buffer
+ * @n_spans: (out): location to store the number of spans
  *
- * Resets as much of the terminal's internal state as possible, discarding any
- * unprocessed input data, resetting character attributes, cursor state,
- * national character set state, status line, terminal modes (insert/delete),
- * selection state, and encoding.
+ * Returns the blocks of cells of the screen (the bottom-most rows, which
+ * the terminal's output addresses) that changed since the last call, so
+ * that an embedder mirroring the contents can read just these with
+ * vte_terminal_get_text_range() instead of the whole screen. The spans may
+ * include cells that did not actually change, e.g. under the cursor.
+ *
+ * The first call returns the whole screen, and so does any call after the
+ * screen scrolled, was resized or switched to or from the alternate screen.
  *
+ * Returns: (array length=n_spans) (transfer full) (nullable): a newly
+ *   allocated array of #VteDamageSpan, or %NULL if nothing changed
+ *
+ * Since: 0.60
  */
-void
-vte_terminal_reset(VteTerminal *terminal,
-                   gboolean clear_tabstops,
-                   gboolean clear_history)
+VteDamageSpan *
+vte_terminal_get_damage(VteTerminal *terminal,
+                        gsize *n_spans)
 {
-	g_return_if_fail(VTE_IS_TERMINAL(terminal));
-        IMPL(terminal)->reset(clear_tabstops, clear_history, true);
+        g_return_val_if_fail(n_spans != NULL, NULL);
+        *n_spans = 0;
+	g_return_val_if_fail(VTE_IS_TERMINAL(terminal), NULL);
+
+        return IMPL(terminal)->get_damage(n_spans);
 }
 
 /**
- * vte_terminal_set_size:
+ * vte_terminal_get_frame_stats:
  * @terminal: a #VteTerminal
- * @columns: the desired number of columns
- * @rows: the desired number of rows
+ * @n_frames: (out): location to store the number of frames
  *
- * Attempts to change the terminal's size in terms of rows and columns.  If
- * the attempt succeeds, the widget will resize itself to the proper size.
+ * Returns what the terminal did for each of the last frames it painted,
+ * oldest first, for example to collect performance statistics. Unlike
+ * the debug output, this is always available, and cheap to keep.
+ *
+ * Returns: (array length=n_frames) (transfer full) (nullable): a newly
+ *   allocated array of #VteFrameStats, or %NULL if no frame was painted yet
+ *
+ * Since: 0.60
  */
-void
-vte_terminal_set_size(VteTerminal *terminal,
+VteFrameStats *
+vte_terminal_get_frame_stats(VteTerminal *terminal,
+                             gsize *n_frames)
+{
+        g_return_val_if_fail(n_frames != NULL, NULL);
+        *n_frames = 0;
+	g_return_val_if_fail(VTE_IS_TERMINAL(terminal), NULL);
+
+        return IMPL(terminal)->get_frame_stats(n_frames);
+}
+
+/**
+ * vte_terminal_get_input_latency:
+ * @terminal: a #VteTerminal
+ * @stage: the stage
+ * @latency: (out caller-allocates): location to store the histogram
+ *
+ * Returns a histogram of the times from key presses to the end of @stage:
+ * until the key's input was written to the PTY, the child's output,
+ * normally its echo, was read and processed, and a frame was painted.
+ *
+ * The terminal follows one key press at a time, from the press to its
+ * frame, so keys typed faster than that are not all measured, and drops
+ * a key press that didn't get to its frame within a second, such as
+ * one the child doesn't echo.
+ *
+ * Since: 0.60
+ */
+void
+vte_terminal_get_input_latency(VteTerminal *terminal,
+                               VteInputLatencyStage stage,
+                               VteInputLatency *latency)
+{
+        g_return_if_fail(latency != NULL);
+        *latency = VteInputLatency{};
+	g_return_if_fail(VTE_IS_TERMINAL(terminal));
+        g_return_if_fail(stage >= VTE_INPUT_LATENCY_STAGE_WRITE &&
+                         stage <= VTE_INPUT_LATENCY_STAGE_PRESENT);
+
+        IMPL(terminal)->get_input_latency(stage, latency);
+}
+
+/**
+ * vte_terminal_reset_input_latency:
+ * @terminal: a #VteTerminal
+ *
+ * Clears the histograms of vte_terminal_get_input_latency(), for
+ * example to measure the effect of changing a setting.
+ *
+ * Since: 0.60
+ */
+void
+vte_terminal_reset_input_latency(VteTerminal *terminal)
+{
+	g_return_if_fail(VTE_IS_TERMINAL(terminal));
+
+        IMPL(terminal)->m_input_latency.reset();
+}
+
+/**
+ * vte_terminal_get_memory_stats:
+ * @terminal: a #VteTerminal
+ * @stats: (out caller-allocates): location to store the statistics
+ *
+ * Returns what @terminal uses of the memory, and of the disk for the
+ * scrollback, so that applications with many terminals can show what
+ * each of them uses and keep them within a budget, see also
+ * vte_terminal_set_scrollback_bytes().
+ *
+ * The sizes are those of the terminal's data, not counting the overhead
+ * of the allocator.
+ *
+ * Since: 0.60
+ */
+void
+vte_terminal_get_memory_stats(VteTerminal *terminal,
+                              VteMemoryStats *stats)
+{
+        g_return_if_fail(stats != NULL);
+        *stats = VteMemoryStats{};
+	g_return_if_fail(VTE_IS_TERMINAL(terminal));
+
+        IMPL(terminal)->get_memory_stats(stats);
+}
+
+/**
+ * vte_terminal_reset:
+ * @terminal: a #VteTerminal
+ * @clear_tabstops: whether to reset tabstops
+ * @clear_history: whether to empty the terminal's scrollback buffer
+ *
+ * Resets as much of the terminal's internal state as possible, discarding any
+ * unprocessed input data, resetting character attributes, cursor state,
+ * national character set state, status line, terminal modes (insert/delete),
+ * selection state, and encoding.
+ *
+ */
+void
+vte_terminal_reset(VteTerminal *terminal,
+                   gboolean clear_tabstops,
+                   gboolean clear_history)
+{
+	g_return_if_fail(VTE_IS_TERMINAL(terminal));
+        IMPL(terminal)->reset(clear_tabstops, clear_history, true);
+}
+
+/**
+ * vte_terminal_set_size:
+ * @terminal: a #VteTerminal
+ * @columns: the desired number of columns
+ * @rows: the desired number of rows
+ *
+ * Attempts to change the terminal's size in terms of rows and columns.  If
+ * the attempt succeeds, the widget will resize itself to the proper size.
+ */
+void
+vte_terminal_set_size(VteTerminal *terminal,
                       long columns,
                       long rows)
 {
@@ -3901,6 +4540,89 @@ vte_terminal_set_enable_shaping(VteTerminal *terminal,
                 g_object_notify_by_pspec(G_OBJECT(terminal), pspecs[PROP_ENABLE_SHAPING]);
 }
 
+/**
+ * vte_terminal_get_enable_io_thread:
+ * @terminal: a #VteTerminal
+ *
+ * Checks whether the terminal reads from its PTY on a separate thread.
+ *
+ * Returns: %TRUE if the I/O thread is enabled, %FALSE if not
+ *
+ * Since: 0.60
+ */
+gboolean
+vte_terminal_get_enable_io_thread(VteTerminal *terminal)
+{
+        g_return_val_if_fail(VTE_IS_TERMINAL(terminal), FALSE);
+        return IMPL(terminal)->m_enable_io_thread;
+}
+
+/**
+ * vte_terminal_set_enable_io_thread:
+ * @terminal: a #VteTerminal
+ * @enable_io_thread: %TRUE to read from the PTY on a separate thread
+ *
+ * Controls whether the terminal reads from its PTY on a separate thread,
+ * so that the child can keep writing while the main thread is busy
+ * painting. Only the reading moves to the thread; processing of the
+ * data still happens on the main thread.
+ *
+ * Since: 0.60
+ */
+void
+vte_terminal_set_enable_io_thread(VteTerminal *terminal,
+                                 gboolean enable_io_thread)
+{
+        g_return_if_fail(VTE_IS_TERMINAL(terminal));
+
+        if (IMPL(terminal)->set_enable_io_thread(enable_io_thread != FALSE))
+                g_object_notify_by_pspec(G_OBJECT(terminal), pspecs[PROP_ENABLE_IO_THREAD]);
+}
+
+/**
+ * vte_terminal_get_headless:
+ * @terminal: a #VteTerminal
+ *
+ * Returns whether the terminal is in headless mode.
+ *
+ * Returns: %TRUE if the terminal is headless
+ *
+ * Since: 0.60
+ */
+gboolean
+vte_terminal_get_headless(VteTerminal *terminal)
+{
+        g_return_val_if_fail(VTE_IS_TERMINAL(terminal), FALSE);
+        return IMPL(terminal)->m_headless;
+}
+
+/**
+ * vte_terminal_set_headless:
+ * @terminal: a #VteTerminal
+ * @headless: whether to make the terminal headless
+ *
+ * Puts the terminal into headless mode, or takes it out of it again.
+ * A headless terminal is never drawn: it does no redraw bookkeeping, does
+ * not update its adjustments, and does not blink the cursor. Data passed
+ * to vte_terminal_feed() is processed immediately instead of from the main
+ * loop, so the emulation can be run over recorded output at full speed and
+ * its results read back with vte_terminal_get_text_range().
+ *
+ * A realized terminal cannot be made headless, and realizing a headless
+ * terminal takes it out of headless mode.
+ *
+ * Since: 0.60
+ */
+void
+vte_terminal_set_headless(VteTerminal *terminal,
+                          gboolean headless)
+{
+        g_return_if_fail(VTE_IS_TERMINAL(terminal));
+
+        if (IMPL(terminal)->set_headless(headless != FALSE))
+                g_object_notify_by_pspec(G_OBJECT(terminal), pspecs[PROP_HEADLESS]);
+}
+
 /**
  * vte_terminal_get_encoding:
  * @terminal: a #VteTerminal
@@ -4262,6 +4984,85 @@ vte_terminal_set_input_enabled (VteTerminal *terminal,
                 g_object_notify_by_pspec(G_OBJECT(terminal), pspecs[PROP_INPUT_ENABLED]);
 }
 
+/**
+ * vte_terminal_get_input_queue_limit:
+ * @terminal: a #VteTerminal
+ *
+ * Returns: the number of bytes of unprocessed data from the child
+ *   above which the terminal stops reading from its PTY, or 0 for no limit
+ *
+ * Since: 0.60
+ */
+guint
+vte_terminal_get_input_queue_limit(VteTerminal *terminal)
+{
+        g_return_val_if_fail(VTE_IS_TERMINAL(terminal), 0);
+        return IMPL(terminal)->m_input_queue_limit;
+}
+
+/**
+ * vte_terminal_set_input_queue_limit:
+ * @terminal: a #VteTerminal
+ * @limit: the limit in bytes, or 0 for no limit
+ *
+ * Sets how many bytes of data read from the child may be queued up
+ * for processing. Above this, the terminal stops reading from its PTY
+ * until the queue has been processed down to half the limit, so that
+ * a child writing faster than the terminal can keep up blocks in the
+ * kernel instead of the terminal buffering its output.
+ *
+ * Since: 0.60
+ */
+void
+vte_terminal_set_input_queue_limit(VteTerminal *terminal,
+                                   guint limit)
+{
+        g_return_if_fail(VTE_IS_TERMINAL(terminal));
+
+        if (IMPL(terminal)->set_input_queue_limit(limit))
+                g_object_notify_by_pspec(G_OBJECT(terminal), pspecs[PROP_INPUT_QUEUE_LIMIT]);
+}
+
+/**
+ * vte_terminal_get_resize_delay:
+ * @terminal: a #VteTerminal
+ *
+ * Returns: the time in milliseconds a resize waits for further resizes,
+ *   see vte_terminal_set_resize_delay()
+ *
+ * Since: 0.60
+ */
+guint
+vte_terminal_get_resize_delay(VteTerminal *terminal)
+{
+        g_return_val_if_fail(VTE_IS_TERMINAL(terminal), 0);
+        return IMPL(terminal)->m_resize_delay;
+}
+
+/**
+ * vte_terminal_set_resize_delay:
+ * @terminal: a #VteTerminal
+ * @delay: the delay in milliseconds, or 0 to apply each size immediately
+ *
+ * Sets how long a change of the terminal's size waits for further changes.
+ * The first size change is applied right away, but while the size keeps
+ * changing within @delay of the last change, such as while the user drags
+ * the window's edge, the contents are just clipped or padded to the widget,
+ * and only the final size is applied, rewrapping the contents and
+ * resizing the PTY, once no change came for @delay.
+ *
+ * Since: 0.60
+ */
+void
+vte_terminal_set_resize_delay(VteTerminal *terminal,
+                              guint delay)
+{
+        g_return_if_fail(VTE_IS_TERMINAL(terminal));
+
+        if (IMPL(terminal)->set_resize_delay(delay))
+                g_object_notify_by_pspec(G_OBJECT(terminal), pspecs[PROP_RESIZE_DELAY]);
+}
+
 /**
  * vte_terminal_get_mouse_autohide:
  * @terminal: a #VteTerminal
@@ -4436,6 +5237,48 @@ vte_terminal_get_scrollback_lines(VteTerminal *terminal)
         return IMPL(terminal)->m_scrollback_lines;
 }
 
+/**
+ * vte_terminal_set_scrollback_bytes:
+ * @terminal: a #VteTerminal
+ * @bytes: the maximum size of the history buffer, or 0
+ *
+ * Limits the scrollback buffer by the space it takes, in addition to
+ * the number of lines set with vte_terminal_set_scrollback_lines(). The
+ * history is stored compressed, and the limit applies to the compressed
+ * size, so the number of lines it holds depends on the contents.
+ *
+ * When the limit is exceeded, the oldest lines are discarded. A value of 0
+ * means no limit.
+ *
+ * See also vte_set_scrollback_budget() for a limit on all terminals.
+ *
+ * Since: 0.60
+ */
+void
+vte_terminal_set_scrollback_bytes(VteTerminal *terminal,
+                                  guint64 bytes)
+{
+        g_return_if_fail(VTE_IS_TERMINAL(terminal));
+
+        if (IMPL(terminal)->set_scrollback_bytes(MIN(bytes, G_MAXSIZE)))
+                g_object_notify_by_pspec(G_OBJECT(terminal), pspecs[PROP_SCROLLBACK_BYTES]);
+}
+
+/**
+ * vte_terminal_get_scrollback_bytes:
+ * @terminal: a #VteTerminal
+ *
+ * Returns: the maximum size of the scrollback buffer, or 0 for no limit
+ *
+ * Since: 0.60
+ */
+guint64
+vte_terminal_get_scrollback_bytes(VteTerminal *terminal)
+{
+        g_return_val_if_fail(VTE_IS_TERMINAL(terminal), 0);
+        return IMPL(terminal)->m_normal_screen.row_data->max_bytes();
+}
+
 /**
  * vte_terminal_set_scroll_on_keystroke:
  * @terminal: a #VteTerminal
@@ -4604,6 +5447,431 @@ vte_terminal_write_contents_sync (VteTerminal *terminal,
         return IMPL(terminal)->write_contents_sync(stream, flags, cancellable, error);
 }
 
+/**
+ * vte_terminal_write_contents_async:
+ * @terminal: a #VteTerminal
+ * @stream: a #GOutputStream to write to
+ * @flags: a set of #VteWriteFlags
+ * @cancellable: (allow-none): a #GCancellable object, or %NULL
+ * @progress_callback: (allow-none) (scope notified): function to call with
+ *   the number of bytes written so far and in total, or %NULL
+ * @progress_data: (closure progress_callback) (allow-none): user data for @progress_callback
+ * @progress_data_destroy: (destroy progress_data) (allow-none): a #GDestroyNotify for @progress_data, or %NULL
+ * @callback: (allow-none): a #GAsyncReadyCallback, or %NULL
+ * @user_data: (closure callback): user data for @callback
+ *
+ * Like vte_terminal_write_contents_sync(), but without blocking the widget while
+ * the contents are written. The contents are those at the time of this call;
+ * what the terminal receives in the meantime is not included.
+ *
+ * When the operation is finished, @callback will be called. You can then call
+ * vte_terminal_write_contents_finish() to get the result of the operation.
+ *
+ * Since: 0.60
+ */
+void
+vte_terminal_write_contents_async(VteTerminal *terminal,
+                                  GOutputStream *stream,
+                                  VteWriteFlags flags,
+                                  GCancellable *cancellable,
+                                  GFileProgressCallback progress_callback,
+                                  gpointer progress_data,
+                                  GDestroyNotify progress_data_destroy,
+                                  GAsyncReadyCallback callback,
+                                  gpointer user_data)
+{
+        g_return_if_fail(VTE_IS_TERMINAL(terminal));
+        g_return_if_fail(G_IS_OUTPUT_STREAM(stream));
+        g_return_if_fail(cancellable == nullptr || G_IS_CANCELLABLE(cancellable));
+        g_return_if_fail(!progress_data_destroy || progress_data);
+
+        IMPL(terminal)->write_contents_async(stream, flags, cancellable,
+                                             progress_callback, progress_data, progress_data_destroy,
+                                             callback, user_data);
+}
+
+/**
+ * vte_terminal_write_contents_finish:
+ * @terminal: a #VteTerminal
+ * @result: a #GAsyncResult
+ * @error: (allow-none): return location for a #GError, or %NULL
+ *
+ * Finishes an operation started with vte_terminal_write_contents_async().
+ *
+ * Returns: %TRUE on success, or %FALSE on error with @error filled in
+ *
+ * Since: 0.60
+ */
+gboolean
+vte_terminal_write_contents_finish(VteTerminal *terminal,
+                                   GAsyncResult *result,
+                                   GError **error)
+{
+        g_return_val_if_fail(VTE_IS_TERMINAL(terminal), FALSE);
+        g_return_val_if_fail(g_task_is_valid(result, terminal), FALSE);
+        g_return_val_if_fail(error == nullptr || *error == nullptr, FALSE);
+
+        return g_task_propagate_boolean(G_TASK(result), error);
+}
+
+/**
+ * vte_terminal_write_text_range_async:
+ * @terminal: a #VteTerminal
+ * @start_row: first row of the range
+ * @start_col: first column of the range
+ * @end_row: last row of the range
+ * @end_col: last column of the range
+ * @format: the #VteFormat to write the text in
+ * @stream: a #GOutputStream to write to
+ * @cancellable: (allow-none): a #GCancellable object, or %NULL
+ * @callback: (allow-none): a #GAsyncReadyCallback, or %NULL
+ * @user_data: (closure callback): user data for @callback
+ *
+ * Writes the text that vte_terminal_get_text_range() returns for the range
+ * to @stream, in plain text, or for %VTE_FORMAT_HTML as HTML with the
+ * attributes of the text, like vte_terminal_copy_clipboard_format() puts on
+ * the clipboard. The text is read and written a chunk at a time, so it is
+ * never in memory as a whole, and without blocking the widget; a consumer
+ * of @stream can process it as it arrives.
+ *
+ * The range is limited to the rows the terminal has at the time of this
+ * call. The rows are read as they are written, so they can include what
+ * the terminal receives in the meantime.
+ *
+ * When the operation is finished, @callback will be called. You can then call
+ * vte_terminal_write_text_range_finish() to get the result of the operation.
+ *
+ * Since: 0.60
+ */
+void
+vte_terminal_write_text_range_async(VteTerminal *terminal,
+                                    long start_row,
+                                    long start_col,
+                                    long end_row,
+                                    long end_col,
+                                    VteFormat format,
+                                    GOutputStream *stream,
+                                    GCancellable *cancellable,
+                                    GAsyncReadyCallback callback,
+                                    gpointer user_data)
+{
+        g_return_if_fail(VTE_IS_TERMINAL(terminal));
+        g_return_if_fail(format == VTE_FORMAT_TEXT || format == VTE_FORMAT_HTML);
+        g_return_if_fail(G_IS_OUTPUT_STREAM(stream));
+        g_return_if_fail(cancellable == nullptr || G_IS_CANCELLABLE(cancellable));
+
+        IMPL(terminal)->write_text_range_async(start_row, start_col,
+                                               end_row, end_col,
+                                               format, stream, cancellable,
+                                               callback, user_data);
+}
+
+/**
+ * vte_terminal_write_text_range_finish:
+ * @terminal: a #VteTerminal
+ * @result: a #GAsyncResult
+ * @error: (allow-none): return location for a #GError, or %NULL
+ *
+ * Finishes an operation started with vte_terminal_write_text_range_async().
+ *
+ * Returns: %TRUE on success, or %FALSE on error with @error filled in
+ *
+ * Since: 0.60
+ */
+gboolean
+vte_terminal_write_text_range_finish(VteTerminal *terminal,
+                                     GAsyncResult *result,
+                                     GError **error)
+{
+        g_return_val_if_fail(VTE_IS_TERMINAL(terminal), FALSE);
+        g_return_val_if_fail(g_task_is_valid(result, terminal), FALSE);
+        g_return_val_if_fail(error == nullptr || *error == nullptr, FALSE);
+
+        return g_task_propagate_boolean(G_TASK(result), error);
+}
+
+/**
+ * vte_terminal_save_scrollback:
+ * @terminal: a #VteTerminal
+ * @stream: a #GOutputStream to write to
+ * @cancellable: (allow-none): a #GCancellable object, or %NULL
+ * @error: (allow-none): return location for a #GError, or %NULL
+ *
+ * Writes the contents of the normal screen, including the scrollback, to
+ * @stream, with their attributes and the cursor position, so that
+ * vte_terminal_restore_scrollback() can bring them back in a later session.
+ *
+ * The data is written in a compact binary format that is only meant to be
+ * read back by the same version of VTE on the same machine. Note that the
+ * scrollback is kept encrypted in memory and on disk, but this data is not.
+ *
+ * This is a synchronous operation and will make the widget (and input
+ * processing) stop for the duration.
+ *
+ * Returns: %TRUE on success, %FALSE if there was an error
+ *
+ * Since: 0.60
+ */
+gboolean
+vte_terminal_save_scrollback(VteTerminal *terminal,
+                             GOutputStream *stream,
+                             GCancellable *cancellable,
+                             GError **error)
+{
+        g_return_val_if_fail(VTE_IS_TERMINAL(terminal), FALSE);
+        g_return_val_if_fail(G_IS_OUTPUT_STREAM(stream), FALSE);
+        g_return_val_if_fail(cancellable == nullptr || G_IS_CANCELLABLE(cancellable), FALSE);
+        g_return_val_if_fail(error == nullptr || *error == nullptr, FALSE);
+
+        return IMPL(terminal)->save_scrollback(stream, cancellable, error);
+}
+
+/**
+ * vte_terminal_restore_scrollback:
+ * @terminal: a #VteTerminal
+ * @stream: a #GInputStream to read from
+ * @cancellable: (allow-none): a #GCancellable object, or %NULL
+ * @error: (allow-none): return location for a #GError, or %NULL
+ *
+ * Replaces the contents of the normal screen, including the scrollback,
+ * with what vte_terminal_save_scrollback() wrote to @stream, and moves the
+ * cursor to where it was saved. The contents are rewrapped if the number
+ * of columns changed in between.
+ *
+ * On error, the contents of @terminal are left unchanged.
+ *
+ * Returns: %TRUE on success, %FALSE if there was an error
+ *
+ * Since: 0.60
+ */
+gboolean
+vte_terminal_restore_scrollback(VteTerminal *terminal,
+                                GInputStream *stream,
+                                GCancellable *cancellable,
+                                GError **error)
+{
+        g_return_val_if_fail(VTE_IS_TERMINAL(terminal), FALSE);
+        g_return_val_if_fail(G_IS_INPUT_STREAM(stream), FALSE);
+        g_return_val_if_fail(cancellable == nullptr || G_IS_CANCELLABLE(cancellable), FALSE);
+        g_return_val_if_fail(error == nullptr || *error == nullptr, FALSE);
+
+        return IMPL(terminal)->restore_scrollback(stream, cancellable, error);
+}
+
+/**
+ * vte_terminal_save_state:
+ * @terminal: a #VteTerminal
+ * @stream: a #GOutputStream to write to
+ * @flags: a set of #VteStateFlags
+ * @cancellable: (allow-none): a #GCancellable object, or %NULL
+ * @error: (allow-none): return location for a #GError, or %NULL
+ *
+ * Writes the state of the terminal emulation to @stream, so that
+ * vte_terminal_restore_state() can move it to another terminal: the
+ * contents of both screens with their cursors and saved cursors, the
+ * scrollback unless @flags has %VTE_STATE_NO_SCROLLBACK, the modes, the
+ * tabstops, the character sets, the colors set by escape sequences, the
+ * hyperlinks, and the window title and current directory and file.
+ *
+ * The PTY and the settings made through the API are not part of the state.
+ * Like vte_terminal_save_scrollback(), the data is only meant to be read
+ * back by the same version of VTE on the same machine, and is not
+ * encrypted.
+ *
+ * This is a synchronous operation and will make the widget (and input
+ * processing) stop for the duration.
+ *
+ * Returns: %TRUE on success, %FALSE if there was an error
+ *
+ * Since: 0.60
+ */
+gboolean
+vte_terminal_save_state(VteTerminal *terminal,
+                        GOutputStream *stream,
+                        VteStateFlags flags,
+                        GCancellable *cancellable,
+                        GError **error)
+{
+        g_return_val_if_fail(VTE_IS_TERMINAL(terminal), FALSE);
+        g_return_val_if_fail(G_IS_OUTPUT_STREAM(stream), FALSE);
+        g_return_val_if_fail(cancellable == nullptr || G_IS_CANCELLABLE(cancellable), FALSE);
+        g_return_val_if_fail(error == nullptr || *error == nullptr, FALSE);
+
+        return IMPL(terminal)->save_state(stream, flags, cancellable, error);
+}
+
+/**
+ * vte_terminal_restore_state:
+ * @terminal: a #VteTerminal
+ * @stream: a #GInputStream to read from
+ * @cancellable: (allow-none): a #GCancellable object, or %NULL
+ * @error: (allow-none): return location for a #GError, or %NULL
+ *
+ * Replaces the state of the terminal emulation with what
+ * vte_terminal_save_state() wrote to @stream. The normal screen is
+ * rewrapped if the number of columns changed in between.
+ *
+ * On error, @terminal is normally left unchanged; if the data was found
+ * invalid only after the contents were replaced, @terminal is reset.
+ *
+ * Returns: %TRUE on success, %FALSE if there was an error
+ *
+ * Since: 0.60
+ */
+gboolean
+vte_terminal_restore_state(VteTerminal *terminal,
+                           GInputStream *stream,
+                           GCancellable *cancellable,
+                           GError **error)
+{
+        g_return_val_if_fail(VTE_IS_TERMINAL(terminal), FALSE);
+        g_return_val_if_fail(G_IS_INPUT_STREAM(stream), FALSE);
+        g_return_val_if_fail(cancellable == nullptr || G_IS_CANCELLABLE(cancellable), FALSE);
+        g_return_val_if_fail(error == nullptr || *error == nullptr, FALSE);
+
+        return IMPL(terminal)->restore_state(stream, cancellable, error);
+}
+
+/**
+ * vte_terminal_add_mark:
+ * @terminal: a #VteTerminal
+ * @column: the column of the cell to mark
+ * @row: the absolute row of the cell to mark
+ *
+ * Marks a cell of the normal screen, for example where a prompt starts.
+ * The mark stays with the cell's text when the terminal is resized and the
+ * text rewraps, so vte_terminal_get_mark() finds the cell's new position.
+ * Remove the mark with vte_terminal_remove_mark() when it's no longer needed.
+ *
+ * Like vte_terminal_get_cursor_position(), this is unaware of BiDi. The
+ * column is a logical column.
+ *
+ * Returns: the mark, which is never 0
+ *
+ * Since: 0.60
+ */
+guint
+vte_terminal_add_mark(VteTerminal *terminal,
+                      long column,
+                      long row)
+{
+        g_return_val_if_fail(VTE_IS_TERMINAL(terminal), 0);
+        g_return_val_if_fail(column >= 0, 0);
+
+        return IMPL(terminal)->add_mark(column, row);
+}
+
+/**
+ * vte_terminal_get_mark:
+ * @terminal: a #VteTerminal
+ * @mark: a mark from vte_terminal_add_mark()
+ * @column: (out) (allow-none): a location to store the column, or %NULL
+ * @row: (out) (allow-none): a location to store the absolute row, or %NULL
+ *
+ * Reads the current position of the cell marked with @mark.
+ *
+ * Returns: %TRUE if the mark is still there, %FALSE if it was removed or its
+ *   row was scrolled out of the scrollback, or cleared with it
+ *
+ * Since: 0.60
+ */
+gboolean
+vte_terminal_get_mark(VteTerminal *terminal,
+                      guint mark,
+                      long *column,
+                      long *row)
+{
+        g_return_val_if_fail(VTE_IS_TERMINAL(terminal), FALSE);
+
+        return IMPL(terminal)->get_mark(mark, column, row);
+}
+
+/**
+ * vte_terminal_remove_mark:
+ * @terminal: a #VteTerminal
+ * @mark: a mark from vte_terminal_add_mark()
+ *
+ * Removes @mark. It is fine to remove a mark that is no longer there.
+ *
+ * Since: 0.60
+ */
+void
+vte_terminal_remove_mark(VteTerminal *terminal,
+                         guint mark)
+{
+        g_return_if_fail(VTE_IS_TERMINAL(terminal));
+
+        IMPL(terminal)->remove_mark(mark);
+}
+
+/**
+ * vte_terminal_find_shell_mark:
+ * @terminal: a #VteTerminal
+ * @kind: the #VteShellMark to find
+ * @row: the row to start at
+ * @backward: whether to find the nearest mark above @row, rather than below it
+ * @column: (out) (allow-none): a location to store the column of the mark, or %NULL
+ * @mark_row: (out) (allow-none): a location to store the row of the mark, or %NULL
+ *
+ * Finds the nearest mark of @kind that the shell set with OSC 133 on the
+ * normal screen, not on @row itself, e.g. to jump to the previous or next
+ * prompt. The rows count from the top of the scrollback, as the adjustment
+ * does.
+ *
+ * Returns: %TRUE if there is such a mark
+ *
+ * Since: 0.60
+ */
+gboolean
+vte_terminal_find_shell_mark(VteTerminal *terminal,
+                             VteShellMark kind,
+                             long row,
+                             gboolean backward,
+                             long *column,
+                             long *mark_row)
+{
+        g_return_val_if_fail(VTE_IS_TERMINAL(terminal), FALSE);
+        g_return_val_if_fail(kind >= VTE_SHELL_MARK_PROMPT && kind <= VTE_SHELL_MARK_END, FALSE);
+
+        return IMPL(terminal)->find_shell_mark(kind, row, backward != FALSE, column, mark_row);
+}
+
+/**
+ * vte_terminal_get_command_output:
+ * @terminal: a #VteTerminal
+ * @row: a row of the output of the command
+ * @start_row: (out) (allow-none): a location to store the first row of the output, or %NULL
+ * @start_col: (out) (allow-none): a location to store the first column of the output, or %NULL
+ * @end_row: (out) (allow-none): a location to store the last row of the output, or %NULL
+ * @end_col: (out) (allow-none): a location to store the column after the output, or %NULL
+ * @exit_status: (out) (allow-none): a location to store the exit status of the command, or %NULL
+ *
+ * Finds the output of the command around @row, from the last
+ * %VTE_SHELL_MARK_OUTPUT mark at or above it to the mark after that, or to
+ * the cursor while the command is still running. The range suits
+ * vte_terminal_get_text_range() and vte_terminal_write_text_range_async().
+ * The exit status is the one the shell sent with %VTE_SHELL_MARK_END, or -1
+ * if it didn't send one.
+ *
+ * Returns: %TRUE if there is such a command
+ *
+ * Since: 0.60
+ */
+gboolean
+vte_terminal_get_command_output(VteTerminal *terminal,
+                                long row,
+                                long *start_row,
+                                long *start_col,
+                                long *end_row,
+                                long *end_col,
+                                int *exit_status)
+{
+        g_return_val_if_fail(VTE_IS_TERMINAL(terminal), FALSE);
+
+        return IMPL(terminal)->get_command_output(row, start_row, start_col,
+                                                  end_row, end_col, exit_status);
+}
+
 /**
  * vte_terminal_set_clear_background:
  * @terminal: a #VteTerminal
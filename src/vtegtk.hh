@@ -31,6 +31,7 @@ enum {
         SIGNAL_CHILD_EXITED,
         SIGNAL_COMMIT,
         SIGNAL_CONTENTS_CHANGED,
+        SIGNAL_CONTENTS_UPDATED,
         SIGNAL_COPY_CLIPBOARD,
         SIGNAL_CURRENT_DIRECTORY_URI_CHANGED,
         SIGNAL_CURRENT_FILE_URI_CHANGED,
@@ -47,6 +48,7 @@ enum {
         SIGNAL_MAXIMIZE_WINDOW,
         SIGNAL_MOVE_WINDOW,
         SIGNAL_PASTE_CLIPBOARD,
+        SIGNAL_PASTE_PROGRESS,
         SIGNAL_RAISE_WINDOW,
         SIGNAL_REFRESH_WINDOW,
         SIGNAL_RESIZE_WINDOW,
@@ -78,15 +80,20 @@ enum {
         PROP_DELETE_BINDING,
         PROP_ENABLE_BIDI,
         PROP_ENABLE_SHAPING,
+        PROP_ENABLE_IO_THREAD,
         PROP_ENCODING,
         PROP_FONT_DESC,
         PROP_FONT_SCALE,
+        PROP_HEADLESS,
         PROP_HYPERLINK_HOVER_URI,
         PROP_ICON_TITLE,
         PROP_INPUT_ENABLED,
+        PROP_INPUT_QUEUE_LIMIT,
         PROP_MOUSE_POINTER_AUTOHIDE,
         PROP_PTY,
+        PROP_RESIZE_DELAY,
         PROP_REWRAP_ON_RESIZE,
+        PROP_SCROLLBACK_BYTES,
         PROP_SCROLLBACK_LINES,
         PROP_SCROLL_ON_KEYSTROKE,
         PROP_SCROLL_ON_OUTPUT,
@@ -56,8 +56,20 @@
 
 #include "chunk.hh"
 #include "pty.hh"
+#include "pty-reader.hh"
+#include "scheduler.hh"
+#include "sgr-cache.hh"
+#include "sixel.hh"
+#include "damage.hh"
+#include "rowchecksums.hh"
+#include "framestats.hh"
+#include "image.hh"
+#include "latency.hh"
+#include "outgoing-queue.hh"
+#include "paste.hh"
 #include "utf8.hh"
 
+#include <bitset>
 #include <list>
 #include <queue>
 #include <optional>
@@ -130,6 +142,7 @@ public:
                 bool origin_mode;
                 VteCell defaults;
                 VteCell color_defaults;
+                vte::base::Ring::hyperlink_idx_t hyperlink_idx;
                 VteCharacterReplacement character_replacements[2];
                 VteCharacterReplacement *character_replacement;
         } saved;
@@ -256,6 +269,47 @@ class Widget;
 
 namespace terminal {
 
+/*
+ * TextSink:
+ *
+ * Receives the text Terminal::get_text() walks. Sinks that don't ask for
+ * attributes get each row in one piece; the others get it in runs of
+ * cells with equal attributes, or character by character.
+ */
+class TextSink {
+public:
+        enum class Attributes {
+                eNone,   /* only the text */
+                eRuns,   /* the cell attributes of each run of equal ones */
+                eChars,  /* the VteCharAttributes of each character */
+        };
+
+        TextSink(Attributes attributes = Attributes::eNone) noexcept
+                : m_attributes{attributes}
+        {
+        }
+
+        virtual ~TextSink() = default;
+
+        inline constexpr Attributes attributes() const noexcept { return m_attributes; }
+
+        /* append:
+         * @text: the text
+         * @len: the length of @text in bytes
+         * @attr: the attributes of the cells of @text, or %nullptr for
+         *   a newline, and for eNone
+         * @chattr: for eChars, the attributes of the character of @text;
+         *   for eRuns, just its position
+         */
+        virtual void append(char const* text,
+                            size_t len,
+                            VteCellAttr const* attr,
+                            VteCharAttributes const& chattr) = 0;
+
+private:
+        Attributes m_attributes;
+};
+
 class Terminal {
         friend class vte::platform::Widget;
 
@@ -357,6 +411,7 @@ public:
         vte::terminal::Tabstops m_tabstops{};
 
         vte::parser::Parser m_parser; /* control sequence state machine */
+        std::string m_osc_string; /* scratch buffer for the UTF-8 OSC argument */
 
         vte::terminal::modes::ECMA m_modes_ecma{};
         vte::terminal::modes::Private m_modes_private{};
@@ -371,6 +426,12 @@ public:
         guint m_pty_input_source{0};
         guint m_pty_output_source{0};
         bool m_pty_input_active{false};
+
+        /* If non-nullptr, PTY input is read on a separate thread, and
+         * m_pty_input_source watches the reader's notification fd.
+         */
+        std::unique_ptr<vte::base::PtyReader> m_pty_reader{};
+        bool m_enable_io_thread{false};
         pid_t m_pty_pid{-1};           /* pid of child process */
         int m_child_exit_status{-1};   /* pid's exit status, or -1 */
         bool m_eos_pending{false};
@@ -406,17 +467,101 @@ public:
          * add allocation origin and padding when passing to gtk.
          */
         GArray *m_update_rects;
+        /* Rows changed while processing, turned into update rects
+         * by flush_damage(). */
+        vte::base::Damage m_damage;
+        /* Rows changed since the last vte_terminal_get_damage(), in
+         * the rows of m_query_damage_screen from its insert_delta,
+         * recorded once that was called for the first time. */
+        vte::base::Damage m_query_damage;
+        VteScreen* m_query_damage_screen{nullptr};
+        bool m_query_damage_enabled{false};
+        bool m_query_damage_all{true};
+        /* Rows changed since the accessible last read them, in its
+         * view of the displayed rows of m_a11y_damage_screen. */
+        vte::base::Damage m_a11y_damage;
+        VteScreen* m_a11y_damage_screen{nullptr};
+        bool m_a11y_damage_enabled{false};
+        bool m_a11y_damage_all{true};
+#ifdef VTE_DEBUG
+        /* The checksums of the rows DECRQCRA asked for, see checksum_area() */
+        vte::base::RowChecksums m_row_checksums;
+        VteScreen* m_row_checksums_screen{nullptr};
+#endif
         bool m_invalidated_all{false};       /* pending refresh of entire terminal */
-        /* If non-nullptr, contains the GList element for @this in g_active_terminals
-         * and means that this terminal is processing data.
-         */
-        GList *m_active_terminals_link;
+        /* The pixels of the last painted frame, kept so that scrolling
+         * only shifts them; see widget_draw(). m_frame_damage has the
+         * rows changed since then, as inclusive ranges. */
+        cairo_surface_t* m_frame_surface{nullptr};
+        cairo_surface_t* m_frame_back_surface{nullptr};
+        bool m_frame_valid{false};
+        VteScreen* m_frame_screen{nullptr};
+        int m_frame_width{0};
+        int m_frame_height{0};
+        int m_frame_scale{0};
+        long m_frame_scroll_offset{0};       /* of the rows from the top, in pixels */
+        bool m_frame_text_blink_state{true};
+        std::vector<std::pair<vte::grid::row_t, vte::grid::row_t>> m_frame_damage{};
+        /* How each displayed row in the frame looks, from m_frame_keys_first_row:
+         * its row_draw_key(), and the visual columns with blinking text */
+        struct FrameRow {
+                uint64_t key{0};
+                vte::grid::column_t blink_start{0};
+                vte::grid::column_t blink_end{0}; /* exclusive */
+        };
+        std::vector<FrameRow> m_frame_rows{};
+        vte::grid::row_t m_frame_keys_first_row{0};
+        /* The frame of the screen last switched away from, kept for
+         * switching back to it, see frame_switch_screen() */
+        cairo_surface_t* m_frame_saved_surface{nullptr};
+        VteScreen* m_frame_saved_screen{nullptr}; /* or nullptr if it's no good */
+        uint64_t m_frame_saved_look{0};           /* the frame_look_key() it was kept with */
+        long m_frame_saved_scroll_offset{0};
+        bool m_frame_saved_text_blink_state{true};
+        bool m_frame_saved_text_to_blink{false};
+        std::vector<FrameRow> m_frame_saved_rows{};
+        vte::grid::row_t m_frame_saved_keys_first_row{0};
+        /* If scheduled, @this is in g_active_terminals and is processing data */
+        vte::base::Scheduler<Terminal>::Entry m_scheduler_entry{this};
+        int64_t m_last_input_time{0};   /* when the user last sent input, µs */
+        bool m_low_latency{false};      /* the child's echo is processed right away, see process_echo() */
         // FIXMEchpe should these two be g[s]size ?
         size_t m_input_bytes;
         long m_max_input_bytes{VTE_MAX_INPUT_READ};
+        unsigned int m_pty_read_batch{1}; /* number of chunks to read into per readv() */
+        size_t m_queued_bytes{0};         /* bytes in m_incoming_queue */
+        unsigned int m_input_queue_limit{VTE_DEFAULT_INPUT_QUEUE_LIMIT}; /* high-water mark; 0 for none */
+        bool m_input_throttled{false};    /* PTY reads paused above the high-water mark */
+        bool m_headless{false};           /* never drawn; feed() processes synchronously */
+        bool m_background{false};         /* unmapped; nothing is drawn until it's mapped again */
+        int64_t m_background_contents_changed_time{0}; /* µs */
+        size_t m_pty_read_syscalls{0};    /* for VTE_DEBUG_IO statistics */
+        size_t m_pty_read_bytes{0};
+
+        /* While the widget is mapped, processing and updates are driven
+         * from a tick callback on the widget's frame clock instead of the
+         * global timeouts; the time left of each refresh interval after
+         * painting is the processing budget.
+         */
+        guint m_tick_callback_id{0};
+        int64_t m_paint_time{0};        /* running average of paint duration, µs */
+
+        /* Always kept, for vte_terminal_get_frame_stats() */
+        vte::base::FrameStats m_frame_stats{};
+        uint64_t m_frame_stats_rows_frozen{0};  /* the rings' counts at the last frame */
+        uint64_t m_frame_stats_rows_thawed{0};
+
+        vte::base::InputLatency m_input_latency{};
+        int64_t m_key_press_time{0}; /* of the key press being handled, or 0 */
+        int64_t m_process_budget{VTE_MAX_PROCESS_TIME * 1000}; /* µs */
+        bool m_frame_clock_stalled{false};
+        bool frame_watchdog_callback() noexcept;
+        vte::glib::Timer m_frame_watchdog_timer{std::bind(&Terminal::frame_watchdog_callback,
+                                                          this),
+                                                "frame-watchdog-timer"};
 
 	/* Output data queue. */
-        VteByteArray *m_outgoing; /* pending input characters */
+        vte::base::OutgoingQueue m_outgoing{}; /* pending input characters */
 
 #ifdef WITH_ICU
         /* Legacy charset support */
@@ -440,21 +585,60 @@ public:
         VteScreen m_alternate_screen;
         VteScreen *m_screen; /* points to either m_normal_screen or m_alternate_screen */
 
+        /* The images on the screens, identified by image_screen() */
+        vte::base::ImageCache m_image_cache{};
+        /* Decodes the DECSIXEL image being received */
+        std::unique_ptr<vte::base::SixelDecoder> m_sixel_decoder{};
+        inline int image_screen(VteScreen const* screen_) const noexcept { return screen_ == &m_alternate_screen; }
+        void remove_images(vte::grid::row_t start,
+                           vte::grid::row_t end);
+        void prune_images();
+        /* The marks on the normal screen from vte_terminal_add_mark(), by
+         * ascending id; rewrapping moves them along with the images */
+        struct Mark {
+                unsigned id;
+                VteVisualPosition position;
+        };
+        std::vector<Mark> m_marks{};
+        unsigned m_next_mark_id{1};
+        /* The marks that shell integration sets with OSC 133 on the normal
+         * screen, by position, so that finding the prompt or the output of a
+         * command is a binary search; rewrapping moves them like the above */
+        struct ShellMark {
+                VteVisualPosition position;
+                VteShellMark kind;
+                int exit_status;  /* for VTE_SHELL_MARK_END, or -1 */
+        };
+        std::vector<ShellMark> m_shell_marks{};
+        void mark_positions(VteScreen const* screen_,
+                            std::vector<VteVisualPosition*>& markers);
+
+        std::vector<VteVisualPosition> image_positions(VteScreen const* screen_);
+        void set_image_positions(VteScreen const* screen_,
+                                 std::vector<VteVisualPosition> const& positions);
+
         VteCell m_defaults;        /* Default characteristics for insertion of new characters:
                                       colors (fore, back, deco) and other attributes (bold, italic,
-                                      explicit hyperlink etc.). */
+                                      etc.). */
         VteCell m_color_defaults;  /* Default characteristics for erasing characters:
                                       colors (fore, back, deco) but no other attributes,
                                       and the U+0000 character that denotes erased cells. */
+        vte::base::Ring::hyperlink_idx_t m_hyperlink_idx{0}; /* The explicit hyperlink for insertion of new characters */
+        vte::base::SGRCache<vte_seq_arg_t> m_sgr_cache; /* SGR parameters -> effect on m_defaults.attr */
 
         /* charsets in the G0 and G1 slots */
         VteCharacterReplacement m_character_replacements[2] = { VTE_CHARACTER_REPLACEMENT_NONE,
                                                                 VTE_CHARACTER_REPLACEMENT_NONE };
         /* pointer to the active one */
         VteCharacterReplacement *m_character_replacement{&m_character_replacements[0]};
+        /* what the active one maps 0x20..0x7f to, or nullptr; see update_charset_map() */
+        gunichar const* m_charset_map{nullptr};
+        bool m_charset_map_narrow{true};  /* whether it maps them all to narrow characters */
 
         /* Word chars */
         std::vector<char32_t> m_word_char_exceptions;
+        /* is_word_char() of the BMP, computed from the above */
+        std::bitset<0x10000> m_word_char_bmp;
 
 	/* Selection information. */
         gboolean m_selecting;
@@ -470,10 +654,23 @@ public:
         VteFormat m_selection_format[LAST_VTE_SELECTION];
         bool m_changing_selection;
         GString *m_selection[LAST_VTE_SELECTION];  // FIXMEegmont rename this so that m_selection_resolved can become m_selection?
+        /* What was copied to each clipboard, as coordinates on @screen, until
+         * turned into m_selection[] on request or before the rows change. */
+        struct CopiedSelection {
+                VteScreen* screen{nullptr};  /* nullptr when not pending */
+                vte::grid::span span{};
+                bool block_mode{false};
+        };
+        CopiedSelection m_selection_copied[LAST_VTE_SELECTION];
         GtkClipboard *m_clipboard[LAST_VTE_SELECTION];
 
         ClipboardTextRequestGtk<Terminal> m_paste_request;
 
+        /* The paste in progress, queued for the child as the PTY drains */
+        vte::base::PasteQueue m_paste{};
+        bool m_paste_continuing{false};
+        std::string m_paste_filtered{}; /* scratch */
+
 	/* Miscellaneous options. */
         EraseMode m_backspace_binding{EraseMode::eAUTO};
         EraseMode m_delete_binding{EraseMode::eAUTO};
@@ -481,6 +678,49 @@ public:
         bool m_allow_bold{true};
         bool m_bold_is_bright{false};
         bool m_rewrap_on_resize{true};
+
+        /* Sizes allocated while resizing, see widget_size_allocate() */
+        unsigned int m_resize_delay{VTE_DEFAULT_RESIZE_DELAY}; /* ms */
+        long m_pending_columns{0};
+        long m_pending_rows{0};
+        bool m_resize_pending{false};
+        bool resize_timer_callback() noexcept;
+        vte::glib::Timer m_resize_timer{std::bind(&Terminal::resize_timer_callback,
+                                                  this),
+                                        "resize-timer"};
+
+        /* Synchronized output, see the VTE_SYNCHRONIZED_OUTPUT mode */
+        inline bool synchronized_output() const noexcept { return m_modes_private.VTE_SYNCHRONIZED_OUTPUT(); }
+        /* Whether the damage is kept instead of being drawn */
+        inline bool updates_held() const noexcept { return m_background || synchronized_output(); }
+        void end_synchronized_output() noexcept;
+        bool synchronized_output_timer_callback() noexcept;
+        vte::glib::Timer m_synchronized_output_timer{std::bind(&Terminal::synchronized_output_timer_callback,
+                                                               this),
+                                                     "synchronized-output-timer"};
+
+        bool font_validation_timer_callback() noexcept;
+        vte::glib::Timer m_font_validation_timer{std::bind(&Terminal::font_validation_timer_callback,
+                                                           this),
+                                                 "font-validation-timer"};
+
+        bool rewrap_timer_callback() noexcept;
+        vte::glib::Timer m_rewrap_timer{std::bind(&Terminal::rewrap_timer_callback,
+                                                  this),
+                                        "rewrap-timer"};
+
+        /* The speed of scrolling, in rows per second, and the scrollback
+         * rows predicted to be shown next, which are thawed while idle */
+        double m_scroll_speed{0};
+        gint64 m_scroll_time{0};
+        VteRing::row_t m_prefetch_start{0};
+        VteRing::row_t m_prefetch_end{0};
+        bool m_prefetch_backward{false};
+        void prefetch_scrollback(double dy);
+        bool prefetch_timer_callback() noexcept;
+        vte::glib::Timer m_prefetch_timer{std::bind(&Terminal::prefetch_timer_callback,
+                                                    this),
+                                          "prefetch-timer"};
         gboolean m_text_modified_flag;
         gboolean m_text_inserted_flag;
         gboolean m_text_deleted_flag;
@@ -537,6 +777,10 @@ public:
          * the viewable area, and also want to catch in-cell movements if they make the pointer visible.
          */
         vte::view::coords m_mouse_last_position{-1, -1};
+        /* The cell the hovered hyperlink and match were last looked up for on motion,
+         * and whether it was visible */
+        vte::grid::coords m_mouse_last_hover_cell{-1, -1};
+        bool m_mouse_last_hover_visible{false};
         double m_mouse_smooth_scroll_delta{0.0};
         bool mouse_autoscroll_timer_callback() noexcept;
         vte::glib::Timer m_mouse_autoscroll_timer{std::bind(&Terminal::mouse_autoscroll_timer_callback,
@@ -565,10 +809,17 @@ public:
                           m_cursor{std::move(cursor)},
                           m_tag{tag}
                 {
+                        if (m_regex)
+                                m_regex->required_bytes(m_first_bytes, m_last_bytes);
                 }
 
                 auto regex() const noexcept { return m_regex.get(); }
                 auto match_flags() const noexcept { return m_match_flags; }
+                /* Whether text with these bytes may contain a match */
+                bool may_match(vte::base::ByteSet const& bytes) const noexcept
+                {
+                        return bytes.intersects(m_first_bytes) && bytes.intersects(m_last_bytes);
+                }
                 auto const& cursor() const noexcept { return m_cursor; }
                 auto tag() const noexcept { return m_tag; }
 
@@ -579,6 +830,9 @@ public:
                 uint32_t m_match_flags{0};
                 vte::platform::Cursor m_cursor{VTE_DEFAULT_CURSOR};
                 int m_tag{-1};
+                /* See Regex::required_bytes() */
+                vte::base::ByteSet m_first_bytes{vte::base::ByteSet::all()};
+                vte::base::ByteSet m_last_bytes{vte::base::ByteSet::all()};
         };
 
         MatchRegex const* m_match_current{nullptr};
@@ -592,6 +846,7 @@ public:
         auto& match_regexes_writable() noexcept
         {
                 match_hilite_clear();
+                m_match_lines.clear();
                 return m_match_regexes;
         }
 
@@ -626,11 +881,40 @@ public:
          */
         vte::grid::span m_match_span;
 
+        /* The matches of each of m_match_regexes in the lines of m_match_contents
+         * checked last, keyed by the text of the line so that they outlive
+         * scrolling and changes elsewhere on the screen. Least recently used first. */
+        class MatchLine {
+        public:
+                class Match {
+                public:
+                        size_t start;  /* byte offsets into the line */
+                        size_t end;
+                };
+
+                std::string m_text{};
+                std::vector<std::vector<Match>> m_matches{};  /* per regex */
+        };
+        std::vector<MatchLine> m_match_lines{};
+        MatchLine const& match_line_lookup(gsize sattr,
+                                           gsize eattr);
+
+        /* Reused by the dingu matching, and by searching; apart, since the
+         * dingu matching leaves an offset limit in its match context */
+        std::unique_ptr<vte::base::MatchState> m_match_state{};
+        std::unique_ptr<vte::base::MatchState> m_search_match_state{};
+        vte::base::MatchState& match_state();
+        vte::base::MatchState& search_match_state();
+
 	/* Search data. */
         vte::base::RefPtr<vte::base::Regex> m_search_regex{};
         uint32_t m_search_regex_match_flags{0};
+        /* A match contains one byte of each; see Regex::required_bytes() */
+        vte::base::ByteSet m_search_first_bytes{vte::base::ByteSet::all()};
+        vte::base::ByteSet m_search_last_bytes{vte::base::ByteSet::all()};
         gboolean m_search_wrap_around;
-        GArray* m_search_attrs; /* Cache attrs */
+        GString* m_search_text{nullptr};  /* the paragraph being searched */
+        std::vector<size_t> m_search_row_offsets{}; /* where each of its rows starts in m_search_text */
 
 	/* Data used when rendering the text which does not require server
 	 * resources and which can be kept after unrealizing. */
@@ -710,6 +994,13 @@ public:
         gboolean m_cursor_moved_pending;
         gboolean m_contents_changed_pending;
 
+        /* What changed since the last contents-changed, for contents-updated */
+        vte::grid::row_t m_contents_damage_start{0};
+        vte::grid::row_t m_contents_damage_end{-1}; /* inclusive */
+        bool m_contents_damage_all{false};
+        VteScreen const* m_contents_screen{nullptr};
+        vte::grid::row_t m_contents_insert_delta{0};
+
         std::string m_window_title{};
         std::string m_current_directory_uri{};
         std::string m_current_file_uri{};
@@ -759,6 +1050,18 @@ public:
         bool m_allow_hyperlink{false};
         vte::base::Ring::hyperlink_idx_t m_hyperlink_hover_idx;
         const char *m_hyperlink_hover_uri; /* data is owned by the ring */
+
+        /* The hyperlinks of the displayed rows in the ring's array, by idx,
+         * see hyperlink_spans_update() */
+        struct HyperlinkSpan {
+                vte::base::Ring::hyperlink_idx_t idx;
+                vte::grid::row_t row;
+                vte::grid::column_t start, end;
+        };
+        std::vector<HyperlinkSpan> m_hyperlink_spans;
+        uint64_t m_hyperlink_spans_generation{0};
+        vte::grid::row_t m_hyperlink_spans_first_row{0};
+        vte::grid::row_t m_hyperlink_spans_end_row{0};
         long m_hyperlink_auto_id{0};
 
         /* RingView and friends */
@@ -776,6 +1079,9 @@ public:
                                        bool fill);
         /* inline */ VteRowData* ring_append(bool fill);
         /* inline */ void ring_remove(vte::grid::row_t position);
+        void ring_rotate(vte::grid::row_t start,
+                         vte::grid::row_t end /* inclusive */,
+                         vte::grid::row_t count);
         inline VteRowData const* find_row_data(vte::grid::row_t row) const;
         inline VteRowData* find_row_data_writable(vte::grid::row_t row) const;
         inline VteCell const* find_charcell(vte::grid::column_t col,
@@ -802,6 +1108,9 @@ public:
 
         void cleanup_fragments(long start,
                                long end);
+        void cleanup_fragments(VteRowData* row,
+                               long start,
+                               long end);
 
         void cursor_down(bool explicit_sequence);
         void drop_scrollback();
@@ -812,6 +1121,26 @@ public:
         void insert_char(gunichar c,
                          bool insert,
                          bool invalidate_now);
+        vte::grid::column_t wrap_for_insert(int columns);
+
+        void update_charset_map() noexcept;
+        inline gunichar map_graphic(gunichar c) const noexcept
+        {
+                if (G_UNLIKELY(m_charset_map != nullptr) && c >= 0x20 && c < 0x80)
+                        return m_charset_map[c - 0x20];
+                return c;
+        }
+
+        inline bool can_insert_printable_ascii() const noexcept
+        {
+                return (m_charset_map == nullptr || m_charset_map_narrow) &&
+                        !m_modes_ecma.IRM() &&
+                        m_screen->cursor.col < m_column_count;
+        }
+        size_t insert_printable_ascii(uint8_t const* data,
+                                      size_t len);
+        void insert_chars(gunichar const* chars,
+                          size_t len);
 
         void invalidate_row(vte::grid::row_t row);
         void invalidate_rows(vte::grid::row_t row_start,
@@ -819,10 +1148,47 @@ public:
         void invalidate_row_and_context(vte::grid::row_t row);
         void invalidate_rows_and_context(vte::grid::row_t row_start,
                                          vte::grid::row_t row_end /* inclusive */);
+        void invalidate_cells_and_context(vte::grid::row_t row,
+                                          vte::grid::column_t column_start,
+                                          vte::grid::column_t column_end);
+        cairo_rectangle_int_t damage_rect(vte::grid::row_t row_start,
+                                          vte::grid::row_t row_end /* inclusive */,
+                                          vte::grid::column_t column_start,
+                                          vte::grid::column_t column_end) const;
+        void damage_cells(vte::grid::row_t row_start,
+                          vte::grid::row_t row_end /* inclusive */,
+                          vte::grid::column_t column_start,
+                          vte::grid::column_t column_end);
+        void flush_damage();
+        void record_query_damage(vte::grid::row_t row_start,
+                                 vte::grid::row_t row_end /* inclusive */,
+                                 vte::grid::column_t column_start,
+                                 vte::grid::column_t column_end);
+        VteDamageSpan* get_damage(gsize* n_spans);
+        inline vte::grid::row_t a11y_first_row() const noexcept { return m_screen->scroll_delta; }
+        vte::base::Damage const* a11y_damage() noexcept;
+        void a11y_damage_reset();
+        VteFrameStats* get_frame_stats(gsize* n_frames);
+        void get_input_latency(VteInputLatencyStage stage,
+                               VteInputLatency* latency) const noexcept;
+        void get_memory_stats(VteMemoryStats* stats) const noexcept;
+        void frame_stats_commit();
         void invalidate(vte::grid::span const& s);
         void invalidate_symmetrical_difference(vte::grid::span const& a, vte::grid::span const& b, bool block);
         void invalidate_match_span();
         void invalidate_all();
+        void invalidate_view();
+        void frame_damage_rows(vte::grid::row_t row_start,
+                               vte::grid::row_t row_end /* inclusive */);
+        void frame_free() noexcept;
+        uint64_t frame_look_key() const;
+        void frame_switch_screen(GdkWindow* window,
+                                 int width,
+                                 int height);
+        cairo_region_t* frame_update();
+        uint64_t row_draw_key(vte::grid::row_t row,
+                              FrameRow& frame_row);
+        void invalidate_text_blink();
 
         guint8 get_bidi_flags() const noexcept;
         void apply_bidi_attributes(vte::grid::row_t start, guint8 bidi_flags, guint8 bidi_flags_mask);
@@ -832,13 +1198,20 @@ public:
         bool invalidate_dirty_rects_and_process_updates();
         void time_process_incoming();
         void process_incoming();
-        void process_incoming_utf8();
-        #ifdef WITH_ICU
-        void process_incoming_pcterm();
-        #endif
-        bool process(bool emit_adj_changed);
-        inline bool is_processing() const { return m_active_terminals_link != nullptr; }
+        template<class P>
+        void process_incoming_decoder(P& decoder);
+        bool process(bool flush_signals);
+        bool process_echo();
+        inline bool is_processing() const { return m_scheduler_entry.is_scheduled() ||
+                                                   m_tick_callback_id != 0; }
         void start_processing();
+        unsigned int scheduler_weight() const noexcept;
+
+        bool frame_clock_usable() const noexcept;
+        bool schedule_frame() noexcept;
+        void unschedule_frame() noexcept;
+        bool frame_tick(GdkFrameClock* clock) noexcept;
+        void update_process_budget(GdkFrameClock* clock) noexcept;
 
         gssize get_preedit_width(bool left_only);
         gssize get_preedit_length(bool left_only);
@@ -895,7 +1268,15 @@ public:
         void widget_copy(VteSelection sel,
                          VteFormat format);
         void widget_paste_received(char const* text);
+        void paste_continue(bool all = false);
+        void paste_stop() noexcept;
+        void paste_cancel();
         void widget_clipboard_cleared(GtkClipboard *clipboard);
+        void selection_copied_serialize(VteSelection sel);
+        void selection_copied_serialize_all();
+        void selection_copied_serialize_mutable();
+        void selection_copied_update_watch();
+        static void selection_copied_discard_cb(void* data);
         void widget_clipboard_requested(GtkClipboard *target_clipboard,
                                         GtkSelectionData *data,
                                         guint info);
@@ -905,6 +1286,7 @@ public:
         void widget_constructed();
         void widget_realize();
         void widget_unrealize();
+        void widget_map();
         void widget_unmap();
         void widget_style_updated();
         void widget_focus_in(GdkEventFocus *event);
@@ -957,6 +1339,8 @@ public:
                                         bool draw_default_bg,
                                         int column_width,
                                         int height);
+        void draw_frame(cairo_t* cr,
+                        cairo_region_t const* region);
         void draw_rows(VteScreen *screen,
                        cairo_region_t const* region,
                        vte::grid::row_t start_row,
@@ -964,6 +1348,12 @@ public:
                        gint start_y,
                        gint column_width,
                        gint row_height);
+        void draw_images(VteScreen *screen,
+                         vte::grid::row_t start_row,
+                         vte::grid::row_t end_row,
+                         gint start_y,
+                         gint column_width,
+                         gint row_height);
 
         void start_autoscroll();
         void stop_autoscroll() noexcept { m_mouse_autoscroll_timer.abort(); }
@@ -980,6 +1370,9 @@ public:
         void pty_channel_eof();
         bool pty_io_read(int const fd,
                          GIOCondition const condition);
+        bool pty_reader_ready();
+        void pty_reader_drain(bool force = false);
+        void update_input_throttle();
         bool pty_io_write(int const fd,
                           GIOCondition const condition);
 
@@ -1010,17 +1403,29 @@ public:
 
         void feed(std::string_view const& data,
                   bool start_processsing_ = true);
+        void feed(GBytes* bytes,
+                  bool start_processsing_ = true);
+        void feed_queued(bool start_processing_);
         void feed_child(char const* data,
                         size_t length) { assert(data); feed_child({data, length}); }
         void feed_child(std::string_view const& str);
         void feed_child_binary(std::string_view const& data);
+        inline size_t pending_input_size() const noexcept { return m_outgoing.size(); }
 
         bool is_word_char(gunichar c) const;
+        bool is_word_char_uncached(gunichar c) const;
         bool is_same_class(vte::grid::column_t acol,
                            vte::grid::row_t arow,
                            vte::grid::column_t bcol,
                            vte::grid::row_t brow) const;
 
+        void get_text(vte::grid::row_t start_row,
+                      vte::grid::column_t start_col,
+                      vte::grid::row_t end_row,
+                      vte::grid::column_t end_col,
+                      bool block,
+                      bool wrap,
+                      TextSink& sink);
         GString* get_text(vte::grid::row_t start_row,
                           vte::grid::column_t start_col,
                           vte::grid::row_t end_row,
@@ -1036,6 +1441,12 @@ public:
                                          GArray* attributes = nullptr);
 
         GString* get_selected_text(GArray* attributes = nullptr);
+        bool write_html(vte::grid::span const& span,
+                        bool block,
+                        GString* string,
+                        GOutputStream* stream,
+                        GCancellable* cancellable,
+                        GError** error);
 
         template<unsigned int redbits, unsigned int greenbits, unsigned int bluebits>
         inline void rgb_from_index(guint index,
@@ -1057,12 +1468,8 @@ public:
                                             guint *pback,
                                             guint *pdeco) const;
 
-        char *cellattr_to_html(VteCellAttr const* attr,
-                               char const* text) const;
-        VteCellAttr const* char_to_cell_attr(VteCharAttributes const* attr) const;
-
-        GString* attributes_to_html(GString* text_string,
-                                    GArray* attrs);
+        void cellattr_to_css(VteCellAttr const* attr,
+                             GString* css) const;
 
         void start_selection(vte::view::coords const& pos,
                              SelectionType type);
@@ -1080,6 +1487,13 @@ public:
         bool cell_is_selected_vis(vte::grid::column_t vcol,
                                   vte::grid::row_t) const;
 
+        /* The selected visual columns start..end (exclusive) of a row */
+        struct SelectionRun {
+                vte::grid::column_t start, end;
+        };
+        void append_selection_runs(vte::grid::row_t row,
+                                   std::vector<SelectionRun>& runs) const;
+
         void reset_default_attributes(bool reset_hyperlink);
 
         void ensure_font();
@@ -1095,6 +1509,7 @@ public:
                              long old_columns,
                              long old_rows,
                              bool do_rewrap);
+        void rewrap_finish();
 
         void vadjustment_value_changed();
 
@@ -1109,6 +1524,9 @@ public:
         void emit_adjustment_changed();
         void emit_commit(std::string_view const& str);
         void emit_eof();
+        void emit_paste_progress(uint64_t sent,
+                                 uint64_t total);
+        void emit_contents_updated();
         void emit_selection_changed();
         void queue_adjustment_changed();
         void queue_adjustment_value_changed(double v);
@@ -1145,6 +1563,7 @@ public:
         void emit_paste_clipboard();
         void emit_hyperlink_hover_uri_changed(const GdkRectangle *bbox);
 
+        void hyperlink_spans_update();
         void hyperlink_invalidate_and_get_bbox(vte::base::Ring::hyperlink_idx_t idx, GdkRectangle *bbox);
         void hyperlink_hilite_update();
 
@@ -1184,9 +1603,7 @@ public:
                                     gsize *sattr_ptr,
                                     gsize *eattr_ptr);
 
-        pcre2_match_context_8 *create_match_context();
-        bool match_check_pcre(pcre2_match_data_8 *match_data,
-                              pcre2_match_context_8 *match_context,
+        bool match_check_pcre(vte::base::MatchState& state,
                               vte::base::Regex const* regex,
                               uint32_t match_flags,
                               gsize sattr,
@@ -1227,17 +1644,47 @@ public:
                               uint32_t flags);
         auto search_regex() const noexcept { return m_search_regex.get(); }
 
-        bool search_rows(pcre2_match_context_8 *match_context,
-                         pcre2_match_data_8 *match_data,
+        void search_append_row(GString* text,
+                               vte::grid::row_t row);
+        vte::grid::column_t search_column_at(vte::grid::row_t row,
+                                             size_t offset,
+                                             size_t len,
+                                             bool end);
+        template<typename F>
+        bool search_paragraph(vte::base::MatchState& state,
+                              vte::base::Regex const* regex,
+                              uint32_t match_flags,
+                              vte::grid::row_t start_row,
+                              vte::grid::row_t end_row,
+                              F&& func);
+        void search_select_match(vte::grid::span const& match,
+                                 bool backward);
+        bool search_rows(vte::base::MatchState& state,
                          vte::grid::row_t start_row,
                          vte::grid::row_t end_row,
                          bool backward);
-        bool search_rows_iter(pcre2_match_context_8 *match_context,
-                              pcre2_match_data_8 *match_data,
+        bool search_rows_iter(vte::base::MatchState& state,
                               vte::grid::row_t start_row,
                               vte::grid::row_t end_row,
                               bool backward);
+        int search_find_ranges(bool backward,
+                               vte::grid::row_t ranges[2][2]);
+        void search_find_failed(bool backward);
         bool search_find(bool backward);
+        void search_async(bool find_all,
+                          bool backward,
+                          gsize max_matches,
+                          GCancellable* cancellable,
+                          GFileProgressCallback progress_callback,
+                          gpointer progress_data,
+                          GDestroyNotify progress_data_destroy,
+                          GAsyncReadyCallback callback,
+                          gpointer user_data);
+        bool search_step(GTask* task);
+        bool search_find_all_finish(GAsyncResult* result,
+                                    long** ranges,
+                                    gsize* n_matches,
+                                    GError** error);
         bool search_set_wrap_around(bool wrap);
 
         void set_size(long columns,
@@ -1292,15 +1739,22 @@ public:
         bool set_delete_binding(EraseMode binding);
         auto delete_binding() const noexcept { return m_delete_binding; }
         bool set_enable_bidi(bool setting);
+        bool set_enable_io_thread(bool setting);
         bool set_enable_shaping(bool setting);
         bool set_encoding(char const* codeset,
                           GError** error);
         bool set_font_desc(PangoFontDescription const* desc);
         bool set_font_scale(double scale);
+        bool set_headless(bool headless);
+        void set_background(bool background) noexcept;
         bool set_input_enabled(bool enabled);
+        bool set_input_queue_limit(unsigned int limit);
+        bool set_resize_delay(unsigned int delay);
         bool set_mouse_autohide(bool autohide);
         bool set_rewrap_on_resize(bool rewrap);
         bool set_scrollback_lines(long lines);
+        bool set_scrollback_bytes(size_t bytes);
+        static void scrollback_evicted_cb(void* data);
         bool set_scroll_on_keystroke(bool scroll);
         bool set_scroll_on_output(bool scroll);
         bool set_word_char_exceptions(std::optional<std::string_view> stropt);
@@ -1310,10 +1764,61 @@ public:
                                   VteWriteFlags flags,
                                   GCancellable *cancellable,
                                   GError **error);
+        void write_contents_async(GOutputStream *stream,
+                                  VteWriteFlags flags,
+                                  GCancellable *cancellable,
+                                  GFileProgressCallback progress_callback,
+                                  gpointer progress_data,
+                                  GDestroyNotify progress_data_destroy,
+                                  GAsyncReadyCallback callback,
+                                  gpointer user_data);
+        void write_text_range_async(vte::grid::row_t start_row,
+                                    vte::grid::column_t start_col,
+                                    vte::grid::row_t end_row,
+                                    vte::grid::column_t end_col,
+                                    VteFormat format,
+                                    GOutputStream* stream,
+                                    GCancellable* cancellable,
+                                    GAsyncReadyCallback callback,
+                                    gpointer user_data);
+        bool write_text_range_step(GTask* task);
+        bool save_scrollback(GOutputStream *stream,
+                             GCancellable *cancellable,
+                             GError **error);
+        bool restore_scrollback(GInputStream *stream,
+                                GCancellable *cancellable,
+                                GError **error);
+        bool save_state(GOutputStream *stream,
+                        VteStateFlags flags,
+                        GCancellable *cancellable,
+                        GError **error);
+        bool restore_state(GInputStream *stream,
+                           GCancellable *cancellable,
+                           GError **error);
+        unsigned add_mark(long column,
+                          long row);
+        bool get_mark(unsigned id,
+                      long* column,
+                      long* row) const;
+        void remove_mark(unsigned id);
+        void add_shell_mark(VteShellMark kind,
+                            int exit_status);
+        bool find_shell_mark(VteShellMark kind,
+                             long row,
+                             bool backward,
+                             long* column,
+                             long* mark_row) const;
+        bool get_command_output(long row,
+                                long* start_row,
+                                long* start_col,
+                                long* end_row,
+                                long* end_col,
+                                int* exit_status) const;
 
         inline void ensure_cursor_is_onscreen();
         inline void home_cursor();
         inline void clear_screen();
+        bool screen_is_blank() const;
         inline void clear_current_line();
         inline void clear_above_current();
         inline void scroll_text(vte::grid::row_t scroll_amount);
@@ -1339,7 +1844,7 @@ public:
         inline void clear_to_bol();
         inline void clear_below_current();
         inline void clear_to_eol();
-        inline void delete_character();
+        inline void delete_characters(long count);
         inline void set_cursor_column(vte::grid::column_t col);
         inline void set_cursor_column1(vte::grid::column_t col); /* 1-based */
         inline int get_cursor_column() const noexcept { return CLAMP(m_screen->cursor.col, 0, m_column_count - 1); }
@@ -1357,12 +1862,14 @@ public:
         inline void move_cursor_up(vte::grid::row_t rows);
         inline void move_cursor_down(vte::grid::row_t rows);
         inline void erase_characters(long count);
-        inline void insert_blank_character();
+        inline void insert_blank_characters(long count);
 
         template<unsigned int redbits, unsigned int greenbits, unsigned int bluebits>
         inline bool seq_parse_sgr_color(vte::parser::Sequence const& seq,
                                         unsigned int& idx,
                                         uint32_t& color) const noexcept;
+        bool apply_sgr(vte::parser::Sequence const& seq,
+                       VteCellAttr& attr) const noexcept;
 
         inline void move_cursor_backward(vte::grid::column_t columns);
         inline void move_cursor_forward(vte::grid::column_t columns);
@@ -1450,6 +1957,9 @@ public:
         void set_current_hyperlink(vte::parser::Sequence const& seq,
                                    vte::parser::StringTokeniser::const_iterator& token,
                                    vte::parser::StringTokeniser::const_iterator const& endtoken) noexcept;
+        void set_shell_mark(vte::parser::Sequence const& seq,
+                            vte::parser::StringTokeniser::const_iterator& token,
+                            vte::parser::StringTokeniser::const_iterator const& endtoken) noexcept;
 
         void ringview_update();
 
@@ -97,6 +97,14 @@ vte_pty_child_setup (VtePty *pty)
         g_return_if_fail(impl != nullptr);
 
         impl->child_setup();
+
+        /* For the caller's own exec; vte_pty_spawn_async() passes
+         * these in the environment instead. */
+        g_setenv("TERM", VTE_TERMINFO_NAME, TRUE);
+
+        char version[7];
+        g_snprintf (version, sizeof (version), "%u", VTE_VERSION_NUMERIC);
+        g_setenv ("VTE_VERSION", version, TRUE);
 }
 
 /*
@@ -55,14 +55,90 @@ _vte_cells_for_cell_array (VteCell *cells)
 	return (VteCells *) (((guchar *) cells) - G_STRUCT_OFFSET (VteCells, cells));
 }
 
+/*
+ * Cell array pool
+ *
+ * Cell arrays come in classes of 2^k - 1 cells, from 127 up to the 65535
+ * a row can hold. Freed arrays are kept on a free list per class and
+ * handed out again, instead of being returned to the heap, so that a
+ * long-running terminal keeps recycling a few blocks of the same sizes
+ * rather than fragmenting the heap through g_realloc(). _vte_cells_prune()
+ * trims the free lists back to what was recently needed.
+ *
+ * Like the rest of the row data, this is only used on the main thread.
+ */
+
+#define VTE_CELLS_CLASS_MIN_BITS	7
+#define VTE_CELLS_N_CLASSES		(16 - VTE_CELLS_CLASS_MIN_BITS + 1)
+#define VTE_CELLS_FREE_MIN		4 /* per class, kept when pruning */
+
+typedef struct _VteCellsClass {
+	VteCells *free_list; /* linked through _vte_cells_set_next() */
+	guint n_free;
+	guint n_used;
+	guint peak_used;     /* since the last prune */
+} VteCellsClass;
+
+static VteCellsClass cells_classes[VTE_CELLS_N_CLASSES];
+static guint64 cells_n_allocations;
+static guint64 cells_n_reuses;
+
+static inline guint
+_vte_cells_class_for_len (guint32 len)
+{
+	return MAX (g_bit_storage (len), VTE_CELLS_CLASS_MIN_BITS) - VTE_CELLS_CLASS_MIN_BITS;
+}
+
+static inline guint32
+_vte_cells_class_alloc_len (guint klass)
+{
+	return (1u << (klass + VTE_CELLS_CLASS_MIN_BITS)) - 1;
+}
+
+static inline gsize
+_vte_cells_size (guint32 alloc_len)
+{
+	return G_STRUCT_OFFSET (VteCells, cells) + alloc_len * sizeof (VteCell);
+}
+
+/* A free array stores the next one on its free list after alloc_len;
+ * VteCell is packed, so go through memcpy. */
+#define VTE_CELLS_NEXT_OFFSET 8
+
+static inline VteCells *
+_vte_cells_get_next (VteCells *cells)
+{
+	VteCells *next;
+	memcpy (&next, (guchar *) cells + VTE_CELLS_NEXT_OFFSET, sizeof (next));
+	return next;
+}
+
+static inline void
+_vte_cells_set_next (VteCells *cells, VteCells *next)
+{
+	memcpy ((guchar *) cells + VTE_CELLS_NEXT_OFFSET, &next, sizeof (next));
+}
+
 static VteCells *
-_vte_cells_realloc (VteCells *cells, guint32 len)
+_vte_cells_alloc (guint klass)
 {
-	guint32 alloc_len = (1 << g_bit_storage (MAX (len, 80))) - 1;
+	VteCellsClass *cls = &cells_classes[klass];
+	VteCells *cells;
+
+	if (cls->free_list) {
+		cells = cls->free_list;
+		cls->free_list = _vte_cells_get_next (cells);
+		cls->n_free--;
+		cells_n_reuses++;
+	} else {
+		guint32 alloc_len = _vte_cells_class_alloc_len (klass);
+		cells = (VteCells *) g_malloc (_vte_cells_size (alloc_len));
+		cells->alloc_len = alloc_len;
+		cells_n_allocations++;
+	}
 
-	_vte_debug_print(VTE_DEBUG_RING, "Enlarging cell array of %d cells to %d cells\n", cells ? cells->alloc_len : 0, alloc_len);
-	cells = (VteCells *)g_realloc (cells, G_STRUCT_OFFSET (VteCells, cells) + alloc_len * sizeof (cells->cells[0]));
-	cells->alloc_len = alloc_len;
+	cls->n_used++;
+	cls->peak_used = MAX (cls->peak_used, cls->n_used);
 
 	return cells;
 }
@@ -70,8 +146,172 @@ _vte_cells_realloc (VteCells *cells, guint32 len)
 static void
 _vte_cells_free (VteCells *cells)
 {
+	VteCellsClass *cls = &cells_classes[_vte_cells_class_for_len (cells->alloc_len)];
+
 	_vte_debug_print(VTE_DEBUG_RING, "Freeing cell array of %d cells\n", cells->alloc_len);
-	g_free (cells);
+
+	_vte_cells_set_next (cells, cls->free_list);
+	cls->free_list = cells;
+	cls->n_free++;
+	cls->n_used--;
+}
+
+/* Returns an array for @len cells, with the first @used cells of @cells,
+ * which it frees. */
+static VteCells *
+_vte_cells_realloc (VteCells *cells, guint32 len, guint32 used)
+{
+	VteCells *new_cells = _vte_cells_alloc (_vte_cells_class_for_len (len));
+
+	_vte_debug_print(VTE_DEBUG_RING, "Enlarging cell array of %d cells to %d cells\n", cells ? cells->alloc_len : 0, new_cells->alloc_len);
+
+	if (cells) {
+		memcpy (new_cells->cells, cells->cells, MIN (used, cells->alloc_len) * sizeof (cells->cells[0]));
+		_vte_cells_free (cells);
+	}
+
+	return new_cells;
+}
+
+/**
+ * _vte_cells_prune:
+ *
+ * Returns the free cell arrays of each class to the heap, except for as
+ * many as were in use at peak since the last prune, on top of those in use
+ * now; frees them all if none are in use.
+ */
+void
+_vte_cells_prune (void)
+{
+	gsize used_bytes = 0, free_bytes = 0;
+	guint klass;
+
+	for (klass = 0; klass < VTE_CELLS_N_CLASSES; klass++) {
+		VteCellsClass *cls = &cells_classes[klass];
+		guint keep = cls->n_used ? MAX (cls->peak_used - cls->n_used, VTE_CELLS_FREE_MIN) : 0;
+
+		while (cls->n_free > keep) {
+			VteCells *cells = cls->free_list;
+			cls->free_list = _vte_cells_get_next (cells);
+			cls->n_free--;
+			g_free (cells);
+		}
+		cls->peak_used = cls->n_used;
+
+		used_bytes += cls->n_used * _vte_cells_size (_vte_cells_class_alloc_len (klass));
+		free_bytes += cls->n_free * _vte_cells_size (_vte_cells_class_alloc_len (klass));
+	}
+
+	_vte_debug_print(VTE_DEBUG_RING,
+			 "Cell arrays: %" G_GSIZE_FORMAT " bytes in use, %" G_GSIZE_FORMAT " bytes free; "
+			 "%" G_GUINT64_FORMAT " allocations, %" G_GUINT64_FORMAT " reuses\n",
+			 used_bytes, free_bytes, cells_n_allocations, cells_n_reuses);
+}
+
+
+/* Sets the @n cells at @cells to @cell. After the first one, this copies
+ * in doubling blocks, so that the bulk of the work is done by memcpy.
+ */
+static inline void
+_vte_cells_fill (VteCell *cells, const VteCell *cell, gulong n)
+{
+	gulong done;
+
+	if (G_UNLIKELY (n == 0))
+		return;
+
+	cells[0] = *cell;
+	for (done = 1; done < n; ) {
+		gulong chunk = MIN (done, n - done);
+		memcpy (&cells[done], cells, chunk * sizeof (cells[0]));
+		done += chunk;
+	}
+}
+
+
+/*
+ * Hyperlink runs
+ */
+
+/* Appends the run from @start to @end to @links, joining it to the last
+ * run if they touch and have the same idx. */
+static inline void
+_vte_hyperlinks_push (VteCellHyperlink *links, guint *n, gulong start, gulong end, guint32 idx)
+{
+	end = MIN (end, 0xFFFF);
+	if (start >= end)
+		return;
+
+	if (*n > 0 && links[*n - 1].end == start && links[*n - 1].idx == idx) {
+		links[*n - 1].end = end;
+		return;
+	}
+
+	links[*n].start = start;
+	links[*n].end = end;
+	links[*n].idx = idx;
+	(*n)++;
+}
+
+static void
+_vte_row_data_set_hyperlinks (VteRowData *row, VteCellHyperlink *links, guint n)
+{
+	g_free (row->hyperlinks);
+	if (n == 0) {
+		g_free (links);
+		links = NULL;
+	}
+	row->hyperlinks = links;
+	row->n_hyperlinks = n;
+}
+
+/* Updates the hyperlink runs for the @n_removed cells at @col being replaced
+ * by @n_inserted cells without hyperlink; the run of @idx (if not 0) then
+ * covers the inserted cells. */
+static void
+_vte_row_data_splice_hyperlinks (VteRowData *row, gulong col, gulong n_removed, gulong n_inserted, guint32 idx)
+{
+	VteCellHyperlink *links = g_new (VteCellHyperlink, row->n_hyperlinks + 2);
+	gulong removed_end = col + n_removed;
+	gboolean inserted = idx == 0;
+	guint i, n = 0;
+
+	for (i = 0; i < row->n_hyperlinks; i++) {
+		VteCellHyperlink const *link = &row->hyperlinks[i];
+
+		_vte_hyperlinks_push (links, &n, link->start, MIN (link->end, col), link->idx);
+		if (!inserted && link->end > col) {
+			_vte_hyperlinks_push (links, &n, col, col + n_inserted, idx);
+			inserted = TRUE;
+		}
+		if (link->end > removed_end)
+			_vte_hyperlinks_push (links, &n,
+					      MAX (link->start, removed_end) - n_removed + n_inserted,
+					      link->end - n_removed + n_inserted,
+					      link->idx);
+	}
+	if (!inserted)
+		_vte_hyperlinks_push (links, &n, col, col + n_inserted, idx);
+
+	_vte_row_data_set_hyperlinks (row, links, n);
+}
+
+void
+_vte_row_data_set_hyperlink_range (VteRowData *row, gulong start, gulong end, guint32 idx)
+{
+	VteCellHyperlink *last;
+
+	if (G_UNLIKELY (end <= start))
+		return;
+
+	/* Fast path: text printed with a hyperlink extends its last run */
+	last = row->n_hyperlinks ? &row->hyperlinks[row->n_hyperlinks - 1] : NULL;
+	if (idx != 0 && last && last->idx == idx && last->start <= start && start <= last->end) {
+		last->end = MAX (last->end, MIN (end, 0xFFFF));
+		return;
+	}
+
+	_vte_row_data_splice_hyperlinks (row, start, end - start, end - start, idx);
 }
 
 
@@ -89,6 +329,7 @@ void
 _vte_row_data_clear (VteRowData *row)
 {
 	VteCell *cells = row->cells;
+	g_free (row->hyperlinks);
 	_vte_row_data_init (row);
 	row->cells = cells;
 }
@@ -99,6 +340,9 @@ _vte_row_data_fini (VteRowData *row)
 	if (row->cells)
 		_vte_cells_free (_vte_cells_for_cell_array (row->cells));
 	row->cells = NULL;
+	g_free (row->hyperlinks);
+	row->hyperlinks = NULL;
+	row->n_hyperlinks = 0;
 }
 
 static inline gboolean
@@ -111,81 +355,209 @@ _vte_row_data_ensure (VteRowData *row, gulong len)
 	if (G_UNLIKELY (len >= 0xFFFF))
 		return FALSE;
 
-	row->cells = _vte_cells_realloc (cells, len)->cells;
+	row->cells = _vte_cells_realloc (cells, len, _vte_row_data_stored_length (row))->cells;
+
+	return TRUE;
+}
+
+/* Stores the cells of @row's filled tail one by one, up to @n (at most the
+ * row's length), keeping the rest of the tail. */
+static gboolean
+_vte_row_data_store (VteRowData *row, gulong n)
+{
+	VteCell tail;
+	gulong n_stored;
+
+	if (G_LIKELY (n <= row->n_cells))
+		return TRUE;
+
+	tail = row->cells[row->n_cells];
+	n_stored = n + (n < row->len);
+	if (G_UNLIKELY (!_vte_row_data_ensure (row, n_stored)))
+		return FALSE;
+
+	_vte_cells_fill (&row->cells[row->n_cells], &tail, n_stored - row->n_cells);
+	row->n_cells = n;
 
 	return TRUE;
 }
 
+void
+_vte_row_data_expand (VteRowData *row)
+{
+	_vte_row_data_store (row, row->len);
+}
+
 void
 _vte_row_data_insert (VteRowData *row, gulong col, const VteCell *cell)
 {
-	gulong i;
+	_vte_row_data_insert_n (row, col, cell, 1);
+}
+
+/* Inserts @n copies of @cell at @col, which must be at most the row's length. */
+void
+_vte_row_data_insert_n (VteRowData *row, gulong col, const VteCell *cell, gulong n)
+{
+	gulong n_stored;
 
-	if (G_UNLIKELY (!_vte_row_data_ensure (row, row->len + 1)))
+	if (G_UNLIKELY (n == 0 || row->len + n >= 0xFFFF || !_vte_row_data_store (row, col)))
 		return;
 
-	for (i = row->len; i > col; i--)
-		row->cells[i] = row->cells[i - 1];
+	/* The cells after @col move along, the filled tail's too */
+	n_stored = _vte_row_data_stored_length (row);
+	if (G_UNLIKELY (!_vte_row_data_ensure (row, n_stored + n)))
+		return;
 
-	row->cells[col] = *cell;
-	row->len++;
+	memmove (&row->cells[col + n], &row->cells[col], (n_stored - col) * sizeof (row->cells[0]));
+	_vte_cells_fill (&row->cells[col], cell, n);
+	row->len += n;
+	row->n_cells += n;
+
+	if (G_UNLIKELY (row->n_hyperlinks))
+		_vte_row_data_splice_hyperlinks (row, col, 0, n, 0);
 }
 
 void _vte_row_data_append (VteRowData *row, const VteCell *cell)
 {
-	if (G_UNLIKELY (!_vte_row_data_ensure (row, row->len + 1)))
+	if (G_UNLIKELY (row->len + 1 >= 0xFFFF))
+		return;
+
+	/* Another one of the filled tail */
+	if (row->n_cells < row->len &&
+	    memcmp (&row->cells[row->n_cells], cell, sizeof (*cell)) == 0) {
+		row->len++;
+		return;
+	}
+
+	if (G_UNLIKELY (!_vte_row_data_store (row, row->len) ||
+			!_vte_row_data_ensure (row, row->len + 1)))
 		return;
 
 	row->cells[row->len] = *cell;
 	row->len++;
+	row->n_cells = row->len;
 }
 
 void _vte_row_data_remove (VteRowData *row, gulong col)
 {
-	gulong i;
+	_vte_row_data_remove_n (row, col, 1);
+}
 
-	for (i = col + 1; i < row->len; i++)
-		row->cells[i - 1] = row->cells[i];
+/* Removes the (up to) @n cells starting at @col. */
+void
+_vte_row_data_remove_n (VteRowData *row, gulong col, gulong n)
+{
+	if (G_UNLIKELY (col >= row->len))
+		return;
+
+	n = MIN (n, row->len - col);
+
+	/* Out of the filled tail, only the count goes down */
+	if (col < row->n_cells) {
+		gulong n_stored = _vte_row_data_stored_length (row);
+		gulong n_removed = MIN (n, row->n_cells - col);
+
+		memmove (&row->cells[col], &row->cells[col + n_removed], (n_stored - col - n_removed) * sizeof (row->cells[0]));
+		row->n_cells -= n_removed;
+	}
+	row->len -= n;
 
-	if (G_LIKELY (row->len))
-		row->len--;
+	if (G_UNLIKELY (row->n_hyperlinks))
+		_vte_row_data_splice_hyperlinks (row, col, n, 0, 0);
 }
 
+/* Extends @row to @len cells with @cell, as its filled tail unless it
+ * already ends in different ones. */
 void _vte_row_data_fill (VteRowData *row, const VteCell *cell, gulong len)
 {
-	if (row->len < len) {
-		gulong i;
+	if (row->len >= len)
+		return;
+
+	if (G_UNLIKELY (len >= 0xFFFF))
+		return;
+
+	if (row->n_cells < row->len &&
+	    memcmp (&row->cells[row->n_cells], cell, sizeof (*cell)) != 0)
+		_vte_row_data_expand (row);
+
+	if (row->n_cells == row->len) {
+		if (G_UNLIKELY (!_vte_row_data_ensure (row, row->n_cells + 1)))
+			return;
+		row->cells[row->n_cells] = *cell;
+	}
+	row->len = len;
+}
+
+/* Sets the cells from @start (inclusive) to @end (exclusive) to @cell,
+ * extending the row if necessary. @start must be at most the row's length.
+ */
+void
+_vte_row_data_fill_range (VteRowData *row, const VteCell *cell, gulong start, gulong end)
+{
+	if (G_UNLIKELY (end <= start || end >= 0xFFFF))
+		return;
 
-		if (G_UNLIKELY (!_vte_row_data_ensure (row, len)))
+	if (end >= row->len) {
+		/* Up to the end: it becomes the filled tail */
+		if (G_UNLIKELY (!_vte_row_data_store (row, start) ||
+				!_vte_row_data_ensure (row, start + 1)))
 			return;
 
-		for (i = row->len; i < len; i++)
-			row->cells[i] = *cell;
+		row->cells[start] = *cell;
+		row->n_cells = start;
+		row->len = end;
+	} else {
+		if (G_UNLIKELY (!_vte_row_data_store (row, end)))
+			return;
 
-		row->len = len;
+		_vte_cells_fill (&row->cells[start], cell, end - start);
 	}
+
+	if (G_UNLIKELY (row->n_hyperlinks))
+		_vte_row_data_splice_hyperlinks (row, start, end - start, end - start, 0);
 }
 
 void _vte_row_data_shrink (VteRowData *row, gulong max_len)
 {
-	if (max_len < row->len)
+	if (max_len < row->len) {
 		row->len = max_len;
+		row->n_cells = MIN (row->n_cells, max_len);
+	}
+
+	if (G_UNLIKELY (row->n_hyperlinks && row->hyperlinks[row->n_hyperlinks - 1].end > max_len))
+		_vte_row_data_splice_hyperlinks (row, max_len, 0xFFFF, 0, 0);
 }
 
 void _vte_row_data_copy (const VteRowData *src, VteRowData *dst)
 {
-        _vte_row_data_ensure (dst, src->len);
+        gulong n_stored = _vte_row_data_stored_length (src);
+
+        _vte_row_data_ensure (dst, n_stored);
         dst->len = src->len;
+        dst->n_cells = src->n_cells;
         dst->attr = src->attr;
-        memcpy(dst->cells, src->cells, src->len * sizeof (src->cells[0]));
+        memcpy(dst->cells, src->cells, n_stored * sizeof (src->cells[0]));
+        _vte_row_data_set_hyperlinks (dst,
+                                      (VteCellHyperlink *) g_memdup (src->hyperlinks,
+                                                                     src->n_hyperlinks * sizeof (src->hyperlinks[0])),
+                                      src->n_hyperlinks);
 }
 
 /* Get the length, ignoring trailing empty cells (with a custom background color). */
 guint16 _vte_row_data_nonempty_length (const VteRowData *row)
 {
-        guint16 len;
+        guint16 len = row->len;
         const VteCell *cell;
-        for (len = row->len; len > 0; len--) {
+
+        /* All of the filled tail or none of it */
+        if (row->n_cells < len) {
+                cell = &row->cells[row->n_cells];
+                if (cell->attr.fragment() || cell->c != 0)
+                        return len;
+                len = row->n_cells;
+        }
+
+        for (; len > 0; len--) {
                 cell = &row->cells[len - 1];
                 if (cell->attr.fragment() || cell->c != 0)
                         break;
@@ -193,3 +565,13 @@ guint16 _vte_row_data_nonempty_length (const VteRowData *row)
         return len;
 }
 
+gsize _vte_row_data_size (const VteRowData *row)
+{
+        const VteCells *cells = _vte_cells_for_cell_array (row->cells);
+        gsize size = row->n_hyperlinks * sizeof (VteCellHyperlink);
+
+        if (cells != NULL)
+                size += _vte_cells_size (cells->alloc_len);
+        return size;
+}
+
@@ -41,46 +41,112 @@ typedef struct _VteRowAttr {
 } VteRowAttr;
 static_assert(sizeof (VteRowAttr) == 1, "VteRowAttr has wrong size");
 
+/*
+ * VteCellHyperlink: The hyperlink of a run of cells, from @start (inclusive)
+ * to @end (exclusive)
+ */
+
+typedef struct _VteCellHyperlink {
+        guint16 start;
+        guint16 end;
+        guint32 idx;    /* VTE_HYPERLINK_IDX_TARGET_IN_STREAM means the target
+                           is irrelevant/unknown at the moment */
+} VteCellHyperlink;
+
 /*
  * VteRowData: A single row's data
+ *
+ * Few cells are ever hyperlinks, so rather than in every cell, their
+ * hyperlink idxs are kept in @hyperlinks, as runs sorted by column, not
+ * overlapping, and of idxs other than 0; NULL if there are none.
+ *
+ * Only the first @n_cells of the @len cells are stored one by one. The
+ * rest, left by filling the row to its end (as erasing with a background
+ * colour does), are all the same cell, stored once at @cells[@n_cells].
+ * _vte_row_data_get_writable() stores them all before handing out a cell.
  */
 
 typedef struct _VteRowData {
 	VteCell *cells;
 	guint16 len;
 	VteRowAttr attr;
+        guint16 n_hyperlinks;
+        guint16 n_cells;
+        VteCellHyperlink *hyperlinks;
 } VteRowData;
 
 
 #define _vte_row_data_length(__row)			((__row)->len + 0)
 
+/* Returns: the number of cells stored at @row's cells, with the filled tail's */
+static inline gulong
+_vte_row_data_stored_length (const VteRowData *row)
+{
+	return row->n_cells + (row->n_cells < row->len);
+}
+
 static inline const VteCell *
 _vte_row_data_get (const VteRowData *row, gulong col)
 {
 	if (G_UNLIKELY (row->len <= col))
 		return NULL;
 
-	return &row->cells[col];
+	return &row->cells[MIN (col, row->n_cells)];
 }
 
+void _vte_row_data_expand (VteRowData *row);
+
 static inline VteCell *
 _vte_row_data_get_writable (VteRowData *row, gulong col)
 {
 	if (G_UNLIKELY (row->len <= col))
 		return NULL;
 
+	if (G_UNLIKELY (row->n_cells < row->len))
+		_vte_row_data_expand (row);
+
 	return &row->cells[col];
 }
 
+/* Returns: the hyperlink idx of the cell at @col, 0 if none */
+static inline guint32
+_vte_row_data_get_hyperlink (const VteRowData *row, gulong col)
+{
+        guint i;
+
+        for (i = 0; i < row->n_hyperlinks && row->hyperlinks[i].start <= col; i++)
+                if (col < row->hyperlinks[i].end)
+                        return row->hyperlinks[i].idx;
+        return 0;
+}
+
+void _vte_row_data_set_hyperlink_range (VteRowData *row, gulong start, gulong end, guint32 idx);
+
+/* Sets the hyperlink idx of the cells from @start to @end (exclusive), 0 for none. */
+static inline void
+_vte_row_data_set_hyperlink (VteRowData *row, gulong start, gulong end, guint32 idx)
+{
+        if (G_LIKELY (idx == 0 && row->n_hyperlinks == 0))
+                return;
+        _vte_row_data_set_hyperlink_range (row, start, end, idx);
+}
+
 void _vte_row_data_init (VteRowData *row);
 void _vte_row_data_clear (VteRowData *row);
 void _vte_row_data_fini (VteRowData *row);
 void _vte_row_data_insert (VteRowData *row, gulong col, const VteCell *cell);
+void _vte_row_data_insert_n (VteRowData *row, gulong col, const VteCell *cell, gulong n);
 void _vte_row_data_append (VteRowData *row, const VteCell *cell);
 void _vte_row_data_remove (VteRowData *row, gulong col);
+void _vte_row_data_remove_n (VteRowData *row, gulong col, gulong n);
 void _vte_row_data_fill (VteRowData *row, const VteCell *cell, gulong len);
+void _vte_row_data_fill_range (VteRowData *row, const VteCell *cell, gulong start, gulong end);
 void _vte_row_data_shrink (VteRowData *row, gulong max_len);
 void _vte_row_data_copy (const VteRowData *src, VteRowData *dst);
 guint16 _vte_row_data_nonempty_length (const VteRowData *row);
+/* The bytes the cells and hyperlink runs of @row take on the heap */
+gsize _vte_row_data_size (const VteRowData *row);
+
+void _vte_cells_prune (void);
 
 G_END_DECLS
@@ -116,6 +116,7 @@ vte::parser::Sequence::type_string() const
         case VTE_SEQ_APC:     return "APC";
         case VTE_SEQ_PM:      return "PM";
         case VTE_SEQ_SOS:     return "SOS";
+        case VTE_SEQ_DCS_DATA: return "DCS_DATA";
         default:
                 g_assert(false);
                 return nullptr;
@@ -141,21 +142,25 @@ vte::parser::Sequence::command_string() const
         }
 }
 
-// FIXMEchpe optimise this
-std::string
-vte::parser::Sequence::string_utf8() const noexcept
+void
+vte::parser::Sequence::string_utf8(std::string& str) const noexcept
 {
-        std::string str;
-
         size_t len;
         auto buf = vte_seq_string_get(&m_seq->arg_str, &len);
 
-        char u[6];
-        for (size_t i = 0; i < len; ++i) {
-                auto ulen = g_unichar_to_utf8(buf[i], u);
-                str.append((char const*)u, ulen);
-        }
+        str.resize(len * VTE_UTF8_BPC);
+        auto const start = str.data();
+        auto p = start;
+        for (size_t i = 0; i < len; ++i)
+                p += g_unichar_to_utf8(buf[i], p);
+        str.resize(p - start);
+}
 
+std::string
+vte::parser::Sequence::string_utf8() const noexcept
+{
+        std::string str;
+        string_utf8(str);
         return str;
 }
 
@@ -250,20 +255,61 @@ Terminal::clear_screen()
 {
         auto row = m_screen->cursor.row - m_screen->insert_delta;
         auto initial = _vte_ring_next(m_screen->row_data);
-	/* Add a new screen's worth of rows. */
-        for (auto i = 0; i < m_row_count; i++)
-                ring_append(true);
+        auto ring = m_screen->row_data;
+
+        if (screen_is_blank()) {
+                /* Clearing a screen that's already clear leaves nothing
+                 * worth keeping in the scrollback, clear it in place. */
+                initial = m_screen->insert_delta;
+                for (auto i = initial; i < _vte_ring_next(ring); i++) {
+                        auto rowdata = _vte_ring_index_writable(ring, i);
+                        _vte_row_data_shrink(rowdata, 0);
+                        rowdata->attr.soft_wrapped = 0;
+                        rowdata->attr.bidi_flags = get_bidi_flags();
+                }
+        } else {
+                /* Add a new screen's worth of rows, at once. */
+                _vte_ring_append_rows(ring, m_row_count, get_bidi_flags());
+        }
+        if (m_color_defaults.attr.back() != VTE_DEFAULT_BG) {
+                for (auto i = initial; i < _vte_ring_next(ring); i++)
+                        _vte_row_data_fill(_vte_ring_index_writable(ring, i),
+                                           &m_color_defaults, m_column_count);
+        }
 	/* Move the cursor and insertion delta to the first line in the
 	 * newly-cleared area and scroll if need be. */
         m_screen->insert_delta = initial;
         m_screen->cursor.row = row + m_screen->insert_delta;
         adjust_adjustments();
-	/* Redraw everything. */
-        invalidate_all();
+	/* Redraw everything. Unless the frame last painted is of the
+         * other screen, in which case it is still good for switching back. */
+        if (m_frame_screen == m_screen)
+                invalidate_all();
+        else
+                invalidate_view();
 	/* We've modified the display.  Make a note of it. */
         m_text_deleted_flag = TRUE;
 }
 
+/* Returns: whether the screen shows nothing, not even an image */
+bool
+Terminal::screen_is_blank() const
+{
+        auto ring = m_screen->row_data;
+        auto const start = m_screen->insert_delta;
+        auto const end = MIN(_vte_ring_next(ring), start + m_row_count);
+
+        for (auto i = start; i < end; i++) {
+                if (_vte_row_data_nonempty_length(_vte_ring_index(ring, i)) != 0)
+                        return false;
+        }
+
+        auto blank = true;
+        m_image_cache.for_each(image_screen(m_screen), start, start + m_row_count,
+                               [&](vte::base::Image const&) { blank = false; });
+        return blank;
+}
+
 /* Clear the current line. */
 void
 Terminal::clear_current_line()
@@ -332,15 +378,9 @@ Terminal::scroll_text(vte::grid::row_t scroll_amount)
                 end = start + m_row_count - 1;
 	}
 
-        while (_vte_ring_next(m_screen->row_data) <= end)
-                ring_append(false);
-
 	if (scroll_amount > 0) {
                 /* Scroll down. */
-		for (auto i = 0; i < scroll_amount; i++) {
-                        ring_remove(end);
-                        ring_insert(start, true);
-		}
+                ring_rotate(start, end, scroll_amount);
                 /* Set the boundaries to hard wrapped where we tore apart the contents.
                  * Need to do it after scrolling down, for the end row to be the desired one. */
                 set_hard_wrapped(start - 1);
@@ -351,10 +391,7 @@ Terminal::scroll_text(vte::grid::row_t scroll_amount)
                 set_hard_wrapped(start - 1);
                 set_hard_wrapped(end);
                 /* Scroll up. */
-		for (auto i = 0; i < -scroll_amount; i++) {
-                        ring_remove(start);
-                        ring_insert(end, true);
-		}
+                ring_rotate(start, end, scroll_amount);
 	}
 
         /* Repaint the affected lines. No need to extend, set_hard_wrapped() took care of
@@ -402,8 +439,11 @@ Terminal::switch_screen(VteScreen *new_screen)
         g_assert (m_hyperlink_hover_idx == 0);
         m_hyperlink_hover_uri = NULL;
         emit_hyperlink_hover_uri_changed(NULL);  /* FIXME only emit if really changed */
-        m_defaults.attr.hyperlink_idx = _vte_ring_get_hyperlink_idx(m_screen->row_data, NULL);
-        g_assert (m_defaults.attr.hyperlink_idx == 0);
+        m_hyperlink_idx = _vte_ring_get_hyperlink_idx(m_screen->row_data, NULL);
+        g_assert (m_hyperlink_idx == 0);
+
+        /* The copies refer to the rows of the screen switched away from */
+        selection_copied_serialize_all();
 
         /* cursor.row includes insert_delta, adjust accordingly */
         auto cr = m_screen->cursor.row - m_screen->insert_delta;
@@ -520,6 +560,14 @@ Terminal::set_mode_private(int mode,
                  */
                 break;
 
+        case vte::terminal::modes::Private::eVTE_SYNCHRONIZED_OUTPUT:
+                /* A nested BSU doesn't extend the timeout */
+                if (!set)
+                        end_synchronized_output();
+                else if (!m_synchronized_output_timer)
+                        m_synchronized_output_timer.schedule(VTE_SYNCHRONIZED_OUTPUT_TIMEOUT);
+                break;
+
         case vte::terminal::modes::Private::eXTERM_ALTBUF:
                 [[fallthrough]];
         case vte::terminal::modes::Private::eXTERM_OPT_ALTBUF:
@@ -550,7 +598,9 @@ Terminal::set_mode_private(int mode,
                                          m_screen->scroll_delta);
                 set_scrollback_lines(m_scrollback_lines);
                 queue_contents_changed();
-                invalidate_all();
+                /* The frames of the screens take care of themselves,
+                 * see Terminal::frame_switch_screen() */
+                invalidate_view();
                 break;
 
         case vte::terminal::modes::Private::eXTERM_SAVE_CURSOR:
@@ -656,6 +706,7 @@ Terminal::set_character_replacement(unsigned slot)
 {
         g_assert(slot < G_N_ELEMENTS(m_character_replacements));
         m_character_replacement = &m_character_replacements[slot];
+        update_charset_map();
 }
 
 /* Clear from the cursor position (inclusive!) to the beginning of the line. */
@@ -682,6 +733,7 @@ Terminal::clear_to_bol()
                         _vte_row_data_append (rowdata, &m_color_defaults);
 		}
 	}
+        _vte_row_data_set_hyperlink(rowdata, 0, m_screen->cursor.col + 1, 0);
         /* Repaint this row's paragraph. */
         invalidate_row_and_context(m_screen->cursor.row);
 
@@ -882,9 +934,9 @@ Terminal::set_cursor_coords1(vte::grid::row_t row,
         set_cursor_row1(row);
 }
 
-/* Delete a character at the current cursor position. */
+/* Delete @count characters at the current cursor position. */
 void
-Terminal::delete_character()
+Terminal::delete_characters(long count)
 {
 	VteRowData *rowdata;
 	long col;
@@ -905,11 +957,12 @@ Terminal::delete_character()
                         len = m_column_count;
                 }
 
-		/* Remove the column. */
+		/* Remove the columns. */
 		if (col < len) {
-                        /* Clean up Tab/CJK fragments. */
-                        cleanup_fragments(col, col + 1);
-			_vte_row_data_remove (rowdata, col);
+                        count = MIN(count, len - col);
+                        /* Clean up Tab/CJK fragments, once for the whole range. */
+                        cleanup_fragments(col, col + count);
+			_vte_row_data_remove_n (rowdata, col, count);
 
                         if (not_default_bg) {
                                 _vte_row_data_fill(rowdata, &m_color_defaults, m_column_count);
@@ -947,34 +1000,22 @@ Terminal::move_cursor_down(vte::grid::row_t rows)
 void
 Terminal::erase_characters(long count)
 {
-	VteCell *cell;
-	long col, i;
-
         ensure_cursor_is_onscreen();
 
+        /* Nothing past the end of the line can be erased. */
+        auto const col = m_screen->cursor.col;
+        count = MIN(count, m_column_count - col);
+
 	/* Clear out the given number of characters. */
 	auto rowdata = ensure_row();
         if (_vte_ring_next(m_screen->row_data) > m_screen->cursor.row) {
 		g_assert(rowdata != NULL);
                 /* Clean up Tab/CJK fragments. */
-                cleanup_fragments(m_screen->cursor.col, m_screen->cursor.col + count);
+                cleanup_fragments(col, col + count);
 		/* Write over the characters.  (If there aren't enough, we'll
 		 * need to create them.) */
-                _vte_row_data_fill (rowdata, &basic_cell, m_screen->cursor.col);
-		for (i = 0; i < count; i++) {
-                        col = m_screen->cursor.col + i;
-			if (col >= 0) {
-				if (col < (glong) _vte_row_data_length (rowdata)) {
-					/* Replace this cell with the current
-					 * defaults. */
-					cell = _vte_row_data_get_writable (rowdata, col);
-                                        *cell = m_color_defaults;
-				} else {
-					/* Add new cells until we have one here. */
-                                        _vte_row_data_fill (rowdata, &m_color_defaults, col + 1);
-				}
-			}
-		}
+                _vte_row_data_fill (rowdata, &basic_cell, col);
+                _vte_row_data_fill_range (rowdata, &m_color_defaults, col, col + count);
                 /* Repaint this row's paragraph. */
                 invalidate_row_and_context(m_screen->cursor.row);
 	}
@@ -983,15 +1024,41 @@ Terminal::erase_characters(long count)
         m_text_deleted_flag = TRUE;
 }
 
-/* Insert a blank character. */
+/* Insert @count blank characters, without moving the cursor.
+ *
+ * This is what insert_char(' ', true, true) did for each of them, but
+ * making room for all of them at once, and cleaning up fragments only
+ * at the insertion point and at the end of the line.
+ */
 void
-Terminal::insert_blank_character()
+Terminal::insert_blank_characters(long count)
 {
         ensure_cursor_is_onscreen();
 
-        auto save = m_screen->cursor;
-        insert_char(' ', true, true);
-        m_screen->cursor = save;
+        auto const col = m_screen->cursor.col;
+        count = MIN(count, m_column_count - col);
+        if (count <= 0)
+                return;
+
+        auto row = ensure_cursor();
+        g_assert(row != NULL);
+
+        VteCell cell = basic_cell;
+        cell.c = ' ';
+        cell.attr = m_defaults.attr;
+        cell.attr.set_columns(1);
+
+        cleanup_fragments(col, col);
+        _vte_row_data_insert_n(row, col, &cell, count);
+        if (_vte_row_data_length (row) > m_column_count)
+                cleanup_fragments(m_column_count, _vte_row_data_length (row));
+        _vte_row_data_shrink (row, m_column_count);
+
+        invalidate_row_and_context(m_screen->cursor.row);
+
+        m_last_graphic_character = ' ';
+        m_line_wrapped = false;
+	m_text_inserted_flag = TRUE;
 }
 
 void
@@ -1230,10 +1297,12 @@ Terminal::erase_in_display(vte::parser::Sequence const& seq)
 	case 0:
 		/* Clear below the current line. */
                 clear_below_current();
+                remove_images(m_screen->cursor.row, G_MAXLONG);
 		break;
 	case 1:
 		/* Clear above the current line. */
                 clear_above_current();
+                remove_images(m_screen->insert_delta, m_screen->cursor.row + 1);
 		/* Clear everything to the left of the cursor, too. */
 		/* FIXME: vttest. */
                 clear_to_bol();
@@ -1284,7 +1353,7 @@ Terminal::erase_in_line(vte::parser::Sequence const& seq)
 void
 Terminal::insert_lines(vte::grid::row_t param)
 {
-        vte::grid::row_t start, end, i;
+        vte::grid::row_t start, end;
 
 	/* Find the region we're messing with. */
         auto row = m_screen->cursor.row;
@@ -1306,12 +1375,9 @@ Terminal::insert_lines(vte::grid::row_t param)
         auto limit = end - row + 1;
         param = MIN (param, limit);
 
-	for (i = 0; i < param; i++) {
-		/* Clear a line off the end of the region and add one to the
-		 * top of the region. */
-                ring_remove(end);
-                ring_insert(row, true);
-	}
+        /* Clear lines off the end of the region and add them to the
+         * top of the region. */
+        ring_rotate(row, end, param);
 
         /* Set the boundaries to hard wrapped where we tore apart the contents.
          * Need to do it after scrolling down, for the end row to be the desired one. */
@@ -1332,7 +1398,7 @@ Terminal::insert_lines(vte::grid::row_t param)
 void
 Terminal::delete_lines(vte::grid::row_t param)
 {
-        vte::grid::row_t start, end, i;
+        vte::grid::row_t start, end;
 
 	/* Find the region we're messing with. */
         auto row = m_screen->cursor.row;
@@ -1359,13 +1425,9 @@ Terminal::delete_lines(vte::grid::row_t param)
         auto limit = end - row + 1;
         param = MIN (param, limit);
 
-	/* Clear them from below the current cursor. */
-	for (i = 0; i < param; i++) {
-		/* Insert a line at the end of the region and remove one from
-		 * the top of the region. */
-                ring_remove(row);
-                ring_insert(end, true);
-	}
+	/* Clear them from below the current cursor, adding lines at
+	 * the end of the region. */
+        ring_rotate(row, end, -param);
         m_screen->cursor.col = 0;
 
         /* Repaint the affected lines. No need to extend, set_hard_wrapped() took care of
@@ -1545,6 +1607,36 @@ Terminal::set_current_directory_uri(vte::parser::Sequence const& seq,
         m_current_directory_uri_changed = true;
 }
 
+/*
+ * Shell integration marks where the prompts, command lines and the output
+ * of the commands start, and where the commands finish:
+ *   OSC 133 ; A ST, OSC 133 ; B ST, OSC 133 ; C ST, OSC 133 ; D [; status] ST
+ * Further parameters, as some shells send, are ignored.
+ */
+void
+Terminal::set_shell_mark(vte::parser::Sequence const& seq,
+                         vte::parser::StringTokeniser::const_iterator& token,
+                         vte::parser::StringTokeniser::const_iterator const& endtoken) noexcept
+{
+        if (token == endtoken || token.size() != 1)
+                return;
+
+        auto kind = VteShellMark{};
+        switch ((*token)[0]) {
+        case 'A': kind = VTE_SHELL_MARK_PROMPT; break;
+        case 'B': kind = VTE_SHELL_MARK_COMMAND; break;
+        case 'C': kind = VTE_SHELL_MARK_OUTPUT; break;
+        case 'D': kind = VTE_SHELL_MARK_END; break;
+        default: return;
+        }
+
+        auto status = -1;
+        if (kind == VTE_SHELL_MARK_END && ++token != endtoken && !token.number(status))
+                status = -1;
+
+        add_shell_mark(kind, status);
+}
+
 void
 Terminal::set_current_file_uri(vte::parser::Sequence const& seq,
                                          vte::parser::StringTokeniser::const_iterator& token,
@@ -1638,7 +1730,7 @@ Terminal::set_current_hyperlink(vte::parser::Sequence const& seq,
                 idx = _vte_ring_get_hyperlink_idx(m_screen->row_data, nullptr);
         }
 
-        m_defaults.attr.hyperlink_idx = idx;
+        m_hyperlink_idx = idx;
 }
 
 /*
@@ -2376,7 +2468,7 @@ Terminal::DA1(vte::parser::Sequence const& seq)
         if (seq.collect1(0, 0) != 0)
                 return;
 
-        reply(seq, VTE_REPLY_DECDA1R, {65, 1, 9});
+        reply(seq, VTE_REPLY_DECDA1R, {65, 1, 4, 9});
 }
 
 void
@@ -2526,10 +2618,7 @@ Terminal::DCH(vte::parser::Sequence const& seq)
 
         auto const value = seq.collect1(0, 1, 1, int(m_column_count - m_screen->cursor.col));
 
-        // FIXMEchpe pass count to delete_character() and simplify
-        // to only cleanup fragments once
-        for (auto i = 0; i < value; i++)
-                delete_character();
+        delete_characters(value);
 }
 
 void
@@ -4319,9 +4408,73 @@ Terminal::DECSIXEL(vte::parser::Sequence const& seq)
 {
         /*
          * DECSIXEL - SIXEL graphics
+         * Draws the image in DATA at the cursor, and moves the cursor
+         * to the row below the image, at the column the image starts in,
+         * scrolling as needed.
+         *
+         * Arguments:
+         *   args[0]: pixel aspect ratio (ignored)
+         *   args[1]: background select
+         *     0, 2: the pixels not drawn get the background colour
+         *     1: the pixels not drawn stay transparent
+         *   args[2]: horizontal grid size (ignored)
+         *
+         * Defaults:
+         *   args[0]: 0
+         *   args[1]: 0
+         *   args[2]: 0
+         *
+         * The parser hands DATA out in chunks, see
+         * vte::parser::Sequence::string_chunk(); all but the last one
+         * come as VTE_SEQ_DCS_DATA.
+         *
+         * Pixels are always square, and the sixel display mode (DECSDM)
+         * is not supported; images always start at the cursor.
          *
          * References: VT330
          */
+
+        if (seq.string_chunk() == 0) {
+                if (!m_sixel_decoder)
+                        m_sixel_decoder = std::make_unique<vte::base::SixelDecoder>();
+                m_sixel_decoder->begin(seq.param(1, 0) == 1);
+        } else if (!m_sixel_decoder) {
+                return;
+        }
+
+        m_sixel_decoder->feed(seq.string());
+        if (seq.type() == VTE_SEQ_DCS_DATA)
+                return;
+
+        auto decoder = std::move(m_sixel_decoder);
+        if (m_cell_width <= 0 || m_cell_height <= 0)
+                return;
+
+        vte::color::rgb bg;
+        rgb_from_index<8, 8, 8>(m_color_defaults.attr.back(), bg);
+        auto const background = 0xff000000u | (bg.red >> 8) << 16 | (bg.green >> 8) << 8 | (bg.blue >> 8);
+
+        auto pixels = std::vector<uint32_t>{};
+        unsigned width, height;
+        if (!decoder->finish(background, pixels, width, height))
+                return;
+
+        /* Keep the decoder for the next image, but not its memory */
+        m_sixel_decoder = std::move(decoder);
+
+        ensure_cursor_is_onscreen();
+        auto const row = m_screen->cursor.row;
+        auto const col = get_cursor_column();
+        auto const n_rows = (long(height) + m_cell_height - 1) / m_cell_height;
+        auto const n_columns = (long(width) + m_cell_width - 1) / m_cell_width;
+        m_image_cache.add(std::move(pixels), width, height,
+                          image_screen(m_screen), row, col, n_rows, n_columns);
+
+        for (auto i = 0; i < n_rows; ++i)
+                cursor_down(true);
+        set_cursor_column(col);
+
+        invalidate_rows(row, row + n_rows - 1);
 }
 
 void
@@ -5373,7 +5526,7 @@ Terminal::ECH(vte::parser::Sequence const& seq)
         /* Erase characters starting at the cursor position (overwriting N with
          * spaces, but not moving the cursor). */
 
-        // FIXMEchpe limit to column_count - cursor.x ?
+        /* erase_characters() limits this to the rest of the line */
         auto const count = seq.collect1(0, 1, 1, int(65535));
         erase_characters(count);
 }
@@ -5734,6 +5887,7 @@ Terminal::GnDm(vte::parser::Sequence const& seq)
                 return;
 
         m_character_replacements[slot] = replacement;
+        update_charset_map();
 }
 
 void
@@ -5948,9 +6102,7 @@ Terminal::ICH(vte::parser::Sequence const& seq)
 
         auto const count = seq.collect1(0, 1, 1, int(m_column_count - m_screen->cursor.col));
 
-        /* TODOegmont: Insert them in a single run, so that we call cleanup_fragments only once. */
-        for (auto i = 0; i < count; i++)
-                insert_blank_character();
+        insert_blank_characters(count);
 }
 
 void
@@ -6385,8 +6537,8 @@ Terminal::OSC(vte::parser::Sequence const& seq)
          * First, extract the number.
          */
 
-        auto str = seq.string_utf8();
-        vte::parser::StringTokeniser tokeniser{str, ';'};
+        seq.string_utf8(m_osc_string);
+        vte::parser::StringTokeniser tokeniser{m_osc_string, ';'};
         auto it = tokeniser.cbegin();
         int osc;
         if (!it.number(osc))
@@ -6408,6 +6560,10 @@ Terminal::OSC(vte::parser::Sequence const& seq)
                 set_current_hyperlink(seq, it, cend);
                 break;
 
+        case VTE_OSC_ITERM2_133:
+                set_shell_mark(seq, it, cend);
+                break;
+
         case -1: /* default */
         case VTE_OSC_XTERM_SET_WINDOW_AND_ICON_TITLE:
         case VTE_OSC_XTERM_SET_WINDOW_TITLE: {
@@ -6488,7 +6644,6 @@ Terminal::OSC(vte::parser::Sequence const& seq)
         case VTE_OSC_XTERM_RESET_COLOR_TEK_BG:
         case VTE_OSC_XTERM_RESET_COLOR_TEK_CURSOR:
         case VTE_OSC_EMACS_51:
-        case VTE_OSC_ITERM2_133:
         case VTE_OSC_ITERM2_1337:
         case VTE_OSC_ITERM2_GROWL:
         case VTE_OSC_KONSOLE_30:
@@ -6734,9 +6889,18 @@ Terminal::REP(vte::parser::Sequence const& seq)
 
         auto const count = seq.collect1(0, 1, 1, int(m_column_count - m_screen->cursor.col));
 
-        // FIXMEchpe insert in one run so we only clean up fragments once
-        for (auto i = 0; i < count; i++)
-                insert_char(m_last_graphic_character, false, true);
+        /* Insert them as runs, so fragments are only cleaned up at their ends */
+        gunichar run[VTE_GRAPHIC_RUN_MAX];
+        auto const c = m_last_graphic_character;
+        auto const row_start = m_screen->cursor.row;
+        std::fill(run, run + std::min(count, int(G_N_ELEMENTS(run))), c);
+        for (auto n = count; n > 0; ) {
+                auto const len = std::min(n, int(G_N_ELEMENTS(run)));
+                insert_chars(run, size_t(len));
+                n -= len;
+        }
+
+        invalidate_rows_and_context(row_start, m_screen->cursor.row);
 }
 
 void
@@ -6767,8 +6931,7 @@ Terminal::RI(vte::parser::Sequence const& seq)
         if (m_screen->cursor.row == start) {
 		/* If we're at the top of the scrolling region, add a
 		 * line at the top to scroll the bottom off. */
-		ring_remove(end);
-		ring_insert(start, true);
+                ring_rotate(start, end, 1);
 
                 /* Set the boundaries to hard wrapped where we tore apart the contents.
                  * Need to do it after scrolling down, for the end row to be the desired one. */
@@ -7111,47 +7274,39 @@ Terminal::SEF(vte::parser::Sequence const& seq)
          */
 }
 
-void
-Terminal::SGR(vte::parser::Sequence const& seq)
+/*
+ * apply_sgr:
+ * @seq: a SGR sequence
+ * @attr: the attributes to modify
+ *
+ * Applies the parameters of @seq to @attr. This only depends on @seq,
+ * so that its effect can be cached; see SGR().
+ *
+ * Returns: whether @seq contained a reset
+ */
+bool
+Terminal::apply_sgr(vte::parser::Sequence const& seq,
+                    VteCellAttr& attr) const noexcept
 {
-        /*
-         * SGR - select-graphics-rendition
-         * Selects the character attributes to use for newly inserted
-         * characters.
-         *
-         * Arguments:
-         *   args[0:]: the attributes
-         *     0 = reset all attributes
-         *
-         * Defaults:
-         *   args[0]: 0 (reset all attributes)
-         *
-         * References: ECMA-48 § 8.3.117
-         *             VT525
-         */
         auto const n_params = seq.size();
-
-	/* If we had no parameters, default to the defaults. */
-	if (n_params == 0) {
-                reset_default_attributes(false);
-                return;
-	}
+        auto reset = false;
 
         for (unsigned int i = 0; i < n_params; i = seq.next(i)) {
                 auto const param = seq.param(i);
                 switch (param) {
                 case -1:
                 case VTE_SGR_RESET_ALL:
-                        reset_default_attributes(false);
+                        attr = basic_cell.attr;
+                        reset = true;
                         break;
                 case VTE_SGR_SET_BOLD:
-                        m_defaults.attr.set_bold(true);
+                        attr.set_bold(true);
                         break;
                 case VTE_SGR_SET_DIM:
-                        m_defaults.attr.set_dim(true);
+                        attr.set_dim(true);
                         break;
                 case VTE_SGR_SET_ITALIC:
-                        m_defaults.attr.set_italic(true);
+                        attr.set_italic(true);
                         break;
                 case VTE_SGR_SET_UNDERLINE: {
                         unsigned int v = 1;
@@ -7159,105 +7314,168 @@ Terminal::SGR(vte::parser::Sequence const& seq)
                         if (seq.param_nonfinal(i)) {
                                 v = seq.param(i + 1, 1, 0, 3);
                         }
-                        m_defaults.attr.set_underline(v);
+                        attr.set_underline(v);
                         break;
                 }
                 case VTE_SGR_SET_BLINK:
                 case VTE_SGR_SET_BLINK_RAPID:
-                        m_defaults.attr.set_blink(true);
+                        attr.set_blink(true);
                         break;
                 case VTE_SGR_SET_REVERSE:
-                        m_defaults.attr.set_reverse(true);
+                        attr.set_reverse(true);
                         break;
                 case VTE_SGR_SET_INVISIBLE:
-                        m_defaults.attr.set_invisible(true);
+                        attr.set_invisible(true);
                         break;
                 case VTE_SGR_SET_STRIKETHROUGH:
-                        m_defaults.attr.set_strikethrough(true);
+                        attr.set_strikethrough(true);
                         break;
                 case VTE_SGR_SET_UNDERLINE_DOUBLE:
-                        m_defaults.attr.set_underline(2);
+                        attr.set_underline(2);
                         break;
                 case VTE_SGR_RESET_BOLD_AND_DIM:
-                        m_defaults.attr.unset(VTE_ATTR_BOLD_MASK | VTE_ATTR_DIM_MASK);
+                        attr.unset(VTE_ATTR_BOLD_MASK | VTE_ATTR_DIM_MASK);
                         break;
                 case VTE_SGR_RESET_ITALIC:
-                        m_defaults.attr.set_italic(false);
+                        attr.set_italic(false);
                         break;
                 case VTE_SGR_RESET_UNDERLINE:
-                        m_defaults.attr.set_underline(0);
+                        attr.set_underline(0);
                         break;
                 case VTE_SGR_RESET_BLINK:
-                        m_defaults.attr.set_blink(false);
+                        attr.set_blink(false);
                         break;
                 case VTE_SGR_RESET_REVERSE:
-                        m_defaults.attr.set_reverse(false);
+                        attr.set_reverse(false);
                         break;
                 case VTE_SGR_RESET_INVISIBLE:
-                        m_defaults.attr.set_invisible(false);
+                        attr.set_invisible(false);
                         break;
                 case VTE_SGR_RESET_STRIKETHROUGH:
-                        m_defaults.attr.set_strikethrough(false);
+                        attr.set_strikethrough(false);
                         break;
                 case VTE_SGR_SET_FORE_LEGACY_START ... VTE_SGR_SET_FORE_LEGACY_END:
-                        m_defaults.attr.set_fore(VTE_LEGACY_COLORS_OFFSET + (param - 30));
+                        attr.set_fore(VTE_LEGACY_COLORS_OFFSET + (param - 30));
                         break;
                 case VTE_SGR_SET_FORE_SPEC: {
                         uint32_t fore;
                         if (G_LIKELY((seq_parse_sgr_color<8, 8, 8>(seq, i, fore))))
-                                m_defaults.attr.set_fore(fore);
+                                attr.set_fore(fore);
                         break;
                 }
                 case VTE_SGR_RESET_FORE:
                         /* default foreground */
-                        m_defaults.attr.set_fore(VTE_DEFAULT_FG);
+                        attr.set_fore(VTE_DEFAULT_FG);
                         break;
                 case VTE_SGR_SET_BACK_LEGACY_START ... VTE_SGR_SET_BACK_LEGACY_END:
-                        m_defaults.attr.set_back(VTE_LEGACY_COLORS_OFFSET + (param - 40));
+                        attr.set_back(VTE_LEGACY_COLORS_OFFSET + (param - 40));
                         break;
                 case VTE_SGR_SET_BACK_SPEC: {
                         uint32_t back;
                         if (G_LIKELY((seq_parse_sgr_color<8, 8, 8>(seq, i, back))))
-                                m_defaults.attr.set_back(back);
+                                attr.set_back(back);
                         break;
                 }
                 case VTE_SGR_RESET_BACK:
                         /* default background */
-                        m_defaults.attr.set_back(VTE_DEFAULT_BG);
+                        attr.set_back(VTE_DEFAULT_BG);
                         break;
                 case VTE_SGR_SET_OVERLINE:
-                        m_defaults.attr.set_overline(true);
+                        attr.set_overline(true);
                         break;
                 case VTE_SGR_RESET_OVERLINE:
-                        m_defaults.attr.set_overline(false);
+                        attr.set_overline(false);
                         break;
                 case VTE_SGR_SET_DECO_SPEC: {
                         uint32_t deco;
                         if (G_LIKELY((seq_parse_sgr_color<4, 5, 4>(seq, i, deco))))
-                                m_defaults.attr.set_deco(deco);
+                                attr.set_deco(deco);
                         break;
                 }
                 case VTE_SGR_SET_SEPARATED_MOSAIC:
-                        m_defaults.attr.set_separated_mosaic(true);
+                        attr.set_separated_mosaic(true);
                         break;
                 case VTE_SGR_RESET_SEPARATED_MOSAIC:
-                        m_defaults.attr.set_separated_mosaic(false);
+                        attr.set_separated_mosaic(false);
                         break;
                 case VTE_SGR_RESET_DECO:
                         /* default decoration color, that is, same as the cell's foreground */
-                        m_defaults.attr.set_deco(VTE_DEFAULT_FG);
+                        attr.set_deco(VTE_DEFAULT_FG);
                         break;
                 case VTE_SGR_SET_FORE_LEGACY_BRIGHT_START ... VTE_SGR_SET_FORE_LEGACY_BRIGHT_END:
-                        m_defaults.attr.set_fore(VTE_LEGACY_COLORS_OFFSET + (param - 90) +
+                        attr.set_fore(VTE_LEGACY_COLORS_OFFSET + (param - 90) +
                                                  VTE_COLOR_BRIGHT_OFFSET);
                         break;
                 case VTE_SGR_SET_BACK_LEGACY_BRIGHT_START ... VTE_SGR_SET_BACK_LEGACY_BRIGHT_END:
-                        m_defaults.attr.set_back(VTE_LEGACY_COLORS_OFFSET + (param - 100) +
+                        attr.set_back(VTE_LEGACY_COLORS_OFFSET + (param - 100) +
                                                  VTE_COLOR_BRIGHT_OFFSET);
                         break;
                 }
         }
 
+
+        return reset;
+}
+
+void
+Terminal::SGR(vte::parser::Sequence const& seq)
+{
+        /*
+         * SGR - select-graphics-rendition
+         * Selects the character attributes to use for newly inserted
+         * characters.
+         *
+         * Arguments:
+         *   args[0:]: the attributes
+         *     0 = reset all attributes
+         *
+         * Defaults:
+         *   args[0]: 0 (reset all attributes)
+         *
+         * References: ECMA-48 § 8.3.117
+         *             VT525
+         */
+        auto const n_params = seq.size();
+
+	/* If we had no parameters, default to the defaults. */
+	if (n_params == 0) {
+                reset_default_attributes(false);
+                return;
+	}
+
+        vte::base::SGRCache<vte_seq_arg_t>::Delta delta;
+        if (auto const cached = m_sgr_cache.lookup(seq.args(), n_params)) {
+                delta = *cached;
+        } else {
+                /* Probe with all attribute bits clear and all set; whatever
+                 * comes out the same either way is what @seq determines.
+                 */
+                auto zero = basic_cell.attr;
+                zero.attr = 0;
+                zero.m_colors = 0;
+                auto ones = basic_cell.attr;
+                ones.attr = ~uint32_t{0};
+                ones.m_colors = ~uint64_t{0};
+
+                auto const reset = apply_sgr(seq, zero);
+                apply_sgr(seq, ones);
+                delta = decltype(delta)::from_probes(zero, ones, reset);
+                m_sgr_cache.insert(seq.args(), n_params, delta);
+        }
+
+        _vte_debug_print(VTE_DEBUG_PARSER,
+                         "SGR cache: %lu hits, %lu misses\n",
+                         m_sgr_cache.hits(), m_sgr_cache.misses());
+
+        if (delta.reset) {
+                /* Same as reset_default_attributes(false), except that the
+                 * attributes proper are fully determined by the delta.
+                 */
+                m_defaults.c = basic_cell.c;
+                m_color_defaults = basic_cell;
+        }
+        delta.apply(m_defaults.attr);
+
 	/* Save the new colors. */
         m_color_defaults.attr.copy_colors(m_defaults.attr);
 }
@@ -8313,7 +8531,16 @@ Terminal::XDGSYNC(vte::parser::Sequence const& seq)
          * References: https://gitlab.com/gnachman/iterm2/wikis/synchronized-updates-spec
          */
 
-        /* TODO: implement this! https://gitlab.gnome.org/GNOME/vte/issues/15 */
+        switch (seq.collect1(0)) {
+        case 1:
+                set_mode_private(vte::terminal::modes::Private::eVTE_SYNCHRONIZED_OUTPUT, true);
+                break;
+        case 2:
+                set_mode_private(vte::terminal::modes::Private::eVTE_SYNCHRONIZED_OUTPUT, false);
+                break;
+        default:
+                break;
+        }
 }
 
 void
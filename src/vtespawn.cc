@@ -69,11 +69,27 @@
  * stream interfaces for communication with child processes.
  */
 
+/* What g_execute() needs allocated, beforehand, since the child may
+ * share the parent's memory; see fork_exec_with_pipes(). */
+typedef struct
+{
+  const gchar  *path;         /* the search path, or NULL */
+  gchar        *search_buf;   /* for the names tried along @path */
+  gchar       **script_argv;  /* for running a script with /bin/sh */
+} ExecBuffers;
+
+static void exec_buffers_init (ExecBuffers  *buffers,
+                               const gchar  *file,
+                               gchar       **argv,
+                               gchar       **envp,
+                               gboolean      search_path,
+                               gboolean      search_path_from_envp);
+static void exec_buffers_clear (ExecBuffers *buffers);
+
 static gint g_execute (const gchar  *file,
                        gchar **argv,
                        gchar **envp,
-                       gboolean search_path,
-                       gboolean search_path_from_envp);
+                       ExecBuffers *buffers);
 
 static gboolean fork_exec_with_pipes (gboolean              intermediate_child,
                                       const gchar          *working_directory,
@@ -87,6 +103,7 @@ static gboolean fork_exec_with_pipes (gboolean              intermediate_child,
                                       gboolean              child_inherits_stdin,
                                       gboolean              file_and_argv_zero,
                                       gboolean              cloexec_pipes,
+                                      gboolean              child_setup_vfork_safe,
                                       GSpawnChildSetupFunc  child_setup,
                                       gpointer              user_data,
                                       GPid                 *child_pid,
@@ -163,6 +180,15 @@ close_and_invalidate (gint *fd)
     }
 }
 
+/* Like close_and_invalidate(), for the child, which leaves @fd's variable
+ * alone since it may be the parent's; see fork_exec_with_pipes(). */
+static void
+close_in_child (gint fd)
+{
+  if (fd >= 0)
+    (void)close(fd);
+}
+
 /*
  * vte_spawn_async_with_pipes_cancellable:
  * @working_directory: (type filename) (allow-none): child's current working directory, or %NULL to inherit parent's, in the GLib file name encoding
@@ -230,6 +256,7 @@ vte_spawn_async_with_pipes_cancellable (const gchar          *working_directory,
                                (flags & G_SPAWN_CHILD_INHERITS_STDIN) != 0,
                                (flags & G_SPAWN_FILE_AND_ARGV_ZERO) != 0,
                                (flags & G_SPAWN_CLOEXEC_PIPES) != 0,
+                               (flags & VTE_SPAWN_CHILD_SETUP_VFORK_SAFE) != 0,
                                child_setup,
                                user_data,
                                child_pid,
@@ -348,6 +375,12 @@ exec_err_to_g_error (gint en)
     }
 }
 
+gint
+vte_spawn_exec_error_from_errno (gint en)
+{
+  return exec_err_to_g_error (en);
+}
+
 static gssize
 write_all (gint fd, gconstpointer vbuf, gsize to_write)
 {
@@ -525,9 +558,46 @@ fdwalk (int (*cb)(void *data, int fd), void *data)
 }
 #endif /* HAVE_FDWALK */
 
+#if defined(__linux__) && defined(SYS_close_range)
+#ifndef CLOSE_RANGE_CLOEXEC
+#define CLOSE_RANGE_CLOEXEC (1U << 2)
+#endif
+
+/* close_range() is in the kernel since Linux 5.9, and its
+ * CLOSE_RANGE_CLOEXEC flag since 5.11; the C library may not have
+ * it yet. It needs no loop over the descriptor table, unlike fdwalk(),
+ * whose fallback goes up to RLIMIT_NOFILE.
+ *
+ * Returns: 0 on success, or -1 if not supported
+ */
+static int
+sys_close_range (unsigned int lowfd,
+                 unsigned int flags)
+{
+  return syscall (SYS_close_range, lowfd, ~0U, flags);
+}
+#endif
+
+/* Sets FD_CLOEXEC on all file descriptors from @lowfd on. */
+static void
+safe_set_cloexec_from (int lowfd)
+{
+#if defined(__linux__) && defined(SYS_close_range)
+  if (sys_close_range (lowfd, CLOSE_RANGE_CLOEXEC) == 0)
+    return;
+#endif
+
+  (void) fdwalk (set_cloexec, GINT_TO_POINTER (lowfd));
+}
+
 static void
 safe_closefrom (int lowfd)
 {
+#if defined(__linux__) && defined(SYS_close_range)
+  if (sys_close_range (lowfd, 0) == 0)
+    return;
+#endif
+
 #if defined(__FreeBSD__) || defined(__OpenBSD__)
   /* Use closefrom function provided by the system if it is known to be
    * async-signal safe.
@@ -598,12 +668,11 @@ do_exec (gint                  child_err_report_fd,
          gchar               **argv,
          gchar               **envp,
          gboolean              close_descriptors,
-         gboolean              search_path,
-         gboolean              search_path_from_envp,
          gboolean              stdout_to_null,
          gboolean              stderr_to_null,
          gboolean              child_inherits_stdin,
          gboolean              file_and_argv_zero,
+         ExecBuffers          *exec_buffers,
          GSpawnChildSetupFunc  child_setup,
          gpointer              user_data)
 {
@@ -686,7 +755,7 @@ do_exec (gint                  child_err_report_fd,
         }
       else
         {
-          fdwalk (set_cloexec, GINT_TO_POINTER (3));
+          safe_set_cloexec_from (3);
         }
     }
   else
@@ -703,7 +772,7 @@ do_exec (gint                  child_err_report_fd,
 
   g_execute (argv[0],
              file_and_argv_zero ? argv + 1 : argv,
-             envp, search_path, search_path_from_envp);
+             envp, exec_buffers);
 
   /* Exec failed */
   write_err_and_exit (child_err_report_fd,
@@ -848,6 +917,7 @@ fork_exec_with_pipes (gboolean              intermediate_child,
                       gboolean              child_inherits_stdin,
                       gboolean              file_and_argv_zero,
                       gboolean              cloexec_pipes,
+                      gboolean              child_setup_vfork_safe,
                       GSpawnChildSetupFunc  child_setup,
                       gpointer              user_data,
                       GPid                 *child_pid,
@@ -865,6 +935,9 @@ fork_exec_with_pipes (gboolean              intermediate_child,
   gint child_err_report_pipe[2] = { -1, -1 };
   gint child_pid_report_pipe[2] = { -1, -1 };
   guint pipe_flags = cloexec_pipes ? FD_CLOEXEC : 0;
+  ExecBuffers exec_buffers = { NULL, NULL, NULL };
+  gboolean vforked = FALSE;
+  sigset_t saved_sigmask;
 
   g_assert(!intermediate_child);
 
@@ -880,7 +953,32 @@ fork_exec_with_pipes (gboolean              intermediate_child,
   if (standard_error && !g_unix_open_pipe (stderr_pipe, FD_CLOEXEC, error))
     goto cleanup_and_fail;
 
-  pid = fork ();
+  exec_buffers_init (&exec_buffers,
+                     argv[0],
+                     file_and_argv_zero ? argv + 1 : argv,
+                     envp, search_path, search_path_from_envp);
+
+#ifdef HAVE_VFORK
+  if (child_setup_vfork_safe)
+    {
+      /* Spare copying our page tables, which takes long in a large
+       * process. The child then runs in our memory, on our stack, until
+       * it execs or exits while we wait; so it must only make calls that
+       * are async-signal-safe, and leave our variables alone, except
+       * for @pid. None of our signal handlers may run in it either, so
+       * the signals stay blocked until it has reset the handlers.
+       */
+      sigset_t all;
+      sigfillset (&all);
+      pthread_sigmask (SIG_SETMASK, &all, &saved_sigmask);
+      vforked = TRUE;
+      pid = vfork ();
+      if (pid != 0)
+        pthread_sigmask (SIG_SETMASK, &saved_sigmask, NULL);
+    }
+  else
+#endif
+    pid = fork ();
 
   if (pid < 0)
     {
@@ -911,15 +1009,32 @@ fork_exec_with_pipes (gboolean              intermediate_child,
        */
       signal (SIGPIPE, SIG_DFL);
 
+      if (vforked)
+        {
+          /* The handlers of the parent are still set, unlike after
+           * fork(); reset them as execve() would before letting the
+           * signals in.
+           */
+          for (int n = 1; n < NSIG; n++)
+            {
+              struct sigaction sa;
+              if (sigaction (n, NULL, &sa) == 0 &&
+                  sa.sa_handler != SIG_DFL &&
+                  sa.sa_handler != SIG_IGN)
+                signal (n, SIG_DFL);
+            }
+          pthread_sigmask (SIG_SETMASK, &saved_sigmask, NULL);
+        }
+
       /* Close the parent's end of the pipes;
        * not needed in the close_descriptors case,
        * though
        */
-      close_and_invalidate (&child_err_report_pipe[0]);
-      close_and_invalidate (&child_pid_report_pipe[0]);
-      close_and_invalidate (&stdin_pipe[1]);
-      close_and_invalidate (&stdout_pipe[0]);
-      close_and_invalidate (&stderr_pipe[0]);
+      close_in_child (child_err_report_pipe[0]);
+      close_in_child (child_pid_report_pipe[0]);
+      close_in_child (stdin_pipe[1]);
+      close_in_child (stdout_pipe[0]);
+      close_in_child (stderr_pipe[0]);
       
       do_exec (child_err_report_pipe[1],
                stdin_pipe[0],
@@ -929,12 +1044,11 @@ fork_exec_with_pipes (gboolean              intermediate_child,
                argv,
                envp,
                close_descriptors,
-               search_path,
-               search_path_from_envp,
                stdout_to_null,
                stderr_to_null,
                child_inherits_stdin,
                file_and_argv_zero,
+               &exec_buffers,
                child_setup,
                user_data);
     }
@@ -945,6 +1059,8 @@ fork_exec_with_pipes (gboolean              intermediate_child,
       gint buf[2];
       gint n_ints = 0;    
 
+      exec_buffers_clear (&exec_buffers);
+
       /* Close the uncared-about ends of the pipes */
       close_and_invalidate (&child_err_report_pipe[1]);
       close_and_invalidate (&child_pid_report_pipe[1]);
@@ -1052,51 +1168,93 @@ fork_exec_with_pipes (gboolean              intermediate_child,
   close_and_invalidate (&stderr_pipe[0]);
   close_and_invalidate (&stderr_pipe[1]);
 
+  exec_buffers_clear (&exec_buffers);
+
   return FALSE;
 }
 
 /* Based on execvp from GNU C Library */
 
 static void
-script_execute (const gchar *file,
-                gchar      **argv,
-                gchar      **envp)
+script_execute (const gchar  *file,
+                gchar       **argv,
+                gchar       **envp,
+                gchar       **new_argv)
 {
   /* Count the arguments.  */
   int argc = 0;
   while (argv[argc])
     ++argc;
   
-  /* Construct an argument list for the shell.  */
-  {
-    gchar **new_argv;
-
-    new_argv = g_new0 (gchar*, argc + 2); /* /bin/sh and NULL */
-    
-    new_argv[0] = (char *) "/bin/sh";
-    new_argv[1] = (char *) file;
-    while (argc > 0)
-      {
-	new_argv[argc + 1] = argv[argc];
-	--argc;
-      }
-
-    /* Execute the shell. */
-    if (envp)
-      execve (new_argv[0], new_argv, envp);
-    else
-      execv (new_argv[0], new_argv);
-    
-    g_free (new_argv);
-  }
+  /* Construct an argument list for the shell, in @new_argv which has
+   * room for /bin/sh and the terminating NULL.  */
+  new_argv[0] = (char *) "/bin/sh";
+  new_argv[1] = (char *) file;
+  new_argv[argc + 1] = NULL;
+  while (argc > 0)
+    {
+      new_argv[argc + 1] = argv[argc];
+      --argc;
+    }
+
+  /* Execute the shell. */
+  if (envp)
+    execve (new_argv[0], new_argv, envp);
+  else
+    execv (new_argv[0], new_argv);
+}
+
+static void
+exec_buffers_init (ExecBuffers  *buffers,
+                   const gchar  *file,
+                   gchar       **argv,
+                   gchar       **envp,
+                   gboolean      search_path,
+                   gboolean      search_path_from_envp)
+{
+  buffers->script_argv = g_new0 (gchar*, g_strv_length (argv) + 2);
+
+  buffers->path = NULL;
+  buffers->search_buf = NULL;
+  if (!(search_path || search_path_from_envp) || strchr (file, '/') != NULL)
+    return;
+
+  if (search_path_from_envp)
+    buffers->path = g_environ_getenv (envp, "PATH");
+  if (search_path && buffers->path == NULL)
+    buffers->path = g_getenv ("PATH");
+
+  if (buffers->path == NULL)
+    {
+      /* There is no 'PATH' in the environment.  The default
+       * search path in libc is the current directory followed by
+       * the path 'confstr' returns for '_CS_PATH'.
+       */
+
+      /* In GLib we put . last, for security, and don't use the
+       * unportable confstr(); UNIX98 does not actually specify
+       * what to search if PATH is unset. POSIX may, dunno.
+       */
+
+      buffers->path = "/bin:/usr/bin:.";
+    }
+
+  buffers->search_buf = (char*)g_malloc (strlen (buffers->path) + strlen (file) + 2);
+}
+
+static void
+exec_buffers_clear (ExecBuffers *buffers)
+{
+  g_clear_pointer (&buffers->search_buf, g_free);
+  g_clear_pointer (&buffers->script_argv, g_free);
+  buffers->path = NULL;
 }
 
 static gint
-g_execute (const gchar *file,
-           gchar      **argv,
-           gchar      **envp,
-           gboolean     search_path,
-           gboolean     search_path_from_envp)
+g_execute (const gchar  *file,
+           gchar       **argv,
+           gchar       **envp,
+           ExecBuffers  *buffers)
 {
   if (*file == '\0')
     {
@@ -1105,7 +1263,7 @@ g_execute (const gchar *file,
       return -1;
     }
 
-  if (!(search_path || search_path_from_envp) || strchr (file, '/') != NULL)
+  if (buffers->path == NULL)
     {
       /* Don't search when it contains a slash. */
       if (envp)
@@ -1114,40 +1272,21 @@ g_execute (const gchar *file,
         execv (file, argv);
       
       if (errno == ENOEXEC)
-	script_execute (file, argv, envp);
+	script_execute (file, argv, envp, buffers->script_argv);
     }
   else
     {
       gboolean got_eacces = 0;
       const gchar *path, *p;
-      gchar *name, *freeme;
+      gchar *name;
       gsize len;
       gsize pathlen;
 
-      path = NULL;
-      if (search_path_from_envp)
-        path = g_environ_getenv (envp, "PATH");
-      if (search_path && path == NULL)
-        path = g_getenv ("PATH");
-
-      if (path == NULL)
-	{
-	  /* There is no 'PATH' in the environment.  The default
-	   * search path in libc is the current directory followed by
-	   * the path 'confstr' returns for '_CS_PATH'.
-           */
-
-          /* In GLib we put . last, for security, and don't use the
-           * unportable confstr(); UNIX98 does not actually specify
-           * what to search if PATH is unset. POSIX may, dunno.
-           */
-          
-          path = "/bin:/usr/bin:.";
-	}
+      path = buffers->path;
 
       len = strlen (file) + 1;
       pathlen = strlen (path);
-      freeme = name = (char*)g_malloc (pathlen + len + 1);
+      name = buffers->search_buf;
       
       /* Copy the file name at the top, including '\0'  */
       memcpy (name + pathlen + 1, file, len);
@@ -1178,7 +1317,7 @@ g_execute (const gchar *file,
             execv (startp, argv);
           
 	  if (errno == ENOEXEC)
-	    script_execute (startp, argv, envp);
+	    script_execute (startp, argv, envp, buffers->script_argv);
 
 	  switch (errno)
 	    {
@@ -1217,7 +1356,6 @@ g_execute (const gchar *file,
                * something went wrong executing it; return the error to our
                * caller.
                */
-              g_free (freeme);
 	      return -1;
 	    }
 	}
@@ -1229,8 +1367,6 @@ g_execute (const gchar *file,
          * error.
          */
         errno = EACCES;
-
-      g_free (freeme);
     }
 
   /* Return the error from the last attempt (probably ENOENT).  */
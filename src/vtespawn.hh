@@ -22,6 +22,11 @@
 
 #include <glib.h>
 
+/* A private #GSpawnFlags flag: the child setup function only makes
+ * async-signal-safe calls, and modifies no memory of the parent, so
+ * that it can run in a vfork()ed child. */
+#define VTE_SPAWN_CHILD_SETUP_VFORK_SAFE (1 << 30)
+
 gboolean vte_spawn_async_cancellable (const gchar          *working_directory,
                                       gchar               **argv,
                                       gchar               **envp,
@@ -46,3 +51,6 @@ gboolean vte_spawn_async_with_pipes_cancellable (const gchar          *working_d
                                                  gint                  timeout,
                                                  GPollFD              *pollfd,
                                                  GError              **error);
+
+/* Returns: the #GSpawnError for a failed exec with errno @en */
+gint vte_spawn_exec_error_from_errno (gint en);
@@ -41,6 +41,7 @@ typedef struct _VteStreamClass {
 	void (*advance_tail) (VteStream *stream, gsize offset);
 	gsize (*tail) (VteStream *stream);
 	gsize (*head) (VteStream *stream);
+	gsize (*size) (VteStream *stream);
 } VteStreamClass;
 
 static GType _vte_stream_get_type (void);
@@ -101,5 +102,11 @@ _vte_stream_head (VteStream *stream)
 	return VTE_STREAM_GET_CLASS (stream)->head (stream);
 }
 
+gsize
+_vte_stream_size (VteStream *stream)
+{
+	return VTE_STREAM_GET_CLASS (stream)->size (stream);
+}
+
 G_END_DECLS
 
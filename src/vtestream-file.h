@@ -36,6 +36,10 @@
  *   advance by 64kB and let the operating system leave a gap (sparse blocks)
  *   in the file which is crucial for compression.
  *
+ *   Reads are served from 4MB windows of the file mapped into memory, so
+ *   that the boa can decrypt straight from the page cache, and the kernel is
+ *   asked to read ahead when the blocks are read in sequence.
+ *
  *   (Random-access-overwrite within the existing area is a rare event, occurs
  *   only when the terminal window size changes. We use it to redo differently
  *   the latest appends. In the topmost layer it's achieved by truncating at
@@ -84,11 +88,31 @@
 #include <unistd.h>
 #include <zlib.h>
 
+#if defined HAVE_MMAP && defined HAVE_SYS_MMAN_H
+# include <sys/mman.h>
+# define VTE_SNAKE_MMAP 1
+#endif
+
+#ifdef __linux__
+# include <sys/vfs.h>
+# include <linux/magic.h>
+#endif
+
 #ifdef WITH_GNUTLS
 # include <gnutls/gnutls.h>
 # include <gnutls/crypto.h>
 #endif
 
+#ifdef WITH_LZ4
+# include <lz4.h>
+#endif
+
+#ifdef WITH_ZSTD
+# include <zstd.h>
+#endif
+
+#include "profile.hh"
+#include "trace.hh"
 #include "vteutils.h"
 
 G_BEGIN_DECLS
@@ -118,6 +142,15 @@ typedef guint8 _vte_overwrite_counter_t;
 #endif
 
 #define VTE_BLOCK_DATALENGTH_SIZE  sizeof(_vte_block_datalength_t)
+
+/* The upper bits of the data length field record the codec the block was compressed with */
+#ifndef VTESTREAM_MAIN
+# define VTE_BLOCK_CODEC_SHIFT 24
+#else
+# define VTE_BLOCK_CODEC_SHIFT 6
+#endif
+#define VTE_BLOCK_DATALENGTH_MASK ((1u << VTE_BLOCK_CODEC_SHIFT) - 1)
+
 #define VTE_OVERWRITE_COUNTER_SIZE sizeof(_vte_overwrite_counter_t)
 #define VTE_BOA_BLOCKSIZE (VTE_SNAKE_BLOCKSIZE - VTE_BLOCK_DATALENGTH_SIZE - VTE_OVERWRITE_COUNTER_SIZE - VTE_CIPHER_TAG_SIZE)
 
@@ -125,6 +158,11 @@ typedef guint8 _vte_overwrite_counter_t;
 #define ALIGN_BOA(x) ((x) / VTE_BOA_BLOCKSIZE * VTE_BOA_BLOCKSIZE)
 #define MOD_BOA(x)   ((x) % VTE_BOA_BLOCKSIZE)
 
+/* The size of the windows the snake maps its file in, a multiple of both the block size and
+ * any page size; and the number of blocks to ask to be read in ahead when reading sequentially. */
+#define VTE_SNAKE_MAP_SIZE   (4 * 1024 * 1024)
+#define VTE_SNAKE_READAHEAD  8
+
 /******************************************************************************************/
 
 #ifndef HAVE_EXPLICIT_BZERO
@@ -201,8 +239,10 @@ _file_try_punch_hole (int fd, gsize offset, gsize len)
          * a smaller (better compressed) block will only overwrite
          * the first part of a larger (less compressed) block.
          * As a compromise, punch hole "randomly" with 1/16 chance.
-         * TODOegmont: This is still very slow for me, no clue why. */
-        if (G_UNLIKELY ((n++ & 0x0F) == 0)) {
+         * TODOegmont: This is still very slow for me, no clue why.
+         * Holes of more than a block, as dropping many rows at once
+         * makes, free enough to be always worth it. */
+        if (G_UNLIKELY (len > VTE_SNAKE_BLOCKSIZE || (n++ & 0x0F) == 0)) {
                 fallocate (fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, offset, len);
         }
 
@@ -347,6 +387,15 @@ typedef struct _VteSnake {
                 gsize fd_head;  /* FD's physical head offset. One of these four is redundant, nevermind. */
         } segment[3];           /* At most 3 segments, [0] at the tail. */
         gsize tail, head;       /* These are redundant too, for convenience. */
+
+        /* Reads go through a window of the file mapped into memory, see _vte_snake_peek(). */
+        char *map;              /* The mapped window, or NULL. */
+        gsize map_offset;       /* Its physical offset, a multiple of VTE_SNAKE_MAP_SIZE. */
+        gsize last_read;        /* Physical offset of the last block read, to detect sequential reads. */
+
+        /* The length of each block written, from the tail, see _vte_snake_size(). */
+        GArray *lengths;
+        gsize bytes;            /* Their sum. */
 } VteSnake;
 #define VTE_SNAKE_SEGMENTS(s) ((s)->state == 4 ? 2 : (s)->state)
 
@@ -372,6 +421,7 @@ _vte_snake_init (VteSnake *snake)
 {
         snake->fd = -1;
         snake->state = 1;
+        snake->lengths = g_array_new (FALSE, FALSE, sizeof (guint32));
 }
 
 static void
@@ -379,7 +429,12 @@ _vte_snake_finalize (GObject *object)
 {
         VteSnake *snake = (VteSnake *) object;
 
+#ifdef VTE_SNAKE_MMAP
+        if (snake->map != NULL)
+                munmap (snake->map, VTE_SNAKE_MAP_SIZE);
+#endif
         _file_close (snake->fd);
+        g_array_unref (snake->lengths);
 
         G_OBJECT_CLASS (_vte_snake_parent_class)->finalize(object);
 }
@@ -407,6 +462,8 @@ _vte_snake_reset (VteSnake *snake, gsize offset)
                 snake->segment[0].st_tail = snake->segment[0].st_head = snake->tail = snake->head = offset;
                 snake->segment[0].fd_tail = snake->segment[0].fd_head = 0;
                 snake->state = 1;
+                g_array_set_size (snake->lengths, 0);
+                snake->bytes = 0;
         } else {
                 /* Never retreat the head: bug 748484. */
                 _vte_snake_advance_tail (snake, offset);
@@ -432,10 +489,91 @@ _vte_snake_offset_map (VteSnake *snake, gsize offset)
         g_assert_not_reached();
 }
 
+#if defined VTE_SNAKE_MMAP && defined HAVE_MADVISE
+static gsize
+_vte_snake_page_size (void)
+{
+        static gsize page_size = 0;
+
+        if (G_UNLIKELY (page_size == 0))
+                page_size = sysconf (_SC_PAGESIZE);
+        return page_size;
+}
+#endif
+
+/*
+ * Return the VTE_SNAKE_BLOCKSIZE bytes at offset where they are mapped into memory,
+ * or NULL if they can't be, in which case _vte_snake_read() needs to be used.
+ * The pointer is valid until the next call to _vte_snake_peek() or _vte_snake_read().
+ *
+ * Writes still go through pwrite(), which is coherent with the mapping: writing to
+ * a sparse file through a mapping would deliver a SIGBUS on a full disk, rather
+ * than an error that the boa can deal with.
+ */
+static const char *
+_vte_snake_peek (VteSnake *snake, gsize offset)
+{
+#ifdef VTE_SNAKE_MMAP
+        gsize fd_offset, map_offset;
+
+        g_assert_cmpuint (offset % VTE_SNAKE_BLOCKSIZE, ==, 0);
+
+        if (G_UNLIKELY (offset < snake->tail || offset >= snake->head || snake->fd == -1))
+                return NULL;
+
+        fd_offset = _vte_snake_offset_map(snake, offset);
+
+        /* Only when the block fits in one window, that's always the case with the real block size */
+        map_offset = fd_offset / VTE_SNAKE_MAP_SIZE * VTE_SNAKE_MAP_SIZE;
+        if (G_UNLIKELY (fd_offset + VTE_SNAKE_BLOCKSIZE > map_offset + VTE_SNAKE_MAP_SIZE))
+                return NULL;
+
+        if (snake->map == NULL || snake->map_offset != map_offset) {
+                void *map;
+
+                /* The window may extend beyond the end of the file, but only the blocks within
+                 * the file, which has been grown to contain whole blocks, are ever accessed. */
+                map = mmap (NULL, VTE_SNAKE_MAP_SIZE, PROT_READ, MAP_SHARED, snake->fd, map_offset);
+                if (G_UNLIKELY (map == MAP_FAILED))
+                        return NULL;
+                if (snake->map != NULL)
+                        munmap (snake->map, VTE_SNAKE_MAP_SIZE);
+                snake->map = (char *) map;
+                snake->map_offset = map_offset;
+        }
+
+# ifdef HAVE_MADVISE
+        /* When scrolling through the history, or searching in it, ask for the next few
+         * blocks in the same direction to be read in while we're processing this one. */
+        if (fd_offset == snake->last_read + VTE_SNAKE_BLOCKSIZE ||
+            fd_offset + VTE_SNAKE_BLOCKSIZE == snake->last_read) {
+                gsize start, end, page_size = _vte_snake_page_size ();
+
+                if (fd_offset > snake->last_read) {
+                        start = fd_offset + VTE_SNAKE_BLOCKSIZE;
+                        end = MIN (start + VTE_SNAKE_READAHEAD * VTE_SNAKE_BLOCKSIZE, map_offset + VTE_SNAKE_MAP_SIZE);
+                } else {
+                        end = fd_offset;
+                        start = end - MIN (end - map_offset, VTE_SNAKE_READAHEAD * VTE_SNAKE_BLOCKSIZE);
+                }
+                start = map_offset + (start - map_offset) / page_size * page_size;
+                if (end > start)
+                        madvise (snake->map + (start - map_offset), end - start, MADV_WILLNEED);
+        }
+# endif
+        snake->last_read = fd_offset;
+
+        return snake->map + (fd_offset - map_offset);
+#else
+        return NULL;
+#endif
+}
+
 /* Place VTE_SNAKE_BLOCKSIZE bytes at data */
 static gboolean
 _vte_snake_read (VteSnake *snake, gsize offset, char *data)
 {
+        const char *block;
         gsize fd_offset;
 
         g_assert_cmpuint (offset % VTE_SNAKE_BLOCKSIZE, ==, 0);
@@ -443,6 +581,12 @@ _vte_snake_read (VteSnake *snake, gsize offset, char *data)
         if (G_UNLIKELY (offset < snake->tail || offset >= snake->head))
                 return FALSE;
 
+        block = _vte_snake_peek (snake, offset);
+        if (G_LIKELY (block != NULL)) {
+                memcpy (data, block, VTE_SNAKE_BLOCKSIZE);
+                return TRUE;
+        }
+
         fd_offset = _vte_snake_offset_map(snake, offset);
 
         return (_file_read (snake->fd, data, VTE_SNAKE_BLOCKSIZE, fd_offset) == VTE_SNAKE_BLOCKSIZE);
@@ -461,6 +605,7 @@ static void
 _vte_snake_write (VteSnake *snake, gsize offset, const char *data, gsize len)
 {
         gsize fd_offset;
+        guint32 len32 = len;
 
         g_assert_cmpuint (offset, >=, snake->tail);
         g_assert_cmpuint (offset, <=, snake->head);
@@ -501,12 +646,17 @@ _vte_snake_write (VteSnake *snake, gsize offset, const char *data, gsize len)
 #endif
                 }
                 snake->head = offset + VTE_SNAKE_BLOCKSIZE;
+                g_array_append_val (snake->lengths, len32);
         } else {
                 /* Overwriting an existing block. The new block might be shorter than the old one,
                  * punch a hole to potentially free up disk space (and for easier unit testing). */
+                guint32 *old_len = &g_array_index (snake->lengths, guint32, (offset - snake->tail) / VTE_SNAKE_BLOCKSIZE);
                 fd_offset = _vte_snake_offset_map(snake, offset);
                 _file_try_punch_hole (snake->fd, fd_offset, VTE_SNAKE_BLOCKSIZE);
+                snake->bytes -= *old_len;
+                *old_len = len32;
         }
+        snake->bytes += len;
         _file_write (snake->fd, data, len, fd_offset);
 }
 
@@ -518,6 +668,8 @@ _vte_snake_write (VteSnake *snake, gsize offset, const char *data, gsize len)
 static void
 _vte_snake_advance_tail (VteSnake *snake, gsize offset)
 {
+        guint i, n;
+
         g_assert_cmpuint (offset, >=, snake->tail);
         g_assert_cmpuint (offset, <=, snake->head);
         g_assert_cmpuint (offset % VTE_SNAKE_BLOCKSIZE, ==, 0);
@@ -527,6 +679,11 @@ _vte_snake_advance_tail (VteSnake *snake, gsize offset)
 		return;
         }
 
+        n = (offset - snake->tail) / VTE_SNAKE_BLOCKSIZE;
+        for (i = 0; i < n; i++)
+                snake->bytes -= g_array_index (snake->lengths, guint32, i);
+        g_array_remove_range (snake->lengths, 0, n);
+
         while (offset > snake->segment[0].st_tail) {
                 if (offset < snake->segment[0].st_head) {
                         /* Drop some (but not all) bytes from the first segment. */
@@ -578,6 +735,14 @@ _vte_snake_head (VteSnake *snake)
         return snake->head;
 }
 
+/* The number of bytes stored, i.e. the sum of the lengths of the blocks
+ * as written (after compression and encryption) */
+static gsize
+_vte_snake_size (VteSnake *snake)
+{
+        return snake->bytes;
+}
+
 static void
 _vte_snake_class_init (VteSnakeClass *klass)
 {
@@ -622,7 +787,8 @@ _vte_snake_class_init (VteSnakeClass *klass)
  *                       boa block 65512(7)
  *
  * Structure of the block that we give to the snake:
- * - 0..4 (0..1): The length of the compressed and encrypted Data, that is D-8 (D-2) [VTE_BLOCK_DATALENGTH_SIZE bytes]
+ * - 0..4 (0..1): The length of the compressed and encrypted Data, that is D-8 (D-2), with the codec
+ *   (VteBoaCodec) in the upper 8 (2) bits [VTE_BLOCK_DATALENGTH_SIZE bytes]
  * - 4..8 (1..2): Overwrite counter [VTE_OVERWRITE_COUNTER_SIZE bytes]
  * - 8..D (2..D): The compressed and encrypted Data [<= VTE_BOA_BLOCKSIZE bytes]
  * - D..T: Encryption verification Tag [VTE_CIPHER_TAG_SIZE bytes]
@@ -642,17 +808,88 @@ _vte_snake_class_init (VteSnakeClass *klass)
         } VteIv;
 #endif
 
-typedef struct _VteBoa {
-        VteSnake parent;
-        gsize tail, head;
+/* The codecs a block can be compressed with. Each block records its own one, so that
+ * the default can change without having to know what a stream was written with.
+ * The unit tests only have the fake codec, in the place of zlib. */
+typedef enum _VteBoaCodec {
+        VTE_BOA_CODEC_ZLIB = 0,
+        VTE_BOA_CODEC_LZ4  = 1,
+        VTE_BOA_CODEC_ZSTD = 2,
+        VTE_BOA_CODEC_N
+} VteBoaCodec;
+
+#if !defined VTESTREAM_MAIN && defined WITH_LZ4
+# define VTE_BOA_CODEC_DEFAULT VTE_BOA_CODEC_LZ4
+#elif !defined VTESTREAM_MAIN && defined WITH_ZSTD
+# define VTE_BOA_CODEC_DEFAULT VTE_BOA_CODEC_ZSTD
+#else
+# define VTE_BOA_CODEC_DEFAULT VTE_BOA_CODEC_ZLIB
+#endif
 
+/* The state that encryption and decryption modify. Each boa has two of these with the
+ * same key, one for the main thread and one for the worker thread.
+ * Without encryption, the blocks keep their layout, with a zero tag. */
+typedef struct _VteBoaCipher {
+        gboolean enabled;
 #if !defined VTESTREAM_MAIN && defined WITH_GNUTLS
-        gnutls_cipher_hd_t cipher_hd;
+        gnutls_cipher_hd_t hd;
         VteIv iv;
 #endif
+} VteBoaCipher;
+
+/*
+ * Sealing, that is, compressing and encrypting a block, is done on a worker
+ * thread so that the main thread doesn't stall whenever a block fills up.
+ * The boa keeps its VteBoaJobs in order, and once they are done, writes them
+ * to the snake from the main thread in the same order. Until then, reads of
+ * these blocks are served from the job's copy of the data.
+ *
+ * The worker also unseals the block next to the one read last, in the
+ * direction of the reads, so that scrolling through the history doesn't wait
+ * for decrypting and uncompressing either. The sealed block is read from the
+ * snake by the main thread though, so that the snake is only ever accessed
+ * from there.
+ */
+typedef struct _VteBoaJob {
+        struct _VteBoa *boa;
+        gsize offset;
+        _vte_overwrite_counter_t overwrite_counter;
+        gboolean unseal;    /* read ahead, rather than write */
+        gint done;          /* set atomically by the worker */
+        gboolean ok;        /* unseal: whether it succeeded */
+        unsigned int len;   /* seal: the length of the sealed block in buf */
+        char *data;         /* VTE_BOA_BLOCKSIZE bytes of plain data */
+        char *buf;          /* the sealed block */
+} VteBoaJob;
+
+typedef struct _VteBoa {
+        VteSnake parent;
+        gsize tail, head;
+
+        VteBoaCipher cipher;
+        VteBoaCipher worker_cipher;
+        VteBoaCodec codec;    /* to compress new blocks with */
         int compressBound;
+
+        gboolean async;       /* whether to seal on the worker thread */
+        GQueue jobs;          /* the blocks not sealed or stored yet, oldest first */
+        GQueue hot;           /* the newest sealed blocks kept in memory, VteBoaJobs without data, oldest first */
+        gsize hot_len;        /* the sealed size of the hot blocks */
+        gsize hot_max;        /* the size up to which to keep sealed blocks in memory rather than in the snake */
+        VteBoaJob *prefetch;  /* the block being read ahead, or NULL */
+        gsize last_read_offset;
 } VteBoa;
 
+/* The number of blocks that can wait to be sealed, per boa */
+#define VTE_BOA_MAX_JOBS 4
+
+/* The sealed size of the newest blocks to keep in memory, per boa, so that
+ * the recent history doesn't need to touch the file */
+#define VTE_BOA_HOT_SIZE (1024 * 1024)
+
+#define VTE_BOA_SEALED_SIZE(boa) MAX(VTE_SNAKE_BLOCKSIZE, \
+                                     VTE_BLOCK_DATALENGTH_SIZE + VTE_OVERWRITE_COUNTER_SIZE + (boa)->compressBound)
+
 typedef struct _VteBoaClass {
         GObjectClass parent_class;
 
@@ -676,15 +913,20 @@ G_DEFINE_TYPE (VteBoa, _vte_boa, VTE_TYPE_SNAKE)
 
 /* Encrypt: len bytes are overwritten in place, followed by VTE_CIPHER_TAG_SIZE more bytes for the tag. */
 static void
-_vte_boa_encrypt (VteBoa *boa, gsize offset, guint32 overwrite_counter, char *data, unsigned int len)
+_vte_boa_cipher_encrypt (VteBoaCipher *cipher, gsize offset, guint32 overwrite_counter, char *data, unsigned int len)
 {
+        if (G_UNLIKELY (!cipher->enabled)) {
+                memset (data + len, 0, VTE_CIPHER_TAG_SIZE);
+                return;
+        }
+
 #ifndef VTESTREAM_MAIN
 # ifdef WITH_GNUTLS
-        boa->iv.offset = offset;
-        boa->iv.overwrite_counter = overwrite_counter;
-        gnutls_cipher_set_iv (boa->cipher_hd, &boa->iv, VTE_CIPHER_IV_SIZE);
-        gnutls_cipher_encrypt (boa->cipher_hd, data, len);
-        gnutls_cipher_tag (boa->cipher_hd, data + len, VTE_CIPHER_TAG_SIZE);
+        cipher->iv.offset = offset;
+        cipher->iv.overwrite_counter = overwrite_counter;
+        gnutls_cipher_set_iv (cipher->hd, &cipher->iv, VTE_CIPHER_IV_SIZE);
+        gnutls_cipher_encrypt (cipher->hd, data, len);
+        gnutls_cipher_tag (cipher->hd, data + len, VTE_CIPHER_TAG_SIZE);
 # endif
 #else
         /* Fake encryption for unit testing: uppercase <-> lowercase, followed by verification tag which is
@@ -701,50 +943,113 @@ _vte_boa_encrypt (VteBoa *boa, gsize offset, guint32 overwrite_counter, char *da
 #endif
 }
 
-/* Decrypt: data is len bytes of data + VTE_CIPHER_TAG_SIZE more bytes of tag. Returns FALSE on tag mismatch. */
+/* Decrypt: src is len bytes of data + VTE_CIPHER_TAG_SIZE more bytes of tag, the len bytes of
+ * the result are written to dst, which can be the same as src. Returns FALSE on tag mismatch. */
 static gboolean
-_vte_boa_decrypt (VteBoa *boa, gsize offset, guint32 overwrite_counter, char *data, unsigned int len)
+_vte_boa_cipher_decrypt (VteBoaCipher *cipher, gsize offset, guint32 overwrite_counter,
+                         const char *src, char *dst, unsigned int len)
 {
         unsigned char tag[VTE_CIPHER_TAG_SIZE];
         unsigned int i, j;
         guint8 faulty = 0;
 
+        if (G_UNLIKELY (!cipher->enabled)) {
+                if (dst != src)
+                        memcpy (dst, src, len);
+                memset (tag, 0, VTE_CIPHER_TAG_SIZE);
+                goto verify;
+        }
+
 #ifndef VTESTREAM_MAIN
 # ifdef WITH_GNUTLS
-        boa->iv.offset = offset;
-        boa->iv.overwrite_counter = overwrite_counter;
-        gnutls_cipher_set_iv (boa->cipher_hd, &boa->iv, VTE_CIPHER_IV_SIZE);
-        gnutls_cipher_decrypt (boa->cipher_hd, data, len);
-        gnutls_cipher_tag (boa->cipher_hd, tag, VTE_CIPHER_TAG_SIZE);
+        cipher->iv.offset = offset;
+        cipher->iv.overwrite_counter = overwrite_counter;
+        gnutls_cipher_set_iv (cipher->hd, &cipher->iv, VTE_CIPHER_IV_SIZE);
+        gnutls_cipher_decrypt2 (cipher->hd, src, len, dst, len);
+        gnutls_cipher_tag (cipher->hd, tag, VTE_CIPHER_TAG_SIZE);
+# else
+        if (dst != src)
+                memcpy (dst, src, len);
 # endif
 #else
         /* Fake decryption for unit testing; see above. */
         for (i = 0; i < len; i++) {
-                unsigned char c = data[i];
+                unsigned char c = src[i];
                 if (c >= 0x40) c ^= 0x20;
-                data[i] = c;
+                dst[i] = c;
         }
         *tag = (((offset / VTE_BOA_BLOCKSIZE) & 037) << 3) | (overwrite_counter & 007);
 #endif
 
+verify:
         /* Constant time tag verification: 738601#c66 */
         for (i = 0, j = len; i < VTE_CIPHER_TAG_SIZE; i++, j++) {
-                faulty |= tag[i] ^ data[j];
+                faulty |= tag[i] ^ src[j];
         }
         return !faulty;
 }
 
+static inline void
+_vte_boa_encrypt (VteBoa *boa, gsize offset, guint32 overwrite_counter, char *data, unsigned int len)
+{
+        _vte_boa_cipher_encrypt (&boa->cipher, offset, overwrite_counter, data, len);
+}
+
+static inline gboolean
+_vte_boa_decrypt (VteBoa *boa, gsize offset, guint32 overwrite_counter, char *data, unsigned int len)
+{
+        return _vte_boa_cipher_decrypt (&boa->cipher, offset, overwrite_counter, data, data, len);
+}
+
+static gboolean
+_vte_boa_codec_available (VteBoaCodec codec)
+{
+        switch (codec) {
+        case VTE_BOA_CODEC_ZLIB:
+                return TRUE;
+#if !defined VTESTREAM_MAIN && defined WITH_LZ4
+        case VTE_BOA_CODEC_LZ4:
+                return TRUE;
+#endif
+#if !defined VTESTREAM_MAIN && defined WITH_ZSTD
+        case VTE_BOA_CODEC_ZSTD:
+                return TRUE;
+#endif
+        default:
+                return FALSE;
+        }
+}
+
+G_GNUC_UNUSED static const char *
+_vte_boa_codec_name (VteBoaCodec codec)
+{
+        switch (codec) {
+        case VTE_BOA_CODEC_ZLIB: return "zlib";
+        case VTE_BOA_CODEC_LZ4:  return "lz4";
+        case VTE_BOA_CODEC_ZSTD: return "zstd";
+        default:                 return "unknown";
+        }
+}
+
+/* The largest size that compressing len bytes can result in, with any of the codecs */
 static int
 _vte_boa_compressBound (unsigned int len)
 {
 #ifndef VTESTREAM_MAIN
-        return compressBound(len);
+        int bound = compressBound(len);
+# ifdef WITH_LZ4
+        bound = MAX (bound, LZ4_compressBound(len));
+# endif
+# ifdef WITH_ZSTD
+        bound = MAX (bound, (int) ZSTD_compressBound(len));
+# endif
+        return bound;
 #else
         return 2 * len;
 #endif
 }
 
-/* Compress; returns the compressed size which might be bigger than the original. */
+/* Compress with zlib; returns the compressed size which might be bigger than the original. */
 static unsigned int
 _vte_boa_compress (char *dst, unsigned int dstlen, const char *src, unsigned int srclen)
 {
@@ -782,16 +1087,15 @@ _vte_boa_compress (char *dst, unsigned int dstlen, const char *src, unsigned int
 #endif
 }
 
-/* Uncompress; returns the uncompressed size. */
+/* Uncompress with zlib; returns the uncompressed size, or 0 on error. */
 static unsigned int
 _vte_boa_uncompress (char *dst, unsigned int dstlen, const char *src, unsigned int srclen)
 {
 #ifndef VTESTREAM_MAIN
         uLongf dstlen_ulongf = dstlen;
-        unsigned int z_ret;
 
-        z_ret = uncompress ((Bytef *) dst, &dstlen_ulongf, (const Bytef *) src, srclen);
-        g_assert_cmpuint (z_ret, ==, Z_OK);
+        if (G_UNLIKELY (uncompress ((Bytef *) dst, &dstlen_ulongf, (const Bytef *) src, srclen) != Z_OK))
+                return 0;
         return dstlen_ulongf;
 #else
         /* Fake decompression for unit testing; see above. */
@@ -810,14 +1114,392 @@ _vte_boa_uncompress (char *dst, unsigned int dstlen, const char *src, unsigned i
 #endif
 }
 
+#if !defined VTESTREAM_MAIN && defined WITH_ZSTD
+/* The contexts are reused, but can't be shared between the main thread and the worker */
+static GPrivate _vte_boa_zstd_cctx = G_PRIVATE_INIT ((GDestroyNotify) ZSTD_freeCCtx);
+static GPrivate _vte_boa_zstd_dctx = G_PRIVATE_INIT ((GDestroyNotify) ZSTD_freeDCtx);
+#endif
+
+/* Compress with the given codec; returns the compressed size which might be bigger than the original,
+ * or G_MAXUINT on error, in which case the data has to be stored uncompressed. */
+static unsigned int
+_vte_boa_codec_compress (VteBoaCodec codec, char *dst, unsigned int dstlen, const char *src, unsigned int srclen)
+{
+        switch (codec) {
+        case VTE_BOA_CODEC_ZLIB:
+                return _vte_boa_compress (dst, dstlen, src, srclen);
+#if !defined VTESTREAM_MAIN && defined WITH_LZ4
+        case VTE_BOA_CODEC_LZ4: {
+                int len = LZ4_compress_default (src, dst, srclen, dstlen);
+                return len > 0 ? (unsigned int) len : G_MAXUINT;
+        }
+#endif
+#if !defined VTESTREAM_MAIN && defined WITH_ZSTD
+        case VTE_BOA_CODEC_ZSTD: {
+                ZSTD_CCtx *cctx = (ZSTD_CCtx *) g_private_get (&_vte_boa_zstd_cctx);
+                size_t len;
+
+                if (G_UNLIKELY (cctx == NULL)) {
+                        cctx = ZSTD_createCCtx ();
+                        g_private_set (&_vte_boa_zstd_cctx, cctx);
+                }
+                len = ZSTD_compressCCtx (cctx, dst, dstlen, src, srclen, 1);
+                return ZSTD_isError (len) ? G_MAXUINT : (unsigned int) len;
+        }
+#endif
+        default:
+                g_assert_not_reached ();
+                return G_MAXUINT;
+        }
+}
+
+/* Uncompress with the given codec; returns the uncompressed size, or 0 on error,
+ * including if the codec isn't available. */
+static unsigned int
+_vte_boa_codec_uncompress (VteBoaCodec codec, char *dst, unsigned int dstlen, const char *src, unsigned int srclen)
+{
+        switch (codec) {
+        case VTE_BOA_CODEC_ZLIB:
+                return _vte_boa_uncompress (dst, dstlen, src, srclen);
+#if !defined VTESTREAM_MAIN && defined WITH_LZ4
+        case VTE_BOA_CODEC_LZ4: {
+                int len = LZ4_decompress_safe (src, dst, srclen, dstlen);
+                return len > 0 ? (unsigned int) len : 0;
+        }
+#endif
+#if !defined VTESTREAM_MAIN && defined WITH_ZSTD
+        case VTE_BOA_CODEC_ZSTD: {
+                ZSTD_DCtx *dctx = (ZSTD_DCtx *) g_private_get (&_vte_boa_zstd_dctx);
+                size_t len;
+
+                if (G_UNLIKELY (dctx == NULL)) {
+                        dctx = ZSTD_createDCtx ();
+                        g_private_set (&_vte_boa_zstd_dctx, dctx);
+                }
+                len = ZSTD_decompressDCtx (dctx, dst, dstlen, src, srclen);
+                return ZSTD_isError (len) ? 0 : (unsigned int) len;
+        }
+#endif
+        default:
+                return 0;
+        }
+}
+
 /*----------------------------------------------------------------------------------------*/
 
+/* Compress (or copy if uncompressable) and encrypt a block of data into buf, which needs to
+ * be VTE_BOA_SEALED_SIZE bytes large. Returns the length of the resulting snake block. */
+static unsigned int
+_vte_boa_seal (VteBoa *boa, VteBoaCipher *cipher, gsize offset, _vte_overwrite_counter_t overwrite_counter,
+               const char *data, char *buf)
+{
+        vte::base::Trace::Scope trace_scope{"boa-compress"};
+        _vte_block_datalength_t compressed_len;
+
+        compressed_len = _vte_boa_codec_compress (boa->codec, buf + VTE_BLOCK_DATALENGTH_SIZE + VTE_OVERWRITE_COUNTER_SIZE,
+                                                  boa->compressBound, data, VTE_BOA_BLOCKSIZE);
+        if (G_UNLIKELY (compressed_len >= VTE_BOA_BLOCKSIZE)) {
+                memcpy (buf + VTE_BLOCK_DATALENGTH_SIZE + VTE_OVERWRITE_COUNTER_SIZE, data, VTE_BOA_BLOCKSIZE);
+                compressed_len = VTE_BOA_BLOCKSIZE;
+        }
+
+        *((_vte_block_datalength_t *) buf) = (_vte_block_datalength_t) (compressed_len | (boa->codec << VTE_BLOCK_CODEC_SHIFT));
+        *((_vte_overwrite_counter_t *) (buf + VTE_BLOCK_DATALENGTH_SIZE)) = (_vte_overwrite_counter_t) overwrite_counter;
+
+        _vte_boa_cipher_encrypt (cipher, offset, overwrite_counter, buf + VTE_BLOCK_DATALENGTH_SIZE + VTE_OVERWRITE_COUNTER_SIZE, compressed_len);
+
+        return VTE_BLOCK_DATALENGTH_SIZE + VTE_OVERWRITE_COUNTER_SIZE + compressed_len + VTE_CIPHER_TAG_SIZE;
+}
+
+/* The reverse of _vte_boa_seal(): decrypt and uncompress a snake block from buf to data.
+ * buf is left intact, so it can be the snake's mapping of the file; the decrypted data goes
+ * to scratch (VTE_BOA_BLOCKSIZE bytes), which can be within buf if that's writable.
+ * data can be NULL if we're only interested in integrity verification and the overwrite_counter. */
+static gboolean
+_vte_boa_unseal (VteBoaCipher *cipher, gsize offset, const char *buf, char *scratch, char *data,
+                 _vte_overwrite_counter_t *overwrite_counter)
+{
+        vte::base::Trace::Scope trace_scope{"boa-decompress"};
+        const char *payload = buf + VTE_BLOCK_DATALENGTH_SIZE + VTE_OVERWRITE_COUNTER_SIZE;
+        _vte_block_datalength_t compressed_len;
+        VteBoaCodec codec;
+        unsigned int uncompressed_len;
+
+        compressed_len = *((const _vte_block_datalength_t *) buf);
+        codec = (VteBoaCodec) (compressed_len >> VTE_BLOCK_CODEC_SHIFT);
+        compressed_len &= VTE_BLOCK_DATALENGTH_MASK;
+        *overwrite_counter = *((const _vte_overwrite_counter_t *) (buf + VTE_BLOCK_DATALENGTH_SIZE));
+
+        /* We could have read an empty block due to a previous disk full. Treat that as an error too. Perform other sanity checks. */
+        if (G_UNLIKELY (compressed_len <= 0 || compressed_len > VTE_BOA_BLOCKSIZE || *overwrite_counter <= 0 ||
+                        !_vte_boa_codec_available (codec)))
+                return FALSE;
+
+        /* A block that wasn't compressable is decrypted straight to its destination */
+        if (G_UNLIKELY (compressed_len >= VTE_BOA_BLOCKSIZE && data != NULL))
+                return _vte_boa_cipher_decrypt (cipher, offset, *overwrite_counter, payload, data, VTE_BOA_BLOCKSIZE);
+
+        /* Decrypt, bail out on tag mismatch. Without encryption, uncompress from buf directly. */
+        if (G_LIKELY (cipher->enabled)) {
+                if (G_UNLIKELY (!_vte_boa_cipher_decrypt (cipher, offset, *overwrite_counter, payload, scratch, compressed_len)))
+                        return FALSE;
+                payload = scratch;
+        }
+
+        if (G_UNLIKELY (data == NULL))
+                return TRUE;
+
+        uncompressed_len = _vte_boa_codec_uncompress (codec, data, VTE_BOA_BLOCKSIZE, payload, compressed_len);
+        return uncompressed_len == VTE_BOA_BLOCKSIZE;
+}
+
+/*----------------------------------------------------------------------------------------*/
+
+/* The worker thread, shared by all the boas */
+static GThreadPool *_vte_boa_worker_pool;
+static GMutex _vte_boa_worker_mutex;
+static GCond _vte_boa_worker_cond;
+
 static void
-_vte_boa_init (VteBoa *boa)
+_vte_boa_worker (gpointer data, gpointer user_data)
+{
+        VteBoaJob *job = (VteBoaJob *) data;
+        VteBoa *boa = job->boa;
+
+        if (job->unseal)
+                job->ok = _vte_boa_unseal (&boa->worker_cipher, job->offset, job->buf,
+                                           job->buf + VTE_BLOCK_DATALENGTH_SIZE + VTE_OVERWRITE_COUNTER_SIZE,
+                                           job->data, &job->overwrite_counter);
+        else
+                job->len = _vte_boa_seal (boa, &boa->worker_cipher, job->offset, job->overwrite_counter, job->data, job->buf);
+
+        g_mutex_lock (&_vte_boa_worker_mutex);
+        g_atomic_int_set (&job->done, TRUE);
+        g_cond_broadcast (&_vte_boa_worker_cond);
+        g_mutex_unlock (&_vte_boa_worker_mutex);
+}
+
+static VteBoaJob *
+_vte_boa_job_new (VteBoa *boa, gsize offset)
+{
+        VteBoaJob *job = g_new0 (VteBoaJob, 1);
+
+        job->boa = boa;
+        job->offset = offset;
+        job->data = (char *) g_malloc (VTE_BOA_BLOCKSIZE);
+        job->buf = (char *) g_malloc (VTE_BOA_SEALED_SIZE(boa));
+        return job;
+}
+
+static void
+_vte_boa_job_free (VteBoaJob *job)
+{
+        g_free (job->data);
+        g_free (job->buf);
+        g_free (job);
+}
+
+static void
+_vte_boa_job_push (VteBoaJob *job)
 {
+        if (G_UNLIKELY (_vte_boa_worker_pool == NULL)) {
+                /* A non-exclusive pool with a single thread runs the jobs in order */
+                _vte_boa_worker_pool = g_thread_pool_new (_vte_boa_worker, NULL, 1, FALSE, NULL);
+        }
+        g_thread_pool_push (_vte_boa_worker_pool, job, NULL);
+}
+
+static void
+_vte_boa_job_wait (VteBoaJob *job)
+{
+        if (g_atomic_int_get (&job->done))
+                return;
+
+        vte::base::Profile::Scope profile_scope{vte::base::Profile::Stage::eStreamCompress};
+
+        g_mutex_lock (&_vte_boa_worker_mutex);
+        while (!g_atomic_int_get (&job->done))
+                g_cond_wait (&_vte_boa_worker_cond, &_vte_boa_worker_mutex);
+        g_mutex_unlock (&_vte_boa_worker_mutex);
+}
+
+/* Write the oldest hot blocks to the snake, in order, until at most max bytes remain */
+static void
+_vte_boa_spill (VteBoa *boa, gsize max)
+{
+        VteBoaJob *job;
+
+        while (boa->hot_len > max) {
+                job = (VteBoaJob *) g_queue_pop_head (&boa->hot);
+                boa->hot_len -= job->len;
+                _vte_snake_write (&boa->parent, OFFSET_BOA_TO_SNAKE(job->offset), job->buf, job->len);
+                _vte_boa_job_free (job);
+        }
+}
+
+/* Keep a sealed block in memory, spilling the oldest ones to the snake if there are too many */
+static void
+_vte_boa_store (VteBoa *boa, VteBoaJob *job)
+{
+        g_free (job->data);
+        job->data = NULL;
+        job->buf = (char *) g_realloc (job->buf, job->len);
+
+        g_queue_push_tail (&boa->hot, job);
+        boa->hot_len += job->len;
+        _vte_boa_spill (boa, boa->hot_max);
+}
+
+/* Store the sealed blocks, in order. Stops at the first one that's not done yet,
+ * unless wait is TRUE. */
+static void
+_vte_boa_flush (VteBoa *boa, gboolean wait)
+{
+        VteBoaJob *job;
+
+        while ((job = (VteBoaJob *) g_queue_peek_head (&boa->jobs)) != NULL) {
+                if (!g_atomic_int_get (&job->done)) {
+                        if (!wait)
+                                break;
+                        _vte_boa_job_wait (job);
+                }
+                g_queue_pop_head (&boa->jobs);
+                _vte_boa_store (boa, job);
+        }
+}
+
+/* The newest block in the queue at the given offset, or NULL */
+static VteBoaJob *
+_vte_boa_queue_find (GQueue *queue, gsize offset)
+{
+        GList *l;
+
+        for (l = queue->tail; l != NULL; l = l->prev) {
+                VteBoaJob *job = (VteBoaJob *) l->data;
+                if (job->offset == offset)
+                        return job;
+        }
+        return NULL;
+}
+
+/* The newest block not sealed yet at the given offset, or NULL */
+static inline VteBoaJob *
+_vte_boa_find_job (VteBoa *boa, gsize offset)
+{
+        return _vte_boa_queue_find (&boa->jobs, offset);
+}
+
+/* The newest sealed block in memory at the given offset, or NULL */
+static inline VteBoaJob *
+_vte_boa_find_hot (VteBoa *boa, gsize offset)
+{
+        return _vte_boa_queue_find (&boa->hot, offset);
+}
+
+static void
+_vte_boa_prefetch_drop (VteBoa *boa)
+{
+        if (boa->prefetch == NULL)
+                return;
+
+        _vte_boa_job_wait (boa->prefetch);
+        _vte_boa_job_free (boa->prefetch);
+        boa->prefetch = NULL;
+}
+
+static void
+_vte_boa_prefetch (VteBoa *boa, gsize offset)
+{
+        VteBoaJob *job, *hot;
+
+        if (boa->prefetch != NULL) {
+                if (boa->prefetch->offset == offset)
+                        return;
+                _vte_boa_prefetch_drop (boa);
+        }
+
+        if (offset < boa->tail || offset >= boa->head || _vte_boa_find_job (boa, offset) != NULL)
+                return;
+
+        job = _vte_boa_job_new (boa, offset);
+        if ((hot = _vte_boa_find_hot (boa, offset)) != NULL) {
+                memcpy (job->buf, hot->buf, hot->len);
+        } else if (G_UNLIKELY (!_vte_snake_read (&boa->parent, OFFSET_BOA_TO_SNAKE(offset), job->buf))) {
+                _vte_boa_job_free (job);
+                return;
+        }
+        job->unseal = TRUE;
+        boa->prefetch = job;
+        _vte_boa_job_push (job);
+}
+
+/*----------------------------------------------------------------------------------------*/
+
+/*----------------------------------------------------------------------------------------*/
+
+static VteStreamEncryption _vte_boa_encryption = VTE_STREAM_ENCRYPTION_ALWAYS;
+
+void
+_vte_file_stream_set_encryption (VteStreamEncryption encryption)
+{
+        _vte_boa_encryption = encryption;
+}
+
+VteStreamEncryption
+_vte_file_stream_get_encryption (void)
+{
+        return _vte_boa_encryption;
+}
+
+/* Whether the temporary files live in memory only (but note that tmpfs can be swapped out) */
+static gboolean
+_vte_boa_tmp_dir_in_memory (void)
+{
+#if defined __linux__ && !defined VTESTREAM_MAIN
+        static int in_memory = -1;
+        struct statfs buf;
+
+        if (in_memory == -1) {
+                in_memory = statfs (g_get_tmp_dir (), &buf) == 0 &&
+                        (buf.f_type == TMPFS_MAGIC || buf.f_type == RAMFS_MAGIC);
+                _vte_debug_print (VTE_DEBUG_RING,
+                                  "Temporary directory %s is %sin memory.\n",
+                                  g_get_tmp_dir (), in_memory ? "" : "not ");
+        }
+        return in_memory;
+#else
+        return FALSE;
+#endif
+}
+
+static gboolean
+_vte_boa_want_encryption (void)
+{
+#if defined VTESTREAM_MAIN || defined WITH_GNUTLS
+        switch (_vte_boa_encryption) {
+        case VTE_STREAM_ENCRYPTION_AUTO:
+                return !_vte_boa_tmp_dir_in_memory ();
+        case VTE_STREAM_ENCRYPTION_NEVER:
+                return FALSE;
+        case VTE_STREAM_ENCRYPTION_ALWAYS:
+        default:
+                return TRUE;
+        }
+#else
+        return FALSE;
+#endif
+}
+
 #if !defined VTESTREAM_MAIN && defined WITH_GNUTLS
-        unsigned char key[VTE_CIPHER_KEY_SIZE];
-        gnutls_datum_t datum_key;
+/* GnuTLS is initialized once for all the boas of the process, and never
+ * deinitialized, rather than for each of them. */
+static void
+_vte_boa_ensure_gnutls (void)
+{
+        static gsize initialized = 0;
+
+        if (!g_once_init_enter (&initialized))
+                return;
 
         gnutls_global_init ();
 
@@ -828,31 +1510,74 @@ _vte_boa_init (VteBoa *boa)
         /* Assert that IV does indeed include all the data we want to use (offset and overwrite_counter). */
         g_assert_cmpuint (offsetof(struct _VteIv, padding), <=, VTE_CIPHER_IV_SIZE);
 
+        g_once_init_leave (&initialized, 1);
+}
+#endif
+
+static void
+_vte_boa_init (VteBoa *boa)
+{
+        boa->cipher.enabled = boa->worker_cipher.enabled = _vte_boa_want_encryption ();
+
+#if !defined VTESTREAM_MAIN && defined WITH_GNUTLS
+        unsigned char key[VTE_CIPHER_KEY_SIZE];
+        gnutls_datum_t datum_key;
+
+        if (!boa->cipher.enabled)
+                goto done_cipher;
+
+        _vte_boa_ensure_gnutls ();
+
         /* Strong random for the key. */
         gnutls_rnd(GNUTLS_RND_KEY, key, VTE_CIPHER_KEY_SIZE);
 
         datum_key.data = key;
         datum_key.size = VTE_CIPHER_KEY_SIZE;
-        gnutls_cipher_init(&boa->cipher_hd, VTE_CIPHER_ALGORITHM, &datum_key, NULL);
+        gnutls_cipher_init(&boa->cipher.hd, VTE_CIPHER_ALGORITHM, &datum_key, NULL);
+        gnutls_cipher_init(&boa->worker_cipher.hd, VTE_CIPHER_ALGORITHM, &datum_key, NULL);
         explicit_bzero(key, VTE_CIPHER_KEY_SIZE);
 
         /* Empty IV. */
-        explicit_bzero(&boa->iv, sizeof(boa->iv));
+        explicit_bzero(&boa->cipher.iv, sizeof(boa->cipher.iv));
+        explicit_bzero(&boa->worker_cipher.iv, sizeof(boa->worker_cipher.iv));
+done_cipher:
 #endif
 
+        boa->codec = VTE_BOA_CODEC_DEFAULT;
         boa->compressBound = _vte_boa_compressBound(VTE_BOA_BLOCKSIZE);
+
+        g_queue_init (&boa->jobs);
+        g_queue_init (&boa->hot);
+
+#ifndef VTESTREAM_MAIN
+        boa->async = TRUE;
+        boa->hot_max = VTE_BOA_HOT_SIZE;
+#endif
 }
 
 static void
 _vte_boa_finalize (GObject *object)
 {
-#if !defined VTESTREAM_MAIN && defined WITH_GNUTLS
         VteBoa *boa = (VteBoa *) object;
+        VteBoaJob *job;
 
-        explicit_bzero(&boa->iv, sizeof(boa->iv));
+        /* The worker might still be using the boa */
+        while ((job = (VteBoaJob *) g_queue_pop_head (&boa->jobs)) != NULL) {
+                _vte_boa_job_wait (job);
+                _vte_boa_job_free (job);
+        }
+        _vte_boa_prefetch_drop (boa);
+        while ((job = (VteBoaJob *) g_queue_pop_head (&boa->hot)) != NULL)
+                _vte_boa_job_free (job);
+
+#if !defined VTESTREAM_MAIN && defined WITH_GNUTLS
+        if (boa->cipher.enabled) {
+                explicit_bzero(&boa->cipher.iv, sizeof(boa->cipher.iv));
+                explicit_bzero(&boa->worker_cipher.iv, sizeof(boa->worker_cipher.iv));
 
-        gnutls_cipher_deinit (boa->cipher_hd);
-        gnutls_global_deinit ();
+                gnutls_cipher_deinit (boa->cipher.hd);
+                gnutls_cipher_deinit (boa->worker_cipher.hd);
+        }
 #endif
 
         G_OBJECT_CLASS (_vte_boa_parent_class)->finalize(object);
@@ -872,6 +1597,11 @@ _vte_boa_reset (VteBoa *boa, gsize offset)
          * head of the stream. See bug 748484. */
         g_assert_cmpuint (offset, >=, boa->tail);
 
+        /* For the same reason, the pending blocks are written rather than dropped */
+        _vte_boa_flush (boa, TRUE);
+        _vte_boa_spill (boa, 0);
+        _vte_boa_prefetch_drop (boa);
+
         _vte_snake_reset (&boa->parent, OFFSET_BOA_TO_SNAKE(offset));
 
         boa->tail = offset;
@@ -880,48 +1610,74 @@ _vte_boa_reset (VteBoa *boa, gsize offset)
 }
 
 /* Place VTE_BOA_BLOCKSIZE bytes at data.
- * data can be NULL if we're only interested in integrity verification and the overwrite_counter. */
+ * data can be NULL if we're only interested in integrity verification and the overwrite_counter.
+ * The block needs to be written to the snake already. */
 static gboolean
 _vte_boa_read_with_overwrite_counter (VteBoa *boa, gsize offset, char *data, _vte_overwrite_counter_t *overwrite_counter)
 {
-        _vte_block_datalength_t compressed_len;
+        const char *block;
         char *buf = g_newa(char, VTE_SNAKE_BLOCKSIZE);
+        VteBoaJob *hot;
 
         g_assert_cmpuint (offset % VTE_BOA_BLOCKSIZE, ==, 0);
 
-        /* Read */
-        if (G_UNLIKELY (!_vte_snake_read (&boa->parent, OFFSET_BOA_TO_SNAKE(offset), buf)))
-                return FALSE;
-
-        compressed_len = *((_vte_block_datalength_t *) buf);
-        *overwrite_counter = *((_vte_overwrite_counter_t *) (buf + VTE_BLOCK_DATALENGTH_SIZE));
-
-        /* We could have read an empty block due to a previous disk full. Treat that as an error too. Perform other sanity checks. */
-        if (G_UNLIKELY (compressed_len <= 0 || compressed_len > VTE_BOA_BLOCKSIZE || *overwrite_counter <= 0))
-                return FALSE;
-
-        /* Decrypt, bail out on tag mismatch */
-        if (G_UNLIKELY (!_vte_boa_decrypt (boa, offset, *overwrite_counter, buf + VTE_BLOCK_DATALENGTH_SIZE + VTE_OVERWRITE_COUNTER_SIZE, compressed_len)))
-                return FALSE;
-
-        /* Uncompress, or copy if wasn't compressable */
-        if (G_LIKELY (data != NULL)) {
-                if (G_UNLIKELY (compressed_len >= VTE_BOA_BLOCKSIZE)) {
-                        memcpy (data, buf + VTE_BLOCK_DATALENGTH_SIZE + VTE_OVERWRITE_COUNTER_SIZE, VTE_BOA_BLOCKSIZE);
-                } else {
-                        unsigned int uncompressed_len;
-                        uncompressed_len = _vte_boa_uncompress(data, VTE_BOA_BLOCKSIZE, buf + VTE_BLOCK_DATALENGTH_SIZE + VTE_OVERWRITE_COUNTER_SIZE, compressed_len);
-                        g_assert_cmpuint (uncompressed_len, ==, VTE_BOA_BLOCKSIZE);
-                }
+        /* Unseal straight from memory or the mapped file if possible, otherwise read it first */
+        if ((hot = _vte_boa_find_hot (boa, offset)) != NULL)
+                block = hot->buf;
+        else
+                block = _vte_snake_peek (&boa->parent, OFFSET_BOA_TO_SNAKE(offset));
+        if (block == NULL) {
+                if (G_UNLIKELY (!_vte_snake_read (&boa->parent, OFFSET_BOA_TO_SNAKE(offset), buf)))
+                        return FALSE;
+                block = buf;
         }
-        return TRUE;
+
+        return _vte_boa_unseal (&boa->cipher, offset, block, buf + VTE_BLOCK_DATALENGTH_SIZE + VTE_OVERWRITE_COUNTER_SIZE,
+                                data, overwrite_counter);
 }
 
 static gboolean
 _vte_boa_read (VteBoa *boa, gsize offset, char *data)
 {
         _vte_overwrite_counter_t overwrite_counter;
-        return _vte_boa_read_with_overwrite_counter (boa, offset, data, &overwrite_counter);
+        VteBoaJob *job;
+        gboolean forward;
+
+        _vte_boa_flush (boa, FALSE);
+
+        /* Read your writes */
+        job = _vte_boa_find_job (boa, offset);
+        if (G_UNLIKELY (job != NULL)) {
+                memcpy (data, job->data, VTE_BOA_BLOCKSIZE);
+                return TRUE;
+        }
+
+        forward = offset >= boa->last_read_offset;
+        boa->last_read_offset = offset;
+
+        job = boa->prefetch;
+        if (job != NULL && job->offset == offset) {
+                boa->prefetch = NULL;
+                _vte_boa_job_wait (job);
+                if (G_LIKELY (job->ok)) {
+                        memcpy (data, job->data, VTE_BOA_BLOCKSIZE);
+                } else if (!_vte_boa_read_with_overwrite_counter (boa, offset, data, &overwrite_counter)) {
+                        _vte_boa_job_free (job);
+                        return FALSE;
+                }
+                _vte_boa_job_free (job);
+        } else if (!_vte_boa_read_with_overwrite_counter (boa, offset, data, &overwrite_counter)) {
+                return FALSE;
+        }
+
+        /* Read ahead */
+        if (boa->async) {
+                if (forward)
+                        _vte_boa_prefetch (boa, offset + VTE_BOA_BLOCKSIZE);
+                else if (offset >= VTE_BOA_BLOCKSIZE)
+                        _vte_boa_prefetch (boa, offset - VTE_BOA_BLOCKSIZE);
+        }
+        return TRUE;
 }
 
 /*
@@ -935,16 +1691,16 @@ _vte_boa_write (VteBoa *boa, gsize offset, const char *data)
            to make sure that an empty block (e.g. after a previous write failure) is always invalid,
            and to make unit testing easier */
         _vte_overwrite_counter_t overwrite_counter = 1;
-
-        /* The helper buffer should be large enough to contain a whole snake block,
-         * and also large enough to compress data that actually grows bigger during compression. */
-        char *buf = g_newa(char, MAX(VTE_SNAKE_BLOCKSIZE,
-                                     VTE_BLOCK_DATALENGTH_SIZE + VTE_OVERWRITE_COUNTER_SIZE + boa->compressBound));
+        VteBoaJob *job;
 
         g_assert_cmpuint (offset, >=, boa->tail);
         g_assert_cmpuint (offset, <=, boa->head);
         g_assert_cmpuint (offset % VTE_BOA_BLOCKSIZE, ==, 0);
 
+        _vte_boa_flush (boa, FALSE);
+        if (boa->prefetch != NULL && boa->prefetch->offset == offset)
+                _vte_boa_prefetch_drop (boa);
+
         if (G_UNLIKELY (offset < boa->head)) {
                 /* Overwriting an existing block. This only happens around a window resize.
                  * We need to read back that block and verify its integrity to get the previous overwrite_counter,
@@ -952,8 +1708,15 @@ _vte_boa_write (VteBoa *boa, gsize offset, const char *data)
                  * Then the new block is encrypted with the new IV.
                  * This is to never reuse the same IV/nonce for encryption.
                  * In case of read failure, do our best to destroy that block (overwrite with zeros, then punch a hole)
-                 * and return, forcing this and all subsequent reads and writes to fail. */
-                if (G_UNLIKELY (!_vte_boa_read_with_overwrite_counter (boa, offset, NULL, &overwrite_counter))) {
+                 * and return, forcing this and all subsequent reads and writes to fail.
+                 * If the block isn't sealed yet, its job knows the overwrite_counter. */
+                job = _vte_boa_find_job (boa, offset);
+                if (job != NULL) {
+                        overwrite_counter = job->overwrite_counter;
+                } else if (G_UNLIKELY (!_vte_boa_read_with_overwrite_counter (boa, offset, NULL, &overwrite_counter))) {
+                        char *buf = g_newa(char, VTE_SNAKE_BLOCKSIZE);
+                        /* The hot blocks go first, so that the zeros are the newest */
+                        _vte_boa_spill (boa, 0);
                         /* Try to overwrite with explicit zeros */
                         memset (buf, 0, VTE_SNAKE_BLOCKSIZE);
                         _vte_snake_write (&boa->parent, OFFSET_BOA_TO_SNAKE(offset), buf, VTE_SNAKE_BLOCKSIZE);
@@ -964,24 +1727,27 @@ _vte_boa_write (VteBoa *boa, gsize offset, const char *data)
                 overwrite_counter++;
         }
 
-        _vte_block_datalength_t compressed_len;
-
-        /* Compress, or copy if uncompressable */
-        compressed_len = _vte_boa_compress (buf + VTE_BLOCK_DATALENGTH_SIZE + VTE_OVERWRITE_COUNTER_SIZE, boa->compressBound,
-                                            data, VTE_BOA_BLOCKSIZE);
-        if (G_UNLIKELY (compressed_len >= VTE_BOA_BLOCKSIZE)) {
-                memcpy (buf + VTE_BLOCK_DATALENGTH_SIZE + VTE_OVERWRITE_COUNTER_SIZE, data, VTE_BOA_BLOCKSIZE);
-                compressed_len = VTE_BOA_BLOCKSIZE;
-        }
-
-        *((_vte_block_datalength_t *) buf) = (_vte_block_datalength_t) compressed_len;
-        *((_vte_overwrite_counter_t *) (buf + VTE_BLOCK_DATALENGTH_SIZE)) = (_vte_overwrite_counter_t) overwrite_counter;
+        if (G_LIKELY (boa->async)) {
+                /* Don't let the worker fall behind too much */
+                if (g_queue_get_length (&boa->jobs) >= VTE_BOA_MAX_JOBS) {
+                        _vte_boa_job_wait ((VteBoaJob *) g_queue_peek_head (&boa->jobs));
+                        _vte_boa_flush (boa, FALSE);
+                }
 
-        /* Encrypt */
-        _vte_boa_encrypt (boa, offset, overwrite_counter, buf + VTE_BLOCK_DATALENGTH_SIZE + VTE_OVERWRITE_COUNTER_SIZE, compressed_len);
+                job = _vte_boa_job_new (boa, offset);
+                job->overwrite_counter = overwrite_counter;
+                memcpy (job->data, data, VTE_BOA_BLOCKSIZE);
+                g_queue_push_tail (&boa->jobs, job);
+                _vte_boa_job_push (job);
+        } else {
+                vte::base::Profile::Scope profile_scope{vte::base::Profile::Stage::eStreamCompress};
 
-        /* Write */
-        _vte_snake_write (&boa->parent, OFFSET_BOA_TO_SNAKE(offset), buf, VTE_BLOCK_DATALENGTH_SIZE + VTE_OVERWRITE_COUNTER_SIZE + compressed_len + VTE_CIPHER_TAG_SIZE);
+                /* The job's buffer is large enough to contain a whole snake block,
+                 * and also large enough to compress data that actually grows bigger during compression. */
+                job = _vte_boa_job_new (boa, offset);
+                job->len = _vte_boa_seal (boa, &boa->cipher, offset, overwrite_counter, data, job->buf);
+                _vte_boa_store (boa, job);
+        }
 
         if (G_LIKELY (offset == boa->head)) {
                 boa->head += VTE_BOA_BLOCKSIZE;
@@ -991,11 +1757,30 @@ _vte_boa_write (VteBoa *boa, gsize offset, const char *data)
 static void
 _vte_boa_advance_tail (VteBoa *boa, gsize offset)
 {
+        VteBoaJob *job;
+
         g_assert_cmpuint (offset, >=, boa->tail);
         g_assert_cmpuint (offset, <=, boa->head);
         g_assert_cmpuint (offset % VTE_BOA_BLOCKSIZE, ==, 0);
 
-        _vte_snake_advance_tail (&boa->parent, OFFSET_BOA_TO_SNAKE(offset));
+        job = (VteBoaJob *) g_queue_peek_head (&boa->jobs);
+        if (G_UNLIKELY (job != NULL && job->offset < offset))
+                _vte_boa_flush (boa, TRUE);
+        if (boa->prefetch != NULL && boa->prefetch->offset < offset)
+                _vte_boa_prefetch_drop (boa);
+
+        /* The hot blocks that are dropped needn't go to the snake at all. The first ones
+         * at each offset come in increasing order, and after the snake's head, so if
+         * the snake has nothing to keep, it can restart where the kept hot blocks go. */
+        while ((job = (VteBoaJob *) g_queue_peek_head (&boa->hot)) != NULL && job->offset < offset) {
+                g_queue_pop_head (&boa->hot);
+                boa->hot_len -= job->len;
+                _vte_boa_job_free (job);
+        }
+        if (OFFSET_BOA_TO_SNAKE(offset) >= boa->parent.head)
+                _vte_snake_reset (&boa->parent, OFFSET_BOA_TO_SNAKE(offset));
+        else
+                _vte_snake_advance_tail (&boa->parent, OFFSET_BOA_TO_SNAKE(offset));
 
         boa->tail = offset;
 }
@@ -1012,6 +1797,22 @@ _vte_boa_head (VteBoa *boa)
         return boa->head;
 }
 
+/* The number of bytes stored. Blocks that are still being sealed are
+ * counted with their uncompressed size. */
+static gsize
+_vte_boa_size (VteBoa *boa)
+{
+        gsize size = _vte_snake_size (&boa->parent);
+        GList *l;
+
+        size += boa->hot_len;
+        for (l = boa->jobs.head; l != NULL; l = l->next) {
+                VteBoaJob *job = (VteBoaJob *) l->data;
+                size += g_atomic_int_get (&job->done) ? job->len : VTE_BOA_BLOCKSIZE;
+        }
+        return size;
+}
+
 static void
 _vte_boa_class_init (VteBoaClass *klass)
 {
@@ -1031,14 +1832,18 @@ _vte_boa_class_init (VteBoaClass *klass)
 
 /*
  * VteFileStream: Implement buffering/caching on top of VteBoa.
+ *
+ * Until the first block is full, the data is only in the write buffer, and
+ * the boa (with its key, cipher and temporary file) isn't created. A terminal
+ * that never has more than a block of history never needs one.
  */
 
 typedef struct _VteFileStream {
         GObject parent;
 
-        VteBoa *boa;
+        VteBoa *boa;  /* created on the first write of a block, or NULL */
 
-        char *rbuf;
+        char *rbuf;   /* allocated on the first read of a block, or NULL */
         /* Offset of the cached record, always a multiple of block size.
          * Use a value of 1 (or anything that's not a multiple of block size)
          * to denote if no record is cached. */
@@ -1066,13 +1871,25 @@ _vte_file_stream_new (void)
 static void
 _vte_file_stream_init (VteFileStream *stream)
 {
-        stream->boa = (VteBoa *)g_object_new (VTE_TYPE_BOA, NULL);
-
-        stream->rbuf = (char *)g_malloc(VTE_BOA_BLOCKSIZE);
         stream->wbuf = (char *)g_malloc(VTE_BOA_BLOCKSIZE);
         stream->rbuf_offset = 1;  /* Invalidate */
 }
 
+static VteBoa *
+_vte_file_stream_ensure_boa (VteFileStream *stream)
+{
+        if (G_LIKELY (stream->boa != NULL))
+                return stream->boa;
+
+        /* No block was written yet, so the stream's data is all in the write
+         * buffer, and the boa starts where the buffer's block does */
+        stream->boa = (VteBoa *)g_object_new (VTE_TYPE_BOA, NULL);
+        if (ALIGN_BOA(stream->tail) != 0)
+                _vte_boa_reset (stream->boa, ALIGN_BOA(stream->tail));
+
+        return stream->boa;
+}
+
 static void
 _vte_file_stream_finalize (GObject *object)
 {
@@ -1080,7 +1897,8 @@ _vte_file_stream_finalize (GObject *object)
 
         g_free(stream->rbuf);
         g_free(stream->wbuf);
-        g_object_unref (stream->boa);
+        if (stream->boa != NULL)
+                g_object_unref (stream->boa);
 
         G_OBJECT_CLASS (_vte_file_stream_parent_class)->finalize(object);
 }
@@ -1095,7 +1913,8 @@ _vte_file_stream_reset (VteStream *astream, gsize offset)
          * to catch if this expectation is broken within a block. */
         g_assert_cmpuint (offset, >=, stream->head);
 
-        _vte_boa_reset (stream->boa, offset_aligned);
+        if (stream->boa != NULL)
+                _vte_boa_reset (stream->boa, offset_aligned);
         stream->tail = stream->head = offset;
 
         /* When resetting at a non-aligned offset, initial bytes of the write buffer
@@ -1136,7 +1955,9 @@ _vte_file_stream_read (VteStream *astream, gsize offset, char *data, gsize len)
                 gsize l = MIN(VTE_BOA_BLOCKSIZE - MOD_BOA(offset), len);
                 gsize offset_aligned = ALIGN_BOA(offset);
                 if (offset_aligned != stream->rbuf_offset) {
-                        if (G_UNLIKELY (!_vte_boa_read (stream->boa, offset_aligned, stream->rbuf)))
+                        if (G_UNLIKELY (stream->rbuf == NULL))
+                                stream->rbuf = (char *)g_malloc(VTE_BOA_BLOCKSIZE);
+                        if (G_UNLIKELY (!_vte_boa_read (_vte_file_stream_ensure_boa (stream), offset_aligned, stream->rbuf)))
                                 return FALSE;
                         stream->rbuf_offset = offset_aligned;
                 }
@@ -1160,7 +1981,7 @@ _vte_file_stream_append (VteStream *astream, const char *data, gsize len)
                 memcpy(stream->wbuf + stream->wbuf_len, data, l);
                 stream->wbuf_len += l; data += l; len -= l;
                 if (stream->wbuf_len == VTE_BOA_BLOCKSIZE) {
-                        _vte_boa_write (stream->boa, ALIGN_BOA(stream->head), stream->wbuf);
+                        _vte_boa_write (_vte_file_stream_ensure_boa (stream), ALIGN_BOA(stream->head), stream->wbuf);
                         stream->wbuf_len = 0;
                 }
                 stream->head += l;
@@ -1183,7 +2004,7 @@ _vte_file_stream_truncate (VteStream *astream, gsize offset)
                  * intact, that is, read back the new partial last block to
                  * the write cache. */
                 gsize offset_aligned = ALIGN_BOA(offset);
-                if (G_UNLIKELY (!_vte_boa_read (stream->boa, offset_aligned, stream->wbuf))) {
+                if (G_UNLIKELY (!_vte_boa_read (_vte_file_stream_ensure_boa (stream), offset_aligned, stream->wbuf))) {
                         /* what now? */
                         memset(stream->wbuf, 0, VTE_BOA_BLOCKSIZE);
                 }
@@ -1204,7 +2025,7 @@ _vte_file_stream_advance_tail (VteStream *astream, gsize offset)
         g_assert_cmpuint (offset, >=, stream->tail);
         g_assert_cmpuint (offset, <=, stream->head);
 
-        if (ALIGN_BOA(offset) > ALIGN_BOA(stream->tail))
+        if (ALIGN_BOA(offset) > ALIGN_BOA(stream->tail) && stream->boa != NULL)
                 _vte_boa_advance_tail (stream->boa, ALIGN_BOA(offset));
 
         stream->tail = offset;
@@ -1226,6 +2047,14 @@ _vte_file_stream_head (VteStream *astream)
 	return stream->head;
 }
 
+static gsize
+_vte_file_stream_size (VteStream *astream)
+{
+	VteFileStream *stream = (VteFileStream *) astream;
+
+	return (stream->boa != NULL ? _vte_boa_size (stream->boa) : 0) + stream->wbuf_len;
+}
+
 static void
 _vte_file_stream_class_init (VteFileStreamClass *klass)
 {
@@ -1240,6 +2069,7 @@ _vte_file_stream_class_init (VteFileStreamClass *klass)
 	klass->advance_tail = _vte_file_stream_advance_tail;
 	klass->tail = _vte_file_stream_tail;
 	klass->head = _vte_file_stream_head;
+	klass->size = _vte_file_stream_size;
 }
 
 G_END_DECLS
@@ -1265,6 +2095,7 @@ G_END_DECLS
 /* Check for the snake's state, tail, head and contents */
 #define assert_snake(__snake, __state, __tail, __head, __contents) do { \
         char __buf[VTE_SNAKE_BLOCKSIZE]; \
+        const char *__block; \
         int __i; \
         g_assert_cmpuint (__snake->state, ==, __state); \
         g_assert_cmpuint (__snake->tail, ==, __tail); \
@@ -1273,6 +2104,8 @@ G_END_DECLS
         for (__i = __tail; __i < __head; __i += VTE_SNAKE_BLOCKSIZE) { \
                 g_assert (_vte_snake_read (__snake, __i, __buf)); \
                 g_assert (memcmp(__buf, __contents + __i - __tail, VTE_SNAKE_BLOCKSIZE) == 0); \
+                __block = _vte_snake_peek (__snake, __i); \
+                g_assert (__block == NULL || memcmp(__block, __buf, VTE_SNAKE_BLOCKSIZE) == 0); \
         } \
 } while (0)
 
@@ -1394,6 +2227,9 @@ test_snake (void)
         assert_file (snake->fd, "Duck......Chinchilla..........Ferret....");
         assert_snake (snake, 1, 0, 40, "Duck......Chinchilla..........Ferret....");
 
+        /* The size counts the lengths written, with overwrites replacing them */
+        g_assert_cmpuint (_vte_snake_size (snake), ==, 4 + 10 + 0 + 6);
+
         /* Start over */
         g_object_unref (snake);
         snake = (VteSnake *)g_object_new (VTE_TYPE_SNAKE, NULL);
@@ -1430,6 +2266,7 @@ test_snake (void)
         _vte_snake_advance_tail (snake, 30);
         assert_file (snake->fd, "Duck......Elephant............Ferret....");
         assert_snake (snake, 4, 30, 60, "Duck......Elephant..Ferret....");
+        g_assert_cmpuint (_vte_snake_size (snake), ==, 4 + 8 + 6);
 
         /* Stay in state 4 */
         _vte_snake_advance_tail (snake, 40);
@@ -1530,6 +2367,139 @@ test_boa (void)
         assert_snake (snake, 1, 250, 260, "\007\001ZEBRAAA\311");
         assert_boa (boa, 175, 182, "zebraaa");
 
+        /* A block recorded to be compressed with a codec that's not available can't be read */
+        char buf[VTE_SNAKE_BLOCKSIZE], data[VTE_BOA_BLOCKSIZE];
+        _vte_overwrite_counter_t overwrite_counter;
+        _vte_boa_write (boa, 182, "beeeeee");
+        g_assert (_vte_snake_read (snake, 260, buf));
+        g_assert (_vte_boa_unseal (&boa->cipher, 182, buf, buf + VTE_BLOCK_DATALENGTH_SIZE + VTE_OVERWRITE_COUNTER_SIZE, data, &overwrite_counter));
+        g_assert (memcmp (data, "beeeeee", VTE_BOA_BLOCKSIZE) == 0);
+        g_assert (_vte_snake_read (snake, 260, buf));
+        buf[0] |= VTE_BOA_CODEC_LZ4 << VTE_BLOCK_CODEC_SHIFT;
+        g_assert (!_vte_boa_unseal (&boa->cipher, 182, buf, buf + VTE_BLOCK_DATALENGTH_SIZE + VTE_OVERWRITE_COUNTER_SIZE, data, &overwrite_counter));
+
+        g_object_unref (boa);
+}
+
+/* Without encryption, the blocks keep their layout with a zero tag */
+static void
+test_boa_plain (void)
+{
+        VteBoa *boa;
+        VteSnake *snake;
+        char buf[100];
+
+        _vte_file_stream_set_encryption (VTE_STREAM_ENCRYPTION_NEVER);
+        boa = (VteBoa *)g_object_new (VTE_TYPE_BOA, NULL);
+        snake = (VteSnake *) &boa->parent;
+        _vte_file_stream_set_encryption (VTE_STREAM_ENCRYPTION_ALWAYS);
+
+        _vte_boa_write (boa, 0, "axolotl");
+        _vte_boa_write (boa, 7, "beeeeee");
+        /* Not assert_file(), which stops at the zero tags */
+        g_assert_cmpint (pread (snake->fd, buf, sizeof (buf), 0), ==, 20);
+        g_assert (memcmp (buf, "\007\001axolotl\000" "\004\0011b6e\000...", 20) == 0);
+        assert_boa (boa, 0, 14, "axolotl" "beeeeee");
+
+        _vte_boa_write (boa, 7, "buffalo");
+        g_assert_cmpint (pread (snake->fd, buf, sizeof (buf), 0), ==, 20);
+        g_assert (memcmp (buf, "\007\001axolotl\000" "\007\002buffalo\000", 20) == 0);
+        assert_boa (boa, 0, 14, "axolotl" "buffalo");
+
+        g_object_unref (boa);
+}
+
+/* Keeping the newest sealed blocks in memory */
+static void
+test_boa_hot (void)
+{
+        VteBoa *boa = (VteBoa *)g_object_new (VTE_TYPE_BOA, NULL);
+        VteSnake *snake = (VteSnake *) &boa->parent;
+
+        /* Up to two blocks of "axolotl" size */
+        boa->hot_max = 20;
+
+        _vte_boa_write (boa, 0, "axolotl");
+        _vte_boa_write (boa, 7, "buffalo");
+        assert_snake (snake, 1, 0, 0, "");
+        assert_boa (boa, 0, 14, "axolotl" "buffalo");
+        g_assert_cmpuint (_vte_boa_size (boa), ==, 20);
+
+        /* The oldest one spills */
+        _vte_boa_write (boa, 14, "cheetah");
+        assert_snake (snake, 1, 0, 10, "\007\001AXOLOTL\001");
+        assert_boa (boa, 0, 21, "axolotl" "buffalo" "cheetah");
+
+        /* Overwriting a hot block takes its overwrite counter */
+        _vte_boa_write (boa, 14, "dolphin");
+        assert_snake (snake, 1, 0, 20, "\007\001AXOLOTL\001" "\007\001BUFFALO\011");
+        assert_boa (boa, 0, 21, "axolotl" "buffalo" "dolphin");
+        _vte_boa_reset (boa, 21);
+        assert_snake (snake, 1, 30, 30, "");
+
+        /* Blocks dropped from memory never reach the snake */
+        _vte_boa_write (boa, 21, "echidna");
+        _vte_boa_write (boa, 28, "ferrets");
+        _vte_boa_advance_tail (boa, 28);
+        assert_snake (snake, 1, 40, 40, "");
+        assert_boa (boa, 28, 35, "ferrets");
+        _vte_boa_write (boa, 35, "giraffe");
+        _vte_boa_write (boa, 42, "hamster");
+        assert_snake (snake, 1, 40, 50, "\007\001FERRETS\041");
+        assert_boa (boa, 28, 49, "ferrets" "giraffe" "hamster");
+
+        g_object_unref (boa);
+}
+
+/* Sealing on the worker thread, and reading ahead */
+static void
+test_boa_async (void)
+{
+        VteBoa *boa = (VteBoa *)g_object_new (VTE_TYPE_BOA, NULL);
+        VteSnake *snake = (VteSnake *) &boa->parent;
+        char buf[VTE_BOA_BLOCKSIZE];
+
+        boa->async = TRUE;
+
+        /* Read your writes, also overwrites of blocks that are not written to the snake yet */
+        _vte_boa_write (boa, 0, "axolotl");
+        _vte_boa_write (boa, 7, "beeeeee");
+        assert_boa (boa, 0, 14, "axolotl" "beeeeee");
+        _vte_boa_write (boa, 7, "buffalo");
+        assert_boa (boa, 0, 14, "axolotl" "buffalo");
+
+        /* The file looks the same as with synchronous writes */
+        _vte_boa_flush (boa, TRUE);
+        assert_file (snake->fd, "\007\001AXOLOTL\001" "\007\002BUFFALO\012");
+        assert_snake (snake, 1, 0, 20, "\007\001AXOLOTL\001" "\007\002BUFFALO\012");
+        assert_boa (boa, 0, 14, "axolotl" "buffalo");
+
+        /* Reading forwards reads ahead the next block */
+        _vte_boa_write (boa, 14, "cheetah");
+        _vte_boa_flush (boa, TRUE);
+        g_assert_true (_vte_boa_read (boa, 0, buf));
+        g_assert_true (_vte_boa_read (boa, 7, buf));
+        g_assert_nonnull (boa->prefetch);
+        g_assert_cmpuint (boa->prefetch->offset, ==, 14);
+        g_assert_true (_vte_boa_read (boa, 14, buf));
+        g_assert (memcmp (buf, "cheetah", VTE_BOA_BLOCKSIZE) == 0);
+
+        /* Reading backwards reads ahead the previous one */
+        g_assert_true (_vte_boa_read (boa, 7, buf));
+        g_assert_nonnull (boa->prefetch);
+        g_assert_cmpuint (boa->prefetch->offset, ==, 0);
+        g_assert_true (_vte_boa_read (boa, 0, buf));
+        g_assert (memcmp (buf, "axolotl", VTE_BOA_BLOCKSIZE) == 0);
+
+        /* Overwriting the block being read ahead drops it */
+        g_assert_true (_vte_boa_read (boa, 7, buf));
+        g_assert_true (_vte_boa_read (boa, 14, buf));
+        g_assert_true (_vte_boa_read (boa, 7, buf));
+        g_assert_nonnull (boa->prefetch);
+        _vte_boa_write (boa, 0, "aardvrk");
+        g_assert_null (boa->prefetch);
+        assert_boa (boa, 0, 21, "aardvrk" "buffalo" "cheetah");
+
         g_object_unref (boa);
 }
 
@@ -1545,7 +2515,8 @@ test_stream (void)
         VteStream *astream = _vte_file_stream_new();
         VteFileStream *stream = (VteFileStream *) astream;
         _vte_file_stream_init (stream);
-        boa = stream->boa;
+        g_assert_null (stream->boa);
+        boa = _vte_file_stream_ensure_boa (stream);
         snake = (VteSnake *) &boa->parent;
 
         /* Append */
@@ -1758,6 +2729,9 @@ test_stream (void)
         g_object_unref (astream);
 }
 
+/* In vtestream-mem.h */
+static void test_mem_stream (void);
+
 int
 main (int argc, char **argv)
 {
@@ -1765,10 +2739,236 @@ main (int argc, char **argv)
 
         test_snake();
         test_boa();
+        test_boa_plain();
+        test_boa_hot();
+        test_boa_async();
         test_stream();
+        test_mem_stream();
 
         printf("vtestream-file tests passed :)\n");
         return 0;
 }
 
 #endif /* VTESTREAM_MAIN */
+
+/******************************************************************************************/
+
+#ifdef VTESTREAM_BENCH
+
+#include "bench.hh"
+
+/*
+ * Benchmark for the codecs: the input files are cut into boa blocks the way a
+ * stream is, and each block is compressed and uncompressed by itself with each
+ * of the available codecs, reporting the compression ratio and the throughput.
+ */
+
+static void
+bench_codec (VteBoaCodec codec, const char *data, gsize n_blocks, int repeat, std::string *json)
+{
+        vte::base::Benchmark compress{"blocks"}, uncompress{"blocks"};
+        unsigned int bound = _vte_boa_compressBound (VTE_BOA_BLOCKSIZE);
+        char *buf = (char *) g_malloc (n_blocks * bound);
+        unsigned int *lens = g_new (unsigned int, n_blocks);
+        char *out = (char *) g_malloc (VTE_BOA_BLOCKSIZE);
+        gsize compressed_bytes = 0;
+        gsize i;
+        int r;
+
+        for (r = 0; r < repeat; r++) {
+                gint64 start_time = g_get_monotonic_time ();
+                for (i = 0; i < n_blocks; i++)
+                        lens[i] = _vte_boa_codec_compress (codec, buf + i * bound, bound,
+                                                           data + i * VTE_BOA_BLOCKSIZE, VTE_BOA_BLOCKSIZE);
+                compress.add (g_get_monotonic_time () - start_time, n_blocks * VTE_BOA_BLOCKSIZE, n_blocks);
+
+                start_time = g_get_monotonic_time ();
+                for (i = 0; i < n_blocks; i++) {
+                        /* Blocks that don't compress are stored as they are */
+                        if (G_UNLIKELY (lens[i] >= VTE_BOA_BLOCKSIZE))
+                                continue;
+                        g_assert_cmpuint (_vte_boa_codec_uncompress (codec, out, VTE_BOA_BLOCKSIZE, buf + i * bound, lens[i]),
+                                          ==, VTE_BOA_BLOCKSIZE);
+                }
+                uncompress.add (g_get_monotonic_time () - start_time, n_blocks * VTE_BOA_BLOCKSIZE, n_blocks);
+        }
+
+        for (i = 0; i < n_blocks; i++) {
+                if (lens[i] < VTE_BOA_BLOCKSIZE) {
+                        _vte_boa_codec_uncompress (codec, out, VTE_BOA_BLOCKSIZE, buf + i * bound, lens[i]);
+                        g_assert (memcmp (out, data + i * VTE_BOA_BLOCKSIZE, VTE_BOA_BLOCKSIZE) == 0);
+                }
+                compressed_bytes += VTE_BLOCK_DATALENGTH_SIZE + VTE_OVERWRITE_COUNTER_SIZE +
+                                    MIN (lens[i], VTE_BOA_BLOCKSIZE) + VTE_CIPHER_TAG_SIZE;
+        }
+
+        if (json == NULL) {
+                g_printerr ("\n%s: %" G_GSIZE_FORMAT " bytes to %" G_GSIZE_FORMAT " bytes, ratio %.2f\n",
+                            _vte_boa_codec_name (codec), n_blocks * VTE_BOA_BLOCKSIZE, compressed_bytes,
+                            (double) (n_blocks * VTE_BOA_BLOCKSIZE) / compressed_bytes);
+                g_printerr ("Compress:");
+                compress.print ();
+                g_printerr ("Uncompress:");
+                uncompress.print ();
+        } else {
+                json->append (json->size () > 1 ? ",{\"codec\":" : "{\"codec\":");
+                vte::base::Benchmark::append_json_string (*json, _vte_boa_codec_name (codec));
+                vte::base::Benchmark::append_format (*json, ",\"bytes\":%" G_GSIZE_FORMAT ",\"compressed_bytes\":%" G_GSIZE_FORMAT,
+                                                     n_blocks * VTE_BOA_BLOCKSIZE, compressed_bytes);
+                json->append (",\"compress\":");
+                compress.append_json (*json);
+                json->append (",\"uncompress\":");
+                uncompress.append_json (*json);
+                json->push_back ('}');
+        }
+
+        g_free (out);
+        g_free (lens);
+        g_free (buf);
+}
+
+/*
+ * Benchmark for VteFileStream: the input is appended in pieces the size of
+ * a typical batch of frozen rows, read back forwards and backwards the way
+ * scrolling through the history does, and truncated piece by piece.
+ */
+
+#define BENCH_STREAM_CHUNK_SIZE 1024
+
+static void
+bench_file_stream (const char *data, gsize len, int repeat, std::string *json)
+{
+        vte::base::Benchmark append{"chunks"}, read_forward{"chunks"}, read_backward{"chunks"}, truncate{"chunks"};
+        char *buf = (char *) g_malloc (BENCH_STREAM_CHUNK_SIZE);
+        gsize n_chunks = len / BENCH_STREAM_CHUNK_SIZE;
+        gsize bytes = n_chunks * BENCH_STREAM_CHUNK_SIZE;
+        gsize i;
+        int r;
+
+        for (r = 0; r < repeat; r++) {
+                VteStream *stream = _vte_file_stream_new ();
+
+                gint64 start_time = g_get_monotonic_time ();
+                for (i = 0; i < n_chunks; i++)
+                        _vte_stream_append (stream, data + i * BENCH_STREAM_CHUNK_SIZE, BENCH_STREAM_CHUNK_SIZE);
+                append.add (g_get_monotonic_time () - start_time, bytes, n_chunks);
+
+                start_time = g_get_monotonic_time ();
+                for (i = 0; i < n_chunks; i++) {
+                        g_assert (_vte_stream_read (stream, i * BENCH_STREAM_CHUNK_SIZE, buf, BENCH_STREAM_CHUNK_SIZE));
+                }
+                read_forward.add (g_get_monotonic_time () - start_time, bytes, n_chunks);
+
+                start_time = g_get_monotonic_time ();
+                for (i = n_chunks; i-- > 0; ) {
+                        g_assert (_vte_stream_read (stream, i * BENCH_STREAM_CHUNK_SIZE, buf, BENCH_STREAM_CHUNK_SIZE));
+                }
+                read_backward.add (g_get_monotonic_time () - start_time, bytes, n_chunks);
+
+                g_assert (memcmp (buf, data, BENCH_STREAM_CHUNK_SIZE) == 0);
+
+                start_time = g_get_monotonic_time ();
+                for (i = n_chunks; i-- > 0; )
+                        _vte_stream_truncate (stream, i * BENCH_STREAM_CHUNK_SIZE);
+                truncate.add (g_get_monotonic_time () - start_time, bytes, n_chunks);
+
+                g_object_unref (stream);
+        }
+
+        if (json == NULL) {
+                g_printerr ("\nFile stream: %" G_GSIZE_FORMAT " chunks of %d bytes\n",
+                            n_chunks, BENCH_STREAM_CHUNK_SIZE);
+                g_printerr ("Append:");
+                append.print ();
+                g_printerr ("Read forward:");
+                read_forward.print ();
+                g_printerr ("Read backward:");
+                read_backward.print ();
+                g_printerr ("Truncate:");
+                truncate.print ();
+        } else {
+                json->append (json->size () > 1 ? ",{\"stream\":\"file\"" : "{\"stream\":\"file\"");
+                json->append (",\"append\":");
+                append.append_json (*json);
+                json->append (",\"read_forward\":");
+                read_forward.append_json (*json);
+                json->append (",\"read_backward\":");
+                read_backward.append_json (*json);
+                json->append (",\"truncate\":");
+                truncate.append_json (*json);
+                json->push_back ('}');
+        }
+
+        g_free (buf);
+}
+
+int
+main (int argc, char **argv)
+{
+        gboolean json = FALSE;
+        int repeat = 1;
+        char **filenames = NULL;
+        GOptionEntry const entries[] = {
+                { "json", 'j', 0, G_OPTION_ARG_NONE, &json,
+                  "Output the results as JSON", nullptr },
+                { "repeat", 'r', 0, G_OPTION_ARG_INT, &repeat,
+                  "Repeat each measurement COUNT times", "COUNT" },
+                { G_OPTION_REMAINING, 0, 0, G_OPTION_ARG_FILENAME_ARRAY, &filenames,
+                  nullptr, nullptr },
+                { nullptr },
+        };
+        GOptionContext *context;
+        GError *error = NULL;
+        GByteArray *data;
+        std::string str;
+        guint len;
+        int codec, i;
+
+        context = g_option_context_new ("FILE… — stream benchmark");
+        g_option_context_add_main_entries (context, entries, nullptr);
+        if (!g_option_context_parse (context, &argc, &argv, &error) || filenames == NULL) {
+                g_printerr ("Failed to parse arguments: %s\n", error ? error->message : "No input files");
+                g_clear_error (&error);
+                g_option_context_free (context);
+                return EXIT_FAILURE;
+        }
+        g_option_context_free (context);
+
+        data = g_byte_array_new ();
+        for (i = 0; filenames[i] != NULL; i++) {
+                char *contents;
+                gsize len;
+
+                if (!g_file_get_contents (filenames[i], &contents, &len, &error)) {
+                        g_printerr ("%s\n", error->message);
+                        g_clear_error (&error);
+                        continue;
+                }
+                g_byte_array_append (data, (const guint8 *) contents, len);
+                g_free (contents);
+        }
+        g_strfreev (filenames);
+
+        /* Pad the last block like an unfinished one would be */
+        len = data->len;
+        g_byte_array_set_size (data, (len + VTE_BOA_BLOCKSIZE - 1) / VTE_BOA_BLOCKSIZE * VTE_BOA_BLOCKSIZE);
+        memset (data->data + len, 0, data->len - len);
+
+        if (json)
+                str.push_back ('[');
+        for (codec = 0; codec < VTE_BOA_CODEC_N; codec++) {
+                if (_vte_boa_codec_available ((VteBoaCodec) codec))
+                        bench_codec ((VteBoaCodec) codec, (const char *) data->data, data->len / VTE_BOA_BLOCKSIZE,
+                                     MAX (repeat, 1), json ? &str : NULL);
+        }
+        bench_file_stream ((const char *) data->data, data->len, MAX (repeat, 1), json ? &str : NULL);
+        if (json) {
+                str.append ("]\n");
+                g_print ("%s", str.c_str ());
+        }
+
+        g_byte_array_unref (data);
+        return EXIT_SUCCESS;
+}
+
+#endif /* VTESTREAM_BENCH */
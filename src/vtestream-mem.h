@@ -0,0 +1,377 @@
+/*
+ * Copyright © 2026 The VTE developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Included after vtestream-file.h, for the block size and the codecs. */
+
+G_BEGIN_DECLS
+
+/*
+ * VteMemStream: A stream kept in memory, for a bounded scrollback.
+ *
+ * Like the file stream, it buffers the data in blocks of VTE_BOA_BLOCKSIZE,
+ * but the full blocks go to an array from the one holding the tail on,
+ * rather than through the boa to a temporary file: no file I/O and no
+ * encryption, the data stays in the process like the writable rows do.
+ * Optionally the blocks are compressed with the boa's codec, if that
+ * makes them smaller; the last one read is kept uncompressed.
+ */
+
+typedef struct _VteMemBlock {
+        char *data;
+        unsigned int len;  /* compressed, or VTE_BOA_BLOCKSIZE if stored as is */
+} VteMemBlock;
+
+typedef struct _VteMemStream {
+        GObject parent;
+
+        gboolean compress;
+
+        GArray *blocks;     /* VteMemBlock, the full ones */
+        gsize blocks_offset; /* of the first of the blocks, always a multiple of block size */
+        gsize blocks_size;  /* the bytes the blocks take */
+
+        char *cbuf;         /* for compressing, allocated on the first full block, or NULL */
+        char *rbuf;         /* allocated on the first read of a compressed block, or NULL */
+        /* Offset of the cached block, or 1 if none, see VteFileStream */
+        gsize rbuf_offset;
+
+        char *wbuf;
+        gsize wbuf_len;
+
+        gsize head, tail;
+} VteMemStream;
+
+typedef VteStreamClass VteMemStreamClass;
+
+static GType _vte_mem_stream_get_type (void);
+#define VTE_TYPE_MEM_STREAM _vte_mem_stream_get_type ()
+
+G_DEFINE_TYPE (VteMemStream, _vte_mem_stream, VTE_TYPE_STREAM)
+
+VteStream *
+_vte_mem_stream_new (gboolean compress)
+{
+        VteMemStream *stream = (VteMemStream *) g_object_new (VTE_TYPE_MEM_STREAM, NULL);
+
+        stream->compress = compress;
+        return (VteStream *) stream;
+}
+
+static void
+_vte_mem_stream_init (VteMemStream *stream)
+{
+        stream->blocks = g_array_new (FALSE, FALSE, sizeof (VteMemBlock));
+        stream->wbuf = (char *)g_malloc(VTE_BOA_BLOCKSIZE);
+        stream->rbuf_offset = 1;  /* Invalidate */
+}
+
+/* Frees the blocks from @index on */
+static void
+_vte_mem_stream_drop_blocks (VteMemStream *stream, guint index)
+{
+        guint i;
+
+        for (i = index; i < stream->blocks->len; i++) {
+                VteMemBlock *block = &g_array_index (stream->blocks, VteMemBlock, i);
+                stream->blocks_size -= block->len;
+                g_free (block->data);
+        }
+        g_array_set_size (stream->blocks, MIN (index, stream->blocks->len));
+}
+
+static void
+_vte_mem_stream_finalize (GObject *object)
+{
+        VteMemStream *stream = (VteMemStream *) object;
+
+        _vte_mem_stream_drop_blocks (stream, 0);
+        g_array_free (stream->blocks, TRUE);
+        g_free(stream->cbuf);
+        g_free(stream->rbuf);
+        g_free(stream->wbuf);
+
+        G_OBJECT_CLASS (_vte_mem_stream_parent_class)->finalize(object);
+}
+
+/* Adds the full write buffer as the next block */
+static void
+_vte_mem_stream_push_block (VteMemStream *stream)
+{
+        VteMemBlock block;
+
+        block.len = G_MAXUINT;
+        if (stream->compress) {
+                if (G_UNLIKELY (stream->cbuf == NULL))
+                        stream->cbuf = (char *)g_malloc(_vte_boa_compressBound(VTE_BOA_BLOCKSIZE));
+                block.len = _vte_boa_codec_compress (VTE_BOA_CODEC_DEFAULT, stream->cbuf,
+                                                     _vte_boa_compressBound(VTE_BOA_BLOCKSIZE),
+                                                     stream->wbuf, VTE_BOA_BLOCKSIZE);
+        }
+        if (block.len < VTE_BOA_BLOCKSIZE) {
+                block.data = (char *)g_memdup(stream->cbuf, block.len);
+        } else {
+                block.len = VTE_BOA_BLOCKSIZE;
+                block.data = (char *)g_memdup(stream->wbuf, VTE_BOA_BLOCKSIZE);
+        }
+
+        g_array_append_val (stream->blocks, block);
+        stream->blocks_size += block.len;
+}
+
+/* Reads the block at @offset_aligned, below the write buffer's, to @data */
+static gboolean
+_vte_mem_stream_read_block (VteMemStream *stream, gsize offset_aligned, char *data)
+{
+        VteMemBlock const *block;
+
+        if (G_UNLIKELY (offset_aligned < stream->blocks_offset))
+                return FALSE;
+
+        block = &g_array_index (stream->blocks, VteMemBlock,
+                                (offset_aligned - stream->blocks_offset) / VTE_BOA_BLOCKSIZE);
+        if (block->len == VTE_BOA_BLOCKSIZE) {
+                memcpy (data, block->data, VTE_BOA_BLOCKSIZE);
+                return TRUE;
+        }
+
+        return _vte_boa_codec_uncompress (VTE_BOA_CODEC_DEFAULT, data, VTE_BOA_BLOCKSIZE,
+                                          block->data, block->len) == VTE_BOA_BLOCKSIZE;
+}
+
+static void
+_vte_mem_stream_reset (VteStream *astream, gsize offset)
+{
+	VteMemStream *stream = (VteMemStream *) astream;
+
+        g_assert_cmpuint (offset, >=, stream->head);
+
+        _vte_mem_stream_drop_blocks (stream, 0);
+        stream->blocks_offset = ALIGN_BOA(offset);
+        stream->tail = stream->head = offset;
+
+        /* As in the file stream, the start of the first block is never read back */
+#ifndef VTESTREAM_MAIN
+        memset(stream->wbuf, 0, MOD_BOA(offset));
+#else
+        memset(stream->wbuf, '-', MOD_BOA(offset));
+#endif
+
+        stream->wbuf_len = MOD_BOA(offset);
+        stream->rbuf_offset = 1;  /* Invalidate */
+}
+
+static gboolean
+_vte_mem_stream_read (VteStream *astream, gsize offset, char *data, gsize len)
+{
+	VteMemStream *stream = (VteMemStream *) astream;
+
+        /* Out of bounds request, see _vte_file_stream_read() */
+        if (G_UNLIKELY (offset < stream->tail || offset + len > stream->head || offset + len < offset)) {
+                if (G_LIKELY (offset + len <= stream->tail || offset >= stream->head))
+                        return FALSE;
+                g_assert_not_reached();
+        }
+
+        while (len && offset < ALIGN_BOA(stream->head)) {
+                gsize l = MIN(VTE_BOA_BLOCKSIZE - MOD_BOA(offset), len);
+                gsize offset_aligned = ALIGN_BOA(offset);
+                VteMemBlock const *block = &g_array_index (stream->blocks, VteMemBlock,
+                                                           (offset_aligned - stream->blocks_offset) / VTE_BOA_BLOCKSIZE);
+
+                if (block->len == VTE_BOA_BLOCKSIZE) {
+                        /* Stored as is, no need to go through the read buffer */
+                        memcpy(data, block->data + MOD_BOA(offset), l);
+                } else {
+                        if (offset_aligned != stream->rbuf_offset) {
+                                if (G_UNLIKELY (stream->rbuf == NULL))
+                                        stream->rbuf = (char *)g_malloc(VTE_BOA_BLOCKSIZE);
+                                if (G_UNLIKELY (!_vte_mem_stream_read_block (stream, offset_aligned, stream->rbuf)))
+                                        return FALSE;
+                                stream->rbuf_offset = offset_aligned;
+                        }
+                        memcpy(data, stream->rbuf + MOD_BOA(offset), l);
+                }
+                offset += l; data += l; len -= l;
+        }
+        if (len) {
+                g_assert_cmpuint (MOD_BOA(offset) + len, <=, stream->wbuf_len);
+                memcpy(data, stream->wbuf + MOD_BOA(offset), len);
+        }
+        return TRUE;
+}
+
+static void
+_vte_mem_stream_append (VteStream *astream, const char *data, gsize len)
+{
+	VteMemStream *stream = (VteMemStream *) astream;
+
+        while (len) {
+                gsize l = MIN(VTE_BOA_BLOCKSIZE - stream->wbuf_len, len);
+                memcpy(stream->wbuf + stream->wbuf_len, data, l);
+                stream->wbuf_len += l; data += l; len -= l;
+                if (stream->wbuf_len == VTE_BOA_BLOCKSIZE) {
+                        _vte_mem_stream_push_block (stream);
+                        stream->wbuf_len = 0;
+                }
+                stream->head += l;
+        }
+}
+
+static void
+_vte_mem_stream_truncate (VteStream *astream, gsize offset)
+{
+	VteMemStream *stream = (VteMemStream *) astream;
+
+        g_assert_cmpuint (offset, >=, stream->tail);
+        g_assert_cmpuint (offset, <=, stream->head);
+
+        if (offset < ALIGN_BOA(stream->head)) {
+                /* Back into the blocks: the new last one becomes the write buffer again */
+                gsize offset_aligned = ALIGN_BOA(offset);
+                if (G_UNLIKELY (!_vte_mem_stream_read_block (stream, offset_aligned, stream->wbuf)))
+                        memset(stream->wbuf, 0, VTE_BOA_BLOCKSIZE);
+                _vte_mem_stream_drop_blocks (stream, (offset_aligned - stream->blocks_offset) / VTE_BOA_BLOCKSIZE);
+
+                if (stream->rbuf_offset != 1 && stream->rbuf_offset >= offset_aligned)
+                        stream->rbuf_offset = 1;  /* Invalidate */
+        }
+        stream->wbuf_len = MOD_BOA(offset);
+	stream->head = offset;
+}
+
+static void
+_vte_mem_stream_advance_tail (VteStream *astream, gsize offset)
+{
+	VteMemStream *stream = (VteMemStream *) astream;
+        guint n, i;
+
+        g_assert_cmpuint (offset, >=, stream->tail);
+        g_assert_cmpuint (offset, <=, stream->head);
+
+        /* Free the blocks wholly before the new tail */
+        n = MIN ((ALIGN_BOA(offset) - stream->blocks_offset) / VTE_BOA_BLOCKSIZE, stream->blocks->len);
+        if (n > 0) {
+                for (i = 0; i < n; i++) {
+                        VteMemBlock *block = &g_array_index (stream->blocks, VteMemBlock, i);
+                        stream->blocks_size -= block->len;
+                        g_free (block->data);
+                }
+                g_array_remove_range (stream->blocks, 0, n);
+                stream->blocks_offset += n * VTE_BOA_BLOCKSIZE;
+        }
+
+        stream->tail = offset;
+}
+
+static gsize
+_vte_mem_stream_tail (VteStream *astream)
+{
+	VteMemStream *stream = (VteMemStream *) astream;
+
+	return stream->tail;
+}
+
+static gsize
+_vte_mem_stream_head (VteStream *astream)
+{
+	VteMemStream *stream = (VteMemStream *) astream;
+
+	return stream->head;
+}
+
+static gsize
+_vte_mem_stream_size (VteStream *astream)
+{
+	VteMemStream *stream = (VteMemStream *) astream;
+
+	return stream->blocks_size + stream->wbuf_len;
+}
+
+static void
+_vte_mem_stream_class_init (VteMemStreamClass *klass)
+{
+	GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+
+	gobject_class->finalize = _vte_mem_stream_finalize;
+
+	klass->reset = _vte_mem_stream_reset;
+	klass->read = _vte_mem_stream_read;
+	klass->append = _vte_mem_stream_append;
+	klass->truncate = _vte_mem_stream_truncate;
+	klass->advance_tail = _vte_mem_stream_advance_tail;
+	klass->tail = _vte_mem_stream_tail;
+	klass->head = _vte_mem_stream_head;
+	klass->size = _vte_mem_stream_size;
+}
+
+G_END_DECLS
+
+/******************************************************************************************/
+
+#ifdef VTESTREAM_MAIN
+
+static void
+test_mem_stream (void)
+{
+        char buf[8];
+
+        for (int compress = 0; compress <= 1; compress++) {
+                VteStream *astream = _vte_mem_stream_new (compress);
+                VteMemStream *stream = (VteMemStream *) astream;
+
+                /* Append */
+                stream_append (astream, "axolot");
+                g_assert_cmpuint (stream->blocks->len, ==, 0);
+                assert_stream (astream, 0, 6, "axolot");
+
+                stream_append (astream, "l" "beeeees" "cat");
+                g_assert_cmpuint (stream->blocks->len, ==, 2);
+                assert_stream (astream, 0, 17, "axolotl" "beeeees" "cat");
+                /* The fake codec gets the repetitions down to 6 bytes */
+                g_assert_cmpuint (_vte_stream_size (astream), ==, compress ? 7 + 6 + 3 : 17);
+                g_assert (_vte_stream_read (astream, 8, buf, 3));
+                g_assert (memcmp (buf, "eee", 3) == 0);
+
+                /* Truncate, back into a block */
+                _vte_stream_truncate (astream, 10);
+                g_assert_cmpuint (stream->blocks->len, ==, 1);
+                assert_stream (astream, 0, 10, "axolotl" "bee");
+                stream_append (astream, "eeee" "cat");
+                assert_stream (astream, 0, 17, "axolotl" "beeeeee" "cat");
+
+                /* The blocks before the tail are dropped */
+                _vte_stream_advance_tail (astream, 9);
+                g_assert_cmpuint (stream->blocks->len, ==, 1);
+                assert_stream (astream, 9, 17, "eeeeecat");
+                g_assert (!_vte_stream_read (astream, 2, buf, 3));
+                _vte_stream_advance_tail (astream, 15);
+                g_assert_cmpuint (stream->blocks->len, ==, 0);
+                assert_stream (astream, 15, 17, "at");
+
+                /* Reset to an unaligned offset */
+                _vte_stream_reset (astream, 178);
+                assert_stream (astream, 178, 178, "");
+                stream_append (astream, "raaa" "zebra");
+                assert_stream (astream, 178, 187, "raaa" "zebra");
+                _vte_stream_truncate (astream, 180);
+                assert_stream (astream, 178, 180, "ra");
+
+                g_object_unref (astream);
+        }
+}
+
+#endif /* VTESTREAM_MAIN */
@@ -35,12 +35,28 @@ void _vte_stream_truncate (VteStream *stream, gsize offset);
 void _vte_stream_advance_tail (VteStream *stream, gsize offset);
 gsize _vte_stream_tail (VteStream *stream);
 gsize _vte_stream_head (VteStream *stream);
+/* The number of bytes the stream occupies in storage, e.g. after compression */
+gsize _vte_stream_size (VteStream *stream);
+
+/* Whether new file streams encrypt what they write to their temporary files */
+typedef enum _VteStreamEncryption {
+        VTE_STREAM_ENCRYPTION_ALWAYS,     /* the default */
+        VTE_STREAM_ENCRYPTION_AUTO,       /* unless the temporary directory is in memory */
+        VTE_STREAM_ENCRYPTION_NEVER
+} VteStreamEncryption;
+
+void _vte_file_stream_set_encryption (VteStreamEncryption encryption);
+VteStreamEncryption _vte_file_stream_get_encryption (void);
 
 /* Various streams */
 
 VteStream *
 _vte_file_stream_new (void);
 
+/* Kept in memory, with the full blocks compressed if @compress */
+VteStream *
+_vte_mem_stream_new (gboolean compress);
+
 G_END_DECLS
 
 #endif
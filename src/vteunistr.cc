@@ -50,7 +50,7 @@
  * form it.  That's what VteUnistrDecomp is.  That is the decomposition.
  *
  * We start giving new vteunistr's unique numbers starting at
- * %VTE_UNISTR_START+1 and going up.  We keep the decompositions in a GArray,
+ * %VTE_UNISTR_START+1 and going up.  We keep the decompositions in an array,
  * called unistr_decomp.  The first entry of the array is unused (that's why
  * we start from %VTE_UNISTR_START plus one).  The decomposition table provides
  * enough information to efficiently answer questions like "what's the first
@@ -61,23 +61,35 @@
  * Given a vteunistr and a gunichar, we have to walk over the entire
  * decomposition table to see if we have already registered (encoded) this
  * combination.  To make that operation fast, we use a reverse map, that is,
- * a GHashTable named unistr_comp.  The hash table maps a decomposition to its
- * encoded vteunistr value.  The value obviously fits in a pointer and does
- * not need memory allocation.  We also want to avoid allocating memory for
- * the key of the hash table entries, as we already have those decompositions
- * in the memory in the unistr_decomp array.  We cannot use direct pointers
- * though as when growing, the GArray may resize and move to a new memory
- * buffer, rendering all our pointers invalid.  For this reason, we keep the
- * index into the array as our hash table key.  When we want to perform a
- * lookup in the hash table, we insert the decomposition that we are searching
- * for as item zero in the unistr_decomp table, then lookup for an equal entry
- * of it in the hash table.  Finally, if the hash lookup fails, we add the new
- * decomposition to the lookup array and the hash table, and return the newly
- * encoded vteunistr value.
+ * an open-addressing hash table named unistr_comp.  Its slots hold indices
+ * into unistr_decomp (zero meaning empty), so a lookup is a linear probe over
+ * a flat array of guint32's, comparing the decompositions they point to.
+ * Entries are never removed from unistr_comp one by one; when the garbage
+ * collector below frees some decompositions, it rebuilds the table from the
+ * ones still alive.
+ *
+ * Garbage collection:
+ *
+ * vteunistr's are only ever stored in the cells of the writable rows of the
+ * rings; frozen rows are stored as UTF-8, and get new vteunistr's when they
+ * are thawed.  So the decompositions that are not reachable from any writable
+ * cell can be reclaimed.  _vte_unistr_gc_begin() starts a new mark epoch, the
+ * rings pass each of their cells to _vte_unistr_gc_mark(), which marks the
+ * whole prefix chain, and _vte_unistr_gc_end() puts the unmarked entries on a
+ * free list for reuse.  Since a reused value then means a different string,
+ * caches keyed by vteunistr have to be dropped when the value returned by
+ * _vte_unistr_get_generation() changes.
  */
 
 #define VTE_UNISTR_START 0x80000000
 
+/* Marks a decomposition that is on the free list; its prefix is the
+ * index of the next free one. */
+#define VTE_UNISTR_FREE_SUFFIX G_MAXUINT32
+
+/* Don't bother collecting until that many new decompositions were made */
+#define VTE_UNISTR_GC_THRESHOLD 4096
+
 static vteunistr unistr_next = VTE_UNISTR_START + 1;
 
 struct VteUnistrDecomp {
@@ -85,59 +97,180 @@ struct VteUnistrDecomp {
 	gunichar  suffix;
 };
 
-GArray     *unistr_decomp;
-GHashTable *unistr_comp;
+static struct VteUnistrDecomp *unistr_decomp;
+static guint32 *unistr_decomp_marks; /* the epoch that last marked each entry */
+static guint32 unistr_decomp_alloc_len;
 
-#define DECOMP_FROM_INDEX(i)	g_array_index (unistr_decomp, struct VteUnistrDecomp, (i))
+static guint32 *unistr_comp;
+static guint32 unistr_comp_mask;
+static guint32 unistr_comp_n_used;
+
+static guint32 unistr_free_list;     /* index of the first free entry, or 0 */
+static guint32 unistr_n_live;
+static guint32 unistr_n_since_gc;
+static guint32 unistr_gc_epoch;
+static guint32 unistr_generation;
+
+#define DECOMP_FROM_INDEX(i)	(unistr_decomp[(i)])
 #define DECOMP_FROM_UNISTR(s)	DECOMP_FROM_INDEX ((s) - VTE_UNISTR_START)
 
-static guint
-unistr_comp_hash (gconstpointer key)
+static inline guint32
+unistr_comp_hash (vteunistr prefix, gunichar suffix)
+{
+	guint32 h = prefix * 0x9E3779B1u ^ suffix;
+	h ^= h >> 15;
+	h *= 0x85EBCA77u;
+	return h ^ (h >> 13);
+}
+
+/* Returns the slot holding @prefix + @suffix, or the empty slot where it goes */
+static guint32 *
+unistr_comp_find (vteunistr prefix, gunichar suffix)
 {
-	struct VteUnistrDecomp *decomp;
-	decomp = &DECOMP_FROM_INDEX (GPOINTER_TO_UINT (key));
-	return decomp->prefix ^ decomp->suffix;
+	guint32 i = unistr_comp_hash (prefix, suffix);
+
+	for (;; i++) {
+		guint32 *slot = &unistr_comp[i & unistr_comp_mask];
+		if (*slot == 0 ||
+		    (DECOMP_FROM_INDEX (*slot).prefix == prefix &&
+		     DECOMP_FROM_INDEX (*slot).suffix == suffix))
+			return slot;
+	}
 }
 
-static gboolean
-unistr_comp_equal (gconstpointer a, gconstpointer b)
+static void
+unistr_comp_rebuild (guint32 n_slots)
 {
-	return 0 == memcmp (&DECOMP_FROM_INDEX (GPOINTER_TO_UINT (a)),
-			    &DECOMP_FROM_INDEX (GPOINTER_TO_UINT (b)),
-			    sizeof (struct VteUnistrDecomp));
+	guint32 i;
+
+	g_free (unistr_comp);
+	unistr_comp = g_new0 (guint32, n_slots);
+	unistr_comp_mask = n_slots - 1;
+	unistr_comp_n_used = 0;
+
+	for (i = 1; i < unistr_next - VTE_UNISTR_START; i++) {
+		if (DECOMP_FROM_INDEX (i).suffix == VTE_UNISTR_FREE_SUFFIX)
+			continue;
+		*unistr_comp_find (DECOMP_FROM_INDEX (i).prefix, DECOMP_FROM_INDEX (i).suffix) = i;
+		unistr_comp_n_used++;
+	}
 }
 
 vteunistr
 _vte_unistr_append_unichar (vteunistr s, gunichar c)
 {
-	struct VteUnistrDecomp decomp;
-	vteunistr ret = 0;
+	guint32 *slot;
+	guint32 i;
 
-	decomp.prefix = s;
-	decomp.suffix = c;
+	if (G_UNLIKELY (!unistr_comp))
+		unistr_comp_rebuild (256);
 
-	if (G_UNLIKELY (!unistr_decomp)) {
-		unistr_decomp = g_array_new (FALSE, TRUE, sizeof (struct VteUnistrDecomp));
-		g_array_set_size (unistr_decomp, 1);
-		unistr_comp = g_hash_table_new (unistr_comp_hash, unistr_comp_equal);
+	slot = unistr_comp_find (s, c);
+	if (G_LIKELY (*slot != 0))
+		return *slot + VTE_UNISTR_START;
+
+	/* sanity check to avoid OOM */
+	if (G_UNLIKELY (_vte_unistr_strlen (s) > 10 || unistr_n_live >= 100000))
+		return s;
+
+	if (unistr_free_list != 0) {
+		i = unistr_free_list;
+		unistr_free_list = DECOMP_FROM_INDEX (i).prefix;
 	} else {
-		DECOMP_FROM_INDEX (0) = decomp;
-		ret = GPOINTER_TO_UINT (g_hash_table_lookup (unistr_comp, GUINT_TO_POINTER (0)));
+		i = unistr_next++ - VTE_UNISTR_START;
+		if (i >= unistr_decomp_alloc_len) {
+			unistr_decomp_alloc_len = MAX (unistr_decomp_alloc_len * 2, 256);
+			unistr_decomp = g_renew (struct VteUnistrDecomp, unistr_decomp, unistr_decomp_alloc_len);
+			unistr_decomp_marks = g_renew (guint32, unistr_decomp_marks, unistr_decomp_alloc_len);
+		}
+	}
+
+	DECOMP_FROM_INDEX (i).prefix = s;
+	DECOMP_FROM_INDEX (i).suffix = c;
+	unistr_decomp_marks[i] = unistr_gc_epoch;
+	unistr_n_live++;
+	unistr_n_since_gc++;
+
+	*slot = i;
+	/* Keep the load factor under 3/4 */
+	if (++unistr_comp_n_used * 4 > (unistr_comp_mask + 1) * 3)
+		unistr_comp_rebuild ((unistr_comp_mask + 1) * 2);
+
+	return i + VTE_UNISTR_START;
+}
+
+gboolean
+_vte_unistr_gc_wanted (void)
+{
+	return unistr_n_since_gc >= VTE_UNISTR_GC_THRESHOLD;
+}
+
+void
+_vte_unistr_gc_begin (void)
+{
+	unistr_gc_epoch++;
+}
+
+void
+_vte_unistr_gc_mark (vteunistr s)
+{
+	while (G_UNLIKELY (s >= VTE_UNISTR_START) && s < unistr_next) {
+		guint32 i = s - VTE_UNISTR_START;
+		if (unistr_decomp_marks[i] == unistr_gc_epoch)
+			return; /* and so is the rest of the chain */
+		unistr_decomp_marks[i] = unistr_gc_epoch;
+		s = DECOMP_FROM_INDEX (i).prefix;
 	}
+}
+
+guint
+_vte_unistr_gc_end (void)
+{
+	guint32 i, n_freed = 0;
 
-	if (G_UNLIKELY (!ret)) {
-		/* sanity check to avoid OOM */
-		if (G_UNLIKELY (_vte_unistr_strlen (s) > 10 || unistr_next - VTE_UNISTR_START > 100000))
-			return s;
+	unistr_n_since_gc = 0;
 
-		ret = unistr_next++;
-		g_array_append_val (unistr_decomp, decomp);
-		g_hash_table_insert (unistr_comp,
-				     GUINT_TO_POINTER (ret - VTE_UNISTR_START),
-				     GUINT_TO_POINTER (ret));
+	for (i = 1; i < unistr_next - VTE_UNISTR_START; i++) {
+		if (unistr_decomp_marks[i] == unistr_gc_epoch ||
+		    DECOMP_FROM_INDEX (i).suffix == VTE_UNISTR_FREE_SUFFIX)
+			continue;
+
+		DECOMP_FROM_INDEX (i).prefix = unistr_free_list;
+		DECOMP_FROM_INDEX (i).suffix = VTE_UNISTR_FREE_SUFFIX;
+		unistr_free_list = i;
+		n_freed++;
 	}
 
-	return ret;
+	if (n_freed == 0)
+		return 0;
+
+	unistr_n_live -= n_freed;
+	unistr_generation++;
+
+	/* Shrink the table along with the live set, but not below its
+	 * initial size */
+	guint32 n_slots = 256;
+	while (n_slots * 3 < unistr_n_live * 4 * 2)
+		n_slots *= 2;
+	unistr_comp_rebuild (n_slots);
+
+	return n_freed;
+}
+
+guint32
+_vte_unistr_get_generation (void)
+{
+	return unistr_generation;
+}
+
+gsize
+_vte_unistr_get_size (void)
+{
+	gsize size = unistr_decomp_alloc_len * (sizeof (struct VteUnistrDecomp) + sizeof (guint32));
+
+	if (unistr_comp != NULL)
+		size += (unistr_comp_mask + 1) * sizeof (guint32);
+	return size;
 }
 
 vteunistr
@@ -219,3 +352,17 @@ _vte_unistr_strlen (vteunistr s)
 	}
 	return len;
 }
+
+int
+_vte_unistr_utf8_len (vteunistr s)
+{
+	int len = 0;
+	g_return_val_if_fail (s < unistr_next, len);
+	while (G_UNLIKELY (s >= VTE_UNISTR_START)) {
+		struct VteUnistrDecomp *decomp;
+		decomp = &DECOMP_FROM_UNISTR (s);
+		len += g_unichar_to_utf8 (decomp->suffix, nullptr);
+		s = decomp->prefix;
+	}
+	return len + g_unichar_to_utf8 ((gunichar) s, nullptr);
+}
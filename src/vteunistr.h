@@ -39,8 +39,9 @@ G_BEGIN_DECLS
  * It can be used to store strings (of a base followed by combining
  * characters) where the code was designed to only allow one character.
  *
- * Strings are internalized efficiently and never freed.  No memory
- * management of vteunistr values is needed.
+ * Strings are internalized efficiently.  No memory management of
+ * vteunistr values is needed, but values no longer stored in any ring
+ * are reclaimed by _vte_unistr_gc_end(), see there.
  **/
 typedef guint32 vteunistr;
 
@@ -118,6 +119,74 @@ _vte_unistr_append_to_gunichars (vteunistr s, GArray *a);
 int
 _vte_unistr_strlen (vteunistr s);
 
+/**
+ * _vte_unistr_utf8_len:
+ * @s: a #vteunistr
+ *
+ * Counts the number of bytes _vte_unistr_append_to_string() appends for @s.
+ *
+ * Returns: length of @s in UTF-8 bytes.
+ **/
+int
+_vte_unistr_utf8_len (vteunistr s);
+
+/**
+ * _vte_unistr_gc_wanted:
+ *
+ * Returns: %TRUE if enough new strings were made since the last
+ *   collection to make another one worthwhile
+ **/
+gboolean
+_vte_unistr_gc_wanted (void);
+
+/**
+ * _vte_unistr_gc_begin:
+ *
+ * Starts a garbage collection.  Every #vteunistr that is still in use
+ * has to be passed to _vte_unistr_gc_mark() before _vte_unistr_gc_end().
+ **/
+void
+_vte_unistr_gc_begin (void);
+
+/**
+ * _vte_unistr_gc_mark:
+ * @s: a #vteunistr
+ *
+ * Marks @s, and the strings it was built from, as in use.
+ **/
+void
+_vte_unistr_gc_mark (vteunistr s);
+
+/**
+ * _vte_unistr_gc_end:
+ *
+ * Reclaims the strings that were not marked since _vte_unistr_gc_begin().
+ * Their values will be handed out again for other strings, which changes
+ * the value returned by _vte_unistr_get_generation().
+ *
+ * Returns: the number of strings reclaimed
+ **/
+guint
+_vte_unistr_gc_end (void);
+
+/**
+ * _vte_unistr_get_generation:
+ *
+ * Returns: a number that changes whenever values may have been reused
+ *   for other strings, so caches keyed by #vteunistr need to be dropped
+ **/
+guint32
+_vte_unistr_get_generation (void);
+
+/**
+ * _vte_unistr_get_size:
+ *
+ * Returns: the bytes the strings take on the heap, which all terminals
+ *   share
+ **/
+gsize
+_vte_unistr_get_size (void);
+
 G_END_DECLS
 
 #endif
@@ -250,6 +250,8 @@ Widget::map() noexcept
 {
         if (m_event_window)
                 gdk_window_show_unraised(m_event_window);
+
+        m_terminal->widget_map();
 }
 
 void
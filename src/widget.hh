@@ -133,6 +133,7 @@ public:
         inline auto pty() const noexcept { return m_pty.get(); }
 
         void feed(std::string_view const& str) { terminal()->feed(str); }
+        void feed(GBytes* bytes) { terminal()->feed(bytes); }
         void feed_child(std::string_view const& str) { terminal()->feed_child(str); }
         void feed_child_binary(std::string_view const& str) { terminal()->feed_child_binary(str); }
 